@@ -133,6 +133,9 @@ XRESULT BaseAntTweakBar::Init() {
     TwAddVarRW( Bar_General, "TesselationFrustumCulling", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.TesselationFrustumCulling, nullptr );
     TwAddVarRW( Bar_General, "AtmosphericScattering", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.AtmosphericScattering, nullptr );
     TwAddVarRW( Bar_General, "SkeletalVertexNormals", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.ShowSkeletalVertexNormals, nullptr );
+    TwAddVarRW( Bar_General, "CompressGothicTextures", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.CompressGothicTextures, nullptr );
+    TwAddVarRW( Bar_General, "EnableSkeletalInstancing", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.EnableSkeletalInstancing, nullptr );
+    TwAddVarRW( Bar_General, "EnablePortalCulling", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.EnablePortalCulling, nullptr );
 
     TwType t;
     if ( FeatureLevel10Compatibility ) {
@@ -143,6 +146,7 @@ XRESULT BaseAntTweakBar::Init() {
     TwAddVarRW( Bar_General, "ShadowmapSize", t, &Engine::GAPI->GetRendererState().RendererSettings.ShadowMapSize, nullptr );
     TwAddVarRW( Bar_General, "WorldShadowRangeScale", TW_TYPE_FLOAT, &Engine::GAPI->GetRendererState().RendererSettings.WorldShadowRangeScale, nullptr );
     TwDefine( " General/WorldShadowRangeScale  step=0.01 min=0" );
+    TwAddVarRW( Bar_General, "EnableShadowCascades", TW_TYPE_BOOLCPP, &Engine::GAPI->GetRendererState().RendererSettings.EnableShadowCascades, nullptr );
 
     TwAddVarRW( Bar_General, "ShadowStrength", TW_TYPE_FLOAT, &Engine::GAPI->GetRendererState().RendererSettings.ShadowStrength, nullptr );
     TwDefine( " General/ShadowStrength  step=0.01 min=0" );
@@ -7,6 +7,7 @@ class BaseShadowedPointLight;
 class D3D11ConstantBuffer;
 class D3D11Texture;
 class D3D11VertexBuffer;
+class MyDirectDrawSurface7;
 class zCTexture;
 class zCVob;
 struct SkeletalMeshVisualInfo;
@@ -122,7 +123,12 @@ public:
 
     /** Draws a vertexarray, used for rendering gothics UI */
     virtual XRESULT DrawVertexArray( ExVertexStruct* vertices, unsigned int numVertices, unsigned int startVertex = 0, unsigned int stride = sizeof( ExVertexStruct ) ) = 0;
-    virtual XRESULT DrawVertexArrayMM( ExVertexStruct* vertices, unsigned int numVertices, unsigned int startVertex = 0, unsigned int stride = sizeof( ExVertexStruct ) ) = 0;
+
+    /** Queues a pretransformed trianglefan of gothics UI. Fans sharing the same state are drawn together. */
+    virtual XRESULT DrawTriangleFanBatched( ExVertexStruct* vertices, unsigned int numVertices, MyDirectDrawSurface7* texture ) { return XR_SUCCESS; };
+
+    /** Draws everything queued by DrawTriangleFanBatched */
+    virtual void FlushBatchedDraws() {};
 
     /** Puts the current world matrix into a CB and binds it to the given slot */
     virtual void SetupPerInstanceConstantBuffer( int slot = 1 ) {};
@@ -211,7 +217,7 @@ public:
     virtual void DrawFrameParticleMeshes( std::unordered_map<zCVob*, MeshVisualInfo*>& progMeshes ) {}
 
     /** Draws particle effects */
-    virtual void DrawFrameParticles( std::map<zCTexture*, std::vector<ParticleInstanceInfo>>& particles, std::map<zCTexture*, ParticleRenderInfo>& info ) {}
+    virtual void DrawFrameParticles( FrameParticleMap& particles, FrameParticleInfoMap& info ) {}
 
     virtual void DrawString( const std::string& str, float x, float y, const zFont* font, zColor& fontColor ) {};
 
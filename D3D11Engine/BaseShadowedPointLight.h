@@ -8,5 +8,11 @@ public:
 
     /** Called when a vob got removed from the world */
     virtual void OnVobRemovedFromWorld( BaseVobInfo* vob ) {};
+
+    /** Called when a vob changed its position */
+    virtual void OnVobMoved( BaseVobInfo* vob ) {};
+
+    /** Called when a vob got added to the world after loading */
+    virtual void OnVobAdded( BaseVobInfo* vob ) {};
 };
 
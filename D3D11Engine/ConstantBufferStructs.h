@@ -189,6 +189,9 @@ struct DS_ScreenQuadConstantBuffer {
     float SQ_ShadowAOStrength;
     float SQ_WorldAOStrength;
     float SQ_Pad;
+
+    /** Far sun-shadow cascade, only read by the shaders which sample it */
+    DirectX::XMFLOAT4X4 SQ_ShadowFarViewProj;
 };
 
 struct CloudConstantBuffer {
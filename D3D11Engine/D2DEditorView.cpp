@@ -67,6 +67,9 @@ D2DEditorView::D2DEditorView( D2DView* view, D2DSubView* parent ) : D2DSubView(
 	SelectedSomething = false;
 
 	Widgets = new WidgetContainer;
+
+	WatermarkVisible = false;
+	HelpTextRect = D2D1::RectF( 0, 0, 0, 0 );
 }
 
 
@@ -342,18 +345,28 @@ XRESULT D2DEditorView::InitControls() {
 
 /** Draws this sub-view */
 void D2DEditorView::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
-	// If the editor is not open, dont draw it. Slide it in otherwise.
-
 	std::wstring str;
 	if ( !Engine::GAPI->GetRendererState().RendererSettings.DisableWatermark ) {
 		// Draw GD3D11-Text
 		str = (L"Development preview\n" + Toolbox::ToWideChar( VERSION_STRING ));
 
 		MainView->GetBrush()->SetColor( D2D1::ColorF( 1, 1, 1, 0.5f ) );
-		MainView->GetRenderTarget()->DrawText( str.c_str(), str.length(), MainView->GetTextFormatBig(), D2D1::RectF( 0, 0, 300, 50 ), MainView->GetBrush() );
+		MainView->GetRenderTarget()->DrawText( str.c_str(), str.length(), MainView->GetTextFormatBig(), GetWatermarkRect(), MainView->GetBrush() );
 	}
 
+	// If the editor is not open, dont draw it
+	if ( !IsEnabled )
+		return;
+
+	// Draw mode-text
+	MainView->GetBrush()->SetColor( D2D1::ColorF( 1, 1, 1, 0.5f ) );
+	MainView->GetRenderTarget()->DrawText( HelpText.c_str(), HelpText.length(), MainView->GetTextFormatBig(), HelpTextRect, MainView->GetBrush() );
+
+	D2DSubView::Draw( clientRectAbs, deltaTime );
+}
 
+/** Slides the panel in and keeps the texts up to date */
+void D2DEditorView::Animate( float deltaTime ) {
 	D2D1_POINT_2F p;
 	p.y = 0;
 	if ( !IsEnabled ) {
@@ -367,20 +380,28 @@ void D2DEditorView::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
 			SetHidden( GetRect().right < 0 );
 			Parent->SetHidden( IsHidden() );
 		}
-
-		return;
 	} else {
 		p.x = Toolbox::lerp( MainPanel->GetPosition().x, 0, std::min( deltaTime * 8.0f, 1.0f ) );
 
+		// Snap, so it doesn't get invalidated forever while creeping towards 0
+		if ( fabsf( p.x ) < 0.5f )
+			p.x = 0.0f;
+
 		SetHidden( false );
 		Parent->SetHidden( IsHidden() );
+		MainPanel->SetPosition( p );
 	}
-	MainPanel->SetPosition( p );
 
+	// Watermark
+	bool watermark = !Engine::GAPI->GetRendererState().RendererSettings.DisableWatermark;
+	if ( watermark != WatermarkVisible ) {
+		WatermarkVisible = watermark;
+		MainView->Invalidate( GetWatermarkRect() );
+	}
 
-	// Draw subviews
-	if ( IsEnabled || MainPanel->GetPosition().x + 40.0f > -MainPanel->GetSize().width ) {
-		// Draw mode-text
+	// Mode-text, the position and time in it change all the time
+	std::wstring str;
+	if ( IsEnabled ) {
 		switch ( Mode ) {
 		case EM_IDLE:
 			str = L"Controls:\n"
@@ -411,14 +432,23 @@ void D2DEditorView::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
 		default:
 			str = L"";
 		}
+	}
 
-		MainView->GetBrush()->SetColor( D2D1::ColorF( 1, 1, 1, 0.5f ) );
-		float helpTextX = (MainPanel->GetRect().right + 20) + (MainPanel->GetPosition().x * 2.0f); // Pos.x is negative or zero, so it doubles up and hides the text
+	float helpTextX = (MainPanel->GetRect().right + 20) + (MainPanel->GetPosition().x * 2.0f); // Pos.x is negative or zero, so it doubles up and hides the text
+	D2D1_RECT_F helpRect = D2D1::RectF( helpTextX, 0, 900, 600 );
+	if ( str != HelpText || memcmp( &helpRect, &HelpTextRect, sizeof( helpRect ) ) != 0 ) {
+		MainView->Invalidate( HelpTextRect );
+		HelpText = str;
+		HelpTextRect = helpRect;
+		MainView->Invalidate( HelpTextRect );
+	}
 
-		MainView->GetRenderTarget()->DrawText( str.c_str(), str.length(), MainView->GetTextFormatBig(), D2D1::RectF( helpTextX, 0, 900, 600 ), MainView->GetBrush() );
+	D2DSubView::Animate( deltaTime );
+}
 
-		D2DSubView::Draw( clientRectAbs, deltaTime );
-	}
+/** Returns where the watermark is drawn */
+D2D1_RECT_F D2DEditorView::GetWatermarkRect() const {
+	return D2D1::RectF( 0, 0, 300, 50 );
 }
 
 /** Updates the editor */
@@ -1206,26 +1236,8 @@ void D2DEditorView::AddVegButtonPressed( SV_Button* sender, void* userdata ) {
 
 /** Traces the set of placed vegatation boxes */
 GVegetationBox* D2DEditorView::TraceVegetationBoxes( const DirectX::XMFLOAT3& wPos, const DirectX::XMFLOAT3& wDir ) {
-	float nearest = FLT_MAX;
-	GVegetationBox* b = nullptr;
-
-	for ( std::list<GVegetationBox*>::const_iterator it = Engine::GAPI->GetVegetationBoxes().begin(); it != Engine::GAPI->GetVegetationBoxes().end(); it++ ) {
-		if ( (*it)->GetWorldMeshPart() )
-			continue; // Only take the usual boxes
-
-		DirectX::XMFLOAT3 bbMin, bbMax;
-		(*it)->GetBoundingBox( &bbMin, &bbMax );
-
-		float t;
-		if ( Toolbox::IntersectBox( bbMin, bbMax, wPos, wDir, t ) ) {
-			if ( t < nearest ) {
-				b = (*it);
-				nearest = t;
-			}
-		}
-	}
-
-	return b;
+	// Only takes the usual boxes, not the ones placed on worldmesh parts
+	return Engine::GAPI->TraceVegetationBoxes( wPos, wDir );
 }
 
 /** Button to add a vegetation-volume was pressed */
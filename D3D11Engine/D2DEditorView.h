@@ -60,6 +60,9 @@ public:
     /** Updates the subview */
     void Update( float deltaTime );
 
+    /** Slides the panel in and keeps the texts up to date */
+    virtual void Animate( float deltaTime );
+
     /** Processes a window-message. Return false to stop the message from going to children */
     virtual bool OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPARAM lParam, const D2D1_RECT_F& clientRectAbs );
 
@@ -143,6 +146,14 @@ protected:
     /** Editor enabled? */
     bool IsEnabled;
 
+    /** Returns where the watermark is drawn */
+    D2D1_RECT_F GetWatermarkRect() const;
+
+    /** What is currently drawn, to only redraw when something changed */
+    bool WatermarkVisible;
+    std::wstring HelpText;
+    D2D1_RECT_F HelpTextRect;
+
     /** Main editor panel */
     SV_Panel* MainPanel;
     SV_TabControl* MainTabControl;
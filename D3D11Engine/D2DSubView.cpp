@@ -3,6 +3,8 @@
 #include "D2DView.h"
 #include "Logger.h"
 
+#include <cstring>
+
 D2DSubView::D2DSubView( D2DView* view, D2DSubView* parent ) {
     //Layer = nullptr;
     MainView = view;
@@ -49,7 +51,37 @@ void D2DSubView::AlignLeftTo( D2DSubView* view, float space ) {
 
 /** Sets the position and size of this sub-view */
 void D2DSubView::SetRect( const D2D1_RECT_F& rect ) {
+    if ( memcmp( &ViewRect, &rect, sizeof( rect ) ) == 0 )
+        return;
+
+    // Old and new area
+    Invalidate();
     ViewRect = rect;
+    Invalidate();
+}
+
+/** Marks this control to be redrawn */
+void D2DSubView::Invalidate() {
+    if ( Hidden )
+        return;
+
+    D2D1_RECT_F r = GetAbsoluteRect();
+    D2DView::ShrinkRect( &r, -SV_DEF_INVALIDATE_MARGIN );
+    MainView->Invalidate( r );
+}
+
+/** Returns the rect of this control in screen-space */
+D2D1_RECT_F D2DSubView::GetAbsoluteRect() const {
+    // Children are placed relative to the top-left corner of their parent
+    D2D1_RECT_F r = ViewRect;
+    for ( D2DSubView* p = Parent; p; p = p->Parent ) {
+        r.left += p->ViewRect.left;
+        r.right += p->ViewRect.left;
+        r.top += p->ViewRect.top;
+        r.bottom += p->ViewRect.top;
+    }
+
+    return r;
 }
 
 /** Returns the rect of this control */
@@ -80,17 +112,21 @@ void D2DSubView::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
     rectAbs.right = clientRectAbs.left + ViewRect.right;
     rectAbs.bottom = clientRectAbs.top + ViewRect.bottom;
 
-    // Draw children
+    // Draw children, skip the ones which are not touched by the current redraw
     for ( std::list<D2DSubView*>::const_iterator it = Children.cbegin(); it != Children.cend(); ++it ) {
+        if ( (*it)->IsHidden() )
+            continue;
+
         D2D1_RECT_F cr;
-        cr.left = clientRectAbs.left + (*it)->GetRect().left;
-        cr.top = clientRectAbs.top + (*it)->GetRect().top;
-        cr.right = clientRectAbs.left + (*it)->GetRect().right;
-        cr.bottom = clientRectAbs.top + (*it)->GetRect().bottom;
+        cr.left = rectAbs.left + (*it)->GetRect().left;
+        cr.top = rectAbs.top + (*it)->GetRect().top;
+        cr.right = rectAbs.left + (*it)->GetRect().right;
+        cr.bottom = rectAbs.top + (*it)->GetRect().bottom;
+        D2DView::ShrinkRect( &cr, -SV_DEF_INVALIDATE_MARGIN );
 
         //MainView->GetRenderTarget()->SetTransform(D2D1::Matrix3x2F::Translation(clientRectAbs.left,clientRectAbs.top));
 
-        if ( !(*it)->IsHidden() )
+        if ( MainView->NeedsRedraw( cr ) )
             (*it)->Draw( rectAbs, deltaTime );
     }
 
@@ -110,6 +146,16 @@ void D2DSubView::Update( float deltaTime ) {
     }
 }
 
+/** Called every frame before drawing */
+void D2DSubView::Animate( float deltaTime ) {
+    if ( Hidden )
+        return;
+
+    for ( std::list<D2DSubView*>::const_iterator it = Children.cbegin(); it != Children.cend(); ++it ) {
+        (*it)->Animate( deltaTime );
+    }
+}
+
 /** Processes a window-message. Return false to stop the message from going to children */
 bool D2DSubView::OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPARAM lParam, const D2D1_RECT_F& clientRectAbs ) {
     // Process children
@@ -120,9 +166,15 @@ bool D2DSubView::OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LP
         cr.right = clientRectAbs.left + (*it)->GetRect().right;
         cr.bottom = clientRectAbs.top + (*it)->GetRect().bottom;
 
-        if ( !(*it)->IsHidden() && !(*it)->IsDisabled() )
-            if ( !(*it)->OnWindowMessage( hWnd, msg, wParam, lParam, cr ) )
+        if ( !(*it)->IsHidden() && !(*it)->IsDisabled() ) {
+            if ( !(*it)->OnWindowMessage( hWnd, msg, wParam, lParam, cr ) ) {
+                // Children return first, so the first one to be set is the innermost
+                if ( !MainView->GetMessageConsumer() )
+                    MainView->SetMessageConsumer( *it );
+
                 return false;
+            }
+        }
     }
 
     return true;
@@ -138,6 +190,7 @@ void D2DSubView::AddChild( D2DSubView* child ) {
     child->SetLevel( Level + 1 );
     child->InitControls();
     Children.push_back( child );
+    child->Invalidate();
 }
 
 /** Deletes a child from this subview */
@@ -205,6 +258,12 @@ D2D1_POINT_2F D2DSubView::GetPosition() const {
 
 /** Sets if this control is hidden */
 void D2DSubView::SetHidden( bool hidden ) {
+    if ( Hidden == hidden )
+        return;
+
+    // Invalidate while visible, so the area gets cleared when hiding
+    Hidden = false;
+    Invalidate();
     Hidden = hidden;
 }
 
@@ -215,7 +274,10 @@ bool D2DSubView::IsHidden() const {
 
 /** Sets if this control is disabled */
 void D2DSubView::SetDisabled( bool disabled ) {
-    Disabled = disabled;
+    if ( Disabled != disabled ) {
+        Disabled = disabled;
+        Invalidate();
+    }
 }
 
 /** Returns if this control is disabled */
@@ -61,6 +61,16 @@ public:
     /** Updates the subview */
     virtual void Update( float deltaTime );
 
+    /** Called every frame before drawing, for controls which move or change on their own. They
+        have to invalidate what they change. */
+    virtual void Animate( float deltaTime );
+
+    /** Marks this control to be redrawn */
+    void Invalidate();
+
+    /** Returns the rect of this control in screen-space */
+    D2D1_RECT_F GetAbsoluteRect() const;
+
     /** Processes a window-message. Return false to stop the message from going to children */
     virtual bool OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPARAM lParam, const D2D1_RECT_F& clientRectAbs );
 
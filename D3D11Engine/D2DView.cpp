@@ -23,6 +23,9 @@ const D2D1::ColorF DefBackgroundColor2 = D2D1::ColorF( 0.0f, 0.0f, 0.0f, 1.0f );
 
 D2DView::D2DView() {
     RenderTarget = nullptr;
+    CacheTarget = nullptr;
+    IsRedrawingPartially = false;
+    MessageConsumer = nullptr;
     Brush = nullptr;
     MainSubView = nullptr;
     Factory = nullptr;
@@ -55,6 +58,7 @@ D2DView::~D2DView() {
     SAFE_RELEASE( BackgroundBrush );
     SAFE_RELEASE( DefaultTextFormat );
     SAFE_RELEASE( WriteFactory );
+    SAFE_RELEASE( CacheTarget );
     SAFE_RELEASE( RenderTarget );
     SAFE_RELEASE( Factory );
 }
@@ -142,6 +146,9 @@ XRESULT D2DView::Init( const INT2& initialResolution, ID3D11Texture2D* rendertar
 
 /** Create resources */
 HRESULT D2DView::InitResources() {
+    // Needs to exist before any control is created, so they use it
+    CreateCacheTarget();
+
     RenderTarget->CreateSolidColorBrush( D2D1::ColorF( D2D1::ColorF::White ), &Brush );
 
     // Create a linear gradient.
@@ -343,16 +350,94 @@ HRESULT D2DView::InitResources() {
     return XR_SUCCESS;
 }
 
+/** Creates the target the controls are cached in */
+HRESULT D2DView::CreateCacheTarget() {
+    SAFE_RELEASE( CacheTarget );
+
+    HRESULT hr = RenderTarget->CreateCompatibleRenderTarget( RenderTarget->GetSize(), &CacheTarget );
+    if ( FAILED( hr ) ) {
+        LogWarn() << "Failed to create the UI-cache, drawing the UI directly";
+        CacheTarget = nullptr;
+    }
+
+    DirtyRegion.SetBounds( UIRect( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height ) );
+    DirtyRegion.AddAll();
+    return hr;
+}
+
 /** Draws the view */
 void D2DView::Render( float deltaTime ) {
-    if ( !EditorView->IsHidden() ) {
+    if ( EditorView->IsHidden() )
+        return;
+
+    const D2D1_RECT_F screen = D2D1::RectF( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height );
+
+    // Let controls move, which invalidates what they touch
+    MainSubView->Animate( deltaTime );
+
+    if ( !CacheTarget ) {
         RenderTarget->BeginDraw();
 
         // Draw sub-views
-        MainSubView->Draw( D2D1::RectF( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height ), deltaTime );
+        MainSubView->Draw( screen, deltaTime );
 
         RenderTarget->EndDraw();
+        return;
     }
+
+    // Redraw only what changed into the cache. Anything invalidated while drawing goes into the next frame.
+    if ( !DirtyRegion.IsEmpty() ) {
+        const std::vector<UIRect> rects = DirtyRegion.GetRects();
+        DirtyRegion.Clear();
+
+        CacheTarget->BeginDraw();
+        for ( const UIRect& r : rects ) {
+            RedrawRect = D2D1::RectF( r.Left, r.Top, r.Right, r.Bottom );
+            IsRedrawingPartially = true;
+
+            CacheTarget->SetTransform( D2D1::Matrix3x2F::Identity() );
+            CacheTarget->PushAxisAlignedClip( RedrawRect, D2D1_ANTIALIAS_MODE_ALIASED );
+            CacheTarget->Clear( D2D1::ColorF( 0, 0, 0, 0 ) );
+
+            MainSubView->Draw( screen, deltaTime );
+
+            CacheTarget->SetTransform( D2D1::Matrix3x2F::Identity() );
+            CacheTarget->PopAxisAlignedClip();
+        }
+        IsRedrawingPartially = false;
+
+        if ( FAILED( CacheTarget->EndDraw() ) ) {
+            DirtyRegion.AddAll();
+        }
+    }
+
+    // Put the cached controls over the frame
+    Microsoft::WRL::ComPtr<ID2D1Bitmap> cache;
+    CacheTarget->GetBitmap( cache.GetAddressOf() );
+
+    RenderTarget->BeginDraw();
+    RenderTarget->SetTransform( D2D1::Matrix3x2F::Identity() );
+    RenderTarget->DrawBitmap( cache.Get(), screen, 1.0f, D2D1_BITMAP_INTERPOLATION_MODE_NEAREST_NEIGHBOR );
+    RenderTarget->EndDraw();
+}
+
+/** Marks the given part of the screen to be redrawn in the next frame */
+void D2DView::Invalidate( const D2D1_RECT_F& rectAbs ) {
+    DirtyRegion.Add( UIRect( rectAbs.left, rectAbs.top, rectAbs.right, rectAbs.bottom ) );
+}
+
+/** Redraws everything in the next frame */
+void D2DView::InvalidateAll() {
+    DirtyRegion.AddAll();
+}
+
+/** Returns whether something inside the given rect is being redrawn right now */
+bool D2DView::NeedsRedraw( const D2D1_RECT_F& rectAbs ) const {
+    if ( !IsRedrawingPartially )
+        return true;
+
+    return rectAbs.left < RedrawRect.right && RedrawRect.left < rectAbs.right
+        && rectAbs.top < RedrawRect.bottom && RedrawRect.top < rectAbs.bottom;
 }
 
 /** Updates the view */
@@ -364,6 +449,7 @@ void D2DView::Update( float deltaTime ) {
 
 /** Releases all resources needed to resize this view */
 XRESULT D2DView::PrepareResize() {
+    SAFE_RELEASE( CacheTarget );
     SAFE_RELEASE( RenderTarget );
 
     return XR_SUCCESS;
@@ -384,6 +470,8 @@ XRESULT D2DView::Resize( const INT2& initialResolution, ID3D11Texture2D* rendert
         return XR_FAILED;
     }
 
+    CreateCacheTarget();
+
     MainSubView->SetRect( D2D1::RectF( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height ) );
     EditorView->SetRect( D2D1::RectF( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height ) );
 
@@ -431,7 +519,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
         Rect.left -= Size;
         LinBrush->SetEndPoint( D2D1::Point2F( Rect.left, 0 ) );
         LinBrush->SetStartPoint( D2D1::Point2F( Rect.right, 0 ) );
-        RenderTarget->FillRectangle( &Rect, LinBrush );
+        GetRenderTarget()->FillRectangle( &Rect, LinBrush );
     }
 
     //Right edge
@@ -441,7 +529,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
         Rect.right += Size;
         LinBrush->SetEndPoint( D2D1::Point2F( Rect.right, 0 ) );
         LinBrush->SetStartPoint( D2D1::Point2F( Rect.left, 0 ) );
-        RenderTarget->FillRectangle( &Rect, LinBrush );
+        GetRenderTarget()->FillRectangle( &Rect, LinBrush );
     }
     //Upper edge
     if ( bTop ) {
@@ -450,7 +538,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
         Rect.top -= Size;
         LinBrush->SetEndPoint( D2D1::Point2F( 0, Rect.top ) );
         LinBrush->SetStartPoint( D2D1::Point2F( 0, Rect.bottom ) );
-        RenderTarget->FillRectangle( &Rect, LinBrush );
+        GetRenderTarget()->FillRectangle( &Rect, LinBrush );
     }
     //Bottom edge
     if ( bBottom ) {
@@ -459,7 +547,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
         Rect.bottom += Size;
         LinBrush->SetEndPoint( D2D1::Point2F( 0, Rect.bottom ) );
         LinBrush->SetStartPoint( D2D1::Point2F( 0, Rect.top ) );
-        RenderTarget->FillRectangle( &Rect, LinBrush );
+        GetRenderTarget()->FillRectangle( &Rect, LinBrush );
     }
     RadBrush->SetRadiusX( Size );
     RadBrush->SetRadiusY( Size );
@@ -475,7 +563,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
             Rect.top -= Size;
 
             RadBrush->SetCenter( D2D1::Point2F( Rect.right, Rect.bottom ) );
-            RenderTarget->FillRectangle( Rect, RadBrush );
+            GetRenderTarget()->FillRectangle( Rect, RadBrush );
         }
 
         if ( bRight && bTop ) {
@@ -487,7 +575,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
             Rect.top -= Size;
 
             RadBrush->SetCenter( D2D1::Point2F( Rect.left, Rect.bottom ) );
-            RenderTarget->FillRectangle( Rect, RadBrush );
+            GetRenderTarget()->FillRectangle( Rect, RadBrush );
         }
 
         if ( bRight && bBottom ) {
@@ -499,7 +587,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
             Rect.bottom += Size;
 
             RadBrush->SetCenter( D2D1::Point2F( Rect.left, Rect.top ) );
-            RenderTarget->FillRectangle( Rect, RadBrush );
+            GetRenderTarget()->FillRectangle( Rect, RadBrush );
         }
 
         if ( bLeft && bBottom ) {
@@ -511,7 +599,7 @@ void D2DView::DrawSmoothShadow( const D2D1_RECT_F* Rectangle,
             Rect.bottom += Size;
 
             RadBrush->SetCenter( D2D1::Point2F( Rect.right, Rect.top ) );
-            RenderTarget->FillRectangle( Rect, RadBrush );
+            GetRenderTarget()->FillRectangle( Rect, RadBrush );
         }
     }
 }
@@ -521,7 +609,16 @@ bool D2DView::OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPARA
     if ( !MainSubView )
         return false;
 
-    return MainSubView->OnWindowMessage( hWnd, msg, wParam, lParam, D2D1::RectF( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height ) );
+    MessageConsumer = nullptr;
+    bool result = MainSubView->OnWindowMessage( hWnd, msg, wParam, lParam, D2D1::RectF( 0, 0, RenderTarget->GetSize().width, RenderTarget->GetSize().height ) );
+
+    // Whoever took the message most likely looks different now
+    if ( MessageConsumer ) {
+        MessageConsumer->Invalidate();
+        MessageConsumer = nullptr;
+    }
+
+    return result;
 }
 
 float D2DView::GetLabelTextWidth( IDWriteTextLayout* layout, size_t length ) {
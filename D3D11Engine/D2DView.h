@@ -6,11 +6,15 @@
 #include <dwrite_1.h>
 
 #include "D2DMessageBox.h"
+#include "UIDirtyRegion.h"
 
 const D2D1_COLOR_F SV_DEF_INNER_LINE_COLOR = D2D1::ColorF( 0.3f, 0.3f, 0.6f, 1.0f );
 const D2D1_COLOR_F SV_DEF_DISABLED_COLOR = D2D1::ColorF( 0.3f, 0.3f, 0.6f, 0.3f );
 const float SV_DEF_SHADOW_RANGE = 19.0f;
 
+/** How far controls may draw outside of their rect, for shadows */
+const float SV_DEF_INVALIDATE_MARGIN = 20.0f;
+
 class D2DDialog;
 class D2DEditorView;
 class D2DSubView;
@@ -50,8 +54,23 @@ public:
     /** Shrinks a rectangle */
     static void ShrinkRect( D2D1_RECT_F* Rect, float Offset );
 
-    /** Returns the current rendertarget */
-    ID2D1RenderTarget* GetRenderTarget() const { return RenderTarget; }
+    /** Returns the rendertarget the controls draw to. That's the cache if there is one, resources
+        created on it can be used on the backbuffer as well. */
+    ID2D1RenderTarget* GetRenderTarget() const { return CacheTarget ? CacheTarget : RenderTarget; }
+
+    /** Marks the given part of the screen to be redrawn in the next frame */
+    void Invalidate( const D2D1_RECT_F& rectAbs );
+
+    /** Redraws everything in the next frame */
+    void InvalidateAll();
+
+    /** Returns whether something inside the given rect is being redrawn right now. Controls outside
+        of it don't need to draw. */
+    bool NeedsRedraw( const D2D1_RECT_F& rectAbs ) const;
+
+    /** Remembers the innermost control which took the current window-message */
+    void SetMessageConsumer( D2DSubView* view ) { MessageConsumer = view; }
+    D2DSubView* GetMessageConsumer() const { return MessageConsumer; }
 
     /** Returns the main brush */
     ID2D1SolidColorBrush* GetBrush() const { return Brush; }
@@ -108,8 +127,22 @@ protected:
     /** Checks dead message boxes and removes them */
     void CheckDeadMessageBoxes();
 
+    /** Creates the target the controls are cached in */
+    HRESULT CreateCacheTarget();
+
     ID2D1Factory* Factory;
     ID2D1RenderTarget* RenderTarget;
+
+    /** The controls are drawn into this and only the parts which changed get redrawn. Every frame
+        it is put over the backbuffer as a whole. */
+    ID2D1BitmapRenderTarget* CacheTarget;
+    UIDirtyRegion DirtyRegion;
+
+    /** Rect currently redrawn, everything is drawn if this is empty */
+    D2D1_RECT_F RedrawRect;
+    bool IsRedrawingPartially;
+
+    D2DSubView* MessageConsumer;
     IDWriteFactory1* WriteFactory;
 
     IDWriteTextFormat* DefaultTextFormat;
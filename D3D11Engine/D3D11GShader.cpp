@@ -6,6 +6,7 @@
 #include "D3D11ConstantBuffer.h"
 #include <d3dcompiler.h>
 #include "D3D11_Helpers.h"
+#include "D3D11ShaderManager.h"
 
 using namespace DirectX;
 
@@ -46,7 +47,7 @@ HRESULT D3D11GShader::CompileShaderFromFile( const CHAR* szFileName, LPCSTR szEn
     m.insert( m.begin(), makros.begin(), makros.end() );
 
     Microsoft::WRL::ComPtr<ID3DBlob> pErrorBlob;
-    hr = D3DCompileFromFile( Toolbox::ToWideChar( szFileName ).c_str(), &m[0], D3D_COMPILE_STANDARD_FILE_INCLUDE, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, &pErrorBlob );
+    hr = D3D11ShaderManager::CompileFromFile( szFileName, &m[0], szEntryPoint, szShaderModel, dwShaderFlags, ppBlobOut, &pErrorBlob );
     if ( FAILED( hr ) ) {
         LogInfo() << "Shader compilation failed!";
         if ( pErrorBlob.Get() ) {
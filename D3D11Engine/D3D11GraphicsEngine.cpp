@@ -15,10 +15,12 @@
 #include "D3D11PointLight.h"
 #include "D3D11ShaderManager.h"
 #include "D3D11VShader.h"
+#include "FrameArena.h"
 #include "GMesh.h"
 #include "GOcean.h"
 #include "GSky.h"
 #include "RenderToTextureBuffer.h"
+#include "StaticInstanceCache.h"
 #include "zCParticleFX.h"
 #include "zCDecal.h"
 #include "zCMaterial.h"
@@ -58,6 +60,9 @@ const int NUM_MIN_FRAME_SHADOW_UPDATES =
 4;  // Minimum lights to update per frame
 const int MAX_IMPORTANT_LIGHT_UPDATES = 1;
 
+/** Bounding radius assumed for skeletal meshes when culling them against a shadow cascade */
+const float SHADOW_CASCADE_SKELETAL_RADIUS = 500.0f;
+
 D3D11GraphicsEngine::D3D11GraphicsEngine() {
     DebugPointlight = nullptr;
     OutputWindow = nullptr;
@@ -68,6 +73,8 @@ D3D11GraphicsEngine::D3D11GraphicsEngine() {
 
     Effects = std::make_unique<D3D11Effect>();
     RenderingStage = DES_MAIN;
+    ActiveShadowCascade = nullptr;
+    SkinnedInstancingActive = false;
     PresentPending = false;
     SaveScreenshotNextFrame = false;
     LineRenderer = std::make_unique<D3D11LineRenderer>();
@@ -273,20 +280,6 @@ XRESULT D3D11GraphicsEngine::Init() {
     SetDebugName( TempParticlesVertexBuffer->GetShaderResourceView().Get(), "TempVertexBuffer->ShaderResourceView" );
     SetDebugName( TempParticlesVertexBuffer->GetVertexBuffer().Get(), "TempVertexBuffer->VertexBuffer" );
 
-    TempMorphedMeshSmallVertexBuffer = std::make_unique<D3D11VertexBuffer>();
-    TempMorphedMeshSmallVertexBuffer->Init(
-        nullptr, MORPHEDMESH_SMALL_BUFFER_SIZE, D3D11VertexBuffer::B_VERTEXBUFFER,
-        D3D11VertexBuffer::U_DYNAMIC, D3D11VertexBuffer::CA_WRITE );
-    SetDebugName( TempMorphedMeshSmallVertexBuffer->GetShaderResourceView().Get(), "TempVertexBuffer->ShaderResourceView" );
-    SetDebugName( TempMorphedMeshSmallVertexBuffer->GetVertexBuffer().Get(), "TempVertexBuffer->VertexBuffer" );
-
-    TempMorphedMeshBigVertexBuffer = std::make_unique<D3D11VertexBuffer>();
-    TempMorphedMeshBigVertexBuffer->Init(
-        nullptr, MORPHEDMESH_HIGH_BUFFER_SIZE, D3D11VertexBuffer::B_VERTEXBUFFER,
-        D3D11VertexBuffer::U_DYNAMIC, D3D11VertexBuffer::CA_WRITE );
-    SetDebugName( TempMorphedMeshBigVertexBuffer->GetShaderResourceView().Get(), "TempVertexBuffer->ShaderResourceView" );
-    SetDebugName( TempMorphedMeshBigVertexBuffer->GetVertexBuffer().Get(), "TempVertexBuffer->VertexBuffer" );
-
     TempHUDVertexBuffer = std::make_unique<D3D11VertexBuffer>();
     TempHUDVertexBuffer->Init(
         nullptr, HUD_BUFFER_SIZE, D3D11VertexBuffer::B_VERTEXBUFFER,
@@ -294,6 +287,20 @@ XRESULT D3D11GraphicsEngine::Init() {
     SetDebugName( TempHUDVertexBuffer->GetShaderResourceView().Get(), "TempVertexBuffer->ShaderResourceView" );
     SetDebugName( TempHUDVertexBuffer->GetVertexBuffer().Get(), "TempVertexBuffer->VertexBuffer" );
 
+    FFBatchRingBuffer = std::make_unique<D3D11VertexBuffer>();
+    FFBatchRingBuffer->Init(
+        nullptr, FF_BATCH_RING_BUFFER_SIZE, D3D11VertexBuffer::B_VERTEXBUFFER,
+        D3D11VertexBuffer::U_DYNAMIC, D3D11VertexBuffer::CA_WRITE );
+    SetDebugName( FFBatchRingBuffer->GetVertexBuffer().Get(), "FFBatchRingBuffer->VertexBuffer" );
+    FFBatchRingOffset = 0;
+
+    FFBatcher = std::make_unique<TriangleFanBatcher<ExVertexStruct, FixedFunctionBatchState>>( FF_BATCH_MAX_VERTICES,
+        [this]( const FixedFunctionBatchState& state, const ExVertexStruct* vertices, unsigned int numVertices ) {
+            DrawFixedFunctionBatch( state, vertices, numVertices );
+        } );
+
+    GlyphRuns = std::make_unique<GlyphRunCache>();
+
     DynamicInstancingBuffer = std::make_unique<D3D11VertexBuffer>();
     DynamicInstancingBuffer->Init(
         nullptr, INSTANCING_BUFFER_SIZE, D3D11VertexBuffer::B_VERTEXBUFFER,
@@ -350,16 +357,13 @@ XRESULT D3D11GraphicsEngine::Init() {
     SetActiveVertexShader( "VS_Ex" );
 
     DistortionTexture = std::make_unique<D3D11Texture>();
-    DistortionTexture->Init( "system\\GD3D11\\textures\\distortion2.dds" );
-
     NoiseTexture = std::make_unique<D3D11Texture>();
-    NoiseTexture->Init( "system\\GD3D11\\textures\\noise.dds" );
-
     WhiteTexture = std::make_unique<D3D11Texture>();
-    WhiteTexture->Init( "system\\GD3D11\\textures\\white.dds" );
+    D3D11Texture::InitFiles( { DistortionTexture.get(), NoiseTexture.get(), WhiteTexture.get() },
+        { "system\\GD3D11\\textures\\distortion2.dds", "system\\GD3D11\\textures\\noise.dds", "system\\GD3D11\\textures\\white.dds" } );
 
     InverseUnitSphereMesh = new GMesh;
-    InverseUnitSphereMesh->LoadMesh( "system\\GD3D11\\meshes\\icoSphere.obj" );
+    InverseUnitSphereMesh->LoadMeshAsync( "system\\GD3D11\\meshes\\icoSphere.obj" );
 
     // Create distance-buffers
     CreateConstantBuffer( (D3D11ConstantBuffer**)&InfiniteRangeConstantBuffer, nullptr, sizeof( float4 ) );
@@ -859,6 +863,14 @@ XRESULT D3D11GraphicsEngine::OnResize( INT2 newSize ) {
     SetDebugName( WorldShadowmap1->GetShaderResView().Get(), "WorldShadowmap1->ShaderResView" );
     SetDebugName( WorldShadowmap1->GetDepthStencilView().Get(), "WorldShadowmap1->DepthStencilView" );
 
+    WorldShadowmap2 = std::make_unique<RenderToDepthStencilBuffer>(
+        GetDevice().Get(), s, s, DXGI_FORMAT_R16_TYPELESS, nullptr, DXGI_FORMAT_D16_UNORM,
+        DXGI_FORMAT_R16_UNORM );
+    SetDebugName( WorldShadowmap2->GetTexture().Get(), "WorldShadowmap2->Texture" );
+    SetDebugName( WorldShadowmap2->GetShaderResView().Get(), "WorldShadowmap2->ShaderResView" );
+    SetDebugName( WorldShadowmap2->GetDepthStencilView().Get(), "WorldShadowmap2->DepthStencilView" );
+    SunShadowCascades.Invalidate();
+
     Engine::AntTweakBar->OnResize( newSize );
 
     return XR_SUCCESS;
@@ -943,12 +955,6 @@ XRESULT D3D11GraphicsEngine::OnBeginFrame() {
     }
     stagingTextures.clear();
 
-    auto& mipMaps = Engine::GAPI->GetMipMapGeneration();
-    for ( D3D11Texture* texture : mipMaps ) {
-        texture->GenerateMipMaps();
-    }
-    mipMaps.clear();
-
     Engine::GAPI->SetFrameProcessedTexturesReady();
     Engine::GAPI->LeaveResourceCriticalSection();
 
@@ -973,6 +979,13 @@ XRESULT D3D11GraphicsEngine::OnBeginFrame() {
         SetDebugName( WorldShadowmap1->GetShaderResView().Get(), "WorldShadowmap1->ShaderResView" );
         SetDebugName( WorldShadowmap1->GetDepthStencilView().Get(), "WorldShadowmap1->DepthStencilView" );
 
+        WorldShadowmap2 = std::make_unique<RenderToDepthStencilBuffer>(
+            GetDevice().Get(), s, s, DXGI_FORMAT_R16_TYPELESS, nullptr, DXGI_FORMAT_D16_UNORM, DXGI_FORMAT_R16_UNORM );
+        SetDebugName( WorldShadowmap2->GetTexture().Get(), "WorldShadowmap2->Texture" );
+        SetDebugName( WorldShadowmap2->GetShaderResView().Get(), "WorldShadowmap2->ShaderResView" );
+        SetDebugName( WorldShadowmap2->GetDepthStencilView().Get(), "WorldShadowmap2->DepthStencilView" );
+        SunShadowCascades.Invalidate();
+
         Engine::GAPI->GetRendererState().RendererSettings.WorldShadowRangeScale =
             Toolbox::GetRecommendedWorldShadowRangeScaleForSize( s );
 
@@ -1021,8 +1034,13 @@ XRESULT D3D11GraphicsEngine::OnBeginFrame() {
 
 /** Called when the game ended it's frame */
 XRESULT D3D11GraphicsEngine::OnEndFrame() {
+    FlushBatchedDraws();
+    GlyphRuns->EndFrame();
     Present();
 
+    // Everything allocated for this frame is gone now
+    FrameArena::EndFrame();
+
     Engine::GAPI->GetRendererState().RendererInfo.Timing.StopTotal();
     m_FrameLimiter->Wait();
     return XR_SUCCESS;
@@ -1610,6 +1628,7 @@ XRESULT D3D11GraphicsEngine::DrawVertexArray( ExVertexStruct* vertices,
     unsigned int numVertices,
     unsigned int startVertex,
     unsigned int stride ) {
+    FlushBatchedDraws();
     UpdateRenderStates();
     auto vShader = ActiveVS;
     // ShaderManager->GetVShader("VS_TransformedEx");
@@ -1637,36 +1656,108 @@ XRESULT D3D11GraphicsEngine::DrawVertexArray( ExVertexStruct* vertices,
     return XR_SUCCESS;
 }
 
-/** Draws a vertexarray, morphed mesh*/
-XRESULT D3D11GraphicsEngine::DrawVertexArrayMM( ExVertexStruct* vertices,
+/** Queues a pretransformed trianglefan of gothics UI */
+XRESULT D3D11GraphicsEngine::DrawTriangleFanBatched( ExVertexStruct* vertices,
     unsigned int numVertices,
-    unsigned int startVertex,
-    unsigned int stride ) {
+    MyDirectDrawSurface7* texture ) {
+    GothicRendererState& state = Engine::GAPI->GetRendererState();
 
-    // Most morphed heads can fit into <= 3072 vertices buffer but some requires larger so let's have 2 different buffers and choose the appropriate one
-    if ( numVertices > 3072 ) {
-        EnsureTempVertexBufferSize( TempMorphedMeshBigVertexBuffer, stride * numVertices );
-        TempMorphedMeshBigVertexBuffer->UpdateBuffer( vertices, stride * numVertices );
+    FixedFunctionBatchState key;
+    key.PipelineKey = GetPipelineKey( state.BlendState, state.RasterizerState, state.DepthState, ActiveVS.get(), ActivePS.get() );
+    key.Texture = texture;
+    key.VS = ActiveVS;
+    key.PS = ActivePS;
+    key.BlendState = state.BlendState;
+    key.DepthState = state.DepthState;
+    key.RasterizerState = state.RasterizerState;
+    key.GraphicsState = state.GraphicsState;
+
+    FFBatcher->AddFan( key, vertices, numVertices );
+    return XR_SUCCESS;
+}
 
-        UINT offset = 0;
-        UINT uStride = stride;
-        GetContext()->IASetVertexBuffers( 0, 1, TempMorphedMeshBigVertexBuffer->GetVertexBuffer().GetAddressOf(), &uStride, &offset );
-    } else {
-        EnsureTempVertexBufferSize( TempMorphedMeshSmallVertexBuffer, stride * numVertices );
-        TempMorphedMeshSmallVertexBuffer->UpdateBuffer( vertices, stride * numVertices );
+/** Draws everything queued by DrawTriangleFanBatched */
+void D3D11GraphicsEngine::FlushBatchedDraws() {
+    if ( FFBatcher )
+        FFBatcher->Flush();
+}
 
-        UINT offset = 0;
-        UINT uStride = stride;
-        GetContext()->IASetVertexBuffers( 0, 1, TempMorphedMeshSmallVertexBuffer->GetVertexBuffer().GetAddressOf(), &uStride, &offset );
+/** Draws the vertices of a batch using the state they were queued with */
+void D3D11GraphicsEngine::DrawFixedFunctionBatch( const FixedFunctionBatchState& batchState,
+    const ExVertexStruct* vertices,
+    unsigned int numVertices ) {
+    GothicRendererState& state = Engine::GAPI->GetRendererState();
+
+    // Gothic may have changed the state since the fans were queued, swap theirs in for the draw.
+    // Usually only the texture or the graphics-state changed, then the pipeline keys still match.
+    const bool swapPipeline = batchState.PipelineKey == 0
+        || batchState.PipelineKey != GetPipelineKey( state.BlendState, state.RasterizerState, state.DepthState, ActiveVS.get(), ActivePS.get() );
+
+    GothicBlendStateInfo blendState = state.BlendState;
+    GothicDepthBufferStateInfo depthState = state.DepthState;
+    GothicRasterizerStateInfo rasterizerState = state.RasterizerState;
+    GothicGraphicsState graphicsState = state.GraphicsState;
+    std::shared_ptr<D3D11VShader> vs = ActiveVS;
+    std::shared_ptr<D3D11PShader> ps = ActivePS;
+
+    // The copies keep their keys and cache-ids, they only need to be applied again
+    if ( swapPipeline ) {
+        state.BlendState = batchState.BlendState;
+        state.BlendState.StateDirty = true;
+        state.DepthState = batchState.DepthState;
+        state.DepthState.StateDirty = true;
+        state.RasterizerState = batchState.RasterizerState;
+        state.RasterizerState.StateDirty = true;
+        ActiveVS = batchState.VS;
+        ActivePS = batchState.PS;
+    }
+    state.GraphicsState = batchState.GraphicsState;
+
+    if ( batchState.Texture )
+        batchState.Texture->BindToSlot( 0 );
+
+    UpdateRenderStates();
+
+    // Bind the FF-Info to the first PS slot
+    ActivePS->GetConstantBuffer()[0]->UpdateBuffer( &state.GraphicsState );
+    ActivePS->GetConstantBuffer()[0]->BindToPixelShader( 0 );
+
+    SetupVS_ExMeshDrawCall();
+
+    // Append to the ring-buffer and only discard it once it's full
+    UINT stride = sizeof( ExVertexStruct );
+    const unsigned int capacity = FFBatchRingBuffer->GetSizeInBytes() / stride;
+    int mapFlags = D3D11VertexBuffer::M_WRITE_NO_OVERWRITE;
+    if ( FFBatchRingOffset + numVertices > capacity ) {
+        FFBatchRingOffset = 0;
+        mapFlags = D3D11VertexBuffer::M_WRITE_DISCARD;
     }
 
-    // Draw the mesh
-    GetContext()->Draw( numVertices, startVertex );
+    void* data;
+    UINT size;
+    if ( XR_SUCCESS == FFBatchRingBuffer->Map( mapFlags, &data, &size ) ) {
+        memcpy( reinterpret_cast<ExVertexStruct*>(data) + FFBatchRingOffset, vertices, numVertices * stride );
+        FFBatchRingBuffer->Unmap();
 
-    Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnTriangles +=
-        numVertices / 3;
+        UINT offset = 0;
+        GetContext()->IASetVertexBuffers( 0, 1, FFBatchRingBuffer->GetVertexBuffer().GetAddressOf(), &stride, &offset );
+        GetContext()->Draw( numVertices, FFBatchRingOffset );
 
-    return XR_SUCCESS;
+        FFBatchRingOffset += numVertices;
+        state.RendererInfo.FrameDrawnTriangles += numVertices / 3;
+    }
+
+    if ( swapPipeline ) {
+        state.BlendState = blendState;
+        state.BlendState.StateDirty = true;
+        state.DepthState = depthState;
+        state.DepthState.StateDirty = true;
+        state.RasterizerState = rasterizerState;
+        state.RasterizerState.StateDirty = true;
+        ActiveVS = vs;
+        ActivePS = ps;
+    }
+    state.GraphicsState = graphicsState;
 }
 
 /** Draws a vertexarray, indexed */
@@ -1675,7 +1766,7 @@ XRESULT D3D11GraphicsEngine::DrawIndexedVertexArray( ExVertexStruct* vertices,
     D3D11VertexBuffer* ib,
     unsigned int numIndices,
     unsigned int stride ) {
-
+    FlushBatchedDraws();
     UpdateRenderStates();
     auto vShader = ActiveVS;  // ShaderManager->GetVShader("VS_TransformedEx");
 
@@ -1715,6 +1806,7 @@ XRESULT D3D11GraphicsEngine::DrawVertexBufferFF( D3D11VertexBuffer* vb,
     unsigned int numVertices,
     unsigned int startVertex,
     unsigned int stride ) {
+    FlushBatchedDraws();
     SetupVS_ExMeshDrawCall();
 
     // Bind the FF-Info to the first PS slot
@@ -1845,6 +1937,42 @@ XRESULT  D3D11GraphicsEngine::DrawSkeletalVertexNormals( SkeletalVobInfo* vi,
 /** Draws a skeletal mesh */
 XRESULT  D3D11GraphicsEngine::DrawSkeletalMesh( SkeletalVobInfo* vi,
     const std::vector<XMFLOAT4X4>& transforms, float4 color, float fatness ) {
+    if ( SkinnedInstancingActive && (RenderingStage == DES_MAIN || RenderingStage == DES_SHADOWMAP) ) {
+        if ( transforms.empty() )
+            return XR_SUCCESS;
+
+        SkinnedInstanceData instance;
+        instance.BoneOffset = SkinnedInstances.AddPalette( &transforms[0]._11, static_cast<uint32_t>(transforms.size()) );
+        memcpy( instance.World, &Engine::GAPI->GetRendererState().TransformState.TransformWorld, sizeof( instance.World ) );
+        instance.Color[0] = color.x;
+        instance.Color[1] = color.y;
+        instance.Color[2] = color.z;
+        instance.Color[3] = color.w;
+        instance.Fatness = fatness;
+        instance.Pad[0] = instance.Pad[1] = 0;
+
+        // The texture has to be taken now, the models of a visual animate their textures one after another.
+        // The shadowmap doesn't need textures, so all models of a visual can share the draw call there.
+        for ( auto const& itm : dynamic_cast<SkeletalMeshVisualInfo*>(vi->VisualInfo)->SkeletalMeshes ) {
+            zCTexture* tex = nullptr;
+            if ( RenderingStage == DES_MAIN && itm.first ) {
+                tex = itm.first->GetAniTexture();
+            }
+
+            for ( SkeletalMeshInfo* mesh : itm.second ) {
+                SkinnedInstances.AddInstance( mesh, tex, instance );
+            }
+        }
+
+        // The attachments drawn next expect the pixel shader to be unbound, like below
+        if ( RenderingStage == DES_SHADOWMAP && ActivePS
+            && (Engine::GAPI->GetRendererState().GraphicsState.FF_GSwitches & GSWITCH_LINEAR_DEPTH) == 0 ) {
+            GetContext()->PSSetShader( nullptr, nullptr, 0 );
+            ActivePS = nullptr;
+        }
+        return XR_SUCCESS;
+    }
+
     if ( GetRenderingStage() == DES_SHADOWMAP_CUBE ) {
         SetActiveVertexShader( "VS_ExSkeletalCube" );
     } else {
@@ -1951,6 +2079,125 @@ XRESULT  D3D11GraphicsEngine::DrawSkeletalMesh( SkeletalVobInfo* vi,
     return XR_SUCCESS;
 }
 
+void D3D11GraphicsEngine::BeginSkinnedInstancing() {
+    SkinnedInstances.Clear();
+    SkinnedInstancingActive = Engine::GAPI->GetRendererState().RendererSettings.EnableSkeletalInstancing;
+}
+
+void D3D11GraphicsEngine::FlushSkinnedInstances() {
+    SkinnedInstancingActive = false;
+    if ( SkinnedInstances.IsEmpty() ) {
+        SkinnedInstances.Clear();
+        return;
+    }
+
+    SkinnedInstances.Build();
+    const std::vector<SkinnedInstanceData>& instances = SkinnedInstances.GetInstances();
+    const uint32_t numBones = SkinnedInstances.GetNumBones();
+
+    // Upload all bones at once
+    if ( !BonePaletteBuffer || BonePaletteBuffer->GetSizeInBytes() < numBones * sizeof( XMFLOAT4X4 ) ) {
+        // Leave some room, so a few more NPCs coming into view don't recreate it
+        const uint32_t capacity = numBones + 1024;
+
+        BonePaletteBuffer = std::make_unique<D3D11VertexBuffer>();
+        BonePaletteBuffer->Init(
+            nullptr, capacity * sizeof( XMFLOAT4X4 ), D3D11VertexBuffer::B_SHADER_RESOURCE,
+            D3D11VertexBuffer::U_DYNAMIC, D3D11VertexBuffer::CA_WRITE, "BonePaletteBuffer", sizeof( XMFLOAT4X4 ) );
+        SetDebugName( BonePaletteBuffer->GetShaderResourceView().Get(), "BonePaletteBuffer->ShaderResourceView" );
+    }
+    BonePaletteBuffer->UpdateBuffer( (void*)SkinnedInstances.GetPalette().data(), numBones * sizeof( XMFLOAT4X4 ) );
+
+    const UINT instanceBytes = static_cast<UINT>(instances.size() * sizeof( SkinnedInstanceData ));
+    if ( DynamicInstancingBuffer->GetSizeInBytes() < instanceBytes ) {
+        if ( Engine::GAPI->GetRendererState().RendererSettings.EnableDebugLog )
+            LogInfo() << "Instancing buffer too small (" << DynamicInstancingBuffer->GetSizeInBytes()
+            << "), need " << instanceBytes << " bytes. Recreating buffer.";
+
+        DynamicInstancingBuffer->Init(
+            nullptr, instanceBytes, D3D11VertexBuffer::B_VERTEXBUFFER,
+            D3D11VertexBuffer::U_DYNAMIC, D3D11VertexBuffer::CA_WRITE );
+
+        SetDebugName( DynamicInstancingBuffer->GetShaderResourceView().Get(), "DynamicInstancingBuffer->ShaderResourceView" );
+        SetDebugName( DynamicInstancingBuffer->GetVertexBuffer().Get(), "DynamicInstancingBuffer->VertexBuffer" );
+    }
+    DynamicInstancingBuffer->UpdateBuffer( (void*)instances.data(), instanceBytes );
+
+    SetActiveVertexShader( "VS_ExSkeletalInstanced" );
+
+    InfiniteRangeConstantBuffer->BindToPixelShader( 3 );
+
+    SetupVS_ExMeshDrawCall();
+    SetupVS_ExConstantBuffer();
+
+    GetContext()->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+    GetContext()->VSSetShaderResources( 0, 1, BonePaletteBuffer->GetShaderResourceView().GetAddressOf() );
+
+    ActiveVS->Apply();
+
+    // Same pixel shaders as DrawSkeletalMesh
+    bool linearDepth = (Engine::GAPI->GetRendererState().GraphicsState.FF_GSwitches & GSWITCH_LINEAR_DEPTH) != 0;
+    if ( linearDepth ) {
+        ActivePS = PS_LinDepth;
+        ActivePS->Apply();
+    } else if ( RenderingStage == DES_SHADOWMAP ) {
+        GetContext()->PSSetShader( nullptr, nullptr, 0 );
+        ActivePS = nullptr;
+    } else {
+        ActivePS = PS_LinDepth;
+    }
+
+    if ( RenderingStage == DES_MAIN && ActiveHDS ) {
+        GetContext()->DSSetShader( nullptr, nullptr, 0 );
+        GetContext()->HSSetShader( nullptr, nullptr, 0 );
+        ActiveHDS = nullptr;
+    }
+
+    const bool tesselationEnabled = Engine::GAPI->GetRendererState().RendererSettings.EnableTesselation;
+
+    for ( const SkinnedInstanceGroup& group : SkinnedInstances.GetGroups() ) {
+        SkeletalMeshInfo* mesh = (SkeletalMeshInfo*)group.Mesh;
+        zCTexture* tex = (zCTexture*)group.Texture;
+        if ( ActivePS && tex ) {
+            if ( !BindTextureNRFX( tex, true ) )
+                continue;
+        }
+
+        D3D11VertexBuffer* ib;
+        unsigned int numIndices;
+        if ( tesselationEnabled && !mesh->IndicesPNAEN.empty() ) {
+            ib = mesh->MeshIndexBufferPNAEN;
+            numIndices = mesh->IndicesPNAEN.size();
+        } else {
+            ib = mesh->MeshIndexBuffer;
+            numIndices = mesh->Indices.size();
+        }
+
+        UINT offsets[] = { 0, 0 };
+        UINT strides[] = { sizeof( ExSkelVertexStruct ), sizeof( SkinnedInstanceData ) };
+        ID3D11Buffer* buffers[] = {
+            mesh->MeshVertexBuffer->GetVertexBuffer().Get(),
+            DynamicInstancingBuffer->GetVertexBuffer().Get(),
+        };
+        GetContext()->IASetVertexBuffers( 0, 2, buffers, strides, offsets );
+
+        if ( sizeof( VERTEX_INDEX ) == sizeof( unsigned short ) ) {
+            GetContext()->IASetIndexBuffer( ib->GetVertexBuffer().Get(),
+                DXGI_FORMAT_R16_UINT, 0 );
+        } else {
+            GetContext()->IASetIndexBuffer( ib->GetVertexBuffer().Get(),
+                DXGI_FORMAT_R32_UINT, 0 );
+        }
+
+        GetContext()->DrawIndexedInstanced( numIndices, group.NumInstances, 0, 0, group.FirstInstance );
+
+        Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnTriangles +=
+            (numIndices / 3) * group.NumInstances;
+    }
+
+    SkinnedInstances.Clear();
+}
+
 /** Draws a batch of instanced geometry */
 XRESULT D3D11GraphicsEngine::DrawInstanced(
     D3D11VertexBuffer* vb, D3D11VertexBuffer* ib, unsigned int numIndices,
@@ -2108,67 +2355,35 @@ XRESULT D3D11GraphicsEngine::UnbindTexture( int slot ) {
 
 /** Recreates the renderstates */
 XRESULT D3D11GraphicsEngine::UpdateRenderStates() {
-    if ( Engine::GAPI->GetRendererState().BlendState.StateDirty &&
-        Engine::GAPI->GetRendererState().BlendState.Hash != FFBlendStateHash ) {
-        D3D11BlendStateInfo* state = (D3D11BlendStateInfo*)
-            GothicStateCache::s_BlendStateMap[Engine::GAPI->GetRendererState().BlendState];
-
-        if ( !state ) {
-            // Create new state
-            state =
-                new D3D11BlendStateInfo( Engine::GAPI->GetRendererState().BlendState );
+    GothicRendererState& state = Engine::GAPI->GetRendererState();
 
-            GothicStateCache::s_BlendStateMap[Engine::GAPI->GetRendererState().BlendState] = state;
+    // The keys are exact, a state matching the bound one doesn't even need a lookup
+    if ( state.BlendState.StateDirty ) {
+        if ( state.BlendState.Key != FFBlendStateKey ) {
+            FFBlendState = GetCachedState( state.BlendState )->State.Get();
+            FFBlendStateKey = state.BlendState.Key;
+            GetContext()->OMSetBlendState( FFBlendState.Get(), float4( 0, 0, 0, 0 ).toPtr(),
+                0xFFFFFFFF );
         }
-
-        FFBlendState = state->State.Get();
-        FFBlendStateHash = Engine::GAPI->GetRendererState().BlendState.Hash;
-
-        Engine::GAPI->GetRendererState().BlendState.StateDirty = false;
-        GetContext()->OMSetBlendState( FFBlendState.Get(), float4( 0, 0, 0, 0 ).toPtr(),
-            0xFFFFFFFF );
+        state.BlendState.StateDirty = false;
     }
 
-    if ( Engine::GAPI->GetRendererState().RasterizerState.StateDirty &&
-        Engine::GAPI->GetRendererState().RasterizerState.Hash !=
-        FFRasterizerStateHash ) {
-        D3D11RasterizerStateInfo* state = (D3D11RasterizerStateInfo*)
-            GothicStateCache::s_RasterizerStateMap[Engine::GAPI->GetRendererState().RasterizerState];
-
-        if ( !state ) {
-            // Create new state
-            state = new D3D11RasterizerStateInfo(
-                Engine::GAPI->GetRendererState().RasterizerState );
-
-            GothicStateCache::s_RasterizerStateMap[Engine::GAPI->GetRendererState().RasterizerState] = state;
+    if ( state.RasterizerState.StateDirty ) {
+        if ( state.RasterizerState.Key != FFRasterizerStateKey ) {
+            FFRasterizerState = GetCachedState( state.RasterizerState )->State.Get();
+            FFRasterizerStateKey = state.RasterizerState.Key;
+            GetContext()->RSSetState( FFRasterizerState.Get() );
         }
-
-        FFRasterizerState = state->State.Get();
-        FFRasterizerStateHash = Engine::GAPI->GetRendererState().RasterizerState.Hash;
-
-        Engine::GAPI->GetRendererState().RasterizerState.StateDirty = false;
-        GetContext()->RSSetState( FFRasterizerState.Get() );
+        state.RasterizerState.StateDirty = false;
     }
 
-    if ( Engine::GAPI->GetRendererState().DepthState.StateDirty &&
-        Engine::GAPI->GetRendererState().DepthState.Hash !=
-        FFDepthStencilStateHash ) {
-        D3D11DepthBufferState* state = (D3D11DepthBufferState*)
-            GothicStateCache::s_DepthBufferMap[Engine::GAPI->GetRendererState().DepthState];
-
-        if ( !state ) {
-            // Create new state
-            state = new D3D11DepthBufferState(
-                Engine::GAPI->GetRendererState().DepthState );
-
-            GothicStateCache::s_DepthBufferMap[Engine::GAPI->GetRendererState().DepthState] = state;
+    if ( state.DepthState.StateDirty ) {
+        if ( state.DepthState.Key != FFDepthStencilStateKey ) {
+            FFDepthStencilState = GetCachedState( state.DepthState )->State.Get();
+            FFDepthStencilStateKey = state.DepthState.Key;
+            GetContext()->OMSetDepthStencilState( FFDepthStencilState.Get(), 0 );
         }
-
-        FFDepthStencilState = state->State.Get();
-        FFDepthStencilStateHash = Engine::GAPI->GetRendererState().DepthState.Hash;
-
-        Engine::GAPI->GetRendererState().DepthState.StateDirty = false;
-        GetContext()->OMSetDepthStencilState( FFDepthStencilState.Get(), 0 );
+        state.DepthState.StateDirty = false;
     }
 
     return XR_SUCCESS;
@@ -2216,6 +2431,7 @@ XRESULT D3D11GraphicsEngine::OnStartWorldRendering() {
     RenderedVobs.clear();
     FrameWaterSurfaces.clear();
     FrameTransparencyMeshes.clear();
+    FrameTransparencyQueue.Clear();
 
     // TODO: TODO: Hack for texture caching!
     zCTextureCacheHack::NumNotCachedTexturesInFrame = 0;
@@ -2260,7 +2476,7 @@ XRESULT D3D11GraphicsEngine::OnStartWorldRendering() {
     DrawWaterSurfaces();
 
     // Draw light-shafts
-    DrawMeshInfoListAlphablended( FrameTransparencyMeshes );
+    DrawMeshInfoListAlphablended( FrameTransparencyMeshes, FrameTransparencyQueue );
 
     // Draw ghosts
     D3D11ENGINE_RENDER_STAGE oldStage = RenderingStage;
@@ -2283,7 +2499,7 @@ XRESULT D3D11GraphicsEngine::OnStartWorldRendering() {
     // Draw unlit decals 
     // TODO: Only get them once!
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawParticleEffects ) {
-        std::vector<zCVob*> decals;
+        FrameVector<zCVob*> decals;
         Engine::GAPI->GetVisibleDecalList( decals );
         // Draw stuff like candle-flames
         DrawDecalList( decals, false );
@@ -2553,11 +2769,13 @@ void D3D11GraphicsEngine::UpdateColorSpace_SwapChain4()
 
 /** Draws a list of mesh infos */
 XRESULT D3D11GraphicsEngine::DrawMeshInfoListAlphablended(
-    const std::vector<std::pair<MeshKey, MeshInfo*>>& list ) {
+    const std::vector<std::pair<MeshKey, MeshInfo*>>& list, TransparencyQueue& queue ) {
     if ( list.empty() ) {
         return XR_SUCCESS;
     }
 
+    queue.Build( Engine::RenderingThreadPool );
+
     SetDefaultStates();
 
     // Setup renderstates
@@ -2595,9 +2813,33 @@ XRESULT D3D11GraphicsEngine::DrawMeshInfoListAlphablended(
 
     int lastAlphaFunc = 0;
 
-    // Draw the list
-    for ( auto const& it : list ) {
-        int indicesNumMod = 1;
+    // Parts of a batch right behind each other in the index buffer go into one call
+    auto drawBatch = [&]( const TransparencyBatch& batch ) {
+        const std::vector<uint32_t>& items = queue.GetItems();
+        unsigned int first = 0;
+        unsigned int numIndices = 0;
+        for ( uint32_t i = batch.FirstItem; i < batch.FirstItem + batch.NumItems; i++ ) {
+            MeshInfo* mesh = list[items[i]].second;
+            if ( numIndices && first + numIndices == mesh->BaseIndexLocation ) {
+                numIndices += mesh->Indices.size();
+                continue;
+            }
+
+            if ( numIndices ) {
+                DrawVertexBufferIndexedUINT( nullptr, nullptr, numIndices, first );
+            }
+            first = mesh->BaseIndexLocation;
+            numIndices = mesh->Indices.size();
+        }
+
+        if ( numIndices ) {
+            DrawVertexBufferIndexedUINT( nullptr, nullptr, numIndices, first );
+        }
+    };
+
+    // Draw the list, the state of a batch is bound once
+    for ( const TransparencyBatch& batch : queue.GetBatches() ) {
+        const std::pair<MeshKey, MeshInfo*>& it = list[queue.GetItems()[batch.FirstItem]];
         if ( zCTexture* texture = it.first.Material->GetAniTexture() ) {
             MyDirectDrawSurface7* surface = texture->GetSurface();
             ID3D11ShaderResourceView* srv[3];
@@ -2644,9 +2886,8 @@ XRESULT D3D11GraphicsEngine::DrawMeshInfoListAlphablended(
             // Don't let the game unload the texture after some time
             texture->CacheIn( 0.6f );
 
-            // Draw the section-part
-            DrawVertexBufferIndexedUINT( nullptr, nullptr, it.second->Indices.size(),
-                it.second->BaseIndexLocation );
+            // Draw the section-parts
+            drawBatch( batch );
         }
     }
 
@@ -2659,11 +2900,9 @@ XRESULT D3D11GraphicsEngine::DrawMeshInfoListAlphablended(
 
     // Draw again, but only to depthbuffer this time to make them work with
     // fogging
-    for ( auto const& it : list ) {
-        if ( it.first.Material->GetAniTexture() != nullptr ) {
-            // Draw the section-part
-            DrawVertexBufferIndexedUINT( nullptr, nullptr, it.second->Indices.size(),
-                it.second->BaseIndexLocation );
+    for ( const TransparencyBatch& batch : queue.GetBatches() ) {
+        if ( list[queue.GetItems()[batch.FirstItem]].first.Material->GetAniTexture() != nullptr ) {
+            drawBatch( batch );
         }
     }
 
@@ -2725,7 +2964,7 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
 
                 // Check surface type
                 if ( worldMesh.first.Info->MaterialType == MaterialInfo::MT_Water ) {
-                    FrameWaterSurfaces[aniTex].push_back( worldMesh.second );
+                    FrameWaterSurfaces.emplace_back( aniTex, worldMesh.second );
                     continue;
                 }
 
@@ -2743,6 +2982,14 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
                 // Check for alphablending
                 if (worldMesh.first.Material->GetAlphaFunc() > zMAT_ALPHA_FUNC_NONE &&
                     worldMesh.first.Material->GetAlphaFunc() != zMAT_ALPHA_FUNC_TEST) {
+                    // The parts only know their section, sort by its center
+                    XMVECTOR center = (XMLoadFloat3( &renderItem->BoundingBox.Min ) + XMLoadFloat3( &renderItem->BoundingBox.Max )) * 0.5f;
+                    float distance;
+                    XMStoreFloat( &distance, XMVector3Length( center - Engine::GAPI->GetCameraPositionXM() ) );
+
+                    FrameTransparencyQueue.Add( distance,
+                        worldMesh.first.Material->GetAlphaFunc() == zMAT_ALPHA_FUNC_ADD ? TB_ADDITIVE : TB_ALPHA,
+                        worldMesh.first.Material, static_cast<uint32_t>(FrameTransparencyMeshes.size()) );
                     FrameTransparencyMeshes.push_back(worldMesh);
                 } else {
                     // Create a new pair using the animated texture
@@ -2880,9 +3127,15 @@ XRESULT D3D11GraphicsEngine::DrawWorldMesh( bool noTextures ) {
 
         if ( Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh > 2 ) {
             if ( !ActiveHDS ) {
-                DrawVertexBufferIndexed( mesh.second->MeshVertexBuffer,
-                    mesh.second->MeshIndexBuffer,
-                    mesh.second->Indices.size() );
+                if ( mesh.second->MeshVertexBuffer && mesh.second->MeshIndexBuffer ) {
+                    DrawVertexBufferIndexed( mesh.second->MeshVertexBuffer,
+                        mesh.second->MeshIndexBuffer,
+                        mesh.second->Indices.size() );
+                } else {
+                    // Only tesselated meshes have buffers of their own, draw its part of the wrapped mesh
+                    DrawVertexBufferIndexedUINT( meshInfo->MeshVertexBuffer, meshInfo->MeshIndexBuffer,
+                        mesh.second->Indices.size(), mesh.second->BaseIndexLocation );
+                }
             } else {
                 // Draw from mesh info
                 DrawVertexBufferIndexed( mesh.second->MeshVertexBuffer,
@@ -3015,7 +3268,9 @@ XRESULT D3D11GraphicsEngine::DrawWorldMeshW( bool noTextures ) {
 
             // Check surface type
             if ( info->MaterialType == MaterialInfo::MT_Water ) {
-                FrameWaterSurfaces[textureInfo.first] = textureInfo.second.second;
+                for ( WorldMeshInfo* mesh : textureInfo.second.second ) {
+                    FrameWaterSurfaces.emplace_back( textureInfo.first, mesh );
+                }
                 textureInfo.second.second.resize( 0 );
                 continue;
             }
@@ -3114,10 +3369,17 @@ XRESULT D3D11GraphicsEngine::DrawWorldMeshW( bool noTextures ) {
         }
 
         if ( ActiveHDS ) {
+            MeshInfo* wrappedMesh = Engine::GAPI->GetWrappedWorldMesh();
             for ( auto&& itr = textureInfo.second.second.begin(); itr != textureInfo.second.second.end(); itr++ ) {
-                DrawVertexBufferIndexed( (*itr)->MeshVertexBuffer,
-                    (*itr)->MeshIndexBuffer,
-                    (*itr)->Indices.size() );
+                if ( (*itr)->MeshVertexBuffer && (*itr)->MeshIndexBuffer ) {
+                    DrawVertexBufferIndexed( (*itr)->MeshVertexBuffer,
+                        (*itr)->MeshIndexBuffer,
+                        (*itr)->Indices.size() );
+                } else {
+                    // Only tesselated meshes have buffers of their own, draw its part of the wrapped mesh
+                    DrawVertexBufferIndexedUINT( wrappedMesh->MeshVertexBuffer, wrappedMesh->MeshIndexBuffer,
+                        (*itr)->Indices.size(), (*itr)->BaseIndexLocation );
+                }
             }
         } else {
             for ( auto&& itr = textureInfo.second.second.begin(); itr != textureInfo.second.second.end(); itr++ ) {
@@ -3145,10 +3407,54 @@ XRESULT D3D11GraphicsEngine::DrawWorldMeshW( bool noTextures ) {
 
 /** Draws the given mesh infos as water */
 void D3D11GraphicsEngine::DrawWaterSurfaces() {
-    if ( FrameWaterSurfaces.empty() ) {
+    // Only draw the bodies of water which can be seen, a lake on screen doesn't pay for every
+    // puddle around it
+    FrameWaterRanges.clear();
+    zCCamera* camera = zCCamera::GetCamera();
+    const PortalVisibility* portals = Engine::GAPI->GetPortalVisibility();
+
+    // Only the water split into bodies is sure to lie behind the rest of the world, other meshes
+    // can have anything in between them
+    uint32_t mergeGap = WaterBodies::MERGE_GAP;
+    for ( auto const& it : FrameWaterSurfaces ) {
+        WorldMeshInfo* mesh = it.second;
+        if ( mesh->Bodies.empty() ) {
+            mergeGap = 0;
+            FrameWaterRanges.push_back( { it.first, mesh->BaseIndexLocation, static_cast<uint32_t>(mesh->Indices.size()) } );
+            continue;
+        }
+
+        for ( const WaterBody& body : mesh->Bodies ) {
+            zTBBox3D box;
+            box.Min = XMFLOAT3( body.Min[0], body.Min[1], body.Min[2] );
+            box.Max = XMFLOAT3( body.Max[0], body.Max[1], body.Max[2] );
+
+            int flags = 15; // Frustum check, no farplane
+            if ( camera && camera->BBox3DInFrustum( box, flags ) == ZTCAM_CLIPTYPE_OUT )
+                continue;
+
+            if ( portals && !portals->IsBoxVisible( body.Min, body.Max ) )
+                continue;
+
+            FrameWaterRanges.push_back( { it.first, mesh->BaseIndexLocation + body.FirstIndex, body.NumIndices } );
+        }
+    }
+
+    GOcean* ocean = !FeatureLevel10Compatibility ? Engine::GAPI->GetOcean() : nullptr;
+    if ( FrameWaterRanges.empty() && !ocean ) {
         return;
     }
 
+    // Water of a texture lies in one piece of the wrapped mesh, so most of the visible bodies merge
+    WaterBodies::MergeRanges( FrameWaterRanges, mergeGap );
+
+    // The depth doesn't care about the texture
+    FrameWaterDepthRanges.assign( FrameWaterRanges.begin(), FrameWaterRanges.end() );
+    for ( WaterDrawRange& range : FrameWaterDepthRanges ) {
+        range.Texture = nullptr;
+    }
+    WaterBodies::MergeRanges( FrameWaterDepthRanges, mergeGap );
+
     SetDefaultStates();
 
     // Copy backbuffer
@@ -3179,12 +3485,8 @@ void D3D11GraphicsEngine::DrawWaterSurfaces() {
     DrawVertexBufferIndexedUINT(
         Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
         Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0 );
-    for ( auto const& it : FrameWaterSurfaces ) {
-        // Draw surfaces
-        for ( auto const& mesh : it.second ) {
-            DrawVertexBufferIndexedUINT( nullptr, nullptr,
-                mesh->Indices.size(), mesh->BaseIndexLocation );
-        }
+    for ( const WaterDrawRange& range : FrameWaterDepthRanges ) {
+        DrawVertexBufferIndexedUINT( nullptr, nullptr, range.NumIndices, range.FirstIndex );
     }
 
     // Bind pixel water shader
@@ -3215,22 +3517,22 @@ void D3D11GraphicsEngine::DrawWaterSurfaces() {
 
     // Bind reflection cube
     GetContext()->PSSetShaderResources( 3, 1, ReflectionCube.GetAddressOf() );
-    for ( auto const& it : FrameWaterSurfaces ) {
-        // Bind diffuse
-        zCTexture* texture = it.first;
-        texture->CacheIn( -1 );    // Force immediate cache in, because water
-                                   // is important!
-        texture->Bind( 0 );
-
-        // Draw surfaces
-        for ( auto const& mesh : it.second ) {
-            DrawVertexBufferIndexedUINT( nullptr, nullptr,
-                mesh->Indices.size(), mesh->BaseIndexLocation );
+    void* boundTexture = nullptr;
+    for ( const WaterDrawRange& range : FrameWaterRanges ) {
+        // Bind diffuse, the ranges are sorted by texture
+        if ( range.Texture != boundTexture ) {
+            zCTexture* texture = static_cast<zCTexture*>(range.Texture);
+            texture->CacheIn( -1 );    // Force immediate cache in, because water
+                                       // is important!
+            texture->Bind( 0 );
+            boundTexture = range.Texture;
         }
+
+        DrawVertexBufferIndexedUINT( nullptr, nullptr, range.NumIndices, range.FirstIndex );
     }
 
     // Draw Ocean
-    if ( !FeatureLevel10Compatibility && Engine::GAPI->GetOcean() ) Engine::GAPI->GetOcean()->Draw();
+    if ( ocean ) ocean->Draw();
 
     // Unbind temporary backbuffer copy
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
@@ -3245,7 +3547,8 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
     FXMVECTOR position, float range, bool cullFront, bool indoor,
     bool noNPCs, std::list<VobInfo*>* renderedVobs,
     std::list<SkeletalVobInfo*>* renderedMobs,
-    std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>* worldMeshCache ) {
+    std::vector<WorldMeshDrawRange>* worldMeshCache,
+    bool dynamicOnly, bool collectVobs ) {
 
     // Setup renderstates
     Engine::GAPI->GetRendererState().RasterizerState.SetDefault();
@@ -3289,7 +3592,6 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
     ActivePS->GetConstantBuffer()[3]->BindToPixelShader( 3 );
 
     float3 pos; XMStoreFloat3( pos.toXMFLOAT3(), position );
-    INT2 s = WorldConverter::GetSectionOfPos( pos );
 
     float vobOutdoorDist =
         Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius;
@@ -3308,9 +3610,19 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
     float alphaRef = Engine::GAPI->GetRendererState().GraphicsState.FF_AlphaRef;
     bool isOutdoor = (Engine::GAPI->GetLoadedWorldInfo()->BspTree->GetBspTreeMode() == zBSP_MODE_OUTDOOR);
 
+    // Sections the vobs are collected from, picked by the same range as the worldmesh below
     std::vector<WorldMeshSectionInfo*> drawnSections;
+    for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
+        for ( auto&& ity : itx.second ) {
+            WorldMeshSectionInfo& section = ity.second;
+            if ( WorldMeshClusterSet::SphereIntersectsBox( &pos.x, range,
+                &section.BoundingBox.Min.x, &section.BoundingBox.Max.x ) ) {
+                drawnSections.emplace_back( &section );
+            }
+        }
+    }
 
-    if ( Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh ) {
+    if ( !dynamicOnly && Engine::GAPI->GetRendererState().RendererSettings.DrawWorldMesh ) {
         // Bind wrapped mesh vertex buffers
         DrawVertexBufferIndexedUINT( Engine::GAPI->GetWrappedWorldMesh()->MeshVertexBuffer,
             Engine::GAPI->GetWrappedWorldMesh()->MeshIndexBuffer, 0, 0 );
@@ -3318,91 +3630,61 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
         ActiveVS->GetConstantBuffer()[1]->UpdateBuffer( &Identity );
         ActiveVS->GetConstantBuffer()[1]->BindToVertexShader( 1 );
 
-        // Only use cache if we haven't already collected the vobs
-        // TODO: Collect vobs in a different way than using the drawn sections!
-        //		 The current solution won't use the cache at all when there are
-        // no vobs near!
-        if ( worldMeshCache && renderedVobs && !renderedVobs->empty() ) {
-            for ( auto&& meshInfoByKey = worldMeshCache->begin(); meshInfoByKey != worldMeshCache->end(); ++meshInfoByKey ) {
-                // Bind texture
-                if ( meshInfoByKey->first.Material && meshInfoByKey->first.Material->GetTexture() ) {
-                    // Check surface type
-                    if ( meshInfoByKey->first.Info->MaterialType == MaterialInfo::MT_Water ) {
+        // Only gather the parts of the worldmesh inside the range, if the caller hasn't already
+        std::vector<WorldMeshDrawRange> rangesInRadius;
+        std::vector<WorldMeshDrawRange>& ranges = worldMeshCache ? *worldMeshCache : rangesInRadius;
+        if ( ranges.empty() ) {
+            for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
+                for ( auto&& ity : itx.second ) {
+                    WorldMeshSectionInfo& section = ity.second;
+                    if ( !WorldMeshClusterSet::SphereIntersectsBox( &pos.x, range,
+                        &section.BoundingBox.Min.x, &section.BoundingBox.Max.x ) ) {
                         continue;
                     }
 
-                    if ( meshInfoByKey->first.Material->GetTexture()->HasAlphaChannel() ||
-                        colorWritesEnabled ) {
-                        if ( alphaRef > 0.0f && meshInfoByKey->first.Material->GetTexture()->CacheIn(
-                            0.6f ) == zRES_CACHED_IN ) {
-                            meshInfoByKey->first.Material->GetTexture()->Bind( 0 );
-                            ActivePS->Apply();
-                        } else
-                            continue;  // Don't render if not loaded
-                    } else {
-                        if ( !linearDepth )  // Only unbind when not rendering linear depth
-                        {
-                            // Unbind PS
-                            GetContext()->PSSetShader( nullptr, nullptr, 0 );
-                        }
-                    }
+                    section.BuildShadowClusters();
+                    section.ShadowClusters.QuerySphere( &pos.x, range, ranges );
                 }
-
-                // Draw from wrapped mesh
-                DrawVertexBufferIndexedUINT( nullptr, nullptr,
-                    meshInfoByKey->second->Indices.size(), meshInfoByKey->second->BaseIndexLocation );
             }
+        }
 
-        } else {
-            for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
-                for ( auto&& ity : itx.second ) {
-                    float vLen; XMStoreFloat( &vLen, XMVector3Length( XMVectorSet( static_cast<float>(itx.first - s.x), static_cast<float>(ity.first - s.y), 0, 0 ) ) );
+        // FastShadows only draw the opaque parts, like the sections FullStaticMesh
+        bool fastShadows = Engine::GAPI->GetRendererState().RendererSettings.FastShadows;
 
-                    if ( vLen < 2 ) {
-                        WorldMeshSectionInfo& section = ity.second;
-                        drawnSections.emplace_back( &section );
+        const MeshKey* boundKey = nullptr;
+        bool skipMesh = false;
+        for ( const WorldMeshDrawRange& r : ranges ) {
+            if ( r.MeshHandle != boundKey ) {
+                boundKey = r.MeshHandle;
+                skipMesh = false;
 
-                        if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
-                            // Draw world mesh
-                            if ( section.FullStaticMesh )
-                                Engine::GAPI->DrawMeshInfo( nullptr, section.FullStaticMesh );
+                // Check surface type
+                if ( boundKey->Info && boundKey->Info->MaterialType == MaterialInfo::MT_Water ) {
+                    skipMesh = true;
+                } else if ( boundKey->Material && boundKey->Material->GetTexture() ) {
+                    // Bind texture
+                    zCTexture* texture = boundKey->Material->GetTexture();
+                    if ( fastShadows && texture->HasAlphaChannel() ) {
+                        skipMesh = true;
+                    } else if ( texture->HasAlphaChannel() || colorWritesEnabled ) {
+                        if ( alphaRef > 0.0f && texture->CacheIn( 0.6f ) == zRES_CACHED_IN ) {
+                            texture->Bind( 0 );
+                            ActivePS->Apply();
                         } else {
-                            for ( auto&& meshInfoByKey = section.WorldMeshes.begin();
-                                meshInfoByKey != section.WorldMeshes.end(); ++meshInfoByKey ) {
-                                // Check surface type
-                                if ( meshInfoByKey->first.Info->MaterialType == MaterialInfo::MT_Water ) {
-                                    continue;
-                                }
-
-                                // Bind texture
-                                if ( meshInfoByKey->first.Material && meshInfoByKey->first.Material->GetTexture() ) {
-                                    if ( meshInfoByKey->first.Material->GetTexture()->HasAlphaChannel() ||
-                                        colorWritesEnabled ) {
-                                        if ( alphaRef > 0.0f &&
-                                            meshInfoByKey->first.Material->GetTexture()->CacheIn( 0.6f ) ==
-                                            zRES_CACHED_IN ) {
-                                            meshInfoByKey->first.Material->GetTexture()->Bind( 0 );
-                                            ActivePS->Apply();
-                                        } else
-                                            continue;  // Don't render if not loaded
-                                    } else {
-                                        if ( !linearDepth )  // Only unbind when not rendering linear
-                                                           // depth
-                                        {
-                                            // Unbind PS
-                                            GetContext()->PSSetShader( nullptr, nullptr, 0 );
-                                        }
-                                    }
-                                }
-
-                                // Draw from wrapped mesh
-                                DrawVertexBufferIndexedUINT( nullptr, nullptr,
-                                    meshInfoByKey->second->Indices.size(), meshInfoByKey->second->BaseIndexLocation );
-                            }
+                            skipMesh = true;  // Don't render if not loaded
                         }
+                    } else if ( !linearDepth ) {
+                        // Only unbind when not rendering linear depth
+                        GetContext()->PSSetShader( nullptr, nullptr, 0 );
                     }
                 }
             }
+
+            if ( skipMesh )
+                continue;
+
+            // Draw from wrapped mesh
+            DrawVertexBufferIndexedUINT( nullptr, nullptr, r.NumIndices, r.FirstIndex );
         }
     }
 
@@ -3410,7 +3692,7 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
         // Draw visible vobs here
         std::list<VobInfo*> rndVob;
         // construct new renderedvob list or fake one
-        if ( !renderedVobs || renderedVobs->empty() ) {
+        if ( collectVobs && !dynamicOnly && (!renderedVobs || renderedVobs->empty()) ) {
             for ( size_t i = 0; i < drawnSections.size(); i++ ) {
                 for ( auto it : drawnSections[i]->Vobs ) {
                     if ( !it->VisualInfo ) {
@@ -3471,7 +3753,7 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround(
     }
 
     bool renderNPCs = !noNPCs;
-    if ( Engine::GAPI->GetRendererState().RendererSettings.DrawMobs ) {
+    if ( !dynamicOnly && Engine::GAPI->GetRendererState().RendererSettings.DrawMobs ) {
         // Draw visible vobs here
         std::list<SkeletalVobInfo*> rndVob;
 
@@ -3654,6 +3936,11 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
                 if ( len < sectionRange ) {
                     const WorldMeshSectionInfo& section = ity.second;
 
+                    // Skip sections which can't cast onto the cascade being drawn
+                    if ( ActiveShadowCascade && !ActiveShadowCascade->TestBox( &section.BoundingBox.Min.x, &section.BoundingBox.Max.x ) ) {
+                        continue;
+                    }
+
                     if ( Engine::GAPI->GetRendererState().RendererSettings.FastShadows ) {
                         // Draw world mesh
                         if ( section.FullStaticMesh )
@@ -3701,12 +3988,77 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
         const std::unordered_map<zCProgMeshProto*, MeshVisualInfo*>& staticMeshVisuals =
             Engine::GAPI->GetStaticMeshVisuals();
 
-        for ( auto const& it : RenderedVobs ) {
-            if ( !it->IsIndoorVob ) {
+        StaticInstanceCache* staticInstances = Engine::GAPI->GetStaticInstanceCache();
+
+        if ( ActiveShadowCascade ) {
+            // RenderedVobs only holds what the camera sees, but casters behind the camera still throw their shadows
+            // into the view. And a cached cascade would keep the holes of the view it was drawn with.
+            const GothicRendererSettings& settings = Engine::GAPI->GetRendererState().RendererSettings;
+            const float lodPixelScale = Engine::GAPI->GetVobLODPixelScale();
+
+            auto addCaster = [&]( VobInfo* vob ) {
+                if ( !vob->VisualInfo || vob->IsIndoorVob || !vob->Vob->GetShowVisual() )
+                    return;
+
+                float dist;
+                XMStoreFloat( &dist, XMVector3Length( XMLoadFloat3( &vob->LastRenderPosition ) - position ) );
+                if ( dist > vobOutdoorDist || !ActiveShadowCascade->TestSphere( &vob->LastRenderPosition.x, vob->VisualInfo->MeshSize ) )
+                    return;
+
+                // The LOD the camera picked may be from long ago, or from the other side of the cascade. Coming from
+                // the coarsest level skips the hysteresis.
+                MeshVisualInfo* visual = reinterpret_cast<MeshVisualInfo*>(vob->VisualInfo);
+                const unsigned char lod = settings.EnableVobLOD
+                    ? visual->SelectLOD( dist, lodPixelScale, settings.VobLODPixelError, static_cast<unsigned char>(visual->NumLODs) ) : 0;
+
                 VobInstanceInfo vii;
-                vii.world = it->WorldMatrix;
-                ((MeshVisualInfo*)it->VisualInfo)->Instances.emplace_back( vii );
+                vii.world = vob->WorldMatrix;
+                visual->AddInstance( vii, lod );
+            };
+
+            for ( const auto& itx : Engine::GAPI->GetWorldSections() ) {
+                for ( const auto& ity : itx.second ) {
+                    float len;
+                    XMStoreFloat( &len, XMVector2Length( XMVectorSet( static_cast<float>(itx.first - s.x), static_cast<float>(ity.first - s.y), 0, 0 ) ) );
+                    if ( len >= sectionRange )
+                        continue;
+
+                    for ( VobInfo* vob : ity.second.Vobs ) {
+                        // Cached vobs come out of the runs below, added and moved ones out of the dynamic list
+                        if ( (staticInstances && StaticInstanceCache::IsCached( vob )) || vob->ParentBSPNodes.empty() )
+                            continue;
+
+                        addCaster( vob );
+                    }
+                }
             }
+
+            // Cached cascades would keep the shadow where the vob was
+            if ( !ActiveShadowCascade->Cached ) {
+                for ( VobInfo* vob : Engine::GAPI->GetDynamicallyAddedVobs() ) {
+                    addCaster( vob );
+                }
+            }
+        } else {
+            for ( auto const& it : RenderedVobs ) {
+                if ( !it->IsIndoorVob ) {
+                    VobInstanceInfo vii;
+                    vii.world = it->WorldMatrix;
+                    ((MeshVisualInfo*)it->VisualInfo)->AddInstance( vii, it->CurrentLOD );
+                }
+            }
+        }
+
+        // The cached static vobs aren't part of RenderedVobs. A cascade picks them by its own volume, into runs and
+        // LODs of its own, so the ones of the camera stay as they are.
+        if ( staticInstances ) {
+            StaticInstanceRuns::CullFunction cull = StaticInstanceCache::InCameraFrustum;
+            if ( const ShadowCascade* cascade = ActiveShadowCascade ) {
+                cull = [cascade]( const float* min, const float* max ) { return cascade->TestBox( min, max ); };
+            }
+
+            staticInstances->CollectRuns( GetStaticInstancePass(), *fPosition.toXMFLOAT3(), vobOutdoorDist, cull, Engine::GAPI->GetVobLODPixelScale() );
+            staticInstances->Update();
         }
 
         // Apply instancing shader
@@ -3720,6 +4072,22 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
             GetContext()->PSSetShader( nullptr, nullptr, 0 );
         }
 
+        // The casters of a cascade can be more than the vobs the camera sees
+        size_t numInstances = 0;
+        for ( auto const& staticMeshVisual : staticMeshVisuals ) {
+            numInstances += staticMeshVisual.second->Instances.size();
+        }
+
+        if ( DynamicInstancingBuffer->GetSizeInBytes() <= sizeof( VobInstanceInfo ) * numInstances ) {
+            DynamicInstancingBuffer->Init(
+                nullptr, sizeof( VobInstanceInfo ) * (numInstances + 1),
+                D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_DYNAMIC,
+                D3D11VertexBuffer::CA_WRITE );
+
+            SetDebugName( DynamicInstancingBuffer->GetShaderResourceView().Get(), "DynamicInstancingBuffer->ShaderResourceView" );
+            SetDebugName( DynamicInstancingBuffer->GetVertexBuffer().Get(), "DynamicInstancingBuffer->VertexBuffer" );
+        }
+
         size_t ByteWidth = DynamicInstancingBuffer->GetSizeInBytes();
         byte* data;
         UINT size;
@@ -3733,15 +4101,14 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
                 break;  // Should never happen
 
             staticMeshVisual.second->StartInstanceNum = loc;
-            memcpy( data + loc * sizeof( VobInstanceInfo ), &staticMeshVisual.second->Instances[0],
-                sizeof( VobInstanceInfo ) * staticMeshVisual.second->Instances.size() );
+            staticMeshVisual.second->WriteInstancesSortedByLOD( reinterpret_cast<VobInstanceInfo*>(data) + loc );
             loc += staticMeshVisual.second->Instances.size();
         }
         DynamicInstancingBuffer->Unmap();
 
         // Draw all vobs the player currently sees
         for ( auto const& staticMeshVisual : staticMeshVisuals ) {
-            if ( staticMeshVisual.second->Instances.empty() ) continue;
+            if ( staticMeshVisual.second->Instances.empty() && !HasStaticInstanceRuns( staticMeshVisual.second ) ) continue;
 
             bool doReset = true;
             for ( auto const& itt : staticMeshVisual.second->MeshesByTexture ) {
@@ -3780,10 +4147,8 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
                     MeshInfo* mi = mlist[i];
 
                     // Draw batch
-                    DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer,
-                        mi->Indices.size(), DynamicInstancingBuffer.get(),
-                        sizeof( VobInstanceInfo ), staticMeshVisual.second->Instances.size(),
-                        sizeof( ExVertexStruct ), staticMeshVisual.second->StartInstanceNum );
+                    DrawVisualInstancesByLOD( staticMeshVisual.second, mi );
+                    DrawVisualInstanceRuns( staticMeshVisual.second, mi );
 
                     Engine::GAPI->GetRendererState().RendererInfo.FrameDrawnVobs +=
                         staticMeshVisual.second->Instances.size();
@@ -3797,6 +4162,7 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawSkeletalMeshes ) {
         // Draw skeletal meshes
+        BeginSkinnedInstancing();
         for ( auto const& skeletalMeshVob : Engine::GAPI->GetSkeletalMeshVobs() ) {
             if ( !skeletalMeshVob->VisualInfo ) continue;
 
@@ -3805,14 +4171,27 @@ void XM_CALLCONV D3D11GraphicsEngine::DrawWorldAround( FXMVECTOR position,
                 if ( npc->HasFlag( NPC_FLAG_GHOST ) ) {
                     continue;
                 }
+
+                // Cached cascades would keep the shadow where the NPC was
+                if ( ActiveShadowCascade && ActiveShadowCascade->Cached ) {
+                    continue;
+                }
             }
 
-            float dist; XMStoreFloat( &dist, XMVector3Length( skeletalMeshVob->Vob->GetPositionWorldXM() - position ) );
-            if ( dist > Engine::GAPI->GetRendererState().RendererSettings.IndoorVobDrawRadius )
-                continue;  // Skip out of range
+            if ( ActiveShadowCascade ) {
+                XMFLOAT3 vobPosition;
+                XMStoreFloat3( &vobPosition, skeletalMeshVob->Vob->GetPositionWorldXM() );
+                if ( !ActiveShadowCascade->TestSphere( &vobPosition.x, SHADOW_CASCADE_SKELETAL_RADIUS ) )
+                    continue;  // Can't cast onto the cascade
+            } else {
+                float dist; XMStoreFloat( &dist, XMVector3Length( skeletalMeshVob->Vob->GetPositionWorldXM() - position ) );
+                if ( dist > Engine::GAPI->GetRendererState().RendererSettings.IndoorVobDrawRadius )
+                    continue;  // Skip out of range
+            }
 
             Engine::GAPI->DrawSkeletalMeshVob( skeletalMeshVob, FLT_MAX );
         }
+        FlushSkinnedInstances();
     }
 
     Engine::GAPI->GetRendererState().BlendState.ColorWritesEnabled = true;
@@ -3890,9 +4269,19 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
         UpdateMorphMeshVisual();
     }
 
+    // Static outdoor vobs come out of the persistent instance buffers of their sections
+    StaticInstanceCache* staticInstances = Engine::GAPI->GetStaticInstanceCache();
+    if ( staticInstances && Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
+        staticInstances->CollectRuns( StaticInstanceCache::PASS_CAMERA, *camPos.toXMFLOAT3(), Engine::GAPI->GetRendererState().RendererSettings.OutdoorVobDrawRadius,
+            StaticInstanceCache::InCameraFrustum, Engine::GAPI->GetVobLODPixelScale() );
+        staticInstances->Update();
+    }
+
     // Need to collect alpha-meshes to render them laterdy
-    std::list<std::pair<MeshKey, std::pair<MeshVisualInfo*, MeshInfo*>>>
+    FrameVector<std::pair<MeshKey, std::pair<MeshVisualInfo*, MeshInfo*>>>
         AlphaMeshes;
+    VobTransparencyQueue.Clear();
+    const XMVECTOR camPosXM = Engine::GAPI->GetCameraPositionXM();
 
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
         // Create instancebuffer for this frame
@@ -3921,8 +4310,7 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
             (void**)&data, &size );
         for ( auto const& staticMeshVisual : staticMeshVisuals ) {
             staticMeshVisual.second->StartInstanceNum = loc;
-            memcpy( data + loc * sizeof( VobInstanceInfo ), &staticMeshVisual.second->Instances[0],
-                sizeof( VobInstanceInfo ) * staticMeshVisual.second->Instances.size() );
+            staticMeshVisual.second->WriteInstancesSortedByLOD( reinterpret_cast<VobInstanceInfo*>(data) + loc );
             loc += staticMeshVisual.second->Instances.size();
         }
         DynamicInstancingBuffer->Unmap();
@@ -3933,7 +4321,7 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
         }
 
         for ( auto const& staticMeshVisual : staticMeshVisuals ) {
-            if ( staticMeshVisual.second->Instances.empty() ) continue;
+            if ( staticMeshVisual.second->Instances.empty() && !HasStaticInstanceRuns( staticMeshVisual.second ) ) continue;
 
             if ( staticMeshVisual.second->MeshSize <
                 Engine::GAPI->GetRendererState().RendererSettings.SmallVobSize ) {
@@ -3960,7 +4348,19 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
                     bool blendBlend = itt.first.Material->GetAlphaFunc() == zMAT_ALPHA_FUNC_BLEND;
                     if ( !doReset || blendAdd || blendBlend ) {
                         MeshVisualInfo* info = staticMeshVisual.second;
+
+                        // All instances go into one call, sort by the nearest, including the clusters
+                        // drawn out of the static cache
+                        float distance = staticInstances ? staticInstances->GetNearestDistance( StaticInstanceCache::PASS_CAMERA, info ) : FLT_MAX;
+                        for ( const VobInstanceInfo& instance : info->Instances ) {
+                            float d;
+                            XMStoreFloat( &d, XMVector3Length( XMVectorSet( instance.world._14, instance.world._24, instance.world._34, 0 ) - camPosXM ) );
+                            distance = std::min( distance, d );
+                        }
+
                         for ( MeshInfo* mesh : mlist ) {
+                            VobTransparencyQueue.Add( distance, blendAdd ? TB_ADDITIVE : TB_ALPHA,
+                                itt.first.Material, static_cast<uint32_t>(AlphaMeshes.size()) );
                             AlphaMeshes.emplace_back(
                                 std::make_pair( itt.first, std::make_pair( info, mesh ) ) );
                         }
@@ -4077,16 +4477,18 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
 
                     if ( !ActiveHDS ) {
                         // Draw batch
-                        DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer,
-                            mi->Indices.size(), DynamicInstancingBuffer.get(),
-                            sizeof( VobInstanceInfo ), staticMeshVisual.second->Instances.size(),
-                            sizeof( ExVertexStruct ), staticMeshVisual.second->StartInstanceNum );
+                        DrawVisualInstancesByLOD( staticMeshVisual.second, mi );
+                        DrawVisualInstanceRuns( staticMeshVisual.second, mi );
                     } else {
                         // Draw batch tesselated
-                        DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBufferPNAEN,
-                            mi->IndicesPNAEN.size(), DynamicInstancingBuffer.get(),
-                            sizeof( VobInstanceInfo ), staticMeshVisual.second->Instances.size(),
-                            sizeof( ExVertexStruct ), staticMeshVisual.second->StartInstanceNum );
+                        if ( !staticMeshVisual.second->Instances.empty() ) {
+                            DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBufferPNAEN,
+                                mi->IndicesPNAEN.size(), DynamicInstancingBuffer.get(),
+                                sizeof( VobInstanceInfo ), staticMeshVisual.second->Instances.size(),
+                                sizeof( ExVertexStruct ), staticMeshVisual.second->StartInstanceNum );
+                        }
+
+                        DrawVisualInstanceRuns( staticMeshVisual.second, mi, true );
                     }
                 }
             }
@@ -4123,7 +4525,7 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
 
     if ( RenderingStage == DES_MAIN ) {
         if ( Engine::GAPI->GetRendererState().RendererSettings.DrawParticleEffects ) {
-            std::vector<zCVob*> decals;
+            FrameVector<zCVob*> decals;
             Engine::GAPI->GetVisibleDecalList( decals );
             DrawDecalList( decals, true );
 
@@ -4150,7 +4552,11 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
     GetContext()->OMSetRenderTargets( 1, HDRBackBuffer->GetRenderTargetView().GetAddressOf(),
         DepthStencilBuffer->GetDepthStencilView().Get() );
 
-    for ( auto const& alphaMesh : AlphaMeshes ) {
+    // Back to front, the state of a batch is bound once
+    VobTransparencyQueue.Build( Engine::RenderingThreadPool );
+    int lastBlend = -1;
+    for ( const TransparencyBatch& batch : VobTransparencyQueue.GetBatches() ) {
+        const auto& alphaMesh = AlphaMeshes[VobTransparencyQueue.GetItems()[batch.FirstItem]];
         zCTexture* tx = alphaMesh.first.Material->GetAniTexture();
 
         if ( !tx ) continue;
@@ -4161,10 +4567,6 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
             alphaMesh.first.Material->GetAlphaFunc() == zMAT_ALPHA_FUNC_BLEND;
 
         // Bind texture
-
-        MeshInfo* mi = alphaMesh.second.second;
-        MeshVisualInfo* vi = alphaMesh.second.first;
-
         if ( tx->CacheIn( 0.6f ) == zRES_CACHED_IN ) {
             MyDirectDrawSurface7* surface = tx->GetSurface();
             ID3D11ShaderResourceView* srv[3];
@@ -4181,8 +4583,8 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
             // Bind both
             GetContext()->PSSetShaderResources( 0, 3, srv );
 
-            if ( (blendAdd || blendBlend) &&
-                !Engine::GAPI->GetRendererState().BlendState.BlendEnabled ) {
+            if ( (blendAdd || blendBlend) && lastBlend != batch.Blend ) {
+                lastBlend = batch.Blend;
                 if ( blendAdd )
                     Engine::GAPI->GetRendererState().BlendState.SetAdditiveBlending();
                 else if ( blendBlend )
@@ -4203,10 +4605,17 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
         }
 
         // Draw batch
-        DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer, mi->Indices.size(),
-            DynamicInstancingBuffer.get(), sizeof( VobInstanceInfo ),
-            vi->Instances.size(), sizeof( ExVertexStruct ),
-            vi->StartInstanceNum );
+        for ( uint32_t i = batch.FirstItem; i < batch.FirstItem + batch.NumItems; i++ ) {
+            const auto& item = AlphaMeshes[VobTransparencyQueue.GetItems()[i]];
+            MeshInfo* mi = item.second.second;
+            MeshVisualInfo* vi = item.second.first;
+
+            DrawInstanced( mi->MeshVertexBuffer, mi->MeshIndexBuffer, mi->Indices.size(),
+                DynamicInstancingBuffer.get(), sizeof( VobInstanceInfo ),
+                vi->Instances.size(), sizeof( ExVertexStruct ),
+                vi->StartInstanceNum );
+            DrawVisualInstanceRuns( vi, mi );
+        }
     }
 
     // Loop again, now that all alpha-meshes have been rendered
@@ -4227,6 +4636,71 @@ XRESULT D3D11GraphicsEngine::DrawVOBsInstanced() {
     return XR_SUCCESS;
 }
 
+/** Draws the instances of a static visual out of the DynamicInstancingBuffer, one call per LOD */
+void D3D11GraphicsEngine::DrawVisualInstancesByLOD( MeshVisualInfo* visual, MeshInfo* mesh ) {
+    for ( unsigned int lod = 0; lod <= mesh->LODs.size(); lod++ ) {
+        if ( !visual->LODInstanceCount[lod] )
+            continue;
+
+        D3D11VertexBuffer* ib = lod == 0 ? mesh->MeshIndexBuffer : mesh->LODs[lod - 1].IndexBuffer;
+        unsigned int numIndices = lod == 0 ? mesh->Indices.size() : mesh->LODs[lod - 1].NumIndices;
+        if ( !ib || !numIndices )
+            continue;
+
+        DrawInstanced( mesh->MeshVertexBuffer, ib, numIndices, DynamicInstancingBuffer.get(),
+            sizeof( VobInstanceInfo ), visual->LODInstanceCount[lod],
+            sizeof( ExVertexStruct ), visual->StartInstanceNum + visual->LODInstanceStart[lod] );
+    }
+}
+
+/** Draws the visible runs of a static visual out of the static instance cache */
+void D3D11GraphicsEngine::DrawVisualInstanceRuns( MeshVisualInfo* visual, MeshInfo* mesh, bool tesselated ) {
+    StaticInstanceCache* staticInstances = Engine::GAPI->GetStaticInstanceCache();
+    if ( !staticInstances )
+        return;
+
+    unsigned int numRuns;
+    const InstanceRun* runs = staticInstances->GetRuns( GetStaticInstancePass(), visual, numRuns );
+    for ( unsigned int r = 0; r < numRuns; r++ ) {
+        const InstanceRun& run = runs[r];
+        D3D11VertexBuffer* ib = mesh->MeshIndexBuffer;
+        unsigned int numIndices = mesh->Indices.size();
+
+        if ( tesselated ) {
+            ib = mesh->MeshIndexBufferPNAEN;
+            numIndices = mesh->IndicesPNAEN.size();
+        } else if ( run.LOD > 0 && run.LOD <= mesh->LODs.size() ) {
+            ib = mesh->LODs[run.LOD - 1].IndexBuffer;
+            numIndices = mesh->LODs[run.LOD - 1].NumIndices;
+        }
+
+        if ( !ib || !numIndices )
+            continue;
+
+        DrawInstanced( mesh->MeshVertexBuffer, ib, numIndices, staticInstances->GetBuffer(),
+            sizeof( VobInstanceInfo ), run.Count, sizeof( ExVertexStruct ), run.Start );
+    }
+}
+
+/** Returns whether the pass being drawn has runs of the visual in the static instance cache */
+bool D3D11GraphicsEngine::HasStaticInstanceRuns( const MeshVisualInfo* visual ) const {
+    StaticInstanceCache* staticInstances = Engine::GAPI->GetStaticInstanceCache();
+    if ( !staticInstances )
+        return false;
+
+    unsigned int numRuns;
+    staticInstances->GetRuns( GetStaticInstancePass(), visual, numRuns );
+    return numRuns > 0;
+}
+
+/** Pass of the static instance cache for what is drawn right now */
+unsigned int D3D11GraphicsEngine::GetStaticInstancePass() const {
+    if ( !ActiveShadowCascade )
+        return StaticInstanceCache::PASS_CAMERA;
+
+    return StaticInstanceCache::PASS_SHADOW_CASCADE + static_cast<unsigned int>(ActiveShadowCascade - &SunShadowCascades.GetCascade( 0 ));
+}
+
 /** Draws the static VOBs */
 XRESULT D3D11GraphicsEngine::DrawVOBs( bool noTextures ) {
     return DrawVOBsInstanced();
@@ -4360,6 +4834,9 @@ INT2 D3D11GraphicsEngine::GetBackbufferResolution() {
 
 /** Sets up the default rendering state */
 void D3D11GraphicsEngine::SetDefaultStates( bool force ) {
+    // Queued UI-draws depend on the old states
+    FlushBatchedDraws();
+
     Engine::GAPI->GetRendererState().RasterizerState.SetDefault();
     Engine::GAPI->GetRendererState().BlendState.SetDefault();
     Engine::GAPI->GetRendererState().DepthState.SetDefault();
@@ -4369,9 +4846,9 @@ void D3D11GraphicsEngine::SetDefaultStates( bool force ) {
     Engine::GAPI->GetRendererState().DepthState.SetDirty();
 
     if ( force ) {
-        FFRasterizerStateHash = 0;
-        FFBlendStateHash = 0;
-        FFDepthStencilStateHash = 0;
+        FFRasterizerStateKey = 0;
+        FFBlendStateKey = 0;
+        FFDepthStencilStateKey = 0;
         UpdateRenderStates();
     }
 }
@@ -4497,6 +4974,11 @@ XRESULT D3D11GraphicsEngine::OnKeyDown( unsigned int key ) {
         Engine::GAPI->PrintMessageTimed( INT2( 30, 30 ), "Reloading shaders..." );
         ReloadShaders();
         break;
+
+    case VK_NUMPAD8:
+        Engine::GAPI->PrintMessageTimed( INT2( 30, 30 ), "Saving shadow geometry..." );
+        Engine::GAPI->SaveShadowGeometry( "system\\GD3D11\\ShadowGeometry.bin" );
+        break;
 #endif
 
     case VK_NUMPAD7:
@@ -4662,57 +5144,56 @@ XRESULT D3D11GraphicsEngine::DrawLighting( std::vector<VobLightInfo*>& lights )
         }
     }
 
-    static XMVECTOR oldP = XMVectorZero();
-    XMVECTOR WorldShadowCP;
-    // Update position
-    // Try to update only if the camera went 500 units away from the last position
-    float len;
-    XMStoreFloat( &len, XMVector3Length( oldP - XMLoadFloat3( &cameraPosition ) ) );
-    if ( (len < 64 &&
-        // And is on even space
-        (cameraPosition.x - (int)cameraPosition.x) < 0.1f &&
-        // but don't let it go too far
-        (cameraPosition.y - (int)cameraPosition.y) < 0.1f) || len < 600.0f ) {
-        WorldShadowCP = oldP;
-    } else {
-        oldP = XMLoadFloat3( &cameraPosition );
-        WorldShadowCP = oldP;
-    }
-
-    // Set the camera height to the highest point in this section
-    FXMVECTOR p = WorldShadowCP + dir * 6000.0f;
-
-    FXMVECTOR lookAt = p - dir;
+    // Fit the cascades to the camera. Without cascades a single one covers the whole range and gets drawn every frame.
+    ShadowCascadeSettings cascadeSettings;
+    cascadeSettings.NumCascades = Engine::GAPI->GetRendererState().RendererSettings.EnableShadowCascades ? 2 : 1;
+    cascadeSettings.FarZ = WorldShadowmap1->GetSizeX() * Engine::GAPI->GetRendererState().RendererSettings.WorldShadowRangeScale * 0.5f;
+    cascadeSettings.Resolution = WorldShadowmap1->GetSizeX();
 
-    // Create shadowmap view-matrix
-    static const XMVECTORF32 c_XM_Up = { { { 0, 1, 0, 0 } } };
-    XMMATRIX crViewRepl = XMMatrixTranspose( XMMatrixLookAtLH( p, lookAt, c_XM_Up ) );
+    XMFLOAT3 cameraForward;
+    XMStoreFloat3( &cameraForward, XMVector3Normalize(
+        XMMatrixInverse( nullptr, XMMatrixTranspose( Engine::GAPI->GetViewMatrixXM() ) ).r[2] ) );
+    XMFLOAT3 lightDir;
+    XMStoreFloat3( &lightDir, dir );
+    const XMFLOAT4X4& proj = Engine::GAPI->GetProjectionMatrix();
 
-    XMMATRIX crProjRepl =
-        XMMatrixTranspose( XMMatrixOrthographicLH(
-            WorldShadowmap1->GetSizeX() * Engine::GAPI->GetRendererState().RendererSettings.WorldShadowRangeScale,
-            WorldShadowmap1->GetSizeX() * Engine::GAPI->GetRendererState().RendererSettings.WorldShadowRangeScale,
-            1,
-            20000.0f ) );
-
-    XMStoreFloat4x4( &cr.ViewReplacement, crViewRepl );
-    XMStoreFloat4x4( &cr.ProjectionReplacement, crProjRepl );
-    XMStoreFloat3( &cr.PositionReplacement, p );
-    XMStoreFloat3( &cr.LookAtReplacement, lookAt );
+    // The cached cascades only hold what was drawn into them, so they have to be drawn again once the
+    // shadowmap was only cleared
+    if ( Engine::GAPI->GetSky()->GetAtmoshpereSettings().LightDirection.y <= 0 ||
+        !Engine::GAPI->GetRendererState().RendererSettings.DrawShadowGeometry ||
+        !Engine::GAPI->GetRendererState().RendererSettings.EnableShadows ) {
+        SunShadowCascades.Invalidate();
+    }
 
-    // Replace gothics camera
-    Engine::GAPI->SetCameraReplacementPtr( &cr );
+    unsigned int renderCascades = SunShadowCascades.Update( cascadeSettings, &cameraPosition.x, &cameraForward.x,
+        1.0f / proj._11, 1.0f / proj._22, &lightDir.x );
 
     // Indoor worlds don't need shadowmaps for the world
     static zTBspMode lastBspMode = zBSP_MODE_OUTDOOR;
     if ( Engine::GAPI->GetLoadedWorldInfo()->BspTree->GetBspTreeMode() == zBSP_MODE_OUTDOOR ) {
-        RenderShadowmaps( WorldShadowCP, nullptr, true );
+        RenderToDepthStencilBuffer* targets[] = { WorldShadowmap1.get(), WorldShadowmap2.get() };
+        for ( int i = 0; i < SunShadowCascades.GetNumCascades(); i++ ) {
+            if ( !(renderCascades & (1u << i)) ) {
+                continue;
+            }
+
+            // Replace gothics camera
+            const ShadowCascade& cascade = SunShadowCascades.GetCascade( i );
+            GetShadowCascadeCamera( cascade, cr );
+            Engine::GAPI->SetCameraReplacementPtr( &cr );
+
+            ActiveShadowCascade = &cascade;
+            RenderShadowmaps( XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>(cascade.Center) ), targets[i], true );
+            ActiveShadowCascade = nullptr;
+        }
         lastBspMode = zBSP_MODE_OUTDOOR;
     } else if ( Engine::GAPI->GetRendererState().RendererSettings.EnableShadows ) {
         // We need to clear shadowmap to avoid some glitches in indoor locations
         // only need to do it once :)
         if ( lastBspMode == zBSP_MODE_OUTDOOR ) {
             GetContext()->ClearDepthStencilView( WorldShadowmap1->GetDepthStencilView().Get(), D3D11_CLEAR_DEPTH, 0.0f, 0 );
+            GetContext()->ClearDepthStencilView( WorldShadowmap2->GetDepthStencilView().Get(), D3D11_CLEAR_DEPTH, 0.0f, 0 );
+            SunShadowCascades.Invalidate();
             lastBspMode = zBSP_MODE_INDOOR;
         }
     }
@@ -4931,9 +5412,15 @@ XRESULT D3D11GraphicsEngine::DrawLighting( std::vector<VobLightInfo*>& lights )
 
     scb.SQ_LightColor = float4( sunColor.x, sunColor.y, sunColor.z, sunStrength );
 
+    // Without cascades the far one is the same as the near one
+    const ShadowCascade& farCascade = SunShadowCascades.GetCascade( SunShadowCascades.GetNumCascades() - 1 );
+    GetShadowCascadeCamera( SunShadowCascades.GetCascade( 0 ), cr );
     scb.SQ_ShadowView = cr.ViewReplacement;
     scb.SQ_ShadowProj = cr.ProjectionReplacement;
     scb.SQ_ShadowmapSize = static_cast<float>(WorldShadowmap1->GetSizeX());
+    XMStoreFloat4x4( &scb.SQ_ShadowFarViewProj, XMMatrixTranspose(
+        XMLoadFloat4x4( reinterpret_cast<const XMFLOAT4X4*>(farCascade.View) ) *
+        XMLoadFloat4x4( reinterpret_cast<const XMFLOAT4X4*>(farCascade.Proj) ) ) );
 
     // Get rain matrix
     scb.SQ_RainView = Effects->GetRainShadowmapCameraRepl().ViewReplacement;
@@ -4970,6 +5457,11 @@ XRESULT D3D11GraphicsEngine::DrawLighting( std::vector<VobLightInfo*>& lights )
     ActiveVS->GetConstantBuffer()[0]->BindToVertexShader( 0 );
 
     WorldShadowmap1->BindToPixelShader( GetContext().Get(), 3 );
+    if ( SunShadowCascades.GetNumCascades() > 1 ) {
+        WorldShadowmap2->BindToPixelShader( GetContext().Get(), 7 );
+    } else {
+        WorldShadowmap1->BindToPixelShader( GetContext().Get(), 7 );
+    }
 
     if ( Effects->GetRainShadowmap() )
         Effects->GetRainShadowmap()->BindToPixelShader( GetContext().Get(), 4 );
@@ -4985,6 +5477,7 @@ XRESULT D3D11GraphicsEngine::DrawLighting( std::vector<VobLightInfo*>& lights )
     // Reset state
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
     GetContext()->PSSetShaderResources( 2, 1, srv.GetAddressOf() );
+    GetContext()->PSSetShaderResources( 7, 1, srv.GetAddressOf() );
     GetContext()->OMSetRenderTargets( 1, HDRBackBuffer->GetRenderTargetView().GetAddressOf(),
         DepthStencilBuffer->GetDepthStencilView().Get() );
 
@@ -4998,7 +5491,8 @@ void XM_CALLCONV D3D11GraphicsEngine::RenderShadowCube(
     Microsoft::WRL::ComPtr<ID3D11RenderTargetView> debugRTV, bool cullFront, bool indoor, bool noNPCs,
     std::list<VobInfo*>* renderedVobs,
     std::list<SkeletalVobInfo*>* renderedMobs,
-    std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>* worldMeshCache ) {
+    std::vector<WorldMeshDrawRange>* worldMeshCache,
+    bool dynamicOnly, bool collectVobs ) {
     D3D11_VIEWPORT oldVP;
     UINT n = 1;
     GetContext()->RSGetViewports( &n, &oldVP );
@@ -5043,12 +5537,14 @@ void XM_CALLCONV D3D11GraphicsEngine::RenderShadowCube(
         Engine::GAPI->GetRendererState().BlendState.SetDirty();
     }
 
-    // Always render shadowcube when dynamic shadows are enabled
-    GetContext()->ClearDepthStencilView( face.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0 );
+    // Always render shadowcube when dynamic shadows are enabled. Dynamic casters go on top of the static ones.
+    if ( !dynamicOnly ) {
+        GetContext()->ClearDepthStencilView( face.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0 );
+    }
 
     // Draw the world mesh without textures
     DrawWorldAround( position, range, cullFront, indoor, noNPCs, renderedVobs,
-        renderedMobs, worldMeshCache );
+        renderedMobs, worldMeshCache, dynamicOnly, collectVobs );
 
     // Restore state
     SetRenderingStage( oldStage );
@@ -5063,6 +5559,17 @@ void XM_CALLCONV D3D11GraphicsEngine::RenderShadowCube(
     SetRenderingStage( DES_MAIN );
 }
 
+/** Builds the camera to render or sample the given sun-shadow cascade with */
+void D3D11GraphicsEngine::GetShadowCascadeCamera( const ShadowCascade& cascade, CameraReplacement& cr ) {
+    XMStoreFloat4x4( &cr.ViewReplacement, XMMatrixTranspose( XMLoadFloat4x4( reinterpret_cast<const XMFLOAT4X4*>(cascade.View) ) ) );
+    XMStoreFloat4x4( &cr.ProjectionReplacement, XMMatrixTranspose( XMLoadFloat4x4( reinterpret_cast<const XMFLOAT4X4*>(cascade.Proj) ) ) );
+
+    FXMVECTOR lightDir = XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>(cascade.LightDir) );
+    FXMVECTOR p = XMLoadFloat3( reinterpret_cast<const XMFLOAT3*>(cascade.Center) ) + lightDir * cascade.DepthExtent;
+    XMStoreFloat3( &cr.PositionReplacement, p );
+    XMStoreFloat3( &cr.LookAtReplacement, p - lightDir );
+}
+
 /** Renders the shadowmaps for the sun */
 void XM_CALLCONV D3D11GraphicsEngine::RenderShadowmaps( FXMVECTOR cameraPosition,
     RenderToDepthStencilBuffer* target,
@@ -5108,7 +5615,8 @@ void XM_CALLCONV D3D11GraphicsEngine::RenderShadowmaps( FXMVECTOR cameraPosition
     Engine::GAPI->GetRendererState().BlendState.SetDirty();
 
     // Dont render shadows from the sun when it isn't on the sky
-    if ( (target != WorldShadowmap1.get() ||
+    bool sunShadowmap = target == WorldShadowmap1.get() || target == WorldShadowmap2.get();
+    if ( (!sunShadowmap ||
         Engine::GAPI->GetSky()->GetAtmoshpereSettings().LightDirection.y >
         0) &&  // Only stop rendering if the sun is down on main-shadowmap
                // TODO: Take this out of here!
@@ -5634,15 +6142,98 @@ void D3D11GraphicsEngine::BindShaderForTexture( zCTexture* texture,
     }
 }
 
-/** Draws the given list of decals */
-void D3D11GraphicsEngine::DrawDecalList( const std::vector<zCVob*>& decals,
+/** Draws the given list of decals, instanced by blend-mode and material */
+void D3D11GraphicsEngine::DrawDecalList( const FrameVector<zCVob*>& decals,
     bool lighting ) {
+    if ( decals.empty() )
+        return;
+
+    XMMATRIX view = Engine::GAPI->GetViewMatrixXM();
+    XMFLOAT3 camPos = Engine::GAPI->GetCameraPosition();
+
+    // Collect everything this pass draws
+    FrameVector<DecalInstanceInput> inputs;
+    inputs.reserve( decals.size() );
+    for ( zCVob* vob : decals ) {
+        zCDecal* d = (zCDecal*)vob->GetVisual();
+
+        if ( !d ) {
+            continue;
+        }
+
+        if ( lighting && !d->GetAlphaTestEnabled() )
+            continue;  // Only allow no alpha or alpha test
+
+        zCMaterial* material = d->GetDecalSettings()->DecalMaterial;
+        int alphaFunc = material ? material->GetAlphaFunc() : zMAT_ALPHA_FUNC_NONE;
+        if ( lighting ) {
+            alphaFunc = zMAT_ALPHA_FUNC_NONE; // All of them use the default blend-state
+        } else if ( alphaFunc != zMAT_ALPHA_FUNC_BLEND && alphaFunc != zMAT_ALPHA_FUNC_ADD
+            && alphaFunc != zMAT_ALPHA_FUNC_MUL && alphaFunc != zMAT_ALPHA_FUNC_MUL2 ) {
+            continue;
+        }
+
+        DecalInstanceInput in;
+        in.Material = material;
+        in.AlphaFunc = alphaFunc;
+        in.Alignment = vob->GetAlignment();
+
+        XMFLOAT3 position = vob->GetPositionWorld();
+        in.Position[0] = position.x;
+        in.Position[1] = position.y;
+        in.Position[2] = position.z;
+        in.Distance = sqrtf( (position.x - camPos.x) * (position.x - camPos.x)
+            + (position.y - camPos.y) * (position.y - camPos.y)
+            + (position.z - camPos.z) * (position.z - camPos.z) );
+
+        XMStoreFloat4x4( reinterpret_cast<XMFLOAT4X4*>(in.World), vob->GetWorldMatrixXM() );
+        in.Size[0] = d->GetDecalSettings()->DecalSize.x;
+        in.Size[1] = d->GetDecalSettings()->DecalSize.y;
+        in.Offset[0] = d->GetDecalSettings()->DecalOffset.x;
+        in.Offset[1] = d->GetDecalSettings()->DecalOffset.y;
+        inputs.push_back( in );
+    }
+
+    if ( inputs.empty() )
+        return;
+
+    // Only the alpha-blended ones need to be drawn back to front
+    DecalBatches.Build( inputs.data(), inputs.size(), zMAT_ALPHA_FUNC_BLEND );
+    const std::vector<uint32_t>& order = DecalBatches.GetOrder();
+
+    // Write all matrices at once
+    size_t byteWidth = DynamicInstancingBuffer->GetSizeInBytes();
+    if ( byteWidth < sizeof( VobInstanceInfo ) * order.size() ) {
+        if ( Engine::GAPI->GetRendererState().RendererSettings.EnableDebugLog )
+            LogInfo() << "Instancing buffer too small (" << byteWidth
+            << "), need " << sizeof( VobInstanceInfo ) * order.size()
+            << " bytes. Recreating buffer.";
+
+        DynamicInstancingBuffer->Init(
+            nullptr, sizeof( VobInstanceInfo ) * order.size(),
+            D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_DYNAMIC,
+            D3D11VertexBuffer::CA_WRITE );
+
+        SetDebugName( DynamicInstancingBuffer->GetShaderResourceView().Get(), "DynamicInstancingBuffer->ShaderResourceView" );
+        SetDebugName( DynamicInstancingBuffer->GetVertexBuffer().Get(), "DynamicInstancingBuffer->VertexBuffer" );
+    }
+
+    XMFLOAT4X4 viewMatrix;
+    XMStoreFloat4x4( &viewMatrix, view );
+
+    byte* data;
+    UINT size;
+    if ( XR_SUCCESS != DynamicInstancingBuffer->Map( D3D11VertexBuffer::M_WRITE_DISCARD, (void**)&data, &size ) )
+        return;
+    DecalInstancing::WriteInstanceMatrices( inputs.data(), order.data(), order.size(),
+        &viewMatrix._11, &camPos.x, data, sizeof( VobInstanceInfo ) );
+    DynamicInstancingBuffer->Unmap();
+
     SetDefaultStates();
 
     Engine::GAPI->GetRendererState().RasterizerState.CullMode = GothicRasterizerStateInfo::CM_CULL_NONE;
     Engine::GAPI->GetRendererState().RasterizerState.SetDirty();
 
-    XMMATRIX view = Engine::GAPI->GetViewMatrixXM();
     Engine::GAPI->SetViewTransformXM( view );  // Update view transform
 
     // Set up alpha
@@ -5654,26 +6245,15 @@ void D3D11GraphicsEngine::DrawDecalList( const std::vector<zCVob*>& decals,
         SetActivePixelShader( "PS_World" );
     }
 
-    SetActiveVertexShader( "VS_Decal" );
+    SetActiveVertexShader( "VS_DecalInstanced" );
 
     SetupVS_ExMeshDrawCall();
     SetupVS_ExConstantBuffer();
-    XMFLOAT3 camPos = Engine::GAPI->GetCameraPosition();
 
     int lastAlphaFunc = -1;
-    for ( unsigned int i = 0; i < decals.size(); i++ ) {
-        zCDecal* d = (zCDecal*)decals[i]->GetVisual();
-
-        if ( !d ) {
-            continue;
-        }
-
-        if ( lighting && !d->GetAlphaTestEnabled() )
-            continue;  // Only allow no alpha or alpha test
-
-        if ( !lighting ) {
-            int alphaFunc = d->GetDecalSettings()->DecalMaterial->GetAlphaFunc();
-            switch ( alphaFunc ) {
+    for ( const DecalBatch& batch : DecalBatches.GetBatches() ) {
+        if ( !lighting && lastAlphaFunc != batch.AlphaFunc ) {
+            switch ( batch.AlphaFunc ) {
             case zMAT_ALPHA_FUNC_BLEND:
                 Engine::GAPI->GetRendererState().BlendState.SetAlphaBlending();
                 break;
@@ -5689,67 +6269,25 @@ void D3D11GraphicsEngine::DrawDecalList( const std::vector<zCVob*>& decals,
             case zMAT_ALPHA_FUNC_MUL2:
                 Engine::GAPI->GetRendererState().BlendState.SetModulate2Blending();
                 break;
-
-            default:
-                continue;
             }
 
-            if ( lastAlphaFunc != alphaFunc ) {
-                Engine::GAPI->GetRendererState().BlendState.SetDirty();
-                UpdateRenderStates();
-                lastAlphaFunc = alphaFunc;
-            }
-        }
-
-        int alignment = decals[i]->GetAlignment();
-
-        XMMATRIX world = decals[i]->GetWorldMatrixXM();
-
-        XMMATRIX offset =
-            XMMatrixTranslation( d->GetDecalSettings()->DecalOffset.x, -d->GetDecalSettings()->DecalOffset.y, 0 );
-
-        XMMATRIX scale =
-            XMMatrixTranspose( XMMatrixScaling( d->GetDecalSettings()->DecalSize.x * 2,
-                -d->GetDecalSettings()->DecalSize.y * 2, 1 ) );
-
-        if ( alignment == zVISUAL_CAM_ALIGN_YAW ) {
-            XMFLOAT3 decalPos = decals[i]->GetPositionWorld();
-            float angle = atan2( decalPos.x - camPos.x, decalPos.z - camPos.z );
-            XMMATRIX rotationVector = XMMatrixTranspose( XMMatrixRotationY( angle ) );
-            //world *= rotationVector;
-
-            // We only need to change rotation vectors - maintain old W-coordinates
-            XMStoreFloat3( reinterpret_cast<XMFLOAT3*>(&world.r[0]), rotationVector.r[0] );
-            XMStoreFloat3( reinterpret_cast<XMFLOAT3*>(&world.r[1]), rotationVector.r[1] );
-            XMStoreFloat3( reinterpret_cast<XMFLOAT3*>(&world.r[2]), rotationVector.r[2] );
-        } else if ( alignment == zVISUAL_CAM_ALIGN_FULL ) {
-            XMFLOAT3 decalPos = decals[i]->GetPositionWorld();
-            world = XMMatrixIdentity();
-            reinterpret_cast<XMFLOAT4*>(&world.r[0])->w = decalPos.x;
-            reinterpret_cast<XMFLOAT4*>(&world.r[1])->w = decalPos.y;
-            reinterpret_cast<XMFLOAT4*>(&world.r[2])->w = decalPos.z;
+            Engine::GAPI->GetRendererState().BlendState.SetDirty();
+            lastAlphaFunc = batch.AlphaFunc;
         }
 
-        XMMATRIX mat = view * world * offset * scale;
-
-        ParticleInstanceInfo ii;
-        ii.scale = float2( 50, 50 );
-        ii.color = 0xFFFFFFFF;
-
-        Engine::GAPI->SetWorldTransformXM( mat );
-        SetupVS_ExPerInstanceConstantBuffer();
-
-        if ( zCMaterial* material = d->GetDecalSettings()->DecalMaterial ) {
+        if ( zCMaterial* material = (zCMaterial*)batch.Material ) {
             if ( zCTexture* texture = material->GetTexture() ) {
                 if ( texture->CacheIn( 0.6f ) != zRES_CACHED_IN ) {
                     continue;  // Don't render not cached surfaces
                 }
 
-                d->GetDecalSettings()->DecalMaterial->BindTexture( 0 );
+                material->BindTexture( 0 );
             }
         }
 
-        DrawVertexBufferIndexed( QuadVertexBuffer, QuadIndexBuffer, 6 );
+        UpdateRenderStates();
+        DrawInstanced( QuadVertexBuffer, QuadIndexBuffer, 6, DynamicInstancingBuffer.get(), sizeof( VobInstanceInfo ),
+            batch.NumInstances, sizeof( ExVertexStruct ), batch.FirstInstance );
     }
 }
 
@@ -6083,8 +6621,8 @@ void D3D11GraphicsEngine::DrawFrameParticleMeshes( std::unordered_map<zCVob*, Me
 
 /** Draws particle effects */
 void D3D11GraphicsEngine::DrawFrameParticles(
-    std::map<zCTexture*, std::vector<ParticleInstanceInfo>>& particles,
-    std::map<zCTexture*, ParticleRenderInfo>& info ) {
+    FrameParticleMap& particles,
+    FrameParticleInfoMap& info ) {
     if ( particles.empty() ) return;
     SetDefaultStates();
 
@@ -6122,8 +6660,8 @@ void D3D11GraphicsEngine::DrawFrameParticles(
     state.RasterizerState.CullMode = GothicRasterizerStateInfo::CM_CULL_NONE;
     state.RasterizerState.SetDirty();
 
-    std::vector<std::tuple<zCTexture*, ParticleRenderInfo*, std::vector<ParticleInstanceInfo>*>> pvecAdd;
-    std::vector<std::tuple<zCTexture*, ParticleRenderInfo*, std::vector<ParticleInstanceInfo>*>> pvecRest;
+    FrameVector<std::tuple<zCTexture*, ParticleRenderInfo*, FrameVector<ParticleInstanceInfo>*>> pvecAdd;
+    FrameVector<std::tuple<zCTexture*, ParticleRenderInfo*, FrameVector<ParticleInstanceInfo>*>> pvecRest;
     for ( auto&& textureParticle : particles ) {
         if ( textureParticle.second.empty() ) continue;
 
@@ -6161,7 +6699,7 @@ void D3D11GraphicsEngine::DrawFrameParticles(
     for ( auto const& textureParticleRenderInfo : pvecAdd ) {
         zCTexture* tx = std::get<0>( textureParticleRenderInfo );
         ParticleRenderInfo& partInfo = *std::get<1>( textureParticleRenderInfo );
-        std::vector<ParticleInstanceInfo>& instances = *std::get<2>( textureParticleRenderInfo );
+        FrameVector<ParticleInstanceInfo>& instances = *std::get<2>( textureParticleRenderInfo );
 
         if ( instances.empty() ) continue;
 
@@ -6190,7 +6728,7 @@ void D3D11GraphicsEngine::DrawFrameParticles(
     for ( auto const& textureParticleRenderInfo : pvecRest ) {
         zCTexture* tx = std::get<0>( textureParticleRenderInfo );
         ParticleRenderInfo& partInfo = *std::get<1>( textureParticleRenderInfo );
-        std::vector<ParticleInstanceInfo>& instances = *std::get<2>( textureParticleRenderInfo );
+        FrameVector<ParticleInstanceInfo>& instances = *std::get<2>( textureParticleRenderInfo );
 
         if ( instances.empty() ) continue;
 
@@ -6359,94 +6897,6 @@ void D3D11GraphicsEngine::SaveScreenshot() {
     Engine::GAPI->PrintMessageTimed( INT2( 30, 30 ), "Screenshot taken: " + name );
 }
 
-namespace UI::zFont {
-    void AppendGlyphs(
-        std::vector<ExVertexStruct>& vertices,
-        const std::string& str, size_t strLen,
-        float x, float y,
-        const ::zFont* font,
-        zColor fontColor, float scale = 1.0f, zCCamera* camera = nullptr ) {
-
-        const float SpaceBetweenChars = 1.0f * scale;
-
-        float xpos = x, ypos = y;
-
-        float farZ;
-        if ( camera ) farZ = camera->GetNearPlane() + 1.0f;
-        else                       farZ = 1.0f;
-
-        vertices.resize( strLen * 6 );
-        for ( size_t i = 0; i < strLen; ++i ) {
-            const unsigned char& c = str[i];
-
-            auto topLeft = font->fontuv1[c];
-            auto botRight = font->fontuv2[c];
-            auto widthPx = float( font->width[c] ) * scale;
-
-            ExVertexStruct* vertex = &vertices[i * 6];
-
-            const float widthf = float( widthPx );
-            const float heightf = float( font->height ) * scale;
-
-            const float minx = float( xpos );
-            const float miny = float( ypos );
-
-            // prepare for next glyph
-            if ( c == '\n' ) { ypos += heightf; xpos = x; } else if ( c == ' ' ) { xpos += widthPx; continue; } else { xpos += widthPx + SpaceBetweenChars; }
-
-            const float maxx = (minx + widthf);
-            const float maxy = (miny + heightf);
-
-            float halfTexel = 0.0f;
-
-            const float texelHalfW = halfTexel / widthf;
-            const float texelHalfH = halfTexel / heightf;
-
-            const float minu = topLeft.pos.x + texelHalfW;
-            const float maxu = botRight.pos.x - texelHalfW;
-            const float minv = topLeft.pos.y + texelHalfH;
-            const float maxv = texelHalfH + botRight.pos.y;
-
-            for ( size_t j = 0; j < 6; j++ ) {
-                vertex[j].Normal = { 1, 0, 0 };
-                vertex[j].TexCoord2 = { 0, 1 };
-                vertex[j].Position.z = farZ;
-                vertex[j].Color = fontColor.dword;
-            }
-
-            vertex[0].Position.x = minx;
-            vertex[0].Position.y = miny;
-            vertex[0].TexCoord.x = minu;
-            vertex[0].TexCoord.y = minv;
-
-            vertex[1].Position.x = maxx;
-            vertex[1].Position.y = miny;
-            vertex[1].TexCoord.x = maxu;
-            vertex[1].TexCoord.y = minv;
-
-            vertex[2].Position.x = maxx;
-            vertex[2].Position.y = maxy;
-            vertex[2].TexCoord.x = maxu;
-            vertex[2].TexCoord.y = maxv;
-
-            vertex[3].Position.x = maxx;
-            vertex[3].Position.y = maxy;
-            vertex[3].TexCoord.x = maxu;
-            vertex[3].TexCoord.y = maxv;
-
-            vertex[4].Position.x = minx;
-            vertex[4].Position.y = maxy;
-            vertex[4].TexCoord.x = minu;
-            vertex[4].TexCoord.y = maxv;
-
-            vertex[5].Position.x = minx;
-            vertex[5].Position.y = miny;
-            vertex[5].TexCoord.x = minu;
-            vertex[5].TexCoord.y = minv;
-        }
-    }
-}
-
 void D3D11GraphicsEngine::DrawString( const std::string& str, float x, float y, const zFont* font, zColor& fontColor ) {
     if ( str.empty() ) return;
     if ( !font ) return;
@@ -6467,93 +6917,94 @@ void D3D11GraphicsEngine::DrawString( const std::string& str, float x, float y,
         return;
     }
 
+    MyDirectDrawSurface7* surface = tx->GetSurface();
+    if ( !surface ) return;
+
     //
-    // Backup old renderstates, BlendState can be ignored here.
+    // Remove special characters at the end
     //
-    auto oldDepthState = Engine::GAPI->GetRendererState().DepthState.Clone();
-
-    Engine::GAPI->GetRendererState().DepthState.DepthWriteEnabled = false;
-    Engine::GAPI->GetRendererState().DepthState.DepthBufferCompareFunc = GothicDepthBufferStateInfo::CF_COMPARISON_ALWAYS;
-    Engine::GAPI->GetRendererState().DepthState.SetDirty();
+    size_t maxLen = str.size();
+    while ( maxLen > 0 && str[maxLen - 1] == '/' ) {
+        maxLen--;
+    }
 
-    UpdateRenderStates();
+    // The layout is reused for as long as the text stays the same
+    const GlyphRun& run = GlyphRuns->GetRun( str.c_str(), maxLen, *font, UIScale );
+    if ( run.Quads.empty() ) return;
 
     //
-    // Setup Shaders
+    // Text is drawn through the UI-batch, so consecutive strings of the same font end up in one drawcall.
+    // Depth is only changed for the batch, the blendstate stays enabled like it always did.
     //
-
-    SetActiveVertexShader( "VS_TransformedEx" );
-    SetActivePixelShader( "PS_FixedFunctionPipe" );
-
-    // Bind the FF-Info to the first PS slot
-    ActivePS->GetConstantBuffer()[0]->UpdateBuffer( &Engine::GAPI->GetRendererState().GraphicsState );
-    ActivePS->GetConstantBuffer()[0]->BindToPixelShader( 0 );
-
-    BindActiveVertexShader();
-    BindActivePixelShader();
-
-    // Set vertex type
-    GetContext()->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
+    GothicRendererState& state = Engine::GAPI->GetRendererState();
+    if ( !state.BlendState.BlendEnabled ) {
+        state.BlendState.SetAlphaBlending();
+        state.BlendState.SetDirty();
+    }
+
+    FixedFunctionBatchState key;
+    key.Texture = surface;
+    key.VS = ShaderManager->GetVShader( "VS_TransformedEx" );
+    key.PS = ShaderManager->GetPShader( "PS_FixedFunctionPipe" );
+    key.BlendState = state.BlendState;
+    key.DepthState = state.DepthState;
+    key.DepthState.DepthWriteEnabled = false;
+    key.DepthState.DepthBufferCompareFunc = GothicDepthBufferStateInfo::CF_COMPARISON_ALWAYS;
+    key.DepthState.SetDirty();
+    key.RasterizerState = state.RasterizerState;
+    key.GraphicsState = state.GraphicsState;
+    key.PipelineKey = GetPipelineKey( key.BlendState, key.RasterizerState, key.DepthState, key.VS.get(), key.PS.get() );
 
     BindViewportInformation( "VS_TransformedEx", 0 );
 
     //
-    // Convert the characters to verticies which mask the Font-Texture alias
+    // Convert the glyphs to verticies which mask the Font-Texture alias
     //
+    zCCamera* camera = zCCamera::GetCamera();
+    const float farZ = camera ? camera->GetNearPlane() + 1.0f : 1.0f;
 
     static std::vector<ExVertexStruct> vertices;
-    vertices.clear();
+    vertices.resize( run.Quads.size() * 6 );
 
-    //
-    // Glyphen anordnen und in den vertices Vector packen
-    // Ggf. Sonderzeichen am Ende entfernen.
-    // 
-    size_t maxLen = str.size();
-    while ( str[maxLen - 1] == '/' ) {
-        maxLen--;
-    }
+    ExVertexStruct* vertex = &vertices[0];
+    for ( const GlyphQuad& q : run.Quads ) {
+        const float minx = x + q.MinX;
+        const float miny = y + q.MinY;
+        const float maxx = x + q.MaxX;
+        const float maxy = y + q.MaxY;
 
-    UI::zFont::AppendGlyphs( vertices, str, maxLen, x, y, font, fontColor, UIScale, zCCamera::GetCamera() );
+        for ( size_t j = 0; j < 6; j++ ) {
+            vertex[j].Normal = { 1, 0, 0 };
+            vertex[j].TexCoord2 = { 0, 1 };
+            vertex[j].Position.z = farZ;
+            vertex[j].Color = fontColor.dword;
+        }
 
-    //if (str[0] == '(') {
-    //	int o = 1;
-    //}
+        vertex[0].Position.x = minx;
+        vertex[0].Position.y = miny;
+        vertex[0].TexCoord = float2( q.MinU, q.MinV );
 
-    // Bind the texture.
-    tx->Bind( 0 );
+        vertex[1].Position.x = maxx;
+        vertex[1].Position.y = miny;
+        vertex[1].TexCoord = float2( q.MaxU, q.MinV );
 
-    // Set PS resources
-    MyDirectDrawSurface7* surface = tx->GetSurface();
+        vertex[2].Position.x = maxx;
+        vertex[2].Position.y = maxy;
+        vertex[2].TexCoord = float2( q.MaxU, q.MaxV );
 
-    ID3D11ShaderResourceView* srv[3] = {
-        // Get diffuse and normalmap
-        surface->GetEngineTexture()->GetShaderResourceView().Get(),
-        surface->GetNormalmap() ? surface->GetNormalmap()->GetShaderResourceView().Get() : NULL,
-        surface->GetFxMap() ? surface->GetFxMap()->GetShaderResourceView().Get() : NULL,
-    };
+        vertex[3].Position.x = maxx;
+        vertex[3].Position.y = maxy;
+        vertex[3].TexCoord = float2( q.MaxU, q.MaxV );
 
-    // Bind both
+        vertex[4].Position.x = minx;
+        vertex[4].Position.y = maxy;
+        vertex[4].TexCoord = float2( q.MinU, q.MaxV );
 
-    GetContext()->PSSetShaderResources( 0, 3, srv );
-    if ( !Engine::GAPI->GetRendererState().BlendState.BlendEnabled ) {
-        Engine::GAPI->GetRendererState().BlendState.SetAlphaBlending();
-        Engine::GAPI->GetRendererState().BlendState.SetDirty();
-        UpdateRenderStates();
+        vertex[5].Position.x = minx;
+        vertex[5].Position.y = miny;
+        vertex[5].TexCoord = float2( q.MinU, q.MinV );
+        vertex += 6;
     }
 
-    //
-    // Populate TempVertexBuffer
-    //
-    EnsureTempVertexBufferSize( TempVertexBuffer, sizeof( ExVertexStruct ) * vertices.size() );
-    TempVertexBuffer->UpdateBuffer( &vertices[0], sizeof( ExVertexStruct ) * vertices.size() );
-
-    //
-    // Draw the verticies
-    //
-    DrawVertexBuffer( TempVertexBuffer.get(), vertices.size(), sizeof( ExVertexStruct ) );
-
-    oldDepthState.ApplyTo( Engine::GAPI->GetRendererState().DepthState );
-    Engine::GAPI->GetRendererState().DepthState.SetDirty();
-
-    UpdateRenderStates();
+    FFBatcher->AddTriangles( key, &vertices[0], static_cast<unsigned int>(vertices.size()) );
 }
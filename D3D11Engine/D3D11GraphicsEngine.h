@@ -2,8 +2,15 @@
 
 #include "D3D11GraphicsEngineBase.h"
 #include "fpslimiter.h"
+#include "TriangleFanBatcher.h"
+#include "GlyphRunCache.h"
+#include "ShadowCascades.h"
+#include "DecalBatcher.h"
+#include "SkinnedInstanceBatcher.h"
+#include "TransparencyQueue.h"
 
 struct RenderToDepthStencilBuffer;
+struct CameraReplacement;
 
 class D3D11ConstantBuffer;
 class D3D11VertexBuffer;
@@ -20,9 +27,9 @@ enum D3D11ENGINE_RENDER_STAGE {
 const unsigned int DRAWVERTEXARRAY_BUFFER_SIZE = 4096 * sizeof( ExVertexStruct );
 const unsigned int POLYS_BUFFER_SIZE = 1024 * sizeof( ExVertexStruct );
 const unsigned int PARTICLES_BUFFER_SIZE = 3072 * sizeof( ParticleInstanceInfo );
-const unsigned int MORPHEDMESH_SMALL_BUFFER_SIZE = 3072 * sizeof( ExVertexStruct );
-const unsigned int MORPHEDMESH_HIGH_BUFFER_SIZE = 20480 * sizeof( ExVertexStruct );
 const unsigned int HUD_BUFFER_SIZE = 6 * sizeof( ExVertexStruct );
+const unsigned int FF_BATCH_MAX_VERTICES = 3 * 2048;
+const unsigned int FF_BATCH_RING_BUFFER_SIZE = 4 * FF_BATCH_MAX_VERTICES * sizeof( ExVertexStruct );
 const int NUM_MAX_BONES = 96;
 const int unsigned INSTANCING_BUFFER_SIZE = sizeof( VobInstanceInfo ) * 2048;
 
@@ -42,9 +49,38 @@ class GOcean;
 class D3D11HDShader;
 class D3D11OcclusionQuerry;
 struct MeshInfo;
+struct MeshVisualInfo;
 struct RenderToTextureBuffer;
 class D3D11Effect;
 
+/** State a trianglefan of the UI was queued with */
+struct FixedFunctionBatchState {
+    MyDirectDrawSurface7* Texture = nullptr;
+    std::shared_ptr<D3D11VShader> VS;
+    std::shared_ptr<D3D11PShader> PS;
+    GothicBlendStateInfo BlendState;
+    GothicDepthBufferStateInfo DepthState;
+    GothicRasterizerStateInfo RasterizerState;
+    GothicGraphicsState GraphicsState;
+
+    /** Covers the three states and the shaders, see D3D11GraphicsEngineBase::GetPipelineKey.
+        0 if the ids didn't fit, then the keys of the states and the shaders are compared on their own. */
+    uint64_t PipelineKey = 0;
+
+    bool operator == ( const FixedFunctionBatchState& o ) const {
+        if ( Texture != o.Texture || memcmp( &GraphicsState, &o.GraphicsState, sizeof( GothicGraphicsState ) ) != 0 )
+            return false;
+
+        if ( PipelineKey != 0 && o.PipelineKey != 0 )
+            return PipelineKey == o.PipelineKey;
+
+        return VS == o.VS && PS == o.PS
+            && BlendState.Key == o.BlendState.Key
+            && DepthState.Key == o.DepthState.Key
+            && RasterizerState.Key == o.RasterizerState.Key;
+    }
+};
+
 class D3D11GraphicsEngine : public D3D11GraphicsEngineBase {
 public:
     D3D11GraphicsEngine();
@@ -152,12 +188,26 @@ public:
     XRESULT DrawSkeletalVertexNormals( SkeletalVobInfo* vi, const std::vector<DirectX::XMFLOAT4X4>& transforms, float4 color, float fatness = 1.0f );
     virtual XRESULT DrawSkeletalMesh( SkeletalVobInfo* vi, const std::vector<DirectX::XMFLOAT4X4>& transforms, float4 color, float fatness = 1.0f ) override;
 
+    /** Skeletal meshes of the main- and shadow-pass drawn from now on are only queued, to be drawn instanced */
+    void BeginSkinnedInstancing();
+
+    /** Draws everything queued since BeginSkinnedInstancing, one instanced call per submesh and texture */
+    void FlushSkinnedInstances();
+
     /** Draws a screen fade effects */
     virtual XRESULT DrawScreenFade( void* camera ) override;
 
     /** Draws a vertexarray, non-indexed */
     virtual XRESULT DrawVertexArray( ExVertexStruct* vertices, unsigned int numVertices, unsigned int startVertex = 0, unsigned int stride = sizeof( ExVertexStruct ) ) override;
-    virtual XRESULT DrawVertexArrayMM( ExVertexStruct* vertices, unsigned int numVertices, unsigned int startVertex = 0, unsigned int stride = sizeof( ExVertexStruct ) ) override;
+
+    /** Queues a pretransformed trianglefan of gothics UI. Fans sharing the same state are drawn together. */
+    virtual XRESULT DrawTriangleFanBatched( ExVertexStruct* vertices, unsigned int numVertices, MyDirectDrawSurface7* texture ) override;
+
+    /** Draws everything queued by DrawTriangleFanBatched */
+    virtual void FlushBatchedDraws() override;
+
+    /** Draws the vertices of a batch using the state they were queued with */
+    void DrawFixedFunctionBatch( const FixedFunctionBatchState& state, const ExVertexStruct* vertices, unsigned int numVertices );
 
     /** Draws a vertexarray, indexed */
     virtual XRESULT DrawIndexedVertexArray( ExVertexStruct* vertices, unsigned int numVertices, D3D11VertexBuffer* ib, unsigned int numIndices, unsigned int stride = sizeof( ExVertexStruct ) ) override;
@@ -166,6 +216,18 @@ public:
     virtual XRESULT DrawInstanced( D3D11VertexBuffer* vb, D3D11VertexBuffer* ib, unsigned int numIndices, void* instanceData, unsigned int instanceDataStride, unsigned int numInstances, unsigned int vertexStride = sizeof( ExVertexStruct ) );
     virtual XRESULT DrawInstanced( D3D11VertexBuffer* vb, D3D11VertexBuffer* ib, unsigned int numIndices, D3D11VertexBuffer* instanceData, unsigned int instanceDataStride, unsigned int numInstances, unsigned int vertexStride = sizeof( ExVertexStruct ), unsigned int startInstanceNum = 0, unsigned int indexOffset = 0 );
 
+    /** Draws the instances of a static visual out of the DynamicInstancingBuffer, one call per LOD */
+    void DrawVisualInstancesByLOD( MeshVisualInfo* visual, MeshInfo* mesh );
+
+    /** Draws the visible runs of a static visual out of the static instance cache, for the pass being drawn */
+    void DrawVisualInstanceRuns( MeshVisualInfo* visual, MeshInfo* mesh, bool tesselated = false );
+
+    /** Returns whether the pass being drawn has runs of the visual in the static instance cache */
+    bool HasStaticInstanceRuns( const MeshVisualInfo* visual ) const;
+
+    /** Pass of the static instance cache for what is drawn right now, the camera or a shadow cascade */
+    unsigned int GetStaticInstancePass() const;
+
     /** Called when a vob was removed from the world */
     virtual XRESULT OnVobRemovedFromWorld( zCVob* vob );
 
@@ -226,8 +288,8 @@ public:
     /** Draws the world mesh */
     virtual XRESULT DrawWorldMesh( bool noTextures = false );
 
-    /** Draws a list of mesh infos */
-    XRESULT DrawMeshInfoListAlphablended( const std::vector<std::pair<MeshKey, MeshInfo*>>& list );
+    /** Draws a list of mesh infos out of the wrapped worldmesh, in the order of the queue, which holds indices into the list */
+    XRESULT DrawMeshInfoListAlphablended( const std::vector<std::pair<MeshKey, MeshInfo*>>& list, TransparencyQueue& queue );
 
     XRESULT DrawWorldMeshW( bool noTextures = false );
 
@@ -245,12 +307,17 @@ public:
 
     /** Draws everything around the given position */
     void XM_CALLCONV DrawWorldAround( DirectX::FXMVECTOR position, int sectionRange, float vobXZRange, bool cullFront = true, bool dontCull = false );
+
+    /** Draws everything around the given position. With dynamicOnly set, the worldmesh and the static mobs
+        are skipped and only the given vobs and the NPCs are drawn. An empty renderedVobs gets filled with
+        all vobs in range, unless collectVobs is false. */
     void XM_CALLCONV DrawWorldAround( DirectX::FXMVECTOR position,
         float range,
         bool cullFront = true,
         bool indoor = false,
         bool noNPCs = false,
-        std::list<VobInfo*>* renderedVobs = nullptr, std::list<SkeletalVobInfo*>* renderedMobs = nullptr, std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>* worldMeshCache = nullptr );
+        std::list<VobInfo*>* renderedVobs = nullptr, std::list<SkeletalVobInfo*>* renderedMobs = nullptr, std::vector<WorldMeshDrawRange>* worldMeshCache = nullptr,
+        bool dynamicOnly = false, bool collectVobs = true );
 
     /** Update morph mesh visual */
     void UpdateMorphMeshVisual();
@@ -267,10 +334,14 @@ public:
     /** Draws the sky using the GSky-Object */
     virtual XRESULT DrawSky();
 
+    /** Builds the camera to render or sample the given sun-shadow cascade with */
+    void GetShadowCascadeCamera( const ShadowCascade& cascade, CameraReplacement& cr );
+
     /** Renders the shadowmaps for the sun */
     void XM_CALLCONV RenderShadowmaps( DirectX::FXMVECTOR cameraPosition, RenderToDepthStencilBuffer* target = nullptr, bool cullFront = true, bool dontCull = false, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> dsvOverwrite = nullptr, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> debugRTV = nullptr );
 
-    /** Renders the shadowmaps for a pointlight */
+    /** Renders the shadowmaps for a pointlight. With dynamicOnly set, the cube isn't cleared and only
+        the given vobs and the NPCs are drawn on top of what's already in there. */
     void XM_CALLCONV RenderShadowCube( DirectX::FXMVECTOR position,
         float range,
         const RenderToDepthStencilBuffer& targetCube,
@@ -279,7 +350,8 @@ public:
         bool cullFront = true,
         bool indoor = false,
         bool noNPCs = false,
-        std::list<VobInfo*>* renderedVobs = nullptr, std::list<SkeletalVobInfo*>* renderedMobs = nullptr, std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>* worldMeshCache = nullptr );
+        std::list<VobInfo*>* renderedVobs = nullptr, std::list<SkeletalVobInfo*>* renderedMobs = nullptr, std::vector<WorldMeshDrawRange>* worldMeshCache = nullptr,
+        bool dynamicOnly = false, bool collectVobs = true );
 
     /** Updates the occlusion for the bsp-tree */
     void UpdateOcclusion();
@@ -315,7 +387,7 @@ public:
     void OnUIEvent( EUIEvent uiEvent );
 
     /** Draws the given list of decals */
-    void DrawDecalList( const std::vector<zCVob*>& decals, bool lighting );
+    void DrawDecalList( const FrameVector<zCVob*>& decals, bool lighting );
 
     /** Draws underwater effects */
     void DrawUnderwaterEffects();
@@ -330,7 +402,7 @@ public:
     void DrawFrameParticleMeshes( std::unordered_map<zCVob*, MeshVisualInfo*>& progMeshes );
 
     /** Draws particle effects */
-    void DrawFrameParticles( std::map<zCTexture*, std::vector<ParticleInstanceInfo>>& particles, std::map<zCTexture*, ParticleRenderInfo>& info );
+    void DrawFrameParticles( FrameParticleMap& particles, FrameParticleInfoMap& info );
 
     /** Returns the UI-View */
     D2DView* GetUIView() { return UIView.get(); }
@@ -390,8 +462,25 @@ protected:
 
     /** Shadowing */
     std::unique_ptr<RenderToDepthStencilBuffer> WorldShadowmap1;
+
+    /** Far sun-shadow cascade, only drawn again when the camera or the sun moved far enough */
+    std::unique_ptr<RenderToDepthStencilBuffer> WorldShadowmap2;
+    ShadowCascadeSet SunShadowCascades;
+
+    /** Cascade the sun-shadow is currently drawn for, casters which can't reach it are skipped */
+    const ShadowCascade* ActiveShadowCascade;
     std::vector<VobInfo*> RenderedVobs;
 
+    /** Draw calls of the decals, kept around so the arrays don't get reallocated every frame */
+    DecalBatcher DecalBatches;
+
+    /** Skeletal meshes queued between BeginSkinnedInstancing and FlushSkinnedInstances */
+    SkinnedInstanceBatcher SkinnedInstances;
+    bool SkinnedInstancingActive;
+
+    /** Bones of all queued skeletal meshes, read by VS_ExSkeletalInstanced */
+    std::unique_ptr<D3D11VertexBuffer> BonePaletteBuffer;
+
     /** Modulate Quad Marks */
     std::vector<std::pair<zCQuadMark*, const QuadMarkInfo*>> MulQuadMarks;
 
@@ -401,12 +490,22 @@ protected:
     /** The editorcontrols */
     std::unique_ptr<D2DView> UIView;
 
-    /** List of water surfaces for this frame */
-    std::unordered_map<zCTexture*, std::vector<WorldMeshInfo*>> FrameWaterSurfaces;
+    /** List of water surfaces for this frame, with the texture they are drawn with */
+    std::vector<std::pair<zCTexture*, WorldMeshInfo*>> FrameWaterSurfaces;
+
+    /** Visible bodies of the water surfaces, merged into ranges of the wrapped world mesh */
+    std::vector<WaterDrawRange> FrameWaterRanges;
+    std::vector<WaterDrawRange> FrameWaterDepthRanges;
 
     /** List of worldmeshes we have to render using alphablending */
     std::vector<std::pair<MeshKey, MeshInfo*>> FrameTransparencyMeshes;
 
+    /** Sorts FrameTransparencyMeshes back to front */
+    TransparencyQueue FrameTransparencyQueue;
+
+    /** Sorts the alphablended vob-meshes back to front */
+    TransparencyQueue VobTransparencyQueue;
+
     /** Reflection */
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ReflectionCube;
     Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ReflectionCube2;
@@ -426,10 +525,16 @@ protected:
     /** Temporary vertex buffers */
     std::unique_ptr<D3D11VertexBuffer> TempPolysVertexBuffer;
     std::unique_ptr<D3D11VertexBuffer> TempParticlesVertexBuffer;
-    std::unique_ptr<D3D11VertexBuffer> TempMorphedMeshSmallVertexBuffer;
-    std::unique_ptr<D3D11VertexBuffer> TempMorphedMeshBigVertexBuffer;
     std::unique_ptr<D3D11VertexBuffer> TempHUDVertexBuffer;
 
+    /** Batched UI-draws. The vertices are appended to the ring-buffer, the GPU may still read the older parts. */
+    std::unique_ptr<TriangleFanBatcher<ExVertexStruct, FixedFunctionBatchState>> FFBatcher;
+    std::unique_ptr<D3D11VertexBuffer> FFBatchRingBuffer;
+    unsigned int FFBatchRingOffset;
+
+    /** Laid out strings of DrawString, reused while the text doesn't change */
+    std::unique_ptr<GlyphRunCache> GlyphRuns;
+
     /** Cached display modes */
     std::vector<DisplayModeInfo> CachedDisplayModes;
     DXGI_RATIONAL CachedRefreshRate;
@@ -22,6 +22,9 @@ const unsigned int INSTANCING_BUFFER_SIZE = sizeof( VobInstanceInfo ) * 2048;
 D3D11GraphicsEngineBase::D3D11GraphicsEngineBase() {
     OutputWindow = HWND( 0 );
     PresentPending = false;
+    FFRasterizerStateKey = 0;
+    FFBlendStateKey = 0;
+    FFDepthStencilStateKey = 0;
 
     // Match the resolution with the current desktop resolution
     Resolution = Engine::GAPI->GetRendererState().RendererSettings.LoadedResolution;
@@ -358,55 +361,94 @@ XRESULT D3D11GraphicsEngineBase::DrawVertexArray( ExVertexStruct* vertices, unsi
 
 /** Recreates the renderstates */
 XRESULT D3D11GraphicsEngineBase::UpdateRenderStates() {
-    if ( Engine::GAPI->GetRendererState().BlendState.StateDirty ) {
-        D3D11BlendStateInfo* state = (D3D11BlendStateInfo*)GothicStateCache::s_BlendStateMap[Engine::GAPI->GetRendererState().BlendState];
+    GothicRendererState& state = Engine::GAPI->GetRendererState();
 
-        if ( !state ) {
-            // Create new state
-            state = new D3D11BlendStateInfo( Engine::GAPI->GetRendererState().BlendState );
+    if ( state.BlendState.StateDirty ) {
+        FFBlendState = GetCachedState( state.BlendState )->State.Get();
+        FFBlendStateKey = state.BlendState.Key;
 
-            GothicStateCache::s_BlendStateMap[Engine::GAPI->GetRendererState().BlendState] = state;
-        }
-
-        FFBlendState = state->State.Get();
         auto float4zeros = float4( 0, 0, 0, 0 );
-        Engine::GAPI->GetRendererState().BlendState.StateDirty = false;
+        state.BlendState.StateDirty = false;
         GetContext()->OMSetBlendState( FFBlendState.Get(), reinterpret_cast<float*>(&float4zeros), 0xFFFFFFFF );
     }
 
-    if ( Engine::GAPI->GetRendererState().RasterizerState.StateDirty ) {
-        D3D11RasterizerStateInfo* state = (D3D11RasterizerStateInfo*)GothicStateCache::s_RasterizerStateMap[Engine::GAPI->GetRendererState().RasterizerState];
+    if ( state.RasterizerState.StateDirty ) {
+        FFRasterizerState = GetCachedState( state.RasterizerState )->State.Get();
+        FFRasterizerStateKey = state.RasterizerState.Key;
+
+        state.RasterizerState.StateDirty = false;
+        GetContext()->RSSetState( FFRasterizerState.Get() );
+    }
 
-        if ( !state ) {
-            // Create new state
-            state = new D3D11RasterizerStateInfo( Engine::GAPI->GetRendererState().RasterizerState );
+    if ( state.DepthState.StateDirty ) {
+        FFDepthStencilState = GetCachedState( state.DepthState )->State.Get();
+        FFDepthStencilStateKey = state.DepthState.Key;
 
-            GothicStateCache::s_RasterizerStateMap[Engine::GAPI->GetRendererState().RasterizerState] = state;
-        }
+        state.DepthState.StateDirty = false;
+        GetContext()->OMSetDepthStencilState( FFDepthStencilState.Get(), 0 );
+    }
+
+    return XR_SUCCESS;
+}
 
-        FFRasterizerState = state->State.Get();
+/** Returns the state-object for the state and creates it if it isn't cached yet */
+D3D11BlendStateInfo* D3D11GraphicsEngineBase::GetCachedState( GothicBlendStateInfo& state ) {
+    if ( !state.Key )
+        state.SetDirty();
 
-        Engine::GAPI->GetRendererState().RasterizerState.StateDirty = false;
-        GetContext()->RSSetState( FFRasterizerState.Get() );
+    D3D11BlendStateInfo* object = static_cast<D3D11BlendStateInfo*>(GothicStateCache::s_BlendStateMap.Find( state.Key, &state.CacheId ));
+    if ( !object ) {
+        // Create new state
+        object = new D3D11BlendStateInfo( state );
+        state.CacheId = GothicStateCache::s_BlendStateMap.Insert( state.Key, object );
     }
 
-    if ( Engine::GAPI->GetRendererState().DepthState.StateDirty ) {
-        D3D11DepthBufferState* state = (D3D11DepthBufferState*)GothicStateCache::s_DepthBufferMap[Engine::GAPI->GetRendererState().DepthState];
+    return object;
+}
 
-        if ( !state ) {
-            // Create new state
-            state = new D3D11DepthBufferState( Engine::GAPI->GetRendererState().DepthState );
+D3D11RasterizerStateInfo* D3D11GraphicsEngineBase::GetCachedState( GothicRasterizerStateInfo& state ) {
+    if ( !state.Key )
+        state.SetDirty();
 
-            GothicStateCache::s_DepthBufferMap[Engine::GAPI->GetRendererState().DepthState] = state;
-        }
+    D3D11RasterizerStateInfo* object = static_cast<D3D11RasterizerStateInfo*>(GothicStateCache::s_RasterizerStateMap.Find( state.Key, &state.CacheId ));
+    if ( !object ) {
+        // Create new state
+        object = new D3D11RasterizerStateInfo( state );
+        state.CacheId = GothicStateCache::s_RasterizerStateMap.Insert( state.Key, object );
+    }
 
-        FFDepthStencilState = state->State.Get();
+    return object;
+}
 
-        Engine::GAPI->GetRendererState().DepthState.StateDirty = false;
-        GetContext()->OMSetDepthStencilState( FFDepthStencilState.Get(), 0 );
+D3D11DepthBufferState* D3D11GraphicsEngineBase::GetCachedState( GothicDepthBufferStateInfo& state ) {
+    if ( !state.Key )
+        state.SetDirty();
+
+    D3D11DepthBufferState* object = static_cast<D3D11DepthBufferState*>(GothicStateCache::s_DepthBufferMap.Find( state.Key, &state.CacheId ));
+    if ( !object ) {
+        // Create new state
+        object = new D3D11DepthBufferState( state );
+        state.CacheId = GothicStateCache::s_DepthBufferMap.Insert( state.Key, object );
     }
 
-    return XR_SUCCESS;
+    return object;
+}
+
+/** Key over the fixed function states and the shaders */
+uint64_t D3D11GraphicsEngineBase::GetPipelineKey( GothicBlendStateInfo& blendState, GothicRasterizerStateInfo& rasterizerState,
+    GothicDepthBufferStateInfo& depthState, D3D11VShader* vs, D3D11PShader* ps ) {
+    // The depth-state goes in by its key, the other two need the id of their state-object
+    if ( blendState.CacheId == PipelineStateKey::INVALID_ID )
+        GetCachedState( blendState );
+
+    if ( rasterizerState.CacheId == PipelineStateKey::INVALID_ID )
+        GetCachedState( rasterizerState );
+
+    if ( !depthState.Key )
+        depthState.SetDirty();
+
+    return PipelineStateKey::MakePipelineKey( depthState.Key, blendState.CacheId, rasterizerState.CacheId,
+        vs ? vs->GetID() : 0, ps ? ps->GetID() : 0 );
 }
 
 
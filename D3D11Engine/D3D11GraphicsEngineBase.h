@@ -6,6 +6,9 @@
 class D3D11DepthBufferState;
 class D3D11BlendStateInfo;
 class D3D11RasterizerStateInfo;
+struct GothicDepthBufferStateInfo;
+struct GothicBlendStateInfo;
+struct GothicRasterizerStateInfo;
 class D3D11PShader;
 class D3D11VShader;
 class D3D11HDShader;
@@ -81,10 +84,6 @@ public:
 
     /** Draws a vertexarray, used for rendering gothics UI */
     virtual XRESULT DrawVertexArray( ExVertexStruct* vertices, unsigned int numVertices, unsigned int startVertex = 0, unsigned int stride = sizeof( ExVertexStruct ) );
-    virtual XRESULT DrawVertexArrayMM( ExVertexStruct* vertices, unsigned int numVertices, unsigned int startVertex = 0, unsigned int stride = sizeof( ExVertexStruct ) )
-    {
-        return DrawVertexArray( vertices, numVertices, startVertex, stride );
-    }
 
     /** Draws a vertexbuffer, non-indexed, binding the FF-Pipe values */
     virtual XRESULT DrawVertexBufferFF( D3D11VertexBuffer* vb, unsigned int numVertices, unsigned int startVertex, unsigned int stride = sizeof( ExVertexStruct ) );
@@ -107,6 +106,16 @@ public:
     /** Recreates the renderstates */
     XRESULT UpdateRenderStates();
 
+    /** Returns the state-object for the state and creates it if it isn't cached yet. Sets the CacheId of the state. */
+    D3D11BlendStateInfo* GetCachedState( GothicBlendStateInfo& state );
+    D3D11RasterizerStateInfo* GetCachedState( GothicRasterizerStateInfo& state );
+    D3D11DepthBufferState* GetCachedState( GothicDepthBufferStateInfo& state );
+
+    /** Key over the fixed function states and the shaders. Two pipelines with the same key are equal,
+        0 means no key could be made and the states have to be compared one by one. */
+    uint64_t GetPipelineKey( GothicBlendStateInfo& blendState, GothicRasterizerStateInfo& rasterizerState,
+        GothicDepthBufferStateInfo& depthState, D3D11VShader* vs, D3D11PShader* ps );
+
     /** Constructs the makro list for shader compilation */
     static void ConstructShaderMakroList( std::vector<D3D_SHADER_MACRO>& list );
 
@@ -198,11 +207,11 @@ protected:
 
     /** FixedFunction-State render states */
     Microsoft::WRL::ComPtr<ID3D11RasterizerState> FFRasterizerState;
-    size_t FFRasterizerStateHash;
+    uint64_t FFRasterizerStateKey;
     Microsoft::WRL::ComPtr<ID3D11BlendState> FFBlendState;
-    size_t FFBlendStateHash;
+    uint64_t FFBlendStateKey;
     Microsoft::WRL::ComPtr<ID3D11DepthStencilState> FFDepthStencilState;
-    size_t FFDepthStencilStateHash;
+    uint64_t FFDepthStencilStateKey;
 
     /** Debug line-renderer */
     std::unique_ptr<D3D11LineRenderer> LineRenderer;
@@ -6,6 +6,7 @@
 #include "D3D11ConstantBuffer.h"
 #include <d3dcompiler.h>
 #include "D3D11_Helpers.h"
+#include "D3D11ShaderManager.h"
 
 using namespace DirectX;
 
@@ -47,7 +48,7 @@ HRESULT D3D11HDShader::CompileShaderFromFile( const CHAR* szFileName, LPCSTR szE
 #endif
 
     Microsoft::WRL::ComPtr<ID3DBlob> pErrorBlob;
-    hr = D3DCompileFromFile( Toolbox::ToWideChar( szFileName ).c_str(), nullptr, D3D_COMPILE_STANDARD_FILE_INCLUDE, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, pErrorBlob.GetAddressOf() );
+    hr = D3D11ShaderManager::CompileFromFile( szFileName, nullptr, szEntryPoint, szShaderModel, dwShaderFlags, ppBlobOut, pErrorBlob.GetAddressOf() );
     if ( FAILED( hr ) ) {
         LogInfo() << "Shader compilation failed!";
         if ( pErrorBlob.Get() ) {
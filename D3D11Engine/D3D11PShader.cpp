@@ -5,11 +5,20 @@
 #include "GothicAPI.h"
 #include "D3D11ConstantBuffer.h"
 #include <d3dcompiler.h>
+#include <atomic>
 #include "D3D11_Helpers.h"
+#include "D3D11ShaderManager.h"
 
 using namespace DirectX;
 
-D3D11PShader::D3D11PShader() {}
+namespace {
+    /** 0 is left for "no shader" in the pipeline keys */
+    std::atomic<UINT> NextShaderID = 1;
+}
+
+D3D11PShader::D3D11PShader() {
+    ID = NextShaderID++;
+}
 
 D3D11PShader::~D3D11PShader() {
     for ( unsigned int i = 0; i < ConstantBuffers.size(); i++ ) {
@@ -46,7 +55,7 @@ HRESULT D3D11PShader::CompileShaderFromFile( const CHAR* szFileName, LPCSTR szEn
     m.insert( m.begin(), makros.begin(), makros.end() );
 
     Microsoft::WRL::ComPtr<ID3DBlob> pErrorBlob;
-    hr = D3DCompileFromFile( Toolbox::ToWideChar( szFileName ).c_str(), &m[0], D3D_COMPILE_STANDARD_FILE_INCLUDE, szEntryPoint, szShaderModel, dwShaderFlags, 0, ppBlobOut, &pErrorBlob );
+    hr = D3D11ShaderManager::CompileFromFile( szFileName, &m[0], szEntryPoint, szShaderModel, dwShaderFlags, ppBlobOut, &pErrorBlob );
 
     if ( FAILED( hr ) ) {
         LogInfo() << "Shader compilation failed!";
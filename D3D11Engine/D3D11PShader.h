@@ -20,11 +20,15 @@ public:
     /** Returns the shader */
     Microsoft::WRL::ComPtr<ID3D11PixelShader> GetShader() { return PixelShader.Get(); }
 
+    /** Unique number of this shader object, used in the pipeline keys */
+    UINT GetID() const { return ID; }
+
 private:
     /** Compiles the shader from file and outputs error messages if needed */
     HRESULT CompileShaderFromFile( const CHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut, const std::vector<D3D_SHADER_MACRO>& makros );
 
     Microsoft::WRL::ComPtr<ID3D11PixelShader> PixelShader;
     std::vector<D3D11ConstantBuffer*> ConstantBuffers;
+    UINT ID;
 };
 
@@ -23,6 +23,8 @@ D3D11PointLight::D3D11PointLight( VobLightInfo* info, bool dynamicLight ) {
 
     DepthCubemap = nullptr;
     ViewMatricesCB = nullptr;
+    CacheRange = 0.0f;
+    RangeProxy = DynamicAABBTree<BaseShadowedPointLight*>::NULL_NODE;
 
     if ( !dynamicLight ) {
         InitDone = false;
@@ -42,12 +44,12 @@ D3D11PointLight::~D3D11PointLight() {
     // Make sure we are out of the init-queue
     while ( !InitDone );
 
+    if ( RangeProxy != DynamicAABBTree<BaseShadowedPointLight*>::NULL_NODE )
+        Engine::GAPI->RemoveShadowedLightRange( RangeProxy );
+
     DepthCubemap.reset();
+    StaticDepthCubemap.reset();
     ViewMatricesCB.reset();
-
-    for ( auto it = WorldMeshCache.begin(); it != WorldMeshCache.end(); it++ ) {
-        SAFE_DELETE( it->second );
-    }
 }
 
 /** Returns true if this is the first time that light is being rendered */
@@ -76,14 +78,6 @@ void D3D11PointLight::InitResources() {
     engine->CreateConstantBuffer( &cb, nullptr, sizeof( CubemapGSConstantBuffer ) );
     ViewMatricesCB.reset( cb );
 
-    // Generate worldmesh cache if we aren't a dynamically added light
-    if ( !DynamicLight ) {
-        WorldConverter::WorldMeshCollectPolyRange( LightInfo->Vob->GetPositionWorld(), LightInfo->Vob->GetLightRange(), Engine::GAPI->GetWorldSections(), WorldMeshCache );
-        WorldCacheInvalid = false;
-    } else {
-        WorldCacheInvalid = true;
-    }
-
     InitDone = true;
 
     Engine::GAPI->LeaveResourceCriticalSection();
@@ -116,19 +110,19 @@ void D3D11PointLight::RenderCubemap( bool forceUpdate ) {
     D3D11GraphicsEngineBase* engineBase = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
     D3D11GraphicsEngine* engine = (D3D11GraphicsEngine*)engineBase; // TODO: Remove and use newer system!
 
-    if ( !NeedsUpdate() && !WantsUpdate() ) {
-        if ( !forceUpdate )
-            return; // Don't update when we don't need to
-    } else {
-        FXMVECTOR xmlastPos = XMLoadFloat3( &LastUpdatePosition );
-        if ( !XMVector3Equal( LightInfo->Vob->GetPositionWorldXM(), xmlastPos ) ) {
-            // Position changed, refresh our caches
-            VobCache.clear();
-            SkeletalVobCache.clear();
-
-            // Invalidate worldcache
-            WorldCacheInvalid = true;
-        }
+    if ( !NeedsUpdate() && !WantsUpdate() && !forceUpdate )
+        return; // Don't update when we don't need to
+
+    FXMVECTOR xmlastPos = XMLoadFloat3( &LastUpdatePosition );
+    bool moved = !XMVector3Equal( LightInfo->Vob->GetPositionWorldXM(), xmlastPos );
+    if ( moved ) {
+        // Position changed, refresh our caches
+        VobCache.clear();
+        SkeletalVobCache.clear();
+
+        // Invalidate worldcache
+        WorldMeshCache.clear();
+        CacheRange = 0.0f;
     }
 
     FXMVECTOR vEyePt = LightInfo->Vob->GetPositionWorldXM();
@@ -191,7 +185,15 @@ void D3D11PointLight::RenderCubemap( bool forceUpdate ) {
     ViewMatricesCB->UpdateBuffer( &gcb );
     ViewMatricesCB->BindToGeometryShader( 2 );
 
-    RenderFullCubemap();
+    // Lights which are carried around would have to redraw the static cube each time anyways
+    if ( Engine::GAPI->GetRendererState().RendererSettings.CachePointlightStaticShadows && !DynamicLight && !moved && DrawnOnce ) {
+        RenderCachedCubemap();
+    } else {
+        // Make sure the static casters get collected again once the light stays where it is
+        Casters.Reset( ShadowCasterSphere() );
+        Casters.ClearChanged();
+        RenderFullCubemap();
+    }
 
     Engine::GAPI->GetRendererState().RasterizerState.DepthClipEnable = oldDepthClip;
     Engine::GAPI->GetRendererState().GraphicsState.SetGraphicsSwitch( GSWITCH_LINEAR_DEPTH, false );
@@ -199,6 +201,11 @@ void D3D11PointLight::RenderCubemap( bool forceUpdate ) {
     LastUpdateColor = LightInfo->Vob->GetLightColor();
     XMStoreFloat3( &LastUpdatePosition, vEyePt );
     DrawnOnce = true;
+
+    // The caches now hold what's in range around here, moved and added vobs get reported for this range.
+    // Flickering lights keep the largest range, the caches aren't recollected for those.
+    CacheRange = std::max( CacheRange, LightInfo->Vob->GetLightRange() * 1.1f );
+    RangeProxy = Engine::GAPI->UpdateShadowedLightRange( this, RangeProxy, LastUpdatePosition, CacheRange );
 }
 
 /** Renders all cubemap faces at once, using the geometry shader */
@@ -216,16 +223,100 @@ void D3D11PointLight::RenderFullCubemap() {
     // Draw no npcs if this is a static light. This is archived by simply not drawing them in the first update
     bool noNPCs = !DrawnOnce;//!LightInfo->Vob->IsStatic();
 
-    // Draw cubemap
-    std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>* wc = &WorldMeshCache;
+    // Draw cubemap. The worldmesh-cache gets filled with the parts in range on the first update after moving.
+    engine->RenderShadowCube( LightInfo->Vob->GetPositionWorldXM(), range, *DepthCubemap, nullptr, nullptr, false, LightInfo->IsIndoorVob, noNPCs, &VobCache, &SkeletalVobCache, &WorldMeshCache );
 
-    // Don't use the cache if we have moved
-    if ( WorldCacheInvalid )
-        wc = nullptr;
+    //Engine::GAPI->GetRendererState().RendererSettings.DrawSkeletalMeshes = oldDrawSkel;
+}
 
-    engine->RenderShadowCube( LightInfo->Vob->GetPositionWorldXM(), range, *DepthCubemap, nullptr, nullptr, false, LightInfo->IsIndoorVob, noNPCs, &VobCache, &SkeletalVobCache, wc );
+/** Redraws the static casters only if needed, copies them into the cubemap and draws the dynamic ones on top */
+void D3D11PointLight::RenderCachedCubemap() {
+    D3D11GraphicsEngineBase* engineBase = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
+    D3D11GraphicsEngine* engine = (D3D11GraphicsEngine*)engineBase; // TODO: Remove and use newer system!
 
-    //Engine::GAPI->GetRendererState().RendererSettings.DrawSkeletalMeshes = oldDrawSkel;
+    if ( !StaticDepthCubemap ) {
+        StaticDepthCubemap = std::make_unique<RenderToDepthStencilBuffer>( engine->GetDevice().Get(),
+            POINTLIGHT_SHADOWMAP_SIZE,
+            POINTLIGHT_SHADOWMAP_SIZE,
+            DXGI_FORMAT_R16_TYPELESS,
+            nullptr,
+            DXGI_FORMAT_D16_UNORM,
+            DXGI_FORMAT_R16_UNORM,
+            6 );
+    }
+
+    float range = LightInfo->Vob->GetLightRange() * 1.1f;
+
+    if ( !Casters.IsBuilt() ) {
+        RebuildCasterSet();
+    }
+
+    if ( Casters.IsStaticDirty() ) {
+        VobCache.clear();
+        for ( BaseVobInfo* vob : Casters.GetStaticCasters() ) {
+            VobCache.emplace_back( static_cast<VobInfo*>(vob) );
+        }
+
+        // The static set is all there is, even if it's empty. Collecting the vobs in range instead would
+        // bake the moved ones into the static map as well.
+        engine->RenderShadowCube( LightInfo->Vob->GetPositionWorldXM(), range, *StaticDepthCubemap, nullptr, nullptr, false, LightInfo->IsIndoorVob, true, &VobCache, &SkeletalVobCache, &WorldMeshCache, false, false );
+
+        Casters.OnStaticRendered();
+    }
+
+    engine->GetContext()->CopyResource( DepthCubemap->GetTexture().Get(), StaticDepthCubemap->GetTexture().Get() );
+
+    // Moved vobs and NPCs
+    std::list<VobInfo*> dynamicVobs;
+    for ( BaseVobInfo* vob : Casters.GetDynamicCasters() ) {
+        dynamicVobs.emplace_back( static_cast<VobInfo*>(vob) );
+    }
+
+    engine->RenderShadowCube( LightInfo->Vob->GetPositionWorldXM(), range, *DepthCubemap, nullptr, nullptr, false, LightInfo->IsIndoorVob, false, &dynamicVobs, nullptr, nullptr, true );
+
+    Casters.ClearChanged();
+}
+
+/** Collects the static casters around the light */
+void D3D11PointLight::RebuildCasterSet() {
+    ShadowCasterSphere light;
+    XMStoreFloat3( reinterpret_cast<XMFLOAT3*>(light.Center), LightInfo->Vob->GetPositionWorldXM() );
+    light.Radius = LightInfo->Vob->GetLightRange() * 1.1f;
+    Casters.Reset( light );
+
+    bool isOutdoor = (Engine::GAPI->GetLoadedWorldInfo()->BspTree->GetBspTreeMode() == zBSP_MODE_OUTDOOR);
+
+    // Same candidates as DrawWorldAround would collect, from the sections the lights sphere touches
+    for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
+        for ( auto&& ity : itx.second ) {
+            WorldMeshSectionInfo& section = ity.second;
+            if ( !WorldMeshClusterSet::SphereIntersectsBox( light.Center, light.Radius,
+                &section.BoundingBox.Min.x, &section.BoundingBox.Max.x ) ) {
+                continue;
+            }
+
+            for ( VobInfo* vob : section.Vobs ) {
+                if ( !vob->VisualInfo || !vob->Vob->GetShowVisual() )
+                    continue;
+
+                // Don't render inside-vobs when the light is outside and vice-versa
+                if ( isOutdoor && vob->IsIndoorVob != LightInfo->IsIndoorVob )
+                    continue;
+
+                Casters.AddStatic( vob, GetCasterBounds( vob ) );
+            }
+        }
+    }
+}
+
+/** Returns the bounding sphere of a vob */
+ShadowCasterSphere D3D11PointLight::GetCasterBounds( VobInfo* vob ) {
+    ShadowCasterSphere bounds;
+    bounds.Center[0] = vob->LastRenderPosition.x;
+    bounds.Center[1] = vob->LastRenderPosition.y;
+    bounds.Center[2] = vob->LastRenderPosition.z;
+    bounds.Radius = vob->VisualInfo ? vob->VisualInfo->MeshSize : 0.0f;
+    return bounds;
 }
 
 /** Renders the scene with the given view-proj-matrices */
@@ -281,7 +372,36 @@ void D3D11PointLight::OnVobRemovedFromWorld( BaseVobInfo* vob ) {
         // Clear cache, if so
         VobCache.clear();
         SkeletalVobCache.clear();
+        Casters.InvalidateStatic();
     }
 
+    Casters.OnCasterRemoved( vob );
+    if ( Casters.HasChanged() )
+        LightInfo->UpdateShadows = true;
+
     Engine::GAPI->LeaveResourceCriticalSection();
 }
+
+/** Called when a vob changed its position */
+void D3D11PointLight::OnVobMoved( BaseVobInfo* vob ) {
+    if ( std::find( SkeletalVobCache.begin(), SkeletalVobCache.end(), vob ) != SkeletalVobCache.end() ) {
+        // Mobs start to get drawn with the NPCs once they moved
+        SkeletalVobCache.clear();
+        Casters.InvalidateStatic();
+    } else if ( VobInfo* vi = dynamic_cast<VobInfo*>(vob) ) {
+        Casters.OnCasterMoved( vi, GetCasterBounds( vi ) );
+    }
+
+    if ( Casters.HasChanged() )
+        LightInfo->UpdateShadows = true;
+}
+
+/** Called when a vob got added to the world after loading */
+void D3D11PointLight::OnVobAdded( BaseVobInfo* vob ) {
+    if ( VobInfo* vi = dynamic_cast<VobInfo*>(vob) ) {
+        Casters.OnCasterAdded( vi, GetCasterBounds( vi ) );
+    }
+
+    if ( Casters.HasChanged() )
+        LightInfo->UpdateShadows = true;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "BaseShadowedPointLight.h"
 #include "WorldConverter.h"
+#include "ShadowCasterSet.h"
 #include <thread>
 #include <condition_variable>
 
@@ -38,6 +39,15 @@ public:
     /** Called when a vob got removed from the world */
     virtual void OnVobRemovedFromWorld( BaseVobInfo* vob );
 
+    /** Called when a vob changed its position */
+    virtual void OnVobMoved( BaseVobInfo* vob );
+
+    /** Called when a vob got added to the world after loading */
+    virtual void OnVobAdded( BaseVobInfo* vob );
+
+    /** Returns the static and dynamic casters of this light */
+    const ShadowCasterSet<BaseVobInfo*>& GetCasters() const { return Casters; }
+
 protected:
     /** Renders the scene with the given view-proj-matrices */
     void RenderCubemapFace( const DirectX::XMFLOAT4X4& view, const DirectX::XMFLOAT4X4& proj, UINT faceIdx );
@@ -45,13 +55,27 @@ protected:
     /** Renders all cubemap faces at once, using the geometry shader */
     void RenderFullCubemap();
 
+    /** Redraws the static casters only if needed, copies them into the cubemap and draws the dynamic ones on top */
+    void RenderCachedCubemap();
+
+    /** Collects the static casters around the light */
+    void RebuildCasterSet();
+
+    /** Returns the bounding sphere of a vob. Uses the whole mesh size as radius, which also covers meshes with their pivot at the bottom. */
+    static ShadowCasterSphere GetCasterBounds( VobInfo* vob );
+
     std::list<VobInfo*> VobCache;
     std::list<SkeletalVobInfo*> SkeletalVobCache;
-    std::map<MeshKey, WorldMeshInfo*, cmpMeshKey> WorldMeshCache;
-    bool WorldCacheInvalid;
+
+    /** Parts of the worldmesh inside the lights range */
+    std::vector<WorldMeshDrawRange> WorldMeshCache;
 
     VobLightInfo* LightInfo;
     std::unique_ptr<RenderToDepthStencilBuffer> DepthCubemap;
+
+    /** Cubemap with only the static casters in it, gets copied into DepthCubemap */
+    std::unique_ptr<RenderToDepthStencilBuffer> StaticDepthCubemap;
+    ShadowCasterSet<BaseVobInfo*> Casters;
     DirectX::XMFLOAT4X4 CubeMapViewMatrices[6];
     DirectX::XMFLOAT3 LastUpdatePosition;
     DWORD LastUpdateColor;
@@ -59,5 +83,10 @@ protected:
     bool DynamicLight;
     bool InitDone;
     bool DrawnOnce;
+
+    /** Largest range the caches were collected with since the light last moved, and its proxy, see
+        GothicAPI::UpdateShadowedLightRange */
+    float CacheRange;
+    int RangeProxy;
 };
 
@@ -10,9 +10,85 @@
 #include "GothicAPI.h"
 #include "Engine.h"
 #include "Threadpool.h"
+#include "ZipFileSystem.h"
+#include <d3dcompiler.h>
+#include <fstream>
 
 const int NUM_MAX_BONES = 96;
 
+namespace {
+    /** Reads a shader-file from disk, or out of the zip-packs if it isn't there */
+    ZipFile ReadShaderFile( const std::string& file ) {
+        std::ifstream f( file, std::ios::binary | std::ios::ate );
+        if ( f ) {
+            // Wrapped like an inflated file, so both are kept alive the same way. The extra byte
+            // gives even empty files a valid pointer.
+            auto buffer = std::make_shared<std::vector<uint8_t>>( static_cast<size_t>(f.tellg()) + 1, 0 );
+            f.seekg( 0 );
+            f.read( reinterpret_cast<char*>(buffer->data()), buffer->size() - 1 );
+
+            ZipFile loose;
+            loose.Buffer = buffer;
+            loose.Data = buffer->data();
+            loose.Size = static_cast<uint32_t>(buffer->size() - 1);
+            return loose;
+        }
+
+        ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem();
+        return packs ? packs->ReadFile( file ) : ZipFile();
+    }
+
+    /** Resolves #includes like D3D_COMPILE_STANDARD_FILE_INCLUDE, next to the including file, but
+        also finds them inside of the zip-packs */
+    class ShaderFileInclude : public ID3DInclude {
+    public:
+        ShaderFileInclude( const std::string& file ) {
+            RootFolder = file.substr( 0, file.find_last_of( "\\/" ) + 1 );
+        }
+
+        HRESULT __stdcall Open( D3D_INCLUDE_TYPE type, LPCSTR fileName, LPCVOID parentData, LPCVOID* data, UINT* bytes ) override {
+            std::string folder = RootFolder;
+            for ( const OpenFile& parent : OpenFiles ) {
+                if ( parent.File.Data == parentData )
+                    folder = parent.Folder;
+            }
+
+            std::string path = folder + fileName;
+            ZipFile file = ReadShaderFile( path );
+            if ( !file.IsValid() ) {
+                path = RootFolder + fileName;
+                file = ReadShaderFile( path );
+                if ( !file.IsValid() )
+                    return E_FAIL;
+            }
+
+            OpenFiles.push_back( { file, path.substr( 0, path.find_last_of( "\\/" ) + 1 ) } );
+            *data = file.Data;
+            *bytes = file.Size;
+            return S_OK;
+        }
+
+        HRESULT __stdcall Close( LPCVOID data ) override {
+            for ( auto it = OpenFiles.begin(); it != OpenFiles.end(); ++it ) {
+                if ( it->File.Data == data ) {
+                    OpenFiles.erase( it );
+                    break;
+                }
+            }
+            return S_OK;
+        }
+
+    private:
+        struct OpenFile {
+            ZipFile File;
+            std::string Folder;
+        };
+
+        std::string RootFolder;
+        std::vector<OpenFile> OpenFiles;
+    };
+}
+
 D3D11ShaderManager::D3D11ShaderManager() {
     ReloadShadersNextFrame = false;
 }
@@ -55,6 +131,9 @@ XRESULT D3D11ShaderManager::Init() {
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
 
+    Shaders.push_back( ShaderInfo( "VS_DecalInstanced", "VS_DecalInstanced.hlsl", "v", 10 ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+
     Shaders.push_back( ShaderInfo( "VS_ExWater", "VS_ExWater.hlsl", "v", 1 ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstance ) );
@@ -91,6 +170,9 @@ XRESULT D3D11ShaderManager::Init() {
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstanceSkeletal ) );
     Shaders.back().cBufferSizes.push_back( NUM_MAX_BONES * sizeof( DirectX::XMFLOAT4X4 ) );
 
+    Shaders.push_back( ShaderInfo( "VS_ExSkeletalInstanced", "VS_ExSkeletalInstanced.hlsl", "v", 13 ) );
+    Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
+
     Shaders.push_back( ShaderInfo( "VS_ExSkeletalVN", "VS_ExSkeletalVN.hlsl", "v", 3 ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerFrame ) );
     Shaders.back().cBufferSizes.push_back( sizeof( VS_ExConstantBuffer_PerInstanceSkeletal ) );
@@ -477,7 +559,8 @@ XRESULT D3D11ShaderManager::Init() {
 XRESULT D3D11ShaderManager::CompileShader( const ShaderInfo& si ) {
     //Check if shader src-file exists
     std::string fileName = Engine::GAPI->GetStartDirectory() + "\\system\\GD3D11\\shaders\\" + si.fileName;
-    if ( FILE* f = fopen( fileName.c_str(), "r" ) ) {
+    ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem();
+    if ( Toolbox::FileExists( fileName ) || (packs && packs->Exists( "system\\GD3D11\\shaders\\" + si.fileName )) ) {
         //Check shader's type
         if ( si.type == "v" ) {
             // See if this is a reload
@@ -554,8 +637,6 @@ XRESULT D3D11ShaderManager::CompileShader( const ShaderInfo& si ) {
                 UpdateGShader( si.name, gs );
             }
         }
-
-        fclose( f );
     }
 
     // Hull/Domain shaders are handled differently, they check inside for missing file
@@ -587,6 +668,17 @@ XRESULT D3D11ShaderManager::CompileShader( const ShaderInfo& si ) {
     return XR_SUCCESS;
 }
 
+/** Compiles a shader-file like D3DCompileFromFile */
+HRESULT D3D11ShaderManager::CompileFromFile( const std::string& file, const D3D_SHADER_MACRO* makros, LPCSTR entryPoint, LPCSTR target,
+    UINT flags, ID3DBlob** code, ID3DBlob** errors ) {
+    ZipFile source = ReadShaderFile( file );
+    if ( !source.IsValid() )
+        return HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND );
+
+    ShaderFileInclude include( file );
+    return D3DCompile( source.Data, source.Size, file.c_str(), makros, &include, entryPoint, target, flags, 0, code, errors );
+}
+
 /** Loads/Compiles Shaderes from list */
 XRESULT D3D11ShaderManager::LoadShaders() {
     size_t numThreads = std::thread::hardware_concurrency();
@@ -594,6 +686,16 @@ XRESULT D3D11ShaderManager::LoadShaders() {
         numThreads = numThreads - 1;
     }
     auto compilationTP = std::make_unique<ThreadPool>( numThreads );
+
+    // Inflate the packed sources all at once, the compilers then find them in the cache of the packs
+    if ( ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem() ) {
+        std::vector<std::string> files;
+        for ( const ShaderInfo& si : Shaders ) {
+            files.push_back( "system\\GD3D11\\shaders\\" + si.fileName );
+        }
+        packs->ReadFiles( files, compilationTP.get() );
+    }
+
     LogInfo() << "Compiling/Reloading shaders with " << compilationTP->getNumThreads() << " threads";
     for ( const ShaderInfo& si : Shaders ) {
         compilationTP->enqueue( [this, si]() { CompileShader( si ); } );
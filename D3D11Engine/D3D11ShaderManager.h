@@ -65,6 +65,11 @@ public:
     std::shared_ptr<D3D11PShader> GetPShader( const std::string& shader );
     std::shared_ptr<D3D11HDShader> GetHDShader( const std::string& shader );
     std::shared_ptr<D3D11GShader> GetGShader( const std::string& shader );
+
+    /** Compiles a shader-file like D3DCompileFromFile. The file and its includes are read out of the
+        zip-packs if they aren't on disk. */
+    static HRESULT CompileFromFile( const std::string& file, const D3D_SHADER_MACRO* makros, LPCSTR entryPoint, LPCSTR target,
+        UINT flags, ID3DBlob** code, ID3DBlob** errors );
 private:
     XRESULT CompileShader( const ShaderInfo& si );
 
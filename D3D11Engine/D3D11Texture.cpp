@@ -4,9 +4,11 @@
 #include "D3D11GraphicsEngineBase.h"
 #include "GothicAPI.h"
 #include <DDSTextureLoader.h>
-#include "RenderToTextureBuffer.h"
 #include <d3dcompiler.h>
 #include "D3D11_Helpers.h"
+#include "DDSParser.h"
+#include "TextureProcessing.h"
+#include "ZipFileSystem.h"
 
 using namespace DirectX;
 
@@ -56,6 +58,12 @@ XRESULT D3D11Texture::Init( const std::string& file ) {
 
     //LogInfo() << "Loading Engine-Texture: " << file;
 
+    // Loose files win over the packs, so mods can still override single textures
+    ZipFileSystem* packs = Engine::GAPI ? Engine::GAPI->GetZipFileSystem() : nullptr;
+    if ( packs && !Toolbox::FileExists( file ) && packs->Exists( file ) ) {
+        return InitPacked( packs->ReadFile( file ), file );
+    }
+
     Microsoft::WRL::ComPtr<ID3D11Texture2D> res;
     LE( CreateDDSTextureFromFile( engine->GetDevice().Get(), Toolbox::ToWideChar( file.c_str() ).c_str(), (ID3D11Resource**)res.ReleaseAndGetAddressOf(), ShaderResourceView.GetAddressOf() ) );
 
@@ -76,12 +84,94 @@ XRESULT D3D11Texture::Init( const std::string& file ) {
     return XR_SUCCESS;
 }
 
+/** Initializes several textures from files at once */
+XRESULT D3D11Texture::InitFiles( const std::vector<D3D11Texture*>& textures, const std::vector<std::string>& files ) {
+    // Loose files win over the packs, so only the others are read from there
+    std::vector<std::string> packedFiles( files.size() );
+    ZipFileSystem* packs = Engine::GAPI ? Engine::GAPI->GetZipFileSystem() : nullptr;
+    for ( size_t i = 0; packs && i < files.size(); i++ ) {
+        if ( !Toolbox::FileExists( files[i] ) && packs->Exists( files[i] ) )
+            packedFiles[i] = files[i];
+    }
+
+    std::vector<ZipFile> packed;
+    if ( packs ) {
+        packed = packs->ReadFiles( packedFiles, Engine::WorkerThreadPool );
+    }
+
+    XRESULT result = XR_SUCCESS;
+    for ( size_t i = 0; i < textures.size(); i++ ) {
+        XRESULT r = packedFiles[i].empty() ? textures[i]->Init( files[i] ) : textures[i]->InitPacked( packed[i], files[i] );
+        if ( r != XR_SUCCESS )
+            result = r;
+    }
+
+    return result;
+}
+
+/** Initializes the texture from a DDS-File read out of the zip-packs */
+XRESULT D3D11Texture::InitPacked( const ZipFile& packed, const std::string& file ) {
+    if ( !packed.IsValid() ) {
+        LogWarn() << "Failed to read packed texture '" << file << "'";
+        return XR_FAILED;
+    }
+
+    DDS::ImageInfo info;
+    DDS::EParseResult result = DDS::Parse( packed.Data, packed.Size, info );
+    if ( result != DDS::PR_OK ) {
+        LogWarn() << "Failed to parse packed texture '" << file << "': " << DDS::ResultToString( result );
+        return XR_FAILED;
+    }
+
+    return Init( info, packed.Data, file );
+}
+
+/** Initializes the texture from an already parsed DDS-File */
+XRESULT D3D11Texture::Init( const DDS::ImageInfo& info, const uint8_t* data, const std::string& fileName ) {
+    HRESULT hr;
+    D3D11GraphicsEngineBase* engine = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
+
+    TextureFormat = (DXGI_FORMAT)info.Format;
+    TextureSize = INT2( info.Width, info.Height );
+    MipMapCount = info.MipCount;
+
+    // Point D3D11 straight at the mip-levels, so the data is only copied once by the driver
+    D3D11_SUBRESOURCE_DATA subresources[DDS::MAX_MIP_LEVELS];
+    for ( UINT i = 0; i < info.MipCount; i++ ) {
+        subresources[i].pSysMem = data + info.Mips[i].Offset;
+        subresources[i].SysMemPitch = info.Mips[i].RowPitch;
+        subresources[i].SysMemSlicePitch = info.Mips[i].Size;
+    }
+
+    CD3D11_TEXTURE2D_DESC textureDesc(
+        TextureFormat,
+        info.Width,
+        info.Height,
+        1,
+        info.MipCount,
+        D3D11_BIND_SHADER_RESOURCE, D3D11_USAGE_IMMUTABLE, 0, 1, 0, 0 );
+
+    LE( engine->GetDevice()->CreateTexture2D( &textureDesc, subresources, Texture.ReleaseAndGetAddressOf() ) );
+    if ( !Texture.Get() )
+        return XR_FAILED;
+
+    SetDebugName( Texture.Get(), "D3D11Texture(\"" + fileName + "\")->Texture" );
+
+    LE( engine->GetDevice()->CreateShaderResourceView( Texture.Get(), nullptr, ShaderResourceView.ReleaseAndGetAddressOf() ) );
+    if ( !ShaderResourceView.Get() )
+        return XR_FAILED;
+
+    SetDebugName( ShaderResourceView.Get(), "D3D11Texture(\"" + fileName + "\")->ShaderResourceView" );
+
+    return XR_SUCCESS;
+}
+
 /** Updates the Texture-Object */
 XRESULT D3D11Texture::UpdateData( void* data, int mip ) {
     D3D11GraphicsEngineBase* engine = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
 
-    UINT TextureWidth = (TextureSize.x >> mip);
-    UINT TextureHeight = (TextureSize.y >> mip);
+    UINT TextureWidth = std::max( TextureSize.x >> mip, 1 );
+    UINT TextureHeight = std::max( TextureSize.y >> mip, 1 );
 
     Microsoft::WRL::ComPtr<ID3D11Texture2D> stagingTexture;
     D3D11_TEXTURE2D_DESC stagingTextureDesc;
@@ -112,8 +202,8 @@ XRESULT D3D11Texture::UpdateData( void* data, int mip ) {
 XRESULT D3D11Texture::UpdateDataDeferred( void* data, int mip ) {
     D3D11GraphicsEngineBase* engine = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
 
-    UINT TextureWidth = (TextureSize.x >> mip);
-    UINT TextureHeight = (TextureSize.y >> mip);
+    UINT TextureWidth = std::max( TextureSize.x >> mip, 1 );
+    UINT TextureHeight = std::max( TextureSize.y >> mip, 1 );
 
     ID3D11Texture2D* stagingTexture;
     D3D11_TEXTURE2D_DESC stagingTextureDesc;
@@ -140,10 +230,40 @@ XRESULT D3D11Texture::UpdateDataDeferred( void* data, int mip ) {
     return XR_SUCCESS;
 }
 
+/** Updates the given mip-level out of RGBA8-pixels */
+XRESULT D3D11Texture::UpdateDataRGBA( const unsigned char* rgba, int mip, UINT numMips, bool deferred ) {
+    TextureProcessOptions options;
+    switch ( TextureFormat ) {
+    case DXGI_FORMAT_R8G8B8A8_UNORM: options.Format = TBF_RGBA8; break;
+    case DXGI_FORMAT_BC1_UNORM: options.Format = TBF_BC1; break;
+    case DXGI_FORMAT_BC3_UNORM: options.Format = TBF_BC3; break;
+    default:
+        return XR_FAILED;
+    }
+
+    options.NumMips = numMips ? numMips : static_cast<UINT>(MipMapCount - mip);
+    options.Pool = Engine::WorkerThreadPool;
+
+    UINT width = std::max( TextureSize.x >> mip, 1 );
+    UINT height = std::max( TextureSize.y >> mip, 1 );
+
+    // Mips and compression are done here, instead of copying through a render target for GenerateMips
+    ProcessedTexture processed;
+    TextureProcessing::Process( rgba, width, height, width * 4, options, processed );
+
+    for ( UINT i = 0; i < processed.Levels.size(); i++ ) {
+        void* data = const_cast<uint8_t*>(processed.GetLevelData( i ));
+        XRESULT result = deferred ? UpdateDataDeferred( data, mip + i ) : UpdateData( data, mip + i );
+        if ( result != XR_SUCCESS )
+            return result;
+    }
+
+    return XR_SUCCESS;
+}
+
 /** Returns the RowPitch-Bytes */
 UINT D3D11Texture::GetRowPitchBytes( int mip ) {
-    int px = (TextureSize.x >> mip);
-    //int py = (TextureSize.y >> mip);
+    int px = std::max( TextureSize.x >> mip, 1 );
 
     if ( TextureFormat == DXGI_FORMAT_BC1_UNORM || TextureFormat == DXGI_FORMAT_BC2_UNORM ||
         TextureFormat == DXGI_FORMAT_BC3_UNORM ) {
@@ -156,8 +276,8 @@ UINT D3D11Texture::GetRowPitchBytes( int mip ) {
 
 /** Returns the size of the texture in bytes */
 UINT D3D11Texture::GetSizeInBytes( int mip ) {
-    int px = (TextureSize.x >> mip);
-    int py = (TextureSize.y >> mip);
+    int px = std::max( TextureSize.x >> mip, 1 );
+    int py = std::max( TextureSize.y >> mip, 1 );
 
     if ( TextureFormat == DXGI_FORMAT_BC1_UNORM || TextureFormat == DXGI_FORMAT_BC2_UNORM ||
         TextureFormat == DXGI_FORMAT_BC3_UNORM ) {
@@ -241,33 +361,3 @@ XRESULT D3D11Texture::CreateThumbnail() {
 const Microsoft::WRL::ComPtr<ID3D11Texture2D>& D3D11Texture::GetThumbnail() {
     return Thumbnail;
 }
-
-/** Generates mipmaps for this texture (may be slow!) */
-XRESULT D3D11Texture::GenerateMipMaps() {
-    if ( MipMapCount == 1 )
-        return XR_SUCCESS;
-
-    D3D11GraphicsEngineBase* engine = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
-
-    std::unique_ptr<RenderToTextureBuffer> b = std::make_unique<RenderToTextureBuffer>( engine->GetDevice().Get(), TextureSize.x, TextureSize.y, DXGI_FORMAT_R8G8B8A8_UNORM, nullptr, DXGI_FORMAT_UNKNOWN, DXGI_FORMAT_UNKNOWN, MipMapCount );
-
-    // Copy the main image
-    engine->GetContext()->CopySubresourceRegion( b->GetTexture().Get(), 0, 0, 0, 0, Texture.Get(), 0, nullptr );
-
-    // Generate mips
-    engine->GetContext()->GenerateMips( b->GetShaderResView().Get() );
-
-    // Copy the full chain back
-    engine->GetContext()->CopyResource( Texture.Get(), b->GetTexture().Get() );
-
-    return XR_SUCCESS;
-}
-
-XRESULT D3D11Texture::GenerateMipMapsDeferred() {
-    if ( MipMapCount == 1 )
-        return XR_SUCCESS;
-
-    Engine::GAPI->AddMipMapGeneration( this );
-
-    return XR_SUCCESS;
-}
@@ -1,6 +1,9 @@
 #pragma once
 #include <wrl/client.h>
 
+namespace DDS { struct ImageInfo; }
+struct ZipFile;
+
 class D3D11Texture {
 public:
     D3D11Texture();
@@ -20,12 +23,23 @@ public:
     /** Initializes the texture from a file */
     XRESULT Init( const std::string& file );
 
+    /** Initializes the texture from an already parsed DDS-File, like one inside a TextureArchive */
+    XRESULT Init( const DDS::ImageInfo& info, const uint8_t* data, const std::string& fileName = "" );
+
+    /** Initializes several textures from files at once. The ones coming out of the zip-packs are
+        inflated in parallel first. Returns XR_FAILED if any of them failed. */
+    static XRESULT InitFiles( const std::vector<D3D11Texture*>& textures, const std::vector<std::string>& files );
+
     /** Updates the Texture-Object */
     XRESULT UpdateData( void* data, int mip = 0 );
 
     /** Updates the Texture-Object using the deferred context (For loading in an other thread) */
     XRESULT UpdateDataDeferred( void* data, int mip );
 
+    /** Updates the given mip-level out of RGBA8-pixels, which get block-compressed first if this is a BC1/BC3-texture.
+        numMips > 1 also fills the following levels with a mip-chain made on the CPU, 0 fills all of them. */
+    XRESULT UpdateDataRGBA( const unsigned char* rgba, int mip, UINT numMips, bool deferred );
+
     /** Returns the RowPitch-Bytes */
     UINT GetRowPitchBytes( int mip );
 
@@ -53,14 +67,13 @@ public:
     /** Returns the thumbnail of this texture. If this returns nullptr, you need to create one first */
     const Microsoft::WRL::ComPtr<ID3D11Texture2D>& GetThumbnail();
 
-    /** Generates mipmaps for this texture (may be slow!) */
-    XRESULT GenerateMipMaps();
-    XRESULT GenerateMipMapsDeferred();
-
     /** Returns this textures ID */
     UINT16 GetID() { return ID; };
 
 private:
+    /** Initializes the texture from a DDS-File read out of the zip-packs */
+    XRESULT InitPacked( const ZipFile& packed, const std::string& file );
+
     /** The ID of this texture */
     UINT16 ID;
 
@@ -24,6 +24,9 @@ public:
     /** Returns the inputlayout */
     Microsoft::WRL::ComPtr<ID3D11InputLayout> GetInputLayout() { return InputLayout.Get(); }
 
+    /** Unique number of this shader object, used in the pipeline keys */
+    UINT GetID() const { return ID; }
+
 private:
     /** Compiles a shader from file and outputs error messages if needed */
     HRESULT CompileShaderFromFile( const CHAR* szFileName, LPCSTR szEntryPoint, LPCSTR szShaderModel, ID3DBlob** ppBlobOut, const std::vector<D3D_SHADER_MACRO>& makros );
@@ -31,5 +34,6 @@ private:
     Microsoft::WRL::ComPtr<ID3D11VertexShader> VertexShader;
     Microsoft::WRL::ComPtr<ID3D11InputLayout> InputLayout;
     std::vector<D3D11ConstantBuffer*> ConstantBuffers;
+    UINT ID;
 };
 
@@ -35,6 +35,7 @@ public:
         M_WRITE = 2,
         M_READ_WRITE = 3,
         M_WRITE_DISCARD = 4,
+        M_WRITE_NO_OVERWRITE = 5,
     };
 
     /** Layed out for D3D11*/
@@ -54,6 +55,9 @@ public:
     /** Updates the vertexbuffer with the given data */
     XRESULT UpdateBufferAligned16( void* data, UINT size = 0 );
 
+    /** Updates only the given byte-range of a buffer created with U_DEFAULT */
+    XRESULT UpdateBufferRange( const void* data, UINT offset, UINT size );
+
     /** Maps the buffer */
     XRESULT Map( int flags, void** dataPtr, UINT* size );
 
@@ -118,6 +118,25 @@ XRESULT D3D11VertexBuffer::UpdateBufferAligned16( void* data, UINT size ) {
     return XR_FAILED;
 }
 
+/** Updates only the given byte-range of a buffer created with U_DEFAULT */
+XRESULT D3D11VertexBuffer::UpdateBufferRange( const void* data, UINT offset, UINT size ) {
+    D3D11GraphicsEngineBase* engine = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
+
+    if ( !VertexBuffer.Get() || offset + size > SizeInBytes ) {
+        return XR_FAILED;
+    }
+
+    D3D11_BOX box = {};
+    box.left = offset;
+    box.right = offset + size;
+    box.bottom = 1;
+    box.back = 1;
+
+    engine->GetContext()->UpdateSubresource( VertexBuffer.Get(), 0, &box, data, 0, 0 );
+
+    return XR_SUCCESS;
+}
+
 /** Maps the buffer */
 XRESULT D3D11VertexBuffer::Map( int flags, void** dataPtr, UINT* size ) {
     D3D11GraphicsEngineBase* engine = (D3D11GraphicsEngineBase*)Engine::GraphicsEngine;
@@ -176,10 +176,14 @@ HRESULT FakeDirectDrawSurface7::Lock( LPRECT lpDestRect, LPDDSURFACEDESC2 lpDDSu
     *lpDDSurfaceDesc = OriginalDesc;
 
     // Allocate some temporary data
+    UINT sizeInBytes;
+    UINT rowPitch;
+    Resource->GetLockBufferSize( MipLevel, sizeInBytes, rowPitch );
+
     delete [] Data;
-    Data = new unsigned char[Resource->GetEngineTexture()->GetSizeInBytes( MipLevel )];
+    Data = new unsigned char[sizeInBytes];
     lpDDSurfaceDesc->lpSurface = Data;
-    lpDDSurfaceDesc->lPitch = Resource->GetEngineTexture()->GetRowPitchBytes( MipLevel );
+    lpDDSurfaceDesc->lPitch = rowPitch;
 
     int px = (OriginalDesc.dwWidth >> MipLevel);
     int py = (OriginalDesc.dwHeight >> MipLevel);
@@ -200,8 +204,12 @@ HRESULT FakeDirectDrawSurface7::Unlock( LPRECT lpRect ) {
 
     int bpp = redBits + greenBits + blueBits + alphaBits;
 
+    // 16 bit surfaces get their mip-chain made out of the first level
     if ( bpp != 16 ) {
-        if ( Engine::GAPI->GetMainThreadID() != GetCurrentThreadId() ) {
+        bool deferred = Engine::GAPI->GetMainThreadID() != GetCurrentThreadId();
+        if ( Resource->IsProcessedOnUnlock() ) {
+            Resource->GetEngineTexture()->UpdateDataRGBA( Data, MipLevel, 1, deferred );
+        } else if ( deferred ) {
             Resource->GetEngineTexture()->UpdateDataDeferred( Data, MipLevel );
         } else {
             Resource->GetEngineTexture()->UpdateData( Data, MipLevel );
@@ -36,6 +36,7 @@ public:
 		DebugWrite( "MyDirect3DDevice7::MyDirect3DDevice7" );
 
 		RefCount = 1;
+		BoundTexture = nullptr;
 
 		ZeroMemory(&FakeDeviceDesc, sizeof(D3DDEVICEDESC7));
 		FakeDeviceDesc.dwDevCaps = (D3DDEVCAPS_FLOATTLVERTEX|D3DDEVCAPS_EXECUTESYSTEMMEMORY|D3DDEVCAPS_TLVERTEXSYSTEMMEMORY|D3DDEVCAPS_TEXTUREVIDEOMEMORY|D3DDEVCAPS_DRAWPRIMTLVERTEX
@@ -118,6 +119,10 @@ public:
 		FakeDeviceDesc.dwVertexProcessingCaps = (D3DVTXPCAPS_TEXGEN|D3DVTXPCAPS_MATERIALSOURCE7|D3DVTXPCAPS_DIRECTIONALLIGHTS|D3DVTXPCAPS_POSITIONALLIGHTS|D3DVTXPCAPS_LOCALVIEWER);
 	}
 
+	~MyDirect3DDevice7() {
+		SetBoundTexture( nullptr );
+	}
+
 	/*** IUnknown methods ***/
 	HRESULT STDMETHODCALLTYPE QueryInterface( REFIID riid, void** ppvObj ) {
 		DebugWrite( "MyDirect3DDevice7::QueryInterface" );
@@ -132,6 +137,7 @@ public:
 
 	ULONG STDMETHODCALLTYPE Release() {
 		DebugWrite( "MyDirect3DDevice7::Release" );
+		RefCount--;
 		if ( 0 == RefCount ) {
 			delete this;
 			return 0;
@@ -353,8 +359,16 @@ public:
 		// Bind the texture
 		MyDirectDrawSurface7* surface = static_cast<MyDirectDrawSurface7*>(lplpTexture);
 
-		if ( surface ) {
+		if ( surface )
 			surface->BindToSlot( dwStage );
+
+		// Queued fans remember their texture, flushing them can overwrite this binding.
+		// Like a real device, keep a reference while it's bound.
+		if ( dwStage == 0 && surface != BoundTexture ) {
+			if ( surface )
+				surface->AddRef();
+
+			SetBoundTexture( surface );
 		}
 
 		return S_OK;
@@ -620,6 +634,7 @@ public:
 		vp.MinZ = lpViewport->dvMinZ;
 		vp.MaxZ = lpViewport->dvMaxZ;
 
+		FlushBatchedDraws();
 		Engine::GraphicsEngine->SetViewport( vp );
 
 		return S_OK;
@@ -751,11 +766,8 @@ public:
 
 		Engine::GraphicsEngine->SetActivePixelShader( "PS_FixedFunctionPipe" );
 		if ( dptPrimitiveType == D3DPT_TRIANGLEFAN ) {
-			static std::vector<ExVertexStruct> vertexList;
-			vertexList.clear();
-			WorldConverter::TriangleFanToList( &exv[0], dwVertexCount, &vertexList );
-
-			Engine::GraphicsEngine->DrawVertexArray( &vertexList[0], vertexList.size() );
+			// Consecutive fans with the same state end up in a single drawcall
+			Engine::GraphicsEngine->DrawTriangleFanBatched( &exv[0], dwVertexCount, BoundTexture );
 		} else {
 			if ( dptPrimitiveType == D3DPT_TRIANGLELIST )
 				Engine::GraphicsEngine->DrawVertexArray( &exv[0], dwVertexCount );
@@ -781,6 +793,8 @@ public:
 			return S_OK;
 		}
 
+		FlushBatchedDraws();
+
 		D3DVERTEXBUFFERDESC desc;
 		lpd3dVertexBuffer->GetVertexBufferDesc( &desc );
 
@@ -884,6 +898,26 @@ public:
 	}
 
 private:
+	/** Swaps the referenced texture of the first stage. Dropping the last reference draws the fans still using it. */
+	void SetBoundTexture( MyDirectDrawSurface7* surface ) {
+		MyDirectDrawSurface7* old = BoundTexture;
+		BoundTexture = surface;
+
+		if ( old )
+			old->Release();
+	}
+
+	/** Draws the queued fans and restores the texture gothic has bound */
+	void FlushBatchedDraws() {
+		Engine::GraphicsEngine->FlushBatchedDraws();
+
+		if ( BoundTexture )
+			BoundTexture->BindToSlot( 0 );
+	}
+
 	D3DDEVICEDESC7 FakeDeviceDesc;
 	int RefCount;
+
+	/** Last texture set to the first stage */
+	MyDirectDrawSurface7* BoundTexture;
 };
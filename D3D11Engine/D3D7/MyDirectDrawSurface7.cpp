@@ -4,6 +4,8 @@
 #include "../D3D11GraphicsEngineBase.h"
 #include "../D3D11Texture.h"
 #include "../zCTexture.h"
+#include "../TextureArchive.h"
+#include "../ZipFileSystem.h"
 
 #define DebugWriteTex(x)  DebugWrite(x)
 
@@ -19,6 +21,7 @@ MyDirectDrawSurface7::MyDirectDrawSurface7() {
     IsReady = false;
     TextureType = ETextureType::TX_UNDEF;
     LockType = 0;
+    ProcessedOnUnlock = false;
 
     // Check for test-bind mode to figure out what zCTexture-Object we are associated with
     std::string bound;
@@ -59,6 +62,26 @@ D3D11Texture* MyDirectDrawSurface7::GetFxMap() {
     return FxMap;
 }
 
+/** Size and pitch of the buffer gothic writes the given mip-level into */
+void MyDirectDrawSurface7::GetLockBufferSize( int mip, UINT& sizeInBytes, UINT& rowPitch ) {
+    if ( !ProcessedOnUnlock ) {
+        sizeInBytes = EngineTexture->GetSizeInBytes( mip );
+        rowPitch = EngineTexture->GetRowPitchBytes( mip );
+        return;
+    }
+
+    // The texture may be block-compressed, but gothic still writes pixels in its own format
+    int bpp = Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwRBitMask )
+        + Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwGBitMask )
+        + Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwBBitMask )
+        + Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwRGBAlphaBitMask );
+
+    UINT width = std::max( OriginalSurfaceDesc.dwWidth >> mip, 1UL );
+    UINT height = std::max( OriginalSurfaceDesc.dwHeight >> mip, 1UL );
+    rowPitch = width * (bpp / 8);
+    sizeInBytes = rowPitch * height;
+}
+
 /** Binds this texture */
 void MyDirectDrawSurface7::BindToSlot( int slot ) {
     if ( !IsReady ) {
@@ -104,64 +127,60 @@ void MyDirectDrawSurface7::LoadAdditionalResources( zCTexture* ownedTexture ) {
         return;
     }
 
-    D3D11Texture* fxMapTexture = nullptr;
-    D3D11Texture* nrmmapTexture = nullptr;
-
-    // Check for normalmap in our mods folder first, then in the original games
-    int j = 0;
-    std::string replacementsFolder = "system\\GD3D11\\textures\\replacements\\Normalmaps_" + std::to_string( j );
-    while ( Toolbox::FolderExists( replacementsFolder ) ) {
-        std::string normalmap = replacementsFolder + "\\" + TextureName + "_normal.dds";
-        if ( Toolbox::FileExists( normalmap ) ) {
-            // Create the texture object this is linked with
-            Engine::GraphicsEngine->CreateTexture( &nrmmapTexture );
-            if ( XR_SUCCESS != nrmmapTexture->Init( normalmap ) ) {
-                SAFE_DELETE( nrmmapTexture );
-                LogWarn() << "Failed to load normalmap!";
-            }
-            break; // No need to check the other folders
-        }
-        j++;
-        replacementsFolder = "system\\GD3D11\\textures\\replacements\\Normalmaps_" + std::to_string( j );
+    Normalmap = LoadReplacementTexture( "_normal.dds" );
+    FxMap = LoadReplacementTexture( "_fx.dds" );
+}
+
+/** Loads a single replacement texture from the archive or from disk */
+D3D11Texture* MyDirectDrawSurface7::LoadReplacementTextureFrom( const std::string& folder, const std::string& suffix ) {
+    D3D11Texture* texture = nullptr;
+    std::string file = folder + "\\" + TextureName + suffix;
+
+    DDS::ImageInfo info;
+    const uint8_t* payload;
+    const TextureArchive* archive = Engine::GAPI->GetReplacementTextureArchive();
+    if ( archive && archive->Find( file, info, &payload ) ) {
+        Engine::GraphicsEngine->CreateTexture( &texture );
+        if ( XR_SUCCESS == texture->Init( info, payload, file ) )
+            return texture;
+
+        SAFE_DELETE( texture );
+        LogWarn() << "Failed to load " << file << " from texture archive!";
     }
-    std::string normalmap = "system\\GD3D11\\textures\\replacements\\Normalmaps_" + Engine::GAPI->GetGameName() + "\\" + TextureName + "_normal.dds";
-    if ( !nrmmapTexture && Toolbox::FileExists( normalmap ) ) {
+
+    std::string path = "system\\GD3D11\\textures\\replacements\\" + file;
+    const ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem();
+    if ( Toolbox::FileExists( path ) || (packs && packs->Exists( path )) ) {
         // Create the texture object this is linked with
-        Engine::GraphicsEngine->CreateTexture( &nrmmapTexture );
-        if ( XR_SUCCESS != nrmmapTexture->Init( normalmap ) ) {
-            SAFE_DELETE( nrmmapTexture );
-            LogWarn() << "Failed to load normalmap!";
+        Engine::GraphicsEngine->CreateTexture( &texture );
+        if ( XR_SUCCESS != texture->Init( path ) ) {
+            SAFE_DELETE( texture );
+            LogWarn() << "Failed to load " << path << "!";
         }
     }
 
-    j = 0;
-    replacementsFolder = "system\\GD3D11\\textures\\replacements\\Normalmaps_" + std::to_string( j );
-    while ( Toolbox::FolderExists( replacementsFolder ) ) {
-        std::string fxMap = replacementsFolder + "\\" + TextureName + "_fx.dds";
-        if ( Toolbox::FileExists( fxMap ) ) {
-            // Create the texture object this is linked with
-            Engine::GraphicsEngine->CreateTexture( &fxMapTexture );
-            if ( XR_SUCCESS != fxMapTexture->Init( fxMap ) ) {
-                SAFE_DELETE( fxMapTexture );
-                LogWarn() << "Failed to load normalmap!";
-            }
-            break; // No need to check the other folders
-        }
-        j++;
-        replacementsFolder = "system\\GD3D11\\textures\\replacements\\Normalmaps_" + std::to_string( j );
-    }
-    std::string fxMap = "system\\GD3D11\\textures\\replacements\\Normalmaps_" + Engine::GAPI->GetGameName() + "\\" + TextureName + "_fx.dds";
-    if ( !fxMapTexture && Toolbox::FileExists( fxMap ) ) {
-        // Create the texture object this is linked with
-        Engine::GraphicsEngine->CreateTexture( &fxMapTexture );
-        if ( XR_SUCCESS != fxMapTexture->Init( fxMap ) ) {
-            SAFE_DELETE( fxMapTexture );
-            LogWarn() << "Failed to load normalmap!";
-        }
+    return texture;
+}
+
+/** Searches the replacement-folders for "<TextureName><suffix>", the packed archive first */
+D3D11Texture* MyDirectDrawSurface7::LoadReplacementTexture( const std::string& suffix ) {
+    const TextureArchive* archive = Engine::GAPI->GetReplacementTextureArchive();
+    const ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem();
+
+    // Check for the texture in our mods folders first, then in the original games
+    for ( int j = 0;; j++ ) {
+        std::string folder = "Normalmaps_" + std::to_string( j );
+        const std::string path = "system\\GD3D11\\textures\\replacements\\" + folder;
+        if ( !(archive && archive->ContainsDirectory( folder ))
+            && !(packs && packs->FolderExists( path ))
+            && !Toolbox::FolderExists( path ) )
+            break;
+
+        if ( D3D11Texture* texture = LoadReplacementTextureFrom( folder, suffix ) )
+            return texture; // No need to check the other folders
     }
 
-    Normalmap = nrmmapTexture;
-    FxMap = fxMapTexture;
+    return LoadReplacementTextureFrom( "Normalmaps_" + Engine::GAPI->GetGameName(), suffix );
 }
 
 HRESULT MyDirectDrawSurface7::QueryInterface( REFIID riid, LPVOID* ppvObj ) {
@@ -182,6 +201,10 @@ ULONG MyDirectDrawSurface7::Release() {
     DebugWriteTex( "IDirectDrawSurface7(%p)::Release(%i)" );
 
     if ( uRet == 0 ) {
+        // Queued UI-draws may still reference this texture
+        if ( Engine::GraphicsEngine )
+            Engine::GraphicsEngine->FlushBatchedDraws();
+
         delete this;
     }
 
@@ -353,17 +376,17 @@ HRESULT MyDirectDrawSurface7::Lock( LPRECT lpDestRect, LPDDSURFACEDESC2 lpDDSurf
     if ( !EngineTexture )
         return S_OK;
 
-    // Check for 16-bit surface. We allocate the texture as 32-bit, so we need to divide the size by two for that
+    // 16-bit and compressed surfaces get a buffer in gothics format, see GetLockBufferSize
     int redBits = Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwRBitMask );
     int greenBits = Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwGBitMask );
     int blueBits = Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwBBitMask );
     int alphaBits = Toolbox::GetNumberOfBits( OriginalSurfaceDesc.ddpfPixelFormat.dwRGBAlphaBitMask );
 
     int bpp = redBits + greenBits + blueBits + alphaBits;
-    int divisor = 1;
 
-    if ( bpp == 16 )
-        divisor = 2;
+    UINT sizeInBytes;
+    UINT rowPitch;
+    GetLockBufferSize( 0, sizeInBytes, rowPitch );
 
     if ( bpp == 24 ) {
         // Handle movie frame,
@@ -378,11 +401,11 @@ HRESULT MyDirectDrawSurface7::Lock( LPRECT lpDestRect, LPDDSURFACEDESC2 lpDDSurf
     } else {
         // Allocate some temporary data
         delete[] LockedData;
-        LockedData = new unsigned char[EngineTexture->GetSizeInBytes( 0 ) / divisor];
+        LockedData = new unsigned char[sizeInBytes];
     }
 
     lpDDSurfaceDesc->lpSurface = LockedData;
-    lpDDSurfaceDesc->lPitch = EngineTexture->GetRowPitchBytes( 0 ) / divisor;
+    lpDDSurfaceDesc->lPitch = rowPitch;
 
     return S_OK;
 }
@@ -417,8 +440,9 @@ HRESULT MyDirectDrawSurface7::Unlock( LPRECT lpRect ) {
 
     if ( bpp == 16 ) {
         // Convert
-        unsigned char* dst = new unsigned char[EngineTexture->GetSizeInBytes( 0 )];
-        for ( unsigned int i = 0; i < EngineTexture->GetSizeInBytes( 0 ) / 4; i++ ) {
+        const unsigned int numPixels = OriginalSurfaceDesc.dwWidth * OriginalSurfaceDesc.dwHeight;
+        unsigned char* dst = new unsigned char[numPixels * 4];
+        for ( unsigned int i = 0; i < numPixels; i++ ) {
             unsigned char temp0 = LockedData[i * 2 + 0];
             unsigned char temp1 = LockedData[i * 2 + 1];
             unsigned pixel_data = temp1 << 8 | temp0;
@@ -434,13 +458,12 @@ HRESULT MyDirectDrawSurface7::Unlock( LPRECT lpRect ) {
             dst[4 * i + 3] = 255;
         }
 
+        // Makes the whole mip-chain out of the first level
         if ( Engine::GAPI->GetMainThreadID() != GetCurrentThreadId() ) {
-            EngineTexture->UpdateDataDeferred( dst, 0 );
-            EngineTexture->GenerateMipMapsDeferred();
+            EngineTexture->UpdateDataRGBA( dst, 0, 0, true );
             Engine::GAPI->AddFrameLoadedTexture( this );
         } else {
-            EngineTexture->UpdateData( dst, 0 );
-            EngineTexture->GenerateMipMaps();
+            EngineTexture->UpdateDataRGBA( dst, 0, 0, false );
             SetReady( true ); // No need to load other stuff to get this ready
         }
 
@@ -512,12 +535,19 @@ HRESULT MyDirectDrawSurface7::Unlock( LPRECT lpRect ) {
                 Engine::GraphicsEngine->DrawQuad( INT2( tlx, tly ), INT2( brx - tlx, bry - tly ) );
             }
         } else {
-            // No conversion needed
-            if ( Engine::GAPI->GetMainThreadID() != GetCurrentThreadId() ) {
+            // No conversion needed, gothic provides the mip-levels itself
+            bool deferred = Engine::GAPI->GetMainThreadID() != GetCurrentThreadId();
+            if ( ProcessedOnUnlock ) {
+                EngineTexture->UpdateDataRGBA( LockedData, 0, 1, deferred );
+            } else if ( deferred ) {
                 EngineTexture->UpdateDataDeferred( LockedData, 0 );
-                Engine::GAPI->AddFrameLoadedTexture( this );
             } else {
                 EngineTexture->UpdateData( LockedData, 0 );
+            }
+
+            if ( deferred ) {
+                Engine::GAPI->AddFrameLoadedTexture( this );
+            } else {
                 SetReady( true ); // No need to load other stuff to get this ready
             }
         }
@@ -659,6 +689,18 @@ HRESULT MyDirectDrawSurface7::SetSurfaceDesc( LPDDSURFACEDESC2 lpDDSurfaceDesc,
     break;
     }
 
+    // Plain 16 and 32 bit textures are converted to RGBA8 on unlock and get block-compressed on the CPU.
+    // BC needs the first level to be a multiple of the block size.
+    ProcessedOnUnlock = bpp == 16 || bpp == 32;
+    if ( ProcessedOnUnlock && Engine::GAPI->GetRendererState().RendererSettings.CompressGothicTextures
+        && (lpDDSurfaceDesc->dwWidth % 4) == 0 && (lpDDSurfaceDesc->dwHeight % 4) == 0 ) {
+        // The 16 bit conversion drops the alpha
+        format = bpp == 16 ? D3D11Texture::ETextureFormat::TF_DXT1 : D3D11Texture::ETextureFormat::TF_DXT5;
+    } else if ( bpp == 32 ) {
+        // Uploaded as it is
+        ProcessedOnUnlock = false;
+    }
+
     // Find out mip-level count
     unsigned int mipMapCount = 1;
     if ( lpDDSurfaceDesc->ddsCaps.dwCaps & DDSCAPS_MIPMAP ) {
@@ -103,9 +103,20 @@ public:
     /** Returns true if this surface is used to render a movie to */
     bool IsMovieSurface() { return LockedData != nullptr; }
 
+    /** Returns true if the pixels are converted to RGBA8 and go through TextureProcessing on unlock */
+    bool IsProcessedOnUnlock() { return ProcessedOnUnlock; }
+
+    /** Size and pitch of the buffer gothic writes the given mip-level into */
+    void GetLockBufferSize( int mip, UINT& sizeInBytes, UINT& rowPitch );
+
     /** Returns the type of this texture */
     ETextureType GetTextureType() { return TextureType; };
 private:
+    /** Searches the replacement-folders for "<TextureName><suffix>", the packed archive first */
+    D3D11Texture* LoadReplacementTexture( const std::string& suffix );
+
+    /** Loads a single replacement texture from the archive or from disk */
+    D3D11Texture* LoadReplacementTextureFrom( const std::string& folder, const std::string& suffix );
 
     /** Faked attached surfaces for the mipmaps */
     std::vector<MyDirectDrawSurface7*> attachedSurfaces;
@@ -132,6 +143,9 @@ private:
     /** Locktype */
     DWORD LockType;
 
+    /** Set for plain 16 and 32 bit textures, which get their mips and compression on the CPU */
+    bool ProcessedOnUnlock;
+
     /** zCTexture this is associated with */
     zCTexture* GothicTexture;
 };
@@ -0,0 +1,334 @@
+#include "DDSParser.h"
+#include <algorithm>
+#include <cstring>
+
+namespace DDS {
+    namespace {
+        const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+        const uint32_t DDSD_MIPMAPCOUNT = 0x00020000;
+        const uint32_t DDSD_DEPTH = 0x00800000;
+
+        const uint32_t DDPF_ALPHA = 0x00000002;
+        const uint32_t DDPF_FOURCC = 0x00000004;
+        const uint32_t DDPF_RGB = 0x00000040;
+        const uint32_t DDPF_LUMINANCE = 0x00020000;
+
+        const uint32_t DDSCAPS2_CUBEMAP = 0x00000200;
+        const uint32_t DDSCAPS2_VOLUME = 0x00200000;
+
+        const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+        const uint32_t D3D10_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+        constexpr uint32_t MakeFourCC( char a, char b, char c, char d ) {
+            return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+        }
+
+#pragma pack(push, 1)
+        struct DDSPixelFormat {
+            uint32_t Size;
+            uint32_t Flags;
+            uint32_t FourCC;
+            uint32_t RGBBitCount;
+            uint32_t RBitMask;
+            uint32_t GBitMask;
+            uint32_t BBitMask;
+            uint32_t ABitMask;
+        };
+
+        struct DDSHeader {
+            uint32_t Size;
+            uint32_t Flags;
+            uint32_t Height;
+            uint32_t Width;
+            uint32_t PitchOrLinearSize;
+            uint32_t Depth;
+            uint32_t MipMapCount;
+            uint32_t Reserved1[11];
+            DDSPixelFormat PixelFormat;
+            uint32_t Caps;
+            uint32_t Caps2;
+            uint32_t Caps3;
+            uint32_t Caps4;
+            uint32_t Reserved2;
+        };
+
+        struct DDSHeaderDXT10 {
+            uint32_t DXGIFormat;
+            uint32_t ResourceDimension;
+            uint32_t MiscFlag;
+            uint32_t ArraySize;
+            uint32_t MiscFlags2;
+        };
+#pragma pack(pop)
+
+        static_assert(sizeof( DDSHeader ) == 124, "Wrong DDS-Header size");
+        static_assert(sizeof( DDSHeaderDXT10 ) == 20, "Wrong DX10-Header size");
+
+        bool MaskIs( const DDSPixelFormat& pf, uint32_t r, uint32_t g, uint32_t b, uint32_t a ) {
+            return pf.RBitMask == r && pf.GBitMask == g && pf.BBitMask == b && pf.ABitMask == a;
+        }
+
+        /** Maps a legacy pixelformat to DXGI, like the DDSTextureLoader does */
+        uint32_t FormatFromPixelFormat( const DDSPixelFormat& pf ) {
+            if ( pf.Flags & DDPF_FOURCC ) {
+                switch ( pf.FourCC ) {
+                case MakeFourCC( 'D', 'X', 'T', '1' ): return FMT_BC1_UNORM;
+                case MakeFourCC( 'D', 'X', 'T', '2' ):
+                case MakeFourCC( 'D', 'X', 'T', '3' ): return FMT_BC2_UNORM;
+                case MakeFourCC( 'D', 'X', 'T', '4' ):
+                case MakeFourCC( 'D', 'X', 'T', '5' ): return FMT_BC3_UNORM;
+                case MakeFourCC( 'A', 'T', 'I', '1' ):
+                case MakeFourCC( 'B', 'C', '4', 'U' ): return FMT_BC4_UNORM;
+                case MakeFourCC( 'B', 'C', '4', 'S' ): return FMT_BC4_SNORM;
+                case MakeFourCC( 'A', 'T', 'I', '2' ):
+                case MakeFourCC( 'B', 'C', '5', 'U' ): return FMT_BC5_UNORM;
+                case MakeFourCC( 'B', 'C', '5', 'S' ): return FMT_BC5_SNORM;
+                case 36: return FMT_R16G16B16A16_UNORM;  // D3DFMT_A16B16G16R16
+                case 111: return FMT_R16_FLOAT;          // D3DFMT_R16F
+                case 113: return FMT_R16G16B16A16_FLOAT; // D3DFMT_A16B16G16R16F
+                case 114: return FMT_R32_FLOAT;          // D3DFMT_R32F
+                case 116: return FMT_R32G32B32A32_FLOAT; // D3DFMT_A32B32G32R32F
+                default: return FMT_UNKNOWN;
+                }
+            }
+
+            if ( pf.Flags & DDPF_RGB ) {
+                switch ( pf.RGBBitCount ) {
+                case 32:
+                    if ( MaskIs( pf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 ) ) return FMT_R8G8B8A8_UNORM;
+                    if ( MaskIs( pf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 ) ) return FMT_B8G8R8A8_UNORM;
+                    if ( MaskIs( pf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000 ) ) return FMT_B8G8R8X8_UNORM;
+                    // This is the wrong way around, but most writers produce it like this
+                    if ( MaskIs( pf, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000 ) ) return FMT_R10G10B10A2_UNORM;
+                    if ( MaskIs( pf, 0xffffffff, 0x00000000, 0x00000000, 0x00000000 ) ) return FMT_R32_FLOAT;
+                    break;
+                case 16:
+                    if ( MaskIs( pf, 0xf800, 0x07e0, 0x001f, 0x0000 ) ) return FMT_B5G6R5_UNORM;
+                    if ( MaskIs( pf, 0x7c00, 0x03e0, 0x001f, 0x8000 ) ) return FMT_B5G5R5A1_UNORM;
+                    if ( MaskIs( pf, 0x0f00, 0x00f0, 0x000f, 0xf000 ) ) return FMT_B4G4R4A4_UNORM;
+                    break;
+                }
+                return FMT_UNKNOWN;
+            }
+
+            if ( pf.Flags & DDPF_LUMINANCE ) {
+                if ( pf.RGBBitCount == 8 && pf.RBitMask == 0xff ) return FMT_R8_UNORM;
+                if ( pf.RGBBitCount == 16 && MaskIs( pf, 0x00ff, 0x0000, 0x0000, 0xff00 ) ) return FMT_R8G8_UNORM;
+                return FMT_UNKNOWN;
+            }
+
+            if ( pf.Flags & DDPF_ALPHA ) {
+                if ( pf.RGBBitCount == 8 ) return FMT_A8_UNORM;
+            }
+
+            return FMT_UNKNOWN;
+        }
+
+        /** Returns the bytes per 4x4-block for compressed formats, bits per pixel otherwise */
+        bool GetFormatSize( uint32_t format, uint32_t& blockBytes, uint32_t& bitsPerPixel ) {
+            blockBytes = 0;
+            bitsPerPixel = 0;
+
+            switch ( format ) {
+            case FMT_BC1_UNORM:
+            case FMT_BC1_UNORM_SRGB:
+            case FMT_BC4_UNORM:
+            case FMT_BC4_SNORM:
+                blockBytes = 8;
+                return true;
+
+            case FMT_BC2_UNORM:
+            case FMT_BC2_UNORM_SRGB:
+            case FMT_BC3_UNORM:
+            case FMT_BC3_UNORM_SRGB:
+            case FMT_BC5_UNORM:
+            case FMT_BC5_SNORM:
+            case FMT_BC6H_UF16:
+            case FMT_BC6H_SF16:
+            case FMT_BC7_UNORM:
+            case FMT_BC7_UNORM_SRGB:
+                blockBytes = 16;
+                return true;
+
+            case FMT_R32G32B32A32_FLOAT:
+                bitsPerPixel = 128;
+                return true;
+
+            case FMT_R16G16B16A16_FLOAT:
+            case FMT_R16G16B16A16_UNORM:
+                bitsPerPixel = 64;
+                return true;
+
+            case FMT_R10G10B10A2_UNORM:
+            case FMT_R8G8B8A8_UNORM:
+            case FMT_R8G8B8A8_UNORM_SRGB:
+            case FMT_R32_FLOAT:
+            case FMT_B8G8R8A8_UNORM:
+            case FMT_B8G8R8X8_UNORM:
+            case FMT_B8G8R8A8_UNORM_SRGB:
+                bitsPerPixel = 32;
+                return true;
+
+            case FMT_R8G8_UNORM:
+            case FMT_R16_FLOAT:
+            case FMT_B5G6R5_UNORM:
+            case FMT_B5G5R5A1_UNORM:
+            case FMT_B4G4R4A4_UNORM:
+                bitsPerPixel = 16;
+                return true;
+
+            case FMT_R8_UNORM:
+            case FMT_A8_UNORM:
+                bitsPerPixel = 8;
+                return true;
+            }
+
+            return false;
+        }
+    }
+
+    /** Returns whether the format is stored in 4x4 blocks */
+    bool IsBlockCompressed( uint32_t format ) {
+        uint32_t blockBytes, bitsPerPixel;
+        return GetFormatSize( format, blockBytes, bitsPerPixel ) && blockBytes != 0;
+    }
+
+    /** Computes row-pitch and size of a single mip-level. Returns false if the format is unknown or the level doesn't fit in 32 bits. */
+    bool ComputeMipSize( uint32_t format, uint32_t width, uint32_t height, uint32_t& rowPitch, uint32_t& size ) {
+        uint32_t blockBytes, bitsPerPixel;
+        if ( !GetFormatSize( format, blockBytes, bitsPerPixel ) )
+            return false;
+
+        // A full-size 128-bit texture is exactly 4 GiB, so the sizes are computed in 64 bits
+        uint64_t pitch, bytes;
+        if ( blockBytes ) {
+            uint64_t blocksWide = width > 0 ? std::max<uint64_t>( 1, (static_cast<uint64_t>(width) + 3) / 4 ) : 0;
+            uint64_t blocksHigh = height > 0 ? std::max<uint64_t>( 1, (static_cast<uint64_t>(height) + 3) / 4 ) : 0;
+            pitch = blocksWide * blockBytes;
+            bytes = pitch * blocksHigh;
+        } else {
+            pitch = (static_cast<uint64_t>(width) * bitsPerPixel + 7) / 8;
+            bytes = pitch * height;
+        }
+
+        if ( bytes > UINT32_MAX )
+            return false;
+
+        rowPitch = static_cast<uint32_t>(pitch);
+        size = static_cast<uint32_t>(bytes);
+        return true;
+    }
+
+    /** Fills the Mips-Array of the given info from Width, Height, MipCount, Format and DataOffset */
+    bool ComputeMipLayout( ImageInfo& info ) {
+        if ( info.MipCount == 0 || info.MipCount > MAX_MIP_LEVELS
+            || info.Width == 0 || info.Height == 0
+            || info.Width > MAX_TEXTURE_SIZE || info.Height > MAX_TEXTURE_SIZE )
+            return false;
+
+        uint64_t offset = info.DataOffset;
+        uint32_t w = info.Width;
+        uint32_t h = info.Height;
+        for ( uint32_t i = 0; i < info.MipCount; i++ ) {
+            MipLevel& mip = info.Mips[i];
+            if ( !ComputeMipSize( info.Format, w, h, mip.RowPitch, mip.Size ) )
+                return false;
+
+            mip.Offset = static_cast<uint32_t>(offset);
+            mip.Width = w;
+            mip.Height = h;
+
+            offset += mip.Size;
+            if ( offset > UINT32_MAX )
+                return false;
+
+            w = std::max<uint32_t>( 1, w / 2 );
+            h = std::max<uint32_t>( 1, h / 2 );
+        }
+
+        info.DataSize = static_cast<uint32_t>(offset - info.DataOffset);
+        return true;
+    }
+
+    /** Parses the header of a DDS-File and computes the layout of all mip-levels */
+    EParseResult Parse( const void* data, size_t size, ImageInfo& info ) {
+        memset( &info, 0, sizeof( info ) );
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+        if ( !bytes || size < sizeof( uint32_t ) + sizeof( DDSHeader ) )
+            return PR_TOO_SMALL;
+
+        uint32_t magic;
+        memcpy( &magic, bytes, sizeof( magic ) );
+        if ( magic != DDS_MAGIC )
+            return PR_BAD_MAGIC;
+
+        DDSHeader header;
+        memcpy( &header, bytes + sizeof( uint32_t ), sizeof( header ) );
+        if ( header.Size != sizeof( DDSHeader ) || header.PixelFormat.Size != sizeof( DDSPixelFormat ) )
+            return PR_BAD_HEADER;
+
+        size_t dataOffset = sizeof( uint32_t ) + sizeof( DDSHeader );
+        uint32_t format = FMT_UNKNOWN;
+
+        if ( (header.PixelFormat.Flags & DDPF_FOURCC) && header.PixelFormat.FourCC == MakeFourCC( 'D', 'X', '1', '0' ) ) {
+            if ( size < dataOffset + sizeof( DDSHeaderDXT10 ) )
+                return PR_TOO_SMALL;
+
+            DDSHeaderDXT10 dx10;
+            memcpy( &dx10, bytes + dataOffset, sizeof( dx10 ) );
+            dataOffset += sizeof( DDSHeaderDXT10 );
+
+            if ( dx10.ResourceDimension != D3D10_RESOURCE_DIMENSION_TEXTURE2D
+                || (dx10.MiscFlag & D3D10_RESOURCE_MISC_TEXTURECUBE)
+                || dx10.ArraySize > 1 )
+                return PR_UNSUPPORTED_DIMENSION;
+
+            format = dx10.DXGIFormat;
+        } else {
+            if ( (header.Flags & DDSD_DEPTH) || (header.Caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)) )
+                return PR_UNSUPPORTED_DIMENSION;
+
+            format = FormatFromPixelFormat( header.PixelFormat );
+        }
+
+        uint32_t rowPitch, mipSize;
+        if ( format == FMT_UNKNOWN || !ComputeMipSize( format, 1, 1, rowPitch, mipSize ) )
+            return PR_UNSUPPORTED_FORMAT;
+
+        info.Width = header.Width;
+        info.Height = header.Height;
+        info.Format = format;
+        info.DataOffset = static_cast<uint32_t>(dataOffset);
+        info.MipCount = (header.Flags & DDSD_MIPMAPCOUNT) && header.MipMapCount > 0 ? header.MipMapCount : 1;
+
+        // Some tools write more levels than possible, clamp to the full chain
+        uint32_t maxMips = 1;
+        for ( uint32_t d = std::max( info.Width, info.Height ); d > 1; d /= 2 )
+            maxMips++;
+        info.MipCount = std::min( info.MipCount, maxMips );
+
+        if ( !ComputeMipLayout( info ) )
+            return PR_BAD_HEADER;
+
+        if ( static_cast<uint64_t>(info.DataOffset) + info.DataSize > size )
+            return PR_TRUNCATED;
+
+        return PR_OK;
+    }
+
+    /** Returns a readable description of the parse-result */
+    const char* ResultToString( EParseResult result ) {
+        switch ( result ) {
+        case PR_OK: return "OK";
+        case PR_TOO_SMALL: return "File too small";
+        case PR_BAD_MAGIC: return "Not a DDS-File";
+        case PR_BAD_HEADER: return "Invalid DDS-Header";
+        case PR_UNSUPPORTED_FORMAT: return "Unsupported pixel-format";
+        case PR_UNSUPPORTED_DIMENSION: return "Only 2D-Textures are supported";
+        case PR_TRUNCATED: return "File is truncated";
+        }
+        return "Unknown";
+    }
+}
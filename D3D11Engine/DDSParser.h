@@ -0,0 +1,95 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/** Zero-copy parser for DDS-Files. Works on a block of memory (usually a memory-mapped file) and
+    only returns offsets into that memory, so the mip-levels can be handed to D3D11 directly.
+    Has no dependencies to windows or D3D11 and can be used from offline-tools as well. */
+namespace DDS {
+    /** 16384 is the maximum texture size D3D11 supports, which has 15 mip-levels */
+    const uint32_t MAX_TEXTURE_SIZE = 16384;
+    const uint32_t MAX_MIP_LEVELS = 15;
+
+    /** DXGI_FORMAT-Values we can read. Kept as plain numbers here so this doesn't need dxgi headers. */
+    enum EFormat : uint32_t {
+        FMT_UNKNOWN = 0,
+        FMT_R32G32B32A32_FLOAT = 2,
+        FMT_R16G16B16A16_FLOAT = 10,
+        FMT_R16G16B16A16_UNORM = 11,
+        FMT_R10G10B10A2_UNORM = 24,
+        FMT_R8G8B8A8_UNORM = 28,
+        FMT_R8G8B8A8_UNORM_SRGB = 29,
+        FMT_R32_FLOAT = 41,
+        FMT_R8G8_UNORM = 49,
+        FMT_R16_FLOAT = 54,
+        FMT_R8_UNORM = 61,
+        FMT_A8_UNORM = 65,
+        FMT_BC1_UNORM = 71,
+        FMT_BC1_UNORM_SRGB = 72,
+        FMT_BC2_UNORM = 74,
+        FMT_BC2_UNORM_SRGB = 75,
+        FMT_BC3_UNORM = 77,
+        FMT_BC3_UNORM_SRGB = 78,
+        FMT_BC4_UNORM = 80,
+        FMT_BC4_SNORM = 81,
+        FMT_BC5_UNORM = 83,
+        FMT_BC5_SNORM = 84,
+        FMT_B5G6R5_UNORM = 85,
+        FMT_B5G5R5A1_UNORM = 86,
+        FMT_B8G8R8A8_UNORM = 87,
+        FMT_B8G8R8X8_UNORM = 88,
+        FMT_B8G8R8A8_UNORM_SRGB = 91,
+        FMT_BC6H_UF16 = 95,
+        FMT_BC6H_SF16 = 96,
+        FMT_BC7_UNORM = 98,
+        FMT_BC7_UNORM_SRGB = 99,
+        FMT_B4G4R4A4_UNORM = 115,
+    };
+
+    enum EParseResult {
+        PR_OK,
+        PR_TOO_SMALL,
+        PR_BAD_MAGIC,
+        PR_BAD_HEADER,
+        PR_UNSUPPORTED_FORMAT,
+        PR_UNSUPPORTED_DIMENSION,
+        PR_TRUNCATED,
+    };
+
+    struct MipLevel {
+        uint32_t Offset; // From the start of the parsed memory
+        uint32_t Size;
+        uint32_t RowPitch;
+        uint32_t Width;
+        uint32_t Height;
+    };
+
+    struct ImageInfo {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t MipCount;
+        uint32_t Format; // DXGI_FORMAT
+
+        /** Offset and size of all pixel-data */
+        uint32_t DataOffset;
+        uint32_t DataSize;
+
+        MipLevel Mips[MAX_MIP_LEVELS];
+    };
+
+    /** Parses the header of a DDS-File and computes the layout of all mip-levels. Only 2D-Textures without arrays are supported.
+        Never reads outside of [data, data + size), so this is safe to use on untrusted input. */
+    EParseResult Parse( const void* data, size_t size, ImageInfo& info );
+
+    /** Computes row-pitch and size of a single mip-level. Returns false if the format is unknown or the level doesn't fit in 32 bits. */
+    bool ComputeMipSize( uint32_t format, uint32_t width, uint32_t height, uint32_t& rowPitch, uint32_t& size );
+
+    /** Fills the Mips-Array of the given info from Width, Height, MipCount, Format and DataOffset */
+    bool ComputeMipLayout( ImageInfo& info );
+
+    /** Returns whether the format is stored in 4x4 blocks */
+    bool IsBlockCompressed( uint32_t format );
+
+    /** Returns a readable description of the parse-result */
+    const char* ResultToString( EParseResult result );
+}
@@ -0,0 +1,180 @@
+#include "DecalBatcher.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <immintrin.h>
+
+namespace {
+    /** World matrix of the decal, with the rotation replaced for camera-aligned decals */
+    void BuildAlignedWorld( const DecalInstanceInput& d, const float cameraPosition[3], float w[16] ) {
+        memcpy( w, d.World, sizeof( d.World ) );
+
+        if ( d.Alignment == DA_YAW ) {
+            // Transposed RotationY( atan2( dx, dz ) ), without going through the angle
+            float dx = d.Position[0] - cameraPosition[0];
+            float dz = d.Position[2] - cameraPosition[2];
+            float len = sqrtf( dx * dx + dz * dz );
+            float c = 1.0f;
+            float s = 0.0f;
+            if ( len > 0.0f ) {
+                c = dz / len;
+                s = dx / len;
+            }
+
+            // Only the rotation, the translation stays
+            w[0] = c;     w[1] = 0.0f; w[2] = s;
+            w[4] = 0.0f;  w[5] = 1.0f; w[6] = 0.0f;
+            w[8] = -s;    w[9] = 0.0f; w[10] = c;
+        } else if ( d.Alignment == DA_FULL ) {
+            static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+            memcpy( w, identity, sizeof( identity ) );
+            w[3] = d.Position[0];
+            w[7] = d.Position[1];
+            w[11] = d.Position[2];
+        }
+    }
+
+    /** Row of a * b, for a row of a and the rows of b */
+    inline __m128 CombineRows( const float* aRow, __m128 b0, __m128 b1, __m128 b2, __m128 b3 ) {
+        __m128 r = _mm_mul_ps( _mm_set1_ps( aRow[0] ), b0 );
+        r = _mm_add_ps( r, _mm_mul_ps( _mm_set1_ps( aRow[1] ), b1 ) );
+        r = _mm_add_ps( r, _mm_mul_ps( _mm_set1_ps( aRow[2] ), b2 ) );
+        r = _mm_add_ps( r, _mm_mul_ps( _mm_set1_ps( aRow[3] ), b3 ) );
+        return r;
+    }
+
+    inline __m128 CombineRows( __m128 aRow, __m128 b0, __m128 b1, __m128 b2, __m128 b3 ) {
+        __m128 r = _mm_mul_ps( _mm_shuffle_ps( aRow, aRow, _MM_SHUFFLE( 0, 0, 0, 0 ) ), b0 );
+        r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( aRow, aRow, _MM_SHUFFLE( 1, 1, 1, 1 ) ), b1 ) );
+        r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( aRow, aRow, _MM_SHUFFLE( 2, 2, 2, 2 ) ), b2 ) );
+        r = _mm_add_ps( r, _mm_mul_ps( _mm_shuffle_ps( aRow, aRow, _MM_SHUFFLE( 3, 3, 3, 3 ) ), b3 ) );
+        return r;
+    }
+
+    void Multiply( const float a[16], const float b[16], float out[16] ) {
+        for ( int i = 0; i < 4; i++ ) {
+            for ( int j = 0; j < 4; j++ ) {
+                out[i * 4 + j] = a[i * 4 + 0] * b[0 * 4 + j] + a[i * 4 + 1] * b[1 * 4 + j]
+                    + a[i * 4 + 2] * b[2 * 4 + j] + a[i * 4 + 3] * b[3 * 4 + j];
+            }
+        }
+    }
+}
+
+/** Builds the batches for the given decals */
+void DecalBatcher::Build( const DecalInstanceInput* decals, size_t numDecals, int orderedAlphaFunc ) {
+    Unordered.clear();
+    Ordered.clear();
+    Order.clear();
+    Batches.clear();
+
+    for ( size_t i = 0; i < numDecals; i++ ) {
+        const DecalInstanceInput& d = decals[i];
+        if ( d.AlphaFunc == orderedAlphaFunc ) {
+            Ordered.push_back( std::make_pair( d.Distance, static_cast<uint32_t>(i) ) );
+        } else {
+            Unordered.push_back( { d.AlphaFunc, d.Material, static_cast<uint32_t>(i) } );
+        }
+    }
+
+    // Group the ones which don't care about the order. The index only keeps the result the same from frame to frame.
+    std::sort( Unordered.begin(), Unordered.end(), []( const SortKey& a, const SortKey& b ) {
+        if ( a.AlphaFunc != b.AlphaFunc )
+            return a.AlphaFunc < b.AlphaFunc;
+        if ( a.Material != b.Material )
+            return std::less<const void*>()(a.Material, b.Material);
+        return a.Index < b.Index;
+    } );
+
+    // Back to front
+    std::sort( Ordered.begin(), Ordered.end(), []( const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b ) {
+        if ( a.first != b.first )
+            return a.first > b.first;
+        return a.second < b.second;
+    } );
+
+    Order.reserve( numDecals );
+    auto addInstance = [&]( uint32_t index ) {
+        const DecalInstanceInput& d = decals[index];
+        if ( Batches.empty() || Batches.back().Material != d.Material || Batches.back().AlphaFunc != d.AlphaFunc ) {
+            Batches.push_back( { d.Material, d.AlphaFunc, static_cast<uint32_t>(Order.size()), 0 } );
+        }
+
+        Batches.back().NumInstances++;
+        Order.push_back( index );
+    };
+
+    for ( const SortKey& k : Unordered ) {
+        addInstance( k.Index );
+    }
+
+    for ( auto const& it : Ordered ) {
+        addInstance( it.second );
+    }
+}
+
+/** Writes the instance matrix of every decal in order to out */
+void DecalInstancing::WriteInstanceMatrices( const DecalInstanceInput* decals, const uint32_t* order, size_t count,
+    const float view[16], const float cameraPosition[3], void* out, size_t stride ) {
+    __m128 v0 = _mm_loadu_ps( view + 0 );
+    __m128 v1 = _mm_loadu_ps( view + 4 );
+    __m128 v2 = _mm_loadu_ps( view + 8 );
+    __m128 v3 = _mm_loadu_ps( view + 12 );
+
+    uint8_t* dst = static_cast<uint8_t*>(out);
+    for ( size_t i = 0; i < count; i++, dst += stride ) {
+        const DecalInstanceInput& d = decals[order[i]];
+
+        float w[16];
+        BuildAlignedWorld( d, cameraPosition, w );
+
+        // Offset * Scale in one matrix. The offset-translation sits in the last row, not the last
+        // column like the other matrices, which is how the single draw calls always did it.
+        float sx = d.Size[0] * 2.0f;
+        float sy = -d.Size[1] * 2.0f;
+        __m128 os0 = _mm_setr_ps( sx, 0.0f, 0.0f, 0.0f );
+        __m128 os1 = _mm_setr_ps( 0.0f, sy, 0.0f, 0.0f );
+        __m128 os2 = _mm_setr_ps( 0.0f, 0.0f, 1.0f, 0.0f );
+        __m128 os3 = _mm_setr_ps( d.Offset[0] * sx, -d.Offset[1] * sy, 0.0f, 1.0f );
+
+        // P = World * Offset * Scale
+        __m128 p0 = CombineRows( w + 0, os0, os1, os2, os3 );
+        __m128 p1 = CombineRows( w + 4, os0, os1, os2, os3 );
+        __m128 p2 = CombineRows( w + 8, os0, os1, os2, os3 );
+        __m128 p3 = CombineRows( w + 12, os0, os1, os2, os3 );
+
+        // View * P
+        __m128 m0 = CombineRows( v0, p0, p1, p2, p3 );
+        __m128 m1 = CombineRows( v1, p0, p1, p2, p3 );
+        __m128 m2 = CombineRows( v2, p0, p1, p2, p3 );
+        __m128 m3 = CombineRows( v3, p0, p1, p2, p3 );
+
+        _MM_TRANSPOSE4_PS( m0, m1, m2, m3 );
+
+        float* o = reinterpret_cast<float*>(dst);
+        _mm_storeu_ps( o + 0, m0 );
+        _mm_storeu_ps( o + 4, m1 );
+        _mm_storeu_ps( o + 8, m2 );
+        _mm_storeu_ps( o + 12, m3 );
+    }
+}
+
+/** Straight matrix multiplications for one decal */
+void DecalInstancing::ComputeInstanceMatrixReference( const DecalInstanceInput& decal, const float view[16],
+    const float cameraPosition[3], float out[16] ) {
+    float w[16];
+    BuildAlignedWorld( decal, cameraPosition, w );
+
+    // XMMatrixTranslation( x, -y, 0 )
+    float offset[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, decal.Offset[0], -decal.Offset[1], 0, 1 };
+
+    // Transposed XMMatrixScaling( 2x, -2y, 1 )
+    float scale[16] = { decal.Size[0] * 2.0f, 0, 0, 0, 0, -decal.Size[1] * 2.0f, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+    float vw[16];
+    float vwo[16];
+    Multiply( view, w, vw );
+    Multiply( vw, offset, vwo );
+    Multiply( vwo, scale, out );
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/** Groups the visible decals into instanced draw calls
+
+    Only alpha-blended decals have to be drawn back to front, everything else (additive, modulated,
+    alpha-tested) looks the same in any order. Those are grouped by blend-mode and material, so
+    every group is one draw call, and are drawn first. The blended decals follow sorted by distance,
+    where neighbours with the same material still share a draw call.
+
+    The instance matrices of all decals are then written in one go, the same matrices the single
+    draw calls used to get: View * World * Offset * Scale, with the world rotation replaced for
+    camera-aligned decals.
+
+    All matrices are stored with the translation in the fourth column, like GetViewMatrixXM and
+    GetWorldMatrixXM return them. Doesn't know anything about the engine, so it can be tested on its own. */
+
+/** Same values as zTVisualCamAlign */
+enum EDecalAlignment {
+    DA_NONE = 0,
+    DA_YAW = 1,
+    DA_FULL = 2
+};
+
+struct DecalInstanceInput {
+    /** Only compared, to find the decals which can share a draw call */
+    const void* Material;
+    int AlphaFunc;
+    int Alignment;
+
+    /** Distance to the camera, for the decals which have to be sorted */
+    float Distance;
+
+    float World[16];
+
+    /** Used instead of the world matrix by camera-aligned decals */
+    float Position[3];
+
+    float Size[2];
+    float Offset[2];
+};
+
+struct DecalBatch {
+    const void* Material;
+    int AlphaFunc;
+
+    /** Range inside of the instance order */
+    uint32_t FirstInstance;
+    uint32_t NumInstances;
+};
+
+class DecalBatcher {
+public:
+    /** Builds the batches for the given decals. Decals using orderedAlphaFunc are drawn last and back to front. */
+    void Build( const DecalInstanceInput* decals, size_t numDecals, int orderedAlphaFunc );
+
+    /** Index of the input decal for every instance, in drawing order */
+    const std::vector<uint32_t>& GetOrder() const { return Order; }
+    const std::vector<DecalBatch>& GetBatches() const { return Batches; }
+
+private:
+    struct SortKey {
+        int AlphaFunc;
+        const void* Material;
+        uint32_t Index;
+    };
+
+    std::vector<SortKey> Unordered;
+    std::vector<std::pair<float, uint32_t>> Ordered;
+    std::vector<uint32_t> Order;
+    std::vector<DecalBatch> Batches;
+};
+
+namespace DecalInstancing {
+    /** Writes the instance matrix of every decal in order to out, one every stride bytes. The matrices
+        are transposed, ready to be read as rows of an instance stream. */
+    void WriteInstanceMatrices( const DecalInstanceInput* decals, const uint32_t* order, size_t count,
+        const float view[16], const float cameraPosition[3], void* out, size_t stride );
+
+    /** Straight matrix multiplications for one decal, as reference for the test-tool. Not transposed. */
+    void ComputeInstanceMatrixReference( const DecalInstanceInput& decal, const float view[16],
+        const float cameraPosition[3], float out[16] );
+}
@@ -0,0 +1,521 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/** Bounding volume hierarchy over boxes which can be added, moved and removed at any time
+
+    Every object gets a leaf, inner nodes hold the box around their two children. New leaves are
+    put next to the node where they enlarge the tree the least, and the tree is kept balanced using
+    rotations, so ray-, sphere- and frustum-queries only have to visit O(log n) nodes.
+
+    Leaves can be enlarged by a margin, so objects moving around a bit don't have to be reinserted.
+    Doesn't know anything about the engine, T is only handed back by the queries. */
+template <typename T>
+class DynamicAABBTree {
+public:
+    static const int NULL_NODE = -1;
+
+    /** Points p with dot(Normal, p) >= Distance are inside */
+    struct Plane {
+        float Normal[3];
+        float Distance;
+    };
+
+    DynamicAABBTree( float margin = 0.0f ) {
+        Margin = margin;
+        Clear();
+    }
+
+    void Clear() {
+        Nodes.clear();
+        Root = NULL_NODE;
+        FreeList = NULL_NODE;
+        NumLeaves = 0;
+    }
+
+    /** Adds an object, returns its proxy to move or remove it later */
+    int Insert( const float min[3], const float max[3], T data ) {
+        int leaf = AllocateNode();
+        Node& n = Nodes[leaf];
+        for ( int a = 0; a < 3; a++ ) {
+            n.Min[a] = min[a] - Margin;
+            n.Max[a] = max[a] + Margin;
+        }
+        n.Data = data;
+        n.Height = 0;
+
+        InsertLeaf( leaf );
+        NumLeaves++;
+        return leaf;
+    }
+
+    void Remove( int proxy ) {
+        RemoveLeaf( proxy );
+        FreeNode( proxy );
+        NumLeaves--;
+    }
+
+    /** Updates the box of an object. Returns whether it had to be reinserted, which is only the case if it
+        left its enlarged box. */
+    bool Move( int proxy, const float min[3], const float max[3] ) {
+        Node& n = Nodes[proxy];
+        if ( Contains( n.Min, n.Max, min, max ) ) {
+            // Still shrink it if it got smaller by more than the margin, or queries would keep hitting it
+            bool tooLarge = false;
+            for ( int a = 0; a < 3; a++ ) {
+                tooLarge |= (min[a] - n.Min[a]) > 2.0f * Margin;
+                tooLarge |= (n.Max[a] - max[a]) > 2.0f * Margin;
+            }
+
+            if ( !tooLarge )
+                return false;
+        }
+
+        RemoveLeaf( proxy );
+
+        Node& moved = Nodes[proxy];
+        for ( int a = 0; a < 3; a++ ) {
+            moved.Min[a] = min[a] - Margin;
+            moved.Max[a] = max[a] + Margin;
+        }
+
+        InsertLeaf( proxy );
+        return true;
+    }
+
+    T GetData( int proxy ) const { return Nodes[proxy].Data; }
+
+    /** Enlarged box of the given object */
+    const float* GetMin( int proxy ) const { return Nodes[proxy].Min; }
+    const float* GetMax( int proxy ) const { return Nodes[proxy].Max; }
+
+    size_t Size() const { return NumLeaves; }
+    bool IsEmpty() const { return NumLeaves == 0; }
+    int GetHeight() const { return Root == NULL_NODE ? 0 : Nodes[Root].Height; }
+
+    /** Calls fn( T ) for all objects whose box overlaps the given one */
+    template <typename F>
+    void QueryBox( const float min[3], const float max[3], F fn ) const {
+        Traverse( [&]( const Node& n ) { return Overlaps( n.Min, n.Max, min, max ); }, fn );
+    }
+
+    /** Calls fn( T ) for all objects whose box touches the sphere */
+    template <typename F>
+    void QuerySphere( const float center[3], float radius, F fn ) const {
+        Traverse( [&]( const Node& n ) { return SphereIntersectsBox( center, radius, n.Min, n.Max ); }, fn );
+    }
+
+    /** Calls fn( T ) for all objects whose box isn't completely outside of one of the planes. Subtrees
+        which are completely inside of a plane don't get tested against it again. */
+    template <typename F>
+    void QueryFrustum( const Plane* planes, int numPlanes, F fn ) const {
+        if ( Root == NULL_NODE )
+            return;
+
+        Stack<std::pair<int, unsigned int>> stack;
+        stack.Push( std::make_pair( Root, (1u << numPlanes) - 1 ) );
+
+        while ( !stack.IsEmpty() ) {
+            const std::pair<int, unsigned int> entry = stack.Pop();
+            const int index = entry.first;
+            unsigned int planeMask = entry.second;
+
+            const Node& n = Nodes[index];
+
+            bool outside = false;
+            for ( int i = 0; i < numPlanes && planeMask; i++ ) {
+                if ( !(planeMask & (1u << i)) )
+                    continue;
+
+                const Plane& p = planes[i];
+                float nearDist = 0.0f, farDist = 0.0f;
+                for ( int a = 0; a < 3; a++ ) {
+                    nearDist += p.Normal[a] * (p.Normal[a] >= 0.0f ? n.Min[a] : n.Max[a]);
+                    farDist += p.Normal[a] * (p.Normal[a] >= 0.0f ? n.Max[a] : n.Min[a]);
+                }
+
+                if ( farDist < p.Distance ) {
+                    outside = true;
+                    break;
+                }
+
+                if ( nearDist >= p.Distance )
+                    planeMask &= ~(1u << i);
+            }
+
+            if ( outside )
+                continue;
+
+            if ( n.IsLeaf() ) {
+                fn( n.Data );
+            } else {
+                stack.Push( std::make_pair( n.Child1, planeMask ) );
+                stack.Push( std::make_pair( n.Child2, planeMask ) );
+            }
+        }
+    }
+
+    /** Calls fn( T, t ) for all objects whose box is hit by the ray no further than maxT, with t being the
+        distance where the ray enters the box. fn returns the new maxT, so returning t finds the closest hit
+        and returning maxT finds all of them. Uses the same math as Toolbox::IntersectBox. */
+    template <typename F>
+    void QueryRay( const float origin[3], const float direction[3], float maxT, F fn ) const {
+        if ( Root == NULL_NODE )
+            return;
+
+        float invDir[3];
+        for ( int a = 0; a < 3; a++ ) {
+            invDir[a] = 1.0f / direction[a];
+        }
+
+        Stack<int> stack;
+        stack.Push( Root );
+
+        while ( !stack.IsEmpty() ) {
+            const Node& n = Nodes[stack.Pop()];
+
+            float t;
+            if ( !IntersectRay( n.Min, n.Max, origin, invDir, t ) || t > maxT )
+                continue;
+
+            if ( n.IsLeaf() ) {
+                maxT = fn( n.Data, t );
+            } else {
+                stack.Push( n.Child1 );
+                stack.Push( n.Child2 );
+            }
+        }
+    }
+
+    static bool Overlaps( const float minA[3], const float maxA[3], const float minB[3], const float maxB[3] ) {
+        for ( int a = 0; a < 3; a++ ) {
+            if ( maxA[a] < minB[a] || minA[a] > maxB[a] )
+                return false;
+        }
+        return true;
+    }
+
+    static bool SphereIntersectsBox( const float center[3], float radius, const float min[3], const float max[3] ) {
+        float d2 = 0.0f;
+        for ( int a = 0; a < 3; a++ ) {
+            const float v = std::max( min[a] - center[a], std::max( 0.0f, center[a] - max[a] ) );
+            d2 += v * v;
+        }
+
+        return d2 <= radius * radius;
+    }
+
+    /** Slab test, t is the distance where the ray enters the box (negative if the origin is inside) */
+    static bool IntersectRay( const float min[3], const float max[3], const float origin[3], const float invDir[3], float& t ) {
+        const float t1 = (min[0] - origin[0]) * invDir[0];
+        const float t2 = (max[0] - origin[0]) * invDir[0];
+        const float t3 = (min[1] - origin[1]) * invDir[1];
+        const float t4 = (max[1] - origin[1]) * invDir[1];
+        const float t5 = (min[2] - origin[2]) * invDir[2];
+        const float t6 = (max[2] - origin[2]) * invDir[2];
+
+        const float tmin = std::max( std::max( std::min( t1, t2 ), std::min( t3, t4 ) ), std::min( t5, t6 ) );
+        const float tmax = std::min( std::min( std::max( t1, t2 ), std::max( t3, t4 ) ), std::max( t5, t6 ) );
+
+        if ( tmax < 0 || tmin > tmax )
+            return false;
+
+        t = tmin;
+        return true;
+    }
+
+private:
+    struct Node {
+        float Min[3];
+        float Max[3];
+        T Data;
+
+        /** Parent, or the next free node while on the free list */
+        int Parent;
+        int Child1;
+        int Child2;
+
+        /** Leaves are 0, free nodes -1 */
+        int Height;
+
+        bool IsLeaf() const { return Child1 == NULL_NODE; }
+    };
+
+    /** Visits all nodes passing the test and calls fn for the leaves */
+    template <typename Test, typename F>
+    void Traverse( Test test, F fn ) const {
+        if ( Root == NULL_NODE )
+            return;
+
+        Stack<int> stack;
+        stack.Push( Root );
+
+        while ( !stack.IsEmpty() ) {
+            const Node& n = Nodes[stack.Pop()];
+
+            if ( !test( n ) )
+                continue;
+
+            if ( n.IsLeaf() ) {
+                fn( n.Data );
+            } else {
+                stack.Push( n.Child1 );
+                stack.Push( n.Child2 );
+            }
+        }
+    }
+
+    /** Traversal stack, only allocates for trees which are deeper than the balancing allows anyways */
+    template <typename S>
+    class Stack {
+    public:
+        Stack() { Count = 0; }
+
+        void Push( const S& s ) {
+            if ( Count < FIXED_SIZE )
+                Fixed[Count] = s;
+            else
+                Overflow.push_back( s );
+            Count++;
+        }
+
+        S Pop() {
+            Count--;
+            if ( Count < FIXED_SIZE )
+                return Fixed[Count];
+
+            S s = Overflow.back();
+            Overflow.pop_back();
+            return s;
+        }
+
+        bool IsEmpty() const { return Count == 0; }
+
+    private:
+        static const size_t FIXED_SIZE = 64;
+        S Fixed[FIXED_SIZE];
+        std::vector<S> Overflow;
+        size_t Count;
+    };
+
+    int AllocateNode() {
+        int index;
+        if ( FreeList != NULL_NODE ) {
+            index = FreeList;
+            FreeList = Nodes[index].Parent;
+        } else {
+            index = static_cast<int>(Nodes.size());
+            Nodes.push_back( Node() );
+        }
+
+        Node& n = Nodes[index];
+        n.Parent = NULL_NODE;
+        n.Child1 = NULL_NODE;
+        n.Child2 = NULL_NODE;
+        n.Height = 0;
+        n.Data = T();
+        return index;
+    }
+
+    void FreeNode( int index ) {
+        Nodes[index].Parent = FreeList;
+        Nodes[index].Height = -1;
+        FreeList = index;
+    }
+
+    static bool Contains( const float outerMin[3], const float outerMax[3], const float min[3], const float max[3] ) {
+        for ( int a = 0; a < 3; a++ ) {
+            if ( min[a] < outerMin[a] || max[a] > outerMax[a] )
+                return false;
+        }
+        return true;
+    }
+
+    static float SurfaceArea( const float min[3], const float max[3] ) {
+        const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    static float CombinedArea( const Node& a, const Node& b ) {
+        float min[3], max[3];
+        for ( int i = 0; i < 3; i++ ) {
+            min[i] = std::min( a.Min[i], b.Min[i] );
+            max[i] = std::max( a.Max[i], b.Max[i] );
+        }
+        return SurfaceArea( min, max );
+    }
+
+    /** Recomputes box and height of an inner node from its children */
+    void Refit( int index ) {
+        Node& n = Nodes[index];
+        const Node& c1 = Nodes[n.Child1];
+        const Node& c2 = Nodes[n.Child2];
+        for ( int a = 0; a < 3; a++ ) {
+            n.Min[a] = std::min( c1.Min[a], c2.Min[a] );
+            n.Max[a] = std::max( c1.Max[a], c2.Max[a] );
+        }
+        n.Height = 1 + std::max( c1.Height, c2.Height );
+    }
+
+    void InsertLeaf( int leaf ) {
+        if ( Root == NULL_NODE ) {
+            Root = leaf;
+            Nodes[Root].Parent = NULL_NODE;
+            return;
+        }
+
+        // Walk down to the node where adding the leaf costs the least surface area
+        int index = Root;
+        while ( !Nodes[index].IsLeaf() ) {
+            const Node& n = Nodes[index];
+            const float area = SurfaceArea( n.Min, n.Max );
+            const float combinedArea = CombinedArea( n, Nodes[leaf] );
+
+            // Cost of making a new parent for this node and the leaf
+            const float cost = 2.0f * combinedArea;
+
+            // Minimum cost of pushing the leaf further down
+            const float inheritanceCost = 2.0f * (combinedArea - area);
+
+            float childCost[2];
+            const int children[2] = { n.Child1, n.Child2 };
+            for ( int c = 0; c < 2; c++ ) {
+                const Node& child = Nodes[children[c]];
+                if ( child.IsLeaf() ) {
+                    childCost[c] = CombinedArea( child, Nodes[leaf] ) + inheritanceCost;
+                } else {
+                    childCost[c] = CombinedArea( child, Nodes[leaf] ) - SurfaceArea( child.Min, child.Max ) + inheritanceCost;
+                }
+            }
+
+            if ( cost < childCost[0] && cost < childCost[1] )
+                break;
+
+            index = childCost[0] < childCost[1] ? children[0] : children[1];
+        }
+
+        // Make a new parent for the sibling and the leaf
+        const int sibling = index;
+        const int oldParent = Nodes[sibling].Parent;
+        const int newParent = AllocateNode();
+        Nodes[newParent].Parent = oldParent;
+        Nodes[newParent].Child1 = sibling;
+        Nodes[newParent].Child2 = leaf;
+        Nodes[sibling].Parent = newParent;
+        Nodes[leaf].Parent = newParent;
+
+        if ( oldParent != NULL_NODE ) {
+            if ( Nodes[oldParent].Child1 == sibling )
+                Nodes[oldParent].Child1 = newParent;
+            else
+                Nodes[oldParent].Child2 = newParent;
+        } else {
+            Root = newParent;
+        }
+
+        RefitUpwards( newParent );
+    }
+
+    void RemoveLeaf( int leaf ) {
+        if ( leaf == Root ) {
+            Root = NULL_NODE;
+            return;
+        }
+
+        const int parent = Nodes[leaf].Parent;
+        const int grandParent = Nodes[parent].Parent;
+        const int sibling = Nodes[parent].Child1 == leaf ? Nodes[parent].Child2 : Nodes[parent].Child1;
+
+        // The sibling takes the place of the parent
+        if ( grandParent != NULL_NODE ) {
+            if ( Nodes[grandParent].Child1 == parent )
+                Nodes[grandParent].Child1 = sibling;
+            else
+                Nodes[grandParent].Child2 = sibling;
+
+            Nodes[sibling].Parent = grandParent;
+            FreeNode( parent );
+            RefitUpwards( grandParent );
+        } else {
+            Root = sibling;
+            Nodes[sibling].Parent = NULL_NODE;
+            FreeNode( parent );
+        }
+
+        Nodes[leaf].Parent = NULL_NODE;
+    }
+
+    /** Rebalances and refits all nodes from the given one up to the root */
+    void RefitUpwards( int index ) {
+        while ( index != NULL_NODE ) {
+            index = Balance( index );
+            Refit( index );
+            index = Nodes[index].Parent;
+        }
+    }
+
+    /** Rotates the given node, if one of its children is more than one level higher than the other one.
+        Returns the node now at its place. */
+    int Balance( int a ) {
+        Node& A = Nodes[a];
+        if ( A.IsLeaf() )
+            return a;
+
+        const int b = A.Child1;
+        const int c = A.Child2;
+        const int balance = Nodes[c].Height - Nodes[b].Height;
+
+        if ( balance > 1 )
+            return Rotate( a, c, b );
+
+        if ( balance < -1 )
+            return Rotate( a, b, c );
+
+        return a;
+    }
+
+    /** Pulls the higher child up to the place of a. other is the lower child, which stays below a. */
+    int Rotate( int a, int up, int other ) {
+        const int f = Nodes[up].Child1;
+        const int g = Nodes[up].Child2;
+
+        // up takes the place of a
+        Nodes[up].Child1 = a;
+        Nodes[up].Parent = Nodes[a].Parent;
+        Nodes[a].Parent = up;
+
+        if ( Nodes[up].Parent != NULL_NODE ) {
+            if ( Nodes[Nodes[up].Parent].Child1 == a )
+                Nodes[Nodes[up].Parent].Child1 = up;
+            else
+                Nodes[Nodes[up].Parent].Child2 = up;
+        } else {
+            Root = up;
+        }
+
+        // The higher grandchild stays at up, the lower one goes to a
+        int keep = f, move = g;
+        if ( Nodes[f].Height < Nodes[g].Height ) {
+            keep = g;
+            move = f;
+        }
+
+        Nodes[up].Child2 = keep;
+        Nodes[a].Child1 = other;
+        Nodes[a].Child2 = move;
+        Nodes[move].Parent = a;
+
+        Refit( a );
+        Refit( up );
+        return up;
+    }
+
+    std::vector<Node> Nodes;
+    int Root;
+    int FreeList;
+    size_t NumLeaves;
+    float Margin;
+};
@@ -14,6 +14,9 @@ namespace Engine {
     void CreateGraphicsEngine() {
         LogInfo() << "Creating Main graphics engine";
 
+        // The engine already loads its textures and meshes on the workers while initializing
+        WorkerThreadPool = new ThreadPool;
+
         GraphicsEngine = new D3D11GraphicsEngine;
 
         if ( !GraphicsEngine ) {
@@ -28,7 +31,6 @@ namespace Engine {
 
         // Create threadpool
         RenderingThreadPool = new ThreadPool;
-        WorkerThreadPool = new ThreadPool;
     }
 
     /** Creates the Global GAPI-Object */
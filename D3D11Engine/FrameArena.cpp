@@ -0,0 +1,110 @@
+#include "FrameArena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+std::atomic<uint32_t> FrameArena::GlobalEpoch( 0 );
+
+FrameArena::FrameArena() {
+    CurrentChunk = 0;
+    Offset = 0;
+    LastAllocation = nullptr;
+    Epoch = GlobalEpoch.load( std::memory_order_relaxed );
+    NumAllocations = 0;
+    BytesAllocated = 0;
+}
+
+FrameArena::~FrameArena() {
+    for ( const Chunk& chunk : Chunks ) {
+        free( chunk.Data );
+    }
+}
+
+/** Starts a new chunk which can hold at least the given amount of bytes */
+void FrameArena::AddChunk( size_t minSize ) {
+    Chunk chunk;
+    chunk.Size = std::max( minSize, Chunks.empty() ? DEFAULT_CHUNK_SIZE : Chunks.back().Size * 2 );
+    chunk.Data = static_cast<uint8_t*>(malloc( chunk.Size ));
+    if ( !chunk.Data )
+        throw std::bad_alloc();
+
+    Chunks.push_back( chunk );
+}
+
+/** Returns memory which stays valid until the end of the frame */
+void* FrameArena::Allocate( size_t size, size_t alignment ) {
+    if ( Chunks.empty() ) {
+        AddChunk( size + alignment );
+        CurrentChunk = 0;
+        Offset = 0;
+    }
+
+    for ( ;;) {
+        const Chunk& chunk = Chunks[CurrentChunk];
+        const uintptr_t base = reinterpret_cast<uintptr_t>(chunk.Data);
+        const uintptr_t aligned = (base + Offset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        const size_t end = static_cast<size_t>(aligned - base) + size;
+
+        if ( end <= chunk.Size ) {
+            Offset = end;
+            LastAllocation = reinterpret_cast<uint8_t*>(aligned);
+            NumAllocations++;
+            BytesAllocated += size;
+            return LastAllocation;
+        }
+
+        // Chunks are only ever appended during a frame, so the current one is always the last
+        AddChunk( size + alignment );
+        CurrentChunk = Chunks.size() - 1;
+        Offset = 0;
+    }
+}
+
+/** Gives the memory back if it was the most recent allocation */
+void FrameArena::Free( void* p, size_t size ) {
+    // Only if it is the whole of the most recent allocation
+    if ( !p || p != LastAllocation || LastAllocation + size != Chunks[CurrentChunk].Data + Offset )
+        return;
+
+    Offset = static_cast<size_t>(LastAllocation - Chunks[CurrentChunk].Data);
+    LastAllocation = nullptr;
+}
+
+/** Makes all memory reusable again */
+void FrameArena::Reset() {
+    // Merge the chunks of a frame which didn't fit, so the next one gets along with a single chunk
+    if ( Chunks.size() > 1 ) {
+        size_t total = 0;
+        for ( const Chunk& chunk : Chunks ) {
+            total += chunk.Size;
+            free( chunk.Data );
+        }
+
+        Chunks.clear();
+        AddChunk( total );
+    }
+
+    CurrentChunk = 0;
+    Offset = 0;
+    LastAllocation = nullptr;
+    NumAllocations = 0;
+    BytesAllocated = 0;
+}
+
+/** Returns the arena of the calling thread */
+FrameArena& FrameArena::Get() {
+    thread_local FrameArena arena;
+
+    const uint32_t epoch = GlobalEpoch.load( std::memory_order_relaxed );
+    if ( arena.Epoch != epoch ) {
+        arena.Reset();
+        arena.Epoch = epoch;
+    }
+
+    return arena;
+}
+
+/** Ends the frame for all threads */
+void FrameArena::EndFrame() {
+    GlobalEpoch.fetch_add( 1, std::memory_order_relaxed );
+}
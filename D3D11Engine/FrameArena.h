@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <vector>
+
+/** Linear allocator for data which only lives for a single frame
+
+    Every thread gets its own arena, allocating is just bumping an offset inside a chunk and freeing
+    does nothing, unless it was the most recent allocation. At the end of the frame all arenas are
+    rewound at once. If a frame needed more than one chunk, they are merged into a single chunk of
+    the combined size, so the arena settles at the high-water mark and stops touching the heap.
+
+    Containers using it must be created and destroyed inside of one frame. Some allocate when they are
+    constructed, like the head-node of MSVC's std::map, so they can't be members which outlive a frame. */
+class FrameArena {
+public:
+    FrameArena();
+    ~FrameArena();
+
+    FrameArena( const FrameArena& ) = delete;
+    FrameArena& operator=( const FrameArena& ) = delete;
+
+    /** Size of the first chunk of each arena */
+    static const size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+    /** Returns memory which stays valid until the end of the frame */
+    void* Allocate( size_t size, size_t alignment );
+
+    /** Gives the memory back if it was the most recent allocation, so growing containers don't waste space */
+    void Free( void* p, size_t size );
+
+    /** Makes all memory reusable again */
+    void Reset();
+
+    /** Statistics of the current frame */
+    size_t GetNumAllocations() const { return NumAllocations; }
+    size_t GetBytesAllocated() const { return BytesAllocated; }
+
+    /** Number of chunks the arena currently owns */
+    size_t GetNumChunks() const { return Chunks.size(); }
+
+    /** Returns the arena of the calling thread */
+    static FrameArena& Get();
+
+    /** Ends the frame for all threads. Each arena rewinds itself the next time it's used on its thread. */
+    static void EndFrame();
+
+private:
+    struct Chunk {
+        uint8_t* Data;
+        size_t Size;
+    };
+
+    /** Starts a new chunk which can hold at least the given amount of bytes */
+    void AddChunk( size_t minSize );
+
+    std::vector<Chunk> Chunks;
+    size_t CurrentChunk;
+    size_t Offset;
+
+    /** Start of the most recent allocation, for Free */
+    uint8_t* LastAllocation;
+
+    /** Frame this arena was last reset for */
+    uint32_t Epoch;
+
+    size_t NumAllocations;
+    size_t BytesAllocated;
+
+    static std::atomic<uint32_t> GlobalEpoch;
+};
+
+/** STL-allocator on top of the FrameArena of the calling thread */
+template <typename T>
+class FrameAllocator {
+public:
+    typedef T value_type;
+
+    FrameAllocator() noexcept {}
+
+    template <typename U>
+    FrameAllocator( const FrameAllocator<U>& ) noexcept {}
+
+    T* allocate( size_t n ) {
+        return static_cast<T*>(FrameArena::Get().Allocate( n * sizeof( T ), alignof(T) ));
+    }
+
+    void deallocate( T* p, size_t n ) noexcept {
+        FrameArena::Get().Free( p, n * sizeof( T ) );
+    }
+
+    template <typename U>
+    bool operator == ( const FrameAllocator<U>& ) const noexcept { return true; }
+
+    template <typename U>
+    bool operator != ( const FrameAllocator<U>& ) const noexcept { return false; }
+};
+
+/** Containers for data which is thrown away at the end of the frame */
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+template <typename T>
+using FrameList = std::list<T, FrameAllocator<T>>;
+
+template <typename K, typename V, typename Compare = std::less<K>>
+using FrameMap = std::map<K, V, Compare, FrameAllocator<std::pair<const K, V>>>;
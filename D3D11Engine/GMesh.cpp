@@ -1,15 +1,76 @@
 #include "GMesh.h"
 
+#include <filesystem>
 #include "assimp\Importer.hpp"
 #include "assimp\postprocess.h"
 #include "assimp\scene.h"
 #include "Engine.h"
 #include "GothicAPI.h"
+#include "MeshCache.h"
+#include "ThreadPool.h"
+#include "ZipFileSystem.h"
 
 #pragma comment(lib, "assimp-vc142-mt.lib")
 
 using namespace Assimp;
 
+static_assert(sizeof( MeshCacheVertex ) == sizeof( ExVertexStruct ), "Cache-files store ExVertexStruct");
+static_assert(sizeof( VERTEX_INDEX ) == sizeof( uint16_t ), "Cache-files store 16-bit indices");
+
+/** A mesh read into memory, handed from the loading thread to the render thread */
+struct GMeshLoadData {
+    struct Submesh {
+        std::string Texture;
+
+        /** Points into the cache-file if the vertices could be used from there, otherwise the owned arrays are filled */
+        const ExVertexStruct* MappedVertices;
+        const VERTEX_INDEX* MappedIndices;
+        unsigned int NumVertices;
+        unsigned int NumIndices;
+
+        std::vector<ExVertexStruct> Vertices;
+        std::vector<VERTEX_INDEX> Indices;
+    };
+
+    /** Stays mapped until the buffers are created */
+    MeshCacheFile Cache;
+    std::vector<Submesh> Submeshes;
+};
+
+namespace {
+    /** Size and modification time of a file, to notice when a cache-file is outdated */
+    bool GetSourceStamp( const std::string& file, uint64_t& size, uint64_t& time ) {
+        std::error_code ec;
+        auto fileSize = std::filesystem::file_size( file, ec );
+        if ( ec )
+            return false;
+
+        auto writeTime = std::filesystem::last_write_time( file, ec );
+        if ( ec )
+            return false;
+
+        size = static_cast<uint64_t>(fileSize);
+        time = static_cast<uint64_t>(writeTime.time_since_epoch().count());
+        return true;
+    }
+
+    void WriteCache( const GMeshLoadData& data, const std::string& file, const MeshCacheWriteOptions& options ) {
+        MeshCacheWriter writer;
+        for ( auto const& s : data.Submeshes ) {
+            writer.AddSubmesh( s.Texture, reinterpret_cast<const MeshCacheVertex*>(s.Vertices.data()), s.NumVertices,
+                s.Indices.data(), s.NumIndices );
+        }
+
+        if ( !writer.Write( file, options ) ) {
+            LogWarn() << "Failed to write mesh cache: " << file;
+            return;
+        }
+
+        LogInfo() << "Wrote mesh cache " << file << " (" << writer.GetNumQuantized() << " of "
+            << data.Submeshes.size() << " submeshes quantized)";
+    }
+}
+
 GMesh::GMesh() {}
 
 GMesh::~GMesh() {
@@ -21,23 +82,209 @@ GMesh::~GMesh() {
 
 /** Load a mesh from file */
 XRESULT GMesh::LoadMesh( const std::string& file, float scale ) {
+    LoadMeshAsync( file, scale );
+    return FinishLoading();
+}
+
+/** Reads the mesh on a worker thread */
+void GMesh::LoadMeshAsync( const std::string& file, float scale ) {
     char dir[260];
     GetCurrentDirectoryA( 260, dir );
     LogInfo() << "Loading custom mesh " << dir << "\\" << file;
 
+    if ( !Engine::WorkerThreadPool ) {
+        std::promise<std::unique_ptr<GMeshLoadData>> result;
+        result.set_value( LoadData( file, scale ) );
+        PendingLoad = result.get_future();
+        return;
+    }
+
+    // Only copies of the arguments go to the thread, so this can be deleted while it runs
+    PendingLoad = Engine::WorkerThreadPool->enqueue( [file, scale]() {
+        return GMesh::LoadData( file, scale );
+    } );
+}
+
+/** Creates the meshes of a background-load */
+XRESULT GMesh::FinishLoading() {
+    if ( !PendingLoad.valid() )
+        return XR_SUCCESS;
+
+    std::unique_ptr<GMeshLoadData> data = PendingLoad.get();
+    if ( !data )
+        return XR_FAILED;
+
+    return CreateMeshes( data.get() );
+}
+
+bool GMesh::IsLoadFinished() const {
+    return !PendingLoad.valid() || PendingLoad.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+}
+
+/** Reads the mesh into memory, from its cache-file if possible */
+std::unique_ptr<GMeshLoadData> GMesh::LoadData( const std::string& file, float scale ) {
     // Check file format
     if ( file.substr( file.find_last_of( "." ) + 1 ) == "mcache" ) {
         // Load cached format
         return LoadCached( file );
     }
 
+    std::string cacheFile = file + MESH_CACHE_EXTENSION;
+
+    MeshCacheWriteOptions options;
+    options.Scale = scale;
+    if ( !GetSourceStamp( file, options.SourceSize, options.SourceTime ) ) {
+        // Some mods only ship the cache-file, also inside of their packs
+        ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem();
+        if ( Toolbox::FileExists( cacheFile ) || (packs && packs->Exists( cacheFile )) ) {
+            return LoadCached( cacheFile );
+        }
+
+        LogError() << "Failed to open custom Mesh: " << file;
+        return nullptr;
+    }
+
+    // Use the cache-file as long as it was made out of this version of the file
+    {
+        MeshCacheFile cache;
+        if ( cache.Open( cacheFile ) ) {
+            const MeshCacheHeader& header = cache.GetHeader();
+            if ( header.SourceSize == options.SourceSize && header.SourceTime == options.SourceTime && header.Scale == scale ) {
+                cache.Close();
+                return LoadCached( cacheFile );
+            }
+
+            LogInfo() << "Mesh cache is outdated: " << cacheFile;
+        }
+    }
+
+    std::unique_ptr<GMeshLoadData> data = Import( file, scale );
+    if ( data ) {
+        WriteCache( *data, cacheFile, options );
+    }
+
+    return data;
+}
+
+/** Loads the cache-file-format */
+std::unique_ptr<GMeshLoadData> GMesh::LoadCached( const std::string& file ) {
+    LogInfo() << "Loading cached mesh: " << file;
+
+    auto data = std::make_unique<GMeshLoadData>();
+
+    // Loose files win over the packs. Only cache-files can come out of them, assimp needs the
+    // files next to a mesh on disk.
+    ZipFileSystem* packs = Engine::GAPI->GetZipFileSystem();
+    if ( packs && !Toolbox::FileExists( file ) && packs->Exists( file ) ) {
+        ZipFile packed = packs->ReadFile( file );
+        if ( !packed.IsValid() || !data->Cache.Open( packed.Data, packed.Size, packed.Buffer ) ) {
+            LogWarn() << "Failed to read packed mesh cache: " << file;
+            return nullptr;
+        }
+    } else if ( !data->Cache.Open( file ) ) {
+        // Either missing or written by an older version
+        return LoadLegacyCached( file );
+    }
+
+    const MeshCacheFile& cache = data->Cache;
+    data->Submeshes.resize( cache.GetNumSubmeshes() );
+    for ( uint32_t i = 0; i < cache.GetNumSubmeshes(); i++ ) {
+        const MeshCacheSubmesh& s = cache.GetSubmesh( i );
+        GMeshLoadData::Submesh& out = data->Submeshes[i];
+
+        out.Texture = cache.GetTextureName( i );
+        out.NumVertices = s.NumVertices;
+        out.NumIndices = s.NumIndices;
+        out.MappedIndices = cache.GetIndices( i );
+
+        // Full precision can be used right out of the file, quantized vertices are decoded here on the loading thread
+        out.MappedVertices = reinterpret_cast<const ExVertexStruct*>(cache.GetFullVertices( i ));
+        if ( !out.MappedVertices ) {
+            out.Vertices.resize( s.NumVertices );
+            cache.DecodeVertices( i, reinterpret_cast<MeshCacheVertex*>(out.Vertices.data()) );
+        }
+    }
+
+    return data;
+}
+
+/** Loads cache-files of the first version */
+std::unique_ptr<GMeshLoadData> GMesh::LoadLegacyCached( const std::string& file ) {
+    FILE* f = fopen( file.c_str(), "rb" );
+
+    if ( !f ) {
+        LogWarn() << "Failed to find cache file: " << file;
+        return nullptr;
+    }
+
+    auto data = std::make_unique<GMeshLoadData>();
+
+    // Read version
+    int Version = 0;
+    fread( &Version, sizeof( Version ), 1, f );
+    if ( Version != 1 ) {
+        LogWarn() << "Broken or unknown mesh cache: " << file;
+        fclose( f );
+        return nullptr;
+    }
+
+    // Read num textures
+    int numTextures;
+    fread( &numTextures, sizeof( numTextures ), 1, f );
+
+    for ( int t = 0; t < numTextures; t++ ) {
+        // Read texture name
+        unsigned char numTxNameChars;
+        fread( &numTxNameChars, sizeof( numTxNameChars ), 1, f );
+
+        char tx[256] = {};
+        if ( numTxNameChars > 255 ) {
+            fread( tx, 255, 1, f );
+            fseek( f, static_cast<long>(numTxNameChars - 255), SEEK_CUR );
+        } else {
+            fread( tx, numTxNameChars, 1, f );
+        }
+
+        // Read num submeshes
+        unsigned char numSubmeshes;
+        fread( &numSubmeshes, sizeof( numSubmeshes ), 1, f );
+
+        for ( int i = 0; i < numSubmeshes; i++ ) {
+            GMeshLoadData::Submesh s = {};
+            s.Texture = tx;
+
+            // Read vertices
+            int numVertices;
+            fread( &numVertices, sizeof( numVertices ), 1, f );
+            s.Vertices.resize( numVertices );
+            fread( s.Vertices.data(), sizeof( ExVertexStruct ) * numVertices, 1, f );
+
+            // Read indices
+            int numIndices;
+            fread( &numIndices, sizeof( numIndices ), 1, f );
+            s.Indices.resize( numIndices );
+            fread( s.Indices.data(), sizeof( VERTEX_INDEX ) * s.Indices.size(), 1, f );
+
+            s.NumVertices = s.Vertices.size();
+            s.NumIndices = s.Indices.size();
+            data->Submeshes.push_back( std::move( s ) );
+        }
+    }
+
+    fclose( f );
+
+    return data;
+}
+
+/** Runs the file through assimp */
+std::unique_ptr<GMeshLoadData> GMesh::Import( const std::string& file, float scale ) {
     Importer imp;
     imp.SetPropertyInteger( AI_CONFIG_PP_SLM_VERTEX_LIMIT, 0xFFFF - 1 );
     const aiScene* s = imp.ReadFile( file, aiProcessPreset_TargetRealtime_Fast | aiProcess_SplitLargeMeshes );
     if ( !s ) {
         LogError() << "Failed to open custom Mesh: " << file;
         LogError() << " - " << imp.GetErrorString();
-        return XR_FAILED;
+        return nullptr;
     }
 
     LogInfo() << "Loading " << std::to_string( s->mNumMeshes ) << " submeshes";
@@ -48,6 +295,8 @@ XRESULT GMesh::LoadMesh( const std::string& file, float scale ) {
             ".mtl-File and the mtllib-reference in the .obj-File. Remember to delete the cache-file after a change!";
     }
 
+    auto data = std::make_unique<GMeshLoadData>();
+
     int startIndex = 0;
     for ( unsigned int i = 0; i < s->mNumMeshes; i++ ) {
         aiString t;
@@ -70,10 +319,12 @@ XRESULT GMesh::LoadMesh( const std::string& file, float scale ) {
             continue;
         }
 
-        MeshInfo* mi = new MeshInfo;
+        GMeshLoadData::Submesh sm = {};
+        sm.Vertices.resize( s->mMeshes[i]->mNumVertices );
+        sm.Indices.resize( s->mMeshes[i]->mNumFaces * 3 );
 
-        ExVertexStruct* vertices = new ExVertexStruct[s->mMeshes[i]->mNumVertices];
-        VERTEX_INDEX* indices = new VERTEX_INDEX[s->mMeshes[i]->mNumFaces * 3];
+        ExVertexStruct* vertices = sm.Vertices.data();
+        VERTEX_INDEX* indices = sm.Indices.data();
 
         for ( unsigned int n = 0; n < s->mMeshes[i]->mNumVertices; n++ ) {
             if ( s->mMeshes[i]->HasNormals() ) {
@@ -117,85 +368,44 @@ XRESULT GMesh::LoadMesh( const std::string& file, float scale ) {
             //LogInfo() << "Got file name: " << name;
         }
 
-        mi->Create( vertices, s->mMeshes[i]->mNumVertices, indices, s->mMeshes[i]->mNumFaces * 3 );
-        Meshes.push_back( mi );
-
-        Textures.push_back( name );
-
-        delete[] vertices;
-        delete[] indices;
+        sm.Texture = name;
+        sm.NumVertices = sm.Vertices.size();
+        sm.NumIndices = sm.Indices.size();
+        data->Submeshes.push_back( std::move( sm ) );
 
         //startIndex += s->mMeshes[i]->mNumFaces * 3;
     }
 
-    return XR_SUCCESS;
+    return data;
 }
 
-/** Draws all buffers this holds */
-void GMesh::DrawMesh() {
-    for ( unsigned int i = 0; i < Meshes.size(); i++ ) {
-        Engine::GAPI->DrawMeshInfo( nullptr, Meshes[i] );
-    }
-}
+/** Creates the buffers of the loaded data */
+XRESULT GMesh::CreateMeshes( GMeshLoadData* data ) {
+    Meshes.reserve( Meshes.size() + data->Submeshes.size() );
+    Textures.reserve( Textures.size() + data->Submeshes.size() );
 
-/** Loads the cache-file-format */
-XRESULT GMesh::LoadCached( const std::string& file ) {
-    FILE* f = fopen( file.c_str(), "rb" );
+    for ( auto& s : data->Submeshes ) {
+        if ( s.NumVertices == 0 || s.NumIndices == 0 )
+            continue;
 
-    LogInfo() << "Loading cached mesh: " << file;
+        ExVertexStruct* vertices = s.MappedVertices ? const_cast<ExVertexStruct*>(s.MappedVertices) : s.Vertices.data();
+        VERTEX_INDEX* indices = s.MappedIndices ? const_cast<VERTEX_INDEX*>(s.MappedIndices) : s.Indices.data();
 
-    if ( !f ) {
-        LogWarn() << "Failed to find cache file: " << file;
-        return XR_FAILED;
+        // Create only reads from the arrays, so the mapped file can go straight in there
+        MeshInfo* mi = new MeshInfo;
+        mi->Create( vertices, s.NumVertices, indices, s.NumIndices );
+        Meshes.push_back( mi );
+        Textures.push_back( s.Texture );
     }
 
-    // Read version
-    int Version;
-    fread( &Version, sizeof( Version ), 1, f );
-
-    // Read num textures
-    int numTextures;
-    fread( &numTextures, sizeof( numTextures ), 1, f );
-
-    for ( int t = 0; t < numTextures; t++ ) {
-        // Read texture name
-        unsigned char numTxNameChars;
-        fread( &numTxNameChars, sizeof( numTxNameChars ), 1, f );
-
-        char tx[256] = {};
-        if ( numTxNameChars > 255 ) {
-            fread( tx, 255, 1, f );
-            fseek( f, static_cast<long>(numTxNameChars - 255), SEEK_CUR );
-        } else {
-            fread( tx, numTxNameChars, 1, f );
-        }
-
-        // Read num submeshes
-        unsigned char numSubmeshes;
-        fread( &numSubmeshes, sizeof( numSubmeshes ), 1, f );
-
-        for ( int i = 0; i < numSubmeshes; i++ ) {
-            MeshInfo* mi = new MeshInfo;
-
-            // Read vertices
-            int numVertices;
-            fread( &numVertices, sizeof( numVertices ), 1, f );
-            mi->Vertices.resize( numVertices );
-            fread( &mi->Vertices[0], sizeof( ExVertexStruct ) * numVertices, 1, f );
+    return XR_SUCCESS;
+}
 
-            // Read indices
-            int numIndices;
-            fread( &numIndices, sizeof( numIndices ), 1, f );
-            mi->Indices.resize( numIndices );
-            fread( &mi->Indices[0], sizeof( VERTEX_INDEX ) * mi->Indices.size(), 1, f );
+/** Draws all buffers this holds */
+void GMesh::DrawMesh() {
+    FinishLoading();
 
-            // Add to GMesh
-            Meshes.push_back( mi );
-            Textures.push_back( std::string( tx ) );
-        }
+    for ( unsigned int i = 0; i < Meshes.size(); i++ ) {
+        Engine::GAPI->DrawMeshInfo( nullptr, Meshes[i] );
     }
-
-    fclose( f );
-
-    return XR_SUCCESS;
 }
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
 enum XRESULT;
 struct MeshInfo;
+struct GMeshLoadData;
 
 class GMesh {
 public:
@@ -16,20 +19,43 @@ public:
         LT_SIMPLEOBJ
     };
 
-    /** Load a mesh from file  */
+    /** Load a mesh from file. Imported meshes are cached in a .mcache-file next to it. */
     XRESULT LoadMesh( const std::string& file, float scale = 1.0f );
 
+    /** Reads the mesh on a worker thread. The meshes are created on the render thread the first time they are needed. */
+    void LoadMeshAsync( const std::string& file, float scale = 1.0f );
+
+    /** Creates the meshes of a background-load, waits for it if it isn't done yet */
+    XRESULT FinishLoading();
+
+    /** Returns true if no background-load is running anymore */
+    bool IsLoadFinished() const;
+
     /** Draws all buffers this holds */
     void DrawMesh();
 
     /** Returns the meshes */
-    std::vector<MeshInfo*>& GetMeshes() { return Meshes; }
-    std::vector<std::string>& GetTextures() { return Textures; }
+    std::vector<MeshInfo*>& GetMeshes() { FinishLoading(); return Meshes; }
+    std::vector<std::string>& GetTextures() { FinishLoading(); return Textures; }
 
 private:
+    /** Reads the mesh into memory, from its cache-file if possible. Can run on any thread. */
+    static std::unique_ptr<GMeshLoadData> LoadData( const std::string& file, float scale );
+
     /** Loads the cache-file-format */
-    XRESULT LoadCached( const std::string& file );
+    static std::unique_ptr<GMeshLoadData> LoadCached( const std::string& file );
+
+    /** Loads cache-files of the first version */
+    static std::unique_ptr<GMeshLoadData> LoadLegacyCached( const std::string& file );
+
+    /** Runs the file through assimp */
+    static std::unique_ptr<GMeshLoadData> Import( const std::string& file, float scale );
+
+    /** Creates the buffers of the loaded data, has to run on the render thread */
+    XRESULT CreateMeshes( GMeshLoadData* data );
 
     std::vector<MeshInfo*> Meshes;
     std::vector<std::string> Textures;
+
+    std::future<std::unique_ptr<GMeshLoadData>> PendingLoad;
 };
@@ -116,7 +116,7 @@ XRESULT GSky::AddSkyTexture( const std::string& file ) {
 /** Loads the sky resources */
 XRESULT GSky::LoadSkyResources() {
     SkyDome = std::make_unique<GMesh>();
-    SkyDome->LoadMesh( "system\\GD3D11\\meshes\\unitSphere.obj" );
+    SkyDome->LoadMeshAsync( "system\\GD3D11\\meshes\\unitSphere.obj" ); // Done by the time the sky gets drawn
     //SkyDome->LoadMesh("system\\GD3D11\\meshes\\skySphere.obj");
 
     LogInfo() << "Loading sky textures...";
@@ -131,17 +131,17 @@ XRESULT GSky::LoadSkyResources() {
     XLE( Engine::GraphicsEngine->CreateTexture( &cloudTex ) );
     CloudTexture.reset( cloudTex );
 
-#ifdef BUILD_GOTHIC_1_08k
-    XLE( CloudTexture->Init( "system\\GD3D11\\Textures\\SkyDay_G1.dds" ) );
-#else
-    XLE( CloudTexture->Init( "system\\GD3D11\\Textures\\SkyDay.dds" ) );
-#endif
-
     D3D11Texture* nightTex;
     XLE( Engine::GraphicsEngine->CreateTexture( &nightTex ) );
     NightTexture.reset( nightTex );
 
-    XLE( NightTexture->Init( "system\\GD3D11\\Textures\\starsh.dds" ) );
+#ifdef BUILD_GOTHIC_1_08k
+    const std::string cloudFile = "system\\GD3D11\\Textures\\SkyDay_G1.dds";
+#else
+    const std::string cloudFile = "system\\GD3D11\\Textures\\SkyDay.dds";
+#endif
+
+    XLE( D3D11Texture::InitFiles( { CloudTexture.get(), NightTexture.get() }, { cloudFile, "system\\GD3D11\\Textures\\starsh.dds" } ) );
 
     VERTEX_INDEX indices[] = { 0, 1,2,3,4,5 };
     SkyPlane = std::make_unique<MeshInfo>();
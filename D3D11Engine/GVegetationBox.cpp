@@ -10,6 +10,28 @@
 #include "D3D11Texture.h"
 #include "D3D11GraphicsEngine.h"
 #include "zCMaterial.h"
+#include "VegetationPlacement.h"
+
+namespace {
+    /** Distance between two grass-meshes at density 1 */
+    const float VEGETATION_SPACING = 40.0f;
+
+    /** Lower bound for the density, so a slider at zero doesn't blow up the spacing */
+    const float MIN_DENSITY = 0.01f;
+
+    /** Version of the snapshot-chunks written by SaveToBuffer */
+    const uint32_t VEGETATION_CHUNK_VERSION = 1;
+
+    /** FNV-1a over the triangle-data, used as seed for the placement */
+    unsigned int HashTriangles( const std::vector<DirectX::XMFLOAT3>& tris ) {
+        unsigned int h = 2166136261u;
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(tris.data());
+        for ( size_t i = 0; i < tris.size() * sizeof( DirectX::XMFLOAT3 ); i++ ) {
+            h = (h ^ data[i]) * 16777619u;
+        }
+        return h;
+    }
+}
 
 GVegetationBox::GVegetationBox() {
     VegetationMesh = nullptr;
@@ -21,6 +43,12 @@ GVegetationBox::GVegetationBox() {
     DrawBoundingBox = false;
     Modified = false;
     Density = 1.0f;
+    Shape = S_None;
+    SpatialProxy = -1;
+    SnapshotId = 0;
+    SnapshotDirty = true;
+    SpotGridCellSize = 1.0f;
+    SpotGridCells[0] = SpotGridCells[1] = 0;
 }
 
 
@@ -219,56 +247,29 @@ void GVegetationBox::InitSpotsRandom( const std::vector<DirectX::XMFLOAT3>& tris
     delete InstancingBuffer; InstancingBuffer = nullptr;
     delete GrassCB; GrassCB = nullptr;
     VegetationSpots.clear();
-
-    // Find random spots on the polygons (TODO: This is still based off the size of the polygons!)
-    std::vector<DirectX::XMFLOAT3> spots;
-    for ( unsigned int i = 0; i < trisInside.size(); i += 3 ) {
-        for ( unsigned int d = 0; d < std::max( 1.0f, 30 * density ); d++ ) {
-            DirectX::XMFLOAT3 tri[] = { trisInside[i], trisInside[i + 1], trisInside[i + 2] };
-
-
-            float b0 = Toolbox::frand();
-            float b1 = (1.0f - b0) * Toolbox::frand();
-            float b2 = 1 - b0 - b1;
-
-
-            DirectX::XMFLOAT3 rnd;
-            XMStoreFloat3( &rnd, XMLoadFloat3( &tri[0] ) * b0 + XMLoadFloat3( &tri[1] ) * b1 + XMLoadFloat3( &tri[2] ) * b2 );
-
-            // Get 2 random points on the edges
-            /*DirectX::XMFLOAT3 rp[3];
-            XMVECTOR rp[0] = DirectX::XMVectorLerpV(XMLoadFloat3(&tri[0]), XMLoadFloat3(&tri[1]), Toolbox::frand());
-            XMVECTOR rp[1] = DirectX::XMVectorLerpV(XMLoadFloat3(&tri[0]), XMLoadFloat3(&tri[2]), Toolbox::frand());
-
-            // Get the last point on that random made edge
-            XMVECTOR rp[2] = DirectX::XMVectorLerpV(rp[0], rp[1], Toolbox::frand());*/
-
-            if ( PositionInsideBox( rnd ) ) {
-                if ( shape == S_Circle ) // Restrict to smalles circle inside our AABB
-                {
-                    float dist;
-                    XMStoreFloat( &dist, DirectX::XMVector2Length( XMVectorSet( rnd.x, rnd.z, 0, 0 ) - XMVectorSet( mid.x, mid.z, 0, 0 ) ) );
-
-                    if ( dist >= rad )
-                        continue;
-                }
-
-                spots.push_back( rnd );
+    SpotGridStart.clear();
+    SpotGridIndices.clear();
+    SnapshotDirty = true;
+
+    // Spread the grass evenly over the polygons, seeded by their positions so a reset gives the same result
+    VegetationPlacement::Settings settings;
+    settings.Seed = HashTriangles( trisInside );
+    settings.MinDistance = VEGETATION_SPACING / sqrtf( std::max( MIN_DENSITY, density ) );
+
+    if ( !trisInside.empty() ) {
+        VegetationPlacement::Place( &trisInside[0].x, trisInside.size() / 3, settings, [&]( const float* p ) {
+            if ( !PositionInsideBox( XMFLOAT3( p[0], p[1], p[2] ) ) )
+                return false;
+
+            // Restrict to smallest circle inside our AABB
+            if ( shape == S_Circle ) {
+                const float dx = p[0] - mid.x;
+                const float dz = p[2] - mid.z;
+                return dx * dx + dz * dz < rad * rad;
             }
-        }
-    }
-
-
-    // Create the transformation matrices for every spot
-    for ( unsigned int i = 0; i < spots.size(); i++ ) {
-        XMMATRIX w = DirectX::XMMatrixTranslation( spots[i].x, spots[i].y, spots[i].z );
-        float scale = Toolbox::lerp( 20, 80, Toolbox::frand() );
-        XMMATRIX s = DirectX::XMMatrixScaling( scale, scale, scale );
-        XMMATRIX r = DirectX::XMMatrixRotationY( Toolbox::frand() * DirectX::XM_2PI );
 
-        DirectX::XMFLOAT4X4 w_float4x4;
-        XMStoreFloat4x4( &w_float4x4, DirectX::XMMatrixTranspose( r * s * w ) );
-        VegetationSpots.push_back( w_float4x4 );
+            return true;
+        }, VegetationSpots );
     }
 
     if ( VegetationSpots.empty() ) {
@@ -277,12 +278,13 @@ void GVegetationBox::InitSpotsRandom( const std::vector<DirectX::XMFLOAT3>& tris
 
     // Create instancing buffer for this box
     Engine::GraphicsEngine->CreateVertexBuffer( &InstancingBuffer );
-    InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( DirectX::XMFLOAT4X4 ) );
+    InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( VegetationInstance ) );
 
     // Create constant buffer
     Engine::GraphicsEngine->CreateConstantBuffer( &GrassCB, nullptr, sizeof( GrassConstantBuffer ) );
 
     RefitBoundingBox();
+    BuildSpotGrid();
 
     Density = density;
     return;
@@ -341,7 +343,7 @@ void GVegetationBox::RenderVegetation( const DirectX::XMFLOAT3& eye ) {
     GrassCB->BindToVertexShader( 1 );
 
     // Draw the batch
-    VegetationMesh->DrawBatch( InstancingBuffer, VegetationSpots.size(), sizeof( DirectX::XMFLOAT4X4 ) );
+    VegetationMesh->DrawBatch( InstancingBuffer, VegetationSpots.size(), sizeof( VegetationInstance ) );
 
     /*for(int i=0;i<VegetationSpots.size();i++)
     {
@@ -377,13 +379,9 @@ void GVegetationBox::VisualizeGrass( const DirectX::XMFLOAT4& color ) {
         if ( i % 10 != 0 )
             continue; // Only render every 10th grassmesh
 
-        DirectX::XMFLOAT3 spot = DirectX::XMFLOAT3( VegetationSpots[i]._14, VegetationSpots[i]._24, VegetationSpots[i]._34 );
-        DirectX::XMFLOAT3 scale;
-
-        // Compute scale
-        //XMStoreFloat(&scale.x, DirectX::XMVector3Length( XMVectorSet(VegetationSpots[i]._11, VegetationSpots[i]._21, VegetationSpots[i]._31, 0) ));
-        XMStoreFloat( &scale.y, DirectX::XMVector3Length( XMVectorSet( VegetationSpots[i]._12, VegetationSpots[i]._22, VegetationSpots[i]._32, 0 ) ) );
-        //XMStoreFloat(&scale.z, DirectX::XMVector3Length( XMVectorSet(VegetationSpots[i]._13, VegetationSpots[i]._23, VegetationSpots[i]._33, 0) ));
+        const float* p = VegetationSpots[i].Position;
+        DirectX::XMFLOAT3 spot = DirectX::XMFLOAT3( p[0], p[1], p[2] );
+        DirectX::XMFLOAT3 scale = DirectX::XMFLOAT3( 0, VegetationPlacement::DecodeScale( VegetationSpots[i] ), 0 );
 
         XMFLOAT3 spot_scale;
         XMStoreFloat3( &spot_scale, XMLoadFloat3( &spot ) + XMLoadFloat3( &scale ) * 2.0f );
@@ -400,30 +398,99 @@ void GVegetationBox::GetBoundingBox( DirectX::XMFLOAT3* bbMin, DirectX::XMFLOAT3
 void GVegetationBox::SetBoundingBox( const DirectX::XMFLOAT3& bbMin, const DirectX::XMFLOAT3& bbMax ) {
     BoxMin = bbMin;
     BoxMax = bbMax;
+
+    Engine::GAPI->OnVegetationBoxMoved( this );
 }
 
-/** Removes all vegetation in range of the given position */
-void GVegetationBox::RemoveVegetationAt( const DirectX::XMFLOAT3& position, float range ) {
-    // Make a list of the vector
-    std::list<DirectX::XMFLOAT4X4> s( VegetationSpots.begin(), VegetationSpots.end() );
+/** Sorts the spots into a grid on the xz-plane, needs to be called whenever VegetationSpots changes */
+void GVegetationBox::BuildSpotGrid() {
+    const float MIN_CELL_SIZE = 200.0f;
+    const int MAX_CELLS = 128;
+
+    SpotGridStart.clear();
+    SpotGridIndices.clear();
+    SpotGridCells[0] = SpotGridCells[1] = 0;
+
+    if ( VegetationSpots.empty() )
+        return;
+
+    // Grid over the spots, which are inside the refitted box
+    const float sizeX = BoxMax.x - BoxMin.x;
+    const float sizeZ = BoxMax.z - BoxMin.z;
+    SpotGridCellSize = std::max( MIN_CELL_SIZE, std::max( sizeX, sizeZ ) / MAX_CELLS );
+    SpotGridOrigin = DirectX::XMFLOAT2( BoxMin.x, BoxMin.z );
+    SpotGridCells[0] = std::min( MAX_CELLS, static_cast<int>(sizeX / SpotGridCellSize) + 1 );
+    SpotGridCells[1] = std::min( MAX_CELLS, static_cast<int>(sizeZ / SpotGridCellSize) + 1 );
+
+    // Counting sort by cell
+    std::vector<unsigned int> cells( VegetationSpots.size() );
+    SpotGridStart.assign( SpotGridCells[0] * SpotGridCells[1] + 1, 0 );
+    for ( unsigned int i = 0; i < VegetationSpots.size(); i++ ) {
+        int x = std::min( SpotGridCells[0] - 1, std::max( 0, static_cast<int>((VegetationSpots[i].Position[0] - SpotGridOrigin.x) / SpotGridCellSize) ) );
+        int z = std::min( SpotGridCells[1] - 1, std::max( 0, static_cast<int>((VegetationSpots[i].Position[2] - SpotGridOrigin.y) / SpotGridCellSize) ) );
+        cells[i] = z * SpotGridCells[0] + x;
+        SpotGridStart[cells[i] + 1]++;
+    }
+
+    for ( unsigned int c = 1; c < SpotGridStart.size(); c++ ) {
+        SpotGridStart[c] += SpotGridStart[c - 1];
+    }
+
+    std::vector<unsigned int> next( SpotGridStart.begin(), SpotGridStart.end() - 1 );
+    SpotGridIndices.resize( VegetationSpots.size() );
+    for ( unsigned int i = 0; i < VegetationSpots.size(); i++ ) {
+        SpotGridIndices[next[cells[i]]++] = i;
+    }
+}
+
+/** Collects the indices of all spots in range of the given position */
+void GVegetationBox::CollectSpotsInRange( const DirectX::XMFLOAT3& position, float range, std::vector<unsigned int>& spots ) {
+    if ( SpotGridIndices.empty() )
+        return;
 
-    // Remove everything in range
-    for ( std::list<DirectX::XMFLOAT4X4>::iterator it = s.begin(); it != s.end();) {
-        FXMVECTOR spot = XMVectorSet( it->_14, it->_24, it->_34, 0 );
+    const int x0 = std::max( 0, static_cast<int>(floorf( (position.x - range - SpotGridOrigin.x) / SpotGridCellSize )) );
+    const int z0 = std::max( 0, static_cast<int>(floorf( (position.z - range - SpotGridOrigin.y) / SpotGridCellSize )) );
+    const int x1 = std::min( SpotGridCells[0] - 1, static_cast<int>(floorf( (position.x + range - SpotGridOrigin.x) / SpotGridCellSize )) );
+    const int z1 = std::min( SpotGridCells[1] - 1, static_cast<int>(floorf( (position.z + range - SpotGridOrigin.y) / SpotGridCellSize )) );
 
-        float d;
-        XMStoreFloat( &d, DirectX::XMVector3Length( spot - XMLoadFloat3( &position ) ) );
+    for ( int z = z0; z <= z1; z++ ) {
+        for ( int x = x0; x <= x1; x++ ) {
+            const int cell = z * SpotGridCells[0] + x;
+            for ( unsigned int i = SpotGridStart[cell]; i < SpotGridStart[cell + 1]; i++ ) {
+                const float* s = VegetationSpots[SpotGridIndices[i]].Position;
+                FXMVECTOR spot = XMVectorSet( s[0], s[1], s[2], 0 );
 
-        if ( d < range ) {
-            it = s.erase( it );
-        } else {
-            ++it;
+                float d;
+                XMStoreFloat( &d, DirectX::XMVector3Length( spot - XMLoadFloat3( &position ) ) );
+
+                if ( d < range )
+                    spots.push_back( SpotGridIndices[i] );
+            }
         }
     }
+}
 
-    // Reassign
-    VegetationSpots.clear();
-    VegetationSpots.assign( s.begin(), s.end() );
+/** Removes all vegetation in range of the given position */
+void GVegetationBox::RemoveVegetationAt( const DirectX::XMFLOAT3& position, float range ) {
+    // Only look at the cells around the position
+    std::vector<unsigned int> inRange;
+    CollectSpotsInRange( position, range, inRange );
+
+    if ( inRange.empty() )
+        return;
+
+    // Remove everything in range, keeping the order of the others
+    std::vector<bool> removed( VegetationSpots.size(), false );
+    for ( unsigned int i : inRange ) {
+        removed[i] = true;
+    }
+
+    unsigned int numKept = 0;
+    for ( unsigned int i = 0; i < VegetationSpots.size(); i++ ) {
+        if ( !removed[i] )
+            VegetationSpots[numKept++] = VegetationSpots[i];
+    }
+    VegetationSpots.resize( numKept );
 
     // Recreate instancing buffer
     delete InstancingBuffer;
@@ -431,13 +498,15 @@ void GVegetationBox::RemoveVegetationAt( const DirectX::XMFLOAT3& position, floa
 
     if ( !IsEmpty() ) {
         Engine::GraphicsEngine->CreateVertexBuffer( &InstancingBuffer );
-        InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( DirectX::XMFLOAT4X4 ) );
+        InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( VegetationInstance ) );
     }
 
     // Refit
     RefitBoundingBox();
+    BuildSpotGrid();
 
     Modified = true;
+    SnapshotDirty = true;
 }
 
 /** Refits the bounding-box around the grass-meshes. If there are none, the box will be set to 0. */
@@ -446,6 +515,7 @@ void GVegetationBox::RefitBoundingBox() {
         BoxMax = DirectX::XMFLOAT3( 0, 0, 0 );
         BoxMin = DirectX::XMFLOAT3( 0, 0, 0 );
 
+        Engine::GAPI->OnVegetationBoxMoved( this );
         return;
     }
 
@@ -454,7 +524,8 @@ void GVegetationBox::RefitBoundingBox() {
     BoxMin = DirectX::XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
 
     for ( unsigned int i = 0; i < VegetationSpots.size(); i++ ) {
-        DirectX::XMFLOAT3 spot = DirectX::XMFLOAT3( VegetationSpots[i]._14, VegetationSpots[i]._24, VegetationSpots[i]._34 );
+        const float* p = VegetationSpots[i].Position;
+        DirectX::XMFLOAT3 spot = DirectX::XMFLOAT3( p[0], p[1], p[2] );
 
         BoxMin.x = BoxMin.x > spot.x ? spot.x : BoxMin.x;
         BoxMin.y = BoxMin.y > spot.y ? spot.y : BoxMin.y;
@@ -464,20 +535,21 @@ void GVegetationBox::RefitBoundingBox() {
         BoxMax.y = BoxMax.y < spot.y ? spot.y : BoxMax.y;
         BoxMax.z = BoxMax.z < spot.z ? spot.z : BoxMax.z;
     }
+
+    Engine::GAPI->OnVegetationBoxMoved( this );
 }
 
 /** Applys a uniform scaling to all vegetations */
 void GVegetationBox::ApplyUniformScaling( float scale ) {
-    XMMATRIX s = DirectX::XMMatrixScaling( scale, scale, scale );
-
     for ( unsigned int i = 0; i < VegetationSpots.size(); i++ ) {
-        XMMATRIX w = DirectX::XMMatrixTranspose( XMLoadFloat4x4( &VegetationSpots[i] ) );
-        XMStoreFloat4x4( &VegetationSpots[i], DirectX::XMMatrixTranspose( s * w ) );
+        VegetationSpots[i].Scale = VegetationPlacement::FloatToHalf( VegetationPlacement::DecodeScale( VegetationSpots[i] ) * scale );
     }
 
     delete InstancingBuffer;
     Engine::GraphicsEngine->CreateVertexBuffer( &InstancingBuffer );
-    InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( DirectX::XMFLOAT4X4 ) );
+    InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( VegetationInstance ) );
+
+    SnapshotDirty = true;
 }
 
 /** Returns true if this is empty */
@@ -485,55 +557,28 @@ bool GVegetationBox::IsEmpty() {
     return VegetationSpots.empty();
 }
 
-/** Saves this box to the given FILE* */
-void GVegetationBox::SaveToFILE( FILE* f, int version ) {
-    // Save size of vegetation array
-    int vsize = VegetationSpots.size();
-    fwrite( &vsize, sizeof( vsize ), 1, f );
-
-    // Save vegetation array itself
-    std::vector<DirectX::XMFLOAT4> spots;
-    for ( unsigned int i = 0; i < VegetationSpots.size(); i++ ) {
-        //FXMVECTOR m0 = XMVectorSet(VegetationSpots[i]._11, VegetationSpots[i]._21, VegetationSpots[i]._31, 0);
-        FXMVECTOR m1 = XMVectorSet( VegetationSpots[i]._12, VegetationSpots[i]._22, VegetationSpots[i]._32, 0 );
-        //FXMVECTOR m2 = XMVectorSet(VegetationSpots[i]._13, VegetationSpots[i]._23, VegetationSpots[i]._33, 0);
-        DirectX::XMFLOAT4 spot = DirectX::XMFLOAT4( VegetationSpots[i]._14, VegetationSpots[i]._24, VegetationSpots[i]._34, XMVectorGetX( DirectX::XMVector3Length( m1 ) ) );
-
-        spots.push_back( spot );
-    }
-
-    fwrite( &spots[0], sizeof( DirectX::XMFLOAT4 ) * vsize, 1, f );
-
-    // Save trisInside
-    int tsize = TrisInside.size();
-    fwrite( &tsize, sizeof( tsize ), 1, f );
-    fwrite( &TrisInside[0], sizeof( DirectX::XMFLOAT3 ) * tsize, 1, f );
-
-    // Save wether this was using a mesh info or not
-    bool hasMeshInfo = MeshPart != nullptr;
-    fwrite( &hasMeshInfo, sizeof( hasMeshInfo ), 1, f );
-}
-
-/** Loads this box from the given FILE* */
+/** Loads this box from the given FILE*, only used for the old .veg-files */
 void GVegetationBox::LoadFromFILE( FILE* f, int version ) {
     // Save size of vegetation array
     int vsize;
     fread( &vsize, sizeof( vsize ), 1, f );
 
-    std::vector<DirectX::XMFLOAT4> spots;
-    spots.resize( vsize );
-    fread( &spots[0], sizeof( DirectX::XMFLOAT4 ) * vsize, 1, f );
-
-    // Reconstruct spots
-    for ( unsigned int i = 0; i < spots.size(); i++ ) {
-        XMMATRIX w = DirectX::XMMatrixTranslation( spots[i].x, spots[i].y, spots[i].z );
-        float scale = spots[i].w;
-        XMMATRIX s = DirectX::XMMatrixScaling( scale, scale, scale );
-        XMMATRIX r = DirectX::XMMatrixRotationY( Toolbox::frand() * DirectX::XM_2PI );
-
-        XMFLOAT4X4 w_XMFLOAT4X4;
-        XMStoreFloat4x4( &w_XMFLOAT4X4, DirectX::XMMatrixTranspose( r * s * w ) );
-        VegetationSpots.push_back( w_XMFLOAT4X4 );
+    VegetationSpots.resize( vsize );
+    if ( version >= 2 ) {
+        if ( vsize )
+            fread( &VegetationSpots[0], sizeof( VegetationInstance ) * vsize, 1, f );
+    } else {
+        // Version 1 only stored position and scale, give them a reproducible rotation
+        std::vector<DirectX::XMFLOAT4> spots;
+        spots.resize( vsize );
+        if ( vsize )
+            fread( &spots[0], sizeof( DirectX::XMFLOAT4 ) * vsize, 1, f );
+
+        VegetationPlacement::Random rnd( vsize );
+        for ( unsigned int i = 0; i < spots.size(); i++ ) {
+            const float p[] = { spots[i].x, spots[i].y, spots[i].z };
+            VegetationSpots[i] = VegetationPlacement::Encode( p, rnd.NextFloat() * DirectX::XM_2PI, spots[i].w );
+        }
     }
 
     // Load tris inside
@@ -546,6 +591,81 @@ void GVegetationBox::LoadFromFILE( FILE* f, int version ) {
     bool hasMeshInfo = MeshPart != nullptr;
     fread( &hasMeshInfo, sizeof( hasMeshInfo ), 1, f );
 
+    InitLoadedSpots( hasMeshInfo );
+
+    // Not in the snapshot yet
+    SnapshotDirty = true;
+}
+
+/** Serializes this box into a snapshot-chunk */
+void GVegetationBox::SaveToBuffer( std::vector<uint8_t>& data ) {
+    auto write = [&]( const void* p, size_t size ) {
+        const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+        data.insert( data.end(), b, b + size );
+    };
+
+    const uint32_t version = VEGETATION_CHUNK_VERSION;
+    const uint32_t shape = Shape;
+    const uint32_t hasMeshInfo = MeshPart != nullptr;
+    const uint32_t numSpots = static_cast<uint32_t>(VegetationSpots.size());
+    const uint32_t numTris = static_cast<uint32_t>(TrisInside.size());
+
+    data.clear();
+    data.reserve( 24 + numSpots * sizeof( VegetationInstance ) + numTris * sizeof( DirectX::XMFLOAT3 ) );
+
+    write( &version, sizeof( version ) );
+    write( &shape, sizeof( shape ) );
+    write( &hasMeshInfo, sizeof( hasMeshInfo ) );
+    write( &Density, sizeof( Density ) );
+
+    // The instances are stored as they are in the instancing-buffer
+    write( &numSpots, sizeof( numSpots ) );
+    write( VegetationSpots.data(), numSpots * sizeof( VegetationInstance ) );
+
+    write( &numTris, sizeof( numTris ) );
+    write( TrisInside.data(), numTris * sizeof( DirectX::XMFLOAT3 ) );
+}
+
+/** Loads this box from a snapshot-chunk */
+XRESULT GVegetationBox::LoadFromBuffer( const std::vector<uint8_t>& data ) {
+    size_t pos = 0;
+    auto read = [&]( void* p, size_t size ) {
+        if ( size > data.size() - pos )
+            return false;
+
+        memcpy( p, data.data() + pos, size );
+        pos += size;
+        return true;
+    };
+
+    uint32_t version, shape, hasMeshInfo, numSpots, numTris;
+    if ( !read( &version, sizeof( version ) ) || version != VEGETATION_CHUNK_VERSION )
+        return XR_FAILED;
+
+    if ( !read( &shape, sizeof( shape ) ) || !read( &hasMeshInfo, sizeof( hasMeshInfo ) ) || !read( &Density, sizeof( Density ) ) )
+        return XR_FAILED;
+
+    if ( !read( &numSpots, sizeof( numSpots ) ) || numSpots > (data.size() - pos) / sizeof( VegetationInstance ) )
+        return XR_FAILED;
+
+    VegetationSpots.resize( numSpots );
+    read( VegetationSpots.data(), numSpots * sizeof( VegetationInstance ) );
+
+    if ( !read( &numTris, sizeof( numTris ) ) || numTris > (data.size() - pos) / sizeof( DirectX::XMFLOAT3 ) )
+        return XR_FAILED;
+
+    TrisInside.resize( numTris );
+    read( TrisInside.data(), numTris * sizeof( DirectX::XMFLOAT3 ) );
+
+    Shape = shape <= S_Circle ? static_cast<EShape>(shape) : S_None;
+
+    InitLoadedSpots( hasMeshInfo != 0 );
+    SnapshotDirty = false;
+    return XR_SUCCESS;
+}
+
+/** Finds mesh and texture the loaded spots are placed on and creates the resources */
+void GVegetationBox::InitLoadedSpots( bool hasMeshInfo ) {
     MeshInfo* hitMesh = nullptr;
     zCMaterial* hitMaterial = nullptr;
 
@@ -556,11 +676,12 @@ void GVegetationBox::LoadFromFILE( FILE* f, int version ) {
     // n without population size (see law of large numbers):
     // float n = pow(1.6448f, 2) * 95 * (100 - 95) / pow(10, 2);
     float n = 12.85f;
-    int j = floor( spots.size() / n );
+    int j = std::max( 1, static_cast<int>(floor( VegetationSpots.size() / n )) );
 
-    for ( unsigned int i = 0; i < spots.size(); i += j ) {
+    for ( unsigned int i = 0; i < VegetationSpots.size(); i += j ) {
         // Use grass-piece and trace straight down
-        DirectX::XMFLOAT3 spot = DirectX::XMFLOAT3( spots[i].x, spots[i].y, spots[i].z );
+        const float* p = VegetationSpots[i].Position;
+        DirectX::XMFLOAT3 spot = DirectX::XMFLOAT3( p[0], p[1], p[2] );
 
         // Little offset
         spot.y += 1.0f;
@@ -596,10 +717,13 @@ void GVegetationBox::LoadFromFILE( FILE* f, int version ) {
     MeshTexture = hitMaterial != nullptr ? hitMaterial->GetTexture() : nullptr;
 
     RefitBoundingBox();
+    BuildSpotGrid();
 
     // Create instancing buffer for this box
-    Engine::GraphicsEngine->CreateVertexBuffer( &InstancingBuffer );
-    InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( DirectX::XMFLOAT4X4 ) );
+    if ( !VegetationSpots.empty() ) {
+        Engine::GraphicsEngine->CreateVertexBuffer( &InstancingBuffer );
+        InstancingBuffer->Init( &VegetationSpots[0], VegetationSpots.size() * sizeof( VegetationInstance ) );
+    }
 
     // Create constant buffer
     Engine::GraphicsEngine->CreateConstantBuffer( &GrassCB, nullptr, sizeof( GrassConstantBuffer ) );
@@ -623,12 +747,9 @@ void GVegetationBox::LoadFromFILE( FILE* f, int version ) {
 
 /** Re-sets the grass with the given density */
 void GVegetationBox::ResetVegetationWithDensity( float density ) {
-    srand( 0 );
-
+    // Placement is seeded by the triangles, so the same density always gives the same grass
     InitSpotsRandom( TrisInside, Shape, density );
     Modified = false;
-
-    srand( Toolbox::timeSinceStartMs() );
 }
 
 /** Returns whether this has been modified or not */
@@ -1,5 +1,6 @@
 #pragma once
 #include "pch.h"
+#include "VegetationPlacement.h"
 
 
 class GMeshSimple;
@@ -71,23 +72,47 @@ public:
     /** Returns true if this is empty */
     bool IsEmpty();
 
-    /** Saves this box to the given FILE* */
-    void SaveToFILE( FILE* f, int version );
-
-    /** Loads this box from the given FILE* */
+    /** Loads this box from the given FILE*, only used for the old .veg-files */
     void LoadFromFILE( FILE* f, int version );
 
+    /** Serializes this box into a snapshot-chunk */
+    void SaveToBuffer( std::vector<uint8_t>& data );
+
+    /** Loads this box from a snapshot-chunk */
+    XRESULT LoadFromBuffer( const std::vector<uint8_t>& data );
+
+    /** Id of the snapshot-chunk this box is stored in, 0 if it doesn't have one yet */
+    uint32_t GetSnapshotId() { return SnapshotId; }
+    void SetSnapshotId( uint32_t id ) { SnapshotId = id; }
+
+    /** Whether this changed since it was last written to the snapshot */
+    bool IsSnapshotDirty() { return SnapshotDirty; }
+    void SetSnapshotDirty( bool dirty ) { SnapshotDirty = dirty; }
+
     /** Returns whether this has been modified or not */
     bool HasBeenModified();
 
     /** Returns the current density of this volume */
     float GetDensity();
+
+    /** Proxy of this box in the spatial index of GothicAPI, -1 if it isn't part of the world */
+    int GetSpatialProxy() { return SpatialProxy; }
+    void SetSpatialProxy( int proxy ) { SpatialProxy = proxy; }
 private:
     /** Puts trasformation for the given spots */
     void InitSpotsRandom( const std::vector<DirectX::XMFLOAT3>& trisInside, EShape shape = S_None, float density = 1.0f );
 
+    /** Finds mesh and texture the loaded spots are placed on and creates the resources */
+    void InitLoadedSpots( bool hasMeshInfo );
+
+    /** Sorts the spots into a grid on the xz-plane, needs to be called whenever VegetationSpots changes */
+    void BuildSpotGrid();
+
+    /** Collects the indices of all spots in range of the given position */
+    void CollectSpotsInRange( const DirectX::XMFLOAT3& position, float range, std::vector<unsigned int>& spots );
+
     std::vector<DirectX::XMFLOAT3> TrisInside;
-    std::vector<DirectX::XMFLOAT4X4> VegetationSpots;
+    std::vector<VegetationInstance> VegetationSpots;
     GMeshSimple* VegetationMesh;
     zCTexture* MeshTexture;
     MeshInfo* MeshPart;
@@ -101,5 +126,15 @@ private:
     D3D11ConstantBuffer* GrassCB;
     bool DrawBoundingBox;
     bool Modified;
+    int SpatialProxy;
+    uint32_t SnapshotId;
+    bool SnapshotDirty;
+
+    /** Spot-indices sorted by grid-cell. The ones of cell i are stored at SpotGridStart[i] to SpotGridStart[i + 1]. */
+    std::vector<unsigned int> SpotGridStart;
+    std::vector<unsigned int> SpotGridIndices;
+    DirectX::XMFLOAT2 SpotGridOrigin;
+    float SpotGridCellSize;
+    int SpotGridCells[2];
 };
 
@@ -0,0 +1,43 @@
+#include "GlyphRunCache.h"
+#include <cstring>
+
+GlyphRunCache::GlyphRunCache() {
+    Frame = 0;
+    NumHits = 0;
+    NumMisses = 0;
+}
+
+/** Advances the frame counter and evicts old runs every now and then */
+void GlyphRunCache::EndFrame() {
+    Frame++;
+    NumHits = 0;
+    NumMisses = 0;
+
+    // Walking the whole map each frame would cost more than it saves
+    if ( Frame % MAX_UNUSED_FRAMES != 0 )
+        return;
+
+    for ( auto it = Runs.begin(); it != Runs.end(); ) {
+        if ( Frame - it->second.LastUsedFrame > MAX_UNUSED_FRAMES ) {
+            it = Runs.erase( it );
+        } else {
+            ++it;
+        }
+    }
+}
+
+/** 64-bit FNV-1a over the characters, combined with font and scale */
+uint64_t GlyphRunCache::HashRun( const char* str, size_t len, const void* font, float scale ) {
+    uint64_t hash = 14695981039346656037ull;
+    for ( size_t i = 0; i < len; i++ ) {
+        hash ^= static_cast<unsigned char>(str[i]);
+        hash *= 1099511628211ull;
+    }
+
+    uint32_t scaleBits;
+    memcpy( &scaleBits, &scale, sizeof( scaleBits ) );
+
+    hash ^= static_cast<uint64_t>(reinterpret_cast<uintptr_t>(font)) * 0x9E3779B97F4A7C15ull;
+    hash ^= static_cast<uint64_t>(scaleBits) << 17;
+    return hash;
+}
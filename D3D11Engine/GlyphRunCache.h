@@ -0,0 +1,122 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** Screen-rectangle and texture-rectangle of a single character */
+struct GlyphQuad {
+    float MinX, MinY, MaxX, MaxY;
+    float MinU, MinV, MaxU, MaxV;
+};
+
+/** A string laid out relative to its origin */
+struct GlyphRun {
+    GlyphRun() {
+        Font = nullptr;
+        Scale = 0.0f;
+        LastUsedFrame = 0;
+    }
+
+    std::string Text;
+    const void* Font;
+    float Scale;
+    std::vector<GlyphQuad> Quads;
+
+    /** Frame this run was last requested in */
+    uint32_t LastUsedFrame;
+};
+
+/** Caches the layout of the strings drawn by the UI
+
+    Most text on screen stays the same for many frames, only its position or color changes. Runs are
+    laid out at the origin and keyed by the string, the font and the scale, so moving or recoloring a
+    text still hits the cache. Runs which haven't been used for a while are thrown away.
+
+    Fonts only need height, width[256], fontuv1[256] and fontuv2[256], with the UVs as v[2]. */
+class GlyphRunCache {
+public:
+    GlyphRunCache();
+
+    /** Frames a run may stay unused before it's evicted */
+    static const uint32_t MAX_UNUSED_FRAMES = 60;
+
+    /** Returns the run of the first len characters of str, laying it out if needed */
+    template <typename Font>
+    const GlyphRun& GetRun( const char* str, size_t len, const Font& font, float scale ) {
+        const uint64_t key = HashRun( str, len, &font, scale );
+
+        GlyphRun& run = Runs[key];
+        if ( run.Font == &font && run.Scale == scale && run.Text.size() == len && run.Text.compare( 0, len, str, len ) == 0 ) {
+            run.LastUsedFrame = Frame;
+            NumHits++;
+            return run;
+        }
+
+        // New run or a hash-collision, either way the entry gets (re)built
+        run.Text.assign( str, len );
+        run.Font = &font;
+        run.Scale = scale;
+        run.LastUsedFrame = Frame;
+        Layout( str, len, font, scale, run.Quads );
+        NumMisses++;
+        return run;
+    }
+
+    /** Lays out the characters at the origin. Spaces only advance, newlines go back to the start of the line. */
+    template <typename Font>
+    static void Layout( const char* str, size_t len, const Font& font, float scale, std::vector<GlyphQuad>& quads ) {
+        const float spaceBetweenChars = 1.0f * scale;
+        const float height = float( font.height ) * scale;
+
+        quads.clear();
+        quads.reserve( len );
+
+        float x = 0.0f, y = 0.0f;
+        for ( size_t i = 0; i < len; i++ ) {
+            const unsigned char c = static_cast<unsigned char>(str[i]);
+            const float width = float( font.width[c] ) * scale;
+
+            if ( c == ' ' ) {
+                x += width;
+                continue;
+            }
+
+            GlyphQuad q;
+            q.MinX = x;
+            q.MinY = y;
+            q.MaxX = x + width;
+            q.MaxY = y + height;
+            q.MinU = font.fontuv1[c].v[0];
+            q.MinV = font.fontuv1[c].v[1];
+            q.MaxU = font.fontuv2[c].v[0];
+            q.MaxV = font.fontuv2[c].v[1];
+            quads.push_back( q );
+
+            if ( c == '\n' ) {
+                y += height;
+                x = 0.0f;
+            } else {
+                x += width + spaceBetweenChars;
+            }
+        }
+    }
+
+    /** Advances the frame counter and evicts old runs every now and then */
+    void EndFrame();
+
+    size_t GetNumRuns() const { return Runs.size(); }
+
+    /** Statistics, counted since the last call to EndFrame */
+    uint32_t GetNumHits() const { return NumHits; }
+    uint32_t GetNumMisses() const { return NumMisses; }
+
+    /** 64-bit FNV-1a over the characters, combined with font and scale */
+    static uint64_t HashRun( const char* str, size_t len, const void* font, float scale );
+
+private:
+    std::unordered_map<uint64_t, GlyphRun> Runs;
+    uint32_t Frame;
+    uint32_t NumHits;
+    uint32_t NumMisses;
+};
@@ -42,12 +42,23 @@
 #include "win32ClipboardWrapper.h"
 #include "zCSoundSystem.h"
 #include "zCView.h"
+#include "TextureArchive.h"
+#include "ZipFileSystem.h"
+#include "XUnzip.h"
+#include "StaticInstanceCache.h"
+#include "RayBatch.h"
+#include "SnapshotArchive.h"
 
 using namespace DirectX;
 
 // Duration how long the scene will stay wet, in MS
 const DWORD SCENE_WETNESS_DURATION_MS = 30 * 1000;
 
+// Chunk-types of the editor snapshot
+const uint32_t SNAPSHOT_CHUNK_VEGETATION = 1;
+const uint32_t SNAPSHOT_CHUNK_SUPPRESSED_TEXTURES = 2;
+const uint32_t SUPPRESSED_TEXTURES_CHUNK_VERSION = 1;
+
 // Draw ghost from back to front of our camera
 auto CompareGhostDistance = []( std::pair<float, SkeletalVobInfo*>& a, std::pair<float, SkeletalVobInfo*>& b ) -> bool { return a.first < b.first; };
 
@@ -126,15 +137,21 @@ GothicAPI::GothicAPI() {
 
     CameraReplacementPtr = nullptr;
     WrappedWorldMesh = nullptr;
+    PortalCellsValid = false;
     Ocean = nullptr;
     CurrentCamera = nullptr;
 
     MainThreadID = GetCurrentThreadId();
 
+    EditorSnapshotNeedsFullSave = false;
+    NextVegetationSnapshotId = 1;
+
     _canRain = false;
 }
 
 GothicAPI::~GothicAPI() {
+    WaitForEditorSnapshot();
+
     //ResetWorld(); // Just let it leak for now. // TODO: Do this properly
     SAFE_DELETE( WrappedWorldMesh );
 }
@@ -217,6 +234,33 @@ void GothicAPI::OnGameStart() {
 
     Inventory = std::make_unique<GInventory>();
 
+    // Prefer the packed replacement-textures, so we don't have to touch thousands of files
+    const std::string replacementArchive = std::string( "system\\GD3D11\\textures\\replacements" ) + TEXTURE_ARCHIVE_EXTENSION;
+    if ( Toolbox::FileExists( replacementArchive ) ) {
+        ReplacementTextureArchive = std::make_unique<TextureArchive>();
+        if ( ReplacementTextureArchive->Open( replacementArchive ) ) {
+            LogInfo() << "Loaded texture archive '" << replacementArchive << "' with " << ReplacementTextureArchive->GetNumEntries() << " textures";
+        } else {
+            LogWarn() << "Failed to open texture archive '" << replacementArchive << "', falling back to loose files";
+            ReplacementTextureArchive.reset();
+        }
+    }
+
+    // Serve assets straight out of the packs instead of extracting them first
+    if ( Toolbox::FolderExists( "system\\GD3D11\\packs" ) ) {
+        PackFileSystem = std::make_unique<ZipFileSystem>( []( const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstSize, uint32_t crc ) {
+            return InflateRawMemory( src, srcSize, dst, dstSize, crc ) == ZR_OK;
+        } );
+
+        int numMounted = PackFileSystem->MountFolder( "system\\GD3D11\\packs" );
+        for ( const std::string& message : PackFileSystem->GetMountLog() ) {
+            LogInfo() << message;
+        }
+
+        if ( numMounted == 0 )
+            PackFileSystem.reset();
+    }
+
     UpdateMTResourceManager();
 }
 
@@ -508,7 +552,7 @@ GVegetationBox* GothicAPI::SpawnVegetationBoxAt( const DirectX::XMFLOAT3& positi
     XMStoreFloat3( &maxposition, XMLoadFloat3( &max ) + XMLoadFloat3( &position ) );
     v->InitVegetationBox( minposition, maxposition, "", density, 1.0f, restrictByTexture );
 
-    VegetationBoxes.push_back( v );
+    AddVegetationBox( v );
 
     return v;
 }
@@ -516,17 +560,73 @@ GVegetationBox* GothicAPI::SpawnVegetationBoxAt( const DirectX::XMFLOAT3& positi
 /** Adds a vegetationbox to the world */
 void GothicAPI::AddVegetationBox( GVegetationBox* box ) {
     VegetationBoxes.push_back( box );
+
+    XMFLOAT3 min, max;
+    box->GetBoundingBox( &min, &max );
+    box->SetSpatialProxy( VegetationTree.Insert( &min.x, &max.x, box ) );
 }
 
 /** Removes a vegetationbox from the world */
 void GothicAPI::RemoveVegetationBox( GVegetationBox* box ) {
+    if ( box->GetSpatialProxy() != DynamicAABBTree<GVegetationBox*>::NULL_NODE )
+        VegetationTree.Remove( box->GetSpatialProxy() );
+
     VegetationBoxes.remove( box );
     delete box;
 }
 
+/** Updates the spatial index after the bounding box of a vegetationbox changed */
+void GothicAPI::OnVegetationBoxMoved( GVegetationBox* box ) {
+    if ( box->GetSpatialProxy() == DynamicAABBTree<GVegetationBox*>::NULL_NODE )
+        return;
+
+    XMFLOAT3 min, max;
+    box->GetBoundingBox( &min, &max );
+    VegetationTree.Move( box->GetSpatialProxy(), &min.x, &max.x );
+}
+
+/** Returns the closest vegetationbox hit by the ray, or nullptr. Boxes placed on worldmesh parts are skipped. */
+GVegetationBox* GothicAPI::TraceVegetationBoxes( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir ) {
+    float nearest = FLT_MAX;
+    GVegetationBox* nearestBox = nullptr;
+
+    VegetationTree.QueryRay( &origin.x, &dir.x, nearest, [&]( GVegetationBox* box, float t ) {
+        if ( !box->GetWorldMeshPart() && t < nearest ) {
+            nearest = t;
+            nearestBox = box;
+        }
+        return nearest;
+    } );
+
+    return nearestBox;
+}
+
+/** Puts the sphere a shadowed light collected its casters in into the spatial index */
+int GothicAPI::UpdateShadowedLightRange( BaseShadowedPointLight* light, int proxy, const DirectX::XMFLOAT3& center, float radius ) {
+    XMFLOAT3 min, max;
+    XMStoreFloat3( &min, XMLoadFloat3( &center ) - XMVectorReplicate( radius ) );
+    XMStoreFloat3( &max, XMLoadFloat3( &center ) + XMVectorReplicate( radius ) );
+
+    if ( proxy == DynamicAABBTree<BaseShadowedPointLight*>::NULL_NODE )
+        return ShadowedLightTree.Insert( &min.x, &max.x, light );
+
+    ShadowedLightTree.Move( proxy, &min.x, &max.x );
+    return proxy;
+}
+
+/** Takes a shadowed light out of the spatial index */
+void GothicAPI::RemoveShadowedLightRange( int proxy ) {
+    ShadowedLightTree.Remove( proxy );
+}
+
 /** Resets the object, like at level load */
 void GothicAPI::ResetWorld() {
+    if ( StaticInstances )
+        StaticInstances->Clear();
+
     WorldSections.clear();
+    WorldPortals.Clear();
+    PortalCellsValid = false;
 
     ResetVobs();
 
@@ -550,6 +650,9 @@ void GothicAPI::ReloadPlayerVob() {
 }
 /** Resets only the vobs */
 void GothicAPI::ResetVobs() {
+    if ( StaticInstances )
+        StaticInstances->Clear();
+
     // Clear sections
     for ( auto&& itx : Engine::GAPI->GetWorldSections() ) {
         for ( auto&& ity : itx.second ) {
@@ -569,7 +672,7 @@ void GothicAPI::ResetVobs() {
     RegisteredVobs.clear();
     BspLeafVobLists.clear();
     DynamicallyAddedVobs.clear();
-    DecalVobs.clear();
+    DecalVobs.Clear();
     VobsByVisual.clear();
     SkeletalVobMap.clear();
 
@@ -628,6 +731,8 @@ void GothicAPI::OnGeometryLoaded( zCPolygon** polys, unsigned int numPolygons )
 #endif
     LogInfo() << "Done extracting world!";
 
+    BuildPortalGraph( polys, numPolygons );
+
 
     // Apply tesselation
     for ( auto const& it : LoadedMaterials ) {
@@ -688,12 +793,12 @@ void GothicAPI::OnWorldLoaded() {
     zCTree<zCVob>* vobTree = oCGame::GetGame()->_zCSession_world->GetGlobalVobTree();
     TraverseVobTree( vobTree );
 
-    // Build instancing cache for the static vobs for each section
-    BuildStaticMeshInstancingCache();
-
     // Build vob info cache for the bsp-leafs
     BuildBspVobMapCache();
 
+    // Build instancing cache for the static vobs for each section. Needs to know which vobs are indoors.
+    BuildStaticMeshInstancingCache();
+
 #ifdef BUILD_GOTHIC_1_08k
     if ( LoadedWorldInfo->CustomWorldLoaded ) {
         CreatezCPolygonsForSections();
@@ -880,6 +985,92 @@ void GothicAPI::BuildStaticMeshInstancingCache() {
     for ( auto const& it : StaticMeshVisuals ) {
         it.second->StartNewFrame();
     }
+
+    if ( !StaticInstances )
+        StaticInstances = std::make_unique<StaticInstanceCache>();
+
+    StaticInstances->Build( WorldSections );
+}
+
+/** Builds the cells and portals of the loaded world out of the sector- and portal-polygons */
+void GothicAPI::BuildPortalGraph( zCPolygon** polys, unsigned int numPolygons ) {
+    WorldPortals.Clear();
+    PortalCellsValid = false;
+
+    // Most outdoor-worlds don't have a single portal
+    bool hasPortals = false;
+    for ( unsigned int i = 0; i < numPolygons && !hasPortals; i++ ) {
+        hasPortals = polys[i]->GetPolyFlags()->PortalPoly != 0;
+    }
+
+    if ( !hasPortals )
+        return;
+
+    std::vector<float> vertices;
+    std::vector<PortalGraphPolygon> graphPolygons;
+    graphPolygons.reserve( numPolygons );
+    for ( unsigned int i = 0; i < numPolygons; i++ ) {
+        zCPolygon* poly = polys[i];
+        const PolyFlags* flags = poly->GetPolyFlags();
+
+        PortalGraphPolygon p;
+        p.Vertices = nullptr;
+        p.NumVertices = poly->GetNumPolyVertices();
+        p.Sector = flags->SectorPoly ? static_cast<int>(flags->SectorIndex) : -1;
+        p.Portal = flags->PortalPoly != 0;
+        p.IndoorOutdoor = flags->PortalIndoorOutdoor != 0;
+        graphPolygons.push_back( p );
+
+        for ( int v = 0; v < poly->GetNumPolyVertices(); v++ ) {
+            const float3& position = poly->getVertices()[v]->Position;
+            vertices.push_back( position.x );
+            vertices.push_back( position.y );
+            vertices.push_back( position.z );
+        }
+    }
+
+    // The vertex-buffer doesn't move anymore
+    size_t offset = 0;
+    for ( PortalGraphPolygon& p : graphPolygons ) {
+        p.Vertices = vertices.data() + offset;
+        offset += p.NumVertices * 3;
+    }
+
+    WorldPortals.Build( graphPolygons.data(), graphPolygons.size() );
+
+    LogInfo() << "Portal-graph: " << WorldPortals.GetCells().size() << " cells, " << WorldPortals.GetPortals().size()
+        << " portals (" << WorldPortals.GetNumDroppedPortals() << " portal-polygons without two cells)";
+}
+
+/** Walks the portals from the current camera, has to happen before the main pass collects anything */
+void GothicAPI::UpdatePortalVisibility() {
+    PortalCellsValid = false;
+    if ( !RendererState.RendererSettings.EnablePortalCulling || !WorldPortals.HasPortals() )
+        return;
+
+    zCCamera::GetCamera()->Activate();
+
+    // Same frustum as the vegetation, the farplane isn't used
+    PortalPlane frustum[4];
+    for ( int i = 0; i < 4; i++ ) {
+        const zTPlane& p = zCCamera::GetCamera()->GetFrustumPlanes()[i];
+        frustum[i].Normal[0] = p.Normal.x;
+        frustum[i].Normal[1] = p.Normal.y;
+        frustum[i].Normal[2] = p.Normal.z;
+        frustum[i].Distance = p.Distance;
+    }
+
+    const XMFLOAT3 camPos = GetCameraPosition();
+    PortalCells.Compute( WorldPortals, &camPos.x, frustum, 4 );
+    PortalCellsValid = true;
+}
+
+/** Returns the cells seen through the portals from the main camera, or nullptr if everything in the frustum is visible */
+const PortalVisibility* GothicAPI::GetPortalVisibility() {
+    if ( !PortalCellsValid || !RendererState.RendererSettings.EnablePortalCulling )
+        return nullptr;
+
+    return &PortalCells;
 }
 
 /** Draws the world-mesh */
@@ -927,14 +1118,26 @@ void GothicAPI::DrawWorldMeshNaive() {
     FrameParticles.clear();
     FrameMeshInstances.clear();
 
+    UpdatePortalVisibility();
+
     START_TIMING();
     Engine::GraphicsEngine->DrawWorldMesh();
     STOP_TIMING( GothicRendererTiming::TT_WorldMesh );
 
-    for ( auto const& vegetationBox : VegetationBoxes ) {
-        vegetationBox->RenderVegetation( GetCameraPosition() );
+    // Only draw the boxes inside the frustum, the farplane isn't used
+    DynamicAABBTree<GVegetationBox*>::Plane vegetationFrustum[4];
+    for ( int i = 0; i < 4; i++ ) {
+        const zTPlane& p = zCCamera::GetCamera()->GetFrustumPlanes()[i];
+        vegetationFrustum[i].Normal[0] = p.Normal.x;
+        vegetationFrustum[i].Normal[1] = p.Normal.y;
+        vegetationFrustum[i].Normal[2] = p.Normal.z;
+        vegetationFrustum[i].Distance = p.Distance;
     }
 
+    VegetationTree.QueryFrustum( vegetationFrustum, 4, [&]( GVegetationBox* vegetationBox ) {
+        vegetationBox->RenderVegetation( GetCameraPosition() );
+    } );
+
     START_TIMING();
     if ( RendererState.RendererSettings.DrawSkeletalMeshes ) {
         // Set up frustum for the camera
@@ -942,6 +1145,9 @@ void GothicAPI::DrawWorldMeshNaive() {
         RendererState.RasterizerState.SetDirty();
         zCCamera::GetCamera()->Activate();
 
+        D3D11GraphicsEngine* g = (D3D11GraphicsEngine*)Engine::GraphicsEngine;
+        g->BeginSkinnedInstancing();
+
         for ( const auto& vobInfo : AnimatedSkeletalVobs ) {
             // Don't render if sleeping and has skeletal meshes available
             if ( !vobInfo->VisualInfo ) continue;
@@ -983,6 +1189,8 @@ void GothicAPI::DrawWorldMeshNaive() {
             if( RendererState.RendererSettings.ShowSkeletalVertexNormals )
                 VNSkeletalVobs.emplace_back( vobInfo );
         }
+
+        g->FlushSkinnedInstances();
     }
     STOP_TIMING( GothicRendererTiming::TT_SkeletalMeshes );
 
@@ -999,7 +1207,7 @@ void GothicAPI::DrawParticlesSimple() {
     ParticleFrameData data;
 
     if ( RendererState.RendererSettings.DrawParticleEffects ) {
-        std::vector<zCVob*> renderedParticleFXs;
+        FrameVector<zCVob*> renderedParticleFXs;
         GetVisibleParticleEffectsList( renderedParticleFXs );
 
         // now it is save to render
@@ -1013,6 +1221,10 @@ void GothicAPI::DrawParticlesSimple() {
         Engine::GraphicsEngine->DrawFrameParticleMeshes( ParticleEffectProgMeshes );
         Engine::GraphicsEngine->DrawFrameParticles( FrameParticles, FrameParticleInfo );
     }
+
+    // Give the memory back to the frame arena
+    FrameParticles.clear();
+    FrameParticleInfo.clear();
 }
 
 // Converts poly strip visuals to render ready geometry
@@ -1109,7 +1321,7 @@ void GothicAPI::CalcPolyStripMeshes() {
 };
 
 /** Returns a list of visible particle-effects */
-void GothicAPI::GetVisibleParticleEffectsList( std::vector<zCVob*>& pfxList ) {
+void GothicAPI::GetVisibleParticleEffectsList( FrameVector<zCVob*>& pfxList ) {
     if ( RendererState.RendererSettings.DrawParticleEffects ) {
         FXMVECTOR camPos = GetCameraPositionXM();
 
@@ -1127,35 +1339,16 @@ void GothicAPI::GetVisibleParticleEffectsList( std::vector<zCVob*>& pfxList ) {
     }
 }
 
-static bool DecalSortcmpFunc( const std::pair<zCVob*, float>& a, const std::pair<zCVob*, float>& b ) {
-    return a.second > b.second; // Back to front
-}
-
-/** Gets a list of visible decals */
-void GothicAPI::GetVisibleDecalList( std::vector<zCVob*>& decals ) {
-    FXMVECTOR camPos = GetCameraPositionXM();
-    static std::vector<std::pair<zCVob*, float>> decalDistances; // Static to get around reallocations
+/** Gets a list of visible decals. They are not sorted, the renderer only needs that for some of them. */
+void GothicAPI::GetVisibleDecalList( FrameVector<zCVob*>& decals ) {
+    XMFLOAT3 camPos = GetCameraPosition();
 
-    float dist;
-    for ( auto const& it : DecalVobs ) {
-        XMStoreFloat( &dist, DirectX::XMVector3Length( it->GetPositionWorldXM() - camPos ) );
-        if ( dist > RendererState.RendererSettings.VisualFXDrawRadius )
-            continue;
-
-        if ( it->GetVisual() ) {
-            decalDistances.push_back( std::make_pair( it, dist ) );
+    // Only looks at the grid cells around the camera
+    DecalVobs.QuerySphere( &camPos.x, RendererState.RendererSettings.VisualFXDrawRadius, [&decals]( zCVob* vob, float ) {
+        if ( vob->GetVisual() ) {
+            decals.push_back( vob );
         }
-    }
-
-    // Sort back to front
-    std::sort( decalDistances.begin(), decalDistances.end(), DecalSortcmpFunc );
-
-    // Put into output list
-    for ( auto const& it : decalDistances ) {
-        decals.push_back( it.first );
-    }
-
-    decalDistances.clear();
+    } );
 }
 
 /** Called when a material got removed */
@@ -1198,6 +1391,12 @@ void GothicAPI::OnVobMoved( zCVob* vob ) {
         return (mask == 0xFFFF);
     };
 
+    if ( DecalVobs.Contains( vob ) ) {
+        XMFLOAT3 position = vob->GetPositionWorld();
+        DecalVobs.Move( vob, &position.x );
+        return;
+    }
+
     auto it = VobMap.find( vob );
     if ( it != VobMap.end() ) {
         VobInfo* vi = it->second;
@@ -1213,8 +1412,20 @@ void GothicAPI::OnVobMoved( zCVob* vob ) {
             MoveVobFromBspToDynamic( vi );
         }
 
+        XMVECTOR oldPosition = XMLoadFloat3( &vi->LastRenderPosition );
         vi->UpdateVobConstantBuffer();
         Engine::GAPI->GetRendererState().RendererInfo.FrameVobUpdates++;
+
+        // Shadowed lights have to take it out of their static casters. Only the lights touching the old
+        // or the new position can have it in there or get it as a new caster.
+        XMVECTOR radius = XMVectorReplicate( vi->VisualInfo ? vi->VisualInfo->MeshSize : 0.0f );
+        XMVECTOR newPosition = XMLoadFloat3( &vi->LastRenderPosition );
+        XMFLOAT3 min, max;
+        XMStoreFloat3( &min, XMVectorMin( oldPosition, newPosition ) - radius );
+        XMStoreFloat3( &max, XMVectorMax( oldPosition, newPosition ) + radius );
+        ShadowedLightTree.QueryBox( &min.x, &max.x, [vi]( BaseShadowedPointLight* light ) {
+            light->OnVobMoved( vi );
+        } );
     } else {
         auto sit = SkeletalVobMap.find( vob );
         if ( sit != SkeletalVobMap.end() ) {
@@ -1227,6 +1438,12 @@ void GothicAPI::OnVobMoved( zCVob* vob ) {
             }
             // This is a mob, remove it from the bsp-cache and add to dynamic list
             MoveVobFromBspToDynamic( vi );
+
+            // Lights only cache mobs standing inside of their range, WorldMatrix still holds where it stood
+            XMFLOAT3 oldPosition( vi->WorldMatrix._14, vi->WorldMatrix._24, vi->WorldMatrix._34 );
+            ShadowedLightTree.QueryBox( &oldPosition.x, &oldPosition.x, [vi]( BaseShadowedPointLight* light ) {
+                light->OnVobMoved( vi );
+            } );
         }
     }
 }
@@ -1260,6 +1477,10 @@ void GothicAPI::OnVisualDeleted( zCVisual* visual ) {
 
         // Delete according to the type
         if ( ext == ".3DS" ) {
+            auto vit = StaticMeshVisuals.find( (zCProgMeshProto*)visual );
+            if ( StaticInstances && vit != StaticMeshVisuals.end() )
+                StaticInstances->RemoveVisual( vit->second );
+
             // Clear the visual from all vobs (TODO: This may be slow!)
             for ( auto it = VobMap.begin(); it != VobMap.end();) {
                 if ( !it->second->VisualInfo ) { // This happens sometimes, so get rid of it
@@ -1444,11 +1665,7 @@ void GothicAPI::OnRemovedVob( zCVob* vob, zCWorld* world ) {
         *pit = ParticleEffectVobs.back();
         ParticleEffectVobs.pop_back();
     }
-    auto dit = std::find( DecalVobs.begin(), DecalVobs.end(), vob );
-    if ( dit != DecalVobs.end() ) {
-        *dit = DecalVobs.back();
-        DecalVobs.pop_back();
-    }
+    DecalVobs.Remove( vob );
 
     // Erase it from the list of lights
     VobLightMap.erase( (zCVobLight*)vob );
@@ -1522,6 +1739,9 @@ void GothicAPI::OnRemovedVob( zCVob* vob, zCWorld* world ) {
     }
     SkeletalVobMap.erase( vob );
 
+    if ( vi && StaticInstances )
+        StaticInstances->RemoveVob( vi );
+
     // Erase the vob from the section
     if ( vi && vi->VobSection ) {
         vi->VobSection->Vobs.remove( vi );
@@ -1636,6 +1856,9 @@ void GothicAPI::OnAddVob( zCVob* vob, zCWorld* world ) {
                 }
 
                 WorldConverter::Extract3DSMeshFromVisual2( pm, mi );
+                if ( world == oCGame::GetGame()->_zCSession_world )
+                    mi->CreateLODs();
+
                 StaticMeshVisuals[pm] = mi;
             }
 
@@ -1662,6 +1885,15 @@ void GothicAPI::OnAddVob( zCVob* vob, zCWorld* world ) {
                 if ( !BspLeafVobLists.empty() ) { // Check if this is the initial loading
                     // It's not, chose this as a dynamically added vob
                     DynamicallyAddedVobs.push_back( vi );
+
+                    // Only the lights touching it can get it as a new caster
+                    XMVECTOR radius = XMVectorReplicate( vi->VisualInfo ? vi->VisualInfo->MeshSize : 0.0f );
+                    XMFLOAT3 min, max;
+                    XMStoreFloat3( &min, XMLoadFloat3( &vi->LastRenderPosition ) - radius );
+                    XMStoreFloat3( &max, XMLoadFloat3( &vi->LastRenderPosition ) + radius );
+                    ShadowedLightTree.QueryBox( &min.x, &max.x, [vi]( BaseShadowedPointLight* light ) {
+                        light->OnVobAdded( vi );
+                    } );
                 }
             } else {
                 // Must be inventory
@@ -1740,7 +1972,8 @@ void GothicAPI::OnAddVob( zCVob* vob, zCWorld* world ) {
             ParticleEffectVobs.push_back( vob );
             break;
         } else if ( ext == ".TGA" ) {
-            DecalVobs.push_back( vob );
+            XMFLOAT3 position = vob->GetPositionWorld();
+            DecalVobs.Insert( vob, &position.x );
             break;
         }
     }
@@ -1951,7 +2184,7 @@ void GothicAPI::DrawSkeletalMeshVob( SkeletalVobInfo* vi, float distance, bool u
                             mm->AdvanceAnis();
                             mm->CalcVertexPositions();
                         }
-                        DrawMorphMesh( mm, mvi->Meshes );
+                        DrawMorphMesh( mm, mvi );
                         continue;
                     }
                 }
@@ -2125,7 +2358,7 @@ void GothicAPI::DrawParticleFX( zCVob* source, zCParticleFX* fx, ParticleFrameDa
             break;
         }
 
-        std::vector<ParticleInstanceInfo>& part = FrameParticles[texture];
+        FrameVector<ParticleInstanceInfo>& part = FrameParticles[texture];
 
         // Check for kill
         zTParticle* kill = nullptr;
@@ -2389,50 +2622,51 @@ VobInfo* GothicAPI::TraceStaticMeshVobsBB( const DirectX::XMFLOAT3& origin, cons
 }
 
 SkeletalVobInfo* GothicAPI::TraceSkeletalMeshVobsBB( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir, DirectX::XMFLOAT3& hit ) {
-    float closest = FLT_MAX;
-    SkeletalVobInfo* vob = nullptr;
     XMFLOAT3 BBoxlocal_min;
     XMFLOAT3 BBoxlocal_max;
 
+    // Collect the boxes first, so they can be traced all at once
+    RayBatch::BoxSoA boxes;
+    std::vector<SkeletalVobInfo*> vobs;
+    boxes.Reserve( SkeletalMeshVobs.size() );
+    vobs.reserve( SkeletalMeshVobs.size() );
+
     for ( auto const& it : SkeletalMeshVobs ) {
-        float t = 0;
         XMStoreFloat3( &BBoxlocal_min, XMVectorSet( it->Vob->GetBBoxLocal().Min.x, it->Vob->GetBBoxLocal().Min.y, it->Vob->GetBBoxLocal().Min.z, 0 ) + it->Vob->GetPositionWorldXM() );
         XMStoreFloat3( &BBoxlocal_max, XMVectorSet( it->Vob->GetBBoxLocal().Max.x, it->Vob->GetBBoxLocal().Max.y, it->Vob->GetBBoxLocal().Max.z, 0 ) + it->Vob->GetPositionWorldXM() );
-        if ( Toolbox::IntersectBox( BBoxlocal_min, BBoxlocal_max, origin, dir, t ) ) {
-            if ( t < closest ) {
-                closest = t;
-                vob = it;
-            }
-        }
+        boxes.Add( &BBoxlocal_min.x, &BBoxlocal_max.x );
+        vobs.push_back( it );
     }
 
-    if ( closest == FLT_MAX )
+    float closest = FLT_MAX;
+    int closestBox = RayBatch::ClosestBox( RayBatch::MakeRay( &origin.x, &dir.x ), boxes, closest );
+    if ( closestBox < 0 || closest == FLT_MAX )
         return nullptr;
 
+    SkeletalVobInfo* vob = vobs[closestBox];
+
     XMStoreFloat3( &hit, XMLoadFloat3( &origin ) + XMLoadFloat3( &dir ) * closest );
 
     return vob;
 }
 
 float GothicAPI::TraceVisualInfo( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir, BaseVisualInfo* visual, zCMaterial** hitMaterial ) {
-    float u, v, t;
+    const RayBatch::Ray ray = RayBatch::MakeRay( &origin.x, &dir.x );
+    float t;
     float closest = FLT_MAX;
 
     for ( auto const& it : visual->Meshes ) {
         for ( unsigned int m = 0; m < it.second.size(); m++ ) {
             MeshInfo* mesh = it.second[m];
+            if ( mesh->Indices.empty() || mesh->Vertices.empty() )
+                continue;
 
-            for ( unsigned int i = 0; i < mesh->Indices.size(); i += 3 ) {
-                if ( Toolbox::IntersectTri( *mesh->Vertices[mesh->Indices[i]].Position.toXMFLOAT3(),
-                    *mesh->Vertices[mesh->Indices[i + 1]].Position.toXMFLOAT3(),
-                    *mesh->Vertices[mesh->Indices[i + 2]].Position.toXMFLOAT3(),
-                    origin, dir, u, v, t ) ) {
-                    if ( t > 0 && t < closest ) {
-                        closest = t;
+            if ( RayBatch::ClosestTriangleIndexed( ray, &mesh->Vertices[0].Position, sizeof( ExVertexStruct ), &mesh->Indices[0], mesh->Indices.size(), 0.0f, t ) >= 0 ) {
+                if ( t < closest ) {
+                    closest = t;
 
-                        if ( hitMaterial )
-                            *hitMaterial = it.first;
-                    }
+                    if ( hitMaterial )
+                        *hitMaterial = it.first;
                 }
             }
         }
@@ -2444,10 +2678,13 @@ float GothicAPI::TraceVisualInfo( const DirectX::XMFLOAT3& origin, const DirectX
 /** Traces the worldmesh and returns the hit-location */
 bool GothicAPI::TraceWorldMesh( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir, DirectX::XMFLOAT3& hit, std::string* hitTextureName, DirectX::XMFLOAT3* hitTriangle, MeshInfo** hitMesh, zCMaterial** hitMaterial ) {
     const int maxSections = 2;
+    const RayBatch::Ray ray = RayBatch::MakeRay( &origin.x, &dir.x );
     float closest = FLT_MAX;
     std::list<std::pair<WorldMeshSectionInfo*, float>> hitSections;
 
-    // Trace bounding-boxes first
+    // Trace bounding-boxes first, all at once
+    RayBatch::BoxSoA boxes;
+    std::vector<WorldMeshSectionInfo*> sections;
     for ( auto&& itx : WorldSections ) {
         for ( auto&& ity : itx.second ) {
             WorldMeshSectionInfo& section = ity.second;
@@ -2455,27 +2692,40 @@ bool GothicAPI::TraceWorldMesh( const DirectX::XMFLOAT3& origin, const DirectX::
             if ( section.WorldMeshes.empty() )
                 continue;
 
-            float t = 0;
-            if ( Toolbox::PositionInsideBox( origin, section.BoundingBox.Min, section.BoundingBox.Max ) || Toolbox::IntersectBox( section.BoundingBox.Min, section.BoundingBox.Max, origin, dir, t ) ) {
-                if ( t < maxSections * WORLD_SECTION_SIZE )
-                    hitSections.push_back( std::make_pair( &section, t ) );
-            }
+            boxes.Add( &section.BoundingBox.Min.x, &section.BoundingBox.Max.x );
+            sections.push_back( &section );
         }
     }
+
+    std::vector<float> boxHits( sections.size() );
+    if ( !sections.empty() )
+        RayBatch::IntersectBoxes( ray, boxes, &boxHits[0] );
+
+    for ( unsigned int i = 0; i < sections.size(); i++ ) {
+        WorldMeshSectionInfo& section = *sections[i];
+
+        float t = boxHits[i];
+        if ( Toolbox::PositionInsideBox( origin, section.BoundingBox.Min, section.BoundingBox.Max ) ) {
+            t = 0;
+        } else if ( t == RayBatch::MISS ) {
+            continue;
+        }
+
+        if ( t < maxSections * WORLD_SECTION_SIZE )
+            hitSections.push_back( std::make_pair( &section, t ) );
+    }
     // Distance-sort
     hitSections.sort( TraceWorldMeshBoxCmp );
 
     int numProcessed = 0;
     for ( auto const& bit : hitSections ) {
         for ( std::map<MeshKey, WorldMeshInfo*>::iterator it = bit.first->WorldMeshes.begin(); it != bit.first->WorldMeshes.end(); ++it ) {
-            float u, v, t;
-
-            for ( unsigned int i = 0; i < it->second->Indices.size(); i += 3 ) {
-                if ( Toolbox::IntersectTri( *it->second->Vertices[it->second->Indices[i]].Position.toXMFLOAT3(),
-                    *it->second->Vertices[it->second->Indices[i + 1]].Position.toXMFLOAT3(),
-                    *it->second->Vertices[it->second->Indices[i + 2]].Position.toXMFLOAT3(),
-                    origin, dir, u, v, t ) ) {
-                    if ( t > 0 && t < closest ) {
+            float t;
+
+            if ( !it->second->Indices.empty() && !it->second->Vertices.empty() ) {
+                int i = RayBatch::ClosestTriangleIndexed( ray, &it->second->Vertices[0].Position, sizeof( ExVertexStruct ), &it->second->Indices[0], it->second->Indices.size(), 0.0f, t );
+                if ( i >= 0 ) {
+                    if ( t < closest ) {
                         closest = t;
 
                         if ( hitTriangle ) {
@@ -2896,6 +3146,24 @@ void GothicAPI::DebugDrawBSPTree() {
     DebugDrawTreeNode( root, root->BBox3D );
 }
 
+/** Converts a geometric error at distance 1 into pixels on screen, for picking the LOD of static vobs */
+float GothicAPI::GetVobLODPixelScale() {
+    return 0.5f * GetProjTransform()._22 * Engine::GraphicsEngine->GetResolution().y;
+}
+
+/** Queues the vob for instanced drawing this frame, with the LOD fitting its distance */
+static void AddVobInstance( VobInfo* vob, float distance, float lodPixelScale ) {
+    const GothicRendererSettings& settings = Engine::GAPI->GetRendererState().RendererSettings;
+    MeshVisualInfo* visual = reinterpret_cast<MeshVisualInfo*>(vob->VisualInfo);
+
+    vob->CurrentLOD = settings.EnableVobLOD ? visual->SelectLOD( distance, lodPixelScale, settings.VobLODPixelError, vob->CurrentLOD ) : 0;
+
+    VobInstanceInfo vii;
+    vii.world = vob->WorldMatrix;
+    vii.color = vob->GroundColor;
+    visual->AddInstance( vii, vob->CurrentLOD );
+}
+
 /** Collects vobs using gothics BSP-Tree */
 void GothicAPI::CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<VobLightInfo*>& lights, std::vector<SkeletalVobInfo*>& mobs ) {
     zCBspTree* tree = LoadedWorldInfo->BspTree;
@@ -2919,6 +3187,7 @@ void GothicAPI::CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<Vob
     
     // Add visible dynamically added vobs
     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
+        const float lodPixelScale = GetVobLODPixelScale();
         float dist;
         for ( VobInfo* it : DynamicallyAddedVobs ) {
             // Get distance to this vob
@@ -2936,11 +3205,7 @@ void GothicAPI::CollectVisibleVobs( std::vector<VobInfo*>& vobs, std::vector<Vob
                     continue;
                 }
 
-                VobInstanceInfo vii;
-                vii.world = it->WorldMatrix;
-                vii.color = it->GroundColor;
-
-                reinterpret_cast<MeshVisualInfo*>(it->VisualInfo)->Instances.push_back( vii );
+                AddVobInstance( it, dist, lodPixelScale );
 
                 vobs.push_back( it );
                 it->VisibleInRenderPass = true;
@@ -2964,6 +3229,7 @@ void GothicAPI::CollectVisibleSections( std::vector<WorldMeshSectionInfo*>& sect
 
     // run through every section and check for range and frustum
     const int sectionViewDist = Engine::GAPI->GetRendererState().RendererSettings.SectionDrawRadius;
+    const PortalVisibility* portals = GetPortalVisibility();
     for ( auto& itx : WorldSections ) {
         if ( abs( itx.first - camSection.x ) >= sectionViewDist ) {
             continue;
@@ -2978,6 +3244,9 @@ void GothicAPI::CollectVisibleSections( std::vector<WorldMeshSectionInfo*>& sect
                 if ( zCCamera::GetCamera()->BBox3DInFrustum( section.BoundingBox, flags ) == ZTCAM_CLIPTYPE_OUT )
                     continue;
 
+                if ( portals && !portals->IsBoxVisible( &section.BoundingBox.Min.x, &section.BoundingBox.Max.x ) )
+                    continue;
+
                 sections.push_back( &section );
             }
         }
@@ -3036,6 +3305,9 @@ void GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob ) {
     }
     vob->ParentBSPNodes.clear();
 
+    if ( StaticInstances )
+        StaticInstances->RemoveVob( vob );
+
     // Add to dynamic vob list
     DynamicallyAddedVobs.push_back( vob );
 }
@@ -3080,25 +3352,44 @@ std::vector<VobInfo*>::iterator GothicAPI::MoveVobFromBspToDynamic( VobInfo* vob
             itn = itc;
     }
 
+    if ( StaticInstances )
+        StaticInstances->RemoveVob( vob );
+
     // Add to dynamic vob list
     DynamicallyAddedVobs.push_back( vob );
 
     return itn;
 }
 
-static void CVVH_AddNotDrawnVobToList( std::vector<VobInfo*>& target, std::vector<VobInfo*>& source, float dist ) {
+/** Checks an indoor-vob against the portals of the room it is in */
+static bool CVVH_IsVobInVisibleCell( VobInfo* vob, const PortalVisibility* portals, const PortalGraph* graph ) {
+    // Indoor-vobs don't move, the cell only has to be found once
+    if ( vob->PortalCell < 0 ) {
+        vob->PortalCell = static_cast<int>(graph->FindCell( &vob->LastRenderPosition.x ));
+    }
+
+    const float size = vob->VisualInfo ? vob->VisualInfo->MeshSize : 0.0f;
+    const float min[3] = { vob->LastRenderPosition.x - size, vob->LastRenderPosition.y - size, vob->LastRenderPosition.z - size };
+    const float max[3] = { vob->LastRenderPosition.x + size, vob->LastRenderPosition.y + size, vob->LastRenderPosition.z + size };
+    return portals->IsBoxVisible( static_cast<uint32_t>(vob->PortalCell), min, max );
+}
+
+static void CVVH_AddNotDrawnVobToList( std::vector<VobInfo*>& target, std::vector<VobInfo*>& source, float dist, const PortalVisibility* portals = nullptr, const PortalGraph* graph = nullptr ) {
     std::vector<VobInfo*> remVobs;
+    const float lodPixelScale = Engine::GAPI->GetVobLODPixelScale();
+
+    // These are drawn out of their sections instance buffer
+    const bool skipCached = Engine::GAPI->GetStaticInstanceCache() != nullptr;
 
     for ( auto const& it : source ) {
-        if ( !it->VisibleInRenderPass ) {
+        if ( !it->VisibleInRenderPass && !(skipCached && StaticInstanceCache::IsCached( it )) ) {
             float vd;
             XMStoreFloat( &vd, XMVector3Length( Engine::GAPI->GetCameraPositionXM() - XMLoadFloat3( &it->LastRenderPosition ) ) );
             if ( vd < dist && it->Vob->GetShowVisual() ) {
-                VobInstanceInfo vii;
-                vii.world = it->WorldMatrix;
-                vii.color = it->GroundColor;
+                if ( portals && !CVVH_IsVobInVisibleCell( it, portals, graph ) )
+                    continue;
 
-                reinterpret_cast<MeshVisualInfo*>(it->VisualInfo)->Instances.push_back( vii );
+                AddVobInstance( it, vd, lodPixelScale );
                 target.push_back( it );
                 it->VisibleInRenderPass = true;
             }
@@ -3177,6 +3468,10 @@ void GothicAPI::CollectVisibleVobsHelper( BspInfo* base, zTBBox3D boxCell, int c
             // Check if this leaf is inside the frustum
             bool insideFrustum = true;
 
+            // Vobs of leafs hidden behind the portals can't be seen, their lights can still shine through
+            const PortalVisibility* portals = GetPortalVisibility();
+            const bool portalVisible = !portals || portals->IsBoxVisible( &base->OriginalNode->BBox3D.Min.x, &base->OriginalNode->BBox3D.Max.x );
+
             zCBspLeaf* leaf = (zCBspLeaf*)(base->OriginalNode);
             std::vector<VobInfo*>& listA = base->IndoorVobs;
             std::vector<VobInfo*>& listB = base->SmallVobs;
@@ -3188,9 +3483,9 @@ void GothicAPI::CollectVisibleVobsHelper( BspInfo* base, zTBBox3D boxCell, int c
             // float dist = DirectX::XMVector3Length(XMLoadFloat3(&base->BBox3D.Min) - XMLoadFloat3(&camPos));
 
             if ( insideFrustum ) {
-                if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
+                if ( portalVisible && Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
                     if ( dist < vobIndoorDist ) {
-                        CVVH_AddNotDrawnVobToList( vobs, listA, vobIndoorDist );
+                        CVVH_AddNotDrawnVobToList( vobs, listA, vobIndoorDist, portals, &WorldPortals );
                     }
 
                     if ( dist < vobOutdoorSmallDist ) {
@@ -3198,13 +3493,13 @@ void GothicAPI::CollectVisibleVobsHelper( BspInfo* base, zTBBox3D boxCell, int c
                     }
                 }
 
-                if ( dist < vobOutdoorDist ) {
+                if ( portalVisible && dist < vobOutdoorDist ) {
                     if ( Engine::GAPI->GetRendererState().RendererSettings.DrawVOBs ) {
                         CVVH_AddNotDrawnVobToList( vobs, listC, vobOutdoorDist );
                     }
                 }
 
-                if ( Engine::GAPI->GetRendererState().RendererSettings.DrawMobs && dist < vobOutdoorSmallDist ) {
+                if ( portalVisible && Engine::GAPI->GetRendererState().RendererSettings.DrawMobs && dist < vobOutdoorSmallDist ) {
                     CVVH_AddNotDrawnVobToList( mobs, listD, vobOutdoorDist );
                 }
 
@@ -3583,11 +3878,11 @@ void GothicAPI::LoadCustomZENResources() {
 
     LogInfo() << "Loading custom ZEN-Resources from: " << zen;
 
-    // Suppressed Textures
-    LoadSuppressedTextures( zen + ".spt" );
-
-    // Load vegetation
-    LoadVegetation( zen + ".veg" );
+    // Vegetation and suppressed textures, fall back to the old files if there is no snapshot yet
+    if ( XR_SUCCESS != LoadEditorSnapshot( zen + SNAPSHOT_EXTENSION ) ) {
+        LoadSuppressedTextures( zen + ".spt" );
+        LoadVegetation( zen + ".veg" );
+    }
 
     // Load world mesh information
     LoadSectionInfos();
@@ -3617,11 +3912,8 @@ void GothicAPI::SaveCustomZENResources() {
 
     LogInfo() << "Saving custom ZEN-Resources to: " << zen;
 
-    // Suppressed Textures
-    SaveSuppressedTextures( zen + ".spt" );
-
-    // Save vegetation
-    SaveVegetation( zen + ".veg" );
+    // Vegetation and suppressed textures
+    SaveEditorSnapshot( zen + SNAPSHOT_EXTENSION );
 
     // Save world mesh information
     SaveSectionInfos();
@@ -3667,6 +3959,7 @@ void GothicAPI::ResetVegetation() {
         delete it;
     }
     VegetationBoxes.clear();
+    VegetationTree.Clear();
 }
 
 
@@ -3677,46 +3970,7 @@ void GothicAPI::SupressTexture( WorldMeshSectionInfo* section, const std::string
     ApplySuppressedSectionTextures(); // This is an editor only feature, so it's okay to "not be blazing fast"
 }
 
-/** Saves Suppressed textures to a file */
-XRESULT GothicAPI::SaveSuppressedTextures( const std::string& file ) {
-    FILE* f = fopen( file.c_str(), "wb" );
-
-    LogInfo() << "Saving suppressed textures";
-
-    if ( !f )
-        return XR_FAILED;
-
-    int version = 1;
-    fwrite( &version, sizeof( version ), 1, f );
-
-    size_t count = SuppressedTexturesBySection.size();
-    fwrite( &count, sizeof( count ), 1, f );
-
-    for ( auto const& it : SuppressedTexturesBySection ) {
-        // Write section xy-coords
-        fwrite( &it.first->WorldCoordinates, sizeof( INT2 ), 1, f );
-
-        size_t countTX = it.second.size();
-        fwrite( &countTX, sizeof( countTX ), 1, f );
-
-        for ( size_t i = 0; i < countTX; i++ ) {
-            size_t numChars = it.second[i].size();
-            numChars = std::min( 255, (int)numChars );
-
-            // Write num of chars
-            fwrite( &numChars, sizeof( numChars ), 1, f );
-
-            // Write chars
-            fwrite( &it.second[0], numChars, 1, f );
-        }
-    }
-
-    fclose( f );
-
-    return XR_SUCCESS;
-}
-
-/** Saves Suppressed textures to a file */
+/** Loads suppressed textures from an old .spt-file */
 XRESULT GothicAPI::LoadSuppressedTextures( const std::string& file ) {
     FILE* f = fopen( file.c_str(), "rb" );
 
@@ -3772,31 +4026,7 @@ XRESULT GothicAPI::LoadSuppressedTextures( const std::string& file ) {
     return XR_SUCCESS;
 }
 
-/** Saves vegetation to a file */
-XRESULT GothicAPI::SaveVegetation( const std::string& file ) {
-    FILE* f = fopen( file.c_str(), "wb" );
-
-    LogInfo() << "Saving vegetation";
-
-    if ( !f )
-        return XR_FAILED;
-
-    int version = 1;
-    fwrite( &version, sizeof( version ), 1, f );
-
-    size_t num = VegetationBoxes.size();
-    fwrite( &num, sizeof( num ), 1, f );
-
-    for ( auto const& it : VegetationBoxes ) {
-        it->SaveToFILE( f, version );
-    }
-
-    fclose( f );
-
-    return XR_SUCCESS;
-}
-
-/** Saves vegetation to a file */
+/** Loads vegetation from an old .veg-file */
 XRESULT GothicAPI::LoadVegetation( const std::string& file ) {
     FILE* f = fopen( file.c_str(), "rb" );
 
@@ -3826,6 +4056,171 @@ XRESULT GothicAPI::LoadVegetation( const std::string& file ) {
     return XR_SUCCESS;
 }
 
+/** Saves vegetation and suppressed textures into the editor snapshot */
+XRESULT GothicAPI::SaveEditorSnapshot( const std::string& file ) {
+    // The archive belongs to the last save until that is done
+    WaitForEditorSnapshot();
+
+    if ( !EditorSnapshot )
+        EditorSnapshot = std::make_unique<SnapshotArchive>();
+
+    // Other world or first save, nothing in the file can be relied on
+    bool fullSave = EditorSnapshotNeedsFullSave;
+    if ( EditorSnapshot->GetFile() != file ) {
+        EditorSnapshot->Open( file );
+        fullSave = true;
+    }
+    EditorSnapshotNeedsFullSave = false;
+
+    // Serialize only what changed. The buffers are never touched again, so the worker can have them
+    // while the editor goes on changing the boxes.
+    std::vector<SnapshotChunk> chunks;
+    chunks.reserve( VegetationBoxes.size() + 1 );
+
+    size_t numChanged = 0;
+    for ( GVegetationBox* box : VegetationBoxes ) {
+        if ( !box->GetSnapshotId() )
+            box->SetSnapshotId( NextVegetationSnapshotId++ );
+
+        SnapshotBuffer data;
+        if ( fullSave || box->IsSnapshotDirty() ) {
+            auto buffer = std::make_shared<std::vector<uint8_t>>();
+            box->SaveToBuffer( *buffer );
+            box->SetSnapshotDirty( false );
+
+            data = std::move( buffer );
+            numChanged++;
+        }
+
+        // Mostly floats, shuffling their bytes helps the compression
+        chunks.emplace_back( MakeSnapshotKey( SNAPSHOT_CHUNK_VEGETATION, box->GetSnapshotId() ), std::move( data ), true );
+    }
+
+    // Small enough to always pass in, the archive skips it if it didn't change
+    auto textures = std::make_shared<std::vector<uint8_t>>();
+    auto write = [&]( const void* p, size_t size ) {
+        const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+        textures->insert( textures->end(), b, b + size );
+    };
+
+    const uint32_t version = SUPPRESSED_TEXTURES_CHUNK_VERSION;
+    const uint32_t numSections = static_cast<uint32_t>(SuppressedTexturesBySection.size());
+    write( &version, sizeof( version ) );
+    write( &numSections, sizeof( numSections ) );
+
+    for ( auto const& it : SuppressedTexturesBySection ) {
+        const uint32_t numTextures = static_cast<uint32_t>(it.second.size());
+        write( &it.first->WorldCoordinates, sizeof( INT2 ) );
+        write( &numTextures, sizeof( numTextures ) );
+
+        for ( const std::string& texture : it.second ) {
+            const uint32_t length = static_cast<uint32_t>(texture.size());
+            write( &length, sizeof( length ) );
+            write( texture.data(), length );
+        }
+    }
+
+    chunks.emplace_back( MakeSnapshotKey( SNAPSHOT_CHUNK_SUPPRESSED_TEXTURES, 0 ), std::move( textures ) );
+
+    LogInfo() << "Saving editor snapshot, " << numChanged << " of " << VegetationBoxes.size() << " vegetationboxes changed";
+
+    SnapshotArchive* archive = EditorSnapshot.get();
+    EditorSnapshotSave = Engine::WorkerThreadPool->enqueue( [archive, chunks]() {
+        if ( !archive->Save( chunks ) ) {
+            LogError() << "Failed to save editor snapshot: " << archive->GetLastError();
+            return false;
+        }
+
+        LogInfo() << "Saved editor snapshot to " << archive->GetFile() << ", wrote " << archive->GetNumChunksWritten()
+            << " of " << chunks.size() << " chunks" << (archive->GetLastSaveWasCompaction() ? " and compacted the file" : "");
+        return true;
+    } );
+
+    return XR_SUCCESS;
+}
+
+/** Loads vegetation and suppressed textures from the editor snapshot */
+XRESULT GothicAPI::LoadEditorSnapshot( const std::string& file ) {
+    WaitForEditorSnapshot();
+
+    if ( !EditorSnapshot )
+        EditorSnapshot = std::make_unique<SnapshotArchive>();
+
+    NextVegetationSnapshotId = 1;
+    EditorSnapshotNeedsFullSave = false;
+
+    // Stays bound to the file even if it doesn't exist, so the next save creates it
+    if ( !EditorSnapshot->Open( file ) )
+        return XR_FAILED;
+
+    LogInfo() << "Loading editor snapshot";
+
+    ResetVegetation();
+    ResetSupressedTextures();
+
+    std::vector<uint8_t> data;
+    for ( uint64_t key : EditorSnapshot->GetKeys( SNAPSHOT_CHUNK_VEGETATION ) ) {
+        const uint32_t id = static_cast<uint32_t>(key);
+        NextVegetationSnapshotId = std::max( NextVegetationSnapshotId, id + 1 );
+
+        GVegetationBox* box = new GVegetationBox;
+        if ( !EditorSnapshot->Read( key, data ) || XR_SUCCESS != box->LoadFromBuffer( data ) ) {
+            LogWarn() << "Vegetationbox " << id << " in the editor snapshot is broken, skipping it";
+            delete box;
+            continue;
+        }
+
+        box->SetSnapshotId( id );
+        AddVegetationBox( box );
+    }
+
+    if ( EditorSnapshot->Read( MakeSnapshotKey( SNAPSHOT_CHUNK_SUPPRESSED_TEXTURES, 0 ), data ) ) {
+        size_t pos = 0;
+        auto read = [&]( void* p, size_t size ) {
+            if ( size > data.size() - pos )
+                return false;
+
+            memcpy( p, data.data() + pos, size );
+            pos += size;
+            return true;
+        };
+
+        uint32_t version = 0, numSections = 0;
+        read( &version, sizeof( version ) );
+        if ( version == SUPPRESSED_TEXTURES_CHUNK_VERSION && read( &numSections, sizeof( numSections ) ) ) {
+            for ( uint32_t s = 0; s < numSections; s++ ) {
+                INT2 coords;
+                uint32_t numTextures;
+                if ( !read( &coords, sizeof( coords ) ) || !read( &numTextures, sizeof( numTextures ) ) )
+                    break;
+
+                std::vector<std::string>& textures = SuppressedTexturesBySection[&WorldSections[coords.x][coords.y]];
+                for ( uint32_t t = 0; t < numTextures; t++ ) {
+                    uint32_t length;
+                    if ( !read( &length, sizeof( length ) ) || length > data.size() - pos )
+                        break;
+
+                    textures.emplace_back( reinterpret_cast<const char*>(data.data() + pos), length );
+                    pos += length;
+                }
+            }
+        }
+
+        ApplySuppressedSectionTextures();
+    }
+
+    return XR_SUCCESS;
+}
+
+/** Blocks until the last snapshot-save is done */
+void GothicAPI::WaitForEditorSnapshot() {
+    if ( !EditorSnapshotSave.valid() )
+        return;
+
+    if ( !EditorSnapshotSave.get() )
+        EditorSnapshotNeedsFullSave = true;
+}
+
 /** Loads the FixBink value from SystemPack.ini */
 void GothicAPI::LoadFixBinkValue() {
     TCHAR NPath[MAX_PATH];
@@ -3858,6 +4253,79 @@ void GothicAPI::SaveWindowResolution() {
     WritePrivateProfileStringA( "VIDEO", "zVidResFullscreenY", std::to_string( res.y ).c_str(), ini.c_str() );
 }
 
+/** Writes the worldmesh-positions and the pointlights of the current world to a file
+
+    Layout, all little endian:
+        uint32 version, uint32 numSections
+        per section: int32 x, int32 y, uint32 numMeshes
+            per mesh: uint32 numVertices, float3 positions[], uint32 numIndices, uint16 indices[]
+        uint32 numLights
+        per light: float3 position, float range, int32 sectionX, int32 sectionY */
+XRESULT GothicAPI::SaveShadowGeometry( const std::string& file ) {
+    FILE* f;
+    fopen_s( &f, file.c_str(), "wb" );
+    if ( !f ) {
+        LogWarn() << "Failed to open " << file << " for writing";
+        return XR_FAILED;
+    }
+
+    uint32_t version = 1;
+    fwrite( &version, sizeof( version ), 1, f );
+
+    uint32_t numSections = 0;
+    for ( auto const& itx : WorldSections ) {
+        numSections += itx.second.size();
+    }
+
+    fwrite( &numSections, sizeof( numSections ), 1, f );
+
+    std::vector<float3> positions;
+    for ( auto const& itx : WorldSections ) {
+        for ( auto const& ity : itx.second ) {
+            int32_t xy[2] = { itx.first, ity.first };
+            uint32_t numMeshes = ity.second.WorldMeshes.size();
+            fwrite( xy, sizeof( xy ), 1, f );
+            fwrite( &numMeshes, sizeof( numMeshes ), 1, f );
+
+            for ( auto const& it : ity.second.WorldMeshes ) {
+                positions.clear();
+                for ( const ExVertexStruct& v : it.second->Vertices ) {
+                    positions.emplace_back( v.Position );
+                }
+
+                uint32_t numVertices = positions.size();
+                uint32_t numIndices = it.second->Indices.size();
+                fwrite( &numVertices, sizeof( numVertices ), 1, f );
+                if ( numVertices )
+                    fwrite( &positions[0], sizeof( float3 ), numVertices, f );
+
+                fwrite( &numIndices, sizeof( numIndices ), 1, f );
+                if ( numIndices )
+                    fwrite( &it.second->Indices[0], sizeof( VERTEX_INDEX ), numIndices, f );
+            }
+        }
+    }
+
+    uint32_t numLights = VobLightMap.size();
+    fwrite( &numLights, sizeof( numLights ), 1, f );
+
+    for ( auto const& it : VobLightMap ) {
+        float3 position = it.second->Vob->GetPositionWorld();
+        float range = it.second->Vob->GetLightRange();
+        INT2 s = WorldConverter::GetSectionOfPos( position );
+        int32_t xy[2] = { s.x, s.y };
+
+        fwrite( &position, sizeof( position ), 1, f );
+        fwrite( &range, sizeof( range ), 1, f );
+        fwrite( xy, sizeof( xy ), 1, f );
+    }
+
+    fclose( f );
+
+    LogInfo() << "Saved shadow geometry of " << numSections << " sections and " << numLights << " lights to " << file;
+    return XR_SUCCESS;
+}
+
 /** Saves the users settings from the menu */
 XRESULT GothicAPI::SaveMenuSettings( const std::string& file ) {
     TCHAR NPath[MAX_PATH];
@@ -3882,7 +4350,14 @@ XRESULT GothicAPI::SaveMenuSettings( const std::string& file ) {
     WritePrivateProfileStringA( "General", "EnableInactiveFpsLock", std::to_string( s.EnableInactiveFpsLock ? TRUE : FALSE ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "General", "MultiThreadResourceManager", std::to_string( s.MTResoureceManager ? TRUE : FALSE ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "General", "CompressBackBuffer", std::to_string( s.CompressBackBuffer ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "CompressGothicTextures", std::to_string( s.CompressGothicTextures ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableSkeletalInstancing", std::to_string( s.EnableSkeletalInstancing ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnablePortalCulling", std::to_string( s.EnablePortalCulling ? TRUE : FALSE ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "General", "AnimateStaticVobs", std::to_string( s.AnimateStaticVobs ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableVobLOD", std::to_string( s.EnableVobLOD ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "VobLODPixelError", std::to_string( s.VobLODPixelError ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "EnableStaticInstanceCache", std::to_string( s.EnableStaticInstanceCache ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "General", "CachePointlightStaticShadows", std::to_string( s.CachePointlightStaticShadows ? TRUE : FALSE ).c_str(), ini.c_str() );
 
     /*
     * Draw-distance is saved on a per World basis using SaveRendererWorldSettings
@@ -3918,6 +4393,7 @@ XRESULT GothicAPI::SaveMenuSettings( const std::string& file ) {
     WritePrivateProfileStringA( "Shadows", "PointlightShadows", std::to_string( s.EnablePointlightShadows ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "Shadows", "EnableDynamicLighting", std::to_string( s.EnableDynamicLighting ? TRUE : FALSE ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "Shadows", "SmoothCameraUpdate", std::to_string( s.SmoothShadowCameraUpdate ? TRUE : FALSE ).c_str(), ini.c_str() );
+    WritePrivateProfileStringA( "Shadows", "EnableCascades", std::to_string( s.EnableShadowCascades ? TRUE : FALSE ).c_str(), ini.c_str() );
 
     WritePrivateProfileStringA( "SMAA", "Enabled", std::to_string( s.EnableSMAA ? TRUE : FALSE ).c_str(), ini.c_str() );
     WritePrivateProfileStringA( "SMAA", "SharpenFactor", std::to_string( s.SharpenFactor ).c_str(), ini.c_str() );
@@ -3974,7 +4450,14 @@ XRESULT GothicAPI::LoadMenuSettings( const std::string& file ) {
     s.EnableInactiveFpsLock = GetPrivateProfileBoolA( "General", "EnableInactiveFpsLock", defaultRendererSettings.EnableInactiveFpsLock, ini );
     s.MTResoureceManager = GetPrivateProfileBoolA( "General", "MultiThreadResourceManager", defaultRendererSettings.MTResoureceManager, ini );
     s.CompressBackBuffer = GetPrivateProfileBoolA( "General", "CompressBackBuffer", defaultRendererSettings.CompressBackBuffer, ini );
+    s.CompressGothicTextures = GetPrivateProfileBoolA( "General", "CompressGothicTextures", defaultRendererSettings.CompressGothicTextures, ini );
+    s.EnableSkeletalInstancing = GetPrivateProfileBoolA( "General", "EnableSkeletalInstancing", defaultRendererSettings.EnableSkeletalInstancing, ini );
+    s.EnablePortalCulling = GetPrivateProfileBoolA( "General", "EnablePortalCulling", defaultRendererSettings.EnablePortalCulling, ini );
     s.AnimateStaticVobs = GetPrivateProfileBoolA( "General", "AnimateStaticVobs", defaultRendererSettings.AnimateStaticVobs, ini );
+    s.EnableVobLOD = GetPrivateProfileBoolA( "General", "EnableVobLOD", defaultRendererSettings.EnableVobLOD, ini );
+    s.VobLODPixelError = GetPrivateProfileFloatA( "General", "VobLODPixelError", defaultRendererSettings.VobLODPixelError, ini );
+    s.EnableStaticInstanceCache = GetPrivateProfileBoolA( "General", "EnableStaticInstanceCache", defaultRendererSettings.EnableStaticInstanceCache, ini );
+    s.CachePointlightStaticShadows = GetPrivateProfileBoolA( "General", "CachePointlightStaticShadows", defaultRendererSettings.CachePointlightStaticShadows, ini );
 
     /*
     * Draw-distance is Loaded on a per World basis using LoadRendererWorldSettings
@@ -4000,6 +4483,7 @@ XRESULT GothicAPI::LoadMenuSettings( const std::string& file ) {
     s.WorldShadowRangeScale = GetPrivateProfileFloatA( "Shadows", "WorldShadowRangeScale", 1.0f, ini );
     s.EnableDynamicLighting = GetPrivateProfileBoolA( "Shadows", "EnableDynamicLighting", defaultRendererSettings.EnableDynamicLighting, ini );
     s.SmoothShadowCameraUpdate = GetPrivateProfileBoolA( "Shadows", "SmoothCameraUpdate", defaultRendererSettings.SmoothShadowCameraUpdate, ini );
+    s.EnableShadowCascades = GetPrivateProfileBoolA( "Shadows", "EnableCascades", defaultRendererSettings.EnableShadowCascades, ini );
 
     INT2 res = {};
     RECT desktopRect;
@@ -4153,13 +4637,6 @@ void GothicAPI::AddStagingTexture( UINT mip, ID3D11Texture2D* stagingTexture, ID
     Engine::GAPI->LeaveResourceCriticalSection();
 }
 
-/** Adds a mip map generation deferred command */
-void GothicAPI::AddMipMapGeneration( D3D11Texture* texture ) {
-    Engine::GAPI->EnterResourceCriticalSection();
-    FrameMipMapGenerations.push_back( texture );
-    Engine::GAPI->LeaveResourceCriticalSection();
-}
-
 /** Adds a texture to the list of the loaded textures for this frame */
 void GothicAPI::AddFrameLoadedTexture( MyDirectDrawSurface7* srf ) {
     srf->AddRef();
@@ -4180,41 +4657,25 @@ void GothicAPI::SetFrameProcessedTexturesReady() {
 }
 
 /** Draws a morphmesh */
-void GothicAPI::DrawMorphMesh( zCMorphMesh* msh, std::map<zCMaterial*, std::vector<MeshInfo*>>& meshes ) {
-    DirectX::XMFLOAT3 bbmin, bbmax;
-    bbmin = DirectX::XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
-    bbmax = DirectX::XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
-
+void GothicAPI::DrawMorphMesh( zCMorphMesh* msh, MeshVisualInfo* meshInfo ) {
     zCProgMeshProto* morphMesh = msh->GetMorphMesh();
     if ( !morphMesh )
         return;
 
-    DirectX::XMFLOAT3* posList = (DirectX::XMFLOAT3*)morphMesh->GetPositionList()->Array;
-    for ( int i = 0; i < morphMesh->GetNumSubmeshes(); i++ ) {
-        std::vector<ExVertexStruct> vertices;
+    // Only uploads if the positions changed since this head was drawn last
+    WorldConverter::UpdateMorphMeshVertices( morphMesh, meshInfo );
 
+    for ( int i = 0; i < morphMesh->GetNumSubmeshes(); i++ ) {
         zCSubMesh* s = morphMesh->GetSubmesh( i );
-        vertices.reserve( s->WedgeList.NumInArray );
-        for ( int v = 0; v < s->WedgeList.NumInArray; v++ ) {
-            zTPMWedge& wedge = s->WedgeList.Array[v];
-            vertices.emplace_back();
-            ExVertexStruct& vx = vertices.back();
-            vx.Position = posList[wedge.position];
-            vx.Normal = wedge.normal;
-            vx.TexCoord = wedge.texUV;
-            vx.Color = 0xFFFFFFFF;
-        }
-
         if ( zCTexture* texture = s->Material->GetAniTexture() ) {
             D3D11GraphicsEngine* g = (D3D11GraphicsEngine*)Engine::GraphicsEngine;
             if ( !g->BindTextureNRFX( texture, (g->GetRenderingStage() == DES_MAIN) ) )
                 continue;
         }
 
-        for ( auto const& it : meshes ) {
+        for ( auto const& it : meshInfo->Meshes ) {
             for ( MeshInfo* mi : it.second ) {
                 if ( mi->MeshIndex == i ) {
-                    mi->MeshVertexBuffer->UpdateBuffer( &vertices[0], vertices.size() * sizeof( ExVertexStruct ) );
                     Engine::GraphicsEngine->DrawVertexBufferIndexed( mi->MeshVertexBuffer, mi->MeshIndexBuffer, mi->Indices.size() );
                     goto Out_Of_Nested_Loop;
                 }
@@ -4342,7 +4803,7 @@ void GothicAPI::SetIntParamFromConfig( const std::string& param, int value ) {
 }
 
 /** Returns the frame particle info collected from all DrawParticleFX-Calls */
-std::map<zCTexture*, ParticleRenderInfo>& GothicAPI::GetFrameParticleInfo() {
+FrameParticleInfoMap& GothicAPI::GetFrameParticleInfo() {
     return FrameParticleInfo;
 }
 
@@ -4533,6 +4994,24 @@ GOcean* GothicAPI::GetOcean() {
     return Ocean.get();
 }
 
+/** Returns the packed replacement-textures, or nullptr if there is no archive */
+const TextureArchive* GothicAPI::GetReplacementTextureArchive() {
+    return ReplacementTextureArchive.get();
+}
+
+/** Returns the file system over the zip-packs, or nullptr if no packs are mounted */
+ZipFileSystem* GothicAPI::GetZipFileSystem() {
+    return PackFileSystem.get();
+}
+
+/** Returns the persistent instances of the static vobs, or nullptr if they are collected through the BSP-Tree */
+StaticInstanceCache* GothicAPI::GetStaticInstanceCache() {
+    if ( !RendererState.RendererSettings.EnableStaticInstanceCache || !StaticInstances || !StaticInstances->GetNumInstances() )
+        return nullptr;
+
+    return StaticInstances.get();
+}
+
 /** Returns our bsp-root-node */
 BspInfo* GothicAPI::GetNewRootNode() {
     return &BspLeafVobLists[LoadedWorldInfo->BspTree->GetRootNode()];
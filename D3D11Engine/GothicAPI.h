@@ -5,6 +5,9 @@
 #include "zCTree.h"
 #include "zCPolyStrip.h"
 #include "zTypes.h"
+#include "DynamicAABBTree.h"
+#include "SpatialHashGrid.h"
+#include "PortalGraph.h"
 
 #define START_TIMING Engine::GAPI->GetRendererState().RendererInfo.Timing.Start
 #define STOP_TIMING Engine::GAPI->GetRendererState().RendererInfo.Timing.Stop
@@ -164,6 +167,10 @@ class GVegetationBox;
 class GOcean;
 class zCMorphMesh;
 class zCDecal;
+class TextureArchive;
+class ZipFileSystem;
+class StaticInstanceCache;
+class SnapshotArchive;
 
 class GothicAPI {
 public:
@@ -265,7 +272,7 @@ public:
     void DrawInventory( zCWorld* world, zCCamera& camera );
 
     /** Draws a morphmesh */
-    void DrawMorphMesh( zCMorphMesh* msh, std::map<zCMaterial*, std::vector<MeshInfo*>>& meshes );
+    void DrawMorphMesh( zCMorphMesh* msh, MeshVisualInfo* meshInfo );
 
     /** Locks the resource CriticalSection */
     void EnterResourceCriticalSection();
@@ -286,10 +293,10 @@ public:
     void DrawParticleFX( zCVob* source, zCParticleFX* fx, ParticleFrameData& data );
 
     /** Gets a list of visible decals */
-    void GetVisibleDecalList( std::vector<zCVob*>& decals );
+    void GetVisibleDecalList( FrameVector<zCVob*>& decals );
 
     /** Returns a list of visible particle-effects */
-    void GetVisibleParticleEffectsList( std::vector<zCVob*>& pfxList );
+    void GetVisibleParticleEffectsList( FrameVector<zCVob*>& pfxList );
 
     /** Sets the Projection matrix */
     void XM_CALLCONV SetProjTransformXM( const XMMATRIX proj );
@@ -297,6 +304,9 @@ public:
     /** Gets the Projection matrix */
     DirectX::XMFLOAT4X4 GetProjTransform();
 
+    /** Converts a geometric error at distance 1 into pixels on screen, for picking the LOD of static vobs */
+    float GetVobLODPixelScale();
+
     /** Sets the world matrix */
     void XM_CALLCONV  SetWorldTransformXM( DirectX::XMMATRIX world, bool transpose = false );
 
@@ -553,6 +563,20 @@ public:
     /** Removes a vegetationbox from the world */
     void RemoveVegetationBox( GVegetationBox* box );
 
+    /** Updates the spatial index after the bounding box of a vegetationbox changed */
+    void OnVegetationBoxMoved( GVegetationBox* box );
+
+    /** Returns the closest vegetationbox hit by the ray, or nullptr. Boxes placed on worldmesh parts are skipped. */
+    GVegetationBox* TraceVegetationBoxes( const DirectX::XMFLOAT3& origin, const DirectX::XMFLOAT3& dir );
+
+    /** Puts the sphere a shadowed light collected its casters in into the spatial index, so moved and added
+        vobs only get reported to the lights they can touch. Pass NULL_NODE as proxy the first time, returns
+        the proxy to use from then on. */
+    int UpdateShadowedLightRange( BaseShadowedPointLight* light, int proxy, const DirectX::XMFLOAT3& center, float radius );
+
+    /** Takes a shadowed light out of the spatial index */
+    void RemoveShadowedLightRange( int proxy );
+
     /** Teleports the player to the given location */
     void SetPlayerPosition( const DirectX::XMFLOAT3& pos );
 
@@ -562,6 +586,9 @@ public:
     /** Returns the map of static mesh visuals */
     const std::unordered_map<zCProgMeshProto*, MeshVisualInfo*>& GetStaticMeshVisuals() { return StaticMeshVisuals; }
 
+    /** Returns the vobs which were added or moved after loading and aren't in the BSP-Tree anymore */
+    const std::list<VobInfo*>& GetDynamicallyAddedVobs() { return DynamicallyAddedVobs; }
+
     /** Returns the collection of PolyStrip meshes infos */
     const std::map<zCTexture*, PolyStripInfo>& GetPolyStripInfos() { return PolyStripInfos; };
 
@@ -574,18 +601,22 @@ public:
     /** Resets the vegetation */
     void ResetVegetation();
 
-    /** Saves Suppressed textures to a file */
-    XRESULT SaveSuppressedTextures( const std::string& file );
-
-    /** Saves Suppressed textures to a file */
+    /** Loads suppressed textures from an old .spt-file */
     XRESULT LoadSuppressedTextures( const std::string& file );
 
-    /** Saves vegetation to a file */
-    XRESULT SaveVegetation( const std::string& file );
-
-    /** Saves vegetation to a file */
+    /** Loads vegetation from an old .veg-file */
     XRESULT LoadVegetation( const std::string& file );
 
+    /** Saves vegetation and suppressed textures into the editor snapshot. Only boxes which changed since
+        the last save get serialized here, compressing and writing happens on a worker thread. */
+    XRESULT SaveEditorSnapshot( const std::string& file );
+
+    /** Loads vegetation and suppressed textures from the editor snapshot. Fails if there is none. */
+    XRESULT LoadEditorSnapshot( const std::string& file );
+
+    /** Blocks until the last snapshot-save is done */
+    void WaitForEditorSnapshot();
+
     /** Returns the main-thread id */
     DWORD GetMainThreadID();
 
@@ -610,18 +641,15 @@ public:
     /** Loads the users settings from the menu */
     XRESULT LoadMenuSettings( const std::string& file );
 
+    /** Writes the worldmesh-positions and the pointlights of the current world to a file, for Tools/ShadowClusterBench */
+    XRESULT SaveShadowGeometry( const std::string& file );
+
     /** Adds a staging texture to the list of the staging textures for this frame */
     void AddStagingTexture( UINT mip, ID3D11Texture2D* stagingTexture, ID3D11Texture2D* texture );
 
     /** Gets a list of the staging textures for this frame */
     std::list<std::pair<std::pair<UINT, ID3D11Texture2D*>, ID3D11Texture2D*>>& GetStagingTextures() {return FrameStagingTextures;}
 
-    /** Adds a mip map generation deferred command */
-    void AddMipMapGeneration( D3D11Texture* texture );
-
-    /** Gets a list of the mip map generation commands for this frame */
-    std::list<D3D11Texture*>& GetMipMapGeneration() {return FrameMipMapGenerations;}
-
     /** Adds a texture to the list of the loaded textures for this frame */
     void AddFrameLoadedTexture( MyDirectDrawSurface7* srf );
 
@@ -632,7 +660,7 @@ public:
     SkeletalVobInfo* GetSkeletalVobByVob( zCVob* vob );
 
     /** Returns the frame particle info collected from all DrawParticleFX-Calls */
-    std::map<zCTexture*, ParticleRenderInfo>& GetFrameParticleInfo();
+    FrameParticleInfoMap& GetFrameParticleInfo();
 
     /** Checks if the normalmaps are there */
     bool CheckNormalmapFilesOld();
@@ -655,6 +683,18 @@ public:
     /** Returns the current ocean-object */
     GOcean* GetOcean();
 
+    /** Returns the packed replacement-textures, or nullptr if there is no archive */
+    const TextureArchive* GetReplacementTextureArchive();
+
+    /** Returns the file system over the zip-packs, or nullptr if no packs are mounted */
+    ZipFileSystem* GetZipFileSystem();
+
+    /** Returns the persistent instances of the static vobs, or nullptr if they are collected through the BSP-Tree */
+    StaticInstanceCache* GetStaticInstanceCache();
+
+    /** Returns the cells seen through the portals from the main camera, or nullptr if everything in the frustum is visible */
+    const PortalVisibility* GetPortalVisibility();
+
     /** Loads the data out of a zCModel and stores it in the cache */
     SkeletalMeshVisualInfo* LoadzCModelData( zCModel* model );
 
@@ -677,6 +717,12 @@ private:
     /** Cleans empty BSPNodes */
     void CleanBSPNodes();
 
+    /** Builds the cells and portals of the loaded world out of the sector- and portal-polygons */
+    void BuildPortalGraph( zCPolygon** polys, unsigned int numPolygons );
+
+    /** Walks the portals from the current camera, has to happen before the main pass collects anything */
+    void UpdatePortalVisibility();
+
     /** Helper function for going through the bsp-tree */
     void BuildBspVobMapCacheHelper( zCBspBase* base );
 
@@ -708,8 +754,9 @@ private:
     /** Currently bound textures from gothic */
     zCTexture* BoundTextures[8];
 
-    std::map<zCTexture*, std::vector<ParticleInstanceInfo>> FrameParticles;
-    std::map<zCTexture*, ParticleRenderInfo> FrameParticleInfo;
+    /** Live in the frame arena, have to be emptied before the frame ends */
+    FrameParticleMap FrameParticles;
+    FrameParticleInfoMap FrameParticleInfo;
 
     /** Loaded game sections */
     std::map<int, std::map<int, WorldMeshSectionInfo>> WorldSections;
@@ -723,7 +770,9 @@ private:
 
     /** List of Vobs having a zCParticleFX-Visual */
     std::vector<zCVob*> ParticleEffectVobs;
-    std::vector<zCVob*> DecalVobs;
+
+    /** Vobs having a decal-visual, by their position */
+    SpatialHashGrid<zCVob*> DecalVobs;
     std::unordered_map<zCVob*, std::string> tempParticleNames;
 
     /** List of Meshes derived from a zCParticleFX-Visual */
@@ -795,15 +844,45 @@ private:
     /** List of available GVegetationBoxes */
     std::list<GVegetationBox*> VegetationBoxes;
 
+    /** Spatial index over VegetationBoxes */
+    DynamicAABBTree<GVegetationBox*> VegetationTree;
+
+    /** Spatial index over the ranges of the shadowed lights, see UpdateShadowedLightRange */
+    DynamicAABBTree<BaseShadowedPointLight*> ShadowedLightTree;
+
     /** Gothics output window */
     HWND OutputWindow;
 
     /** Ocean */
     std::unique_ptr<GOcean> Ocean;
 
+    /** Packed version of the textures\\replacements-folder */
+    std::unique_ptr<TextureArchive> ReplacementTextureArchive;
+
+    /** Zip-packs from system\\GD3D11\\packs, read without extracting them */
+    std::unique_ptr<ZipFileSystem> PackFileSystem;
+
+    /** Instancing-buffer of the static outdoor vobs, built once per world */
+    std::unique_ptr<StaticInstanceCache> StaticInstances;
+
+    /** Rooms of the current world and what the main camera can see of them */
+    PortalGraph WorldPortals;
+    PortalVisibility PortalCells;
+    bool PortalCellsValid;
+
     /** Suppressed textures for the sections */
     std::map<WorldMeshSectionInfo*, std::vector<std::string>> SuppressedTexturesBySection;
 
+    /** Vegetation and suppressed textures of the current world, only touched by the saving task while it runs */
+    std::unique_ptr<SnapshotArchive> EditorSnapshot;
+    std::future<bool> EditorSnapshotSave;
+
+    /** Set if a save failed, the next one can't rely on what is in the file then */
+    bool EditorSnapshotNeedsFullSave;
+
+    /** Id for the next vegetationbox which gets its own chunk */
+    uint32_t NextVegetationSnapshotId;
+
     /** Current camera, stored to find out about camera switches */
     zCCamera* CurrentCamera;
 
@@ -812,7 +891,6 @@ private:
 
     /** Textures loaded this frame */
     std::list<std::pair<std::pair<UINT, ID3D11Texture2D*>, ID3D11Texture2D*>> FrameStagingTextures;
-    std::list<D3D11Texture*> FrameMipMapGenerations;
     std::list<MyDirectDrawSurface7*> FrameLoadedTextures;
 
     /** Quad marks loaded in the world */
@@ -5,6 +5,7 @@
 #include "pch.h"
 #include "BasicTimer.h"
 #include "BasePipelineStates.h"
+#include "PipelineStateKey.h"
 
 /** Struct handling all the graphical states set by the game. Can be used as Constantbuffer */
 const int GSWITCH_FOG = 1;
@@ -100,58 +101,27 @@ struct GothicGraphicsState {
     FixedFunctionStage FF_Stages[2];
 };
 
-__declspec(align(4)) struct GothicPipelineState {
-    /** Sets this state dirty, which means that it will be updated before next rendering */
-    void SetDirty() {
-        StateDirty = true;
-        HashThis( (char*)this, StructSize );
-    }
-
-    /** Hashes the whole struct */
-    void HashThis( char* data, int size ) {
-        Hash = 0;
-
-        // Start hashing at the data of the other structs, skip the data of this one
-        for ( int i = sizeof( GothicPipelineState ); i < size; i += 4 ) {
-            DWORD d;
-            memcpy( &d, data + i, 4 );
-
-            Toolbox::hash_combine( Hash, d );
-        }
-    }
-
+/** Base of the states below. Each of them packs itself into Key when SetDirty is called, so changes
+    made to the fields are only seen after that. */
+struct GothicPipelineState {
     bool operator==( const GothicPipelineState& o ) const {
-        return Hash == o.Hash;
+        return Key == o.Key;
     }
 
     bool StateDirty;
-    size_t Hash;
-    int StructSize;
-};
-
-struct GothicPipelineKeyHasher {
-    static const size_t bucket_size = 10; // mean bucket size that the container should try not to exceed
-    static const size_t min_buckets = (1 << 10); // minimum number of buckets, power of 2, >0
 
-    static std::size_t hash_value( float value ) {
-        stdext::hash<float> hasher;
-        return hasher( value );
-    }
-
-    static void hash_combine( std::size_t& seed, float value ) {
-        seed ^= hash_value( value ) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-    }
+    /** Exact encoding of the state, see PipelineStateKey.h */
+    uint64_t Key;
 
-    std::size_t operator()( const GothicPipelineState& k ) const {
-        return k.Hash;
-    }
+    /** Id of the state-object in GothicStateCache, INVALID_ID until it was looked up after the last change */
+    uint32_t CacheId;
 };
 
 namespace GothicStateCache {
-    /** Hashmap for caching the state-objects */
-    __declspec(selectany) std::unordered_map<GothicDepthBufferStateInfo, BaseDepthBufferState*, GothicPipelineKeyHasher> s_DepthBufferMap;
-    __declspec(selectany) std::unordered_map<GothicBlendStateInfo, BaseBlendStateInfo*, GothicPipelineKeyHasher> s_BlendStateMap;
-    __declspec(selectany) std::unordered_map<GothicRasterizerStateInfo, BaseRasterizerStateInfo*, GothicPipelineKeyHasher> s_RasterizerStateMap;
+    /** Tables for caching the state-objects, by the key of their state */
+    __declspec(selectany) StateKeyTable<BaseDepthBufferState> s_DepthBufferMap;
+    __declspec(selectany) StateKeyTable<BaseBlendStateInfo> s_BlendStateMap;
+    __declspec(selectany) StateKeyTable<BaseRasterizerStateInfo> s_RasterizerStateMap;
 };
 
 /** Depth buffer state information */
@@ -159,8 +129,10 @@ class BaseDepthBufferState;
 
 struct GothicDepthBufferStateInfo : public GothicPipelineState {
     GothicDepthBufferStateInfo() {
-        StructSize = sizeof( GothicDepthBufferStateInfo );
         Padding[0] = Padding[1] = false;
+        StateDirty = false;
+        Key = 0;
+        CacheId = PipelineStateKey::INVALID_ID;
     }
 
     /** Layed out for D3D11 */
@@ -184,6 +156,13 @@ struct GothicDepthBufferStateInfo : public GothicPipelineState {
         DepthBufferCompareFunc = DEFAULT_DEPTH_COMP_STATE;
     }
 
+    /** Sets this state dirty, which means that it will be updated before next rendering */
+    void SetDirty() {
+        StateDirty = true;
+        Key = PipelineStateKey::PackDepth( DepthBufferEnabled, DepthWriteEnabled, DepthBufferCompareFunc );
+        CacheId = PipelineStateKey::INVALID_ID;
+    }
+
     /** Depthbuffer settings */
     bool DepthBufferEnabled;
     bool DepthWriteEnabled;
@@ -192,10 +171,8 @@ struct GothicDepthBufferStateInfo : public GothicPipelineState {
 
     /** Deletes all cached states */
     static void DeleteCachedObjects() {
-        for ( auto it = GothicStateCache::s_DepthBufferMap.begin(); it != GothicStateCache::s_DepthBufferMap.end(); ++it ) {
-            delete it->second;
-        }
-        GothicStateCache::s_DepthBufferMap.clear();
+        GothicStateCache::s_DepthBufferMap.ForEach( []( uint64_t, BaseDepthBufferState* state ) { delete state; } );
+        GothicStateCache::s_DepthBufferMap.Clear();
     }
 
     GothicDepthBufferStateInfo Clone() {
@@ -205,8 +182,8 @@ struct GothicDepthBufferStateInfo : public GothicPipelineState {
         c.DepthBufferCompareFunc = DepthBufferCompareFunc;
 
         c.StateDirty = StateDirty;
-        c.Hash = Hash;
-        c.StructSize = StructSize;
+        c.Key = Key;
+        c.CacheId = CacheId;
         return c;
     }
 
@@ -215,7 +192,6 @@ struct GothicDepthBufferStateInfo : public GothicPipelineState {
         c.DepthWriteEnabled = DepthWriteEnabled;
         c.DepthBufferCompareFunc = DepthBufferCompareFunc;
 
-        c.StructSize = StructSize;
         c.SetDirty();
     }
 };
@@ -225,8 +201,10 @@ class BaseBlendStateInfo;
 
 struct GothicBlendStateInfo : public GothicPipelineState {
     GothicBlendStateInfo() {
-        StructSize = sizeof( GothicBlendStateInfo );
         Padding = false;
+        StateDirty = false;
+        Key = 0;
+        CacheId = PipelineStateKey::INVALID_ID;
     }
 
     /** Layed out for D3D11 */
@@ -272,6 +250,14 @@ struct GothicBlendStateInfo : public GothicPipelineState {
         ColorWritesEnabled = true;
     }
 
+    /** Sets this state dirty, which means that it will be updated before next rendering */
+    void SetDirty() {
+        StateDirty = true;
+        Key = PipelineStateKey::PackBlend( SrcBlend, DestBlend, BlendOp, SrcBlendAlpha, DestBlendAlpha, BlendOpAlpha,
+            BlendEnabled, AlphaToCoverage, ColorWritesEnabled );
+        CacheId = PipelineStateKey::INVALID_ID;
+    }
+
     /** Sets up alphablending */
     void SetAlphaBlending() {
         SrcBlend = BF_SRC_ALPHA;
@@ -337,11 +323,8 @@ struct GothicBlendStateInfo : public GothicPipelineState {
 
     /** Deletes all cached states */
     static void DeleteCachedObjects() {
-        for ( auto it = GothicStateCache::s_BlendStateMap.begin(); it != GothicStateCache::s_BlendStateMap.end(); ++it ) {
-            delete it->second;
-        }
-
-        GothicStateCache::s_BlendStateMap.clear();
+        GothicStateCache::s_BlendStateMap.ForEach( []( uint64_t, BaseBlendStateInfo* state ) { delete state; } );
+        GothicStateCache::s_BlendStateMap.Clear();
     }
 
     GothicBlendStateInfo Clone() {
@@ -357,8 +340,8 @@ struct GothicBlendStateInfo : public GothicPipelineState {
         c.ColorWritesEnabled = ColorWritesEnabled;
 
         c.StateDirty = StateDirty;
-        c.Hash = Hash;
-        c.StructSize = StructSize;
+        c.Key = Key;
+        c.CacheId = CacheId;
         return c;
     }
 
@@ -373,7 +356,6 @@ struct GothicBlendStateInfo : public GothicPipelineState {
         c.AlphaToCoverage = AlphaToCoverage;
         c.ColorWritesEnabled = ColorWritesEnabled;
 
-        c.StructSize = StructSize;
         c.SetDirty();
     }
 };
@@ -383,8 +365,10 @@ class BaseRasterizerStateInfo;
 
 struct GothicRasterizerStateInfo : public GothicPipelineState {
     GothicRasterizerStateInfo() {
-        StructSize = sizeof( GothicRasterizerStateInfo );
         Padding = false;
+        StateDirty = false;
+        Key = 0;
+        CacheId = PipelineStateKey::INVALID_ID;
     }
 
     /** Layed out for D3D11 */
@@ -403,6 +387,13 @@ struct GothicRasterizerStateInfo : public GothicPipelineState {
         DepthClipEnable = false;
     }
 
+    /** Sets this state dirty, which means that it will be updated before next rendering */
+    void SetDirty() {
+        StateDirty = true;
+        Key = PipelineStateKey::PackRasterizer( CullMode, FrontCounterClockwise, DepthClipEnable, Wireframe, ZBias );
+        CacheId = PipelineStateKey::INVALID_ID;
+    }
+
     ECullMode CullMode;
     bool FrontCounterClockwise;
     bool DepthClipEnable;
@@ -412,18 +403,17 @@ struct GothicRasterizerStateInfo : public GothicPipelineState {
 
     /** Deletes all cached states */
     static void DeleteCachedObjects() {
-        for ( auto it = GothicStateCache::s_RasterizerStateMap.begin(); it != GothicStateCache::s_RasterizerStateMap.end(); ++it ) {
-            delete it->second;
-        }
-
-        GothicStateCache::s_RasterizerStateMap.clear();
+        GothicStateCache::s_RasterizerStateMap.ForEach( []( uint64_t, BaseRasterizerStateInfo* state ) { delete state; } );
+        GothicStateCache::s_RasterizerStateMap.Clear();
     }
 };
 
 /** Sampler state information */
 struct GothicSamplerStateInfo : public GothicPipelineState {
     GothicSamplerStateInfo() {
-        StructSize = sizeof( GothicSamplerStateInfo );
+        StateDirty = false;
+        Key = 0;
+        CacheId = PipelineStateKey::INVALID_ID;
     }
 
     /** Layed out for D3D11 */
@@ -441,6 +431,12 @@ struct GothicSamplerStateInfo : public GothicPipelineState {
         AddressV = TA_WRAP;
     }
 
+    /** Sets this state dirty, which means that it will be updated before next rendering */
+    void SetDirty() {
+        StateDirty = true;
+        Key = PipelineStateKey::PackSampler( AddressU, AddressV );
+    }
+
     ETextureAddress AddressU;
     ETextureAddress AddressV;
 };
@@ -541,6 +537,9 @@ struct GothicRendererSettings {
         VisualFXDrawRadius = 8000.0f;
         OutdoorSmallVobDrawRadius = 10000.0f;
         SmallVobSize = 1500.0f;
+        EnableVobLOD = true;
+        VobLODPixelError = 1.5f;
+        EnableStaticInstanceCache = true;
 
 #ifdef BUILD_GOTHIC_1_08k
         SetupOldWorldSpecificValues();
@@ -602,6 +601,7 @@ struct GothicRendererSettings {
         EnablePointlightShadows = PLS_UPDATE_DYNAMIC;
         MinLightShadowUpdateRange = 300.0f;
         PartialDynamicShadowUpdates = true;
+        CachePointlightStaticShadows = true;
 
         EnableGodRays = true;
 
@@ -650,12 +650,16 @@ struct GothicRendererSettings {
         ChangeWindowPreset = 0;
         StretchWindow = true;
         SmoothShadowCameraUpdate = true;
+        EnableShadowCascades = true;
         DisplayFlip = false;
         LowLatency = false;
         HDR_Monitor = false;
         EnableInactiveFpsLock = true;
         MTResoureceManager = false;
         CompressBackBuffer = false;
+        CompressGothicTextures = true;
+        EnableSkeletalInstancing = true;
+        EnablePortalCulling = true;
         AnimateStaticVobs = true;
         RunInSpacerNet = false;
     }
@@ -724,6 +728,9 @@ struct GothicRendererSettings {
     float MinLightShadowUpdateRange;
     bool PartialDynamicShadowUpdates;
 
+    /** Keep a static-only shadowcube per pointlight and only redraw the moving casters on top of a copy of it */
+    bool CachePointlightStaticShadows;
+
     int MaxNumFaces;
 
     float SharpenFactor;
@@ -735,6 +742,13 @@ struct GothicRendererSettings {
     float OutdoorSmallVobDrawRadius;
     float VisualFXDrawRadius;
     float SmallVobSize;
+
+    /** Draw simplified static vobs when their error stays below VobLODPixelError on screen */
+    bool EnableVobLOD;
+    float VobLODPixelError;
+
+    /** Draw the static outdoor vobs out of persistent per-section instance buffers instead of collecting them each frame */
+    bool EnableStaticInstanceCache;
     float WorldShadowRangeScale;
     float GammaValue;
     float BrightnessValue;
@@ -803,9 +817,21 @@ struct GothicRendererSettings {
     bool StretchWindow;
     int ChangeWindowPreset;
     bool SmoothShadowCameraUpdate;
+
+    /** Split the sun-shadow into a near cascade drawn every frame and a cached far one */
+    bool EnableShadowCascades;
     bool EnableInactiveFpsLock;
     bool MTResoureceManager;
     bool CompressBackBuffer;
+
+    /** Block-compress the uncompressed textures gothic loads, on the CPU. Only affects textures created afterwards. */
+    bool CompressGothicTextures;
+
+    /** Draw the skeletal meshes of the main- and sun-shadow-pass instanced, with all bones in one buffer */
+    bool EnableSkeletalInstancing;
+
+    /** Only draw what can be seen through the portals of the room the camera is in */
+    bool EnablePortalCulling;
     bool AnimateStaticVobs;
     bool RunInSpacerNet;
 };
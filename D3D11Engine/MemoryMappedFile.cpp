@@ -0,0 +1,107 @@
+#include "MemoryMappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MemoryMappedFile::MemoryMappedFile() {
+    Data = nullptr;
+    Size = 0;
+
+#ifdef _WIN32
+    FileHandle = INVALID_HANDLE_VALUE;
+    MappingHandle = nullptr;
+#else
+    FileDescriptor = -1;
+#endif
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+    Close();
+}
+
+/** Maps the given file. Closes any previously mapped file. */
+bool MemoryMappedFile::Open( const std::string& file ) {
+    Close();
+
+#ifdef _WIN32
+    FileHandle = CreateFileA( file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr );
+    if ( FileHandle == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if ( !GetFileSizeEx( FileHandle, &fileSize ) || fileSize.QuadPart == 0 || static_cast<uint64_t>(fileSize.QuadPart) > SIZE_MAX ) {
+        Close();
+        return false;
+    }
+
+    MappingHandle = CreateFileMappingA( FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( !MappingHandle ) {
+        Close();
+        return false;
+    }
+
+    // On 32-bit this can fail for very big files when the address space is fragmented
+    Data = reinterpret_cast<const uint8_t*>(MapViewOfFile( MappingHandle, FILE_MAP_READ, 0, 0, 0 ));
+    if ( !Data ) {
+        Close();
+        return false;
+    }
+
+    Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    FileDescriptor = open( file.c_str(), O_RDONLY );
+    if ( FileDescriptor < 0 )
+        return false;
+
+    struct stat st;
+    if ( fstat( FileDescriptor, &st ) != 0 || st.st_size <= 0 ) {
+        Close();
+        return false;
+    }
+
+    void* mapped = mmap( nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, FileDescriptor, 0 );
+    if ( mapped == MAP_FAILED ) {
+        Close();
+        return false;
+    }
+
+    Data = reinterpret_cast<const uint8_t*>(mapped);
+    Size = static_cast<size_t>(st.st_size);
+#endif
+
+    return true;
+}
+
+/** Unmaps the file */
+void MemoryMappedFile::Close() {
+#ifdef _WIN32
+    if ( Data )
+        UnmapViewOfFile( Data );
+
+    if ( MappingHandle )
+        CloseHandle( MappingHandle );
+
+    if ( FileHandle != INVALID_HANDLE_VALUE )
+        CloseHandle( FileHandle );
+
+    MappingHandle = nullptr;
+    FileHandle = INVALID_HANDLE_VALUE;
+#else
+    if ( Data )
+        munmap( const_cast<uint8_t*>(Data), Size );
+
+    if ( FileDescriptor >= 0 )
+        close( FileDescriptor );
+
+    FileDescriptor = -1;
+#endif
+
+    Data = nullptr;
+    Size = 0;
+}
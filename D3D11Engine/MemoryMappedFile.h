@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/** Read-only view of a whole file in memory. The OS pages the data in on first access,
+    so opening even big archives is cheap. */
+class MemoryMappedFile {
+public:
+    MemoryMappedFile();
+    ~MemoryMappedFile();
+
+    MemoryMappedFile( const MemoryMappedFile& ) = delete;
+    MemoryMappedFile& operator=( const MemoryMappedFile& ) = delete;
+
+    /** Maps the given file. Closes any previously mapped file. */
+    bool Open( const std::string& file );
+
+    /** Unmaps the file */
+    void Close();
+
+    bool IsOpen() const { return Data != nullptr; }
+
+    /** Returns the start of the mapped memory */
+    const uint8_t* GetData() const { return Data; }
+
+    /** Returns the size of the mapped file */
+    size_t GetSize() const { return Size; }
+
+private:
+    const uint8_t* Data;
+    size_t Size;
+
+#ifdef _WIN32
+    void* FileHandle;
+    void* MappingHandle;
+#else
+    int FileDescriptor;
+#endif
+};
@@ -0,0 +1,546 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <immintrin.h>
+
+namespace {
+    uint64_t AlignUp( uint64_t value, uint64_t alignment ) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    uint32_t StrideOf( uint32_t format ) {
+        switch ( format ) {
+        case MCVF_FULL: return sizeof( MeshCacheVertex );
+        case MCVF_QUANTIZED: return sizeof( MeshCacheQuantizedVertex );
+        default: return 0;
+        }
+    }
+
+    /** Checks that the given range lies inside the file */
+    bool InFile( uint64_t offset, uint64_t size, uint64_t fileSize ) {
+        return offset <= fileSize && size <= fileSize - offset;
+    }
+
+    float SignNotZero( float v ) {
+        return v >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    /** Tries to quantize the vertices, returns false if they would lose too much */
+    bool TryQuantize( const std::vector<MeshCacheVertex>& vertices, const float boundsMin[3], const float boundsMax[3],
+        const MeshCacheWriteOptions& options, std::vector<MeshCacheQuantizedVertex>& out ) {
+        out.resize( vertices.size() );
+        for ( size_t i = 0; i < vertices.size(); i++ ) {
+            const MeshCacheVertex& v = vertices[i];
+
+            // Normals are stored as directions only
+            float len = sqrtf( v.Normal[0] * v.Normal[0] + v.Normal[1] * v.Normal[1] + v.Normal[2] * v.Normal[2] );
+            if ( !(fabsf( len - 1.0f ) <= 1e-3f) )
+                return false;
+
+            MeshCacheQuantization::QuantizeVertex( v, boundsMin, boundsMax, out[i] );
+
+            MeshCacheVertex d;
+            MeshCacheQuantization::DequantizeVertex( out[i], boundsMin, boundsMax, d );
+            for ( int a = 0; a < 3; a++ ) {
+                if ( !(fabsf( d.Position[a] - v.Position[a] ) <= options.MaxPositionError) )
+                    return false;
+                if ( !(fabsf( d.Normal[a] - v.Normal[a] ) <= 2e-3f) )
+                    return false;
+            }
+
+            for ( int a = 0; a < 2; a++ ) {
+                if ( !(fabsf( d.TexCoord[a] - v.TexCoord[a] ) <= options.MaxTexCoordError)
+                    || !(fabsf( d.TexCoord2[a] - v.TexCoord2[a] ) <= options.MaxTexCoordError) )
+                    return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+uint16_t MeshCacheQuantization::FloatToHalf( float f ) {
+    uint32_t x;
+    memcpy( &x, &f, sizeof( x ) );
+
+    uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+    uint32_t abs = x & 0x7FFFFFFF;
+
+    if ( abs >= 0x7F800000 ) // Inf and NaN
+        return sign | 0x7C00 | (abs > 0x7F800000 ? 0x0200 : 0);
+
+    if ( abs >= 0x477FF000 ) // Rounds to more than 65504
+        return sign | 0x7C00;
+
+    if ( abs < 0x38800000 ) {
+        // Subnormal, in steps of 2^-24. Scaling by a power of two is exact, so only the rounding is left.
+        float af;
+        memcpy( &af, &abs, sizeof( af ) );
+        return sign | static_cast<uint16_t>(nearbyintf( af * 16777216.0f ));
+    }
+
+    // Round to nearest even, a carry goes into the exponent on its own
+    uint32_t h = ((abs >> 23) - 127 + 15) << 10 | ((abs & 0x7FFFFF) >> 13);
+    uint32_t rest = abs & 0x1FFF;
+    if ( rest > 0x1000 || (rest == 0x1000 && (h & 1)) )
+        h++;
+
+    return sign | static_cast<uint16_t>(h);
+}
+
+float MeshCacheQuantization::HalfToFloat( uint16_t h ) {
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+
+    if ( exponent == 0 ) {
+        float f = mantissa / 16777216.0f;
+        return sign ? -f : f;
+    }
+
+    uint32_t x;
+    if ( exponent == 31 ) {
+        x = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy( &f, &x, sizeof( f ) );
+    return f;
+}
+
+void MeshCacheQuantization::EncodeOctahedral( const float normal[3], int16_t out[2] ) {
+    float sum = fabsf( normal[0] ) + fabsf( normal[1] ) + fabsf( normal[2] );
+    if ( sum <= 0.0f ) {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    // Project onto the octahedron, fold the lower half over
+    float x = normal[0] / sum;
+    float y = normal[1] / sum;
+    if ( normal[2] < 0.0f ) {
+        float fx = (1.0f - fabsf( y )) * SignNotZero( x );
+        float fy = (1.0f - fabsf( x )) * SignNotZero( y );
+        x = fx;
+        y = fy;
+    }
+
+    out[0] = static_cast<int16_t>(lrintf( std::min( std::max( x, -1.0f ), 1.0f ) * 32767.0f ));
+    out[1] = static_cast<int16_t>(lrintf( std::min( std::max( y, -1.0f ), 1.0f ) * 32767.0f ));
+}
+
+void MeshCacheQuantization::DecodeOctahedral( const int16_t in[2], float normal[3] ) {
+    float x = std::max( in[0] / 32767.0f, -1.0f );
+    float y = std::max( in[1] / 32767.0f, -1.0f );
+    float z = 1.0f - fabsf( x ) - fabsf( y );
+    if ( z < 0.0f ) {
+        float fx = (1.0f - fabsf( y )) * SignNotZero( x );
+        float fy = (1.0f - fabsf( x )) * SignNotZero( y );
+        x = fx;
+        y = fy;
+    }
+
+    float len = sqrtf( x * x + y * y + z * z );
+    normal[0] = x / len;
+    normal[1] = y / len;
+    normal[2] = z / len;
+}
+
+void MeshCacheQuantization::QuantizeVertex( const MeshCacheVertex& v, const float boundsMin[3], const float boundsMax[3], MeshCacheQuantizedVertex& out ) {
+    for ( int a = 0; a < 3; a++ ) {
+        float extent = boundsMax[a] - boundsMin[a];
+        float t = extent > 0.0f ? (v.Position[a] - boundsMin[a]) / extent : 0.0f;
+        out.Position[a] = static_cast<uint16_t>(lrintf( std::min( std::max( t, 0.0f ), 1.0f ) * 65535.0f ));
+    }
+    out.Padding = 0;
+
+    EncodeOctahedral( v.Normal, out.Normal );
+
+    for ( int a = 0; a < 2; a++ ) {
+        out.TexCoord[a] = FloatToHalf( v.TexCoord[a] );
+        out.TexCoord2[a] = FloatToHalf( v.TexCoord2[a] );
+    }
+
+    out.Color = v.Color;
+}
+
+void MeshCacheQuantization::DequantizeVertex( const MeshCacheQuantizedVertex& v, const float boundsMin[3], const float boundsMax[3], MeshCacheVertex& out ) {
+    for ( int a = 0; a < 3; a++ ) {
+        out.Position[a] = boundsMin[a] + (boundsMax[a] - boundsMin[a]) * (v.Position[a] / 65535.0f);
+    }
+
+    DecodeOctahedral( v.Normal, out.Normal );
+
+    for ( int a = 0; a < 2; a++ ) {
+        out.TexCoord[a] = HalfToFloat( v.TexCoord[a] );
+        out.TexCoord2[a] = HalfToFloat( v.TexCoord2[a] );
+    }
+
+    out.Color = v.Color;
+}
+
+namespace {
+    /** Exact half to float conversion of the low 16 bits of every lane */
+    inline __m128 HalfToFloat4( __m128i h ) {
+        const __m128i exponentMask = _mm_set1_epi32( 0x7C00 );
+        __m128i sign = _mm_slli_epi32( _mm_and_si128( h, _mm_set1_epi32( 0x8000 ) ), 16 );
+        __m128i em = _mm_and_si128( h, _mm_set1_epi32( 0x7FFF ) );
+
+        // Moving the bits up and scaling by 2^112 fixes the exponent bias, subnormals included
+        __m128 f = _mm_mul_ps( _mm_castsi128_ps( _mm_slli_epi32( em, 13 ) ), _mm_castsi128_ps( _mm_set1_epi32( 0x77800000 ) ) );
+
+        // Inf and NaN keep their mantissa, but need the full exponent
+        __m128i special = _mm_cmpeq_epi32( _mm_and_si128( em, exponentMask ), exponentMask );
+        f = _mm_or_ps( f, _mm_castsi128_ps( _mm_and_si128( special, _mm_set1_epi32( 0x7F800000 ) ) ) );
+        return _mm_or_ps( f, _mm_castsi128_ps( sign ) );
+    }
+
+    inline __m128 Abs4( __m128 v ) {
+        return _mm_and_ps( v, _mm_castsi128_ps( _mm_set1_epi32( 0x7FFFFFFF ) ) );
+    }
+
+    inline __m128 Select4( __m128 mask, __m128 a, __m128 b ) {
+        return _mm_or_ps( _mm_and_ps( mask, a ), _mm_andnot_ps( mask, b ) );
+    }
+
+    /** Low and high 16 bits of every lane */
+    inline __m128i Low16( __m128i v ) {
+        return _mm_and_si128( v, _mm_set1_epi32( 0xFFFF ) );
+    }
+
+    inline __m128i High16( __m128i v ) {
+        return _mm_srli_epi32( v, 16 );
+    }
+}
+
+/** DequantizeVertex for a whole array, four vertices at a time */
+void MeshCacheQuantization::DequantizeVertices( const MeshCacheQuantizedVertex* in, uint32_t count, const float boundsMin[3], const float boundsMax[3], MeshCacheVertex* out ) {
+    static_assert(sizeof( MeshCacheQuantizedVertex ) == 24, "Decoding expects 6 words per vertex");
+    static_assert(sizeof( MeshCacheVertex ) == 44, "Decoding expects 11 words per vertex");
+
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 minusOne = _mm_set1_ps( -1.0f );
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxPosition = _mm_set1_ps( 65535.0f );
+    const __m128 maxNormal = _mm_set1_ps( 32767.0f );
+
+    __m128 boundsMinV[3];
+    __m128 extent[3];
+    for ( int a = 0; a < 3; a++ ) {
+        boundsMinV[a] = _mm_set1_ps( boundsMin[a] );
+        extent[a] = _mm_set1_ps( boundsMax[a] - boundsMin[a] );
+    }
+
+    uint32_t i = 0;
+    for ( ; i + 4 <= count; i += 4 ) {
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(in + i);
+
+        // Words 0-3 of the four vertices, transposed so every register holds one word of all of them
+        __m128 w0 = _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 0) ) );
+        __m128 w1 = _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 24) ) );
+        __m128 w2 = _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 48) ) );
+        __m128 w3 = _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast<const __m128i*>(src + 72) ) );
+        _MM_TRANSPOSE4_PS( w0, w1, w2, w3 );
+
+        // Words 4 and 5
+        __m128i t01 = _mm_unpacklo_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(src + 16) ),
+            _mm_loadl_epi64( reinterpret_cast<const __m128i*>(src + 40) ) );
+        __m128i t23 = _mm_unpacklo_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(src + 64) ),
+            _mm_loadl_epi64( reinterpret_cast<const __m128i*>(src + 88) ) );
+        __m128i texCoords2 = _mm_unpacklo_epi64( t01, t23 );
+        __m128 color = _mm_castsi128_ps( _mm_unpackhi_epi64( t01, t23 ) );
+
+        __m128i position01 = _mm_castps_si128( w0 );
+        __m128i position2 = _mm_castps_si128( w1 );
+        __m128i normal = _mm_castps_si128( w2 );
+        __m128i texCoords = _mm_castps_si128( w3 );
+
+        // Same operations in the same order as DequantizeVertex
+        __m128 q[3] = { _mm_cvtepi32_ps( Low16( position01 ) ), _mm_cvtepi32_ps( High16( position01 ) ), _mm_cvtepi32_ps( Low16( position2 ) ) };
+        __m128 p[3];
+        for ( int a = 0; a < 3; a++ ) {
+            p[a] = _mm_add_ps( boundsMinV[a], _mm_mul_ps( extent[a], _mm_div_ps( q[a], maxPosition ) ) );
+        }
+
+        __m128 x = _mm_max_ps( _mm_div_ps( _mm_cvtepi32_ps( _mm_srai_epi32( _mm_slli_epi32( normal, 16 ), 16 ) ), maxNormal ), minusOne );
+        __m128 y = _mm_max_ps( _mm_div_ps( _mm_cvtepi32_ps( _mm_srai_epi32( normal, 16 ) ), maxNormal ), minusOne );
+        __m128 z = _mm_sub_ps( _mm_sub_ps( one, Abs4( x ) ), Abs4( y ) );
+        __m128 folded = _mm_cmplt_ps( z, zero );
+        __m128 fx = _mm_mul_ps( _mm_sub_ps( one, Abs4( y ) ), Select4( _mm_cmpge_ps( x, zero ), one, minusOne ) );
+        __m128 fy = _mm_mul_ps( _mm_sub_ps( one, Abs4( x ) ), Select4( _mm_cmpge_ps( y, zero ), one, minusOne ) );
+        x = Select4( folded, fx, x );
+        y = Select4( folded, fy, y );
+        __m128 len = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_mul_ps( z, z ) ) );
+        __m128 n[3] = { _mm_div_ps( x, len ), _mm_div_ps( y, len ), _mm_div_ps( z, len ) };
+
+        __m128 u = HalfToFloat4( Low16( texCoords ) );
+        __m128 v = HalfToFloat4( High16( texCoords ) );
+        __m128 u2 = HalfToFloat4( Low16( texCoords2 ) );
+        __m128 v2 = HalfToFloat4( High16( texCoords2 ) );
+
+        // Back to one vertex per register: 4 + 4 + 3 words
+        __m128 a0 = p[0], a1 = p[1], a2 = p[2], a3 = n[0];
+        __m128 b0 = n[1], b1 = n[2], b2 = u, b3 = v;
+        __m128 c0 = u2, c1 = v2, c2 = color, c3 = zero;
+        _MM_TRANSPOSE4_PS( a0, a1, a2, a3 );
+        _MM_TRANSPOSE4_PS( b0, b1, b2, b3 );
+        _MM_TRANSPOSE4_PS( c0, c1, c2, c3 );
+
+        float* dst = reinterpret_cast<float*>(out + i);
+        const __m128 heads[4] = { a0, a1, a2, a3 };
+        const __m128 middles[4] = { b0, b1, b2, b3 };
+        const __m128 tails[4] = { c0, c1, c2, c3 };
+        for ( int k = 0; k < 4; k++ ) {
+            float* vertex = dst + k * 11;
+            _mm_storeu_ps( vertex, heads[k] );
+            _mm_storeu_ps( vertex + 4, middles[k] );
+            _mm_storel_pi( reinterpret_cast<__m64*>(vertex + 8), tails[k] );
+            _mm_store_ss( vertex + 10, _mm_shuffle_ps( tails[k], tails[k], _MM_SHUFFLE( 2, 2, 2, 2 ) ) );
+        }
+    }
+
+    for ( ; i < count; i++ ) {
+        DequantizeVertex( in[i], boundsMin, boundsMax, out[i] );
+    }
+}
+
+MeshCacheFile::MeshCacheFile() {
+    Data = nullptr;
+    Size = 0;
+    Header = nullptr;
+    Submeshes = nullptr;
+    StringTable = nullptr;
+}
+
+/** Maps the file and validates header and submeshes */
+bool MeshCacheFile::Open( const std::string& file ) {
+    Close();
+
+    if ( !File.Open( file ) )
+        return false;
+
+    Data = File.GetData();
+    Size = File.GetSize();
+    return Parse();
+}
+
+/** Uses a file that is already in memory */
+bool MeshCacheFile::Open( const uint8_t* data, size_t size, const std::shared_ptr<const std::vector<uint8_t>>& buffer ) {
+    Close();
+
+    // Full vertices are used in place, but stored zip-entries can start anywhere
+    if ( reinterpret_cast<uintptr_t>(data) % alignof(MeshCacheHeader) != 0 ) {
+        auto copy = std::make_shared<std::vector<uint8_t>>( data, data + size );
+        Buffer = copy;
+        Data = copy->data();
+    } else {
+        Buffer = buffer;
+        Data = data;
+    }
+
+    Size = size;
+    return Parse();
+}
+
+/** Validates header and submeshes of the file at Data */
+bool MeshCacheFile::Parse() {
+    const uint8_t* data = Data;
+    uint64_t size = Size;
+
+    if ( size < sizeof( MeshCacheHeader ) ) {
+        Close();
+        return false;
+    }
+
+    const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(data);
+    if ( header->Magic != MESH_CACHE_MAGIC || header->Version != MESH_CACHE_VERSION
+        || header->IndexSize != sizeof( uint16_t ) || header->FileSize != size ) {
+        Close();
+        return false;
+    }
+
+    uint64_t tableSize = static_cast<uint64_t>(header->NumSubmeshes) * sizeof( MeshCacheSubmesh );
+    if ( header->SubmeshTableOffset % alignof(MeshCacheSubmesh) != 0
+        || !InFile( header->SubmeshTableOffset, tableSize, size )
+        || !InFile( header->StringTableOffset, header->StringTableSize, size ) ) {
+        Close();
+        return false;
+    }
+
+    const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(data + header->SubmeshTableOffset);
+    for ( uint32_t i = 0; i < header->NumSubmeshes; i++ ) {
+        const MeshCacheSubmesh& s = submeshes[i];
+        uint32_t stride = StrideOf( s.VertexFormat );
+        if ( stride == 0 || s.VertexStride != stride
+            || s.VertexOffset % MESH_CACHE_ALIGNMENT != 0 || s.IndexOffset % MESH_CACHE_ALIGNMENT != 0
+            || !InFile( s.VertexOffset, static_cast<uint64_t>(s.NumVertices) * stride, size )
+            || !InFile( s.IndexOffset, static_cast<uint64_t>(s.NumIndices) * sizeof( uint16_t ), size )
+            || !InFile( s.NameOffset, s.NameLength, header->StringTableSize ) ) {
+            Close();
+            return false;
+        }
+    }
+
+    Header = header;
+    Submeshes = submeshes;
+    StringTable = reinterpret_cast<const char*>(data + header->StringTableOffset);
+    return true;
+}
+
+void MeshCacheFile::Close() {
+    File.Close();
+    Buffer.reset();
+    Data = nullptr;
+    Size = 0;
+    Header = nullptr;
+    Submeshes = nullptr;
+    StringTable = nullptr;
+}
+
+std::string MeshCacheFile::GetTextureName( uint32_t index ) const {
+    const MeshCacheSubmesh& s = Submeshes[index];
+    return std::string( StringTable + s.NameOffset, s.NameLength );
+}
+
+/** Vertices inside the mapped file, if the submesh is stored in full precision */
+const MeshCacheVertex* MeshCacheFile::GetFullVertices( uint32_t index ) const {
+    const MeshCacheSubmesh& s = Submeshes[index];
+    if ( s.VertexFormat != MCVF_FULL )
+        return nullptr;
+
+    return reinterpret_cast<const MeshCacheVertex*>(Data + s.VertexOffset);
+}
+
+/** Writes the vertices of the submesh to out */
+void MeshCacheFile::DecodeVertices( uint32_t index, MeshCacheVertex* out ) const {
+    const MeshCacheSubmesh& s = Submeshes[index];
+    if ( s.NumVertices == 0 )
+        return;
+
+    if ( s.VertexFormat == MCVF_FULL ) {
+        memcpy( out, Data + s.VertexOffset, s.NumVertices * sizeof( MeshCacheVertex ) );
+        return;
+    }
+
+    const MeshCacheQuantizedVertex* q = reinterpret_cast<const MeshCacheQuantizedVertex*>(Data + s.VertexOffset);
+    MeshCacheQuantization::DequantizeVertices( q, s.NumVertices, s.BoundsMin, s.BoundsMax, out );
+}
+
+/** Indices inside the mapped file */
+const uint16_t* MeshCacheFile::GetIndices( uint32_t index ) const {
+    return reinterpret_cast<const uint16_t*>(Data + Submeshes[index].IndexOffset);
+}
+
+MeshCacheWriter::MeshCacheWriter() {
+    NumQuantized = 0;
+}
+
+void MeshCacheWriter::AddSubmesh( const std::string& texture, const MeshCacheVertex* vertices, uint32_t numVertices,
+    const uint16_t* indices, uint32_t numIndices ) {
+    PendingSubmesh p;
+    p.Texture = texture;
+    p.Vertices.assign( vertices, vertices + numVertices );
+    p.Indices.assign( indices, indices + numIndices );
+    Pending.push_back( std::move( p ) );
+}
+
+/** Builds the whole file in memory */
+std::vector<uint8_t> MeshCacheWriter::Build( const MeshCacheWriteOptions& options ) {
+    NumQuantized = 0;
+
+    MeshCacheHeader header = {};
+    header.Magic = MESH_CACHE_MAGIC;
+    header.Version = MESH_CACHE_VERSION;
+    header.NumSubmeshes = static_cast<uint32_t>(Pending.size());
+    header.IndexSize = sizeof( uint16_t );
+    header.SubmeshTableOffset = sizeof( MeshCacheHeader );
+    header.StringTableOffset = header.SubmeshTableOffset + Pending.size() * sizeof( MeshCacheSubmesh );
+    header.SourceSize = options.SourceSize;
+    header.SourceTime = options.SourceTime;
+    header.Scale = options.Scale;
+
+    std::string strings;
+    std::vector<MeshCacheSubmesh> submeshes( Pending.size() );
+    std::vector<std::vector<MeshCacheQuantizedVertex>> quantized( Pending.size() );
+    for ( size_t i = 0; i < Pending.size(); i++ ) {
+        const PendingSubmesh& p = Pending[i];
+        MeshCacheSubmesh& s = submeshes[i];
+        memset( &s, 0, sizeof( s ) );
+
+        s.NameOffset = static_cast<uint32_t>(strings.size());
+        s.NameLength = static_cast<uint32_t>(p.Texture.size());
+        strings += p.Texture;
+
+        s.NumVertices = static_cast<uint32_t>(p.Vertices.size());
+        s.NumIndices = static_cast<uint32_t>(p.Indices.size());
+
+        for ( int a = 0; a < 3; a++ ) {
+            s.BoundsMin[a] = p.Vertices.empty() ? 0.0f : p.Vertices[0].Position[a];
+            s.BoundsMax[a] = s.BoundsMin[a];
+        }
+        for ( const MeshCacheVertex& v : p.Vertices ) {
+            for ( int a = 0; a < 3; a++ ) {
+                s.BoundsMin[a] = std::min( s.BoundsMin[a], v.Position[a] );
+                s.BoundsMax[a] = std::max( s.BoundsMax[a], v.Position[a] );
+            }
+        }
+
+        s.VertexFormat = MCVF_FULL;
+        if ( options.Quantize && !p.Vertices.empty() && TryQuantize( p.Vertices, s.BoundsMin, s.BoundsMax, options, quantized[i] ) ) {
+            s.VertexFormat = MCVF_QUANTIZED;
+            NumQuantized++;
+        } else {
+            quantized[i].clear();
+        }
+        s.VertexStride = StrideOf( s.VertexFormat );
+    }
+
+    header.StringTableSize = strings.size();
+
+    uint64_t offset = header.StringTableOffset + header.StringTableSize;
+    for ( MeshCacheSubmesh& s : submeshes ) {
+        s.VertexOffset = AlignUp( offset, MESH_CACHE_ALIGNMENT );
+        s.IndexOffset = AlignUp( s.VertexOffset + static_cast<uint64_t>(s.NumVertices) * s.VertexStride, MESH_CACHE_ALIGNMENT );
+        offset = s.IndexOffset + static_cast<uint64_t>(s.NumIndices) * sizeof( uint16_t );
+    }
+    header.FileSize = AlignUp( offset, MESH_CACHE_ALIGNMENT );
+
+    std::vector<uint8_t> data( static_cast<size_t>(header.FileSize), 0 );
+    memcpy( &data[0], &header, sizeof( header ) );
+    if ( !submeshes.empty() )
+        memcpy( &data[static_cast<size_t>(header.SubmeshTableOffset)], submeshes.data(), submeshes.size() * sizeof( MeshCacheSubmesh ) );
+    if ( !strings.empty() )
+        memcpy( &data[static_cast<size_t>(header.StringTableOffset)], strings.data(), strings.size() );
+
+    for ( size_t i = 0; i < Pending.size(); i++ ) {
+        const PendingSubmesh& p = Pending[i];
+        const MeshCacheSubmesh& s = submeshes[i];
+        if ( s.VertexFormat == MCVF_QUANTIZED ) {
+            memcpy( &data[static_cast<size_t>(s.VertexOffset)], quantized[i].data(), quantized[i].size() * sizeof( MeshCacheQuantizedVertex ) );
+        } else if ( !p.Vertices.empty() ) {
+            memcpy( &data[static_cast<size_t>(s.VertexOffset)], p.Vertices.data(), p.Vertices.size() * sizeof( MeshCacheVertex ) );
+        }
+
+        if ( !p.Indices.empty() )
+            memcpy( &data[static_cast<size_t>(s.IndexOffset)], p.Indices.data(), p.Indices.size() * sizeof( uint16_t ) );
+    }
+
+    return data;
+}
+
+bool MeshCacheWriter::Write( const std::string& file, const MeshCacheWriteOptions& options ) {
+    std::vector<uint8_t> data = Build( options );
+
+    FILE* f = fopen( file.c_str(), "wb" );
+    if ( !f )
+        return false;
+
+    bool ok = fwrite( data.data(), 1, data.size(), f ) == data.size();
+    ok = fclose( f ) == 0 && ok;
+    return ok;
+}
@@ -0,0 +1,210 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MemoryMappedFile.h"
+
+/** Cache-file for custom meshes (.mcache)
+
+    Holds the submeshes of a converted mesh, so it doesn't have to go through the importer again.
+    Layout:
+
+    [MeshCacheHeader]
+    [MeshCacheSubmesh * NumSubmeshes]
+    [String table]                      - Texture names, not null-terminated
+    [Streams]                           - Vertices and indices of every submesh, each aligned to MESH_CACHE_ALIGNMENT
+
+    Full vertex streams have the layout of ExVertexStruct, so they can go to the GPU right out of the
+    mapped file. Quantized streams store positions with 16 bit inside the bounds of the submesh,
+    normals octahedral-encoded and texture coordinates as half-floats. The writer only uses them
+    where the error stays below the given limits.
+
+    The first version of the format had no header, only a version-int of 1. Those files are
+    rejected here and have to be read the old way. */
+
+const uint32_t MESH_CACHE_MAGIC = 0x48534D47; // "GMSH"
+const uint32_t MESH_CACHE_VERSION = 2;
+const uint32_t MESH_CACHE_ALIGNMENT = 16;
+const char* const MESH_CACHE_EXTENSION = ".mcache";
+
+enum EMeshCacheVertexFormat {
+    MCVF_FULL = 0,
+    MCVF_QUANTIZED = 1
+};
+
+/** Same layout as ExVertexStruct */
+struct MeshCacheVertex {
+    float Position[3];
+    float Normal[3];
+    float TexCoord[2];
+    float TexCoord2[2];
+    uint32_t Color;
+};
+
+struct MeshCacheQuantizedVertex {
+    /** Fraction of the submesh bounds */
+    uint16_t Position[3];
+    uint16_t Padding;
+
+    /** Octahedral encoding */
+    int16_t Normal[2];
+
+    /** Half-floats */
+    uint16_t TexCoord[2];
+    uint16_t TexCoord2[2];
+
+    uint32_t Color;
+};
+
+#pragma pack(push, 4)
+struct MeshCacheHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumSubmeshes;
+
+    /** Size of one index in bytes */
+    uint32_t IndexSize;
+
+    uint64_t SubmeshTableOffset;
+    uint64_t StringTableOffset;
+    uint64_t StringTableSize;
+
+    /** Size of the whole file, to notice if writing it got interrupted */
+    uint64_t FileSize;
+
+    /** Size and modification time of the file this was made from, to notice when it changed */
+    uint64_t SourceSize;
+    uint64_t SourceTime;
+
+    /** Scale the positions were multiplied with */
+    float Scale;
+    uint32_t Reserved;
+};
+
+struct MeshCacheSubmesh {
+    /** Location of the texture name inside the string table */
+    uint32_t NameOffset;
+    uint32_t NameLength;
+
+    uint32_t NumVertices;
+    uint32_t NumIndices;
+
+    /** One of EMeshCacheVertexFormat */
+    uint32_t VertexFormat;
+    uint32_t VertexStride;
+
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+
+    float BoundsMin[3];
+    float BoundsMax[3];
+};
+#pragma pack(pop)
+
+class MeshCacheFile {
+public:
+    MeshCacheFile();
+
+    /** Maps the file and validates header and submeshes. Returns false if the file is missing, broken or of an older version. */
+    bool Open( const std::string& file );
+
+    /** Uses a file that is already in memory, like one read out of a zip-pack. The memory has to stay
+        valid while this is open, unless buffer owns it. */
+    bool Open( const uint8_t* data, size_t size, const std::shared_ptr<const std::vector<uint8_t>>& buffer );
+    void Close();
+
+    bool IsOpen() const { return Header != nullptr; }
+
+    const MeshCacheHeader& GetHeader() const { return *Header; }
+
+    uint32_t GetNumSubmeshes() const { return Header ? Header->NumSubmeshes : 0; }
+    const MeshCacheSubmesh& GetSubmesh( uint32_t index ) const { return Submeshes[index]; }
+
+    std::string GetTextureName( uint32_t index ) const;
+
+    /** Vertices inside the mapped file, if the submesh is stored in full precision. nullptr otherwise. */
+    const MeshCacheVertex* GetFullVertices( uint32_t index ) const;
+
+    /** Writes the vertices of the submesh to out, which has to hold NumVertices of them */
+    void DecodeVertices( uint32_t index, MeshCacheVertex* out ) const;
+
+    /** Indices inside the mapped file */
+    const uint16_t* GetIndices( uint32_t index ) const;
+
+private:
+    /** Validates header and submeshes of the file at Data */
+    bool Parse();
+
+    MemoryMappedFile File;
+    std::shared_ptr<const std::vector<uint8_t>> Buffer;
+    const uint8_t* Data;
+    uint64_t Size;
+    const MeshCacheHeader* Header;
+    const MeshCacheSubmesh* Submeshes;
+    const char* StringTable;
+};
+
+struct MeshCacheWriteOptions {
+    MeshCacheWriteOptions() {
+        Quantize = true;
+        MaxPositionError = 0.02f;
+        MaxTexCoordError = 1.0f / 2048.0f;
+        SourceSize = 0;
+        SourceTime = 0;
+        Scale = 1.0f;
+    }
+
+    /** Whether submeshes may be stored quantized at all */
+    bool Quantize;
+
+    /** Largest error a quantized submesh may have, otherwise it is stored in full precision */
+    float MaxPositionError;
+    float MaxTexCoordError;
+
+    /** Stored in the header */
+    uint64_t SourceSize;
+    uint64_t SourceTime;
+    float Scale;
+};
+
+/** Builds .mcache-files */
+class MeshCacheWriter {
+public:
+    MeshCacheWriter();
+
+    void AddSubmesh( const std::string& texture, const MeshCacheVertex* vertices, uint32_t numVertices,
+        const uint16_t* indices, uint32_t numIndices );
+
+    /** Builds the whole file in memory */
+    std::vector<uint8_t> Build( const MeshCacheWriteOptions& options );
+
+    bool Write( const std::string& file, const MeshCacheWriteOptions& options );
+
+    /** Number of submeshes the last Build stored quantized */
+    uint32_t GetNumQuantized() const { return NumQuantized; }
+
+private:
+    struct PendingSubmesh {
+        std::string Texture;
+        std::vector<MeshCacheVertex> Vertices;
+        std::vector<uint16_t> Indices;
+    };
+
+    std::vector<PendingSubmesh> Pending;
+    uint32_t NumQuantized;
+};
+
+namespace MeshCacheQuantization {
+    uint16_t FloatToHalf( float f );
+    float HalfToFloat( uint16_t h );
+
+    void EncodeOctahedral( const float normal[3], int16_t out[2] );
+    void DecodeOctahedral( const int16_t in[2], float normal[3] );
+
+    void QuantizeVertex( const MeshCacheVertex& v, const float boundsMin[3], const float boundsMax[3], MeshCacheQuantizedVertex& out );
+    void DequantizeVertex( const MeshCacheQuantizedVertex& v, const float boundsMin[3], const float boundsMax[3], MeshCacheVertex& out );
+
+    /** DequantizeVertex for a whole array, four vertices at a time with SSE2. Gives the same results. */
+    void DequantizeVertices( const MeshCacheQuantizedVertex* in, uint32_t count, const float boundsMin[3], const float boundsMax[3], MeshCacheVertex* out );
+}
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "MeshModifier.h"
+#include "MeshSimplifier.h"
 /*#include "include\OpenMesh\Tools\Subdivider\Uniform\CatmullClarkT.hh"
 #include "include\OpenMesh\Tools\Subdivider\Uniform\LoopT.hh"
 #include "include\OpenMesh\Tools\Decimater\DecimaterT.hh"
@@ -191,35 +192,18 @@ void MeshModifier::DropTexcoords( const std::vector<ExVertexStruct>& inVertices,
 
 /** Decimates the mesh, reducing its complexity */
 void MeshModifier::Decimate( const std::vector<ExVertexStruct>& inVertices, const std::vector<unsigned short>& inIndices, std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices ) {
-    /*MyMesh mesh;
+    // Halve the triangle count, vertices stay as they are
+    MeshSimplifierInput mesh = { inVertices.empty() ? nullptr : &inVertices[0].Position.x, sizeof( ExVertexStruct ), inVertices.size(), &inIndices };
+    MeshSimplifier::Decimate( mesh, outIndices );
 
-    PutVertexData(mesh, inVertices, inIndices);
-
-    Decimater decimater(mesh); // a decimater object, connected to a mesh
-
-    //HModQuadric hModQuadric; // use a quadric module
-    HModRoundnessT hModRoundness;
-
-    decimater.add(hModRoundness); // register module at the decimater
-
-    //
-    //since we need exactly one priority module (non-binary)
-    //we have to call set_binary(false) for our priority module
-    //in the case of HModQuadric, unset_max_err() calls set_binary(false) internally
-    //
-    //decimater.module(hModRoundness).set_binary(false);//.unset_max_err();
-    decimater.module(hModRoundness).set_min_roundness(0.05f);
-    //decimater.module(hModRoundness).set_min_angle(
-    decimater.module(hModRoundness).initialize();
-    decimater.initialize(); // let the decimater initialize the mesh and the
-    // modules
-    decimater.decimate(); // do decimation
-
-    mesh.update_normals();
-    mesh.triangulate();
+    outVertices = inVertices;
+}
 
-    // Get data out of the openmesh
-    PullVertexData(mesh, outVertices, outIndices);*/
+/** Builds simplified index lists for the mesh, each one with about half the triangles of the previous one.
+    Stops early once the geometric error would exceed maxError. Returns the number of generated levels. */
+unsigned int MeshModifier::GenerateLODChain( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, unsigned int numLevels, float maxError, std::vector<std::vector<VERTEX_INDEX>>& outLevels, std::vector<float>& outErrors ) {
+    MeshSimplifierInput mesh = { vertices.empty() ? nullptr : &vertices[0].Position.x, sizeof( ExVertexStruct ), vertices.size(), &indices };
+    return MeshSimplifier::GenerateLODChain( mesh, numLevels, maxError, outLevels, outErrors );
 }
 
 struct PNAENEdge {
@@ -19,6 +19,10 @@ public:
     /** Decimates the mesh, reducing its complexity */
     static void Decimate( const std::vector<ExVertexStruct>& inVertices, const std::vector<unsigned short>& inIndices, std::vector<ExVertexStruct>& outVertices, std::vector<VERTEX_INDEX>& outIndices );
 
+    /** Builds simplified index lists for the mesh, each one with about half the triangles of the previous one.
+        Stops early once the geometric error would exceed maxError. Returns the number of generated levels. */
+    static unsigned int GenerateLODChain( const std::vector<ExVertexStruct>& vertices, const std::vector<VERTEX_INDEX>& indices, unsigned int numLevels, float maxError, std::vector<std::vector<VERTEX_INDEX>>& outLevels, std::vector<float>& outErrors );
+
     /** Computes PNAEN-Indices for the given mesh */
     static void ComputePNAENIndices( const std::vector<ExVertexStruct>& inVertices, const std::vector<unsigned short>& inIndices, std::vector<VERTEX_INDEX>& outIndices );
     static void ComputePNAENIndices( const std::vector<ExVertexStruct>& inVertices, const std::vector<unsigned int>& inIndices, std::vector<unsigned int>& outIndices );
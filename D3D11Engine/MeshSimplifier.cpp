@@ -0,0 +1,399 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+    struct Vec3 {
+        float x, y, z;
+    };
+
+    Vec3 Sub( const Vec3& a, const Vec3& b ) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    Vec3 Cross( const Vec3& a, const Vec3& b ) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    float Dot( const Vec3& a, const Vec3& b ) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    struct Quadric {
+        double m[10];
+
+        void Clear() { memset( m, 0, sizeof( m ) ); }
+
+        void AddPlane( double a, double b, double c, double d ) {
+            m[0] += a * a; m[1] += a * b; m[2] += a * c; m[3] += a * d;
+            m[4] += b * b; m[5] += b * c; m[6] += b * d;
+            m[7] += c * c; m[8] += c * d;
+            m[9] += d * d;
+        }
+
+        void Add( const Quadric& q ) {
+            for ( int i = 0; i < 10; i++ )
+                m[i] += q.m[i];
+        }
+
+        /** Sum of squared distances of the point to all planes of this quadric */
+        double Evaluate( const Vec3& p ) const {
+            double x = p.x, y = p.y, z = p.z;
+            return m[0] * x * x + 2 * m[1] * x * y + 2 * m[2] * x * z + 2 * m[3] * x
+                + m[4] * y * y + 2 * m[5] * y * z + 2 * m[6] * y
+                + m[7] * z * z + 2 * m[8] * z
+                + m[9];
+        }
+    };
+
+    struct Collapse {
+        double Cost;
+        unsigned int From;
+        unsigned int To;
+        unsigned int FromVersion;
+        unsigned int ToVersion;
+
+        bool operator < ( const Collapse& o ) const { return Cost > o.Cost; } // Min-heap
+    };
+
+    class QuadricSimplifier {
+    public:
+        QuadricSimplifier( const MeshSimplifierInput& mesh ) {
+            const unsigned int numVertices = static_cast<unsigned int>(mesh.NumVertices);
+            Positions.resize( numVertices );
+            for ( unsigned int i = 0; i < numVertices; i++ ) {
+                const float* p = reinterpret_cast<const float*>(reinterpret_cast<const char*>(mesh.Positions) + i * mesh.Stride);
+                Positions[i] = { p[0], p[1], p[2] };
+            }
+
+            Locked.assign( numVertices, false );
+            Dead.assign( numVertices, false );
+            Versions.assign( numVertices, 0 );
+            Quadrics.resize( numVertices );
+            for ( Quadric& q : Quadrics )
+                q.Clear();
+
+            const std::vector<uint16_t>& indices = *mesh.Indices;
+            VertexTriangles.resize( numVertices );
+            Triangles.reserve( indices.size() / 3 );
+            NumAlive = 0;
+            MaxAppliedCost = 0.0;
+
+            for ( size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+                Triangle t = { { indices[i], indices[i + 1], indices[i + 2] }, true };
+                if ( t.v[0] >= numVertices || t.v[1] >= numVertices || t.v[2] >= numVertices
+                    || t.v[0] == t.v[1] || t.v[1] == t.v[2] || t.v[0] == t.v[2] )
+                    continue;
+
+                const unsigned int ti = static_cast<unsigned int>(Triangles.size());
+                Triangles.push_back( t );
+                NumAlive++;
+
+                for ( int c = 0; c < 3; c++ )
+                    VertexTriangles[t.v[c]].push_back( ti );
+            }
+
+            LockBordersAndSeams();
+            ComputeQuadrics();
+
+            for ( unsigned int v = 0; v < numVertices; v++ )
+                PushCollapsesAround( v );
+        }
+
+        unsigned int GetNumTriangles() const { return NumAlive; }
+
+        /** Collapses edges until the triangle count is reached or the next collapse would exceed maxCost.
+            Returns the highest cost that was applied so far. */
+        double Simplify( unsigned int targetTriangles, double maxCost ) {
+            while ( NumAlive > targetTriangles && !Heap.empty() ) {
+                Collapse c = Heap.top();
+                if ( c.Cost > maxCost )
+                    break;
+
+                Heap.pop();
+                if ( Dead[c.From] || Dead[c.To] || Versions[c.From] != c.FromVersion || Versions[c.To] != c.ToVersion )
+                    continue;
+
+                if ( !CanCollapse( c.From, c.To ) )
+                    continue;
+
+                DoCollapse( c.From, c.To );
+                MaxAppliedCost = std::max( MaxAppliedCost, c.Cost );
+            }
+
+            return MaxAppliedCost;
+        }
+
+        void GetIndices( std::vector<uint16_t>& indices ) const {
+            indices.clear();
+            indices.reserve( NumAlive * 3 );
+            for ( const Triangle& t : Triangles ) {
+                if ( !t.Alive )
+                    continue;
+
+                indices.push_back( static_cast<uint16_t>(t.v[0]) );
+                indices.push_back( static_cast<uint16_t>(t.v[1]) );
+                indices.push_back( static_cast<uint16_t>(t.v[2]) );
+            }
+        }
+
+    private:
+        struct Triangle {
+            unsigned int v[3];
+            bool Alive;
+
+            bool Contains( unsigned int x ) const { return v[0] == x || v[1] == x || v[2] == x; }
+        };
+
+        void LockBordersAndSeams() {
+            // Edges used by exactly one triangle are open borders, more than two means non-manifold
+            std::unordered_map<uint64_t, int> edgeUse;
+            for ( const Triangle& t : Triangles ) {
+                for ( int c = 0; c < 3; c++ ) {
+                    unsigned int a = t.v[c], b = t.v[(c + 1) % 3];
+                    edgeUse[a < b ? (uint64_t( a ) << 32) | b : (uint64_t( b ) << 32) | a]++;
+                }
+            }
+
+            for ( const auto& e : edgeUse ) {
+                if ( e.second != 2 ) {
+                    Locked[static_cast<unsigned int>(e.first >> 32)] = true;
+                    Locked[static_cast<unsigned int>(e.first & 0xFFFFFFFF)] = true;
+                }
+            }
+
+            // Vertices sharing their position with another vertex sit on a normal- or UV-seam
+            std::unordered_map<uint64_t, unsigned int> byPosition;
+            for ( unsigned int i = 0; i < Positions.size(); i++ ) {
+                uint32_t x, y, z;
+                memcpy( &x, &Positions[i].x, 4 );
+                memcpy( &y, &Positions[i].y, 4 );
+                memcpy( &z, &Positions[i].z, 4 );
+                uint64_t key = (uint64_t( x ) * 73856093) ^ (uint64_t( y ) * 19349663) ^ (uint64_t( z ) * 83492791);
+
+                auto it = byPosition.find( key );
+                if ( it == byPosition.end() ) {
+                    byPosition[key] = i;
+                } else {
+                    Locked[i] = true;
+                    Locked[it->second] = true;
+                }
+            }
+        }
+
+        void ComputeQuadrics() {
+            for ( const Triangle& t : Triangles ) {
+                const Vec3& p0 = Positions[t.v[0]];
+                Vec3 n = Cross( Sub( Positions[t.v[1]], p0 ), Sub( Positions[t.v[2]], p0 ) );
+                double len = sqrt( double( n.x ) * n.x + double( n.y ) * n.y + double( n.z ) * n.z );
+                if ( len <= 0.0 )
+                    continue;
+
+                double a = n.x / len, b = n.y / len, c = n.z / len;
+                double d = -(a * p0.x + b * p0.y + c * p0.z);
+                for ( int i = 0; i < 3; i++ )
+                    Quadrics[t.v[i]].AddPlane( a, b, c, d );
+            }
+        }
+
+        void PushCollapse( unsigned int from, unsigned int to ) {
+            if ( Locked[from] )
+                return;
+
+            Quadric q = Quadrics[from];
+            q.Add( Quadrics[to] );
+
+            Collapse c;
+            c.Cost = std::max( 0.0, q.Evaluate( Positions[to] ) );
+            c.From = from;
+            c.To = to;
+            c.FromVersion = Versions[from];
+            c.ToVersion = Versions[to];
+            Heap.push( c );
+        }
+
+        void GatherNeighbours( unsigned int v, std::vector<unsigned int>& out ) const {
+            out.clear();
+            for ( unsigned int ti : VertexTriangles[v] ) {
+                for ( unsigned int x : Triangles[ti].v ) {
+                    if ( x != v && std::find( out.begin(), out.end(), x ) == out.end() )
+                        out.push_back( x );
+                }
+            }
+        }
+
+        void PushCollapsesAround( unsigned int v ) {
+            GatherNeighbours( v, Neighbours );
+            for ( unsigned int n : Neighbours ) {
+                PushCollapse( v, n );
+                PushCollapse( n, v );
+            }
+        }
+
+        bool CanCollapse( unsigned int from, unsigned int to ) {
+            // Link condition: Both ends may only share the vertices opposite of their common triangles,
+            // otherwise the collapse would pinch the surface
+            unsigned int numShared = 0;
+            for ( unsigned int ti : VertexTriangles[from] ) {
+                if ( Triangles[ti].Contains( to ) )
+                    numShared++;
+            }
+
+            if ( numShared == 0 )
+                return false;
+
+            GatherNeighbours( from, Neighbours );
+            GatherNeighbours( to, OtherNeighbours );
+            unsigned int numCommon = 0;
+            for ( unsigned int n : Neighbours ) {
+                if ( std::find( OtherNeighbours.begin(), OtherNeighbours.end(), n ) != OtherNeighbours.end() )
+                    numCommon++;
+            }
+
+            if ( numCommon != numShared )
+                return false;
+
+            // Don't flip or squash the remaining triangles
+            for ( unsigned int ti : VertexTriangles[from] ) {
+                const Triangle& t = Triangles[ti];
+                if ( t.Contains( to ) )
+                    continue;
+
+                Vec3 p[3], q[3];
+                for ( int c = 0; c < 3; c++ ) {
+                    p[c] = Positions[t.v[c]];
+                    q[c] = t.v[c] == from ? Positions[to] : p[c];
+                }
+
+                Vec3 before = Cross( Sub( p[1], p[0] ), Sub( p[2], p[0] ) );
+                Vec3 after = Cross( Sub( q[1], q[0] ), Sub( q[2], q[0] ) );
+                float lenBefore = sqrtf( Dot( before, before ) );
+                float lenAfter = sqrtf( Dot( after, after ) );
+                if ( lenAfter <= lenBefore * 1e-3f || Dot( before, after ) < 0.2f * lenBefore * lenAfter )
+                    return false;
+            }
+
+            return true;
+        }
+
+        void DoCollapse( unsigned int from, unsigned int to ) {
+            for ( unsigned int ti : VertexTriangles[from] ) {
+                Triangle& t = Triangles[ti];
+                if ( t.Contains( to ) ) {
+                    // Degenerates, remove it from the other corners
+                    t.Alive = false;
+                    NumAlive--;
+                    for ( unsigned int x : t.v ) {
+                        if ( x == from )
+                            continue;
+
+                        std::vector<unsigned int>& list = VertexTriangles[x];
+                        list.erase( std::find( list.begin(), list.end(), ti ) );
+                    }
+                } else {
+                    for ( unsigned int& x : t.v ) {
+                        if ( x == from )
+                            x = to;
+                    }
+
+                    VertexTriangles[to].push_back( ti );
+                }
+            }
+
+            VertexTriangles[from].clear();
+            Dead[from] = true;
+            Quadrics[to].Add( Quadrics[from] );
+            Versions[to]++;
+
+            PushCollapsesAround( to );
+        }
+
+        std::vector<Vec3> Positions;
+        std::vector<Quadric> Quadrics;
+        std::vector<bool> Locked;
+        std::vector<bool> Dead;
+        std::vector<unsigned int> Versions;
+        std::vector<Triangle> Triangles;
+        std::vector<std::vector<unsigned int>> VertexTriangles;
+        std::priority_queue<Collapse> Heap;
+        std::vector<unsigned int> Neighbours;
+        std::vector<unsigned int> OtherNeighbours;
+        unsigned int NumAlive;
+        double MaxAppliedCost;
+    };
+}
+
+/** Halves the triangle count of the mesh, without any error bound */
+void MeshSimplifier::Decimate( const MeshSimplifierInput& mesh, std::vector<uint16_t>& outIndices ) {
+    QuadricSimplifier simplifier( mesh );
+    simplifier.Simplify( simplifier.GetNumTriangles() / 2, DBL_MAX );
+    simplifier.GetIndices( outIndices );
+}
+
+/** Builds simplified index lists for the mesh, each one with about half the triangles of the previous one */
+unsigned int MeshSimplifier::GenerateLODChain( const MeshSimplifierInput& mesh, unsigned int numLevels, float maxError, std::vector<std::vector<uint16_t>>& outLevels, std::vector<float>& outErrors ) {
+    outLevels.clear();
+    outErrors.clear();
+
+    QuadricSimplifier simplifier( mesh );
+    const double maxCost = double( maxError ) * maxError;
+
+    for ( unsigned int i = 0; i < numLevels; i++ ) {
+        unsigned int before = simplifier.GetNumTriangles();
+        double cost = simplifier.Simplify( before / 2, maxCost );
+
+        // Not worth an extra level if the error bound stopped us too early
+        if ( simplifier.GetNumTriangles() > before - before / 8 || simplifier.GetNumTriangles() == 0 )
+            break;
+
+        outLevels.emplace_back();
+        simplifier.GetIndices( outLevels.back() );
+        outErrors.push_back( static_cast<float>(sqrt( cost )) );
+    }
+
+    return static_cast<unsigned int>(outLevels.size());
+}
+
+/** Builds the levels of all submeshes of a visual */
+unsigned int MeshSimplifier::GenerateLODChains( const std::vector<MeshSimplifierInput>& meshes, unsigned int numLevels, float maxError, std::vector<std::vector<std::vector<uint16_t>>>& outLevels, float* outErrors ) {
+    numLevels = std::min( numLevels, MAX_LODS );
+    std::fill( outErrors, outErrors + MAX_LODS, 0.0f );
+    outLevels.assign( meshes.size(), std::vector<std::vector<uint16_t>>() );
+
+    unsigned int numLODs = 0;
+    std::vector<float> meshErrors;
+    for ( size_t m = 0; m < meshes.size(); m++ ) {
+        unsigned int n = GenerateLODChain( meshes[m], numLevels, maxError, outLevels[m], meshErrors );
+
+        for ( unsigned int l = 0; l < n; l++ ) {
+            outErrors[l] = std::max( outErrors[l], meshErrors[l] );
+        }
+
+        numLODs = std::max( numLODs, n );
+    }
+
+    // Meshes which couldn't be reduced as far as the others stay at their last level
+    for ( size_t m = 0; m < meshes.size(); m++ ) {
+        while ( outLevels[m].size() < numLODs ) {
+            outLevels[m].push_back( outLevels[m].empty() ? *meshes[m].Indices : outLevels[m].back() );
+        }
+    }
+
+    // Make sure the errors never shrink, so picking the level can stop at the first one which is too coarse
+    for ( unsigned int l = 1; l < numLODs; l++ ) {
+        outErrors[l] = std::max( outErrors[l], outErrors[l - 1] );
+    }
+
+    return numLODs;
+}
+
+/** Picks the level for an instance at the given distance */
+unsigned char MeshSimplifier::SelectLOD( const float* errors, unsigned int numLODs, float distance, float pixelScale, float maxPixelError, unsigned char currentLOD ) {
+    const float pixelsPerUnit = pixelScale / std::max( distance, 1.0f );
+
+    // Errors grow with each level, so take the coarsest one which is still below the threshold
+    unsigned char lod = 0;
+    while ( lod < numLODs && errors[lod] * pixelsPerUnit <= maxPixelError )
+        lod++;
+
+    while ( lod > currentLOD && errors[lod - 1] * pixelsPerUnit > maxPixelError * LOD_HYSTERESIS )
+        lod--;
+
+    return lod;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Generates and picks the LODs of static meshes
+
+    Meshes are simplified with the quadric error metric (Garland & Heckbert) using half-edge
+    collapses. Vertices are only ever merged into existing ones, so all levels of a mesh can share
+    one vertexbuffer. Open borders and UV-seams are locked, which keeps submeshes and seams free of
+    cracks. Each level has about half the triangles of the one before, its error is the largest
+    distance a collapse has moved the surface so far.
+
+    The submeshes of a visual get their levels together, so a visual has one error per level and
+    the level can be picked once for the whole instance.
+
+    Doesn't know anything about the engine, so it can be tested on its own. */
+
+/** Positions of a submesh, x, y and z as floats at the start of every vertex */
+struct MeshSimplifierInput {
+    const float* Positions;
+    size_t Stride;
+    size_t NumVertices;
+    const std::vector<uint16_t>* Indices;
+};
+
+class MeshSimplifier {
+public:
+    /** Levels stop once they would get coarser than this */
+    static constexpr unsigned int MAX_LODS = 3;
+
+    /** A coarser level is only picked once its error is this far below the threshold */
+    static constexpr float LOD_HYSTERESIS = 0.75f;
+
+    /** Halves the triangle count of the mesh, without any error bound */
+    static void Decimate( const MeshSimplifierInput& mesh, std::vector<uint16_t>& outIndices );
+
+    /** Builds simplified index lists for the mesh, each one with about half the triangles of the previous one.
+        Stops early once the geometric error would exceed maxError. Returns the number of generated levels. */
+    static unsigned int GenerateLODChain( const MeshSimplifierInput& mesh, unsigned int numLevels, float maxError, std::vector<std::vector<uint16_t>>& outLevels, std::vector<float>& outErrors );
+
+    /** Builds the levels of all submeshes of a visual. Submeshes which couldn't be reduced as far as the
+        others repeat their last level. outErrors gets MAX_LODS entries, levels which weren't generated are 0.
+        The errors never shrink from one level to the next. Returns the number of levels. */
+    static unsigned int GenerateLODChains( const std::vector<MeshSimplifierInput>& meshes, unsigned int numLevels, float maxError, std::vector<std::vector<std::vector<uint16_t>>>& outLevels, float* outErrors );
+
+    /** Picks the level for an instance at the given distance. The coarsest level whose error stays below
+        maxPixelError pixels on screen is taken, switching to a coarser one than currentLOD needs some headroom. */
+    static unsigned char SelectLOD( const float* errors, unsigned int numLODs, float distance, float pixelScale, float maxPixelError, unsigned char currentLOD );
+};
@@ -0,0 +1,93 @@
+#include "MorphMeshVertices.h"
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+MorphMeshVertices::MorphMeshVertices() {
+    SubmeshStart.push_back( 0 );
+    MaxPositionIndex = 0;
+}
+
+/** Adds the next submesh */
+void MorphMeshVertices::AddSubmesh( const uint16_t* wedgePositions, size_t numWedges ) {
+    WedgePositions.insert( WedgePositions.end(), wedgePositions, wedgePositions + numWedges );
+    SubmeshStart.push_back( WedgePositions.size() );
+
+    for ( size_t i = 0; i < numWedges; i++ ) {
+        MaxPositionIndex = std::max<size_t>( MaxPositionIndex, wedgePositions[i] );
+    }
+
+    // The new wedges were never expanded
+    Invalidate();
+}
+
+/** Takes over the positions if they differ from the last ones */
+bool MorphMeshVertices::Update( const float* positions, size_t numPositions ) {
+    if ( !WedgePositions.empty() && numPositions <= MaxPositionIndex )
+        return false;
+
+    if ( Positions.size() != numPositions * 3 ) {
+        Positions.assign( positions, positions + numPositions * 3 );
+        return true;
+    }
+
+    return MorphMeshKernels::CopyIfChanged( positions, Positions.data(), Positions.size() );
+}
+
+/** Writes the current positions into the first 12 bytes of every vertex of the given submesh */
+void MorphMeshVertices::Expand( size_t submesh, void* vertices, size_t stride ) const {
+    if ( Positions.empty() )
+        return;
+
+    MorphMeshKernels::ExpandPositions( Positions.data(), &WedgePositions[0] + SubmeshStart[submesh], GetNumWedges( submesh ), vertices, stride );
+}
+
+namespace MorphMeshKernels {
+    /** Copies src to dst and returns true if they weren't bitwise equal */
+    bool CopyIfChanged( const float* src, float* dst, size_t count ) {
+        // Compared as integers, so NaNs and -0 count as changes like memcmp would
+        size_t i = 0;
+        for ( ; i + 16 <= count; i += 16 ) {
+            const __m128i* a = reinterpret_cast<const __m128i*>(src + i);
+            const __m128i* b = reinterpret_cast<const __m128i*>(dst + i);
+
+            __m128i diff = _mm_xor_si128( _mm_loadu_si128( a ), _mm_loadu_si128( b ) );
+            diff = _mm_or_si128( diff, _mm_xor_si128( _mm_loadu_si128( a + 1 ), _mm_loadu_si128( b + 1 ) ) );
+            diff = _mm_or_si128( diff, _mm_xor_si128( _mm_loadu_si128( a + 2 ), _mm_loadu_si128( b + 2 ) ) );
+            diff = _mm_or_si128( diff, _mm_xor_si128( _mm_loadu_si128( a + 3 ), _mm_loadu_si128( b + 3 ) ) );
+
+            if ( _mm_movemask_epi8( _mm_cmpeq_epi32( diff, _mm_setzero_si128() ) ) != 0xFFFF )
+                break;
+        }
+
+        // Everything before i is equal, the rest either differs or is the tail
+        if ( i + 16 > count && (i == count || !memcmp( src + i, dst + i, (count - i) * sizeof( float ) )) )
+            return false;
+
+        memcpy( dst + i, src + i, (count - i) * sizeof( float ) );
+        return true;
+    }
+
+    bool CopyIfChangedScalar( const float* src, float* dst, size_t count ) {
+        bool changed = false;
+        for ( size_t i = 0; i < count; i++ ) {
+            uint32_t a, b;
+            memcpy( &a, &src[i], sizeof( a ) );
+            memcpy( &b, &dst[i], sizeof( b ) );
+            if ( a != b ) {
+                dst[i] = src[i];
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    /** Gathers the positions of the wedges into strided vertices */
+    void ExpandPositions( const float* positions, const uint16_t* wedgePositions, size_t numWedges, void* vertices, size_t stride ) {
+        uint8_t* out = reinterpret_cast<uint8_t*>(vertices);
+        for ( size_t i = 0; i < numWedges; i++ ) {
+            memcpy( out, &positions[wedgePositions[i] * 3], 3 * sizeof( float ) );
+            out += stride;
+        }
+    }
+}
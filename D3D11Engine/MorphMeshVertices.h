@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Keeps the vertices of a morph mesh in sync with the positions Gothic blends every frame
+
+    zCMorphMesh::CalcVertexPositions blends the active morph-channels into the position-list of the
+    mesh. Every wedge (vertex) points into that list, its normal and uv never change. This holds the
+    wedge-indices of all submeshes in one flat array and a copy of the positions expanded last time.
+    If Gothic produced the same positions again, which it does for every head that isn't talking or
+    blinking, Update returns false and nothing has to be expanded or uploaded.
+
+    Doesn't know anything about the engine, the vertex-layout is given by a stride. */
+class MorphMeshVertices {
+public:
+    MorphMeshVertices();
+
+    /** Adds the next submesh. wedgePositions holds the index into the position-list of every vertex. */
+    void AddSubmesh( const uint16_t* wedgePositions, size_t numWedges );
+
+    /** Takes over the positions if they differ from the last ones. Returns false if nothing changed,
+        or if there are fewer positions than the wedges point to. */
+    bool Update( const float* positions, size_t numPositions );
+
+    /** Writes the current positions into the first 12 bytes of every vertex of the given submesh */
+    void Expand( size_t submesh, void* vertices, size_t stride ) const;
+
+    size_t GetNumSubmeshes() const { return SubmeshStart.size() - 1; }
+    size_t GetNumWedges( size_t submesh ) const { return SubmeshStart[submesh + 1] - SubmeshStart[submesh]; }
+
+    /** Forces the next Update to report a change */
+    void Invalidate() { Positions.clear(); }
+
+private:
+    std::vector<float> Positions;
+    std::vector<uint16_t> WedgePositions;
+
+    /** Wedges of submesh i are stored at SubmeshStart[i] to SubmeshStart[i + 1] */
+    std::vector<size_t> SubmeshStart;
+    size_t MaxPositionIndex;
+};
+
+/** The kernels, exposed so the test-tool can check them against each other */
+namespace MorphMeshKernels {
+    /** Copies src to dst and returns true if they weren't bitwise equal. SSE2, 16 floats per step. */
+    bool CopyIfChanged( const float* src, float* dst, size_t count );
+    bool CopyIfChangedScalar( const float* src, float* dst, size_t count );
+
+    /** Gathers the positions of the wedges into strided vertices */
+    void ExpandPositions( const float* positions, const uint16_t* wedgePositions, size_t numWedges, void* vertices, size_t stride );
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/** Exact 64-bit encodings of the fixed function states and a flat table to find their state-objects
+
+    Every field of a state gets its own bits, so two states have the same key exactly when they are
+    equal. Comparing states and looking up their objects is then an integer compare and a probe
+    into an array, instead of hashing the whole struct and trusting the hash.
+
+    Bit 63 is set in every key, 0 is left for "no key" and for the empty slots of the table.
+    The enum-values are the ones of the Gothic*StateInfo structs, which are laid out for D3D11. */
+namespace PipelineStateKey {
+    const uint64_t VALID_BIT = 1ull << 63;
+
+    /** Returned by the tables for keys they don't know */
+    const uint32_t INVALID_ID = 0xFFFFFFFF;
+
+    /** Bits of the fields inside the pipeline key. Ids which don't fit make the key 0. */
+    const int PIPELINE_DEPTH_BITS = 6;
+    const int PIPELINE_BLEND_ID_BITS = 12;
+    const int PIPELINE_RASTERIZER_ID_BITS = 12;
+    const int PIPELINE_SHADER_ID_BITS = 16;
+
+    /** SrcBlend, DestBlend, SrcBlendAlpha and DestBlendAlpha take 5 bits, the ops 3 bits */
+    inline uint64_t PackBlend( int srcBlend, int destBlend, int blendOp,
+        int srcBlendAlpha, int destBlendAlpha, int blendOpAlpha,
+        bool blendEnabled, bool alphaToCoverage, bool colorWritesEnabled ) {
+        return VALID_BIT
+            | (static_cast<uint64_t>(srcBlend & 0x1F) << 0)
+            | (static_cast<uint64_t>(destBlend & 0x1F) << 5)
+            | (static_cast<uint64_t>(blendOp & 0x7) << 10)
+            | (static_cast<uint64_t>(srcBlendAlpha & 0x1F) << 13)
+            | (static_cast<uint64_t>(destBlendAlpha & 0x1F) << 18)
+            | (static_cast<uint64_t>(blendOpAlpha & 0x7) << 23)
+            | (static_cast<uint64_t>(blendEnabled) << 26)
+            | (static_cast<uint64_t>(alphaToCoverage) << 27)
+            | (static_cast<uint64_t>(colorWritesEnabled) << 28);
+    }
+
+    /** The whole 32 bits of the z-bias are kept */
+    inline uint64_t PackRasterizer( int cullMode, bool frontCounterClockwise, bool depthClipEnable, bool wireframe, int zBias ) {
+        return VALID_BIT
+            | (static_cast<uint64_t>(cullMode & 0x3) << 0)
+            | (static_cast<uint64_t>(frontCounterClockwise) << 2)
+            | (static_cast<uint64_t>(depthClipEnable) << 3)
+            | (static_cast<uint64_t>(wireframe) << 4)
+            | (static_cast<uint64_t>(static_cast<uint32_t>(zBias)) << 8);
+    }
+
+    /** Only uses the lowest PIPELINE_DEPTH_BITS bits apart from the valid-bit */
+    inline uint64_t PackDepth( bool depthBufferEnabled, bool depthWriteEnabled, int compareFunc ) {
+        return VALID_BIT
+            | (static_cast<uint64_t>(depthBufferEnabled) << 0)
+            | (static_cast<uint64_t>(depthWriteEnabled) << 1)
+            | (static_cast<uint64_t>(compareFunc & 0xF) << 2);
+    }
+
+    inline uint64_t PackSampler( int addressU, int addressV ) {
+        return VALID_BIT
+            | (static_cast<uint64_t>(addressU & 0x7) << 0)
+            | (static_cast<uint64_t>(addressV & 0x7) << 3);
+    }
+
+    /** Key over the whole fixed function pipeline: The depth-state is small enough to go in as it is,
+        blend- and rasterizer-state go in by the id of their state-object, the shaders by their own id.
+        Returns 0 if one of the ids doesn't fit, such keys must not be compared. */
+    inline uint64_t MakePipelineKey( uint64_t depthKey, uint32_t blendId, uint32_t rasterizerId, uint32_t vsId, uint32_t psId ) {
+        if ( depthKey == 0
+            || blendId >= (1u << PIPELINE_BLEND_ID_BITS)
+            || rasterizerId >= (1u << PIPELINE_RASTERIZER_ID_BITS)
+            || vsId >= (1u << PIPELINE_SHADER_ID_BITS)
+            || psId >= (1u << PIPELINE_SHADER_ID_BITS) ) {
+            return 0;
+        }
+
+        int shift = 0;
+        uint64_t key = depthKey & ((1ull << PIPELINE_DEPTH_BITS) - 1);
+        shift += PIPELINE_DEPTH_BITS;
+        key |= static_cast<uint64_t>(blendId) << shift;
+        shift += PIPELINE_BLEND_ID_BITS;
+        key |= static_cast<uint64_t>(rasterizerId) << shift;
+        shift += PIPELINE_RASTERIZER_ID_BITS;
+        key |= static_cast<uint64_t>(vsId) << shift;
+        shift += PIPELINE_SHADER_ID_BITS;
+        key |= static_cast<uint64_t>(psId) << shift;
+        return key | VALID_BIT;
+    }
+
+    /** Spreads the packed bits over the whole word, the low bits of the keys barely change */
+    struct KeyHasher {
+        uint64_t operator()( uint64_t key ) const {
+            key ^= key >> 33;
+            key *= 0xFF51AFD7ED558CCDull;
+            key ^= key >> 33;
+            key *= 0xC4CEB9FE1A85EC53ull;
+            key ^= key >> 33;
+            return key;
+        }
+    };
+}
+
+/** Open-addressing table from state-key to state-object, with linear probing
+
+    The slots are one flat array which is kept at most half full, a lookup usually touches a single
+    cache line. Every object also gets an id, counting up from 0 in the order they were added. The
+    ids don't change when the table grows, so they can be used in other keys. Entries are never
+    removed on their own, only all at once. The objects are owned by whoever inserted them. */
+template <typename T, typename Hasher = PipelineStateKey::KeyHasher>
+class StateKeyTable {
+public:
+    StateKeyTable( uint32_t initialCapacity = 64 ) {
+        uint32_t capacity = 4;
+        while ( capacity < initialCapacity )
+            capacity *= 2;
+
+        Slots.resize( capacity );
+        NumEntries = 0;
+    }
+
+    /** Returns the object stored for the key or nullptr. Writes its id to outId, if given. */
+    T* Find( uint64_t key, uint32_t* outId = nullptr ) const {
+        if ( key == 0 ) {
+            if ( outId ) *outId = PipelineStateKey::INVALID_ID;
+            return nullptr;
+        }
+
+        const uint32_t mask = static_cast<uint32_t>(Slots.size()) - 1;
+        for ( uint32_t i = static_cast<uint32_t>(Hasher()(key)) & mask;; i = (i + 1) & mask ) {
+            const Slot& s = Slots[i];
+            if ( s.Key == key ) {
+                if ( outId ) *outId = s.Id;
+                return s.Value;
+            }
+
+            // There always is an empty slot, since the table is never more than half full
+            if ( s.Key == 0 ) {
+                if ( outId ) *outId = PipelineStateKey::INVALID_ID;
+                return nullptr;
+            }
+        }
+    }
+
+    /** Adds the object, the key must not be in the table yet. Returns the id of the new entry. */
+    uint32_t Insert( uint64_t key, T* value ) {
+        if ( key == 0 )
+            return PipelineStateKey::INVALID_ID;
+
+        if ( (NumEntries + 1) * 2 > Slots.size() )
+            Grow();
+
+        const uint32_t id = NumEntries++;
+        Place( key, value, id );
+        return id;
+    }
+
+    /** Calls fn( key, value ) for every entry */
+    template <typename Fn>
+    void ForEach( Fn fn ) const {
+        for ( const Slot& s : Slots ) {
+            if ( s.Key != 0 )
+                fn( s.Key, s.Value );
+        }
+    }
+
+    /** Drops all entries and starts the ids at 0 again. Doesn't delete the objects. */
+    void Clear() {
+        for ( Slot& s : Slots ) {
+            s = Slot();
+        }
+        NumEntries = 0;
+    }
+
+    uint32_t GetNumEntries() const { return NumEntries; }
+    uint32_t GetCapacity() const { return static_cast<uint32_t>(Slots.size()); }
+
+    /** Number of slots looked at to find the key, for checking how well the keys spread */
+    uint32_t GetProbeLength( uint64_t key ) const {
+        const uint32_t mask = static_cast<uint32_t>(Slots.size()) - 1;
+        uint32_t length = 1;
+        for ( uint32_t i = static_cast<uint32_t>(Hasher()(key)) & mask;; i = (i + 1) & mask, length++ ) {
+            if ( Slots[i].Key == key || Slots[i].Key == 0 )
+                return length;
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t Key = 0;
+        T* Value = nullptr;
+        uint32_t Id = 0;
+    };
+
+    void Place( uint64_t key, T* value, uint32_t id ) {
+        const uint32_t mask = static_cast<uint32_t>(Slots.size()) - 1;
+        uint32_t i = static_cast<uint32_t>(Hasher()(key)) & mask;
+        while ( Slots[i].Key != 0 ) {
+            i = (i + 1) & mask;
+        }
+
+        Slots[i].Key = key;
+        Slots[i].Value = value;
+        Slots[i].Id = id;
+    }
+
+    void Grow() {
+        std::vector<Slot> old;
+        old.swap( Slots );
+        Slots.resize( old.size() * 2 );
+
+        for ( const Slot& s : old ) {
+            if ( s.Key != 0 )
+                Place( s.Key, s.Value, s.Id );
+        }
+    }
+
+    std::vector<Slot> Slots;
+    uint32_t NumEntries;
+};
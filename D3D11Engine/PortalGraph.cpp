@@ -0,0 +1,596 @@
+#include "PortalGraph.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+    /** Distance to a portal at which the camera counts as standing inside of the opening */
+    const float PORTAL_NEAR_DISTANCE = 10.0f;
+
+    /** Cells reaching less than this behind a portal are treated as lying in front of it */
+    const float PORTAL_SIDE_TOLERANCE = 1.0f;
+
+    void Quantize( const float* p, float invSnap, int* q ) {
+        for ( int a = 0; a < 3; a++ ) {
+            q[a] = static_cast<int>(floorf( p[a] * invSnap + 0.5f ));
+        }
+    }
+
+    /** 21 bits per axis, enough for +-1M world units with a snap of 1 */
+    uint64_t VertexKey( int x, int y, int z ) {
+        return static_cast<uint64_t>(x & 0x1FFFFF)
+            | (static_cast<uint64_t>(y & 0x1FFFFF) << 21)
+            | (static_cast<uint64_t>(z & 0x1FFFFF) << 42);
+    }
+
+    float Dot( const float* a, const float* b ) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    void Cross( const float* a, const float* b, float* out ) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    struct PortalPiece {
+        uint32_t Polygon;
+        std::vector<uint32_t> Cells;
+        float Normal[3];
+        float Distance;
+    };
+
+    bool SameOpening( const PortalPiece& a, const PortalPiece& b, float snap ) {
+        if ( a.Cells != b.Cells )
+            return false;
+
+        const float d = Dot( a.Normal, b.Normal );
+        if ( fabsf( d ) < 0.99f )
+            return false;
+
+        return fabsf( a.Distance - (d > 0.0f ? b.Distance : -b.Distance) ) < snap * 4.0f;
+    }
+
+    uint32_t FindRoot( std::vector<uint32_t>& parents, uint32_t i ) {
+        while ( parents[i] != i ) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+}
+
+void PortalGraph::Clear() {
+    Cells.clear();
+    Portals.clear();
+    NumDroppedPortals = 0;
+}
+
+void PortalGraph::Build( const PortalGraphPolygon* polygons, size_t numPolygons, float vertexSnap ) {
+    Clear();
+
+    const float snap = std::max( vertexSnap, 0.001f );
+    const float invSnap = 1.0f / snap;
+
+    Cell outside;
+    for ( int a = 0; a < 3; a++ ) {
+        outside.Min[a] = -FLT_MAX;
+        outside.Max[a] = FLT_MAX;
+    }
+    outside.Sector = -1;
+    Cells.push_back( outside );
+
+    // Only vertices next to a portal can connect a cell to it
+    std::vector<uint64_t> portalKeys;
+    for ( size_t i = 0; i < numPolygons; i++ ) {
+        const PortalGraphPolygon& poly = polygons[i];
+        if ( !poly.Portal )
+            continue;
+
+        for ( uint32_t v = 0; v < poly.NumVertices; v++ ) {
+            int q[3];
+            Quantize( &poly.Vertices[v * 3], invSnap, q );
+            for ( int dx = -1; dx <= 1; dx++ ) {
+                for ( int dy = -1; dy <= 1; dy++ ) {
+                    for ( int dz = -1; dz <= 1; dz++ ) {
+                        portalKeys.push_back( VertexKey( q[0] + dx, q[1] + dy, q[2] + dz ) );
+                    }
+                }
+            }
+        }
+    }
+    std::sort( portalKeys.begin(), portalKeys.end() );
+    portalKeys.erase( std::unique( portalKeys.begin(), portalKeys.end() ), portalKeys.end() );
+
+    // Sort the polygons into their cells and remember which cells have vertices next to a portal
+    std::unordered_map<int, uint32_t> sectorCells;
+    std::vector<std::pair<uint64_t, uint32_t>> touching;
+    for ( size_t i = 0; i < numPolygons; i++ ) {
+        const PortalGraphPolygon& poly = polygons[i];
+        if ( poly.Portal )
+            continue;
+
+        uint32_t cell = OUTSIDE_CELL;
+        if ( poly.Sector >= 0 ) {
+            auto it = sectorCells.find( poly.Sector );
+            if ( it == sectorCells.end() ) {
+                Cell c;
+                for ( int a = 0; a < 3; a++ ) {
+                    c.Min[a] = FLT_MAX;
+                    c.Max[a] = -FLT_MAX;
+                }
+                c.Sector = poly.Sector;
+
+                it = sectorCells.emplace( poly.Sector, static_cast<uint32_t>(Cells.size()) ).first;
+                Cells.push_back( c );
+            }
+            cell = it->second;
+        }
+
+        for ( uint32_t v = 0; v < poly.NumVertices; v++ ) {
+            const float* p = &poly.Vertices[v * 3];
+            if ( cell != OUTSIDE_CELL ) {
+                Cell& c = Cells[cell];
+                for ( int a = 0; a < 3; a++ ) {
+                    c.Min[a] = std::min( c.Min[a], p[a] );
+                    c.Max[a] = std::max( c.Max[a], p[a] );
+                }
+            }
+
+            int q[3];
+            Quantize( p, invSnap, q );
+            const uint64_t key = VertexKey( q[0], q[1], q[2] );
+            if ( std::binary_search( portalKeys.begin(), portalKeys.end(), key ) ) {
+                touching.emplace_back( key, cell );
+            }
+        }
+    }
+    std::sort( touching.begin(), touching.end() );
+    touching.erase( std::unique( touching.begin(), touching.end() ), touching.end() );
+
+    // Find the cells of every portal polygon
+    std::vector<PortalPiece> pieces;
+    for ( size_t i = 0; i < numPolygons; i++ ) {
+        const PortalGraphPolygon& poly = polygons[i];
+        if ( !poly.Portal )
+            continue;
+
+        if ( poly.NumVertices < 3 ) {
+            NumDroppedPortals++;
+            continue;
+        }
+
+        PortalPiece piece;
+        piece.Polygon = static_cast<uint32_t>(i);
+
+        for ( uint32_t v = 0; v < poly.NumVertices; v++ ) {
+            int q[3];
+            Quantize( &poly.Vertices[v * 3], invSnap, q );
+            for ( int dx = -1; dx <= 1; dx++ ) {
+                for ( int dy = -1; dy <= 1; dy++ ) {
+                    for ( int dz = -1; dz <= 1; dz++ ) {
+                        const uint64_t key = VertexKey( q[0] + dx, q[1] + dy, q[2] + dz );
+                        auto it = std::lower_bound( touching.begin(), touching.end(), std::make_pair( key, 0u ) );
+                        for ( ; it != touching.end() && it->first == key; ++it ) {
+                            piece.Cells.push_back( it->second );
+                        }
+                    }
+                }
+            }
+        }
+
+        if ( poly.IndoorOutdoor ) {
+            piece.Cells.push_back( OUTSIDE_CELL );
+        }
+
+        std::sort( piece.Cells.begin(), piece.Cells.end() );
+        piece.Cells.erase( std::unique( piece.Cells.begin(), piece.Cells.end() ), piece.Cells.end() );
+        if ( piece.Cells.size() < 2 ) {
+            NumDroppedPortals++;
+            continue;
+        }
+
+        // Newell's method, works for any planar polygon
+        float n[3] = { 0.0f, 0.0f, 0.0f };
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        for ( uint32_t v = 0; v < poly.NumVertices; v++ ) {
+            const float* a = &poly.Vertices[v * 3];
+            const float* b = &poly.Vertices[((v + 1) % poly.NumVertices) * 3];
+            n[0] += (a[1] - b[1]) * (a[2] + b[2]);
+            n[1] += (a[2] - b[2]) * (a[0] + b[0]);
+            n[2] += (a[0] - b[0]) * (a[1] + b[1]);
+            for ( int k = 0; k < 3; k++ ) {
+                center[k] += a[k];
+            }
+        }
+
+        const float length = sqrtf( Dot( n, n ) );
+        if ( length < 1e-6f ) {
+            NumDroppedPortals++;
+            continue;
+        }
+
+        for ( int k = 0; k < 3; k++ ) {
+            piece.Normal[k] = n[k] / length;
+            center[k] /= static_cast<float>(poly.NumVertices);
+        }
+        piece.Distance = Dot( piece.Normal, center );
+        pieces.push_back( std::move( piece ) );
+    }
+
+    // The polygons of one opening share vertices, lie in the same plane and lead to the same cells
+    std::vector<uint32_t> parents( pieces.size() );
+    for ( uint32_t i = 0; i < parents.size(); i++ ) {
+        parents[i] = i;
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> pieceKeys;
+    for ( uint32_t i = 0; i < pieces.size(); i++ ) {
+        const PortalGraphPolygon& poly = polygons[pieces[i].Polygon];
+        for ( uint32_t v = 0; v < poly.NumVertices; v++ ) {
+            int q[3];
+            Quantize( &poly.Vertices[v * 3], invSnap, q );
+            pieceKeys.emplace_back( VertexKey( q[0], q[1], q[2] ), i );
+        }
+    }
+    std::sort( pieceKeys.begin(), pieceKeys.end() );
+
+    for ( size_t first = 0; first < pieceKeys.size(); ) {
+        size_t last = first + 1;
+        while ( last < pieceKeys.size() && pieceKeys[last].first == pieceKeys[first].first ) {
+            last++;
+        }
+
+        for ( size_t a = first; a < last; a++ ) {
+            for ( size_t b = first; b < a; b++ ) {
+                const uint32_t pa = pieceKeys[a].second;
+                const uint32_t pb = pieceKeys[b].second;
+                if ( SameOpening( pieces[pa], pieces[pb], snap ) ) {
+                    parents[FindRoot( parents, pa )] = FindRoot( parents, pb );
+                }
+            }
+        }
+        first = last;
+    }
+
+    // Build one convex portal per opening
+    std::unordered_map<uint32_t, std::vector<uint32_t>> openings;
+    std::vector<uint32_t> openingOrder;
+    for ( uint32_t i = 0; i < pieces.size(); i++ ) {
+        const uint32_t root = FindRoot( parents, i );
+        auto& members = openings[root];
+        if ( members.empty() ) {
+            openingOrder.push_back( root );
+        }
+        members.push_back( i );
+    }
+
+    for ( uint32_t root : openingOrder ) {
+        const std::vector<uint32_t>& members = openings[root];
+        const PortalPiece& base = pieces[members[0]];
+
+        // 2D basis inside of the plane
+        float u[3];
+        if ( fabsf( base.Normal[0] ) < 0.9f ) {
+            const float x[3] = { 1.0f, 0.0f, 0.0f };
+            Cross( base.Normal, x, u );
+        } else {
+            const float y[3] = { 0.0f, 1.0f, 0.0f };
+            Cross( base.Normal, y, u );
+        }
+        const float ul = sqrtf( Dot( u, u ) );
+        for ( int k = 0; k < 3; k++ ) {
+            u[k] /= ul;
+        }
+        float w[3];
+        Cross( base.Normal, u, w );
+
+        struct HullPoint {
+            float X, Y;
+            const float* P;
+        };
+        std::vector<HullPoint> points;
+        float distance = 0.0f;
+        for ( uint32_t m : members ) {
+            const PortalGraphPolygon& poly = polygons[pieces[m].Polygon];
+            for ( uint32_t v = 0; v < poly.NumVertices; v++ ) {
+                const float* p = &poly.Vertices[v * 3];
+                points.push_back( { Dot( p, u ), Dot( p, w ), p } );
+                distance += Dot( base.Normal, p );
+            }
+        }
+        distance /= static_cast<float>(points.size());
+
+        // Monotone chain
+        std::sort( points.begin(), points.end(), []( const HullPoint& a, const HullPoint& b ) {
+            return a.X < b.X || (a.X == b.X && a.Y < b.Y);
+        } );
+        auto turn = []( const HullPoint& o, const HullPoint& a, const HullPoint& b ) {
+            return (a.X - o.X) * (b.Y - o.Y) - (a.Y - o.Y) * (b.X - o.X);
+        };
+
+        std::vector<HullPoint> hull( points.size() * 2 );
+        size_t k = 0;
+        for ( size_t i = 0; i < points.size(); i++ ) {
+            while ( k >= 2 && turn( hull[k - 2], hull[k - 1], points[i] ) <= 0.0f ) k--;
+            hull[k++] = points[i];
+        }
+        for ( size_t i = points.size() - 1, t = k + 1; i > 0; i-- ) {
+            while ( k >= t && turn( hull[k - 2], hull[k - 1], points[i - 1] ) <= 0.0f ) k--;
+            hull[k++] = points[i - 1];
+        }
+        hull.resize( k > 0 ? k - 1 : 0 );
+
+        if ( hull.size() < 3 ) {
+            NumDroppedPortals += static_cast<uint32_t>(members.size());
+            continue;
+        }
+
+        Portal portal;
+        portal.Plane.Normal[0] = base.Normal[0];
+        portal.Plane.Normal[1] = base.Normal[1];
+        portal.Plane.Normal[2] = base.Normal[2];
+        portal.Plane.Distance = distance;
+        for ( int a = 0; a < 3; a++ ) {
+            portal.Min[a] = FLT_MAX;
+            portal.Max[a] = -FLT_MAX;
+        }
+
+        for ( const HullPoint& h : hull ) {
+            for ( int a = 0; a < 3; a++ ) {
+                portal.Vertices.push_back( h.P[a] );
+                portal.Min[a] = std::min( portal.Min[a], h.P[a] );
+                portal.Max[a] = std::max( portal.Max[a], h.P[a] );
+            }
+        }
+        portal.Cells = base.Cells;
+
+        const uint32_t index = static_cast<uint32_t>(Portals.size());
+        for ( uint32_t c : portal.Cells ) {
+            Cells[c].Portals.push_back( index );
+        }
+        Portals.push_back( std::move( portal ) );
+    }
+}
+
+uint32_t PortalGraph::FindCell( const float* point ) const {
+    uint32_t best = OUTSIDE_CELL;
+    float bestVolume = FLT_MAX;
+    for ( uint32_t i = 1; i < Cells.size(); i++ ) {
+        const Cell& c = Cells[i];
+        if ( point[0] < c.Min[0] || point[1] < c.Min[1] || point[2] < c.Min[2]
+            || point[0] > c.Max[0] || point[1] > c.Max[1] || point[2] > c.Max[2] ) {
+            continue;
+        }
+
+        const float volume = (c.Max[0] - c.Min[0]) * (c.Max[1] - c.Min[1]) * (c.Max[2] - c.Min[2]);
+        if ( volume < bestVolume ) {
+            bestVolume = volume;
+            best = i;
+        }
+    }
+    return best;
+}
+
+void PortalVisibility::Compute( const PortalGraph& graph, const float* cameraPosition, const PortalPlane* frustum, int numPlanes ) {
+    for ( uint32_t c : VisibleCells ) {
+        if ( c < CellFrusta.size() ) {
+            CellFrusta[c].clear();
+            CellOverflow[c] = 0;
+        }
+    }
+    VisibleCells.clear();
+    Planes.clear();
+    Frusta.clear();
+    NumPortalVisits = 0;
+
+    Graph = &graph;
+    Camera[0] = cameraPosition[0];
+    Camera[1] = cameraPosition[1];
+    Camera[2] = cameraPosition[2];
+
+    CellFrusta.resize( graph.GetCells().size() );
+    CellOverflow.resize( graph.GetCells().size(), 0 );
+    PortalOnPath.assign( graph.GetPortals().size(), 0 );
+    ClipBuffers.resize( (MAX_DEPTH + 1) * 2 );
+
+    Planes.insert( Planes.end(), frustum, frustum + numPlanes );
+    Frusta.push_back( { 0, static_cast<uint32_t>(numPlanes) } );
+
+    CameraCell = graph.FindCell( cameraPosition );
+    Visit( CameraCell, 0, 0 );
+}
+
+void PortalVisibility::Visit( uint32_t cell, uint32_t frustum, int depth ) {
+    std::vector<uint32_t>& frusta = CellFrusta[cell];
+    if ( frusta.empty() ) {
+        VisibleCells.push_back( cell );
+    }
+
+    if ( frusta.size() < MAX_FRUSTA_PER_CELL ) {
+        frusta.push_back( frustum );
+    } else {
+        CellOverflow[cell] = 1;
+    }
+
+    if ( depth >= MAX_DEPTH )
+        return;
+
+    const Frustum f = Frusta[frustum];
+    std::vector<float>& clipA = ClipBuffers[depth * 2];
+    std::vector<float>& clipB = ClipBuffers[depth * 2 + 1];
+
+    for ( uint32_t p : Graph->GetCells()[cell].Portals ) {
+        if ( PortalOnPath[p] || NumPortalVisits >= MAX_PORTAL_VISITS )
+            continue;
+
+        const PortalGraph::Portal& portal = Graph->GetPortals()[p];
+        if ( !BoxInFrustum( frustum, portal.Min, portal.Max ) )
+            continue;
+
+        uint32_t next = frustum;
+        const float side = Dot( portal.Plane.Normal, Camera ) - portal.Plane.Distance;
+        const bool inOpening = fabsf( side ) < PORTAL_NEAR_DISTANCE
+            && Camera[0] >= portal.Min[0] - PORTAL_NEAR_DISTANCE && Camera[0] <= portal.Max[0] + PORTAL_NEAR_DISTANCE
+            && Camera[1] >= portal.Min[1] - PORTAL_NEAR_DISTANCE && Camera[1] <= portal.Max[1] + PORTAL_NEAR_DISTANCE
+            && Camera[2] >= portal.Min[2] - PORTAL_NEAR_DISTANCE && Camera[2] <= portal.Max[2] + PORTAL_NEAR_DISTANCE;
+
+        if ( !inOpening ) {
+            // Clip the portal against the frustum it is seen through
+            clipA = portal.Vertices;
+            for ( uint32_t i = 0; i < f.NumPlanes && clipA.size() >= 9; i++ ) {
+                const PortalPlane& plane = Planes[f.FirstPlane + i];
+                const size_t n = clipA.size() / 3;
+
+                clipB.clear();
+                for ( size_t v = 0; v < n; v++ ) {
+                    const float* a = &clipA[v * 3];
+                    const float* b = &clipA[((v + 1) % n) * 3];
+                    const float da = Dot( plane.Normal, a ) - plane.Distance;
+                    const float db = Dot( plane.Normal, b ) - plane.Distance;
+
+                    if ( da >= 0.0f ) {
+                        clipB.insert( clipB.end(), a, a + 3 );
+                    }
+
+                    if ( (da >= 0.0f) != (db >= 0.0f) ) {
+                        const float t = da / (da - db);
+                        for ( int k = 0; k < 3; k++ ) {
+                            clipB.push_back( a[k] + (b[k] - a[k]) * t );
+                        }
+                    }
+                }
+                clipA.swap( clipB );
+            }
+
+            const size_t n = clipA.size() / 3;
+            if ( n < 3 )
+                continue;
+
+            float center[3] = { 0.0f, 0.0f, 0.0f };
+            for ( size_t v = 0; v < n; v++ ) {
+                for ( int k = 0; k < 3; k++ ) {
+                    center[k] += clipA[v * 3 + k];
+                }
+            }
+            for ( int k = 0; k < 3; k++ ) {
+                center[k] /= static_cast<float>(n);
+            }
+
+            // Planes through the camera and every edge of what is left
+            next = static_cast<uint32_t>(Frusta.size());
+            const uint32_t firstPlane = static_cast<uint32_t>(Planes.size());
+            for ( size_t v = 0; v < n; v++ ) {
+                const float* a = &clipA[v * 3];
+                const float* b = &clipA[((v + 1) % n) * 3];
+                const float ea[3] = { a[0] - Camera[0], a[1] - Camera[1], a[2] - Camera[2] };
+                const float eb[3] = { b[0] - Camera[0], b[1] - Camera[1], b[2] - Camera[2] };
+
+                PortalPlane plane;
+                Cross( ea, eb, plane.Normal );
+                const float length = sqrtf( Dot( plane.Normal, plane.Normal ) );
+                if ( length <= 1e-6f * sqrtf( Dot( ea, ea ) * Dot( eb, eb ) ) )
+                    continue;  // Edge too short or pointing at the camera
+
+                for ( int k = 0; k < 3; k++ ) {
+                    plane.Normal[k] /= length;
+                }
+                plane.Distance = Dot( plane.Normal, Camera );
+                if ( Dot( plane.Normal, center ) < plane.Distance ) {
+                    for ( int k = 0; k < 3; k++ ) {
+                        plane.Normal[k] = -plane.Normal[k];
+                    }
+                    plane.Distance = -plane.Distance;
+                }
+                Planes.push_back( plane );
+            }
+
+            // Nothing in front of the portal can be seen through it
+            PortalPlane back = portal.Plane;
+            if ( side > 0.0f ) {
+                for ( int k = 0; k < 3; k++ ) {
+                    back.Normal[k] = -back.Normal[k];
+                }
+                back.Distance = -back.Distance;
+            }
+            Planes.push_back( back );
+
+            Frusta.push_back( { firstPlane, static_cast<uint32_t>(Planes.size()) - firstPlane } );
+        }
+
+        NumPortalVisits++;
+        PortalOnPath[p] = 1;
+        for ( uint32_t c : portal.Cells ) {
+            if ( c == cell )
+                continue;
+
+            // A room lying completely on the side of the camera can't be seen through this portal,
+            // like the inside of a house seen from behind through its door
+            if ( c != PortalGraph::OUTSIDE_CELL && !inOpening ) {
+                const PortalGraph::Cell& target = Graph->GetCells()[c];
+                float nearDist = 0.0f;
+                for ( int a = 0; a < 3; a++ ) {
+                    const float n = side > 0.0f ? portal.Plane.Normal[a] : -portal.Plane.Normal[a];
+                    nearDist += n * (n >= 0.0f ? target.Min[a] : target.Max[a]);
+                }
+                const float d = side > 0.0f ? portal.Plane.Distance : -portal.Plane.Distance;
+                if ( nearDist >= d - PORTAL_SIDE_TOLERANCE )
+                    continue;
+            }
+
+            Visit( c, next, depth + 1 );
+        }
+        PortalOnPath[p] = 0;
+    }
+}
+
+bool PortalVisibility::BoxInFrustum( uint32_t frustum, const float* min, const float* max ) const {
+    const Frustum& f = Frusta[frustum];
+    for ( uint32_t i = 0; i < f.NumPlanes; i++ ) {
+        const PortalPlane& p = Planes[f.FirstPlane + i];
+        float farDist = 0.0f;
+        for ( int a = 0; a < 3; a++ ) {
+            farDist += p.Normal[a] * (p.Normal[a] >= 0.0f ? max[a] : min[a]);
+        }
+
+        if ( farDist < p.Distance )
+            return false;
+    }
+    return true;
+}
+
+bool PortalVisibility::IsBoxVisible( uint32_t cell, const float* min, const float* max ) const {
+    if ( !IsCellVisible( cell ) )
+        return false;
+
+    if ( CellOverflow[cell] )
+        return BoxInFrustum( 0, min, max );
+
+    for ( uint32_t f : CellFrusta[cell] ) {
+        if ( BoxInFrustum( f, min, max ) )
+            return true;
+    }
+    return false;
+}
+
+bool PortalVisibility::IsBoxVisible( const float* min, const float* max ) const {
+    if ( !Graph )
+        return true;
+
+    const std::vector<PortalGraph::Cell>& cells = Graph->GetCells();
+    for ( uint32_t c : VisibleCells ) {
+        const PortalGraph::Cell& cell = cells[c];
+        if ( c != PortalGraph::OUTSIDE_CELL
+            && (max[0] < cell.Min[0] || max[1] < cell.Min[1] || max[2] < cell.Min[2]
+                || min[0] > cell.Max[0] || min[1] > cell.Max[1] || min[2] > cell.Max[2]) ) {
+            continue;
+        }
+
+        if ( IsBoxVisible( c, min, max ) )
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Cells and portals of a level, and which of the cells the camera can see through the portals
+
+    Gothic marks the rooms of its levels as sectors: every polygon inside of one has SectorPoly set
+    and the index of the sector. Everything else belongs to the outside. The doors and windows between
+    them are portal polygons, which aren't drawn. A portal connects the cells whose polygons touch its
+    vertices, and the portal polygons of one opening are merged into a single convex polygon.
+
+    The visibility starts in the cell of the camera with the camera frustum. Every portal of the cell
+    which is inside the frustum is clipped against it, the planes through the camera and the edges of
+    what is left of the portal make the frustum for the cells behind it, and so on. A cell can be seen
+    through several portals, so it keeps all frusta it was reached with and a box inside of the cell
+    is visible if it is inside of any of them.
+
+    Doesn't know anything about the engine, so it can be tested on its own. */
+
+/** Points p with dot(Normal, p) >= Distance are inside */
+struct PortalPlane {
+    float Normal[3];
+    float Distance;
+};
+
+struct PortalGraphPolygon {
+    /** x, y, z of every vertex */
+    const float* Vertices;
+    uint32_t NumVertices;
+
+    /** Index of the sector the polygon is in, negative for the outside */
+    int Sector;
+
+    bool Portal;
+
+    /** Set on portals between a sector and the outside */
+    bool IndoorOutdoor;
+};
+
+class PortalGraph {
+public:
+    static constexpr uint32_t OUTSIDE_CELL = 0;
+
+    struct Cell {
+        /** Bounds of the polygons in the cell, the outside cell reaches everywhere */
+        float Min[3];
+        float Max[3];
+
+        int Sector;
+        std::vector<uint32_t> Portals;
+    };
+
+    struct Portal {
+        /** x, y, z of a convex polygon */
+        std::vector<float> Vertices;
+        PortalPlane Plane;
+        float Min[3];
+        float Max[3];
+
+        /** Usually two, more when the opening touches more cells */
+        std::vector<uint32_t> Cells;
+    };
+
+    /** Extracts the cells and portals. Vertices closer than vertexSnap are the same. */
+    void Build( const PortalGraphPolygon* polygons, size_t numPolygons, float vertexSnap = 1.0f );
+
+    void Clear();
+
+    /** Without portals there is nothing to gain from walking the graph */
+    bool HasPortals() const { return !Portals.empty(); }
+
+    /** Smallest sector whose bounds contain the point, or the outside */
+    uint32_t FindCell( const float* point ) const;
+
+    const std::vector<Cell>& GetCells() const { return Cells; }
+    const std::vector<Portal>& GetPortals() const { return Portals; }
+
+    /** Portal polygons which didn't touch two cells and were dropped */
+    uint32_t GetNumDroppedPortals() const { return NumDroppedPortals; }
+
+private:
+    std::vector<Cell> Cells;
+    std::vector<Portal> Portals;
+    uint32_t NumDroppedPortals = 0;
+};
+
+class PortalVisibility {
+public:
+    /** Portals looked through behind each other at most */
+    static constexpr int MAX_DEPTH = 16;
+
+    /** Cells reached through more openings than this are tested against the camera frustum only */
+    static constexpr uint32_t MAX_FRUSTA_PER_CELL = 8;
+
+    /** Portals entered per update at most, keeps levels with many small portals in check */
+    static constexpr uint32_t MAX_PORTAL_VISITS = 4096;
+
+    /** Walks the portals, starting in the cell of the camera with the given frustum */
+    void Compute( const PortalGraph& graph, const float* cameraPosition, const PortalPlane* frustum, int numPlanes );
+
+    bool IsCellVisible( uint32_t cell ) const { return cell < CellFrusta.size() && !CellFrusta[cell].empty(); }
+
+    /** Whether the box can be seen through one of the openings the cell was reached with */
+    bool IsBoxVisible( uint32_t cell, const float* min, const float* max ) const;
+
+    /** Whether the box can be seen in any of the visible cells it overlaps */
+    bool IsBoxVisible( const float* min, const float* max ) const;
+
+    uint32_t GetCameraCell() const { return CameraCell; }
+    const std::vector<uint32_t>& GetVisibleCells() const { return VisibleCells; }
+    uint32_t GetNumFrusta() const { return static_cast<uint32_t>(Frusta.size()); }
+
+private:
+    struct Frustum {
+        uint32_t FirstPlane;
+        uint32_t NumPlanes;
+    };
+
+    void Visit( uint32_t cell, uint32_t frustum, int depth );
+    bool BoxInFrustum( uint32_t frustum, const float* min, const float* max ) const;
+
+    const PortalGraph* Graph = nullptr;
+    float Camera[3] = {};
+    uint32_t CameraCell = PortalGraph::OUTSIDE_CELL;
+    uint32_t NumPortalVisits = 0;
+
+    std::vector<PortalPlane> Planes;
+    std::vector<Frustum> Frusta;
+
+    /** Frusta every cell was reached with, empty for cells which can't be seen */
+    std::vector<std::vector<uint32_t>> CellFrusta;
+    std::vector<uint8_t> CellOverflow;
+    std::vector<uint32_t> VisibleCells;
+
+    /** Portals on the current path, they must not be entered twice */
+    std::vector<uint8_t> PortalOnPath;
+
+    /** Two buffers per depth for clipping the portal polygons */
+    std::vector<std::vector<float>> ClipBuffers;
+};
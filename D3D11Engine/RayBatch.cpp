@@ -0,0 +1,489 @@
+#include "RayBatch.h"
+#include <cstdint>
+#include <immintrin.h>
+
+namespace RayBatch {
+    namespace {
+        // Thin wrappers, so the kernels below are written only once for SSE and AVX. Functions taking
+        // more than three vectors get them by reference, x86 can't pass more of them aligned by value.
+        // Min and max take their arguments swapped, which makes them behave like std::min/std::max
+        // for NaNs as well, so the results match the scalar functions exactly.
+#ifdef __AVX__
+        typedef __m256 vfloat;
+
+        inline vfloat VLoad( const float* p ) { return _mm256_loadu_ps( p ); }
+        inline void VStore( float* p, vfloat a ) { _mm256_storeu_ps( p, a ); }
+        inline vfloat VSet( float f ) { return _mm256_set1_ps( f ); }
+        inline vfloat VAdd( vfloat a, vfloat b ) { return _mm256_add_ps( a, b ); }
+        inline vfloat VSub( vfloat a, vfloat b ) { return _mm256_sub_ps( a, b ); }
+        inline vfloat VMul( vfloat a, vfloat b ) { return _mm256_mul_ps( a, b ); }
+        inline vfloat VDiv( vfloat a, vfloat b ) { return _mm256_div_ps( a, b ); }
+        inline vfloat VMin( vfloat a, vfloat b ) { return _mm256_min_ps( b, a ); }
+        inline vfloat VMax( vfloat a, vfloat b ) { return _mm256_max_ps( b, a ); }
+        inline vfloat VLess( vfloat a, vfloat b ) { return _mm256_cmp_ps( a, b, _CMP_LT_OQ ); }
+        inline vfloat VGreater( vfloat a, vfloat b ) { return _mm256_cmp_ps( a, b, _CMP_GT_OQ ); }
+        inline vfloat VAnd( vfloat a, vfloat b ) { return _mm256_and_ps( a, b ); }
+        inline vfloat VOr( vfloat a, vfloat b ) { return _mm256_or_ps( a, b ); }
+        inline vfloat VAndNot( vfloat a, vfloat b ) { return _mm256_andnot_ps( a, b ); }
+        inline vfloat VSelect( vfloat a, vfloat b, vfloat mask ) { return _mm256_blendv_ps( a, b, mask ); }
+        inline int VMask( vfloat a ) { return _mm256_movemask_ps( a ); }
+        inline vfloat VLaneIndex() { return _mm256_setr_ps( 0, 1, 2, 3, 4, 5, 6, 7 ); }
+        inline vfloat VTrue() { return _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) ); }
+#else
+        typedef __m128 vfloat;
+
+        inline vfloat VLoad( const float* p ) { return _mm_loadu_ps( p ); }
+        inline void VStore( float* p, vfloat a ) { _mm_storeu_ps( p, a ); }
+        inline vfloat VSet( float f ) { return _mm_set1_ps( f ); }
+        inline vfloat VAdd( vfloat a, vfloat b ) { return _mm_add_ps( a, b ); }
+        inline vfloat VSub( vfloat a, vfloat b ) { return _mm_sub_ps( a, b ); }
+        inline vfloat VMul( vfloat a, vfloat b ) { return _mm_mul_ps( a, b ); }
+        inline vfloat VDiv( vfloat a, vfloat b ) { return _mm_div_ps( a, b ); }
+        inline vfloat VMin( vfloat a, vfloat b ) { return _mm_min_ps( b, a ); }
+        inline vfloat VMax( vfloat a, vfloat b ) { return _mm_max_ps( b, a ); }
+        inline vfloat VLess( vfloat a, vfloat b ) { return _mm_cmplt_ps( a, b ); }
+        inline vfloat VGreater( vfloat a, vfloat b ) { return _mm_cmpgt_ps( a, b ); }
+        inline vfloat VAnd( vfloat a, vfloat b ) { return _mm_and_ps( a, b ); }
+        inline vfloat VOr( vfloat a, vfloat b ) { return _mm_or_ps( a, b ); }
+        inline vfloat VAndNot( vfloat a, vfloat b ) { return _mm_andnot_ps( a, b ); }
+        inline vfloat VSelect( vfloat a, vfloat b, vfloat mask ) { return _mm_or_ps( _mm_and_ps( mask, b ), _mm_andnot_ps( mask, a ) ); }
+        inline int VMask( vfloat a ) { return _mm_movemask_ps( a ); }
+        inline vfloat VLaneIndex() { return _mm_setr_ps( 0, 1, 2, 3 ); }
+        inline vfloat VTrue() { return _mm_castsi128_ps( _mm_set1_epi32( -1 ) ); }
+#endif
+
+        const float TRI_EPSILON = 0.00001f;
+
+        /** Ray with its components spread over all lanes */
+        struct RayLanes {
+            vfloat OX, OY, OZ;
+            vfloat DX, DY, DZ;
+            vfloat IX, IY, IZ;
+        };
+
+        RayLanes BroadcastRay( const Ray& ray ) {
+            RayLanes r;
+            r.OX = VSet( ray.Origin[0] );
+            r.OY = VSet( ray.Origin[1] );
+            r.OZ = VSet( ray.Origin[2] );
+            r.DX = VSet( ray.Direction[0] );
+            r.DY = VSet( ray.Direction[1] );
+            r.DZ = VSet( ray.Direction[2] );
+
+            // Same as the scalar version, no reciprocal-approximation
+            r.IX = VSet( 1.0f / ray.Direction[0] );
+            r.IY = VSet( 1.0f / ray.Direction[1] );
+            r.IZ = VSet( 1.0f / ray.Direction[2] );
+            return r;
+        }
+
+        /** Puts one ray into each lane, the last one is repeated if there are less rays than lanes */
+        RayLanes GatherRays( const Ray* rays, size_t numRays ) {
+            alignas(32) float c[9][LANES];
+            for ( size_t l = 0; l < LANES; l++ ) {
+                const Ray& ray = rays[l < numRays ? l : numRays - 1];
+                for ( int a = 0; a < 3; a++ ) {
+                    c[a][l] = ray.Origin[a];
+                    c[3 + a][l] = ray.Direction[a];
+                    c[6 + a][l] = 1.0f / ray.Direction[a];
+                }
+            }
+
+            RayLanes r;
+            r.OX = VLoad( c[0] ); r.OY = VLoad( c[1] ); r.OZ = VLoad( c[2] );
+            r.DX = VLoad( c[3] ); r.DY = VLoad( c[4] ); r.DZ = VLoad( c[5] );
+            r.IX = VLoad( c[6] ); r.IY = VLoad( c[7] ); r.IZ = VLoad( c[8] );
+            return r;
+        }
+
+        /** Slab test, returns the mask of hits and the entry distance in t */
+        inline vfloat BoxKernel( const RayLanes& r, const vfloat& minX, const vfloat& minY, const vfloat& minZ, const vfloat& maxX, const vfloat& maxY, const vfloat& maxZ, vfloat& t ) {
+            const vfloat t1 = VMul( VSub( minX, r.OX ), r.IX );
+            const vfloat t2 = VMul( VSub( maxX, r.OX ), r.IX );
+            const vfloat t3 = VMul( VSub( minY, r.OY ), r.IY );
+            const vfloat t4 = VMul( VSub( maxY, r.OY ), r.IY );
+            const vfloat t5 = VMul( VSub( minZ, r.OZ ), r.IZ );
+            const vfloat t6 = VMul( VSub( maxZ, r.OZ ), r.IZ );
+
+            const vfloat tmin = VMax( VMax( VMin( t1, t2 ), VMin( t3, t4 ) ), VMin( t5, t6 ) );
+            const vfloat tmax = VMin( VMin( VMax( t1, t2 ), VMax( t3, t4 ) ), VMax( t5, t6 ) );
+
+            // Behind the ray or missed
+            const vfloat miss = VOr( VLess( tmax, VSet( 0.0f ) ), VGreater( tmin, tmax ) );
+
+            t = tmin;
+            return VAndNot( miss, VTrue() );
+        }
+
+        /** Moeller-Trumbore, returns the mask of hits and t, u and v */
+        inline vfloat TriangleKernel( const RayLanes& r,
+            const vfloat& v0x, const vfloat& v0y, const vfloat& v0z,
+            const vfloat& e1x, const vfloat& e1y, const vfloat& e1z,
+            const vfloat& e2x, const vfloat& e2y, const vfloat& e2z,
+            vfloat& t, vfloat& u, vfloat& v ) {
+
+            // pvec = cross(dir, edge2)
+            const vfloat px = VSub( VMul( r.DY, e2z ), VMul( r.DZ, e2y ) );
+            const vfloat py = VSub( VMul( r.DZ, e2x ), VMul( r.DX, e2z ) );
+            const vfloat pz = VSub( VMul( r.DX, e2y ), VMul( r.DY, e2x ) );
+
+            const vfloat det = VAdd( VAdd( VMul( e1x, px ), VMul( e1y, py ) ), VMul( e1z, pz ) );
+            vfloat miss = VAnd( VGreater( det, VSet( -TRI_EPSILON ) ), VLess( det, VSet( TRI_EPSILON ) ) );
+
+            const vfloat invDet = VDiv( VSet( 1.0f ), det );
+
+            const vfloat tx = VSub( r.OX, v0x );
+            const vfloat ty = VSub( r.OY, v0y );
+            const vfloat tz = VSub( r.OZ, v0z );
+
+            u = VMul( VAdd( VAdd( VMul( tx, px ), VMul( ty, py ) ), VMul( tz, pz ) ), invDet );
+            miss = VOr( miss, VOr( VLess( u, VSet( 0.0f ) ), VGreater( u, VSet( 1.0f ) ) ) );
+
+            // qvec = cross(tvec, edge1)
+            const vfloat qx = VSub( VMul( ty, e1z ), VMul( tz, e1y ) );
+            const vfloat qy = VSub( VMul( tz, e1x ), VMul( tx, e1z ) );
+            const vfloat qz = VSub( VMul( tx, e1y ), VMul( ty, e1x ) );
+
+            v = VMul( VAdd( VAdd( VMul( r.DX, qx ), VMul( r.DY, qy ) ), VMul( r.DZ, qz ) ), invDet );
+            miss = VOr( miss, VOr( VLess( v, VSet( 0.0f ) ), VGreater( VAdd( u, v ), VSet( 1.0f ) ) ) );
+
+            t = VMul( VAdd( VAdd( VMul( e2x, qx ), VMul( e2y, qy ) ), VMul( e2z, qz ) ), invDet );
+
+            return VAndNot( miss, VTrue() );
+        }
+
+        /** Mask of the lanes which hold one of the first count primitives */
+        inline vfloat ValidLanes( size_t base, size_t count ) {
+            return VLess( VAdd( VLaneIndex(), VSet( static_cast<float>(base) ) ), VSet( static_cast<float>(count) ) );
+        }
+
+        /** Keeps the closest distance and its index per lane */
+        struct ClosestLanes {
+            ClosestLanes() {
+                T = VSet( MISS );
+                Index = VSet( -1.0f );
+                U = VSet( 0.0f );
+                V = VSet( 0.0f );
+            }
+
+            inline void Update( const vfloat& hit, const vfloat& t, const vfloat& index ) {
+                const vfloat closer = VAnd( hit, VLess( t, T ) );
+                T = VSelect( T, t, closer );
+                Index = VSelect( Index, index, closer );
+            }
+
+            inline void Update( const vfloat& hit, const vfloat& t, const vfloat& index, const vfloat& u, const vfloat& v ) {
+                const vfloat closer = VAnd( hit, VLess( t, T ) );
+                T = VSelect( T, t, closer );
+                Index = VSelect( Index, index, closer );
+                U = VSelect( U, u, closer );
+                V = VSelect( V, v, closer );
+            }
+
+            /** Picks the closest lane, the lower index wins on equal distances */
+            int Reduce( float& outT, float* outU = nullptr, float* outV = nullptr ) const {
+                alignas(32) float t[LANES], index[LANES], u[LANES], v[LANES];
+                VStore( t, T );
+                VStore( index, Index );
+                VStore( u, U );
+                VStore( v, V );
+
+                int best = -1;
+                for ( size_t l = 0; l < LANES; l++ ) {
+                    if ( index[l] < 0.0f )
+                        continue;
+
+                    if ( best < 0 || t[l] < t[best] || (t[l] == t[best] && index[l] < index[best]) )
+                        best = static_cast<int>(l);
+                }
+
+                if ( best < 0 ) {
+                    outT = MISS;
+                    return -1;
+                }
+
+                outT = t[best];
+                if ( outU ) *outU = u[best];
+                if ( outV ) *outV = v[best];
+                return static_cast<int>(index[best]);
+            }
+
+            vfloat T, Index, U, V;
+        };
+
+        /** Loads LANES triangles of an indexed list into SoA-registers and runs the kernel */
+        template <typename Index>
+        inline vfloat IndexedTriangleKernel( const RayLanes& r, const uint8_t* positions, size_t stride, const Index* indices, size_t firstTriangle, size_t numTriangles, vfloat& t, vfloat& u, vfloat& v ) {
+            alignas(32) float c[9][LANES];
+            for ( size_t l = 0; l < LANES; l++ ) {
+                const size_t tri = firstTriangle + l < numTriangles ? firstTriangle + l : firstTriangle;
+                const float* p0 = reinterpret_cast<const float*>(positions + indices[tri * 3 + 0] * stride);
+                const float* p1 = reinterpret_cast<const float*>(positions + indices[tri * 3 + 1] * stride);
+                const float* p2 = reinterpret_cast<const float*>(positions + indices[tri * 3 + 2] * stride);
+
+                for ( int a = 0; a < 3; a++ ) {
+                    c[a][l] = p0[a];
+                    c[3 + a][l] = p1[a] - p0[a];
+                    c[6 + a][l] = p2[a] - p0[a];
+                }
+            }
+
+            return TriangleKernel( r, VLoad( c[0] ), VLoad( c[1] ), VLoad( c[2] ),
+                VLoad( c[3] ), VLoad( c[4] ), VLoad( c[5] ),
+                VLoad( c[6] ), VLoad( c[7] ), VLoad( c[8] ), t, u, v );
+        }
+
+        template <typename Index>
+        int ClosestTriangleIndexedImpl( const Ray& ray, const void* positions, size_t stride, const Index* indices, size_t numIndices, float tMin, float& outT ) {
+            const RayLanes r = BroadcastRay( ray );
+            const uint8_t* data = static_cast<const uint8_t*>(positions);
+            const size_t numTriangles = numIndices / 3;
+            const vfloat vMin = VSet( tMin );
+
+            ClosestLanes closest;
+            for ( size_t i = 0; i < numTriangles; i += LANES ) {
+                vfloat t, u, v;
+                vfloat hit = IndexedTriangleKernel( r, data, stride, indices, i, numTriangles, t, u, v );
+                hit = VAnd( VAnd( hit, VGreater( t, vMin ) ), ValidLanes( i, numTriangles ) );
+
+                if ( VMask( hit ) )
+                    closest.Update( hit, t, VAdd( VLaneIndex(), VSet( static_cast<float>(i) ) ) );
+            }
+
+            const int tri = closest.Reduce( outT );
+            return tri < 0 ? -1 : tri * 3;
+        }
+
+        /** Pushes zeros to the given arrays until their size is a multiple of LANES */
+        void Pad( std::vector<float>* arrays[], size_t numArrays, size_t count ) {
+            const size_t padded = (count + LANES - 1) / LANES * LANES;
+            for ( size_t i = 0; i < numArrays; i++ ) {
+                arrays[i]->resize( padded, 0.0f );
+            }
+        }
+    }
+
+    BoxSoA::BoxSoA() {
+        Count = 0;
+    }
+
+    void BoxSoA::Clear() {
+        MinX.clear(); MinY.clear(); MinZ.clear();
+        MaxX.clear(); MaxY.clear(); MaxZ.clear();
+        Count = 0;
+    }
+
+    void BoxSoA::Reserve( size_t n ) {
+        n += LANES;
+        MinX.reserve( n ); MinY.reserve( n ); MinZ.reserve( n );
+        MaxX.reserve( n ); MaxY.reserve( n ); MaxZ.reserve( n );
+    }
+
+    /** Adds a box, returns its index */
+    size_t BoxSoA::Add( const float min[3], const float max[3] ) {
+        std::vector<float>* arrays[] = { &MinX, &MinY, &MinZ, &MaxX, &MaxY, &MaxZ };
+        for ( auto a : arrays ) {
+            a->resize( Count );
+        }
+
+        MinX.push_back( min[0] ); MinY.push_back( min[1] ); MinZ.push_back( min[2] );
+        MaxX.push_back( max[0] ); MaxY.push_back( max[1] ); MaxZ.push_back( max[2] );
+
+        Pad( arrays, 6, Count + 1 );
+        return Count++;
+    }
+
+    TriangleSoA::TriangleSoA() {
+        Count = 0;
+    }
+
+    void TriangleSoA::Clear() {
+        V0X.clear(); V0Y.clear(); V0Z.clear();
+        E1X.clear(); E1Y.clear(); E1Z.clear();
+        E2X.clear(); E2Y.clear(); E2Z.clear();
+        Count = 0;
+    }
+
+    void TriangleSoA::Reserve( size_t n ) {
+        n += LANES;
+        V0X.reserve( n ); V0Y.reserve( n ); V0Z.reserve( n );
+        E1X.reserve( n ); E1Y.reserve( n ); E1Z.reserve( n );
+        E2X.reserve( n ); E2Y.reserve( n ); E2Z.reserve( n );
+    }
+
+    /** Adds a triangle, returns its index */
+    size_t TriangleSoA::Add( const float v0[3], const float v1[3], const float v2[3] ) {
+        std::vector<float>* arrays[] = { &V0X, &V0Y, &V0Z, &E1X, &E1Y, &E1Z, &E2X, &E2Y, &E2Z };
+        for ( auto a : arrays ) {
+            a->resize( Count );
+        }
+
+        V0X.push_back( v0[0] ); V0Y.push_back( v0[1] ); V0Z.push_back( v0[2] );
+        E1X.push_back( v1[0] - v0[0] ); E1Y.push_back( v1[1] - v0[1] ); E1Z.push_back( v1[2] - v0[2] );
+        E2X.push_back( v2[0] - v0[0] ); E2Y.push_back( v2[1] - v0[1] ); E2Z.push_back( v2[2] - v0[2] );
+
+        Pad( arrays, 9, Count + 1 );
+        return Count++;
+    }
+
+    void TriangleSoA::AddIndexed( const void* positions, size_t stride, const unsigned short* indices, size_t numIndices ) {
+        const uint8_t* data = static_cast<const uint8_t*>(positions);
+        Reserve( Count + numIndices / 3 );
+        for ( size_t i = 0; i + 2 < numIndices; i += 3 ) {
+            Add( reinterpret_cast<const float*>(data + indices[i] * stride),
+                reinterpret_cast<const float*>(data + indices[i + 1] * stride),
+                reinterpret_cast<const float*>(data + indices[i + 2] * stride) );
+        }
+    }
+
+    void TriangleSoA::AddIndexed( const void* positions, size_t stride, const unsigned int* indices, size_t numIndices ) {
+        const uint8_t* data = static_cast<const uint8_t*>(positions);
+        Reserve( Count + numIndices / 3 );
+        for ( size_t i = 0; i + 2 < numIndices; i += 3 ) {
+            Add( reinterpret_cast<const float*>(data + indices[i] * stride),
+                reinterpret_cast<const float*>(data + indices[i + 1] * stride),
+                reinterpret_cast<const float*>(data + indices[i + 2] * stride) );
+        }
+    }
+
+    /** Writes the distance to each box into outT, or MISS */
+    size_t IntersectBoxes( const Ray& ray, const BoxSoA& boxes, float* outT ) {
+        const RayLanes r = BroadcastRay( ray );
+        const size_t count = boxes.Size();
+
+        size_t numHits = 0;
+        for ( size_t i = 0; i < count; i += LANES ) {
+            vfloat t;
+            vfloat hit = BoxKernel( r,
+                VLoad( &boxes.MinX[i] ), VLoad( &boxes.MinY[i] ), VLoad( &boxes.MinZ[i] ),
+                VLoad( &boxes.MaxX[i] ), VLoad( &boxes.MaxY[i] ), VLoad( &boxes.MaxZ[i] ), t );
+            hit = VAnd( hit, ValidLanes( i, count ) );
+
+            alignas(32) float lanes[LANES];
+            VStore( lanes, VSelect( VSet( MISS ), t, hit ) );
+
+            const int mask = VMask( hit );
+            for ( size_t l = 0; l < LANES && i + l < count; l++ ) {
+                outT[i + l] = lanes[l];
+                numHits += (mask >> l) & 1;
+            }
+        }
+
+        return numHits;
+    }
+
+    /** Returns the index of the closest box hit, or -1 */
+    int ClosestBox( const Ray& ray, const BoxSoA& boxes, float& outT ) {
+        const RayLanes r = BroadcastRay( ray );
+        const size_t count = boxes.Size();
+
+        ClosestLanes closest;
+        for ( size_t i = 0; i < count; i += LANES ) {
+            vfloat t;
+            vfloat hit = BoxKernel( r,
+                VLoad( &boxes.MinX[i] ), VLoad( &boxes.MinY[i] ), VLoad( &boxes.MinZ[i] ),
+                VLoad( &boxes.MaxX[i] ), VLoad( &boxes.MaxY[i] ), VLoad( &boxes.MaxZ[i] ), t );
+            hit = VAnd( hit, ValidLanes( i, count ) );
+
+            if ( VMask( hit ) )
+                closest.Update( hit, t, VAdd( VLaneIndex(), VSet( static_cast<float>(i) ) ) );
+        }
+
+        return closest.Reduce( outT );
+    }
+
+    /** Returns the index of the closest triangle hit with a distance greater than tMin, or -1 */
+    int ClosestTriangle( const Ray& ray, const TriangleSoA& triangles, float tMin, float& outT, float& outU, float& outV ) {
+        const RayLanes r = BroadcastRay( ray );
+        const size_t count = triangles.Size();
+        const vfloat vMin = VSet( tMin );
+
+        ClosestLanes closest;
+        for ( size_t i = 0; i < count; i += LANES ) {
+            vfloat t, u, v;
+            vfloat hit = TriangleKernel( r,
+                VLoad( &triangles.V0X[i] ), VLoad( &triangles.V0Y[i] ), VLoad( &triangles.V0Z[i] ),
+                VLoad( &triangles.E1X[i] ), VLoad( &triangles.E1Y[i] ), VLoad( &triangles.E1Z[i] ),
+                VLoad( &triangles.E2X[i] ), VLoad( &triangles.E2Y[i] ), VLoad( &triangles.E2Z[i] ), t, u, v );
+            hit = VAnd( VAnd( hit, VGreater( t, vMin ) ), ValidLanes( i, count ) );
+
+            if ( VMask( hit ) )
+                closest.Update( hit, t, VAdd( VLaneIndex(), VSet( static_cast<float>(i) ) ), u, v );
+        }
+
+        return closest.Reduce( outT, &outU, &outV );
+    }
+
+    int ClosestTriangleIndexed( const Ray& ray, const void* positions, size_t stride, const unsigned short* indices, size_t numIndices, float tMin, float& outT ) {
+        return ClosestTriangleIndexedImpl( ray, positions, stride, indices, numIndices, tMin, outT );
+    }
+
+    int ClosestTriangleIndexed( const Ray& ray, const void* positions, size_t stride, const unsigned int* indices, size_t numIndices, float tMin, float& outT ) {
+        return ClosestTriangleIndexedImpl( ray, positions, stride, indices, numIndices, tMin, outT );
+    }
+
+    /** LANES rays are tested against each box at once */
+    void ClosestBoxes( const Ray* rays, size_t numRays, const BoxSoA& boxes, int* outIndices, float* outT ) {
+        const size_t count = boxes.Size();
+
+        for ( size_t first = 0; first < numRays; first += LANES ) {
+            const size_t packetSize = numRays - first < LANES ? numRays - first : LANES;
+            const RayLanes r = GatherRays( rays + first, packetSize );
+
+            vfloat bestT = VSet( MISS );
+            vfloat bestIndex = VSet( -1.0f );
+            for ( size_t i = 0; i < count; i++ ) {
+                vfloat t;
+                const vfloat hit = BoxKernel( r,
+                    VSet( boxes.MinX[i] ), VSet( boxes.MinY[i] ), VSet( boxes.MinZ[i] ),
+                    VSet( boxes.MaxX[i] ), VSet( boxes.MaxY[i] ), VSet( boxes.MaxZ[i] ), t );
+
+                const vfloat closer = VAnd( hit, VLess( t, bestT ) );
+                bestT = VSelect( bestT, t, closer );
+                bestIndex = VSelect( bestIndex, VSet( static_cast<float>(i) ), closer );
+            }
+
+            alignas(32) float t[LANES], index[LANES];
+            VStore( t, bestT );
+            VStore( index, bestIndex );
+            for ( size_t l = 0; l < packetSize; l++ ) {
+                outIndices[first + l] = static_cast<int>(index[l]);
+                outT[first + l] = t[l];
+            }
+        }
+    }
+
+    /** LANES rays are tested against each triangle at once */
+    void ClosestTriangles( const Ray* rays, size_t numRays, const TriangleSoA& triangles, float tMin, int* outIndices, float* outT ) {
+        const size_t count = triangles.Size();
+        const vfloat vMin = VSet( tMin );
+
+        for ( size_t first = 0; first < numRays; first += LANES ) {
+            const size_t packetSize = numRays - first < LANES ? numRays - first : LANES;
+            const RayLanes r = GatherRays( rays + first, packetSize );
+
+            vfloat bestT = VSet( MISS );
+            vfloat bestIndex = VSet( -1.0f );
+            for ( size_t i = 0; i < count; i++ ) {
+                vfloat t, u, v;
+                vfloat hit = TriangleKernel( r,
+                    VSet( triangles.V0X[i] ), VSet( triangles.V0Y[i] ), VSet( triangles.V0Z[i] ),
+                    VSet( triangles.E1X[i] ), VSet( triangles.E1Y[i] ), VSet( triangles.E1Z[i] ),
+                    VSet( triangles.E2X[i] ), VSet( triangles.E2Y[i] ), VSet( triangles.E2Z[i] ), t, u, v );
+                hit = VAnd( hit, VGreater( t, vMin ) );
+
+                const vfloat closer = VAnd( hit, VLess( t, bestT ) );
+                bestT = VSelect( bestT, t, closer );
+                bestIndex = VSelect( bestIndex, VSet( static_cast<float>(i) ), closer );
+            }
+
+            alignas(32) float t[LANES], index[LANES];
+            VStore( t, bestT );
+            VStore( index, bestIndex );
+            for ( size_t l = 0; l < packetSize; l++ ) {
+                outIndices[first + l] = static_cast<int>(index[l]);
+                outT[first + l] = t[l];
+            }
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/** Ray vs. box and ray vs. triangle tests on many primitives at once
+
+    Does the same math as Toolbox::IntersectBox and Toolbox::IntersectTri, but tests 4 (SSE) or
+    8 (AVX builds) primitives per instruction. The primitives are stored as structure of arrays.
+    The packet-functions test that many rays against each primitive instead.
+
+    All "closest"-queries return the first primitive with the smallest distance, just like a
+    scalar loop using "t < closest" would. Only depends on SSE2/AVX, not on the engine. */
+namespace RayBatch {
+#ifdef __AVX__
+    const size_t LANES = 8;
+#else
+    const size_t LANES = 4;
+#endif
+
+    /** Returned as distance for primitives which weren't hit */
+    const float MISS = 3.402823466e+38f;
+
+    struct Ray {
+        float Origin[3];
+        float Direction[3];
+    };
+
+    inline Ray MakeRay( const float origin[3], const float direction[3] ) {
+        Ray r;
+        for ( int i = 0; i < 3; i++ ) {
+            r.Origin[i] = origin[i];
+            r.Direction[i] = direction[i];
+        }
+        return r;
+    }
+
+    /** Axis aligned boxes, stored as structure of arrays. The arrays are padded to a multiple of LANES. */
+    class BoxSoA {
+    public:
+        BoxSoA();
+
+        void Clear();
+        void Reserve( size_t n );
+
+        /** Adds a box, returns its index */
+        size_t Add( const float min[3], const float max[3] );
+
+        size_t Size() const { return Count; }
+
+        std::vector<float> MinX, MinY, MinZ;
+        std::vector<float> MaxX, MaxY, MaxZ;
+
+    private:
+        size_t Count;
+    };
+
+    /** Triangles as first vertex and the two edges starting at it, stored as structure of arrays */
+    class TriangleSoA {
+    public:
+        TriangleSoA();
+
+        void Clear();
+        void Reserve( size_t n );
+
+        /** Adds a triangle, returns its index */
+        size_t Add( const float v0[3], const float v1[3], const float v2[3] );
+
+        /** Adds all triangles of an indexed trianglelist. Stride is given in bytes. */
+        void AddIndexed( const void* positions, size_t stride, const unsigned short* indices, size_t numIndices );
+        void AddIndexed( const void* positions, size_t stride, const unsigned int* indices, size_t numIndices );
+
+        size_t Size() const { return Count; }
+
+        std::vector<float> V0X, V0Y, V0Z;
+        std::vector<float> E1X, E1Y, E1Z;
+        std::vector<float> E2X, E2Y, E2Z;
+
+    private:
+        size_t Count;
+    };
+
+    /** Writes the distance to each box into outT, or MISS. A hit is reported with the distance of the entry point,
+        which is negative if the origin is inside the box. Returns the number of boxes hit. */
+    size_t IntersectBoxes( const Ray& ray, const BoxSoA& boxes, float* outT );
+
+    /** Returns the index of the closest box hit, or -1 */
+    int ClosestBox( const Ray& ray, const BoxSoA& boxes, float& outT );
+
+    /** Returns the index of the closest triangle hit with a distance greater than tMin, or -1 */
+    int ClosestTriangle( const Ray& ray, const TriangleSoA& triangles, float tMin, float& outT, float& outU, float& outV );
+
+    /** Same as ClosestTriangle, but reads the triangles from an indexed trianglelist. Returns the index of the
+        first index of the triangle. Stride is given in bytes. */
+    int ClosestTriangleIndexed( const Ray& ray, const void* positions, size_t stride, const unsigned short* indices, size_t numIndices, float tMin, float& outT );
+    int ClosestTriangleIndexed( const Ray& ray, const void* positions, size_t stride, const unsigned int* indices, size_t numIndices, float tMin, float& outT );
+
+    /** Packet versions, LANES rays are tested against each primitive at once. Write the closest index (or -1)
+        and distance of each ray into outIndices and outT. */
+    void ClosestBoxes( const Ray* rays, size_t numRays, const BoxSoA& boxes, int* outIndices, float* outT );
+    void ClosestTriangles( const Ray* rays, size_t numRays, const TriangleSoA& triangles, float tMin, int* outIndices, float* outT );
+}
@@ -22,4 +22,5 @@ void SV_Border::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
 /** Sets the border color */
 void SV_Border::SetBorderColor( const D2D1_COLOR_F& color ) {
     BorderColor = color;
+    Invalidate();
 }
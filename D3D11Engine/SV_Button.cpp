@@ -95,14 +95,19 @@ void SV_Button::SetCaption( const std::string& caption ) {
     } else {
         LogWarn() << "Failed to create TextLayout for caption '" << caption << "'";
     }
+
+    Invalidate();
 }
 
 /** Sets the position and size of this sub-view */
 void SV_Button::SetRect( const D2D1_RECT_F& rect ) {
+    D2D1_RECT_F r = ViewRect;
+
     D2DSubView::SetRect( rect );
 
-    // Need to update the layout
-    SetCaption( Caption );
+    // Need to update the layout, if it actually changed
+    if ( memcmp( &r, &ViewRect, sizeof( r ) ) != 0 || !CaptionLayout )
+        SetCaption( Caption );
 }
 
 /** Processes a window-message. Return false to stop the message from going to children */
@@ -143,7 +148,10 @@ bool SV_Button::OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPA
 
 /** Sets the button state */
 void SV_Button::SetPressed( bool pressed ) {
-    IsPressed = pressed;
+    if ( IsPressed != pressed ) {
+        IsPressed = pressed;
+        Invalidate();
+    }
 }
 
 /** Sets the callback */
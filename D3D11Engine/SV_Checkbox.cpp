@@ -6,6 +6,7 @@
 SV_Checkbox::SV_Checkbox( D2DView* view, D2DSubView* parent ) : D2DSubView( view, parent ) {
     CaptionLayout = nullptr;
     DataToUpdate = nullptr;
+    LastData = false;
     IsChecked = false;
     SetCheckedChangedCallback( nullptr, nullptr );
 }
@@ -59,9 +60,15 @@ void SV_Checkbox::DrawCross( const D2D1_RECT_F& r ) {
 
 /** Sets the state */
 void SV_Checkbox::SetChecked( bool active ) {
-    IsChecked = active;
-    if ( DataToUpdate )
+    if ( IsChecked != active ) {
+        IsChecked = active;
+        Invalidate();
+    }
+
+    if ( DataToUpdate ) {
         *DataToUpdate = IsChecked;
+        LastData = IsChecked;
+    }
 }
 
 /** Returns the state */
@@ -89,11 +96,28 @@ void SV_Checkbox::SetCaption( const std::wstring& caption ) {
     } else {
         LogWarn() << "Failed to create TextLayout for caption '" << Toolbox::ToMultiByte( caption ) << "'";
     }
+
+    Invalidate();
 }
 
 /** Sets the data location to update with this checkbox */
 void SV_Checkbox::SetDataToUpdate( bool* data ) {
     DataToUpdate = data;
+    if ( data )
+        LastData = *data;
+}
+
+/** Takes over values the bound data got from somewhere else */
+void SV_Checkbox::Animate( float deltaTime ) {
+    if ( DataToUpdate && *DataToUpdate != LastData ) {
+        LastData = *DataToUpdate;
+        if ( IsChecked != LastData ) {
+            IsChecked = LastData;
+            Invalidate();
+        }
+    }
+
+    D2DSubView::Animate( deltaTime );
 }
 
 /** Sets the position and size of this sub-view */
@@ -103,10 +127,12 @@ void SV_Checkbox::SetRect( const D2D1_RECT_F& rect ) {
     // Restrict the vertical size to the size of the checkbox
     r.bottom = rect.top + SV_CHKBOX_BOX_SIZE_XY;
 
+    D2D1_RECT_F old = ViewRect;
     D2DSubView::SetRect( r );
 
-    // Need to update the layout
-    SetCaption( Caption );
+    // Need to update the layout, if it actually changed
+    if ( memcmp( &old, &ViewRect, sizeof( old ) ) != 0 || !CaptionLayout )
+        SetCaption( Caption );
 }
 
 void SV_Checkbox::SetCheckedChangedCallback( SV_CheckboxCheckedChangedCallback cb, void* userdata ) {
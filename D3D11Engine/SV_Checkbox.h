@@ -35,6 +35,9 @@ public:
     /** Processes a window-message. Return false to stop the message from going to children */
     virtual bool OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPARAM lParam, const D2D1_RECT_F& clientRectAbs );
 
+    /** Takes over values the bound data got from somewhere else */
+    virtual void Animate( float deltaTime );
+
 protected:
     /** Draws the cross */
     void DrawCross( const D2D1_RECT_F& r );
@@ -43,6 +46,9 @@ protected:
     bool IsChecked;
     bool* DataToUpdate;
 
+    /** Bound data as of the last time the checkbox wrote or showed it */
+    bool LastData;
+
     /** Current Caption */
     std::wstring Caption;
 
@@ -5,6 +5,8 @@
 
 SV_Label::SV_Label( D2DView* view, D2DSubView* parent ) : D2DSubView( view, parent ) {
     CaptionLayout = nullptr;
+    CaptionWidth = 0.0f;
+    CaptionHeight = 0.0f;
     VertAlignment = DWRITE_PARAGRAPH_ALIGNMENT_NEAR;
     HorizAlignment = DWRITE_TEXT_ALIGNMENT_LEADING;
     DrawBackground = false;
@@ -30,7 +32,7 @@ void SV_Label::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
             MainView->GetBrush()->SetColor( D2D1::ColorF( 0, 0, 0, 0.7f ) );
 
             if ( HorizAlignment == DWRITE_TEXT_ALIGNMENT_LEADING ) {
-                MainView->GetRenderTarget()->FillRoundedRectangle( D2D1::RoundedRect( D2D1::RectF( ViewRect.left - 1, ViewRect.top, ViewRect.left + D2DView::GetLabelTextWidth( CaptionLayout, Caption.length() ) + 1, ViewRect.top + D2DView::GetTextHeight( CaptionLayout, Caption.length() ) + 3 ), 2, 2 ), MainView->GetBrush() );
+                MainView->GetRenderTarget()->FillRoundedRectangle( D2D1::RoundedRect( D2D1::RectF( ViewRect.left - 1, ViewRect.top, ViewRect.left + CaptionWidth + 1, ViewRect.top + CaptionHeight + 3 ), 2, 2 ), MainView->GetBrush() );
             } else {
                 MainView->GetRenderTarget()->FillRoundedRectangle( D2D1::RoundedRect( ViewRect, 2, 2 ), MainView->GetBrush() );
             }
@@ -66,11 +68,20 @@ void SV_Label::SetCaption( const std::wstring& caption ) {
     CaptionLayout->SetFontSize( TextSize, range );
 
     if ( CaptionLayout ) {
-        SetVertAlignment( VertAlignment );
-        SetHorizAlignment( HorizAlignment );
+        CaptionLayout->SetParagraphAlignment( VertAlignment );
+        CaptionLayout->SetTextAlignment( HorizAlignment );
     } else {
         LogWarn() << "Failed to create TextLayout for caption '" << Toolbox::ToMultiByte( caption) << "'";
     }
+
+    UpdateCaptionSize();
+    Invalidate();
+}
+
+/** Measures the text for the background */
+void SV_Label::UpdateCaptionSize() {
+    CaptionWidth = CaptionLayout ? D2DView::GetLabelTextWidth( CaptionLayout, Caption.length() ) : 0.0f;
+    CaptionHeight = CaptionLayout ? D2DView::GetTextHeight( CaptionLayout, Caption.length() ) : 0.0f;
 }
 
 /** Sets the position and size of this sub-view */
@@ -88,7 +99,11 @@ void SV_Label::SetRect( const D2D1_RECT_F& rect ) {
 
 /** Sets the horizontal alignment of this text */
 void SV_Label::SetHorizAlignment( DWRITE_TEXT_ALIGNMENT alignment ) {
+    if ( HorizAlignment == alignment )
+        return;
+
     HorizAlignment = alignment;
+    Invalidate();
 
     if ( CaptionLayout )
         CaptionLayout->SetTextAlignment( alignment );
@@ -96,7 +111,11 @@ void SV_Label::SetHorizAlignment( DWRITE_TEXT_ALIGNMENT alignment ) {
 
 /** Sets the horizontal alignment of this text */
 void SV_Label::SetVertAlignment( DWRITE_PARAGRAPH_ALIGNMENT alignment ) {
+    if ( VertAlignment == alignment )
+        return;
+
     VertAlignment = alignment;
+    Invalidate();
 
     if ( CaptionLayout )
         CaptionLayout->SetParagraphAlignment( alignment );
@@ -104,7 +123,10 @@ void SV_Label::SetVertAlignment( DWRITE_PARAGRAPH_ALIGNMENT alignment ) {
 
 /** Sets if this text should have a background */
 void SV_Label::SetDrawBackground( bool bgr ) {
-    DrawBackground = bgr;
+    if ( DrawBackground != bgr ) {
+        DrawBackground = bgr;
+        Invalidate();
+    }
 }
 
 /** Sets the text size */
@@ -118,10 +140,14 @@ void SV_Label::SetTextSize( float size ) {
 
         if ( CaptionLayout )
             CaptionLayout->SetFontSize( TextSize, range );
+
+        UpdateCaptionSize();
+        Invalidate();
     }
 }
 
 /** Sets the text color */
 void SV_Label::SetTextColor( const D2D1_COLOR_F& color ) {
     TextColor = color;
+    Invalidate();
 }
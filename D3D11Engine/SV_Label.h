@@ -34,6 +34,9 @@ public:
     void SetDrawBackground( bool bgr );
 
 protected:
+    /** Measures the text for the background */
+    void UpdateCaptionSize();
+
     /** Current Caption */
     std::wstring Caption;
 
@@ -43,6 +46,10 @@ protected:
     /** Text layout */
     IDWriteTextLayout* CaptionLayout;
 
+    /** Size of the text, updated with the layout */
+    float CaptionWidth;
+    float CaptionHeight;
+
     /** Alignment */
     DWRITE_TEXT_ALIGNMENT HorizAlignment;
     DWRITE_PARAGRAPH_ALIGNMENT VertAlignment;
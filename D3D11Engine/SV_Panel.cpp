@@ -78,17 +78,20 @@ void SV_Panel::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
 /** Sets the border color */
 void SV_Panel::SetPanelColor( const D2D1_COLOR_F& color ) {
     PanelColor = color;
+    Invalidate();
 }
 
 /** Set if this panel should have a shadow */
 void SV_Panel::SetPanelShadow( bool shadow, float range ) {
     HasShadow = shadow;
     ShadowRange = range;
+    Invalidate();
 }
 
 /** Set if this panel should render as a solid color */
 void SV_Panel::SetRenderMode( EPanelRenderMode mode ) {
     RenderMode = mode;
+    Invalidate();
 }
 
 /** Returns the panels solid color */
@@ -121,15 +124,18 @@ HRESULT SV_Panel::SetD3D11TextureAsImage( ID3D11Texture2D* texture, INT2 size )
     MainView->GetRenderTarget()->CreateBitmap( D2D1::SizeU( size.x, size.y ), mapped.pData, mapped.RowPitch, properties, &Image );
     engine->GetContext()->Unmap( staging.Get(), 0 );
 
+    Invalidate();
     return S_OK;
 }
 
 /** Set if this should have a dark overlay on top */
 void SV_Panel::SetDarkOverlay( bool value ) {
     HasDarkOverlay = value;
+    Invalidate();
 }
 
 /** Set if this should have a glossy outline */
 void SV_Panel::SetGlossyOutline( bool value ) {
     HasGlossyOutline = value;
+    Invalidate();
 }
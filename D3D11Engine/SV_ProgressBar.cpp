@@ -36,5 +36,8 @@ void SV_ProgressBar::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
 
 /** Sets the progress of this bar */
 void SV_ProgressBar::SetProgress( float p ) {
-    Progress = p;
+    if ( Progress != p ) {
+        Progress = p;
+        Invalidate();
+    }
 }
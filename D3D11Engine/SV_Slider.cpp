@@ -19,6 +19,8 @@ SV_Slider::SV_Slider( D2DView* view, D2DSubView* parent ) : D2DSubView( view, pa
 
     DataToUpdate = nullptr;
     DataToUpdateInt = nullptr;
+    LastData = 0.0f;
+    LastDataInt = 0;
 
     // Add label
     ValueLabel = new SV_Label( view, this );
@@ -173,36 +175,7 @@ void SV_Slider::RenderSlider() {
     }
     ValueLabel->SetDisabled( IsDisabled() );
 
-    // Only change when needed
-    if ( (DraggingSlider && (!DataToUpdate)) || (DataToUpdate && *DataToUpdate != Value) || !ValueLabel ) {
-        if ( DisplayValues.empty() ) {
-            // Remove trailing zeros
-            std::string str;
-            char txt[32];
-
-            if ( IsIntegral ) {
-                sprintf_s( txt, "%d", (int)(Value * DisplayMultiplier + 0.5f) );
-                str = txt;
-            } else {
-                sprintf_s( txt, "%.2f", Value * DisplayMultiplier );
-                str = txt;
-
-                str.erase( str.find_last_not_of( '0' ) + 1, std::string::npos );
-
-                // Fix integral numbers going like "100.", make them go "100" instead"
-                if ( str.back() == '.' )
-                    str.pop_back();
-            }
-
-            ValueLabel->SetCaption( Toolbox::ToWideChar( str ) );
-        } else {
-            unsigned int v = (unsigned int)(Value + 0.5f);
-            if ( v >= DisplayValues.size() )
-                v = DisplayValues.size() - 1;
-
-            ValueLabel->SetCaption( Toolbox::ToWideChar( DisplayValues[v] ) );
-        }
-    }
+    // The caption is updated along with the value, setting it here would invalidate while drawing
 
     /*
     //SetLinearGradientToRect(D2DObjects->BrushCollection.LinearReflectBrushHigh,&bc,true);
@@ -215,31 +188,60 @@ void SV_Slider::RenderSlider() {
     bc.bottom=sc.top+BarPosition+(BarSize/2);*/
 }
 
+/** Takes over values the bound data got from somewhere else */
+void SV_Slider::Animate( float deltaTime ) {
+    if ( !DraggingSlider ) {
+        if ( DataToUpdate && *DataToUpdate != LastData ) {
+            LastData = *DataToUpdate;
+            ShowValueP( (LastData - Min) / (Max - Min) );
+        } else if ( DataToUpdateInt && *DataToUpdateInt != LastDataInt ) {
+            LastDataInt = *DataToUpdateInt;
+            ShowValueP( ((float)LastDataInt - Min) / (Max - Min) );
+        }
+    }
+
+    D2DSubView::Animate( deltaTime );
+}
+
 /** Sets the value of this slider (0..1) */
 void SV_Slider::SetValueP( float value ) {
-    value = std::min( 1.0f, value );
-    value = std::max( 0.0f, value );
-
     float oldVal = Value;
-    Value = Toolbox::lerp( Min, Max, value );
-
-    if ( IsIntegral )
-        Value = (float)((int)(Value + 0.5f));
-
-    BarPosition = (GetSize().width - ((SV_SLIDERCONTROL_SLIDER_SIZEX + 2) * 2)) * value + (SV_SLIDERCONTROL_SLIDER_SIZEX + 2);
+    ShowValueP( value );
 
     // Update data
-    if ( DataToUpdate )
+    if ( DataToUpdate ) {
         *DataToUpdate = Value;
+        LastData = Value;
+    }
 
-    if ( DataToUpdateInt )
+    if ( DataToUpdateInt ) {
         *DataToUpdateInt = (int)(Value + 0.5f);
+        LastDataInt = *DataToUpdateInt;
+    }
 
     // Fire callback
     if ( oldVal != Value && ValueChangedCallback )
         ValueChangedCallback( this, ValueChangedUserdata );
+}
+
+/** Moves the bar and updates the caption, without touching the bound data */
+void SV_Slider::ShowValueP( float value ) {
+    value = std::min( 1.0f, value );
+    value = std::max( 0.0f, value );
+
+    Value = Toolbox::lerp( Min, Max, value );
+
+    if ( IsIntegral )
+        Value = (float)((int)(Value + 0.5f));
+
+    BarPosition = (GetSize().width - ((SV_SLIDERCONTROL_SLIDER_SIZEX + 2) * 2)) * value + (SV_SLIDERCONTROL_SLIDER_SIZEX + 2);
+    Invalidate();
+
+    UpdateCaption();
+}
 
-    // Update caption:
+/** Puts the current value into the label */
+void SV_Slider::UpdateCaption() {
     if ( DisplayValues.empty() ) {
         // Remove trailing zeros
         std::string str;
@@ -283,11 +285,15 @@ void SV_Slider::SetMinMax( float min, float max ) {
 /** Sets the data location to update with this slider */
 void SV_Slider::SetDataToUpdate( float* data ) {
     DataToUpdate = data;
+    if ( data )
+        LastData = *data;
 }
 
 /** Sets the data location to update with this slider */
 void SV_Slider::SetDataToUpdate( int* data ) {
     DataToUpdateInt = data;
+    if ( data )
+        LastDataInt = *data;
 }
 
 /** Sets the callback */
@@ -309,9 +315,11 @@ void SV_Slider::SetIsIntegralSlider( bool value ) {
 /** Sets an array of values to display */
 void SV_Slider::SetDisplayValues( const std::vector<std::string>& values ) {
     DisplayValues = values;
+    UpdateCaption();
 }
 
 /** Sets a value multiplier for displaying purposes */
 void SV_Slider::SetDisplayMultiplier( float mul ) {
     DisplayMultiplier = mul;
+    UpdateCaption();
 }
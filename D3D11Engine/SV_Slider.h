@@ -19,6 +19,9 @@ public:
     /** Processes a window-message. Return false to stop the message from going to children */
     virtual bool OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam, LPARAM lParam, const D2D1_RECT_F& clientRectAbs );
 
+    /** Takes over values the bound data got from somewhere else */
+    virtual void Animate( float deltaTime );
+
     /** Sets the value of this slider (0..1) */
     void SetValueP( float value );
 
@@ -51,6 +54,12 @@ protected:
     /** Draws the slider */
     void RenderSlider();
 
+    /** Moves the bar and updates the caption, without touching the bound data */
+    void ShowValueP( float value );
+
+    /** Puts the current value into the label */
+    void UpdateCaption();
+
     /** Current bar position */
     float BarPosition;
     bool DraggingSlider;
@@ -61,6 +70,10 @@ protected:
     float Max;
     float* DataToUpdate;
     int* DataToUpdateInt;
+
+    /** Bound data as of the last time the slider wrote or showed it */
+    float LastData;
+    int LastDataInt;
     SV_Label* ValueLabel;
     bool IsIntegral;
     std::vector<std::string> DisplayValues;
@@ -27,6 +27,7 @@ SV_TabControl::~SV_TabControl() {}
 
 SV_TabControl_Tab::SV_TabControl_Tab() {
     CaptionLayout = nullptr;
+    CaptionWidth = 0.0f;
 }
 
 SV_TabControl_Tab::~SV_TabControl_Tab() {
@@ -52,6 +53,9 @@ void SV_TabControl::SetTabCaption( const std::string& caption, SV_TabControl_Tab
     } else {
         LogWarn() << "Failed to create TextLayout for caption '" << caption << "'";
     }
+
+    tab->CaptionWidth = D2DView::GetLabelTextWidth( tab->CaptionLayout, caption.length() );
+    Invalidate();
 }
 
 /** Draws this sub-view */
@@ -67,7 +71,7 @@ void SV_TabControl::Draw( const D2D1_RECT_F& clientRectAbs, float deltaTime ) {
             continue;
         }
 
-        float width = D2DView::GetLabelTextWidth( it->second.CaptionLayout, it->first.length() );
+        float width = it->second.CaptionWidth;
 
         D2D1_RECT_F tabRect = D2D1::RectF( x + ViewRect.left, ViewRect.top, x + ViewRect.left + width + 10.0f, ViewRect.top + SV_TABCONTROL_HEADER_SIZE_Y );
 
@@ -151,7 +155,7 @@ bool SV_TabControl::OnWindowMessage( HWND hWnd, unsigned int msg, WPARAM wParam,
                 continue;
             }
 
-            float width = D2DView::GetLabelTextWidth( it->second.CaptionLayout, it->first.length() );
+            float width = it->second.CaptionWidth;
 
             D2D1_RECT_F tabRect = D2D1::RectF( x + ViewRect.left, ViewRect.top, x + ViewRect.left + width + 10.0f, ViewRect.top + SV_TABCONTROL_HEADER_SIZE_Y );
             if ( PointInsideRect( D2D1::Point2F( (float)p.x, (float)p.y ), tabRect ) ) {
@@ -217,6 +221,7 @@ void SV_TabControl::SetActiveTab( const std::string& tab ) {
     // Set and Show active
     ActiveTab = &Tabs[tab];
     SetTabVisibility( ActiveTab, false );
+    Invalidate();
     if ( TabSwitchedCallback ) {
         TabSwitchedCallback( this, TabSwitchedUserdata );
     }
@@ -236,4 +241,5 @@ std::string SV_TabControl::GetActiveTab() const {
 /** If true, this will only show the currently active tab */
 void SV_TabControl::SetOnlyShowActiveTab( bool value ) {
     OnlyShowActiveTab = value;
+    Invalidate();
 }
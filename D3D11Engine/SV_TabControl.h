@@ -14,6 +14,9 @@ struct SV_TabControl_Tab {
 
     IDWriteTextLayout* CaptionLayout;
     std::string Caption;
+
+    /** Width of the caption, measured when it is set */
+    float CaptionWidth;
     std::list<D2DSubView*> Controls;
 };
 
@@ -27,6 +27,8 @@ cbuffer DS_ScreenQuadConstantBuffer : register( b0 )
 	float SQ_ShadowAOStrength;
 	float SQ_WorldAOStrength;
 	float SQ_Pad;
+	
+	matrix SQ_ShadowFarViewProj;
 };
 
 //--------------------------------------------------------------------------------------
@@ -42,6 +44,7 @@ Texture2D	TX_Shadowmap : register( t3 );
 Texture2D	TX_RainShadowmap : register( t4 );
 TextureCube	TX_ReflectionCube : register( t5 );
 Texture2D	TX_Distortion : register( t6 );
+Texture2D	TX_ShadowmapFar : register( t7 );
 
 
 //--------------------------------------------------------------------------------------
@@ -98,7 +101,7 @@ float IsWet(float3 wsPosition, Texture2D shadowmap, SamplerComparisonState sampl
 	return shadowmap.SampleCmpLevelZero( samplerState, projectedTexCoords.xy, vShadowSamplingPos.z - bias);
 }
 
-float ComputeShadowValue(float2 uv, float3 wsPosition, Texture2D shadowmap, SamplerComparisonState samplerState, float distance, float vertLighting, matrix viewProj, float bias = 0.01f, float softnessScale = 1.0f)
+float ComputeShadowValue(float2 uv, float3 wsPosition, Texture2D shadowmap, SamplerComparisonState samplerState, float distance, float vertLighting, matrix viewProj, float bias = 0.01f, float softnessScale = 1.0f, bool fadeBorder = true)
 {
 	// Reconstruct VS World ShadowViewPosition from depth
 	float4 vShadowSamplingPos = mul(float4(wsPosition, 1), viewProj);
@@ -154,12 +157,16 @@ float ComputeShadowValue(float2 uv, float3 wsPosition, Texture2D shadowmap, Samp
 #endif
 	}
 	
-	float border;
-	border = pow(abs(projectedTexCoords.x), 16.0f);
-	border += pow(abs(projectedTexCoords.y), 16.0f);
-	border += pow(abs(1.0f-projectedTexCoords.x), 16.0f);
-	border += pow(abs(1.0f-projectedTexCoords.y), 16.0f);
-	shadow = lerp(shadow, vertLighting, saturate(border));
+	// The near cascade hands over to the far one instead of fading out
+	if(fadeBorder)
+	{
+		float border;
+		border = pow(abs(projectedTexCoords.x), 16.0f);
+		border += pow(abs(projectedTexCoords.y), 16.0f);
+		border += pow(abs(1.0f-projectedTexCoords.x), 16.0f);
+		border += pow(abs(1.0f-projectedTexCoords.y), 16.0f);
+		shadow = lerp(shadow, vertLighting, saturate(border));
+	}
 	
 	return saturate(shadow);
 }
@@ -328,7 +335,15 @@ float4 PSMain( PS_INPUT Input ) : SV_TARGET
 	// Get shadowing
 	float shadow = 0.0f;
 	if(AC_LightPos.y > 0) // only get shadow value if it isn't night-time otherwise report that the whole scene is in shadow
-		shadow = ComputeShadowValue(uv, wsPosition, TX_Shadowmap, SS_Comp, vsPosition.z, vertLighting, mul(SQ_ShadowView, SQ_ShadowProj), lerp(0.00005f, 0.0001f, vsPosition.z / 1000));
+	{
+		// Use the near cascade as long as the position is inside of it, leave some room for the filter
+		matrix nearViewProj = mul(SQ_ShadowView, SQ_ShadowProj);
+		float4 vNearPos = mul(float4(wsPosition, 1), nearViewProj);
+		if(all(abs(vNearPos.xy / vNearPos.w) < 0.98f))
+			shadow = ComputeShadowValue(uv, wsPosition, TX_Shadowmap, SS_Comp, vsPosition.z, vertLighting, nearViewProj, lerp(0.00005f, 0.0001f, vsPosition.z / 1000), 1.0f, false);
+		else
+			shadow = ComputeShadowValue(uv, wsPosition, TX_ShadowmapFar, SS_Comp, vsPosition.z, vertLighting, SQ_ShadowFarViewProj, lerp(0.00005f, 0.0001f, vsPosition.z / 1000));
+	}
 #else
 	float shadow = vertLighting;
 #endif
@@ -0,0 +1,56 @@
+//--------------------------------------------------------------------------------------
+// Instanced decals
+//--------------------------------------------------------------------------------------
+
+cbuffer Matrices_PerFrame : register( b0 )
+{
+	matrix M_View;
+	matrix M_Proj;
+	matrix M_ViewProj;	
+};
+
+
+//--------------------------------------------------------------------------------------
+// Input / Output structures
+//--------------------------------------------------------------------------------------
+struct VS_INPUT
+{
+	float3 vPosition	: POSITION;
+	float3 vNormal		: NORMAL;
+	float2 vTex1		: TEXCOORD0;
+	float2 vTex2		: TEXCOORD1;
+	float4 vDiffuse		: DIFFUSE;
+	float4x4 InstanceWorldViewMatrix : INSTANCE_WORLD_MATRIX;
+};
+
+struct VS_OUTPUT
+{
+	float2 vTexcoord		: TEXCOORD0;
+	float2 vTexcoord2		: TEXCOORD1;
+	float4 vDiffuse			: TEXCOORD2;
+	float3 vNormalVS		: TEXCOORD4;
+	float3 vViewPosition	: TEXCOORD5;
+	float4 vPosition		: SV_POSITION;
+};
+
+//--------------------------------------------------------------------------------------
+// Vertex Shader
+//--------------------------------------------------------------------------------------
+VS_OUTPUT VSMain( VS_INPUT Input )
+{
+	VS_OUTPUT Output;
+	
+	// The instance matrix already contains the view-transform
+	float3 positionView = mul(float4(Input.vPosition,1), Input.InstanceWorldViewMatrix).xyz;
+	
+	Output.vPosition = mul( float4(positionView,1), M_Proj);
+	Output.vTexcoord2 = Input.vTex2;
+	Output.vTexcoord = Input.vTex1;
+	Output.vDiffuse  = Input.vDiffuse;
+	Output.vNormalVS = mul(Input.vNormal, (float3x3)Input.InstanceWorldViewMatrix);
+	Output.vViewPosition = positionView;
+	//Output.vWorldPosition = positionWorld;
+	
+	return Output;
+}
+
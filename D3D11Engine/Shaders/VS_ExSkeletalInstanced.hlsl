@@ -0,0 +1,76 @@
+//--------------------------------------------------------------------------------------
+// Instanced skinned meshes, the bones of all instances are in one palette
+//--------------------------------------------------------------------------------------
+
+cbuffer Matrices_PerFrame : register( b0 )
+{
+	matrix M_View;
+	matrix M_Proj;
+	matrix M_ViewProj;	
+};
+
+StructuredBuffer<float4x4> BonePalette : register( t0 );
+
+//--------------------------------------------------------------------------------------
+// Input / Output structures
+//--------------------------------------------------------------------------------------
+struct VS_INPUT
+{
+	float4 vPosition[4]	: POSITION;
+	float3 vNormal		: NORMAL;
+	float3 vBindPoseNormal		: TEXCOORD0;
+	float2 vTex1		: TEXCOORD1;
+	uint4 BoneIndices : BONEIDS;
+	float4 Weights 	: WEIGHTS;
+	float4x4 InstanceWorldMatrix : INSTANCE_WORLD_MATRIX;
+	float4 vInstanceColor : INSTANCE_COLOR;
+	float InstanceFatness : INSTANCE_FATNESS;
+	uint InstanceBoneOffset : INSTANCE_BONE_OFFSET;
+};
+
+struct VS_OUTPUT
+{
+	float2 vTexcoord		: TEXCOORD0;
+	float2 vTexcoord2		: TEXCOORD1;
+	float4 vDiffuse			: TEXCOORD2;
+	float3 vNormalVS		: TEXCOORD4;
+	float3 vViewPosition	: TEXCOORD5;
+	float4 vPosition		: SV_POSITION;
+};
+
+//--------------------------------------------------------------------------------------
+// Vertex Shader
+//--------------------------------------------------------------------------------------
+VS_OUTPUT VSMain( VS_INPUT Input )
+{
+	VS_OUTPUT Output;
+	
+	uint4 bones = Input.BoneIndices + Input.InstanceBoneOffset;
+	float4x4 b0 = BonePalette[bones.x];
+	float4x4 b1 = BonePalette[bones.y];
+	float4x4 b2 = BonePalette[bones.z];
+	float4x4 b3 = BonePalette[bones.w];
+	
+	float3 position = float3(0, 0, 0);
+	position += Input.Weights.x * mul(float4(Input.vPosition[0].xyz, 1), b0).xyz;
+	position += Input.Weights.y * mul(float4(Input.vPosition[1].xyz, 1), b1).xyz;
+	position += Input.Weights.z * mul(float4(Input.vPosition[2].xyz, 1), b2).xyz;
+	position += Input.Weights.w * mul(float4(Input.vPosition[3].xyz, 1), b3).xyz;
+	
+	float3 normal = float3(0, 0, 0);
+	normal += Input.Weights.x * mul(Input.vNormal, (float3x3)b0);
+	normal += Input.Weights.y * mul(Input.vNormal, (float3x3)b1);
+	normal += Input.Weights.z * mul(Input.vNormal, (float3x3)b2);
+	normal += Input.Weights.w * mul(Input.vNormal, (float3x3)b3);
+	
+	float3 positionWorld = mul(float4(position + Input.InstanceFatness * normal,1), Input.InstanceWorldMatrix).xyz;
+	
+	Output.vPosition = mul(float4(positionWorld,1), M_ViewProj);
+	Output.vTexcoord2 = Input.vTex1;
+	Output.vTexcoord = Input.vTex1;
+	Output.vDiffuse  = Input.vInstanceColor;
+	Output.vNormalVS = mul(Input.vBindPoseNormal, (float3x3)mul(Input.InstanceWorldMatrix, M_View));
+	Output.vViewPosition = mul(float4(positionWorld,1),M_View).xyz;
+	
+	return Output;
+}
@@ -24,7 +24,9 @@ struct VS_INPUT
 {
 	float3 vPosition	: POSITION;
 	float2 vTex1		: TEXCOORD0;
-	float4x4 InstanceWorldMatrix : INSTANCE_WORLD_MATRIX;
+	float3 InstancePosition : INSTANCE_POSITION;
+	float InstanceRotation : INSTANCE_ROTATION; // 0..1 maps to 0..2pi
+	float InstanceScale : INSTANCE_SCALE;
 };
 
 struct VS_OUTPUT
@@ -42,7 +44,11 @@ VS_OUTPUT VSMain( VS_INPUT Input )
 {
 	VS_OUTPUT Output;
 	
-	float3 wpos = mul(float4(Input.vPosition,1), Input.InstanceWorldMatrix).xyz;
+	// Rotate around y, scale and move to the instance position
+	float s, c;
+	sincos(Input.InstanceRotation * 6.28318530718f, s, c);
+	float3 rpos = float3(Input.vPosition.x * c + Input.vPosition.z * s, Input.vPosition.y, Input.vPosition.z * c - Input.vPosition.x * s);
+	float3 wpos = rpos * Input.InstanceScale + Input.InstancePosition;
 	
 	float wind = sin(Input.vPosition.z * 0.001f) * 0.5f + 0.5f;
 	wind += sin(Input.vPosition.x * 0.001f) * 0.5f + 0.5f;
@@ -0,0 +1,231 @@
+#include "ShadowCascades.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    float Dot( const float a[3], const float b[3] ) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    void Cross( const float a[3], const float b[3], float out[3] ) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    bool Normalize( float v[3] ) {
+        float len = sqrtf( Dot( v, v ) );
+        if ( len < 1e-6f )
+            return false;
+
+        v[0] /= len;
+        v[1] /= len;
+        v[2] /= len;
+        return true;
+    }
+
+    /** Tests a light space box (center relative to the cascade, extents along the light axes) */
+    bool TestLightSpace( const ShadowCascade& c, const float d[3], float ex, float ey, float ez ) {
+        float x = Dot( d, c.Right );
+        float y = Dot( d, c.Up );
+        float z = Dot( d, c.LightDir );
+
+        return fabsf( x ) <= c.Radius + ex
+            && fabsf( y ) <= c.Radius + ey
+            && z + ez >= -c.Radius          // Not completely below the receivers
+            && z - ez <= c.DepthExtent;     // Not completely behind the light-view position
+    }
+}
+
+/** Tests whether the given box can cast a shadow onto something inside this cascade */
+bool ShadowCascade::TestBox( const float min[3], const float max[3] ) const {
+    float d[3];
+    float h[3];
+    for ( int a = 0; a < 3; a++ ) {
+        d[a] = (min[a] + max[a]) * 0.5f - Center[a];
+        h[a] = (max[a] - min[a]) * 0.5f;
+    }
+
+    // Extents of the box projected onto the light axes
+    float ex = fabsf( Right[0] ) * h[0] + fabsf( Right[1] ) * h[1] + fabsf( Right[2] ) * h[2];
+    float ey = fabsf( Up[0] ) * h[0] + fabsf( Up[1] ) * h[1] + fabsf( Up[2] ) * h[2];
+    float ez = fabsf( LightDir[0] ) * h[0] + fabsf( LightDir[1] ) * h[1] + fabsf( LightDir[2] ) * h[2];
+    return TestLightSpace( *this, d, ex, ey, ez );
+}
+
+bool ShadowCascade::TestSphere( const float center[3], float radius ) const {
+    float d[3] = { center[0] - Center[0], center[1] - Center[1], center[2] - Center[2] };
+    return TestLightSpace( *this, d, radius, radius, radius );
+}
+
+/** Practical split scheme: Blends logarithmic and uniform splits */
+void ShadowCascadeMath::ComputeSplits( float nearZ, float farZ, int numCascades, float lambda, float* splits ) {
+    nearZ = std::max( nearZ, 0.001f );
+    for ( int i = 0; i <= numCascades; i++ ) {
+        float f = static_cast<float>(i) / numCascades;
+        float logSplit = nearZ * powf( farZ / nearZ, f );
+        float uniformSplit = nearZ + (farZ - nearZ) * f;
+        splits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+    }
+
+    // No rounding errors at the ends
+    splits[0] = nearZ;
+    splits[numCascades] = farZ;
+}
+
+/** Smallest sphere around the slice of a symmetric view frustum */
+void ShadowCascadeMath::FitSliceSphere( float splitNear, float splitFar, float tanHalfFovX, float tanHalfFovY, float& centerDistance, float& radius ) {
+    // All corners of one end of the slice are the same distance away from the view-axis, so the
+    // center is on there. It's where the near and far corners are equally far away, unless that's
+    // beyond the far end, then the far corners decide alone.
+    float k2 = tanHalfFovX * tanHalfFovX + tanHalfFovY * tanHalfFovY;
+    centerDistance = std::min( (splitNear + splitFar) * (1.0f + k2) * 0.5f, splitFar );
+
+    float dn = centerDistance - splitNear;
+    float df = splitFar - centerDistance;
+    radius = sqrtf( std::max( dn * dn + splitNear * splitNear * k2, df * df + splitFar * splitFar * k2 ) );
+}
+
+/** Builds the light space axes for the given sun direction */
+void ShadowCascadeMath::BuildLightBasis( const float lightDir[3], float right[3], float up[3] ) {
+    // Same as XMMatrixLookAtLH, looking down from the sun
+    float forward[3] = { -lightDir[0], -lightDir[1], -lightDir[2] };
+    const float worldUp[3] = { 0.0f, 1.0f, 0.0f };
+    const float worldForward[3] = { 0.0f, 0.0f, 1.0f };
+
+    Cross( worldUp, forward, right );
+    if ( !Normalize( right ) ) {
+        // Sun straight above
+        Cross( worldForward, forward, right );
+        Normalize( right );
+    }
+
+    Cross( forward, right, up );
+}
+
+/** Snaps the sphere to the texel grid and builds the matrices */
+void ShadowCascadeMath::FitCascade( const float center[3], float radius, const float lightDir[3], int resolution, float depthExtent, ShadowCascade& out ) {
+    float l[3] = { lightDir[0], lightDir[1], lightDir[2] };
+    if ( !Normalize( l ) ) {
+        l[0] = 0.0f;
+        l[1] = 1.0f;
+        l[2] = 0.0f;
+    }
+
+    for ( int a = 0; a < 3; a++ ) {
+        out.LightDir[a] = l[a];
+    }
+    BuildLightBasis( out.LightDir, out.Right, out.Up );
+
+    // Whole units, so the texel size doesn't flicker with rounding errors of the fitting
+    out.Radius = ceilf( radius );
+    out.TexelSize = 2.0f * out.Radius / resolution;
+
+    // The light-view position has to be outside of the sphere, or the nearest receivers get clipped
+    out.DepthExtent = std::max( depthExtent, out.Radius + 1.0f );
+
+    // Snap the center to whole texels along the axes of the shadowmap. The view-matrix then only
+    // ever moves by whole texels and every point of the world keeps landing on the same texel.
+    float x = floorf( Dot( center, out.Right ) / out.TexelSize + 0.5f ) * out.TexelSize;
+    float y = floorf( Dot( center, out.Up ) / out.TexelSize + 0.5f ) * out.TexelSize;
+    float z = Dot( center, out.LightDir );
+    for ( int a = 0; a < 3; a++ ) {
+        out.Center[a] = out.Right[a] * x + out.Up[a] * y + out.LightDir[a] * z;
+    }
+
+    // View-matrix like XMMatrixLookAtLH from Center + LightDir * DepthExtent towards the center
+    float eye[3];
+    float forward[3];
+    for ( int a = 0; a < 3; a++ ) {
+        eye[a] = out.Center[a] + out.LightDir[a] * out.DepthExtent;
+        forward[a] = -out.LightDir[a];
+    }
+
+    float* v = out.View;
+    v[0] = out.Right[0]; v[1] = out.Up[0]; v[2] = forward[0]; v[3] = 0.0f;
+    v[4] = out.Right[1]; v[5] = out.Up[1]; v[6] = forward[1]; v[7] = 0.0f;
+    v[8] = out.Right[2]; v[9] = out.Up[2]; v[10] = forward[2]; v[11] = 0.0f;
+    v[12] = -Dot( out.Right, eye );
+    v[13] = -Dot( out.Up, eye );
+    v[14] = -Dot( forward, eye );
+    v[15] = 1.0f;
+
+    // Projection like XMMatrixOrthographicLH, deep enough for the whole sphere
+    const float nearZ = 1.0f;
+    float farZ = out.DepthExtent + out.Radius;
+    float* p = out.Proj;
+    std::fill( p, p + 16, 0.0f );
+    p[0] = 1.0f / out.Radius;
+    p[5] = 1.0f / out.Radius;
+    p[10] = 1.0f / (farZ - nearZ);
+    p[14] = -nearZ / (farZ - nearZ);
+    p[15] = 1.0f;
+}
+
+ShadowCascadeSet::ShadowCascadeSet() {
+    NumCascades = 0;
+    Resolution = 0;
+    Invalidate();
+}
+
+/** Forces all cascades to be rendered with the next Update */
+void ShadowCascadeSet::Invalidate() {
+    std::fill( Valid, Valid + MAX_SHADOW_CASCADES, false );
+}
+
+/** Refits the cascades to the given camera */
+unsigned int ShadowCascadeSet::Update( const ShadowCascadeSettings& settings, const float cameraPosition[3], const float cameraForward[3],
+    float tanHalfFovX, float tanHalfFovY, const float lightDir[3] ) {
+    int numCascades = std::min( std::max( settings.NumCascades, 1 ), MAX_SHADOW_CASCADES );
+    if ( numCascades != NumCascades || settings.Resolution != Resolution ) {
+        NumCascades = numCascades;
+        Resolution = settings.Resolution;
+        Invalidate();
+    }
+
+    float l[3] = { lightDir[0], lightDir[1], lightDir[2] };
+    if ( !Normalize( l ) ) {
+        l[0] = 0.0f;
+        l[1] = 1.0f;
+        l[2] = 0.0f;
+    }
+
+    float splits[MAX_SHADOW_CASCADES + 1];
+    ShadowCascadeMath::ComputeSplits( settings.NearZ, settings.FarZ, NumCascades, settings.SplitLambda, splits );
+
+    unsigned int renderMask = 0;
+    for ( int i = 0; i < NumCascades; i++ ) {
+        ShadowCascade& c = Cascades[i];
+        bool cached = i >= settings.NumDynamicCascades;
+
+        float centerDistance;
+        float radius;
+        ShadowCascadeMath::FitSliceSphere( splits[i], splits[i + 1], tanHalfFovX, tanHalfFovY, centerDistance, radius );
+
+        float center[3];
+        for ( int a = 0; a < 3; a++ ) {
+            center[a] = cameraPosition[a] + cameraForward[a] * centerDistance;
+        }
+
+        float fitRadius = cached ? radius * (1.0f + settings.GuardBand) : radius;
+        if ( cached && Valid[i] && c.Cached
+            && c.SplitNear == splits[i] && c.SplitFar == splits[i + 1]
+            && c.Radius == ceilf( fitRadius ) && c.DepthExtent == std::max( settings.DepthExtent, c.Radius + 1.0f )
+            && Dot( l, c.LightDir ) >= settings.SunCosThreshold ) {
+            // Keep the cascade as long as the needed sphere still fits into the rendered one
+            float d[3] = { center[0] - c.Center[0], center[1] - c.Center[1], center[2] - c.Center[2] };
+            if ( sqrtf( Dot( d, d ) ) + radius <= c.Radius ) {
+                continue;
+            }
+        }
+
+        ShadowCascadeMath::FitCascade( center, fitRadius, l, Resolution, settings.DepthExtent, c );
+        c.SplitNear = splits[i];
+        c.SplitFar = splits[i + 1];
+        c.Cached = cached;
+        Valid[i] = true;
+        renderMask |= 1u << i;
+    }
+
+    return renderMask;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/** Cascaded shadowmaps for the sun
+
+    The view frustum is cut into slices along the view direction, every slice gets its own
+    orthographic shadowmap. The slices are fitted with a bounding sphere, which doesn't change its
+    size when the camera turns, and the center is snapped to whole shadowmap texels in light space.
+    Together this keeps the shadow edges from crawling while the camera moves.
+
+    The far cascades are cached: they are fitted with a guard band and only get rendered again when
+    the camera left it or the sun moved on. Since they can stay around for a long time, only static
+    casters should go in there, anything moving belongs into the cascades which get rendered every frame.
+
+    All matrices are row-vector matrices, like DirectXMath builds them. Doesn't know anything about
+    the engine, so it can be tested on its own. */
+
+const int MAX_SHADOW_CASCADES = 4;
+
+struct ShadowCascade {
+    /** Part of the view frustum the cascade was fitted to, as distance along the view direction */
+    float SplitNear;
+    float SplitFar;
+
+    /** Center of the covered sphere, snapped to the texel grid */
+    float Center[3];
+
+    /** Radius the shadowmap covers, including the guard band */
+    float Radius;
+    float TexelSize;
+
+    /** Light space axes. LightDir points towards the sun. */
+    float Right[3];
+    float Up[3];
+    float LightDir[3];
+
+    /** Distance from the center to the light-view position, at least the radius. Casters further towards the sun are clipped. */
+    float DepthExtent;
+
+    float View[16];
+    float Proj[16];
+
+    /** Whether the cascade is cached and should only contain static casters */
+    bool Cached;
+
+    /** Tests whether the given box can cast a shadow onto something inside this cascade. The
+        cascade box is extruded towards the sun for this, up to the light-view position. */
+    bool TestBox( const float min[3], const float max[3] ) const;
+    bool TestSphere( const float center[3], float radius ) const;
+};
+
+struct ShadowCascadeSettings {
+    ShadowCascadeSettings() {
+        NumCascades = 2;
+        NumDynamicCascades = 1;
+        NearZ = 50.0f;
+        FarZ = 8192.0f;
+        SplitLambda = 0.8f;
+        Resolution = 2048;
+        DepthExtent = 6000.0f;
+        GuardBand = 0.1f;
+        SunCosThreshold = 0.99994f;
+    }
+
+    int NumCascades;
+
+    /** Number of cascades, starting with the nearest, which get rendered every frame */
+    int NumDynamicCascades;
+
+    /** View distance the cascades cover */
+    float NearZ;
+    float FarZ;
+
+    /** Blend between uniform (0) and logarithmic (1) splits */
+    float SplitLambda;
+
+    /** Size of a shadowmap in texels */
+    int Resolution;
+
+    /** How far casters can be from the cascade center towards the sun */
+    float DepthExtent;
+
+    /** Cached cascades are made this much larger, so the camera can move around in them */
+    float GuardBand;
+
+    /** Cached cascades are rendered again once the dot-product of the old and new sun direction drops below this */
+    float SunCosThreshold;
+};
+
+/** Building blocks, exposed for the test-tool */
+namespace ShadowCascadeMath {
+    /** Practical split scheme: Blends logarithmic and uniform splits. Writes numCascades + 1 distances. */
+    void ComputeSplits( float nearZ, float farZ, int numCascades, float lambda, float* splits );
+
+    /** Smallest sphere around the slice of a symmetric view frustum. centerDistance is along the view direction. */
+    void FitSliceSphere( float splitNear, float splitFar, float tanHalfFovX, float tanHalfFovY, float& centerDistance, float& radius );
+
+    /** Builds the light space axes for the given sun direction */
+    void BuildLightBasis( const float lightDir[3], float right[3], float up[3] );
+
+    /** Snaps the sphere to the texel grid and builds the matrices. SplitNear/SplitFar and Cached aren't touched. */
+    void FitCascade( const float center[3], float radius, const float lightDir[3], int resolution, float depthExtent, ShadowCascade& out );
+}
+
+class ShadowCascadeSet {
+public:
+    ShadowCascadeSet();
+
+    /** Refits the cascades to the given camera. Returns a bitmask of the cascades which have to be
+        rendered now, the others still hold their matrices from the frame their shadowmap was made. */
+    unsigned int Update( const ShadowCascadeSettings& settings, const float cameraPosition[3], const float cameraForward[3],
+        float tanHalfFovX, float tanHalfFovY, const float lightDir[3] );
+
+    /** Forces all cascades to be rendered with the next Update, for example when the shadowmaps got lost */
+    void Invalidate();
+
+    int GetNumCascades() const { return NumCascades; }
+    const ShadowCascade& GetCascade( int i ) const { return Cascades[i]; }
+
+private:
+    ShadowCascade Cascades[MAX_SHADOW_CASCADES];
+    bool Valid[MAX_SHADOW_CASCADES];
+    int NumCascades;
+    int Resolution;
+};
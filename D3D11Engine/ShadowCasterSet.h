@@ -0,0 +1,187 @@
+#pragma once
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+/** Bounding sphere of a shadow caster */
+struct ShadowCasterSphere {
+    float Center[3];
+    float Radius;
+};
+
+/** Splits the casters around a shadowed light into a static and a dynamic set
+
+    Static casters are rendered into a cached shadowmap once, dynamic ones are rasterized on top of
+    a copy of it with every update. The static set is built from a sphere-culled candidate list
+    whenever the light moves. Casters which move or get added afterwards are only tracked in the
+    dynamic set; if one of them was part of the static set, the cached map has to be redrawn.
+
+    Doesn't know anything about vobs or the device, the caster only needs to be hashable. */
+template <typename Caster>
+class ShadowCasterSet {
+public:
+    ShadowCasterSet() {
+        Light.Center[0] = Light.Center[1] = Light.Center[2] = 0.0f;
+        Light.Radius = 0.0f;
+        StaticDirty = true;
+        Changed = false;
+    }
+
+    /** Throws everything away and starts over with the given light-sphere. The static set needs to be refilled using AddStatic. */
+    void Reset( const ShadowCasterSphere& light ) {
+        Light = light;
+        StaticCasters.clear();
+        DynamicCasters.clear();
+        Entries.clear();
+        StaticDirty = true;
+        Changed = true;
+    }
+
+    /** Adds a candidate to the static set, if it touches the light. Returns whether it was added. */
+    bool AddStatic( Caster caster, const ShadowCasterSphere& bounds ) {
+        if ( !Intersects( Light, bounds ) || Entries.find( caster ) != Entries.end() )
+            return false;
+
+        Insert( caster, true );
+        StaticDirty = true;
+        return true;
+    }
+
+    /** Called when a caster moved. Static casters are moved over to the dynamic set. */
+    void OnCasterMoved( Caster caster, const ShadowCasterSphere& bounds ) {
+        if ( !IsBuilt() )
+            return;
+
+        const bool inRange = Intersects( Light, bounds );
+
+        auto it = Entries.find( caster );
+        if ( it != Entries.end() ) {
+            if ( it->second.Static ) {
+                // Its old position is baked into the static map
+                Remove( it );
+                StaticDirty = true;
+
+                if ( inRange )
+                    Insert( caster, false );
+
+            } else if ( !inRange ) {
+                Remove( it );
+            }
+
+            // Either gone or moving around inside the light, the map has to be updated anyways
+            Changed = true;
+        } else if ( inRange ) {
+            Insert( caster, false );
+            Changed = true;
+        }
+    }
+
+    /** Called when a caster got added to the world after the static set was built */
+    void OnCasterAdded( Caster caster, const ShadowCasterSphere& bounds ) {
+        if ( !IsBuilt() || !Intersects( Light, bounds ) || Entries.find( caster ) != Entries.end() )
+            return;
+
+        Insert( caster, false );
+        Changed = true;
+    }
+
+    /** Called when a caster got removed from the world */
+    void OnCasterRemoved( Caster caster ) {
+        auto it = Entries.find( caster );
+        if ( it == Entries.end() )
+            return;
+
+        if ( it->second.Static )
+            StaticDirty = true;
+
+        Remove( it );
+        Changed = true;
+    }
+
+    /** Forces the static map to be redrawn, for casters this set doesn't track */
+    void InvalidateStatic() {
+        StaticDirty = true;
+        Changed = true;
+    }
+
+    /** Returns whether Reset was called with a light-sphere yet. Moved and added casters are ignored until then. */
+    bool IsBuilt() const { return Light.Radius > 0.0f; }
+
+    /** Returns whether the static map has to be redrawn */
+    bool IsStaticDirty() const { return StaticDirty; }
+
+    /** Returns whether anything changed since the last call to ClearChanged */
+    bool HasChanged() const { return Changed; }
+
+    /** To be called after the static map was redrawn */
+    void OnStaticRendered() { StaticDirty = false; }
+
+    /** To be called after the map was updated */
+    void ClearChanged() { Changed = false; }
+
+    /** Returns whether the caster is in the static set */
+    bool IsStatic( Caster caster ) const {
+        auto it = Entries.find( caster );
+        return it != Entries.end() && it->second.Static;
+    }
+
+    /** Returns whether the caster is in the dynamic set */
+    bool IsDynamic( Caster caster ) const {
+        auto it = Entries.find( caster );
+        return it != Entries.end() && !it->second.Static;
+    }
+
+    const std::vector<Caster>& GetStaticCasters() const { return StaticCasters; }
+    const std::vector<Caster>& GetDynamicCasters() const { return DynamicCasters; }
+    const ShadowCasterSphere& GetLight() const { return Light; }
+
+    /** Sphere-sphere test */
+    static bool Intersects( const ShadowCasterSphere& a, const ShadowCasterSphere& b ) {
+        const float dx = a.Center[0] - b.Center[0];
+        const float dy = a.Center[1] - b.Center[1];
+        const float dz = a.Center[2] - b.Center[2];
+        const float r = a.Radius + b.Radius;
+        return dx * dx + dy * dy + dz * dz <= r * r;
+    }
+
+private:
+    struct Entry {
+        bool Static;
+
+        /** Position inside StaticCasters or DynamicCasters */
+        size_t Index;
+    };
+
+    typedef typename std::unordered_map<Caster, Entry>::iterator EntryIterator;
+
+    void Insert( Caster caster, bool isStatic ) {
+        std::vector<Caster>& list = isStatic ? StaticCasters : DynamicCasters;
+
+        Entry e;
+        e.Static = isStatic;
+        e.Index = list.size();
+        Entries[caster] = e;
+        list.push_back( caster );
+    }
+
+    /** Swaps the caster with the last one of its list, so removing stays O(1) */
+    void Remove( EntryIterator it ) {
+        std::vector<Caster>& list = it->second.Static ? StaticCasters : DynamicCasters;
+        const size_t index = it->second.Index;
+
+        if ( index != list.size() - 1 ) {
+            list[index] = list.back();
+            Entries[list[index]].Index = index;
+        }
+
+        list.pop_back();
+        Entries.erase( it );
+    }
+
+    ShadowCasterSphere Light;
+    std::vector<Caster> StaticCasters;
+    std::vector<Caster> DynamicCasters;
+    std::unordered_map<Caster, Entry> Entries;
+    bool StaticDirty;
+    bool Changed;
+};
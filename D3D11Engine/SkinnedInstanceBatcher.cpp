@@ -0,0 +1,59 @@
+#include "SkinnedInstanceBatcher.h"
+
+uint32_t SkinnedInstanceBatcher::AddPalette( const float* bones, uint32_t numBones ) {
+    if ( !bones || numBones == 0 )
+        return INVALID_OFFSET;
+
+    const uint32_t offset = GetNumBones();
+    Palette.insert( Palette.end(), bones, bones + numBones * 16 );
+    return offset;
+}
+
+void SkinnedInstanceBatcher::AddInstance( const void* mesh, const void* texture, const SkinnedInstanceData& instance ) {
+    if ( instance.BoneOffset == INVALID_OFFSET )
+        return;
+
+    const GroupKey key = { mesh, texture };
+    auto it = GroupIndices.find( key );
+    if ( it == GroupIndices.end() ) {
+        it = GroupIndices.emplace( key, static_cast<uint32_t>(Groups.size()) ).first;
+
+        SkinnedInstanceGroup group;
+        group.Mesh = mesh;
+        group.Texture = texture;
+        group.FirstInstance = 0;
+        group.NumInstances = 0;
+        Groups.push_back( group );
+    }
+
+    Groups[it->second].NumInstances++;
+    Pending.push_back( { it->second, instance } );
+}
+
+void SkinnedInstanceBatcher::Build() {
+    // Counting sort, the sizes of the groups are already known
+    uint32_t first = 0;
+    for ( SkinnedInstanceGroup& group : Groups ) {
+        group.FirstInstance = first;
+        first += group.NumInstances;
+    }
+
+    Instances.resize( Pending.size() );
+
+    NextInstance.resize( Groups.size() );
+    for ( size_t i = 0; i < Groups.size(); i++ ) {
+        NextInstance[i] = Groups[i].FirstInstance;
+    }
+
+    for ( const PendingInstance& p : Pending ) {
+        Instances[NextInstance[p.Group]++] = p.Data;
+    }
+}
+
+void SkinnedInstanceBatcher::Clear() {
+    Palette.clear();
+    Pending.clear();
+    GroupIndices.clear();
+    Groups.clear();
+    Instances.clear();
+}
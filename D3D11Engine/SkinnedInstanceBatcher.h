@@ -0,0 +1,90 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/** Collects the skinned meshes of a pass and groups them into instanced draw calls
+
+    The bones of every model go into one shared palette, one after another, so a single buffer
+    holds the bones of all models drawn in the pass. Every instance only carries the offset of its
+    bones inside the palette next to its world matrix, color and fatness.
+
+    The submeshes are grouped by mesh and texture, since models of the same visual can still show
+    different textures (body- and face-variations). Every group is one draw call. Groups are kept
+    in the order their first instance was added, and the instances of a group in the order they
+    were added, so roughly sorted input (front to back) stays roughly sorted.
+
+    Doesn't know anything about the engine, the meshes and textures are only compared. */
+
+/** Per-instance vertex data, the layout of INSTANCE_* in VS_ExSkeletalInstanced */
+struct SkinnedInstanceData {
+    /** Transposed, like it would go into a constantbuffer */
+    float World[16];
+    float Color[4];
+    float Fatness;
+    uint32_t BoneOffset;
+    uint32_t Pad[2];
+};
+
+struct SkinnedInstanceGroup {
+    const void* Mesh;
+    const void* Texture;
+
+    /** Range inside of GetInstances() */
+    uint32_t FirstInstance;
+    uint32_t NumInstances;
+};
+
+class SkinnedInstanceBatcher {
+public:
+    static const uint32_t INVALID_OFFSET = 0xFFFFFFFF;
+
+    /** Appends the bones of a model to the palette and returns the offset of the first one.
+        Every bone is a 4x4 matrix of 16 floats. */
+    uint32_t AddPalette( const float* bones, uint32_t numBones );
+
+    /** Adds one submesh of a model, using bones added by AddPalette before */
+    void AddInstance( const void* mesh, const void* texture, const SkinnedInstanceData& instance );
+
+    /** Sorts the instances into their groups. Has to be called before reading the instances. */
+    void Build();
+
+    /** Drops everything for the next pass, keeps the memory */
+    void Clear();
+
+    bool IsEmpty() const { return Pending.empty(); }
+
+    const std::vector<float>& GetPalette() const { return Palette; }
+    uint32_t GetNumBones() const { return static_cast<uint32_t>(Palette.size() / 16); }
+    const std::vector<SkinnedInstanceData>& GetInstances() const { return Instances; }
+    const std::vector<SkinnedInstanceGroup>& GetGroups() const { return Groups; }
+
+private:
+    struct GroupKey {
+        const void* Mesh;
+        const void* Texture;
+
+        bool operator==( const GroupKey& o ) const { return Mesh == o.Mesh && Texture == o.Texture; }
+    };
+
+    struct GroupKeyHasher {
+        size_t operator()( const GroupKey& k ) const {
+            uint64_t h = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(k.Mesh)) * 0x9E3779B97F4A7C15ull;
+            h ^= static_cast<uint64_t>(reinterpret_cast<uintptr_t>(k.Texture)) + (h << 6) + (h >> 2);
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    struct PendingInstance {
+        uint32_t Group;
+        SkinnedInstanceData Data;
+    };
+
+    std::vector<float> Palette;
+    std::vector<PendingInstance> Pending;
+    std::unordered_map<GroupKey, uint32_t, GroupKeyHasher> GroupIndices;
+    std::vector<SkinnedInstanceGroup> Groups;
+    std::vector<SkinnedInstanceData> Instances;
+    std::vector<uint32_t> NextInstance;
+};
@@ -0,0 +1,655 @@
+#include "SnapshotArchive.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    /** Files smaller than this are never compacted, not worth the full rewrite */
+    const uint64_t COMPACT_MIN_SIZE = 64 * 1024;
+
+    const size_t LZ_MIN_MATCH = 4;
+    const size_t LZ_MAX_OFFSET = 0xFFFF;
+    const int LZ_HASH_BITS = 14;
+
+    struct Crc32Table {
+        Crc32Table() {
+            for ( uint32_t i = 0; i < 256; i++ ) {
+                uint32_t c = i;
+                for ( int k = 0; k < 8; k++ ) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                Values[i] = c;
+            }
+        }
+
+        uint32_t Values[256];
+    };
+
+    uint32_t Read32( const uint8_t* p ) {
+        uint32_t v;
+        memcpy( &v, p, sizeof( v ) );
+        return v;
+    }
+
+    /** Writes the extra bytes of a length which didn't fit into its 4 bits of the token */
+    void WriteLength( std::vector<uint8_t>& out, size_t length ) {
+        while ( length >= 255 ) {
+            out.push_back( 255 );
+            length -= 255;
+        }
+        out.push_back( static_cast<uint8_t>(length) );
+    }
+
+    /** Reads the extra bytes of a length, fails if they run past the input or the length exceeds the limit */
+    bool ReadLength( const uint8_t*& ip, const uint8_t* end, size_t& length, size_t limit ) {
+        for ( ;; ) {
+            if ( ip >= end )
+                return false;
+
+            const uint8_t b = *ip++;
+            length += b;
+            if ( length > limit )
+                return false;
+
+            if ( b != 255 )
+                return true;
+        }
+    }
+
+    /** Token, literals and (unless it is the last sequence) offset and match-length */
+    void WriteSequence( std::vector<uint8_t>& out, const uint8_t* literals, size_t numLiterals, size_t offset, size_t matchLength ) {
+        const size_t matchCode = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+        const uint8_t token = static_cast<uint8_t>((std::min<size_t>( numLiterals, 15 ) << 4) | std::min<size_t>( matchCode, 15 ));
+        out.push_back( token );
+
+        if ( numLiterals >= 15 )
+            WriteLength( out, numLiterals - 15 );
+
+        out.insert( out.end(), literals, literals + numLiterals );
+
+        if ( !matchLength )
+            return;
+
+        out.push_back( static_cast<uint8_t>(offset & 0xFF) );
+        out.push_back( static_cast<uint8_t>(offset >> 8) );
+
+        if ( matchCode >= 15 )
+            WriteLength( out, matchCode - 15 );
+    }
+
+    bool Seek( FILE* f, uint64_t offset ) {
+#ifdef _WIN32
+        return _fseeki64( f, static_cast<__int64>(offset), SEEK_SET ) == 0;
+#else
+        return fseeko( f, static_cast<off_t>(offset), SEEK_SET ) == 0;
+#endif
+    }
+
+    bool SeekEnd( FILE* f, uint64_t& size ) {
+#ifdef _WIN32
+        if ( _fseeki64( f, 0, SEEK_END ) != 0 )
+            return false;
+        size = static_cast<uint64_t>(_ftelli64( f ));
+#else
+        if ( fseeko( f, 0, SEEK_END ) != 0 )
+            return false;
+        size = static_cast<uint64_t>(ftello( f ));
+#endif
+        return true;
+    }
+
+    /** Makes sure everything written so far is on the disk, so the header never points to data which isn't */
+    bool FlushToDisk( FILE* f ) {
+        if ( fflush( f ) != 0 )
+            return false;
+
+#ifdef _WIN32
+        return _commit( _fileno( f ) ) == 0;
+#else
+        return fsync( fileno( f ) ) == 0;
+#endif
+    }
+
+    bool Write( FILE* f, const void* data, size_t size ) {
+        return !size || fwrite( data, size, 1, f ) == 1;
+    }
+
+    void FinishTableRef( SnapshotTableRef& ref ) {
+        ref.RefCrc = SnapshotCodec::Crc32( &ref, offsetof( SnapshotTableRef, RefCrc ) );
+    }
+}
+
+namespace SnapshotCodec {
+    /** Standard CRC-32 (IEEE), continue a running crc by passing it in */
+    uint32_t Crc32( const void* data, size_t size, uint32_t crc ) {
+        static const Crc32Table table;
+
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for ( size_t i = 0; i < size; i++ ) {
+            crc = table.Values[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    /** Byte-oriented LZ77 in the style of LZ4. Returns false if the data doesn't get smaller. */
+    bool Compress( const uint8_t* src, size_t size, std::vector<uint8_t>& out ) {
+        out.clear();
+        if ( size < LZ_MIN_MATCH * 2 )
+            return false;
+
+        out.reserve( size );
+
+        // Last position of every 4-byte sequence, by hash
+        std::vector<uint32_t> positions( 1 << LZ_HASH_BITS, 0xFFFFFFFF );
+
+        size_t anchor = 0;
+        size_t i = 0;
+        while ( i + LZ_MIN_MATCH <= size ) {
+            const uint32_t sequence = Read32( src + i );
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+            const uint32_t candidate = positions[hash];
+            positions[hash] = static_cast<uint32_t>(i);
+
+            if ( candidate == 0xFFFFFFFF || i - candidate > LZ_MAX_OFFSET || Read32( src + candidate ) != sequence ) {
+                i++;
+                continue;
+            }
+
+            size_t length = LZ_MIN_MATCH;
+            while ( i + length < size && src[candidate + length] == src[i + length] ) {
+                length++;
+            }
+
+            WriteSequence( out, src + anchor, i - anchor, i - candidate, length );
+
+            // Give the inside of the match a chance to be found later, one entry is enough
+            if ( length > LZ_MIN_MATCH && i + length - 2 + LZ_MIN_MATCH <= size ) {
+                const size_t p = i + length - 2;
+                positions[(Read32( src + p ) * 2654435761u) >> (32 - LZ_HASH_BITS)] = static_cast<uint32_t>(p);
+            }
+
+            i += length;
+            anchor = i;
+
+            if ( out.size() >= size )
+                return false;
+        }
+
+        // The last sequence only has literals
+        WriteSequence( out, src + anchor, size - anchor, 0, 0 );
+        return out.size() < size;
+    }
+
+    /** Returns false if the input is broken or doesn't decode to exactly dstSize bytes */
+    bool Decompress( const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize ) {
+        const uint8_t* ip = src;
+        const uint8_t* const end = src + size;
+        size_t op = 0;
+
+        for ( ;; ) {
+            if ( ip >= end )
+                return false;
+
+            const uint8_t token = *ip++;
+
+            size_t numLiterals = token >> 4;
+            if ( numLiterals == 15 && !ReadLength( ip, end, numLiterals, dstSize ) )
+                return false;
+
+            if ( numLiterals > static_cast<size_t>(end - ip) || numLiterals > dstSize - op )
+                return false;
+
+            if ( numLiterals )
+                memcpy( dst + op, ip, numLiterals );
+            ip += numLiterals;
+            op += numLiterals;
+
+            // Input ends after the literals of the last sequence
+            if ( ip == end )
+                return op == dstSize;
+
+            if ( end - ip < 2 )
+                return false;
+
+            const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+            ip += 2;
+            if ( offset == 0 || offset > op )
+                return false;
+
+            size_t length = token & 15;
+            if ( length == 15 && !ReadLength( ip, end, length, dstSize ) )
+                return false;
+
+            length += LZ_MIN_MATCH;
+            if ( length > dstSize - op )
+                return false;
+
+            // Byte by byte, the match may overlap the bytes it is producing
+            const uint8_t* match = dst + op - offset;
+            for ( size_t k = 0; k < length; k++ ) {
+                dst[op + k] = match[k];
+            }
+            op += length;
+        }
+    }
+
+    /** Stores byte 0 of all 4-byte words first, then byte 1 and so on. Trailing bytes are copied. */
+    void Shuffle( const uint8_t* src, size_t size, uint8_t* dst ) {
+        const size_t numWords = size / 4;
+        for ( size_t b = 0; b < 4; b++ ) {
+            for ( size_t w = 0; w < numWords; w++ ) {
+                dst[b * numWords + w] = src[w * 4 + b];
+            }
+        }
+        if ( size > numWords * 4 )
+            memcpy( dst + numWords * 4, src + numWords * 4, size - numWords * 4 );
+    }
+
+    void Unshuffle( const uint8_t* src, size_t size, uint8_t* dst ) {
+        const size_t numWords = size / 4;
+        for ( size_t b = 0; b < 4; b++ ) {
+            for ( size_t w = 0; w < numWords; w++ ) {
+                dst[w * 4 + b] = src[b * numWords + w];
+            }
+        }
+        if ( size > numWords * 4 )
+            memcpy( dst + numWords * 4, src + numWords * 4, size - numWords * 4 );
+    }
+}
+
+SnapshotArchive::SnapshotArchive() {
+    ActiveTable = 0;
+    Sequence = 0;
+    NumChunksWritten = 0;
+    LastSaveWasCompaction = false;
+}
+
+/** Binds the archive to the given file and reads its chunk table */
+bool SnapshotArchive::Open( const std::string& file ) {
+    Close();
+    FileName = file;
+
+    if ( !File.Open( file ) )
+        return false;
+
+    if ( !ReadTable() ) {
+        File.Close();
+        Entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/** Unmaps the file and forgets all chunks */
+void SnapshotArchive::Close() {
+    File.Close();
+    Entries.clear();
+    ActiveTable = 0;
+    Sequence = 0;
+}
+
+/** Validates the header and loads the newest complete table */
+bool SnapshotArchive::ReadTable() {
+    const uint8_t* data = File.GetData();
+    const size_t size = File.GetSize();
+
+    SnapshotHeader header;
+    if ( size < sizeof( header ) )
+        return false;
+
+    memcpy( &header, data, sizeof( header ) );
+    if ( header.Magic != SNAPSHOT_MAGIC || header.Version != SNAPSHOT_VERSION )
+        return false;
+
+    int best = -1;
+    for ( int t = 0; t < 2; t++ ) {
+        SnapshotTableRef& ref = header.Tables[t];
+        if ( SnapshotCodec::Crc32( &ref, offsetof( SnapshotTableRef, RefCrc ) ) != ref.RefCrc )
+            continue;
+
+        if ( ref.TableOffset < sizeof( header ) || ref.TableOffset > size
+            || ref.NumChunks > (size - ref.TableOffset) / sizeof( SnapshotChunkEntry ) )
+            continue;
+
+        const size_t tableOffset = static_cast<size_t>(ref.TableOffset);
+        if ( SnapshotCodec::Crc32( data + tableOffset, ref.NumChunks * sizeof( SnapshotChunkEntry ) ) != ref.TableCrc )
+            continue;
+
+        if ( best < 0 || ref.Sequence > header.Tables[best].Sequence )
+            best = t;
+    }
+
+    if ( best < 0 )
+        return false;
+
+    const SnapshotTableRef& ref = header.Tables[best];
+    const uint8_t* table = data + static_cast<size_t>(ref.TableOffset);
+
+    Entries.clear();
+    Entries.reserve( ref.NumChunks );
+    for ( uint32_t i = 0; i < ref.NumChunks; i++ ) {
+        SnapshotChunkEntry e;
+        memcpy( &e, table + i * sizeof( e ), sizeof( e ) );
+
+        if ( e.Offset < sizeof( header ) || e.Offset > size || e.StoredSize > size - e.Offset )
+            return false;
+
+        if ( !Entries.emplace( e.Key, e ).second )
+            return false;
+    }
+
+    ActiveTable = best;
+    Sequence = ref.Sequence;
+    return true;
+}
+
+/** Returns the keys of all stored chunks with the given type, sorted */
+std::vector<uint64_t> SnapshotArchive::GetKeys( uint32_t type ) const {
+    std::vector<uint64_t> keys;
+    for ( auto const& it : Entries ) {
+        if ( static_cast<uint32_t>(it.first >> 32) == type )
+            keys.push_back( it.first );
+    }
+
+    std::sort( keys.begin(), keys.end() );
+    return keys;
+}
+
+/** Reads and verifies the given chunk */
+bool SnapshotArchive::Read( uint64_t key, std::vector<uint8_t>& data ) const {
+    auto it = Entries.find( key );
+    if ( it == Entries.end() || !File.IsOpen() )
+        return false;
+
+    const SnapshotChunkEntry& e = it->second;
+    const uint8_t* stored = File.GetData() + static_cast<size_t>(e.Offset);
+    if ( SnapshotCodec::Crc32( stored, e.StoredSize ) != e.StoredCrc )
+        return false;
+
+    data.resize( e.RawSize );
+
+    std::vector<uint8_t> shuffled;
+    uint8_t* target = data.data();
+    if ( e.Flags & SCF_SHUFFLED ) {
+        shuffled.resize( e.RawSize );
+        target = shuffled.data();
+    }
+
+    if ( e.Flags & SCF_COMPRESSED ) {
+        if ( !SnapshotCodec::Decompress( stored, e.StoredSize, target, e.RawSize ) )
+            return false;
+    } else {
+        if ( e.StoredSize != e.RawSize )
+            return false;
+
+        if ( e.RawSize )
+            memcpy( target, stored, e.RawSize );
+    }
+
+    if ( e.Flags & SCF_SHUFFLED )
+        SnapshotCodec::Unshuffle( shuffled.data(), e.RawSize, data.data() );
+
+    return SnapshotCodec::Crc32( data.data(), data.size() ) == e.RawCrc;
+}
+
+/** Encodes a chunk, fills everything of the entry except the offset */
+void SnapshotArchive::EncodeChunk( const SnapshotChunk& chunk, SnapshotChunkEntry& entry, std::vector<uint8_t>& stored ) {
+    const std::vector<uint8_t>& raw = *chunk.Data;
+
+    entry.Key = chunk.Key;
+    entry.Offset = 0;
+    entry.RawSize = static_cast<uint32_t>(raw.size());
+    entry.RawCrc = SnapshotCodec::Crc32( raw.data(), raw.size() );
+    entry.Flags = 0;
+
+    std::vector<uint8_t> shuffled;
+    const uint8_t* source = raw.data();
+    if ( chunk.Shuffle && raw.size() >= 8 ) {
+        shuffled.resize( raw.size() );
+        SnapshotCodec::Shuffle( raw.data(), raw.size(), shuffled.data() );
+        source = shuffled.data();
+    }
+
+    if ( SnapshotCodec::Compress( source, raw.size(), stored ) ) {
+        entry.Flags |= SCF_COMPRESSED;
+        if ( !shuffled.empty() )
+            entry.Flags |= SCF_SHUFFLED;
+    } else {
+        stored = raw;
+    }
+
+    entry.StoredSize = static_cast<uint32_t>(stored.size());
+    entry.StoredCrc = SnapshotCodec::Crc32( stored.data(), stored.size() );
+}
+
+/** Makes the file hold exactly the given chunks */
+bool SnapshotArchive::Save( const std::vector<SnapshotChunk>& chunks ) {
+    LastError.clear();
+    NumChunksWritten = 0;
+    LastSaveWasCompaction = false;
+
+    if ( FileName.empty() ) {
+        LastError = "Archive isn't bound to a file";
+        return false;
+    }
+
+    std::vector<SnapshotChunkEntry> table;
+    table.reserve( chunks.size() );
+
+    // Index into the table and the encoded bytes of every chunk which has to be written
+    std::vector<std::pair<size_t, std::vector<uint8_t>>> payloads;
+
+    uint64_t liveSize = sizeof( SnapshotHeader ) + chunks.size() * sizeof( SnapshotChunkEntry );
+    uint64_t appendSize = chunks.size() * sizeof( SnapshotChunkEntry );
+    for ( const SnapshotChunk& chunk : chunks ) {
+        auto old = Entries.find( chunk.Key );
+
+        if ( !chunk.Data ) {
+            if ( old == Entries.end() ) {
+                LastError = "Chunk " + std::to_string( chunk.Key ) + " is marked as unchanged, but isn't in the archive";
+                return false;
+            }
+
+            table.push_back( old->second );
+        } else {
+            if ( chunk.Data->size() > 0xFFFFFFFFu ) {
+                LastError = "Chunk " + std::to_string( chunk.Key ) + " is too big";
+                return false;
+            }
+
+            const uint32_t crc = SnapshotCodec::Crc32( chunk.Data->data(), chunk.Data->size() );
+            if ( old != Entries.end() && old->second.RawSize == chunk.Data->size() && old->second.RawCrc == crc ) {
+                // Same content as stored
+                table.push_back( old->second );
+            } else {
+                SnapshotChunkEntry e;
+                std::vector<uint8_t> stored;
+                EncodeChunk( chunk, e, stored );
+
+                appendSize += stored.size();
+                table.push_back( e );
+                payloads.emplace_back( table.size() - 1, std::move( stored ) );
+            }
+        }
+
+        liveSize += table.back().StoredSize;
+    }
+
+    // Sorted, so equal snapshots give equal tables and duplicates are easy to find
+    std::vector<size_t> order( table.size() );
+    for ( size_t i = 0; i < order.size(); i++ ) {
+        order[i] = i;
+    }
+    std::sort( order.begin(), order.end(), [&]( size_t a, size_t b ) { return table[a].Key < table[b].Key; } );
+
+    for ( size_t i = 1; i < order.size(); i++ ) {
+        if ( table[order[i]].Key == table[order[i - 1]].Key ) {
+            LastError = "Chunk " + std::to_string( table[order[i]].Key ) + " was given twice";
+            return false;
+        }
+    }
+
+    NumChunksWritten = static_cast<uint32_t>(payloads.size());
+
+    const uint64_t newSize = File.GetSize() + appendSize;
+    const bool compact = !File.IsOpen() || (newSize > COMPACT_MIN_SIZE && newSize - liveSize > newSize / 2);
+
+    bool result;
+    if ( compact ) {
+        LastSaveWasCompaction = true;
+        result = Rewrite( table, payloads );
+    } else {
+        // Nothing changed at all, not even the set of chunks
+        if ( payloads.empty() && table.size() == Entries.size() )
+            return true;
+
+        result = Append( table, payloads );
+    }
+
+    if ( !result )
+        return false;
+
+    // Pick up the table just written
+    if ( !Open( FileName ) ) {
+        LastError = "Couldn't read back " + FileName + " after saving";
+        return false;
+    }
+
+    return true;
+}
+
+/** Appends payloads and table to the current file and switches the header over to them */
+bool SnapshotArchive::Append( std::vector<SnapshotChunkEntry>& table, const std::vector<std::pair<size_t, std::vector<uint8_t>>>& payloads ) {
+    // The mapping keeps other handles from writing on windows
+    File.Close();
+
+    FILE* f = fopen( FileName.c_str(), "r+b" );
+    if ( !f ) {
+        LastError = "Couldn't open " + FileName + " for writing";
+        Open( FileName );
+        return false;
+    }
+
+    bool ok = true;
+    uint64_t offset = 0;
+    ok = ok && SeekEnd( f, offset );
+
+    for ( auto const& p : payloads ) {
+        table[p.first].Offset = offset;
+        ok = ok && Write( f, p.second.data(), p.second.size() );
+        offset += p.second.size();
+    }
+
+    std::sort( table.begin(), table.end(), []( const SnapshotChunkEntry& a, const SnapshotChunkEntry& b ) { return a.Key < b.Key; } );
+
+    const int slot = 1 - ActiveTable;
+    SnapshotTableRef ref;
+    ref.Sequence = Sequence + 1;
+    ref.TableOffset = offset;
+    ref.NumChunks = static_cast<uint32_t>(table.size());
+    ref.TableCrc = SnapshotCodec::Crc32( table.data(), table.size() * sizeof( SnapshotChunkEntry ) );
+    FinishTableRef( ref );
+
+    ok = ok && Write( f, table.data(), table.size() * sizeof( SnapshotChunkEntry ) );
+
+    // Only switch the header over once the new table is on disk
+    ok = ok && FlushToDisk( f );
+    ok = ok && Seek( f, offsetof( SnapshotHeader, Tables ) + slot * sizeof( SnapshotTableRef ) );
+    ok = ok && Write( f, &ref, sizeof( ref ) );
+    ok = ok && FlushToDisk( f );
+
+    if ( fclose( f ) != 0 )
+        ok = false;
+
+    if ( !ok ) {
+        LastError = "Failed to write to " + FileName;
+        Open( FileName );
+        return false;
+    }
+
+    return true;
+}
+
+/** Writes a new file holding only the live chunks and replaces the current one with it */
+bool SnapshotArchive::Rewrite( std::vector<SnapshotChunkEntry>& table, const std::vector<std::pair<size_t, std::vector<uint8_t>>>& payloads ) {
+    const std::string tempFile = FileName + ".tmp";
+
+    FILE* f = fopen( tempFile.c_str(), "wb" );
+    if ( !f ) {
+        LastError = "Couldn't create " + tempFile;
+        return false;
+    }
+
+    // Which entries get new data
+    std::vector<const std::vector<uint8_t>*> newData( table.size(), nullptr );
+    for ( auto const& p : payloads ) {
+        newData[p.first] = &p.second;
+    }
+
+    SnapshotHeader header;
+    memset( &header, 0, sizeof( header ) );
+    header.Magic = SNAPSHOT_MAGIC;
+    header.Version = SNAPSHOT_VERSION;
+
+    bool ok = Write( f, &header, sizeof( header ) );
+
+    uint64_t offset = sizeof( header );
+    for ( size_t i = 0; i < table.size(); i++ ) {
+        // Unchanged chunks are copied over as they are stored
+        const uint8_t* data = newData[i] ? newData[i]->data() : File.GetData() + static_cast<size_t>(table[i].Offset);
+
+        ok = ok && Write( f, data, table[i].StoredSize );
+        table[i].Offset = offset;
+        offset += table[i].StoredSize;
+    }
+
+    std::sort( table.begin(), table.end(), []( const SnapshotChunkEntry& a, const SnapshotChunkEntry& b ) { return a.Key < b.Key; } );
+    ok = ok && Write( f, table.data(), table.size() * sizeof( SnapshotChunkEntry ) );
+
+    SnapshotTableRef& ref = header.Tables[0];
+    ref.Sequence = Sequence + 1;
+    ref.TableOffset = offset;
+    ref.NumChunks = static_cast<uint32_t>(table.size());
+    ref.TableCrc = SnapshotCodec::Crc32( table.data(), table.size() * sizeof( SnapshotChunkEntry ) );
+    FinishTableRef( ref );
+
+    ok = ok && Seek( f, 0 );
+    ok = ok && Write( f, &header, sizeof( header ) );
+    ok = ok && FlushToDisk( f );
+
+    if ( fclose( f ) != 0 )
+        ok = false;
+
+    if ( !ok ) {
+        LastError = "Failed to write " + tempFile;
+        remove( tempFile.c_str() );
+        return false;
+    }
+
+    File.Close();
+
+#ifdef _WIN32
+    ok = MoveFileExA( tempFile.c_str(), FileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+    ok = rename( tempFile.c_str(), FileName.c_str() ) == 0;
+#endif
+
+    if ( !ok ) {
+        LastError = "Couldn't replace " + FileName;
+        remove( tempFile.c_str() );
+        Open( FileName );
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MemoryMappedFile.h"
+
+/** Chunked binary snapshot (.gsnap), used for the data the world-editor creates
+
+    Every chunk is identified by a 64-bit key (type in the upper, id in the lower half) and
+    checksummed and compressed on its own, so single chunks can be replaced. Layout:
+
+    [SnapshotHeader]                    - Two table-references, the valid one with the higher sequence wins
+    [Chunk payloads]                    - In the order they were written, old versions stay until compaction
+    [SnapshotChunkEntry * NumChunks]    - Chunk table, sorted by key, anywhere after the header
+
+    Saving only appends: changed chunks and a new table go to the end of the file, then the
+    unused table-reference of the header is overwritten. If the game dies while saving, the
+    other reference still points to the old, complete table. Once most of the file is garbage
+    it is rewritten into a temporary file, which then replaces the old one.
+
+    Doesn't know anything about the engine, so it can be tested on its own. */
+
+const uint32_t SNAPSHOT_MAGIC = 0x50414E53; // "SNAP"
+const uint32_t SNAPSHOT_VERSION = 1;
+const char* const SNAPSHOT_EXTENSION = ".gsnap";
+
+/** Builds a chunk key */
+inline uint64_t MakeSnapshotKey( uint32_t type, uint32_t id ) {
+    return (static_cast<uint64_t>(type) << 32) | id;
+}
+
+enum ESnapshotChunkFlags {
+    SCF_COMPRESSED = 1,
+
+    /** The bytes were grouped by their position inside 4-byte words before compressing */
+    SCF_SHUFFLED = 2
+};
+
+#pragma pack(push, 4)
+struct SnapshotTableRef {
+    uint64_t Sequence;
+    uint64_t TableOffset;
+    uint32_t NumChunks;
+    uint32_t TableCrc;
+
+    /** Crc of the fields above, to detect a torn write of the header */
+    uint32_t RefCrc;
+};
+
+struct SnapshotHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    SnapshotTableRef Tables[2];
+};
+
+struct SnapshotChunkEntry {
+    uint64_t Key;
+    uint64_t Offset;
+    uint32_t StoredSize;
+    uint32_t RawSize;
+
+    /** Crc of the bytes as they are in the file, checked before decompressing */
+    uint32_t StoredCrc;
+
+    /** Crc of the original data, also used to find chunks which didn't change */
+    uint32_t RawCrc;
+    uint32_t Flags;
+};
+#pragma pack(pop)
+
+/** Immutable chunk data. Can be handed to the saving thread while the editor keeps working on its own copy. */
+typedef std::shared_ptr<const std::vector<uint8_t>> SnapshotBuffer;
+
+struct SnapshotChunk {
+    SnapshotChunk( uint64_t key = 0, SnapshotBuffer data = nullptr, bool shuffle = false ) {
+        Key = key;
+        Data = std::move( data );
+        Shuffle = shuffle;
+    }
+
+    uint64_t Key;
+
+    /** nullptr if the chunk didn't change since the last save, the stored version is kept then */
+    SnapshotBuffer Data;
+
+    /** Group the bytes of 4-byte words before compressing, helps a lot with float-arrays */
+    bool Shuffle;
+};
+
+/** Building blocks of the format, exposed for the test-tool */
+namespace SnapshotCodec {
+    /** Standard CRC-32 (IEEE), continue a running crc by passing it in */
+    uint32_t Crc32( const void* data, size_t size, uint32_t crc = 0 );
+
+    /** Byte-oriented LZ77 in the style of LZ4. Returns false if the data doesn't get smaller. */
+    bool Compress( const uint8_t* src, size_t size, std::vector<uint8_t>& out );
+
+    /** Returns false if the input is broken or doesn't decode to exactly dstSize bytes.
+        Never reads or writes outside of the given ranges, whatever the input is. */
+    bool Decompress( const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize );
+
+    /** Stores byte 0 of all 4-byte words first, then byte 1 and so on. Trailing bytes are copied. */
+    void Shuffle( const uint8_t* src, size_t size, uint8_t* dst );
+    void Unshuffle( const uint8_t* src, size_t size, uint8_t* dst );
+}
+
+class SnapshotArchive {
+public:
+    SnapshotArchive();
+
+    SnapshotArchive( const SnapshotArchive& ) = delete;
+    SnapshotArchive& operator=( const SnapshotArchive& ) = delete;
+
+    /** Binds the archive to the given file and reads its chunk table. Returns false if the file is
+        missing or broken, the archive is empty then and the next Save creates the file. */
+    bool Open( const std::string& file );
+
+    /** Unmaps the file and forgets all chunks */
+    void Close();
+
+    const std::string& GetFile() const { return FileName; }
+
+    /** Returns whether the given chunk is stored */
+    bool Contains( uint64_t key ) const { return Entries.find( key ) != Entries.end(); }
+
+    /** Returns the keys of all stored chunks with the given type, sorted */
+    std::vector<uint64_t> GetKeys( uint32_t type ) const;
+
+    /** Reads and verifies the given chunk. Returns false if it is missing or broken. */
+    bool Read( uint64_t key, std::vector<uint8_t>& data ) const;
+
+    /** Makes the file hold exactly the given chunks. Only chunks whose data changed get encoded
+        and written, the others stay where they are. Doesn't touch any engine-state, so it can
+        run on a worker thread as long as nothing else uses this archive meanwhile. */
+    bool Save( const std::vector<SnapshotChunk>& chunks );
+
+    /** Returns the reason for the last failed Save */
+    const std::string& GetLastError() const { return LastError; }
+
+    /** Number of chunks the last Save actually had to write */
+    uint32_t GetNumChunksWritten() const { return NumChunksWritten; }
+
+    /** Whether the last Save rewrote the whole file instead of appending */
+    bool GetLastSaveWasCompaction() const { return LastSaveWasCompaction; }
+
+private:
+    /** Validates the header and loads the newest complete table */
+    bool ReadTable();
+
+    /** Encodes a chunk, fills everything of the entry except the offset */
+    static void EncodeChunk( const SnapshotChunk& chunk, SnapshotChunkEntry& entry, std::vector<uint8_t>& stored );
+
+    /** Appends payloads and table to the current file and switches the header over to them */
+    bool Append( std::vector<SnapshotChunkEntry>& table, const std::vector<std::pair<size_t, std::vector<uint8_t>>>& payloads );
+
+    /** Writes a new file holding only the live chunks and replaces the current one with it */
+    bool Rewrite( std::vector<SnapshotChunkEntry>& table, const std::vector<std::pair<size_t, std::vector<uint8_t>>>& payloads );
+
+    std::string FileName;
+    MemoryMappedFile File;
+    std::unordered_map<uint64_t, SnapshotChunkEntry> Entries;
+
+    /** Which table-reference of the header is the current one */
+    int ActiveTable;
+    uint64_t Sequence;
+
+    std::string LastError;
+    uint32_t NumChunksWritten;
+    bool LastSaveWasCompaction;
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/** Uniform grid on the XZ-plane for point-like objects, only the cells in use are stored
+
+    Objects are put into the cell their position falls into, a sphere query then only has to look at
+    the cells touching the sphere and the objects in there, instead of every object in the world.
+    Adding, moving and removing are O(1), the objects of a cell are kept in an array and removing
+    swaps the last one into the hole.
+
+    Doesn't know anything about the engine, T is only handed back by the queries and has to be
+    usable as a key of an unordered_map. */
+template <typename T>
+class SpatialHashGrid {
+public:
+    SpatialHashGrid( float cellSize = 2000.0f ) {
+        CellSize = cellSize;
+    }
+
+    void Clear() {
+        Cells.clear();
+        Objects.clear();
+    }
+
+    /** Adds the object or moves it, if it is already in there */
+    void Insert( T object, const float position[3] ) {
+        auto it = Objects.find( object );
+        if ( it != Objects.end() ) {
+            MoveEntry( object, it->second, position );
+            return;
+        }
+
+        Entry& e = Objects[object];
+        SetPosition( e, position );
+        e.Cell = CellKey( position );
+        AddToCell( object, e );
+    }
+
+    /** Updates the position of the object. Returns false if it isn't in the grid. */
+    bool Move( T object, const float position[3] ) {
+        auto it = Objects.find( object );
+        if ( it == Objects.end() )
+            return false;
+
+        MoveEntry( object, it->second, position );
+        return true;
+    }
+
+    bool Remove( T object ) {
+        auto it = Objects.find( object );
+        if ( it == Objects.end() )
+            return false;
+
+        RemoveFromCell( it->second );
+        Objects.erase( it );
+        return true;
+    }
+
+    bool Contains( T object ) const {
+        return Objects.find( object ) != Objects.end();
+    }
+
+    size_t Size() const { return Objects.size(); }
+    size_t GetNumCells() const { return Cells.size(); }
+
+    /** Calls fn( object, distance ) for every object whose stored position is inside the sphere */
+    template <typename F>
+    void QuerySphere( const float center[3], float radius, F&& fn ) const {
+        if ( Objects.empty() || radius < 0.0f )
+            return;
+
+        int32_t minX = CellCoord( center[0] - radius );
+        int32_t maxX = CellCoord( center[0] + radius );
+        int32_t minZ = CellCoord( center[2] - radius );
+        int32_t maxZ = CellCoord( center[2] + radius );
+
+        // Huge spheres would touch more cells than there are in use
+        if ( static_cast<uint64_t>(maxX - minX + 1) * static_cast<uint64_t>(maxZ - minZ + 1) > Cells.size() ) {
+            for ( auto const& it : Cells ) {
+                QueryCell( it.second, center, radius, fn );
+            }
+            return;
+        }
+
+        for ( int32_t z = minZ; z <= maxZ; z++ ) {
+            for ( int32_t x = minX; x <= maxX; x++ ) {
+                auto it = Cells.find( PackKey( x, z ) );
+                if ( it != Cells.end() ) {
+                    QueryCell( it->second, center, radius, fn );
+                }
+            }
+        }
+    }
+
+    /** Calls fn( object ) for every object */
+    template <typename F>
+    void ForEach( F&& fn ) const {
+        for ( auto const& it : Objects ) {
+            fn( it.first );
+        }
+    }
+
+private:
+    struct Entry {
+        float Position[3];
+        uint64_t Cell;
+
+        /** Index inside the array of the cell */
+        uint32_t Index;
+    };
+
+    struct CellItem {
+        T Object;
+        float Position[3];
+    };
+
+    static void SetPosition( Entry& e, const float position[3] ) {
+        e.Position[0] = position[0];
+        e.Position[1] = position[1];
+        e.Position[2] = position[2];
+    }
+
+    int32_t CellCoord( float v ) const {
+        return static_cast<int32_t>(floorf( v / CellSize ));
+    }
+
+    static uint64_t PackKey( int32_t x, int32_t z ) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+    }
+
+    uint64_t CellKey( const float position[3] ) const {
+        return PackKey( CellCoord( position[0] ), CellCoord( position[2] ) );
+    }
+
+    void AddToCell( T object, Entry& e ) {
+        std::vector<CellItem>& cell = Cells[e.Cell];
+        e.Index = static_cast<uint32_t>(cell.size());
+        cell.push_back( { object, { e.Position[0], e.Position[1], e.Position[2] } } );
+    }
+
+    void RemoveFromCell( const Entry& e ) {
+        auto cit = Cells.find( e.Cell );
+        std::vector<CellItem>& cell = cit->second;
+        if ( e.Index + 1 != cell.size() ) {
+            cell[e.Index] = cell.back();
+            Objects[cell[e.Index].Object].Index = e.Index;
+        }
+        cell.pop_back();
+
+        if ( cell.empty() ) {
+            Cells.erase( cit );
+        }
+    }
+
+    void MoveEntry( T object, Entry& e, const float position[3] ) {
+        uint64_t key = CellKey( position );
+        SetPosition( e, position );
+        if ( key == e.Cell ) {
+            CellItem& item = Cells[e.Cell][e.Index];
+            item.Position[0] = position[0];
+            item.Position[1] = position[1];
+            item.Position[2] = position[2];
+            return;
+        }
+
+        RemoveFromCell( e );
+        e.Cell = key;
+        AddToCell( object, e );
+    }
+
+    template <typename F>
+    static void QueryCell( const std::vector<CellItem>& cell, const float center[3], float radius, F& fn ) {
+        float r2 = radius * radius;
+        for ( const CellItem& item : cell ) {
+            float dx = item.Position[0] - center[0];
+            float dy = item.Position[1] - center[1];
+            float dz = item.Position[2] - center[2];
+            float d2 = dx * dx + dy * dy + dz * dz;
+            if ( d2 <= r2 ) {
+                fn( item.Object, sqrtf( d2 ) );
+            }
+        }
+    }
+
+    float CellSize;
+
+    /** The positions are stored in the cells as well, so the queries don't have to look into Objects */
+    std::unordered_map<uint64_t, std::vector<CellItem>> Cells;
+    std::unordered_map<T, Entry> Objects;
+};
@@ -0,0 +1,255 @@
+#include "pch.h"
+#include "StaticInstanceCache.h"
+#include "Engine.h"
+#include "GothicAPI.h"
+#include "BaseGraphicsEngine.h"
+#include "D3D11VertexBuffer.h"
+#include "zCVob.h"
+#include "zCCamera.h"
+#include <algorithm>
+
+StaticInstanceCache::StaticInstanceCache() {
+    Buffer = nullptr;
+    DirtyBegin = 0;
+    DirtyEnd = 0;
+}
+
+StaticInstanceCache::~StaticInstanceCache() {
+    // Visuals and sections may already be gone at this point
+    SAFE_DELETE( Buffer );
+}
+
+/** Removes everything from the cache */
+void StaticInstanceCache::Clear() {
+    for ( MeshVisualInfo* visual : Visuals ) {
+        if ( visual )
+            visual->InstanceCacheIndex = -1;
+    }
+
+    for ( VobInfo* vob : SlotVobs ) {
+        if ( vob )
+            vob->InstanceSlot = INSTANCE_SLOT_NONE;
+    }
+
+    Visuals.clear();
+    SlotVobs.clear();
+    InstanceData.clear();
+    SlotHidden.clear();
+    Runs.Clear();
+
+    for ( StaticInstancePass& pass : Passes ) {
+        pass = StaticInstancePass();
+    }
+
+    SAFE_DELETE( Buffer );
+    DirtyBegin = 0;
+    DirtyEnd = 0;
+}
+
+/** Puts all static outdoor vobs of the given sections into the cache */
+void StaticInstanceCache::Build( std::map<int, std::map<int, WorldMeshSectionInfo>>& sections ) {
+    Clear();
+
+    std::vector<StaticInstanceVisual> visuals;
+    std::vector<StaticInstanceEntry> entries;
+    std::vector<VobInfo*> entryVobs;
+
+    uint32_t sectionIndex = 0;
+    for ( auto& itx : sections ) {
+        for ( auto& ity : itx.second ) {
+            for ( VobInfo* vob : ity.second.Vobs ) {
+                // Indoor vobs and vobs which were added or moved after loading stay in the BSP-Tree and the dynamic list
+                if ( !vob->VisualInfo || vob->IsIndoorVob || vob->ParentBSPNodes.empty() )
+                    continue;
+
+                // Morphmeshes need their vertices updated for each frame they are visible
+                MeshVisualInfo* visual = reinterpret_cast<MeshVisualInfo*>(vob->VisualInfo);
+                if ( visual->MorphMeshVisual || visual->MeshesByTexture.empty() )
+                    continue;
+
+                if ( visual->InstanceCacheIndex < 0 ) {
+                    visual->InstanceCacheIndex = static_cast<int>(Visuals.size());
+                    Visuals.push_back( visual );
+
+                    StaticInstanceVisual v;
+                    v.MeshSize = visual->MeshSize;
+                    v.LODErrors = visual->LODErrors;
+                    v.NumLODs = visual->NumLODs;
+                    visuals.push_back( v );
+                }
+
+                StaticInstanceEntry e;
+                e.Visual = static_cast<uint32_t>(visual->InstanceCacheIndex);
+                e.Section = sectionIndex;
+                e.Position[0] = vob->LastRenderPosition.x;
+                e.Position[1] = vob->LastRenderPosition.y;
+                e.Position[2] = vob->LastRenderPosition.z;
+                e.Radius = visual->MeshSize;
+                entries.push_back( e );
+                entryVobs.push_back( vob );
+            }
+
+            sectionIndex++;
+        }
+    }
+
+    if ( entries.empty() )
+        return;
+
+    // Sections come out of the map ordered by x, then y. The clusters keep that order inside of each
+    // visual, which puts sections of the same column next to each other in the buffer.
+    std::vector<uint32_t> order;
+    Runs.Build( visuals, entries, order );
+
+    InstanceData.resize( entries.size() );
+    SlotHidden.resize( entries.size() );
+    SlotVobs.resize( entries.size() );
+
+    for ( unsigned int i = 0; i < order.size(); i++ ) {
+        VobInfo* vob = entryVobs[order[i]];
+        vob->InstanceSlot = i;
+        SlotVobs[i] = vob;
+        WriteSlot( i, vob, !vob->Vob->GetShowVisual() );
+    }
+
+    Engine::GraphicsEngine->CreateVertexBuffer( &Buffer );
+    Buffer->Init( &InstanceData[0], InstanceData.size() * sizeof( VobInstanceInfo ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_DEFAULT );
+
+    DirtyBegin = 0;
+    DirtyEnd = 0;
+
+    LogInfo() << "Cached " << InstanceData.size() << " static vob instances of " << Visuals.size() << " visuals in " << Runs.GetClusters().size() << " clusters";
+}
+
+/** Writes the current transform of the vob into its slot, or an empty one if it shouldn't be drawn */
+void StaticInstanceCache::WriteSlot( unsigned int slot, const VobInfo* vob, bool hidden ) {
+    VobInstanceInfo& instance = InstanceData[slot];
+
+    if ( !vob || hidden ) {
+        // A zero transform collapses all triangles into a point, so the rasterizer drops them
+        memset( &instance, 0, sizeof( instance ) );
+    } else {
+        instance.world = vob->WorldMatrix;
+        instance.color = vob->GroundColor;
+        memset( instance.GP_Slot, 0, sizeof( instance.GP_Slot ) );
+    }
+
+    SlotHidden[slot] = hidden ? 1 : 0;
+
+    if ( DirtyBegin == DirtyEnd ) {
+        DirtyBegin = slot;
+        DirtyEnd = slot + 1;
+    } else {
+        DirtyBegin = std::min( DirtyBegin, slot );
+        DirtyEnd = std::max( DirtyEnd, slot + 1 );
+    }
+}
+
+/** Takes the vob out of the cache */
+void StaticInstanceCache::RemoveVob( VobInfo* vob ) {
+    if ( !IsCached( vob ) )
+        return;
+
+    WriteSlot( vob->InstanceSlot, nullptr, false );
+    SlotVobs[vob->InstanceSlot] = nullptr;
+    vob->InstanceSlot = INSTANCE_SLOT_NONE;
+}
+
+/** Takes all vobs using the visual out of the cache */
+void StaticInstanceCache::RemoveVisual( MeshVisualInfo* visual ) {
+    if ( visual->InstanceCacheIndex < 0 || static_cast<size_t>(visual->InstanceCacheIndex) >= Visuals.size() || Visuals[visual->InstanceCacheIndex] != visual )
+        return;
+
+    const uint32_t index = static_cast<uint32_t>(visual->InstanceCacheIndex);
+    for ( const StaticInstanceCluster& c : Runs.GetClusters() ) {
+        if ( c.Visual != index )
+            continue;
+
+        for ( uint32_t slot = c.Start; slot < c.Start + c.Count; slot++ ) {
+            if ( SlotVobs[slot] )
+                RemoveVob( SlotVobs[slot] );
+        }
+    }
+
+    Runs.RemoveVisual( index );
+    Visuals[index] = nullptr;
+    visual->InstanceCacheIndex = -1;
+}
+
+/** Culls against the frustum of the current camera */
+bool StaticInstanceCache::InCameraFrustum( const float* min, const float* max ) {
+    zTBBox3D box;
+    box.Min = DirectX::XMFLOAT3( min[0], min[1], min[2] );
+    box.Max = DirectX::XMFLOAT3( max[0], max[1], max[2] );
+
+    int flags = 15; // Frustum check, no farplane
+    return zCCamera::GetCamera()->BBox3DInFrustum( box, flags ) != ZTCAM_CLIPTYPE_OUT;
+}
+
+/** Culls the clusters and fills the runs of the pass */
+void StaticInstanceCache::CollectRuns( unsigned int pass, const DirectX::XMFLOAT3& position, float maxDistance, const StaticInstanceRuns::CullFunction& cull, float lodPixelScale ) {
+    const GothicRendererSettings& settings = Engine::GAPI->GetRendererState().RendererSettings;
+
+    StaticInstancePassSettings s;
+    s.Position[0] = position.x;
+    s.Position[1] = position.y;
+    s.Position[2] = position.z;
+    s.MaxDistance = maxDistance;
+    s.VobDrawRadius = settings.OutdoorVobDrawRadius;
+    s.SmallVobDrawRadius = settings.OutdoorSmallVobDrawRadius;
+    s.SmallVobSize = settings.SmallVobSize;
+    s.EnableLOD = settings.EnableVobLOD;
+    s.LODPixelScale = lodPixelScale;
+    s.LODPixelError = settings.VobLODPixelError;
+
+    StaticInstancePass& p = Passes[pass];
+    Runs.Collect( p, s, cull );
+
+    // Scripts can hide vobs without moving them
+    const std::vector<StaticInstanceCluster>& clusters = Runs.GetClusters();
+    for ( uint32_t ci : p.VisibleClusters ) {
+        const StaticInstanceCluster& c = clusters[ci];
+        for ( uint32_t slot = c.Start; slot < c.Start + c.Count; slot++ ) {
+            const VobInfo* vob = SlotVobs[slot];
+            if ( !vob )
+                continue;
+
+            const bool hidden = !vob->Vob->GetShowVisual();
+            if ( hidden != (SlotHidden[slot] != 0) )
+                WriteSlot( slot, vob, hidden );
+        }
+    }
+}
+
+/** Returns the runs of the visual collected for the pass */
+const InstanceRun* StaticInstanceCache::GetRuns( unsigned int pass, const MeshVisualInfo* visual, unsigned int& numRuns ) const {
+    numRuns = 0;
+
+    const StaticInstancePass& p = Passes[pass];
+    if ( visual->InstanceCacheIndex < 0 || static_cast<size_t>(visual->InstanceCacheIndex) + 1 >= p.RunStart.size() )
+        return nullptr;
+
+    const uint32_t start = p.RunStart[visual->InstanceCacheIndex];
+    numRuns = p.RunStart[visual->InstanceCacheIndex + 1] - start;
+    return numRuns ? &p.Runs[start] : nullptr;
+}
+
+/** Returns the distance to the closest cluster of the visual drawn in the pass */
+float StaticInstanceCache::GetNearestDistance( unsigned int pass, const MeshVisualInfo* visual ) const {
+    const StaticInstancePass& p = Passes[pass];
+    if ( visual->InstanceCacheIndex < 0 || static_cast<size_t>(visual->InstanceCacheIndex) >= p.NearestDistance.size() )
+        return FLT_MAX;
+
+    return p.NearestDistance[visual->InstanceCacheIndex];
+}
+
+/** Uploads all slots which changed since the last call */
+void StaticInstanceCache::Update() {
+    if ( !Buffer || DirtyBegin == DirtyEnd )
+        return;
+
+    Buffer->UpdateBufferRange( &InstanceData[DirtyBegin], DirtyBegin * sizeof( VobInstanceInfo ), (DirtyEnd - DirtyBegin) * sizeof( VobInstanceInfo ) );
+
+    DirtyBegin = 0;
+    DirtyEnd = 0;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "pch.h"
+#include "WorldObjects.h"
+#include "ShadowCascades.h"
+#include "StaticInstanceRuns.h"
+
+/** Persistent instancing-data for the static outdoor vobs of the world
+
+    The transforms of these vobs are uploaded once after loading, grouped by visual and inside of each
+    visual into small clusters, see StaticInstanceRuns. Per pass only the visible clusters are picked,
+    and neighbouring clusters of the same visual are drawn with a single call, so the BSP-Tree doesn't
+    have to be walked for them anymore.
+
+    The camera and every shadow cascade are passes of their own, with their own runs and LODs.
+
+    Vobs which start moving or get removed leave the cache. Their slot is patched with an empty transform
+    instead of rebuilding the buffer. */
+class StaticInstanceCache {
+public:
+    /** Passes the runs are collected for */
+    static constexpr unsigned int PASS_CAMERA = 0;
+    static constexpr unsigned int PASS_SHADOW_CASCADE = 1;
+    static constexpr unsigned int NUM_PASSES = PASS_SHADOW_CASCADE + MAX_SHADOW_CASCADES;
+
+    StaticInstanceCache();
+    ~StaticInstanceCache();
+
+    /** Puts all static outdoor vobs of the given sections into the cache. Needs the BSP-cache to be built. */
+    void Build( std::map<int, std::map<int, WorldMeshSectionInfo>>& sections );
+
+    /** Removes everything from the cache */
+    void Clear();
+
+    /** Takes the vob out of the cache, it has to be collected the regular way afterwards */
+    void RemoveVob( VobInfo* vob );
+
+    /** Takes all vobs using the visual out of the cache, before the visual gets deleted */
+    void RemoveVisual( MeshVisualInfo* visual );
+
+    /** Culls the clusters against the given position and the culling volume, and fills the runs of the pass.
+        cull can be empty to only cull by distance. */
+    void CollectRuns( unsigned int pass, const DirectX::XMFLOAT3& position, float maxDistance, const StaticInstanceRuns::CullFunction& cull, float lodPixelScale );
+
+    /** Returns the runs of the visual collected for the pass */
+    const InstanceRun* GetRuns( unsigned int pass, const MeshVisualInfo* visual, unsigned int& numRuns ) const;
+
+    /** Returns the distance to the closest cluster of the visual drawn in the pass, FLT_MAX if it has no runs */
+    float GetNearestDistance( unsigned int pass, const MeshVisualInfo* visual ) const;
+
+    /** Uploads all slots which changed since the last call */
+    void Update();
+
+    /** Returns the buffer holding the instances */
+    D3D11VertexBuffer* GetBuffer() const { return Buffer; }
+
+    /** Returns the number of slots, including the ones of removed vobs */
+    unsigned int GetNumInstances() const { return static_cast<unsigned int>(InstanceData.size()); }
+
+    /** Returns whether the vob is drawn out of the cache */
+    static bool IsCached( const VobInfo* vob ) { return vob->InstanceSlot != INSTANCE_SLOT_NONE; }
+
+    /** Culls against the frustum of the current camera */
+    static bool InCameraFrustum( const float* min, const float* max );
+
+private:
+    /** Writes the current transform of the vob into its slot, or an empty one if it shouldn't be drawn */
+    void WriteSlot( unsigned int slot, const VobInfo* vob, bool hidden );
+
+    std::vector<VobInstanceInfo> InstanceData;
+    std::vector<unsigned char> SlotHidden;
+
+    /** Vob stored in each slot, nullptr once it left the cache */
+    std::vector<VobInfo*> SlotVobs;
+
+    /** Visuals which have instances in the cache, nullptr once removed */
+    std::vector<MeshVisualInfo*> Visuals;
+
+    StaticInstanceRuns Runs;
+    StaticInstancePass Passes[NUM_PASSES];
+
+    D3D11VertexBuffer* Buffer;
+
+    /** Slots which need to be uploaded */
+    unsigned int DirtyBegin;
+    unsigned int DirtyEnd;
+};
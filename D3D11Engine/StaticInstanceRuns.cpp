@@ -0,0 +1,155 @@
+#include "StaticInstanceRuns.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    int GetCell( float v ) {
+        return static_cast<int>(floorf( v / StaticInstanceRuns::CLUSTER_SIZE ));
+    }
+
+    float PointBoxDistance( const float* p, const float* min, const float* max ) {
+        float sq = 0.0f;
+        for ( int i = 0; i < 3; i++ ) {
+            float d = std::max( std::max( min[i] - p[i], 0.0f ), p[i] - max[i] );
+            sq += d * d;
+        }
+
+        return sqrtf( sq );
+    }
+}
+
+/** Clusters the entries */
+void StaticInstanceRuns::Build( const std::vector<StaticInstanceVisual>& visuals, const std::vector<StaticInstanceEntry>& entries, std::vector<uint32_t>& outOrder ) {
+    Visuals = visuals;
+    Clusters.clear();
+
+    // Visual, then section, then the cell on the ground
+    outOrder.resize( entries.size() );
+    for ( uint32_t i = 0; i < entries.size(); i++ )
+        outOrder[i] = i;
+
+    std::stable_sort( outOrder.begin(), outOrder.end(), [&entries]( uint32_t ia, uint32_t ib ) {
+        const StaticInstanceEntry& a = entries[ia];
+        const StaticInstanceEntry& b = entries[ib];
+        if ( a.Visual != b.Visual ) return a.Visual < b.Visual;
+        if ( a.Section != b.Section ) return a.Section < b.Section;
+
+        const int ax = GetCell( a.Position[0] ), bx = GetCell( b.Position[0] );
+        if ( ax != bx ) return ax < bx;
+        return GetCell( a.Position[2] ) < GetCell( b.Position[2] );
+        } );
+
+    for ( uint32_t slot = 0; slot < outOrder.size(); slot++ ) {
+        const StaticInstanceEntry& e = entries[outOrder[slot]];
+
+        bool startCluster = Clusters.empty();
+        if ( !startCluster ) {
+            const StaticInstanceEntry& prev = entries[outOrder[slot - 1]];
+            startCluster = Clusters.back().Count >= MAX_CLUSTER_INSTANCES
+                || prev.Visual != e.Visual || prev.Section != e.Section
+                || GetCell( prev.Position[0] ) != GetCell( e.Position[0] )
+                || GetCell( prev.Position[2] ) != GetCell( e.Position[2] );
+        }
+
+        if ( startCluster ) {
+            StaticInstanceCluster c;
+            c.Visual = e.Visual;
+            c.Start = slot;
+            c.Count = 0;
+            for ( int i = 0; i < 3; i++ ) {
+                c.Min[i] = FLT_MAX;
+                c.Max[i] = -FLT_MAX;
+            }
+            Clusters.push_back( c );
+        }
+
+        StaticInstanceCluster& c = Clusters.back();
+        c.Count++;
+        for ( int i = 0; i < 3; i++ ) {
+            c.Min[i] = std::min( c.Min[i], e.Position[i] - e.Radius );
+            c.Max[i] = std::max( c.Max[i], e.Position[i] + e.Radius );
+        }
+    }
+}
+
+void StaticInstanceRuns::Clear() {
+    Visuals.clear();
+    Clusters.clear();
+}
+
+/** Drops the clusters of the visual */
+void StaticInstanceRuns::RemoveVisual( uint32_t visual ) {
+    Visuals[visual].LODErrors = nullptr;
+    Visuals[visual].NumLODs = 0;
+
+    for ( StaticInstanceCluster& c : Clusters ) {
+        if ( c.Visual == visual )
+            c.Count = 0;
+    }
+}
+
+/** Fills the runs of the pass */
+void StaticInstanceRuns::Collect( StaticInstancePass& pass, const StaticInstancePassSettings& settings, const CullFunction& cull ) const {
+    if ( pass.ClusterLODs.size() != Clusters.size() )
+        pass.ClusterLODs.assign( Clusters.size(), 0 );
+
+    pass.Runs.clear();
+    pass.VisibleClusters.clear();
+    pass.RunStart.assign( Visuals.size() + 1, 0 );
+    pass.NearestDistance.assign( Visuals.size(), FLT_MAX );
+
+    uint32_t nextVisual = 0;
+    float visualDistance = 0.0f;
+    for ( uint32_t ci = 0; ci < Clusters.size(); ci++ ) {
+        const StaticInstanceCluster& c = Clusters[ci];
+        const StaticInstanceVisual& visual = Visuals[c.Visual];
+
+        // Clusters are ordered by visual, so the runs of each visual start where those of the one before end
+        if ( c.Visual >= nextVisual ) {
+            for ( ; nextVisual <= c.Visual; nextVisual++ )
+                pass.RunStart[nextVisual] = static_cast<uint32_t>(pass.Runs.size());
+
+            visualDistance = std::min( settings.MaxDistance, visual.MeshSize < settings.SmallVobSize
+                ? settings.SmallVobDrawRadius : settings.VobDrawRadius );
+        }
+
+        if ( !c.Count )
+            continue;
+
+        const float distance = PointBoxDistance( settings.Position, c.Min, c.Max );
+        if ( distance >= visualDistance )
+            continue;
+
+        if ( cull && !cull( c.Min, c.Max ) )
+            continue;
+
+        // The closest point of the cluster decides, so no instance gets a coarser level than it would on its own
+        unsigned char lod = 0;
+        if ( settings.EnableLOD ) {
+            lod = MeshSimplifier::SelectLOD( visual.LODErrors, visual.NumLODs, distance, settings.LODPixelScale, settings.LODPixelError, pass.ClusterLODs[ci] );
+        }
+
+        pass.ClusterLODs[ci] = lod;
+        pass.VisibleClusters.push_back( ci );
+        pass.NearestDistance[c.Visual] = std::min( pass.NearestDistance[c.Visual], distance );
+
+        if ( pass.Runs.size() > pass.RunStart[c.Visual] ) {
+            InstanceRun& last = pass.Runs.back();
+            if ( last.LOD == lod && last.Start + last.Count == c.Start ) {
+                last.Count += c.Count;
+                continue;
+            }
+        }
+
+        InstanceRun run;
+        run.Start = c.Start;
+        run.Count = c.Count;
+        run.LOD = lod;
+        pass.Runs.push_back( run );
+    }
+
+    for ( ; nextVisual <= Visuals.size(); nextVisual++ )
+        pass.RunStart[nextVisual] = static_cast<uint32_t>(pass.Runs.size());
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/** Picks the parts of the static instance cache which are drawn in a pass, and their LODs
+
+    The instances of every visual are split into small clusters: Instances of the same section and
+    the same cell of a CLUSTER_SIZE grid, at most MAX_CLUSTER_INSTANCES of them. The cache stores the
+    instances in the order of the clusters, so every cluster is a range of the buffer, and the
+    clusters of a visual follow each other.
+
+    A pass tests every cluster against its draw distance and its culling volume, and picks the LOD by
+    the closest point of the cluster. Clusters following each other with the same LOD are merged into
+    one run. Each pass keeps its own LODs, so drawing a shadowmap doesn't disturb the hysteresis of the
+    camera.
+
+    Doesn't know anything about the engine, so it can be tested on its own. */
+
+/** Consecutive instances of the static instance cache, drawn with a single call */
+struct InstanceRun {
+    unsigned int Start;
+    unsigned int Count;
+    unsigned char LOD;
+};
+
+/** An instance going into the cache */
+struct StaticInstanceEntry {
+    uint32_t Visual;
+    uint32_t Section;
+    float Position[3];
+    float Radius;
+};
+
+/** A visual with instances in the cache */
+struct StaticInstanceVisual {
+    /** Visuals smaller than SmallVobSize use SmallVobDrawRadius */
+    float MeshSize;
+
+    /** Errors of the LODs, see MeshSimplifier::SelectLOD. Has to stay valid as long as the visual is used. */
+    const float* LODErrors;
+    unsigned int NumLODs;
+};
+
+/** Instances of one visual which are tested together */
+struct StaticInstanceCluster {
+    uint32_t Visual;
+    uint32_t Start;
+    uint32_t Count;
+    float Min[3];
+    float Max[3];
+};
+
+struct StaticInstancePassSettings {
+    StaticInstancePassSettings() {
+        Position[0] = Position[1] = Position[2] = 0.0f;
+        MaxDistance = 0.0f;
+        VobDrawRadius = 0.0f;
+        SmallVobDrawRadius = 0.0f;
+        SmallVobSize = 0.0f;
+        EnableLOD = false;
+        LODPixelScale = 1.0f;
+        LODPixelError = 1.0f;
+    }
+
+    /** Distances and LODs are measured from here */
+    float Position[3];
+    float MaxDistance;
+
+    float VobDrawRadius;
+    float SmallVobDrawRadius;
+    float SmallVobSize;
+
+    bool EnableLOD;
+    float LODPixelScale;
+    float LODPixelError;
+};
+
+/** Result and LOD-history of one pass */
+struct StaticInstancePass {
+    /** Runs of all visuals, those of visual v are Runs[RunStart[v]] up to Runs[RunStart[v + 1]] */
+    std::vector<InstanceRun> Runs;
+    std::vector<uint32_t> RunStart;
+
+    /** Clusters which are drawn */
+    std::vector<uint32_t> VisibleClusters;
+
+    /** Distance to the closest drawn cluster of every visual, FLT_MAX for visuals without runs.
+        Sorts the transparent visuals back to front. */
+    std::vector<float> NearestDistance;
+
+    /** LOD of every cluster the last time it was drawn */
+    std::vector<unsigned char> ClusterLODs;
+};
+
+class StaticInstanceRuns {
+public:
+    /** Clusters are cut at this grid and this many instances */
+    static constexpr float CLUSTER_SIZE = 2000.0f;
+    static constexpr uint32_t MAX_CLUSTER_INSTANCES = 64;
+
+    /** Returns false for boxes which can't be seen by the pass */
+    typedef std::function<bool( const float* min, const float* max )> CullFunction;
+
+    /** Clusters the entries. outOrder gets the index of the entry to store at each slot of the cache. */
+    void Build( const std::vector<StaticInstanceVisual>& visuals, const std::vector<StaticInstanceEntry>& entries, std::vector<uint32_t>& outOrder );
+
+    void Clear();
+
+    /** Drops the clusters of the visual, before it gets deleted. Its slots stay where they are. */
+    void RemoveVisual( uint32_t visual );
+
+    /** Fills the runs of the pass. cull can be empty to only cull by distance. */
+    void Collect( StaticInstancePass& pass, const StaticInstancePassSettings& settings, const CullFunction& cull ) const;
+
+    const std::vector<StaticInstanceCluster>& GetClusters() const { return Clusters; }
+    uint32_t GetNumVisuals() const { return static_cast<uint32_t>(Visuals.size()); }
+
+private:
+    std::vector<StaticInstanceVisual> Visuals;
+    std::vector<StaticInstanceCluster> Clusters;
+};
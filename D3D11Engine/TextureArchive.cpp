@@ -0,0 +1,375 @@
+#include "TextureArchive.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+    /** Reads a whole file into memory */
+    bool ReadWholeFile( const std::string& file, std::vector<uint8_t>& data ) {
+        FILE* f = fopen( file.c_str(), "rb" );
+        if ( !f )
+            return false;
+
+        fseek( f, 0, SEEK_END );
+        long size = ftell( f );
+        fseek( f, 0, SEEK_SET );
+
+        if ( size <= 0 ) {
+            fclose( f );
+            return false;
+        }
+
+        data.resize( static_cast<size_t>(size) );
+        bool ok = fread( &data[0], 1, data.size(), f ) == data.size();
+        fclose( f );
+        return ok;
+    }
+
+    uint64_t AlignUp( uint64_t v, uint64_t alignment ) {
+        return (v + alignment - 1) / alignment * alignment;
+    }
+
+    /** Returns the directory-part of a normalized name, without the trailing backslash */
+    std::string DirectoryOf( const std::string& normalizedName ) {
+        size_t p = normalizedName.find_last_of( '\\' );
+        return p == std::string::npos ? std::string() : normalizedName.substr( 0, p );
+    }
+}
+
+TextureArchive::TextureArchive() {
+    Header = nullptr;
+    Entries = nullptr;
+    StringTable = nullptr;
+}
+
+TextureArchive::~TextureArchive() {
+    Close();
+}
+
+/** Maps the archive and validates header and index */
+bool TextureArchive::Open( const std::string& file ) {
+    Close();
+
+    if ( !File.Open( file ) )
+        return false;
+
+    const uint8_t* data = File.GetData();
+    uint64_t size = File.GetSize();
+
+    if ( size < sizeof( TextureArchiveHeader ) ) {
+        Close();
+        return false;
+    }
+
+    const TextureArchiveHeader* header = reinterpret_cast<const TextureArchiveHeader*>(data);
+    if ( header->Magic != TEXTURE_ARCHIVE_MAGIC || header->Version != TEXTURE_ARCHIVE_VERSION ) {
+        Close();
+        return false;
+    }
+
+    uint64_t indexSize = static_cast<uint64_t>(header->NumEntries) * sizeof( TextureArchiveEntry );
+    if ( header->IndexOffset % alignof(TextureArchiveEntry) != 0
+        || header->IndexOffset > size || indexSize > size - header->IndexOffset
+        || header->StringTableOffset > size || header->StringTableSize > size - header->StringTableOffset ) {
+        Close();
+        return false;
+    }
+
+    Header = header;
+    Entries = reinterpret_cast<const TextureArchiveEntry*>(data + header->IndexOffset);
+    StringTable = reinterpret_cast<const char*>(data + header->StringTableOffset);
+
+    // Remember which directories exist, so callers can walk their search-paths without touching the disk
+    for ( uint32_t i = 0; i < header->NumEntries; i++ ) {
+        const TextureArchiveEntry& e = Entries[i];
+        if ( e.NameOffset > header->StringTableSize || e.NameLength > header->StringTableSize - e.NameOffset )
+            continue;
+
+        std::string dir = DirectoryOf( GetEntryName( e ) );
+        while ( !dir.empty() && Directories.insert( dir ).second ) {
+            dir = DirectoryOf( dir );
+        }
+    }
+
+    return true;
+}
+
+/** Unmaps the archive */
+void TextureArchive::Close() {
+    File.Close();
+    Header = nullptr;
+    Entries = nullptr;
+    StringTable = nullptr;
+    Directories.clear();
+}
+
+/** Returns the name of the given entry */
+std::string TextureArchive::GetEntryName( const TextureArchiveEntry& entry ) const {
+    if ( !Header || entry.NameOffset > Header->StringTableSize || entry.NameLength > Header->StringTableSize - entry.NameOffset )
+        return std::string();
+
+    return std::string( StringTable + entry.NameOffset, entry.NameLength );
+}
+
+/** Converts a path into the form used for hashing */
+std::string TextureArchive::NormalizeName( const std::string& name ) {
+    std::string n = name;
+    for ( char& c : n ) {
+        if ( c == '/' )
+            c = '\\';
+        else
+            c = static_cast<char>(toupper( static_cast<unsigned char>(c) ));
+    }
+
+    // Strip leading ".\" and separators
+    size_t start = 0;
+    while ( start < n.size() && (n[start] == '\\' || (n[start] == '.' && start + 1 < n.size() && n[start + 1] == '\\')) )
+        start += n[start] == '.' ? 2 : 1;
+
+    return n.substr( start );
+}
+
+/** 64-bit FNV-1a of the normalized name */
+uint64_t TextureArchive::HashName( const std::string& normalizedName ) {
+    uint64_t hash = 14695981039346656037ull;
+    for ( char c : normalizedName ) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/** Binary search over the sorted index */
+const TextureArchiveEntry* TextureArchive::FindEntry( const std::string& normalizedName ) const {
+    if ( !Header )
+        return nullptr;
+
+    uint64_t hash = HashName( normalizedName );
+    const TextureArchiveEntry* end = Entries + Header->NumEntries;
+    const TextureArchiveEntry* it = std::lower_bound( Entries, end, hash, []( const TextureArchiveEntry& e, uint64_t h ) {
+        return e.NameHash < h;
+        } );
+
+    // The writer refuses colliding hashes, but compare the name anyways in case of a different name with the same hash
+    for ( ; it != end && it->NameHash == hash; ++it ) {
+        if ( it->NameLength == normalizedName.size()
+            && it->NameOffset <= Header->StringTableSize && it->NameLength <= Header->StringTableSize - it->NameOffset
+            && memcmp( StringTable + it->NameOffset, normalizedName.data(), it->NameLength ) == 0 )
+            return it;
+    }
+
+    return nullptr;
+}
+
+/** Checks that everything the entry points to is inside the archive */
+bool TextureArchive::ValidateEntry( const TextureArchiveEntry& entry ) const {
+    uint64_t size = File.GetSize();
+    if ( entry.PayloadOffset > size || entry.PayloadSize > size - entry.PayloadOffset )
+        return false;
+
+    if ( entry.MipCount == 0 || entry.MipCount > DDS::MAX_MIP_LEVELS )
+        return false;
+
+    return true;
+}
+
+/** Looks up a texture by its path inside the archive */
+bool TextureArchive::Find( const std::string& name, DDS::ImageInfo& info, const uint8_t** payload ) const {
+    const TextureArchiveEntry* entry = FindEntry( NormalizeName( name ) );
+    if ( !entry || !ValidateEntry( *entry ) )
+        return false;
+
+    memset( &info, 0, sizeof( info ) );
+    info.Width = entry->Width;
+    info.Height = entry->Height;
+    info.Format = entry->Format;
+    info.MipCount = entry->MipCount;
+    info.DataOffset = entry->MipOffsets[0];
+
+    // Sizes are implicit through format and dimensions, so only the offsets had to be stored
+    if ( !DDS::ComputeMipLayout( info ) )
+        return false;
+
+    for ( uint32_t i = 0; i < info.MipCount; i++ ) {
+        info.Mips[i].Offset = entry->MipOffsets[i];
+        if ( info.Mips[i].Offset > entry->PayloadSize || info.Mips[i].Size > entry->PayloadSize - info.Mips[i].Offset )
+            return false;
+    }
+
+    if ( payload )
+        *payload = File.GetData() + entry->PayloadOffset;
+
+    return true;
+}
+
+/** Returns whether a texture with the given name is in the archive */
+bool TextureArchive::Contains( const std::string& name ) const {
+    return FindEntry( NormalizeName( name ) ) != nullptr;
+}
+
+/** Returns whether at least one texture is stored below the given directory */
+bool TextureArchive::ContainsDirectory( const std::string& directory ) const {
+    return Directories.find( NormalizeName( directory ) ) != Directories.end();
+}
+
+/** Validates the DDS-Data and queues the entry */
+bool TextureArchiveWriter::AddEntry( const std::string& name, const std::string& sourceFile, std::vector<uint8_t>& data ) {
+    PendingEntry e;
+    e.Name = TextureArchive::NormalizeName( name );
+    e.SourceFile = sourceFile;
+    e.Size = static_cast<uint32_t>(data.size());
+
+    if ( data.size() > UINT32_MAX ) {
+        LastError = name + ": File too big";
+        return false;
+    }
+
+    DDS::EParseResult r = DDS::Parse( data.data(), data.size(), e.Info );
+    if ( r != DDS::PR_OK ) {
+        LastError = name + ": " + DDS::ResultToString( r );
+        return false;
+    }
+
+    uint64_t hash = TextureArchive::HashName( e.Name );
+    if ( !Hashes.insert( hash ).second ) {
+        LastError = name + ": Duplicate name or hash collision";
+        return false;
+    }
+
+    // Files get re-read when writing, so we don't have to keep everything in memory
+    if ( sourceFile.empty() )
+        e.Data = std::move( data );
+
+    Pending.push_back( std::move( e ) );
+    return true;
+}
+
+/** Adds a DDS-File to the archive */
+bool TextureArchiveWriter::AddFile( const std::string& name, const std::string& file ) {
+    std::vector<uint8_t> data;
+    if ( !ReadWholeFile( file, data ) ) {
+        LastError = file + ": Failed to read";
+        return false;
+    }
+
+    return AddEntry( name, file, data );
+}
+
+/** Adds a DDS-File from memory */
+bool TextureArchiveWriter::AddMemory( const std::string& name, std::vector<uint8_t> data ) {
+    return AddEntry( name, std::string(), data );
+}
+
+/** Adds all .dds-files below the given directory, named relative to it */
+int TextureArchiveWriter::AddDirectory( const std::string& directory ) {
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    int numAdded = 0;
+    for ( fs::recursive_directory_iterator it( directory, ec ), end; !ec && it != end; it.increment( ec ) ) {
+        if ( !it->is_regular_file() )
+            continue;
+
+        std::string ext = it->path().extension().string();
+        std::transform( ext.begin(), ext.end(), ext.begin(), ::tolower );
+        if ( ext != ".dds" )
+            continue;
+
+        std::string relative = fs::relative( it->path(), directory, ec ).string();
+        if ( AddFile( relative, it->path().string() ) )
+            numAdded++;
+    }
+
+    return numAdded;
+}
+
+/** Writes the archive */
+bool TextureArchiveWriter::Write( const std::string& file ) {
+    // Store payloads by name so files of the same directory end up next to each other
+    std::sort( Pending.begin(), Pending.end(), []( const PendingEntry& a, const PendingEntry& b ) {
+        return a.Name < b.Name;
+        } );
+
+    TextureArchiveHeader header = {};
+    header.Magic = TEXTURE_ARCHIVE_MAGIC;
+    header.Version = TEXTURE_ARCHIVE_VERSION;
+    header.NumEntries = static_cast<uint32_t>(Pending.size());
+    header.Alignment = TEXTURE_ARCHIVE_ALIGNMENT;
+    header.IndexOffset = sizeof( TextureArchiveHeader );
+    header.StringTableOffset = header.IndexOffset + Pending.size() * sizeof( TextureArchiveEntry );
+
+    std::string strings;
+    std::vector<TextureArchiveEntry> entries( Pending.size() );
+    for ( size_t i = 0; i < Pending.size(); i++ ) {
+        const PendingEntry& p = Pending[i];
+        TextureArchiveEntry& e = entries[i];
+        memset( &e, 0, sizeof( e ) );
+
+        e.NameHash = TextureArchive::HashName( p.Name );
+        e.NameOffset = static_cast<uint32_t>(strings.size());
+        e.NameLength = static_cast<uint32_t>(p.Name.size());
+        e.PayloadSize = p.Size;
+        e.Width = p.Info.Width;
+        e.Height = p.Info.Height;
+        e.Format = p.Info.Format;
+        e.MipCount = p.Info.MipCount;
+        for ( uint32_t m = 0; m < p.Info.MipCount; m++ )
+            e.MipOffsets[m] = p.Info.Mips[m].Offset;
+
+        strings += p.Name;
+    }
+
+    header.StringTableSize = strings.size();
+    header.DataOffset = AlignUp( header.StringTableOffset + header.StringTableSize, TEXTURE_ARCHIVE_ALIGNMENT );
+
+    uint64_t offset = header.DataOffset;
+    for ( TextureArchiveEntry& e : entries ) {
+        e.PayloadOffset = offset;
+        offset = AlignUp( offset + e.PayloadSize, TEXTURE_ARCHIVE_ALIGNMENT );
+    }
+
+    FILE* f = fopen( file.c_str(), "wb" );
+    if ( !f ) {
+        LastError = file + ": Failed to open for writing";
+        return false;
+    }
+
+    // The index is sorted by hash, the payloads stay in name-order
+    std::vector<TextureArchiveEntry> index = entries;
+    std::sort( index.begin(), index.end(), []( const TextureArchiveEntry& a, const TextureArchiveEntry& b ) {
+        return a.NameHash < b.NameHash;
+        } );
+
+    bool ok = fwrite( &header, sizeof( header ), 1, f ) == 1;
+    ok = ok && (index.empty() || fwrite( index.data(), sizeof( TextureArchiveEntry ), index.size(), f ) == index.size());
+    ok = ok && (strings.empty() || fwrite( strings.data(), 1, strings.size(), f ) == strings.size());
+
+    const std::vector<uint8_t> padding( TEXTURE_ARCHIVE_ALIGNMENT, 0 );
+    uint64_t written = header.StringTableOffset + header.StringTableSize;
+    std::vector<uint8_t> data;
+    for ( size_t i = 0; ok && i < Pending.size(); i++ ) {
+        const PendingEntry& p = Pending[i];
+
+        ok = fwrite( padding.data(), 1, static_cast<size_t>(entries[i].PayloadOffset - written), f ) == entries[i].PayloadOffset - written;
+
+        if ( p.SourceFile.empty() ) {
+            data = p.Data;
+        } else if ( !ReadWholeFile( p.SourceFile, data ) || data.size() != p.Size ) {
+            LastError = p.SourceFile + ": File changed while packing";
+            ok = false;
+            break;
+        }
+
+        ok = ok && fwrite( data.data(), 1, data.size(), f ) == data.size();
+        written = entries[i].PayloadOffset + p.Size;
+    }
+
+    fclose( f );
+
+    if ( !ok && LastError.empty() )
+        LastError = file + ": Failed to write";
+
+    return ok;
+}
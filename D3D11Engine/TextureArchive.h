@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include "DDSParser.h"
+#include "MemoryMappedFile.h"
+
+/** Packed texture archive (.gta)
+
+    Holds many DDS-Files in one file, so loading replacement textures doesn't need one
+    open/read/close per texture. Layout:
+
+    [TextureArchiveHeader]
+    [TextureArchiveEntry * NumEntries]  - Sorted by NameHash
+    [String table]                      - Normalized names, not null-terminated
+    [DDS-Files]                         - Each one aligned to TEXTURE_ARCHIVE_ALIGNMENT
+
+    The DDS-Files are stored untouched. Their mip-layout is precomputed into the entry,
+    so the engine can upload directly out of the mapped memory. */
+
+const uint32_t TEXTURE_ARCHIVE_MAGIC = 0x52415447; // "GTAR"
+const uint32_t TEXTURE_ARCHIVE_VERSION = 1;
+const uint32_t TEXTURE_ARCHIVE_ALIGNMENT = 4096;
+const char* const TEXTURE_ARCHIVE_EXTENSION = ".gta";
+
+#pragma pack(push, 4)
+struct TextureArchiveHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumEntries;
+    uint32_t Alignment;
+    uint64_t IndexOffset;
+    uint64_t StringTableOffset;
+    uint64_t StringTableSize;
+    uint64_t DataOffset;
+};
+
+struct TextureArchiveEntry {
+    uint64_t NameHash;
+
+    /** Location of the DDS-File inside the archive */
+    uint64_t PayloadOffset;
+    uint32_t PayloadSize;
+
+    /** Location of the name inside the string table */
+    uint32_t NameOffset;
+    uint32_t NameLength;
+
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Format;
+    uint32_t MipCount;
+
+    /** Mip offsets relative to PayloadOffset */
+    uint32_t MipOffsets[DDS::MAX_MIP_LEVELS];
+};
+#pragma pack(pop)
+
+class TextureArchive {
+public:
+    TextureArchive();
+    ~TextureArchive();
+
+    /** Maps the archive and validates header and index. Returns false if the file is missing or broken. */
+    bool Open( const std::string& file );
+
+    /** Unmaps the archive */
+    void Close();
+
+    bool IsOpen() const { return Header != nullptr; }
+
+    /** Looks up a texture by its path inside the archive, like "Normalmaps_Original\\STONE_normal.dds".
+        Fills the layout of all mip-levels with pointers into the mapped memory. */
+    bool Find( const std::string& name, DDS::ImageInfo& info, const uint8_t** payload ) const;
+
+    /** Returns whether a texture with the given name is in the archive */
+    bool Contains( const std::string& name ) const;
+
+    /** Returns whether at least one texture is stored below the given directory */
+    bool ContainsDirectory( const std::string& directory ) const;
+
+    /** Returns the number of textures in the archive */
+    uint32_t GetNumEntries() const { return Header ? Header->NumEntries : 0; }
+
+    /** Returns the entry at the given index. Entries are sorted by hash, not by name. */
+    const TextureArchiveEntry& GetEntry( uint32_t index ) const { return Entries[index]; }
+
+    /** Returns the name of the given entry */
+    std::string GetEntryName( const TextureArchiveEntry& entry ) const;
+
+    /** Converts a path into the form used for hashing: uppercase and with backslashes */
+    static std::string NormalizeName( const std::string& name );
+
+    /** 64-bit FNV-1a of the normalized name */
+    static uint64_t HashName( const std::string& normalizedName );
+
+private:
+    /** Binary search over the sorted index */
+    const TextureArchiveEntry* FindEntry( const std::string& normalizedName ) const;
+
+    /** Checks that everything the entry points to is inside the archive */
+    bool ValidateEntry( const TextureArchiveEntry& entry ) const;
+
+    MemoryMappedFile File;
+    const TextureArchiveHeader* Header;
+    const TextureArchiveEntry* Entries;
+    const char* StringTable;
+
+    /** All directories which contain textures, normalized */
+    std::unordered_set<std::string> Directories;
+};
+
+/** Builds .gta-files out of loose DDS-Files. Used by the offline packer tool. */
+class TextureArchiveWriter {
+public:
+    /** Adds a DDS-File to the archive. The name is the path the engine will look it up with. */
+    bool AddFile( const std::string& name, const std::string& file );
+
+    /** Adds a DDS-File from memory */
+    bool AddMemory( const std::string& name, std::vector<uint8_t> data );
+
+    /** Adds all .dds-files below the given directory, named relative to it. Returns the number of added files. */
+    int AddDirectory( const std::string& directory );
+
+    /** Writes the archive */
+    bool Write( const std::string& file );
+
+    /** Returns the reason for the last failed call */
+    const std::string& GetLastError() const { return LastError; }
+
+private:
+    struct PendingEntry {
+        std::string Name;
+        std::string SourceFile; // Empty if the data was added from memory
+        std::vector<uint8_t> Data;
+        uint32_t Size;
+        DDS::ImageInfo Info;
+    };
+
+    /** Validates the DDS-Data and queues the entry */
+    bool AddEntry( const std::string& name, const std::string& sourceFile, std::vector<uint8_t>& data );
+
+    std::vector<PendingEntry> Pending;
+    std::unordered_set<uint64_t> Hashes;
+    std::string LastError;
+};
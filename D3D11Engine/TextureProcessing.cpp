@@ -0,0 +1,792 @@
+#include "TextureProcessing.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <immintrin.h>
+#include <memory>
+#include <thread>
+#include "ThreadPool.h"
+
+namespace {
+    const double PI = 3.14159265358979323846;
+
+    double SRGBToLinearExact( double c ) {
+        return c <= 0.04045 ? c / 12.92 : pow( (c + 0.055) / 1.055, 2.4 );
+    }
+
+    inline int Expand5( int v ) { return (v << 3) | (v >> 2); }
+    inline int Expand6( int v ) { return (v << 2) | (v >> 4); }
+
+    /** Color two thirds of the way from b to a, like the palette of a BC-block */
+    inline int Interpolate( int a, int b ) { return (2 * a + b + 1) / 3; }
+
+    /** Modified bessel-function of the first kind, for the kaiser-window */
+    double BesselI0( double x ) {
+        double sum = 1.0;
+        double term = 1.0;
+        for ( int k = 1; k < 32; k++ ) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    struct ColorTables {
+        ColorTables() {
+            for ( int i = 0; i < 256; i++ ) {
+                SRGBToLinear[i] = static_cast<float>(SRGBToLinearExact( i / 255.0 ));
+                UNormToFloat[i] = i / 255.0f;
+            }
+
+            // Linear values where rounding switches over to the next sRGB-value
+            for ( int i = 0; i < 255; i++ ) {
+                SRGBThresholds[i] = static_cast<float>(SRGBToLinearExact( (i + 0.5) / 255.0 ));
+            }
+
+            // Thresholds lie at least 1 / (255 * 12.92) apart, so no bucket holds more than one of them
+            int below = 0;
+            for ( int b = 0; b < SRGB_BUCKETS; b++ ) {
+                while ( below < 255 && SRGBThresholds[below] < b / static_cast<float>(SRGB_BUCKETS) ) {
+                    below++;
+                }
+                SRGBBuckets[b] = static_cast<uint8_t>(below);
+            }
+
+            BuildSingleColorMatch( Match5, 31, Expand5 );
+            BuildSingleColorMatch( Match6, 63, Expand6 );
+        }
+
+        /** Finds the endpoints whose first interpolated color comes closest to every value */
+        static void BuildSingleColorMatch( uint8_t match[256][2], int maxValue, int (*expand)(int) ) {
+            for ( int v = 0; v < 256; v++ ) {
+                int bestError = 256;
+                for ( int hi = 0; hi <= maxValue; hi++ ) {
+                    for ( int lo = 0; lo <= maxValue; lo++ ) {
+                        int error = abs( Interpolate( expand( hi ), expand( lo ) ) - v );
+                        if ( error < bestError ) {
+                            bestError = error;
+                            match[v][0] = static_cast<uint8_t>(hi);
+                            match[v][1] = static_cast<uint8_t>(lo);
+                        }
+                    }
+                }
+            }
+        }
+
+        float SRGBToLinear[256];
+        float UNormToFloat[256];
+        float SRGBThresholds[255];
+
+        /** Number of thresholds below the start of each bucket of linear values */
+        static const int SRGB_BUCKETS = 4096;
+        uint8_t SRGBBuckets[SRGB_BUCKETS];
+        uint8_t Match5[256][2];
+        uint8_t Match6[256][2];
+    };
+
+    const ColorTables& GetTables() {
+        static const ColorTables tables;
+        return tables;
+    }
+
+    /** Source texels 2x + First ... 2x + First + Count - 1 make up destination texel x */
+    struct FilterTaps {
+        int First;
+        int Count;
+        float Weights[6];
+    };
+
+    FilterTaps MakeKaiserTaps() {
+        const double alpha = 4.0;
+        const double width = 1.5; // In destination texels
+
+        FilterTaps taps = {};
+        taps.First = -2;
+        taps.Count = 6;
+
+        double weights[6];
+        double sum = 0.0;
+        for ( int i = 0; i < taps.Count; i++ ) {
+            // Distance of the source texel center to the destination texel center, in destination texels
+            double d = (taps.First + i - 0.5) / 2.0;
+            double sinc = sin( PI * d ) / (PI * d);
+            double r = d / width;
+            double window = BesselI0( alpha * sqrt( std::max( 0.0, 1.0 - r * r ) ) ) / BesselI0( alpha );
+            weights[i] = sinc * window;
+            sum += weights[i];
+        }
+
+        for ( int i = 0; i < taps.Count; i++ ) {
+            taps.Weights[i] = static_cast<float>(weights[i] / sum);
+        }
+        return taps;
+    }
+
+    const FilterTaps& GetTaps( ETextureMipFilter filter ) {
+        static const FilterTaps box = { 0, 2, { 0.5f, 0.5f } };
+        static const FilterTaps kaiser = MakeKaiserTaps();
+        return filter == TMF_KAISER ? kaiser : box;
+    }
+
+    /** Filters a row along x, one RGBA-texel per register. Only the texels at the border need clamping. */
+    void FilterRow( const float* row, uint32_t width, const FilterTaps& taps, float* out ) {
+        const int last = static_cast<int>(width) - 1;
+        const uint32_t dstWidth = width / 2;
+        for ( uint32_t x = 0; x < dstWidth; x++ ) {
+            const int first = static_cast<int>(2 * x) + taps.First;
+            __m128 sum = _mm_setzero_ps();
+            if ( first >= 0 && first + taps.Count - 1 <= last ) {
+                const float* texel = row + first * 4;
+                for ( int k = 0; k < taps.Count; k++ ) {
+                    sum = _mm_add_ps( sum, _mm_mul_ps( _mm_set1_ps( taps.Weights[k] ), _mm_loadu_ps( texel + k * 4 ) ) );
+                }
+            } else {
+                for ( int k = 0; k < taps.Count; k++ ) {
+                    int s = std::min( std::max( first + k, 0 ), last );
+                    sum = _mm_add_ps( sum, _mm_mul_ps( _mm_set1_ps( taps.Weights[k] ), _mm_loadu_ps( row + s * 4 ) ) );
+                }
+            }
+            _mm_storeu_ps( out + x * 4, sum );
+        }
+    }
+
+    /** Filters along y into a single row, four floats at a time */
+    void FilterColumn( const float* src, uint32_t width, uint32_t height, uint32_t y, const FilterTaps& taps, float* out ) {
+        const size_t rowFloats = static_cast<size_t>(width) * 4;
+        const float* rows[6];
+        for ( int k = 0; k < taps.Count; k++ ) {
+            int s = std::min( std::max( static_cast<int>(2 * y) + taps.First + k, 0 ), static_cast<int>(height) - 1 );
+            rows[k] = src + s * rowFloats;
+        }
+
+        for ( size_t i = 0; i < rowFloats; i += 4 ) {
+            __m128 sum = _mm_setzero_ps();
+            for ( int k = 0; k < taps.Count; k++ ) {
+                sum = _mm_add_ps( sum, _mm_mul_ps( _mm_set1_ps( taps.Weights[k] ), _mm_loadu_ps( rows[k] + i ) ) );
+            }
+            _mm_storeu_ps( out + i, sum );
+        }
+    }
+
+    /** The 16 texels of a block, one array per channel */
+    struct BlockPixels {
+        alignas(16) float R[16];
+        alignas(16) float G[16];
+        alignas(16) float B[16];
+    };
+
+    struct ColorEndpoints {
+        uint16_t Color0;
+        uint16_t Color1;
+    };
+
+    uint16_t Quantize565( float r, float g, float b ) {
+        int r5 = std::min( std::max( static_cast<int>(lrintf( r * (31.0f / 255.0f) )), 0 ), 31 );
+        int g6 = std::min( std::max( static_cast<int>(lrintf( g * (63.0f / 255.0f) )), 0 ), 63 );
+        int b5 = std::min( std::max( static_cast<int>(lrintf( b * (31.0f / 255.0f) )), 0 ), 31 );
+        return static_cast<uint16_t>((r5 << 11) | (g6 << 5) | b5);
+    }
+
+    void Unpack565( uint16_t c, int rgb[3] ) {
+        rgb[0] = Expand5( c >> 11 );
+        rgb[1] = Expand6( (c >> 5) & 63 );
+        rgb[2] = Expand5( c & 31 );
+    }
+
+    /** Palette of the four color mode */
+    void BuildPalette( uint16_t color0, uint16_t color1, int palette[4][3] ) {
+        Unpack565( color0, palette[0] );
+        Unpack565( color1, palette[1] );
+        for ( int c = 0; c < 3; c++ ) {
+            palette[2][c] = Interpolate( palette[0][c], palette[1][c] );
+            palette[3][c] = Interpolate( palette[1][c], palette[0][c] );
+        }
+    }
+
+    /** Picks the closest palette entry for every texel, four texels at a time. Returns the 2-bit indices. */
+    uint32_t MatchIndices( const BlockPixels& pixels, const int palette[4][3], float& error ) {
+        __m128 pr[4];
+        __m128 pg[4];
+        __m128 pb[4];
+        for ( int k = 0; k < 4; k++ ) {
+            pr[k] = _mm_set1_ps( static_cast<float>(palette[k][0]) );
+            pg[k] = _mm_set1_ps( static_cast<float>(palette[k][1]) );
+            pb[k] = _mm_set1_ps( static_cast<float>(palette[k][2]) );
+        }
+
+        uint32_t indices = 0;
+        __m128 total = _mm_setzero_ps();
+        for ( int q = 0; q < 4; q++ ) {
+            __m128 r = _mm_load_ps( pixels.R + q * 4 );
+            __m128 g = _mm_load_ps( pixels.G + q * 4 );
+            __m128 b = _mm_load_ps( pixels.B + q * 4 );
+
+            __m128 best = _mm_set1_ps( 1e30f );
+            __m128i bestIndex = _mm_setzero_si128();
+            for ( int k = 0; k < 4; k++ ) {
+                __m128 dr = _mm_sub_ps( r, pr[k] );
+                __m128 dg = _mm_sub_ps( g, pg[k] );
+                __m128 db = _mm_sub_ps( b, pb[k] );
+                __m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dr, dr ), _mm_mul_ps( dg, dg ) ), _mm_mul_ps( db, db ) );
+
+                __m128i closer = _mm_castps_si128( _mm_cmplt_ps( d, best ) );
+                best = _mm_min_ps( d, best );
+                bestIndex = _mm_or_si128( _mm_and_si128( closer, _mm_set1_epi32( k ) ), _mm_andnot_si128( closer, bestIndex ) );
+            }
+            total = _mm_add_ps( total, best );
+
+            alignas(16) uint32_t chosen[4];
+            _mm_store_si128( reinterpret_cast<__m128i*>(chosen), bestIndex );
+            for ( int j = 0; j < 4; j++ ) {
+                indices |= chosen[j] << (2 * (q * 4 + j));
+            }
+        }
+
+        alignas(16) float sums[4];
+        _mm_store_ps( sums, total );
+        error = sums[0] + sums[1] + sums[2] + sums[3];
+        return indices;
+    }
+
+    /** Least-squares endpoints for the given indices. Returns false if all texels use the same weight. */
+    bool FitEndpoints( const BlockPixels& pixels, uint32_t indices, ColorEndpoints& out ) {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        float at[3] = {};
+        float bt[3] = {};
+        for ( int i = 0; i < 16; i++ ) {
+            float a = weights[(indices >> (2 * i)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+
+            const float p[3] = { pixels.R[i], pixels.G[i], pixels.B[i] };
+            for ( int c = 0; c < 3; c++ ) {
+                at[c] += a * p[c];
+                bt[c] += b * p[c];
+            }
+        }
+
+        float det = aa * bb - ab * ab;
+        if ( fabsf( det ) < 1e-6f )
+            return false;
+
+        float c0[3];
+        float c1[3];
+        for ( int c = 0; c < 3; c++ ) {
+            c0[c] = (at[c] * bb - bt[c] * ab) / det;
+            c1[c] = (bt[c] * aa - at[c] * ab) / det;
+        }
+
+        out.Color0 = Quantize565( c0[0], c0[1], c0[2] );
+        out.Color1 = Quantize565( c1[0], c1[1], c1[2] );
+        return true;
+    }
+
+    void WriteColorBlock( uint16_t color0, uint16_t color1, uint32_t indices, uint8_t out[8] ) {
+        // The four color mode needs color0 > color1
+        if ( color0 < color1 ) {
+            std::swap( color0, color1 );
+            indices ^= 0x55555555; // 0 <-> 1, 2 <-> 3
+        } else if ( color0 == color1 ) {
+            indices = 0;
+        }
+
+        out[0] = static_cast<uint8_t>(color0);
+        out[1] = static_cast<uint8_t>(color0 >> 8);
+        out[2] = static_cast<uint8_t>(color1);
+        out[3] = static_cast<uint8_t>(color1 >> 8);
+        out[4] = static_cast<uint8_t>(indices);
+        out[5] = static_cast<uint8_t>(indices >> 8);
+        out[6] = static_cast<uint8_t>(indices >> 16);
+        out[7] = static_cast<uint8_t>(indices >> 24);
+    }
+
+    void CompressColorBlock( const uint8_t block[64], uint8_t out[8] ) {
+        BlockPixels pixels;
+        float mean[3] = {};
+        bool singleColor = true;
+        for ( int i = 0; i < 16; i++ ) {
+            pixels.R[i] = block[i * 4 + 0];
+            pixels.G[i] = block[i * 4 + 1];
+            pixels.B[i] = block[i * 4 + 2];
+            mean[0] += pixels.R[i];
+            mean[1] += pixels.G[i];
+            mean[2] += pixels.B[i];
+            singleColor = singleColor && memcmp( block, block + i * 4, 3 ) == 0;
+        }
+
+        if ( singleColor ) {
+            // Interpolated colors get closer than the endpoints alone
+            const ColorTables& tables = GetTables();
+            uint16_t color0 = static_cast<uint16_t>((tables.Match5[block[0]][0] << 11) | (tables.Match6[block[1]][0] << 5) | tables.Match5[block[2]][0]);
+            uint16_t color1 = static_cast<uint16_t>((tables.Match5[block[0]][1] << 11) | (tables.Match6[block[1]][1] << 5) | tables.Match5[block[2]][1]);
+            WriteColorBlock( color0, color1, 0xAAAAAAAA, out ); // Everything on index 2
+            return;
+        }
+
+        for ( int c = 0; c < 3; c++ ) {
+            mean[c] /= 16.0f;
+        }
+
+        // Covariance of the colors
+        float cov[6] = {};
+        for ( int i = 0; i < 16; i++ ) {
+            float r = pixels.R[i] - mean[0];
+            float g = pixels.G[i] - mean[1];
+            float b = pixels.B[i] - mean[2];
+            cov[0] += r * r;
+            cov[1] += r * g;
+            cov[2] += r * b;
+            cov[3] += g * g;
+            cov[4] += g * b;
+            cov[5] += b * b;
+        }
+
+        // Principal axis by power-iteration, starting at the diagonal of the bounding box
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for ( int iteration = 0; iteration < 4; iteration++ ) {
+            float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+            float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+            float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+            float m = std::max( fabsf( x ), std::max( fabsf( y ), fabsf( z ) ) );
+            if ( m < 1e-4f )
+                break;
+
+            axis[0] = x / m;
+            axis[1] = y / m;
+            axis[2] = z / m;
+        }
+
+        // The texels furthest out along the axis become the endpoints
+        int minTexel = 0;
+        int maxTexel = 0;
+        float minDot = 1e30f;
+        float maxDot = -1e30f;
+        for ( int i = 0; i < 16; i++ ) {
+            float d = pixels.R[i] * axis[0] + pixels.G[i] * axis[1] + pixels.B[i] * axis[2];
+            if ( d < minDot ) {
+                minDot = d;
+                minTexel = i;
+            }
+            if ( d > maxDot ) {
+                maxDot = d;
+                maxTexel = i;
+            }
+        }
+
+        ColorEndpoints best;
+        best.Color0 = Quantize565( pixels.R[maxTexel], pixels.G[maxTexel], pixels.B[maxTexel] );
+        best.Color1 = Quantize565( pixels.R[minTexel], pixels.G[minTexel], pixels.B[minTexel] );
+
+        int palette[4][3];
+        float bestError;
+        BuildPalette( best.Color0, best.Color1, palette );
+        uint32_t bestIndices = MatchIndices( pixels, palette, bestError );
+
+        // Refit the endpoints to the chosen indices, as long as it gets better
+        for ( int iteration = 0; iteration < 2; iteration++ ) {
+            ColorEndpoints refined;
+            if ( !FitEndpoints( pixels, bestIndices, refined ) )
+                break;
+
+            if ( refined.Color0 == best.Color0 && refined.Color1 == best.Color1 )
+                break;
+
+            float error;
+            BuildPalette( refined.Color0, refined.Color1, palette );
+            uint32_t indices = MatchIndices( pixels, palette, error );
+            if ( error >= bestError )
+                break;
+
+            best = refined;
+            bestIndices = indices;
+            bestError = error;
+        }
+
+        WriteColorBlock( best.Color0, best.Color1, bestIndices, out );
+    }
+
+    /** Eight-value mode between the smallest and largest alpha */
+    void CompressAlphaBlock( const uint8_t block[64], uint8_t out[8] ) {
+        int minAlpha = 255;
+        int maxAlpha = 0;
+        for ( int i = 0; i < 16; i++ ) {
+            minAlpha = std::min( minAlpha, static_cast<int>(block[i * 4 + 3]) );
+            maxAlpha = std::max( maxAlpha, static_cast<int>(block[i * 4 + 3]) );
+        }
+
+        out[0] = static_cast<uint8_t>(maxAlpha);
+        out[1] = static_cast<uint8_t>(minAlpha);
+        memset( out + 2, 0, 6 );
+        if ( minAlpha == maxAlpha )
+            return;
+
+        int palette[8];
+        palette[0] = maxAlpha;
+        palette[1] = minAlpha;
+        for ( int k = 1; k < 7; k++ ) {
+            palette[k + 1] = ((7 - k) * maxAlpha + k * minAlpha + 3) / 7;
+        }
+
+        uint64_t bits = 0;
+        for ( int i = 0; i < 16; i++ ) {
+            int a = block[i * 4 + 3];
+            int bestIndex = 0;
+            int bestError = 256;
+            for ( int k = 0; k < 8; k++ ) {
+                int error = abs( a - palette[k] );
+                if ( error < bestError ) {
+                    bestError = error;
+                    bestIndex = k;
+                }
+            }
+            bits |= static_cast<uint64_t>(bestIndex) << (3 * i);
+        }
+
+        for ( int i = 0; i < 6; i++ ) {
+            out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+        }
+    }
+
+    /** Decodes a color block, threeColorMode is only allowed for BC1 */
+    void DecompressColorBlock( const uint8_t in[8], bool allowThreeColors, uint8_t block[64] ) {
+        uint16_t color0 = static_cast<uint16_t>(in[0] | (in[1] << 8));
+        uint16_t color1 = static_cast<uint16_t>(in[2] | (in[3] << 8));
+        uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+
+        int palette[4][4];
+        Unpack565( color0, palette[0] );
+        Unpack565( color1, palette[1] );
+        palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+        if ( color0 > color1 || !allowThreeColors ) {
+            for ( int c = 0; c < 3; c++ ) {
+                palette[2][c] = Interpolate( palette[0][c], palette[1][c] );
+                palette[3][c] = Interpolate( palette[1][c], palette[0][c] );
+            }
+        } else {
+            for ( int c = 0; c < 3; c++ ) {
+                palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+                palette[3][c] = 0;
+            }
+            palette[3][3] = 0;
+        }
+
+        for ( int i = 0; i < 16; i++ ) {
+            const int* p = palette[(indices >> (2 * i)) & 3];
+            for ( int c = 0; c < 4; c++ ) {
+                block[i * 4 + c] = static_cast<uint8_t>(p[c]);
+            }
+        }
+    }
+
+    /** Copies the 4x4 block at (bx, by), repeating the last row and column where it sticks out */
+    void FetchBlock( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch, uint32_t bx, uint32_t by, uint8_t block[64] ) {
+        for ( uint32_t y = 0; y < 4; y++ ) {
+            const uint8_t* row = rgba + static_cast<size_t>(std::min( by * 4 + y, height - 1 )) * rowPitch;
+            if ( bx * 4 + 4 <= width ) {
+                memcpy( block + y * 16, row + bx * 16, 16 );
+                continue;
+            }
+
+            for ( uint32_t x = 0; x < 4; x++ ) {
+                memcpy( block + y * 16 + x * 4, row + std::min( bx * 4 + x, width - 1 ) * 4, 4 );
+            }
+        }
+    }
+
+    /** Writes one level of the processed texture */
+    void WriteLevel( const uint8_t* rgba, uint32_t rowPitch, const ProcessedTextureLevel& level,
+        const TextureProcessOptions& options, uint8_t* out ) {
+        if ( options.Format == TBF_RGBA8 ) {
+            for ( uint32_t y = 0; y < level.Height; y++ ) {
+                memcpy( out + y * level.RowPitch, rgba + static_cast<size_t>(y) * rowPitch, level.Width * 4 );
+            }
+            return;
+        }
+
+        TextureProcessing::CompressImage( rgba, level.Width, level.Height, rowPitch, options.Format, out, options.Pool );
+    }
+}
+
+uint32_t TextureProcessing::GetNumMipLevels( uint32_t width, uint32_t height ) {
+    uint32_t size = std::max( width, height );
+    uint32_t levels = 1;
+    while ( size > 1 ) {
+        size /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+uint32_t TextureProcessing::GetRowPitch( ETextureBlockFormat format, uint32_t width ) {
+    switch ( format ) {
+    case TBF_BC1: return std::max( 1u, (width + 3) / 4 ) * 8;
+    case TBF_BC3: return std::max( 1u, (width + 3) / 4 ) * 16;
+    default: return width * 4;
+    }
+}
+
+uint32_t TextureProcessing::GetLevelSize( ETextureBlockFormat format, uint32_t width, uint32_t height ) {
+    uint32_t rows = format == TBF_RGBA8 ? height : std::max( 1u, (height + 3) / 4 );
+    return GetRowPitch( format, width ) * rows;
+}
+
+float TextureProcessing::SRGBToLinear( uint8_t value ) {
+    return GetTables().SRGBToLinear[value];
+}
+
+uint8_t TextureProcessing::LinearToSRGB( float value ) {
+    if ( !(value > 0.0f) )
+        return 0;
+    if ( value >= 1.0f )
+        return 255;
+
+    // Count the thresholds below the value: the ones below its bucket, plus the one that may be inside
+    const ColorTables& tables = GetTables();
+    uint32_t i = tables.SRGBBuckets[static_cast<int>(value * ColorTables::SRGB_BUCKETS)];
+    if ( i < 255 && value > tables.SRGBThresholds[i] )
+        i++;
+    return static_cast<uint8_t>(i);
+}
+
+void TextureProcessing::ToLinear( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch, bool gammaCorrect, float* out ) {
+    const ColorTables& tables = GetTables();
+    const float* colorTable = gammaCorrect ? tables.SRGBToLinear : tables.UNormToFloat;
+    for ( uint32_t y = 0; y < height; y++ ) {
+        const uint8_t* row = rgba + static_cast<size_t>(y) * rowPitch;
+        float* dst = out + static_cast<size_t>(y) * width * 4;
+        for ( uint32_t x = 0; x < width * 4; x += 4 ) {
+            dst[x + 0] = colorTable[row[x + 0]];
+            dst[x + 1] = colorTable[row[x + 1]];
+            dst[x + 2] = colorTable[row[x + 2]];
+            dst[x + 3] = tables.UNormToFloat[row[x + 3]];
+        }
+    }
+}
+
+void TextureProcessing::FromLinear( const float* linear, uint32_t width, uint32_t height, bool gammaCorrect, uint8_t* out ) {
+    const ColorTables& tables = GetTables();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.0f );
+    const __m128 unorm = _mm_set1_ps( 255.0f );
+    const __m128 buckets = _mm_set1_ps( static_cast<float>(ColorTables::SRGB_BUCKETS) );
+    const __m128i lastBucket = _mm_set1_epi32( ColorTables::SRGB_BUCKETS - 1 );
+
+    const size_t count = static_cast<size_t>(width) * height * 4;
+    for ( size_t i = 0; i < count; i += 4 ) {
+        // Clamping like LinearToSRGB, NaN goes to 0
+        __m128 v = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( linear + i ), zero ), one );
+
+        alignas(16) int32_t values[4];
+        _mm_store_si128( reinterpret_cast<__m128i*>(values), _mm_cvtps_epi32( _mm_mul_ps( v, unorm ) ) );
+        out[i + 3] = static_cast<uint8_t>(values[3]);
+        if ( !gammaCorrect ) {
+            out[i + 0] = static_cast<uint8_t>(values[0]);
+            out[i + 1] = static_cast<uint8_t>(values[1]);
+            out[i + 2] = static_cast<uint8_t>(values[2]);
+            continue;
+        }
+
+        // Same lookup as LinearToSRGB
+        alignas(16) float clamped[4];
+        alignas(16) int32_t bucket[4];
+        _mm_store_ps( clamped, v );
+        __m128i b = _mm_cvttps_epi32( _mm_mul_ps( v, buckets ) );
+        b = _mm_xor_si128( b, _mm_and_si128( _mm_xor_si128( b, lastBucket ), _mm_cmpgt_epi32( b, lastBucket ) ) ); // min
+        _mm_store_si128( reinterpret_cast<__m128i*>(bucket), b );
+        for ( int c = 0; c < 3; c++ ) {
+            uint32_t s = tables.SRGBBuckets[bucket[c]];
+            if ( s < 255 && clamped[c] > tables.SRGBThresholds[s] )
+                s++;
+            out[i + c] = static_cast<uint8_t>(s);
+        }
+    }
+}
+
+void TextureProcessing::Downsample( const float* src, uint32_t width, uint32_t height, ETextureMipFilter filter, float* dst ) {
+    const FilterTaps& taps = GetTaps( filter );
+    const uint32_t dstWidth = std::max( width / 2, 1u );
+    const uint32_t dstHeight = std::max( height / 2, 1u );
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps( 1.0f );
+
+    // Along y into one row, then along x into the destination. Sides of a single texel stay as they are.
+    std::vector<float> column( static_cast<size_t>(width) * 4 );
+    for ( uint32_t y = 0; y < dstHeight; y++ ) {
+        const float* row = src;
+        if ( height > 1 ) {
+            FilterColumn( src, width, height, y, taps, column.data() );
+            row = column.data();
+        }
+
+        float* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+        if ( width > 1 ) {
+            FilterRow( row, width, taps, out );
+        } else {
+            memcpy( out, row, 4 * sizeof( float ) );
+        }
+
+        // The negative lobes of the kaiser-filter can overshoot
+        for ( uint32_t x = 0; x < dstWidth * 4; x += 4 ) {
+            _mm_storeu_ps( out + x, _mm_min_ps( _mm_max_ps( _mm_loadu_ps( out + x ), zero ), one ) );
+        }
+    }
+}
+
+void TextureProcessing::CompressImage( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch,
+    ETextureBlockFormat format, uint8_t* out, ThreadPool* pool ) {
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const uint32_t blockSize = format == TBF_BC1 ? 8 : 16;
+
+    auto compressRow = [=]( uint32_t by ) {
+        uint8_t block[64];
+        uint8_t* dst = out + static_cast<size_t>(by) * blocksX * blockSize;
+        for ( uint32_t bx = 0; bx < blocksX; bx++ ) {
+            FetchBlock( rgba, width, height, rowPitch, bx, by, block );
+            if ( format == TBF_BC1 ) {
+                CompressBC1Block( block, dst + bx * blockSize );
+            } else {
+                CompressBC3Block( block, dst + bx * blockSize );
+            }
+        }
+    };
+
+    // Small images aren't worth waking up other threads
+    size_t numHelpers = 0;
+    if ( pool && blocksX * blocksY >= 256 ) {
+        numHelpers = std::min<size_t>( pool->getNumThreads(), blocksY - 1 );
+    }
+
+    if ( !numHelpers ) {
+        for ( uint32_t by = 0; by < blocksY; by++ ) {
+            compressRow( by );
+        }
+        return;
+    }
+
+    // Rows are handed out one by one. The caller works along, so nothing waits on a helper that
+    // hasn't started yet, which could never happen when this runs on the pool itself. Helpers
+    // starting late only find the job done, so it is shared.
+    struct Job {
+        std::function<void( uint32_t )> CompressRow;
+        uint32_t NumRows;
+        std::atomic<uint32_t> NextRow;
+        std::atomic<uint32_t> RowsDone;
+    };
+
+    auto job = std::make_shared<Job>();
+    job->CompressRow = compressRow;
+    job->NumRows = blocksY;
+    job->NextRow = 0;
+    job->RowsDone = 0;
+
+    auto work = []( Job& j ) {
+        for ( uint32_t row = j.NextRow++; row < j.NumRows; row = j.NextRow++ ) {
+            j.CompressRow( row );
+            j.RowsDone++;
+        }
+    };
+
+    for ( size_t i = 0; i < numHelpers; i++ ) {
+        pool->enqueue( [job, work]() { work( *job ); } );
+    }
+
+    work( *job );
+    while ( job->RowsDone.load() < job->NumRows ) {
+        std::this_thread::yield();
+    }
+}
+
+void TextureProcessing::Process( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch,
+    const TextureProcessOptions& options, ProcessedTexture& out ) {
+    uint32_t numLevels = GetNumMipLevels( width, height );
+    if ( options.NumMips ) {
+        numLevels = std::min( numLevels, options.NumMips );
+    }
+
+    out.Format = options.Format;
+    out.Levels.resize( numLevels );
+
+    uint32_t offset = 0;
+    for ( uint32_t i = 0; i < numLevels; i++ ) {
+        ProcessedTextureLevel& level = out.Levels[i];
+        level.Width = std::max( width >> i, 1u );
+        level.Height = std::max( height >> i, 1u );
+        level.RowPitch = GetRowPitch( options.Format, level.Width );
+        level.Size = GetLevelSize( options.Format, level.Width, level.Height );
+        level.Offset = offset;
+        offset = (offset + level.Size + 15) & ~15u;
+    }
+    out.Data.resize( offset );
+
+    // The first level comes straight from the source
+    WriteLevel( rgba, rowPitch, out.Levels[0], options, out.Data.data() );
+    if ( numLevels == 1 )
+        return;
+
+    std::vector<float> current( static_cast<size_t>(width) * height * 4 );
+    std::vector<float> next( static_cast<size_t>(std::max( width / 2, 1u )) * std::max( height / 2, 1u ) * 4 );
+    std::vector<uint8_t> pixels( next.size() );
+    ToLinear( rgba, width, height, rowPitch, options.GammaCorrect, current.data() );
+
+    for ( uint32_t i = 1; i < numLevels; i++ ) {
+        const ProcessedTextureLevel& above = out.Levels[i - 1];
+        const ProcessedTextureLevel& level = out.Levels[i];
+
+        Downsample( current.data(), above.Width, above.Height, options.Filter, next.data() );
+        FromLinear( next.data(), level.Width, level.Height, options.GammaCorrect, pixels.data() );
+        WriteLevel( pixels.data(), level.Width * 4, level, options, out.Data.data() + level.Offset );
+
+        std::swap( current, next );
+    }
+}
+
+void TextureProcessing::CompressBC1Block( const uint8_t block[64], uint8_t out[8] ) {
+    CompressColorBlock( block, out );
+}
+
+void TextureProcessing::CompressBC3Block( const uint8_t block[64], uint8_t out[16] ) {
+    CompressAlphaBlock( block, out );
+    CompressColorBlock( block, out + 8 );
+}
+
+void TextureProcessing::DecompressBC1Block( const uint8_t in[8], uint8_t block[64] ) {
+    DecompressColorBlock( in, true, block );
+}
+
+void TextureProcessing::DecompressBC3Block( const uint8_t in[16], uint8_t block[64] ) {
+    DecompressColorBlock( in + 8, false, block );
+
+    int a0 = in[0];
+    int a1 = in[1];
+    int palette[8];
+    palette[0] = a0;
+    palette[1] = a1;
+    if ( a0 > a1 ) {
+        for ( int k = 1; k < 7; k++ ) {
+            palette[k + 1] = ((7 - k) * a0 + k * a1 + 3) / 7;
+        }
+    } else {
+        for ( int k = 1; k < 5; k++ ) {
+            palette[k + 1] = ((5 - k) * a0 + k * a1 + 2) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t bits = 0;
+    for ( int i = 0; i < 6; i++ ) {
+        bits |= static_cast<uint64_t>(in[2 + i]) << (8 * i);
+    }
+
+    for ( int i = 0; i < 16; i++ ) {
+        block[i * 4 + 3] = static_cast<uint8_t>(palette[(bits >> (3 * i)) & 7]);
+    }
+}
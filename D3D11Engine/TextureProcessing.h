@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+/** CPU-side processing of textures that arrive uncompressed at runtime
+
+    Mip-levels are filtered in linear space: The 8-bit colors are taken as sRGB-encoded, converted
+    to linear floats once and every level is made out of the float data of the level above it, so
+    rounding doesn't add up along the chain. Alpha is filtered as it is.
+
+    BC1/BC3-compression works on 4x4 blocks. The color endpoints come from the principal axis of the
+    block and are refined with a least-squares fit to the chosen indices. Blocks of a single color
+    use precomputed endpoint-pairs that hit the color through the interpolation. */
+
+enum ETextureMipFilter {
+    TMF_BOX,    // 2x2 average
+    TMF_KAISER  // Kaiser-windowed sinc over 6x6 texels, keeps the smaller mips sharper
+};
+
+enum ETextureBlockFormat {
+    TBF_RGBA8,
+    TBF_BC1,    // Opaque, alpha is dropped
+    TBF_BC3
+};
+
+struct TextureProcessOptions {
+    TextureProcessOptions() {
+        NumMips = 0;
+        Filter = TMF_KAISER;
+        GammaCorrect = true;
+        Format = TBF_BC1;
+        Pool = nullptr;
+    }
+
+    /** Number of levels to make, 0 for the full chain */
+    uint32_t NumMips;
+    ETextureMipFilter Filter;
+
+    /** Whether the colors are sRGB-encoded and have to be filtered in linear space */
+    bool GammaCorrect;
+
+    ETextureBlockFormat Format;
+
+    /** Spreads the compression over the threads of this pool if set. The calling thread always takes part. */
+    ThreadPool* Pool;
+};
+
+struct ProcessedTextureLevel {
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t RowPitch;
+
+    /** Location inside ProcessedTexture::Data */
+    uint32_t Offset;
+    uint32_t Size;
+};
+
+struct ProcessedTexture {
+    ETextureBlockFormat Format;
+    std::vector<ProcessedTextureLevel> Levels;
+    std::vector<uint8_t> Data;
+
+    const uint8_t* GetLevelData( uint32_t level ) const { return Data.data() + Levels[level].Offset; }
+};
+
+namespace TextureProcessing {
+    uint32_t GetNumMipLevels( uint32_t width, uint32_t height );
+    uint32_t GetRowPitch( ETextureBlockFormat format, uint32_t width );
+    uint32_t GetLevelSize( ETextureBlockFormat format, uint32_t width, uint32_t height );
+
+    /** Makes the mip-chain of an RGBA8-image and brings every level into the wanted format. rowPitch is in bytes. */
+    void Process( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch,
+        const TextureProcessOptions& options, ProcessedTexture& out );
+
+    /** RGBA8 to linear RGBA floats and back */
+    void ToLinear( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch, bool gammaCorrect, float* out );
+    void FromLinear( const float* linear, uint32_t width, uint32_t height, bool gammaCorrect, uint8_t* out );
+
+    float SRGBToLinear( uint8_t value );
+
+    /** Nearest sRGB-value, same as rounding the exact conversion */
+    uint8_t LinearToSRGB( float value );
+
+    /** Halves linear RGBA floats to max(width / 2, 1) x max(height / 2, 1). Borders are clamped. */
+    void Downsample( const float* src, uint32_t width, uint32_t height, ETextureMipFilter filter, float* dst );
+
+    /** Compresses a whole RGBA8-image. Blocks sticking out of the image repeat the last row and column. */
+    void CompressImage( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t rowPitch,
+        ETextureBlockFormat format, uint8_t* out, ThreadPool* pool );
+
+    /** Single 4x4 blocks of RGBA8-pixels, row by row */
+    void CompressBC1Block( const uint8_t block[64], uint8_t out[8] );
+    void CompressBC3Block( const uint8_t block[64], uint8_t out[16] );
+    void DecompressBC1Block( const uint8_t in[8], uint8_t block[64] );
+    void DecompressBC3Block( const uint8_t in[16], uint8_t block[64] );
+}
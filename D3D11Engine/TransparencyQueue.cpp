@@ -0,0 +1,234 @@
+#include "TransparencyQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include "ThreadPool.h"
+
+namespace {
+    const uint32_t RADIX_SIZE = 256;
+    const int NUM_PASSES = 8;
+
+    /** Below this an insertion sort beats the histograms */
+    const size_t INSERTION_SORT_MAX = 32;
+
+    /** Entries per chunk at least, so a chunk is worth handing to another thread */
+    const size_t MIN_CHUNK_SIZE = 4096;
+
+    /** Sign, exponent and 7 bits of mantissa of the distance */
+    const uint64_t DISTANCE_SHIFT = 48;
+    const uint32_t DISTANCE_DROPPED_BITS = 16;
+
+    const uint64_t BLEND_SHIFT = 30;
+    const uint64_t STATE_MASK = (1ull << BLEND_SHIFT) - 1;
+
+    uint32_t GetState( uint64_t key ) { return static_cast<uint32_t>(key & STATE_MASK); }
+    uint32_t GetBlend( uint64_t key ) { return static_cast<uint32_t>((key >> BLEND_SHIFT) & 3); }
+
+    /** Runs work on every chunk, the chunks are handed out one by one like in TextureProcessing.
+        The caller works along, so nothing waits on a helper that hasn't started yet. */
+    void ForEachChunk( size_t numChunks, ThreadPool* pool, const std::function<void( size_t )>& work ) {
+        const size_t numHelpers = pool ? std::min<size_t>( pool->getNumThreads(), numChunks - 1 ) : 0;
+        if ( !numHelpers ) {
+            for ( size_t c = 0; c < numChunks; c++ ) {
+                work( c );
+            }
+            return;
+        }
+
+        struct Job {
+            std::function<void( size_t )> Work;
+            size_t NumChunks;
+            std::atomic<size_t> NextChunk;
+            std::atomic<size_t> ChunksDone;
+        };
+
+        auto job = std::make_shared<Job>();
+        job->Work = work;
+        job->NumChunks = numChunks;
+        job->NextChunk = 0;
+        job->ChunksDone = 0;
+
+        auto run = []( Job& j ) {
+            for ( size_t c = j.NextChunk++; c < j.NumChunks; c = j.NextChunk++ ) {
+                j.Work( c );
+                j.ChunksDone++;
+            }
+        };
+
+        for ( size_t i = 0; i < numHelpers; i++ ) {
+            pool->enqueue( [job, run]() { run( *job ); } );
+        }
+
+        run( *job );
+        while ( job->ChunksDone.load() < job->NumChunks ) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+uint64_t TransparencyQueue::MakeKey( float distance, ETransparencyBlend blend, uint32_t state ) {
+    // Flip the sign bit of positive floats and all bits of negative ones, then they sort like unsigned
+    // integers. Inverted once more, so the farthest comes first.
+    uint32_t bits;
+    memcpy( &bits, &distance, sizeof( bits ) );
+    bits ^= (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+
+    return (static_cast<uint64_t>(~bits >> DISTANCE_DROPPED_BITS) << DISTANCE_SHIFT)
+        | (static_cast<uint64_t>(blend & 3) << BLEND_SHIFT)
+        | (state & STATE_MASK);
+}
+
+void TransparencyQueue::RadixSort( std::vector<Entry>& entries, std::vector<Entry>& scratch, ThreadPool* pool ) {
+    const size_t n = entries.size();
+    if ( n <= INSERTION_SORT_MAX ) {
+        for ( size_t i = 1; i < n; i++ ) {
+            const Entry e = entries[i];
+            size_t j = i;
+            for ( ; j > 0 && entries[j - 1].Key > e.Key; j-- ) {
+                entries[j] = entries[j - 1];
+            }
+            entries[j] = e;
+        }
+        return;
+    }
+
+    scratch.resize( n );
+
+    size_t numChunks = 1;
+    if ( pool && n >= PARALLEL_MIN_ENTRIES ) {
+        numChunks = std::min( (n + MIN_CHUNK_SIZE - 1) / MIN_CHUNK_SIZE, (pool->getNumThreads() + 1) * 2 );
+    }
+    const size_t chunkSize = (n + numChunks - 1) / numChunks;
+
+    // Bytes which are the same in all keys don't need a pass
+    std::vector<uint64_t> chunkDiffs( numChunks );
+    ForEachChunk( numChunks, pool, [&]( size_t c ) {
+        const size_t begin = c * chunkSize;
+        const size_t end = std::min( begin + chunkSize, n );
+        const uint64_t first = entries[0].Key;
+        uint64_t diff = 0;
+        for ( size_t i = begin; i < end; i++ ) {
+            diff |= entries[i].Key ^ first;
+        }
+        chunkDiffs[c] = diff;
+    } );
+
+    uint64_t diff = 0;
+    for ( uint64_t d : chunkDiffs ) {
+        diff |= d;
+    }
+
+    // Histogram of every chunk, turned into the offsets the chunk writes its entries to
+    std::vector<uint32_t> offsets( numChunks * RADIX_SIZE );
+    Entry* src = entries.data();
+    Entry* dst = scratch.data();
+
+    for ( int pass = 0; pass < NUM_PASSES; pass++ ) {
+        const int shift = pass * 8;
+        if ( !((diff >> shift) & 0xFF) )
+            continue;
+
+        ForEachChunk( numChunks, pool, [&]( size_t c ) {
+            uint32_t* counts = &offsets[c * RADIX_SIZE];
+            std::fill( counts, counts + RADIX_SIZE, 0 );
+
+            const size_t end = std::min( c * chunkSize + chunkSize, n );
+            for ( size_t i = c * chunkSize; i < end; i++ ) {
+                counts[(src[i].Key >> shift) & 0xFF]++;
+            }
+        } );
+
+        // Every digit starts behind the smaller ones, and inside of a digit the chunks keep their order
+        uint32_t sum = 0;
+        for ( uint32_t digit = 0; digit < RADIX_SIZE; digit++ ) {
+            for ( size_t c = 0; c < numChunks; c++ ) {
+                const uint32_t count = offsets[c * RADIX_SIZE + digit];
+                offsets[c * RADIX_SIZE + digit] = sum;
+                sum += count;
+            }
+        }
+
+        ForEachChunk( numChunks, pool, [&]( size_t c ) {
+            uint32_t* next = &offsets[c * RADIX_SIZE];
+
+            const size_t end = std::min( c * chunkSize + chunkSize, n );
+            for ( size_t i = c * chunkSize; i < end; i++ ) {
+                dst[next[(src[i].Key >> shift) & 0xFF]++] = src[i];
+            }
+        } );
+
+        std::swap( src, dst );
+    }
+
+    if ( src != entries.data() ) {
+        entries.swap( scratch );
+    }
+}
+
+void TransparencyQueue::Add( float distance, ETransparencyBlend blend, const void* state, uint32_t item ) {
+    auto it = StateIndices.find( state );
+    if ( it == StateIndices.end() ) {
+        it = StateIndices.emplace( state, static_cast<uint32_t>(States.size()) ).first;
+        States.push_back( state );
+    }
+
+    Entries.push_back( { MakeKey( distance, blend, it->second ), item } );
+}
+
+void TransparencyQueue::Build( ThreadPool* pool ) {
+    Items.clear();
+    Batches.clear();
+
+    RadixSort( Entries, Scratch, pool );
+
+    // Runs of additive meshes can be drawn in any order, group them by their state. Inside of a
+    // state they go by item, items of neighbouring parts of a buffer often are neighbours as well.
+    for ( size_t begin = 0; begin < Entries.size(); ) {
+        if ( GetBlend( Entries[begin].Key ) != TB_ADDITIVE ) {
+            begin++;
+            continue;
+        }
+
+        size_t end = begin + 1;
+        while ( end < Entries.size() && GetBlend( Entries[end].Key ) == TB_ADDITIVE ) {
+            end++;
+        }
+
+        if ( end - begin > 1 ) {
+            std::sort( Entries.begin() + begin, Entries.begin() + end, []( const Entry& a, const Entry& b ) {
+                return GetState( a.Key ) < GetState( b.Key ) || (GetState( a.Key ) == GetState( b.Key ) && a.Item < b.Item);
+            } );
+        }
+        begin = end;
+    }
+
+    Items.reserve( Entries.size() );
+    for ( size_t i = 0; i < Entries.size(); i++ ) {
+        const uint64_t key = Entries[i].Key;
+        const ETransparencyBlend blend = static_cast<ETransparencyBlend>(GetBlend( key ));
+        const void* state = States[GetState( key )];
+
+        if ( Batches.empty() || Batches.back().Blend != blend || Batches.back().State != state ) {
+            TransparencyBatch batch;
+            batch.Blend = blend;
+            batch.State = state;
+            batch.FirstItem = static_cast<uint32_t>(i);
+            batch.NumItems = 0;
+            Batches.push_back( batch );
+        }
+
+        Batches.back().NumItems++;
+        Items.push_back( Entries[i].Item );
+    }
+}
+
+void TransparencyQueue::Clear() {
+    Entries.clear();
+    States.clear();
+    StateIndices.clear();
+    Items.clear();
+    Batches.clear();
+}
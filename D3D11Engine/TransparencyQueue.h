@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+/** Sorts the alpha-blended meshes of a pass back to front and groups them into batches
+
+    Every mesh gets a 64-bit key: The distance to the camera in the upper bits, flipped so the
+    farthest mesh comes first, then the blend-mode and the render-state (texture and material) of
+    the mesh. The distance only keeps 7 bits of its mantissa, so meshes less than about 1% apart
+    count as equally far and are ordered by their state. The keys are sorted with an LSD radix sort,
+    8 bits per pass, passes where all keys have the same byte are skipped. Large queues spread the
+    passes over a thread pool.
+
+    After sorting, neighbours with the same blend-mode and state form one batch, so the state is only
+    bound once for them. Additive blending doesn't depend on the order, so the meshes of a run of
+    additive meshes are grouped by their state first, which gives fewer and larger batches there.
+    Inside of such a batch the items are ascending, so neighbouring parts of a buffer can be merged.
+
+    Doesn't know anything about the engine, the states are only compared. */
+
+enum ETransparencyBlend {
+    TB_ALPHA = 0,
+    TB_ADDITIVE = 1
+};
+
+struct TransparencyBatch {
+    ETransparencyBlend Blend;
+    const void* State;
+
+    /** Range inside of GetItems() */
+    uint32_t FirstItem;
+    uint32_t NumItems;
+};
+
+class TransparencyQueue {
+public:
+    struct Entry {
+        uint64_t Key;
+        uint32_t Item;
+    };
+
+    /** States of one queue, more can't be told apart in the key */
+    static constexpr uint32_t MAX_STATES = 1u << 30;
+
+    /** Queues didn't get faster with threads below this many meshes */
+    static constexpr size_t PARALLEL_MIN_ENTRIES = 16384;
+
+    /** Key for a mesh at the given distance, farther meshes get smaller keys */
+    static uint64_t MakeKey( float distance, ETransparencyBlend blend, uint32_t state );
+
+    /** Stable sort of the entries by their key. Spreads the passes over the pool if one is given
+        and there are enough entries, the calling thread always takes part. */
+    static void RadixSort( std::vector<Entry>& entries, std::vector<Entry>& scratch, ThreadPool* pool = nullptr );
+
+    /** Queues a mesh. item is handed back in GetItems(), usually an index into the callers list. */
+    void Add( float distance, ETransparencyBlend blend, const void* state, uint32_t item );
+
+    /** Sorts the queue and builds the batches. Has to be called before reading the items. */
+    void Build( ThreadPool* pool = nullptr );
+
+    /** Drops everything for the next frame, keeps the memory */
+    void Clear();
+
+    bool IsEmpty() const { return Entries.empty(); }
+    size_t GetNumEntries() const { return Entries.size(); }
+
+    /** Items back to front, grouped by the batches */
+    const std::vector<uint32_t>& GetItems() const { return Items; }
+    const std::vector<TransparencyBatch>& GetBatches() const { return Batches; }
+
+private:
+    std::vector<Entry> Entries;
+    std::vector<Entry> Scratch;
+    std::vector<const void*> States;
+    std::unordered_map<const void*, uint32_t> StateIndices;
+    std::vector<uint32_t> Items;
+    std::vector<TransparencyBatch> Batches;
+};
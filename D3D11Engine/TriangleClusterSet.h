@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Splits meshes into small groups of consecutive triangles with a bounding box each
+
+    Shadow passes of small lights only need the geometry right around them. Instead of drawing whole
+    meshes, the clusters touching the light-sphere are collected into a list of index-ranges, where
+    ranges of the same mesh which follow each other are merged into a single drawcall.
+
+    The triangles aren't reordered, so the ranges can be drawn straight out of the original
+    indexbuffer. Doesn't know anything about the device, Mesh is only handed back with the ranges. */
+template <typename Mesh>
+class TriangleClusterSet {
+public:
+    /** Maximum number of triangles in a cluster */
+    static const unsigned int CLUSTER_TRIANGLES = 64;
+
+    struct Cluster {
+        float Min[3];
+        float Max[3];
+        unsigned int FirstIndex;
+        unsigned int NumIndices;
+        Mesh MeshHandle;
+    };
+
+    /** Part of a mesh to draw */
+    struct Range {
+        Mesh MeshHandle;
+        unsigned int FirstIndex;
+        unsigned int NumIndices;
+    };
+
+    TriangleClusterSet() {
+        Clear();
+    }
+
+    void Clear() {
+        Clusters.clear();
+        for ( int i = 0; i < 3; i++ ) {
+            Min[i] = FLT_MAX;
+            Max[i] = -FLT_MAX;
+        }
+        NumTriangles = 0;
+    }
+
+    /** Adds the clusters of a trianglelist. The stride of the positions is given in bytes, baseIndexLocation
+        is where the indices start in the buffer the ranges will be drawn from. */
+    template <typename Index>
+    void AddMesh( Mesh mesh, const void* positions, size_t stride, const Index* indices, unsigned int numIndices, unsigned int baseIndexLocation ) {
+        const uint8_t* vertexData = static_cast<const uint8_t*>(positions);
+        numIndices -= numIndices % 3;
+
+        for ( unsigned int first = 0; first < numIndices; first += CLUSTER_TRIANGLES * 3 ) {
+            Cluster c;
+            c.FirstIndex = baseIndexLocation + first;
+            c.NumIndices = std::min( CLUSTER_TRIANGLES * 3, numIndices - first );
+            c.MeshHandle = mesh;
+
+            for ( int i = 0; i < 3; i++ ) {
+                c.Min[i] = FLT_MAX;
+                c.Max[i] = -FLT_MAX;
+            }
+
+            for ( unsigned int i = first; i < first + c.NumIndices; i++ ) {
+                const float* p = reinterpret_cast<const float*>(vertexData + indices[i] * stride);
+                for ( int a = 0; a < 3; a++ ) {
+                    c.Min[a] = std::min( c.Min[a], p[a] );
+                    c.Max[a] = std::max( c.Max[a], p[a] );
+                }
+            }
+
+            for ( int a = 0; a < 3; a++ ) {
+                Min[a] = std::min( Min[a], c.Min[a] );
+                Max[a] = std::max( Max[a], c.Max[a] );
+            }
+
+            Clusters.push_back( c );
+            NumTriangles += c.NumIndices / 3;
+        }
+    }
+
+    /** Appends the ranges of all clusters touching the sphere. Returns the number of triangles added. */
+    size_t QuerySphere( const float center[3], float radius, std::vector<Range>& out ) const {
+        if ( Clusters.empty() || !SphereIntersectsBox( center, radius, Min, Max ) )
+            return 0;
+
+        size_t numTriangles = 0;
+        bool canMerge = false;
+        for ( const Cluster& c : Clusters ) {
+            if ( !SphereIntersectsBox( center, radius, c.Min, c.Max ) ) {
+                canMerge = false;
+                continue;
+            }
+
+            // Clusters are stored in index-order, so neighbours of the same mesh can be drawn at once
+            if ( canMerge && out.back().MeshHandle == c.MeshHandle && out.back().FirstIndex + out.back().NumIndices == c.FirstIndex ) {
+                out.back().NumIndices += c.NumIndices;
+            } else {
+                Range r;
+                r.MeshHandle = c.MeshHandle;
+                r.FirstIndex = c.FirstIndex;
+                r.NumIndices = c.NumIndices;
+                out.push_back( r );
+            }
+
+            canMerge = true;
+            numTriangles += c.NumIndices / 3;
+        }
+
+        return numTriangles;
+    }
+
+    bool IsEmpty() const { return Clusters.empty(); }
+    size_t GetNumClusters() const { return Clusters.size(); }
+    size_t GetNumTriangles() const { return NumTriangles; }
+    const std::vector<Cluster>& GetClusters() const { return Clusters; }
+
+    /** Box around all clusters */
+    const float* GetMin() const { return Min; }
+    const float* GetMax() const { return Max; }
+
+    /** Returns whether the sphere touches the box */
+    static bool SphereIntersectsBox( const float center[3], float radius, const float min[3], const float max[3] ) {
+        float d2 = 0.0f;
+        for ( int a = 0; a < 3; a++ ) {
+            const float v = std::max( min[a] - center[a], std::max( 0.0f, center[a] - max[a] ) );
+            d2 += v * v;
+        }
+
+        return d2 <= radius * radius;
+    }
+
+private:
+    std::vector<Cluster> Clusters;
+    float Min[3];
+    float Max[3];
+    size_t NumTriangles;
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/** Collects consecutive trianglefans and -lists into one trianglelist, as long as they share the same state
+
+    The UI of the game is made out of thousands of tiny fans per frame. Instead of drawing each of
+    them on its own, they are converted and appended here, and only drawn once the state changes,
+    the batch is full or someone else wants to draw.
+
+    Doesn't know anything about the device: Drawing happens in the flush-callback, which gets the
+    state the vertices were queued with. The key only needs operator==. */
+template <typename Vertex, typename Key>
+class TriangleFanBatcher {
+public:
+    typedef std::function<void( const Key& key, const Vertex* vertices, unsigned int numVertices )> FlushCallback;
+
+    /** maxVertices is rounded down to whole triangles */
+    TriangleFanBatcher( unsigned int maxVertices, FlushCallback onFlush ) {
+        MaxVertices = std::max( 3u, maxVertices - maxVertices % 3 );
+        OnFlush = onFlush;
+
+        Vertices.reserve( MaxVertices );
+    }
+
+    /** Appends the fan to the batch. Draws the pending vertices first if the key doesn't match. */
+    void AddFan( const Key& key, const Vertex* fan, unsigned int numVertices ) {
+        if ( numVertices < 3 )
+            return;
+
+        if ( !Vertices.empty() && !(PendingKey == key) )
+            Flush();
+
+        if ( Vertices.empty() )
+            PendingKey = key;
+
+        // Fans too big for the rest of the batch are split up, each part is still a valid list
+        unsigned int triangle = 0;
+        const unsigned int numTriangles = numVertices - 2;
+        while ( triangle < numTriangles ) {
+            unsigned int space = (MaxVertices - static_cast<unsigned int>(Vertices.size())) / 3;
+            if ( space == 0 ) {
+                Flush();
+                PendingKey = key;
+                space = MaxVertices / 3;
+            }
+
+            const unsigned int count = std::min( space, numTriangles - triangle );
+            const size_t start = Vertices.size();
+            Vertices.resize( start + count * 3 );
+            FanToList( fan, triangle, count, &Vertices[start] );
+            triangle += count;
+        }
+    }
+
+    /** Appends vertices which already form a trianglelist */
+    void AddTriangles( const Key& key, const Vertex* vertices, unsigned int numVertices ) {
+        numVertices -= numVertices % 3;
+        if ( numVertices == 0 )
+            return;
+
+        if ( !Vertices.empty() && !(PendingKey == key) )
+            Flush();
+
+        if ( Vertices.empty() )
+            PendingKey = key;
+
+        unsigned int done = 0;
+        while ( done < numVertices ) {
+            unsigned int space = MaxVertices - static_cast<unsigned int>(Vertices.size());
+            if ( space < 3 ) {
+                Flush();
+                PendingKey = key;
+                space = MaxVertices;
+            }
+
+            const unsigned int count = std::min( space - space % 3, numVertices - done );
+            Vertices.insert( Vertices.end(), vertices + done, vertices + done + count );
+            done += count;
+        }
+    }
+
+    /** Draws everything pending */
+    void Flush() {
+        if ( Vertices.empty() )
+            return;
+
+        OnFlush( PendingKey, &Vertices[0], static_cast<unsigned int>(Vertices.size()) );
+        Vertices.clear();
+    }
+
+    /** Returns whether there is nothing to draw */
+    bool IsEmpty() const { return Vertices.empty(); }
+
+    /** Returns the number of vertices waiting to be drawn */
+    unsigned int GetNumPendingVertices() const { return static_cast<unsigned int>(Vertices.size()); }
+
+    /** Returns the maximum number of vertices drawn at once */
+    unsigned int GetMaxVertices() const { return MaxVertices; }
+
+    /** Writes count triangles of the fan, starting at the given one, as a list. Keeps the winding
+        of WorldConverter::TriangleFanToList. */
+    static void FanToList( const Vertex* fan, unsigned int firstTriangle, unsigned int count, Vertex* out ) {
+        for ( unsigned int i = firstTriangle + 1; i < firstTriangle + 1 + count; i++ ) {
+            *out++ = fan[0];
+            *out++ = fan[i + 1];
+            *out++ = fan[i];
+        }
+    }
+
+private:
+    std::vector<Vertex> Vertices;
+    Key PendingKey;
+    unsigned int MaxVertices;
+    FlushCallback OnFlush;
+};
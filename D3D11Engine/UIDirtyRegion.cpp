@@ -0,0 +1,111 @@
+#include "UIDirtyRegion.h"
+#include <algorithm>
+#include <cfloat>
+
+UIRect UIRect::Union( const UIRect& r ) const {
+    if ( IsEmpty() )
+        return r;
+
+    if ( r.IsEmpty() )
+        return *this;
+
+    return UIRect( std::min( Left, r.Left ), std::min( Top, r.Top ), std::max( Right, r.Right ), std::max( Bottom, r.Bottom ) );
+}
+
+UIRect UIRect::Intersection( const UIRect& r ) const {
+    return UIRect( std::max( Left, r.Left ), std::max( Top, r.Top ), std::min( Right, r.Right ), std::min( Bottom, r.Bottom ) );
+}
+
+UIRect UIRect::Inflated( float amount ) const {
+    return UIRect( Left - amount, Top - amount, Right + amount, Bottom + amount );
+}
+
+UIDirtyRegion::UIDirtyRegion( size_t maxRects ) {
+    MaxRects = std::max<size_t>( 1, maxRects );
+    Bounds = UIRect( -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX );
+}
+
+/** Marks the given rectangle as changed. Everything outside of the bounds is cut off. */
+void UIDirtyRegion::Add( const UIRect& rect ) {
+    const UIRect r = rect.Intersection( Bounds );
+    if ( r.IsEmpty() )
+        return;
+
+    for ( size_t i = 0; i < Rects.size(); i++ ) {
+        if ( Rects[i].Contains( r ) )
+            return;
+    }
+
+    // Drop the ones the new rectangle covers
+    Rects.erase( std::remove_if( Rects.begin(), Rects.end(), [&]( const UIRect& o ) { return r.Contains( o ); } ), Rects.end() );
+    Rects.push_back( r );
+
+    if ( Rects.size() > MaxRects )
+        Reduce();
+}
+
+/** Marks everything inside the bounds as changed */
+void UIDirtyRegion::AddAll() {
+    Rects.clear();
+    Rects.push_back( Bounds );
+}
+
+/** Sets the area everything is clipped to, usually the screen */
+void UIDirtyRegion::SetBounds( const UIRect& bounds ) {
+    Bounds = bounds;
+
+    std::vector<UIRect> old;
+    old.swap( Rects );
+    for ( const UIRect& r : old ) {
+        Add( r );
+    }
+}
+
+void UIDirtyRegion::Clear() {
+    Rects.clear();
+}
+
+/** Returns true if the given rectangle touches anything that has changed */
+bool UIDirtyRegion::Intersects( const UIRect& rect ) const {
+    for ( const UIRect& r : Rects ) {
+        if ( r.Intersects( rect ) )
+            return true;
+    }
+
+    return false;
+}
+
+/** Sum of the areas of all rectangles */
+float UIDirtyRegion::GetArea() const {
+    float area = 0.0f;
+    for ( const UIRect& r : Rects ) {
+        area += r.GetArea();
+    }
+
+    return area;
+}
+
+/** Merges the two rectangles with the smallest waste until there are few enough */
+void UIDirtyRegion::Reduce() {
+    while ( Rects.size() > MaxRects ) {
+        size_t bestA = 0, bestB = 1;
+        float bestWaste = FLT_MAX;
+        for ( size_t a = 0; a < Rects.size(); a++ ) {
+            for ( size_t b = a + 1; b < Rects.size(); b++ ) {
+                const float waste = Rects[a].Union( Rects[b] ).GetArea() - Rects[a].GetArea() - Rects[b].GetArea();
+                if ( waste < bestWaste ) {
+                    bestWaste = waste;
+                    bestA = a;
+                    bestB = b;
+                }
+            }
+        }
+
+        const UIRect merged = Rects[bestA].Union( Rects[bestB] );
+        Rects.erase( Rects.begin() + bestB );
+        Rects.erase( Rects.begin() + bestA );
+
+        // The merged one may now cover others
+        Add( merged );
+    }
+}
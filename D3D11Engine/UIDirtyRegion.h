@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/** Axis aligned rectangle in pixels, same layout as D2D1_RECT_F */
+struct UIRect {
+    UIRect() {
+        Left = Top = Right = Bottom = 0.0f;
+    }
+
+    UIRect( float left, float top, float right, float bottom ) {
+        Left = left;
+        Top = top;
+        Right = right;
+        Bottom = bottom;
+    }
+
+    bool IsEmpty() const {
+        return Right <= Left || Bottom <= Top;
+    }
+
+    float GetArea() const {
+        return IsEmpty() ? 0.0f : (Right - Left) * (Bottom - Top);
+    }
+
+    bool Intersects( const UIRect& r ) const {
+        return Left < r.Right && r.Left < Right && Top < r.Bottom && r.Top < Bottom;
+    }
+
+    bool Contains( const UIRect& r ) const {
+        return r.Left >= Left && r.Right <= Right && r.Top >= Top && r.Bottom <= Bottom;
+    }
+
+    UIRect Union( const UIRect& r ) const;
+    UIRect Intersection( const UIRect& r ) const;
+    UIRect Inflated( float amount ) const;
+
+    float Left;
+    float Top;
+    float Right;
+    float Bottom;
+};
+
+/** Collects the parts of the screen which have changed since the last redraw
+
+    Invalidated rectangles are kept apart as long as possible, so a slider on one side of the screen
+    and a label on the other don't cause everything in between to be redrawn. Rectangles which are
+    covered by others are dropped, and when there are more than the given maximum, the two whose
+    union wastes the least area get merged.
+
+    Doesn't know anything about D2D, so it can be checked on its own. */
+class UIDirtyRegion {
+public:
+    UIDirtyRegion( size_t maxRects = 8 );
+
+    /** Marks the given rectangle as changed. Everything outside of the bounds is cut off. */
+    void Add( const UIRect& rect );
+
+    /** Marks everything inside the bounds as changed */
+    void AddAll();
+
+    /** Sets the area everything is clipped to, usually the screen */
+    void SetBounds( const UIRect& bounds );
+    const UIRect& GetBounds() const { return Bounds; }
+
+    void Clear();
+    bool IsEmpty() const { return Rects.empty(); }
+
+    /** Returns true if the given rectangle touches anything that has changed */
+    bool Intersects( const UIRect& rect ) const;
+
+    /** Rectangles to redraw, they don't contain each other but may overlap */
+    const std::vector<UIRect>& GetRects() const { return Rects; }
+
+    /** Sum of the areas of all rectangles */
+    float GetArea() const;
+
+private:
+    /** Merges the two rectangles with the smallest waste until there are few enough */
+    void Reduce();
+
+    std::vector<UIRect> Rects;
+    UIRect Bounds;
+    size_t MaxRects;
+};
@@ -0,0 +1,225 @@
+#include "VegetationPlacement.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace VegetationPlacement {
+    namespace {
+        const float TWO_PI = 6.28318530718f;
+
+        /** Upper limit, so huge boxes with a tiny distance can't stall the editor */
+        const size_t MAX_ATTEMPTS = 4 * 1024 * 1024;
+
+        /** End of a list in PointGrid */
+        const uint32_t NONE = 0xFFFFFFFF;
+
+        float TriangleArea( const float* t ) {
+            const float e1[3] = { t[3] - t[0], t[4] - t[1], t[5] - t[2] };
+            const float e2[3] = { t[6] - t[0], t[7] - t[1], t[8] - t[2] };
+            const float c[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            return 0.5f * sqrtf( c[0] * c[0] + c[1] * c[1] + c[2] * c[2] );
+        }
+
+        /** Grid with cells the size of the minimum distance, so only the 27 cells around a candidate need to be checked */
+        class PointGrid {
+        public:
+            PointGrid( float cellSize ) {
+                InvCellSize = 1.0f / cellSize;
+            }
+
+            bool HasPointCloserThan( const float p[3], float distance, const std::vector<VegetationInstance>& points ) const {
+                int c[3];
+                GetCell( p, c );
+
+                const float d2 = distance * distance;
+                for ( int z = c[2] - 1; z <= c[2] + 1; z++ ) {
+                    for ( int y = c[1] - 1; y <= c[1] + 1; y++ ) {
+                        for ( int x = c[0] - 1; x <= c[0] + 1; x++ ) {
+                            auto it = Heads.find( Key( x, y, z ) );
+                            if ( it == Heads.end() )
+                                continue;
+
+                            for ( uint32_t i = it->second; i != NONE; i = Next[i] ) {
+                                const float* q = points[i].Position;
+                                const float dx = p[0] - q[0], dy = p[1] - q[1], dz = p[2] - q[2];
+                                if ( dx * dx + dy * dy + dz * dz < d2 )
+                                    return true;
+                            }
+                        }
+                    }
+                }
+
+                return false;
+            }
+
+            void Add( const float p[3], uint32_t index ) {
+                int c[3];
+                GetCell( p, c );
+
+                auto it = Heads.find( Key( c[0], c[1], c[2] ) );
+                Next.push_back( it != Heads.end() ? it->second : NONE );
+                Heads[Key( c[0], c[1], c[2] )] = index;
+            }
+
+        private:
+            void GetCell( const float p[3], int c[3] ) const {
+                for ( int a = 0; a < 3; a++ ) {
+                    c[a] = static_cast<int>(floorf( p[a] * InvCellSize ));
+                }
+            }
+
+            static uint64_t Key( int x, int y, int z ) {
+                return ((static_cast<uint64_t>(x) & 0x1FFFFF) << 42) | ((static_cast<uint64_t>(y) & 0x1FFFFF) << 21) | (static_cast<uint64_t>(z) & 0x1FFFFF);
+            }
+
+            float InvCellSize;
+            std::unordered_map<uint64_t, uint32_t> Heads;
+            std::vector<uint32_t> Next;
+        };
+    }
+
+    /** Places instances on the given trianglelist (9 floats per triangle) */
+    void Place( const float* triangles, size_t numTriangles, const Settings& settings,
+        const std::function<bool( const float* position )>& filter, std::vector<VegetationInstance>& out ) {
+        out.clear();
+        if ( !numTriangles || settings.MinDistance <= 0.0f )
+            return;
+
+        // Cumulative areas, to pick triangles by their size
+        std::vector<float> cdf( numTriangles );
+        double totalArea = 0.0;
+        for ( size_t i = 0; i < numTriangles; i++ ) {
+            totalArea += TriangleArea( &triangles[i * 9] );
+            cdf[i] = static_cast<float>(totalArea);
+        }
+
+        if ( totalArea <= 0.0 )
+            return;
+
+        const double maxInstances = totalArea / (settings.MinDistance * settings.MinDistance);
+        const size_t numAttempts = static_cast<size_t>(std::min<double>( MAX_ATTEMPTS, std::ceil( maxInstances * settings.AttemptsPerInstance ) ));
+
+        Random rnd( settings.Seed );
+        PointGrid grid( settings.MinDistance );
+
+        for ( size_t a = 0; a < numAttempts; a++ ) {
+            // Area-weighted triangle
+            const float r = rnd.NextFloat() * cdf.back();
+            const size_t tri = std::min<size_t>( numTriangles - 1, std::upper_bound( cdf.begin(), cdf.end(), r ) - cdf.begin() );
+            const float* t = &triangles[tri * 9];
+
+            // Uniform point on it
+            const float s = sqrtf( rnd.NextFloat() );
+            const float v = rnd.NextFloat();
+            const float b0 = 1.0f - s;
+            const float b1 = s * (1.0f - v);
+            const float b2 = s * v;
+
+            float p[3];
+            for ( int i = 0; i < 3; i++ ) {
+                p[i] = t[i] * b0 + t[3 + i] * b1 + t[6 + i] * b2;
+            }
+
+            // Always draw these, so the result doesn't depend on which candidates get rejected
+            const float rotation = rnd.NextFloat() * TWO_PI;
+            const float scale = settings.MinScale + (settings.MaxScale - settings.MinScale) * rnd.NextFloat();
+
+            if ( filter && !filter( p ) )
+                continue;
+
+            if ( grid.HasPointCloserThan( p, settings.MinDistance, out ) )
+                continue;
+
+            grid.Add( p, static_cast<uint32_t>(out.size()) );
+            out.push_back( Encode( p, rotation, scale ) );
+        }
+    }
+
+    /** Packs the given values into an instance */
+    VegetationInstance Encode( const float position[3], float rotation, float scale ) {
+        VegetationInstance v;
+        v.Position[0] = position[0];
+        v.Position[1] = position[1];
+        v.Position[2] = position[2];
+
+        float r = fmodf( rotation, TWO_PI );
+        if ( r < 0.0f )
+            r += TWO_PI;
+
+        v.Rotation = static_cast<uint16_t>(static_cast<uint32_t>(r / TWO_PI * 65536.0f + 0.5f) & 0xFFFF);
+        v.Scale = FloatToHalf( scale );
+        return v;
+    }
+
+    /** Rotation around the y-axis in radians */
+    float DecodeRotation( const VegetationInstance& instance ) {
+        return instance.Rotation * (TWO_PI / 65536.0f);
+    }
+
+    float DecodeScale( const VegetationInstance& instance ) {
+        return HalfToFloat( instance.Scale );
+    }
+
+    uint16_t FloatToHalf( float f ) {
+        uint32_t x;
+        memcpy( &x, &f, sizeof( x ) );
+
+        const uint32_t sign = (x >> 16) & 0x8000;
+        const uint32_t absX = x & 0x7FFFFFFF;
+
+        // NaN and infinity
+        if ( absX >= 0x7F800000 )
+            return static_cast<uint16_t>(sign | 0x7C00 | (absX > 0x7F800000 ? 0x200 : 0));
+
+        // Too large, becomes infinity
+        if ( absX >= 0x477FF000 )
+            return static_cast<uint16_t>(sign | 0x7C00);
+
+        // Too small for a normal half, denormalize
+        if ( absX < 0x38800000 ) {
+            if ( absX < 0x33000000 )
+                return static_cast<uint16_t>(sign);
+
+            const uint32_t mantissa = (absX & 0x7FFFFF) | 0x800000;
+            const int shift = 126 - static_cast<int>(absX >> 23);
+            const uint32_t half = mantissa >> shift;
+            const uint32_t rest = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            return static_cast<uint16_t>(sign | (half + (rest > halfway || (rest == halfway && (half & 1)))));
+        }
+
+        // Round to nearest even
+        const uint32_t rebased = absX - 0x38000000;
+        const uint32_t half = rebased >> 13;
+        const uint32_t rest = rebased & 0x1FFF;
+        return static_cast<uint16_t>(sign | (half + (rest > 0x1000 || (rest == 0x1000 && (half & 1)))));
+    }
+
+    float HalfToFloat( uint16_t h ) {
+        const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+        const uint32_t exponent = (h >> 10) & 0x1F;
+        uint32_t mantissa = h & 0x3FF;
+
+        uint32_t x;
+        if ( exponent == 0x1F ) {
+            x = sign | 0x7F800000 | (mantissa << 13);
+        } else if ( exponent ) {
+            x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        } else if ( mantissa ) {
+            // Denormal, normalize it
+            int e = 113;
+            while ( !(mantissa & 0x400) ) {
+                mantissa <<= 1;
+                e--;
+            }
+            x = sign | (static_cast<uint32_t>(e) << 23) | ((mantissa & 0x3FF) << 13);
+        } else {
+            x = sign;
+        }
+
+        float f;
+        memcpy( &f, &x, sizeof( f ) );
+        return f;
+    }
+}
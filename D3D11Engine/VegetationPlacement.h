@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/** A single grass-mesh as it is stored in the instancing-buffer and the vegetation-file, 16 bytes */
+struct VegetationInstance {
+    float Position[3];
+
+    /** Rotation around the y-axis, 0..65535 maps to 0..2pi */
+    uint16_t Rotation;
+
+    /** Uniform scale as half-float */
+    uint16_t Scale;
+};
+
+/** Spreads vegetation over a set of triangles
+
+    Candidates are picked area-weighted, so the density doesn't depend on how finely the surface is
+    tessellated, and get rejected if they are closer than MinDistance to one already placed (dart
+    throwing), which gives even blue-noise coverage without clumps. The random-generator is seeded
+    and doesn't depend on the CRT, so the same input results in the same instances everywhere.
+
+    Doesn't know anything about the engine or the device. */
+namespace VegetationPlacement {
+    struct Settings {
+        Settings() {
+            Seed = 1;
+            MinDistance = 40.0f;
+            MinScale = 20.0f;
+            MaxScale = 80.0f;
+            AttemptsPerInstance = 3.0f;
+        }
+
+        unsigned int Seed;
+
+        /** No two instances are closer than this */
+        float MinDistance;
+
+        /** Instances are uniformly scaled by a random value in this range */
+        float MinScale;
+        float MaxScale;
+
+        /** Candidates to try per instance which would fit into the area, more gives denser packing */
+        float AttemptsPerInstance;
+    };
+
+    /** Small xorshift generator, gives the same numbers on every platform */
+    class Random {
+    public:
+        Random( unsigned int seed ) {
+            // Mix the seed, so similar seeds don't start with similar numbers
+            State = seed * 0x9E3779B9u + 0x7F4A7C15u;
+            if ( !State )
+                State = 0x6D2B79F5u;
+        }
+
+        uint32_t Next() {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            return State;
+        }
+
+        /** Returns a value in [0, 1) */
+        float NextFloat() {
+            return (Next() >> 8) * (1.0f / 16777216.0f);
+        }
+
+    private:
+        uint32_t State;
+    };
+
+    /** Places instances on the given trianglelist (9 floats per triangle). Candidates which the filter
+        returns false for are thrown away, it may be empty. The output is cleared first. */
+    void Place( const float* triangles, size_t numTriangles, const Settings& settings,
+        const std::function<bool( const float* position )>& filter, std::vector<VegetationInstance>& out );
+
+    /** Packs the given values into an instance */
+    VegetationInstance Encode( const float position[3], float rotation, float scale );
+
+    /** Rotation around the y-axis in radians */
+    float DecodeRotation( const VegetationInstance& instance );
+    float DecodeScale( const VegetationInstance& instance );
+
+    uint16_t FloatToHalf( float f );
+    float HalfToFloat( uint16_t h );
+}
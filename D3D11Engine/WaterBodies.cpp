@@ -0,0 +1,283 @@
+#include "WaterBodies.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+namespace {
+    /** 21 bits per axis, enough for +-1M world units with a snap of 1 */
+    uint64_t VertexKey( const float* p, float invSnap ) {
+        uint64_t key = 0;
+        for ( int a = 0; a < 3; a++ ) {
+            const int q = static_cast<int>(floorf( p[a] * invSnap + 0.5f ));
+            key |= static_cast<uint64_t>(q & 0x1FFFFF) << (21 * a);
+        }
+        return key;
+    }
+
+    float Dot( const float* a, const float* b ) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    /** Puts a zero between every bit of the lower 16 */
+    uint32_t SpreadBits( uint32_t v ) {
+        v &= 0xFFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    uint32_t FindRoot( std::vector<uint32_t>& parents, uint32_t i ) {
+        while ( parents[i] != i ) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+}
+
+template <typename Index>
+void WaterBodies::Build( const void* positions, size_t stride, Index* indices, uint32_t numIndices,
+    std::vector<WaterBody>& outBodies, const WaterBodyOptions& options ) {
+    outBodies.clear();
+
+    const uint32_t numTriangles = numIndices / 3;
+    if ( !numTriangles )
+        return;
+
+    const uint8_t* vertexData = static_cast<const uint8_t*>(positions);
+    auto position = [&]( uint32_t i ) {
+        return reinterpret_cast<const float*>(vertexData + static_cast<size_t>(indices[i]) * stride);
+    };
+
+    // Degenerate triangles have no normal and join the first body they touch, so they can't bridge
+    // a waterfall and the lake below
+    std::vector<float> unitNormals( numTriangles * 3 );
+    for ( uint32_t t = 0; t < numTriangles; t++ ) {
+        const float* p0 = position( t * 3 );
+        const float* p1 = position( t * 3 + 1 );
+        const float* p2 = position( t * 3 + 2 );
+
+        const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        float n[3];
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        const float length = sqrtf( Dot( n, n ) );
+        for ( int a = 0; a < 3; a++ ) {
+            unitNormals[t * 3 + a] = length > 0.0f ? n[a] / length : 0.0f;
+        }
+    }
+
+    // Corners sorted by their position, so all triangles touching a position follow each other
+    const float invSnap = 1.0f / options.VertexSnap;
+    std::vector<std::pair<uint64_t, uint32_t>> corners( numTriangles * 3 );
+    for ( uint32_t i = 0; i < numTriangles * 3; i++ ) {
+        corners[i] = std::make_pair( VertexKey( position( i ), invSnap ), i / 3 );
+    }
+    std::sort( corners.begin(), corners.end() );
+
+    std::vector<uint32_t> parents( numTriangles );
+    for ( uint32_t t = 0; t < numTriangles; t++ ) {
+        parents[t] = t;
+    }
+
+    std::vector<uint8_t> degenerateJoined( numTriangles );
+
+    for ( size_t begin = 0; begin < corners.size(); ) {
+        size_t end = begin + 1;
+        while ( end < corners.size() && corners[end].first == corners[begin].first ) {
+            end++;
+        }
+
+        for ( size_t a = begin; a < end; a++ ) {
+            const uint32_t ta = corners[a].second;
+            const float* na = &unitNormals[ta * 3];
+
+            for ( size_t b = a + 1; b < end; b++ ) {
+                const uint32_t tb = corners[b].second;
+                if ( ta == tb )
+                    continue;
+
+                const float* nb = &unitNormals[tb * 3];
+
+                if ( Dot( na, na ) == 0.0f || Dot( nb, nb ) == 0.0f ) {
+                    const uint32_t degenerate = Dot( na, na ) == 0.0f ? ta : tb;
+                    if ( degenerateJoined[degenerate] )
+                        continue;
+                    degenerateJoined[degenerate] = 1;
+                } else if ( Dot( na, nb ) < options.MinNormalDot ) {
+                    continue;
+                }
+
+                const uint32_t ra = FindRoot( parents, ta );
+                const uint32_t rb = FindRoot( parents, tb );
+                if ( ra != rb ) {
+                    parents[std::max( ra, rb )] = std::min( ra, rb );
+                }
+            }
+        }
+        begin = end;
+    }
+
+    std::vector<uint32_t> bodyOf( numTriangles );
+    std::vector<uint32_t> bodyOfRoot( numTriangles, UINT32_MAX );
+    std::vector<std::array<float, 2>> centers;
+    float minXZ[2] = { FLT_MAX, FLT_MAX };
+    float maxXZ[2] = { -FLT_MAX, -FLT_MAX };
+    for ( uint32_t t = 0; t < numTriangles; t++ ) {
+        const uint32_t root = FindRoot( parents, t );
+        if ( bodyOfRoot[root] == UINT32_MAX ) {
+            bodyOfRoot[root] = static_cast<uint32_t>(outBodies.size());
+            outBodies.emplace_back();
+            outBodies.back().NumIndices = 0;
+            centers.push_back( { 0.0f, 0.0f } );
+        }
+
+        const uint32_t b = bodyOfRoot[root];
+        bodyOf[t] = b;
+        outBodies[b].NumIndices += 3;
+
+        for ( int c = 0; c < 3; c++ ) {
+            const float* p = position( t * 3 + c );
+            centers[b][0] += p[0];
+            centers[b][1] += p[2];
+            minXZ[0] = std::min( minXZ[0], p[0] );
+            minXZ[1] = std::min( minXZ[1], p[2] );
+            maxXZ[0] = std::max( maxXZ[0], p[0] );
+            maxXZ[1] = std::max( maxXZ[1], p[2] );
+        }
+    }
+
+    // Bodies close to each other get ranges close to each other, then the ones on screen mostly
+    // follow each other and merge into few drawcalls. They are ordered along a Z-curve over x and z.
+    std::vector<std::pair<uint32_t, uint32_t>> order( outBodies.size() );
+    for ( size_t b = 0; b < outBodies.size(); b++ ) {
+        uint32_t code = 0;
+        for ( int a = 0; a < 2; a++ ) {
+            const float center = centers[b][a] / outBodies[b].NumIndices;
+            const float extent = maxXZ[a] - minXZ[a];
+            const uint32_t cell = extent > 0.0f ? std::min( static_cast<uint32_t>((center - minXZ[a]) / extent * 65536.0f), 65535u ) : 0;
+            code |= SpreadBits( cell ) << a;
+        }
+        order[b] = std::make_pair( code, static_cast<uint32_t>(b) );
+    }
+    std::sort( order.begin(), order.end() );
+
+    uint32_t first = 0;
+    for ( auto const& it : order ) {
+        outBodies[it.second].FirstIndex = first;
+        first += outBodies[it.second].NumIndices;
+    }
+
+    std::vector<Index> reordered( numTriangles * 3 );
+    std::vector<uint32_t> next( outBodies.size() );
+    for ( size_t b = 0; b < outBodies.size(); b++ ) {
+        next[b] = outBodies[b].FirstIndex;
+    }
+
+    for ( uint32_t t = 0; t < numTriangles; t++ ) {
+        Index* dst = &reordered[next[bodyOf[t]]];
+        next[bodyOf[t]] += 3;
+        for ( int c = 0; c < 3; c++ ) {
+            dst[c] = indices[t * 3 + c];
+        }
+    }
+    std::copy( reordered.begin(), reordered.end(), indices );
+
+    std::vector<WaterBody> sorted( outBodies.size() );
+    for ( size_t b = 0; b < order.size(); b++ ) {
+        sorted[b] = outBodies[order[b].second];
+    }
+    outBodies.swap( sorted );
+
+    // The plane goes through the area-weighted center of the triangles, along their summed normals
+    for ( size_t b = 0; b < outBodies.size(); b++ ) {
+        WaterBody& body = outBodies[b];
+        double normal[3] = {};
+        double center[3] = {};
+        double area = 0.0;
+
+        for ( int a = 0; a < 3; a++ ) {
+            body.Min[a] = FLT_MAX;
+            body.Max[a] = -FLT_MAX;
+        }
+
+        for ( uint32_t i = body.FirstIndex; i < body.FirstIndex + body.NumIndices; i += 3 ) {
+            const float* p[3] = { position( i ), position( i + 1 ), position( i + 2 ) };
+            const float e1[3] = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+            const float e2[3] = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+            const double n[3] = {
+                static_cast<double>(e1[1]) * e2[2] - static_cast<double>(e1[2]) * e2[1],
+                static_cast<double>(e1[2]) * e2[0] - static_cast<double>(e1[0]) * e2[2],
+                static_cast<double>(e1[0]) * e2[1] - static_cast<double>(e1[1]) * e2[0] };
+            const double weight = sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+
+            for ( int a = 0; a < 3; a++ ) {
+                normal[a] += n[a];
+                center[a] += weight * (static_cast<double>(p[0][a]) + p[1][a] + p[2][a]) / 3.0;
+
+                for ( int c = 0; c < 3; c++ ) {
+                    body.Min[a] = std::min( body.Min[a], p[c][a] );
+                    body.Max[a] = std::max( body.Max[a], p[c][a] );
+                }
+            }
+            area += weight;
+        }
+
+        const double length = sqrt( normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] );
+        if ( length > 0.0 && area > 0.0 ) {
+            const double sign = normal[1] < 0.0 ? -1.0 : 1.0;
+            for ( int a = 0; a < 3; a++ ) {
+                body.Normal[a] = static_cast<float>(sign * normal[a] / length);
+                center[a] /= area;
+            }
+        } else {
+            // Only degenerate triangles, or they cancel out
+            body.Normal[0] = 0.0f;
+            body.Normal[1] = 1.0f;
+            body.Normal[2] = 0.0f;
+            for ( int a = 0; a < 3; a++ ) {
+                center[a] = position( body.FirstIndex )[a];
+            }
+        }
+
+        body.Distance = static_cast<float>(body.Normal[0] * center[0] + body.Normal[1] * center[1] + body.Normal[2] * center[2]);
+
+        body.Planar = true;
+        for ( uint32_t i = body.FirstIndex; i < body.FirstIndex + body.NumIndices && body.Planar; i++ ) {
+            body.Planar = fabsf( Dot( body.Normal, position( i ) ) - body.Distance ) <= options.PlaneTolerance;
+        }
+    }
+}
+
+template void WaterBodies::Build<uint16_t>( const void* positions, size_t stride, uint16_t* indices, uint32_t numIndices,
+    std::vector<WaterBody>& outBodies, const WaterBodyOptions& options );
+template void WaterBodies::Build<uint32_t>( const void* positions, size_t stride, uint32_t* indices, uint32_t numIndices,
+    std::vector<WaterBody>& outBodies, const WaterBodyOptions& options );
+
+void WaterBodies::MergeRanges( std::vector<WaterDrawRange>& ranges, uint32_t maxGap ) {
+    std::sort( ranges.begin(), ranges.end(), []( const WaterDrawRange& a, const WaterDrawRange& b ) {
+        return a.Texture < b.Texture || (a.Texture == b.Texture && a.FirstIndex < b.FirstIndex);
+    } );
+
+    size_t numMerged = 0;
+    for ( size_t i = 0; i < ranges.size(); i++ ) {
+        if ( numMerged ) {
+            WaterDrawRange& last = ranges[numMerged - 1];
+            if ( last.Texture == ranges[i].Texture && ranges[i].FirstIndex <= last.FirstIndex + last.NumIndices + maxGap ) {
+                const uint32_t end = std::max( last.FirstIndex + last.NumIndices, ranges[i].FirstIndex + ranges[i].NumIndices );
+                last.NumIndices = end - last.FirstIndex;
+                continue;
+            }
+        }
+        ranges[numMerged++] = ranges[i];
+    }
+    ranges.resize( numMerged );
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** Splits the water meshes of the world into single bodies of water and batches their drawcalls
+
+    The world keeps one water mesh per section and texture, which usually holds a lake together with
+    every puddle and river bend around it. At conversion time the triangles of such a mesh are
+    grouped into bodies: Triangles sharing a vertex belong to the same body if they face the same
+    way, so a waterfall is cut off the river it falls into. The indices are reordered so every body
+    is a single range, the triangles keep their order inside of it. Bodies lying close to each other
+    get ranges close to each other. Every body gets its plane and its bounds, then the renderer can
+    test them on their own.
+
+    Visible bodies are drawn as ranges of the world indexbuffer. Sorted by texture and position,
+    ranges which follow each other in the buffer are merged into one drawcall. Small gaps are drawn
+    along, a few hidden puddles cost less than another drawcall.
+
+    Doesn't know anything about the engine, so it can be tested on its own. */
+
+struct WaterBody {
+    /** Points p with dot(Normal, p) = Distance are on the surface. Faces up, unless the body is vertical. */
+    float Normal[3];
+    float Distance;
+
+    float Min[3];
+    float Max[3];
+
+    /** Range inside of the reordered indices of the mesh */
+    uint32_t FirstIndex;
+    uint32_t NumIndices;
+
+    /** All vertices are within PlaneTolerance of the plane */
+    bool Planar;
+};
+
+struct WaterBodyOptions {
+    WaterBodyOptions() {
+        VertexSnap = 1.0f;
+        MinNormalDot = 0.95f;
+        PlaneTolerance = 5.0f;
+    }
+
+    /** Vertices closer than this are the same, the world has split vertices along texture seams */
+    float VertexSnap;
+
+    /** Neighbours whose normals differ more than this are cut apart, 0.95 is about 18 degrees */
+    float MinNormalDot;
+
+    /** Distance of the vertices to the plane up to which a body counts as flat */
+    float PlaneTolerance;
+};
+
+/** Part of an indexbuffer to draw with a texture, the texture is only compared */
+struct WaterDrawRange {
+    void* Texture;
+    uint32_t FirstIndex;
+    uint32_t NumIndices;
+};
+
+namespace WaterBodies {
+    /** Hidden indices which are drawn along instead of starting another drawcall, 128 triangles */
+    constexpr uint32_t MERGE_GAP = 3 * 128;
+
+    /** Finds the bodies of a trianglelist and reorders its indices so every body is one range. The
+        stride of the positions is given in bytes. Implemented for 16 and 32 bit indices. */
+    template <typename Index>
+    void Build( const void* positions, size_t stride, Index* indices, uint32_t numIndices,
+        std::vector<WaterBody>& outBodies, const WaterBodyOptions& options = WaterBodyOptions() );
+
+    /** Sorts the ranges by texture and position and merges those of a texture which are at most maxGap indices apart */
+    void MergeRanges( std::vector<WaterDrawRange>& ranges, uint32_t maxGap = 0 );
+}
@@ -29,106 +29,14 @@ WorldConverter::WorldConverter() {}
 
 WorldConverter::~WorldConverter() {}
 
-/** Collects all world-polys in the specific range. Drops all materials that have no alphablending */
-void WorldConverter::WorldMeshCollectPolyRange( const float3& position, float range, std::map<int, std::map<int, WorldMeshSectionInfo>>& inSections, std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>& outMeshes ) {
-    INT2 s = GetSectionOfPos( position );
-    MeshKey opaqueKey;
-    opaqueKey.Material = nullptr;
-    opaqueKey.Info = nullptr;
-    opaqueKey.Texture = nullptr;
-
-    WorldMeshInfo* opaqueMesh = new WorldMeshInfo;
-    outMeshes[opaqueKey] = opaqueMesh;
-
-    FXMVECTOR xmPosition = XMLoadFloat3( position.toXMFLOAT3() );
-
-    // Generate the meshes
-    for ( auto const& itx : Engine::GAPI->GetWorldSections() ) {
-        for ( auto const& ity : itx.second ) {
-            float len;
-            XMStoreFloat( &len, XMVector2Length( XMVectorSet( static_cast<float> (itx.first - s.x), static_cast<float> (ity.first - s.y), 0, 0 ) ) );
-            if ( len < 2 ) {
-                // Check all polys from all meshes
-                for ( auto const& it : ity.second.WorldMeshes ) {
-                    WorldMeshInfo* m;
-
-                    // Create new mesh-part for alphatested surfaces
-                    if ( it.first.Texture && it.first.Texture->HasAlphaChannel() ) {
-                        m = new WorldMeshInfo;
-                        outMeshes[it.first] = m;
-                    } else {
-                        // Just use the same mesh for opaque surfaces
-                        m = opaqueMesh;
-                    }
-
-                    for ( unsigned int i = 0; i < it.second->Indices.size(); i += 3 ) {
-                        // Check if one of them is in range
-
-                        const float range2 = range * range;
-                        if ( Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 0]].Position.toXMFLOAT3() ) ) < range2
-                            || Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 1]].Position.toXMFLOAT3() ) ) < range2
-                            || Toolbox::XMVector3LengthSqFloat( xmPosition - XMLoadFloat3( it.second->Vertices[it.second->Indices[i + 2]].Position.toXMFLOAT3() ) ) < range2 ) {
-                            for ( int v = 0; v < 3; v++ )
-                                m->Vertices.emplace_back( it.second->Vertices[it.second->Indices[i + v]] );
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    // Index all meshes
-    for ( auto it = outMeshes.begin(); it != outMeshes.end();) {
-        if ( it->second->Vertices.empty() ) {
-            it = outMeshes.erase( it );
-            continue;
-        }
-
-        std::vector<VERTEX_INDEX> indices;
-        std::vector<ExVertexStruct> vertices;
-        IndexVertices( &it->second->Vertices[0], it->second->Vertices.size(), vertices, indices );
-
-        it->second->Vertices = vertices;
-        it->second->Indices = indices;
-
-        // Create the buffers
-        Engine::GraphicsEngine->CreateVertexBuffer( &it->second->MeshVertexBuffer );
-        Engine::GraphicsEngine->CreateVertexBuffer( &it->second->MeshIndexBuffer );
-
-        // Init and fill them
-        it->second->MeshVertexBuffer->Init( &it->second->Vertices[0], it->second->Vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-        it->second->MeshIndexBuffer->Init( &it->second->Indices[0], it->second->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-
-        ++it;
-    }
-}
-
 /** Converts a loaded custommesh to be the worldmesh */
 XRESULT WorldConverter::LoadWorldMeshFromFile( const std::string& file, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh ) {
     GMesh* mesh = new GMesh();
 
     const float worldScale = 100.0f;
 
-    // Check if we have this file cached
-    if ( Toolbox::FileExists( (file + ".mcache").c_str() ) ) {
-        // Load the meshfile, cached
-        mesh->LoadMesh( (file + ".mcache").c_str(), worldScale );
-    } else {
-        // Create cache-file
-        mesh->LoadMesh( file, worldScale );
-
-        std::vector<MeshInfo*>& meshes = mesh->GetMeshes();
-        std::vector<std::string>& textures = mesh->GetTextures();
-        std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> gm;
-
-        for ( unsigned int m = 0; m < meshes.size(); m++ ) {
-            auto& meshData = gm[textures[m]];
-
-            meshData.emplace_back( std::make_pair( meshes[m]->Vertices, meshes[m]->Indices ) );
-        }
-
-        CacheMesh( gm, file + ".mcache" );
-    }
+    // Uses file.mcache if it's up to date, or creates it
+    mesh->LoadMesh( file, worldScale );
 
 
     std::vector<MeshInfo*>& meshes = mesh->GetMeshes();
@@ -267,17 +175,27 @@ XRESULT WorldConverter::LoadWorldMeshFromFile( const std::string& file, std::map
                     it.second->Vertices.size(),
                     sizeof( ExVertexStruct ) );
 
-                // Init and fill them
-                it.second->MeshVertexBuffer->Init( &it.second->Vertices[0], it.second->Vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-                it.second->MeshIndexBuffer->Init( &it.second->Indices[0], it.second->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+                // Water is drawn body by body
+                if ( it.first.Info && it.first.Info->MaterialType == MaterialInfo::MT_Water ) {
+                    BuildWaterBodies( it.second );
+                }
 
-                // Remember them, to wrap then up later
-                vertexBuffers.emplace_back( &it.second->Vertices );
-                indexBuffers.emplace_back( &it.second->Indices );
+                // The mesh is drawn out of its part of the wrapped worldmesh, so it doesn't need buffers of its
+                // own. Only tesselated meshes get theirs, once their settings are loaded.
+                SAFE_DELETE( it.second->MeshVertexBuffer );
+                SAFE_DELETE( it.second->MeshIndexBuffer );
             }
         }
     }
 
+    // Remember them, to wrap then up
+    std::vector<WorldMeshInfo*> wrappedMeshes;
+    GetWrappedMeshOrder( *outSections, wrappedMeshes );
+    for ( WorldMeshInfo* mesh : wrappedMeshes ) {
+        vertexBuffers.emplace_back( &mesh->Vertices );
+        indexBuffers.emplace_back( &mesh->Indices );
+    }
+
     std::vector<ExVertexStruct> wrappedVertices;
     std::vector<unsigned int> wrappedIndices;
     std::vector<unsigned int> offsets;
@@ -286,15 +204,15 @@ XRESULT WorldConverter::LoadWorldMeshFromFile( const std::string& file, std::map
     WorldConverter::WrapVertexBuffers( vertexBuffers, indexBuffers, wrappedVertices, wrappedIndices, offsets );
 
     // Propergate the offsets
-    int i = 0;
+    for ( size_t i = 0; i < wrappedMeshes.size(); i++ ) {
+        wrappedMeshes[i]->BaseIndexLocation = offsets[i];
+    }
+
     for ( auto& itx : *outSections ) {
         for ( auto& ity : itx.second ) {
             int numIndices = 0;
             for ( auto const& it : ity.second.WorldMeshes ) {
-                it.second->BaseIndexLocation = offsets[i];
                 numIndices += it.second->Indices.size();
-
-                i++;
             }
 
             ity.second.NumIndices = numIndices;
@@ -705,18 +623,27 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
                     it.second->Vertices.size(),
                     sizeof( ExVertexStruct ) );
 
-                // Init and fill them
-                it.second->MeshVertexBuffer->Init( &it.second->Vertices[0], it.second->Vertices.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-                it.second->MeshIndexBuffer->Init( &it.second->Indices[0], it.second->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
-
+                // Water is drawn body by body
+                if ( it.first.Info && it.first.Info->MaterialType == MaterialInfo::MT_Water ) {
+                    BuildWaterBodies( it.second );
+                }
 
-                // Remember them, to wrap then up later
-                vertexBuffers.emplace_back( &it.second->Vertices );
-                indexBuffers.emplace_back( &it.second->Indices );
+                // The mesh is drawn out of its part of the wrapped worldmesh, so it doesn't need buffers of its
+                // own. Only tesselated meshes get theirs, once their settings are loaded.
+                SAFE_DELETE( it.second->MeshVertexBuffer );
+                SAFE_DELETE( it.second->MeshIndexBuffer );
             }
         }
     }
 
+    // Remember them, to wrap then up
+    std::vector<WorldMeshInfo*> wrappedMeshes;
+    GetWrappedMeshOrder( *outSections, wrappedMeshes );
+    for ( WorldMeshInfo* mesh : wrappedMeshes ) {
+        vertexBuffers.emplace_back( &mesh->Vertices );
+        indexBuffers.emplace_back( &mesh->Indices );
+    }
+
     std::vector<ExVertexStruct> wrappedVertices;
     std::vector<unsigned int> wrappedIndices;
     std::vector<unsigned int> offsets;
@@ -725,15 +652,8 @@ HRESULT WorldConverter::ConvertWorldMesh( zCPolygon** polys, unsigned int numPol
     WorldConverter::WrapVertexBuffers( vertexBuffers, indexBuffers, wrappedVertices, wrappedIndices, offsets );
 
     // Propergate the offsets
-    int i = 0;
-    for ( auto const& itx : *outSections ) {
-        for ( auto const& ity : itx.second ) {
-            for ( auto const& it : ity.second.WorldMeshes ) {
-                it.second->BaseIndexLocation = offsets[i];
-
-                i++;
-            }
-        }
+    for ( size_t i = 0; i < wrappedMeshes.size(); i++ ) {
+        wrappedMeshes[i]->BaseIndexLocation = offsets[i];
     }
 
     // Create the buffers for wrapped mesh
@@ -1466,31 +1386,42 @@ void WorldConverter::UpdateMorphMeshVisual( void* v, MeshVisualInfo* meshInfo )
     if ( !morphMesh )
         return;
 
-    DirectX::XMFLOAT3* posList = (DirectX::XMFLOAT3*)morphMesh->GetPositionList()->Array;
-    for ( int i = 0; i < morphMesh->GetNumSubmeshes(); i++ ) {
-        std::vector<ExVertexStruct> vertices;
+    UpdateMorphMeshVertices( morphMesh, meshInfo );
+}
 
-        zCSubMesh* s = morphMesh->GetSubmesh( i );
-        vertices.reserve( s->WedgeList.NumInArray );
-        for ( int v = 0; v < s->WedgeList.NumInArray; v++ ) {
-            zTPMWedge& wedge = s->WedgeList.Array[v];
-            vertices.emplace_back();
-            ExVertexStruct& vx = vertices.back();
-            vx.Position = posList[wedge.position];
-            vx.Normal = wedge.normal;
-            vx.TexCoord = wedge.texUV;
-            vx.Color = 0xFFFFFFFF;
+/** Writes the positions Gothic blended for the morph mesh into its vertex buffers, if they changed since the last call */
+void WorldConverter::UpdateMorphMeshVertices( zCProgMeshProto* morphMesh, MeshVisualInfo* meshInfo ) {
+    if ( !meshInfo->MorphVertices ) {
+        // Which position every wedge uses never changes, only the positions do
+        meshInfo->MorphVertices = new MorphMeshVertices;
+        std::vector<VERTEX_INDEX> wedgePositions;
+        for ( int i = 0; i < morphMesh->GetNumSubmeshes(); i++ ) {
+            zCSubMesh* s = morphMesh->GetSubmesh( i );
+
+            wedgePositions.resize( s->WedgeList.NumInArray );
+            for ( int v = 0; v < s->WedgeList.NumInArray; v++ ) {
+                wedgePositions[v] = s->WedgeList.Array[v].position;
+            }
+
+            meshInfo->MorphVertices->AddSubmesh( wedgePositions.data(), wedgePositions.size() );
         }
+    }
 
-        for ( auto const& it : meshInfo->Meshes ) {
-            for ( MeshInfo* mi : it.second ) {
-                if ( mi->MeshIndex == i ) {
-                    mi->MeshVertexBuffer->UpdateBuffer( &vertices[0], vertices.size() * sizeof( ExVertexStruct ) );
-                    goto Out_Of_Nested_Loop;
-                }
-            }
+    // Idle heads give the same positions every frame, nothing to do for them
+    MorphMeshVertices* morph = meshInfo->MorphVertices;
+    if ( !morph->Update( reinterpret_cast<const float*>(morphMesh->GetPositionList()->Array), morphMesh->GetPositionList()->NumInArray ) )
+        return;
+
+    // The meshes keep their vertices, only the positions get overwritten
+    for ( auto const& it : meshInfo->Meshes ) {
+        for ( MeshInfo* mi : it.second ) {
+            if ( mi->MeshIndex < 0 || static_cast<size_t>(mi->MeshIndex) >= morph->GetNumSubmeshes()
+                || mi->Vertices.size() != morph->GetNumWedges( mi->MeshIndex ) )
+                continue;
+
+            morph->Expand( mi->MeshIndex, &mi->Vertices[0], sizeof( ExVertexStruct ) );
+            mi->MeshVertexBuffer->UpdateBuffer( &mi->Vertices[0], mi->Vertices.size() * sizeof( ExVertexStruct ) );
         }
-        Out_Of_Nested_Loop:;
     }
 }
 
@@ -1863,41 +1794,37 @@ void WorldConverter::WrapVertexBuffers( const std::list<std::vector<ExVertexStru
     }
 }
 
-/** Caches a mesh */
-void WorldConverter::CacheMesh( const std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> geometry, const std::string& file ) {
-    FILE* f = fopen( file.c_str(), "wb" );
-    // Write version
-    int Version = 1;
-    fwrite( &Version, sizeof( Version ), 1, f );
-
-    // Write num textures
-    size_t numTextures = geometry.size();
-    fwrite( &numTextures, sizeof( numTextures ), 1, f );
-
-    for ( auto const& it : geometry ) {
-        // Save texture name
-        uint8_t numTxNameChars = static_cast<uint8_t>(it.first.size());
-        fwrite( &numTxNameChars, sizeof( numTxNameChars ), 1, f );
-        fwrite( &it.first[0], numTxNameChars, 1, f );
-
-        // Save num submeshes
-        uint8_t numSubmeshes = static_cast<uint8_t>(it.second.size());
-        fwrite( &numSubmeshes, sizeof( numSubmeshes ), 1, f );
-
-        for ( uint8_t i = 0; i < numSubmeshes; i++ ) {
-            // Save vertices
-            size_t numVertices = it.second[i].first.size();
-            fwrite( &numVertices, sizeof( numVertices ), 1, f );
-            fwrite( &it.second[i].first[0], sizeof( ExVertexStruct ) * it.second[i].first.size(), 1, f );
-
-            // Save indices
-            size_t numIndices = it.second[i].second.size();
-            fwrite( &numIndices, sizeof( numIndices ), 1, f );
-            fwrite( &it.second[i].second[0], sizeof( VERTEX_INDEX ) * it.second[i].second.size(), 1, f );
+/** Order of the world meshes in the big vertexbuffer */
+void WorldConverter::GetWrappedMeshOrder( const std::map<int, std::map<int, WorldMeshSectionInfo>>& sections, std::vector<WorldMeshInfo*>& outMeshes ) {
+    std::vector<std::pair<zCTexture*, WorldMeshInfo*>> water;
+
+    for ( auto const& itx : sections ) {
+        for ( auto const& ity : itx.second ) {
+            for ( auto const& it : ity.second.WorldMeshes ) {
+                if ( !it.second->Bodies.empty() ) {
+                    water.emplace_back( it.first.Texture, it.second );
+                } else {
+                    outMeshes.emplace_back( it.second );
+                }
+            }
         }
     }
 
-    fclose( f );
+    // Stable, so the sections of a texture stay in order and neighbours in y follow each other
+    std::stable_sort( water.begin(), water.end(), []( const auto& a, const auto& b ) { return a.first < b.first; } );
+    for ( auto const& it : water ) {
+        outMeshes.emplace_back( it.second );
+    }
+}
+
+/** Splits a water mesh into its bodies */
+void WorldConverter::BuildWaterBodies( WorldMeshInfo* mesh ) {
+    mesh->Bodies.clear();
+    if ( mesh->Indices.empty() )
+        return;
+
+    WaterBodies::Build( &mesh->Vertices[0].Position.x, sizeof( ExVertexStruct ),
+        &mesh->Indices[0], static_cast<uint32_t>(mesh->Indices.size()), mesh->Bodies );
 }
 
 /** Updates a quadmark info */
@@ -1973,11 +1900,16 @@ void WorldConverter::CreatePNAENInfoFor( WorldMeshInfo* mesh, bool softNormals )
     delete mesh->MeshVertexBuffer;
     Engine::GraphicsEngine->CreateVertexBuffer( &mesh->MeshVertexBuffer );
 
+    // Worldmeshes only get their own buffers once they are tesselated
+    delete mesh->MeshIndexBuffer;
+    Engine::GraphicsEngine->CreateVertexBuffer( &mesh->MeshIndexBuffer );
+
     mesh->VerticesPNAEN = mesh->Vertices;
 
     MeshModifier::ComputePNAEN18Indices( mesh->VerticesPNAEN, mesh->Indices, mesh->IndicesPNAEN, true, softNormals );
     mesh->MeshIndexBufferPNAEN->Init( &mesh->IndicesPNAEN[0], mesh->IndicesPNAEN.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
     mesh->MeshVertexBuffer->Init( &mesh->VerticesPNAEN[0], mesh->VerticesPNAEN.size() * sizeof( ExVertexStruct ), D3D11VertexBuffer::B_VERTEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+    mesh->MeshIndexBuffer->Init( &mesh->Indices[0], mesh->Indices.size() * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
 }
 
 /** Turns a MeshInfo into PNAEN */
@@ -2081,6 +2013,9 @@ void WorldConverter::TesselateMesh( WorldMeshInfo* mesh, int amount ) {
 
         // Index
         WorldConverter::IndexVertices( &meshTess[0], meshTess.size(), mesh->Vertices, mesh->Indices );
+
+        // The ranges of the bodies are gone, the mesh is drawn as a whole
+        mesh->Bodies.clear();
     }
 
     MeshModifier::ComputePNAEN18Indices( mesh->Vertices, mesh->Indices, mesh->IndicesPNAEN, true, true );
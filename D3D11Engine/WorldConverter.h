@@ -29,9 +29,6 @@ public:
     WorldConverter();
     virtual ~WorldConverter();
 
-    /** Collects all world-polys in the specific range. Drops all materials that have no alphablending */
-    static void WorldMeshCollectPolyRange( const float3& position, float range, std::map<int, std::map<int, WorldMeshSectionInfo>>& inSections, std::map<MeshKey, WorldMeshInfo*, cmpMeshKey>& outMeshes );
-
     /** Converts the worldmesh into a more usable format */
     static HRESULT ConvertWorldMesh( zCPolygon** polys, unsigned int numPolygons, std::map<int, std::map<int, WorldMeshSectionInfo>>* outSections, WorldInfo* info, MeshInfo** outWrappedMesh, bool indoorLocation );
 
@@ -63,6 +60,9 @@ public:
     /** Updates a Morph-Mesh visual */
     static void UpdateMorphMeshVisual( void* visual, MeshVisualInfo* meshInfo );
 
+    /** Writes the positions Gothic blended for the morph mesh into its vertex buffers, if they changed since the last call */
+    static void UpdateMorphMeshVertices( zCProgMeshProto* morphMesh, MeshVisualInfo* meshInfo );
+
     /** Extracts a skeletal mesh from a zCModel */
     static void ExtractSkeletalMeshFromVob( zCModel* model, SkeletalMeshVisualInfo* skeletalMeshInfo );
 
@@ -95,12 +95,16 @@ public:
     /** Tesselates the given triangle and adds the values to the list */
     static void TesselateTriangle( ExVertexStruct* tri, std::vector<ExVertexStruct>& tesselated, int amount );
 
+    /** Order of the world meshes in the big vertexbuffer: Section by section, with the water of all sections
+        behind them, grouped by texture. Visible water of neighbouring sections can then be drawn at once. */
+    static void GetWrappedMeshOrder( const std::map<int, std::map<int, WorldMeshSectionInfo>>& sections, std::vector<WorldMeshInfo*>& outMeshes );
+
+    /** Splits a water mesh into its bodies and reorders its indices, has to be done before its buffers are filled */
+    static void BuildWaterBodies( WorldMeshInfo* mesh );
+
     /** Builds a big vertexbuffer from the world sections */
     static void WrapVertexBuffers( const std::list<std::vector<ExVertexStruct>*>& vertexBuffers, const std::list<std::vector<VERTEX_INDEX>*>& indexBuffers, std::vector<ExVertexStruct>& outVertices, std::vector<unsigned int>& outIndices, std::vector<unsigned int>& outOffsets );
 
-    /** Caches a mesh */
-    static void CacheMesh( const std::map<std::string, std::vector<std::pair<std::vector<ExVertexStruct>, std::vector<VERTEX_INDEX>>>> geometry, const std::string& file );
-
     /** Turns a MeshInfo into PNAEN */
     static void CreatePNAENInfoFor( MeshInfo* mesh, bool softNormals = false );
     static void CreatePNAENInfoFor( SkeletalMeshInfo* mesh, MeshInfo* bindPoseMesh, bool softNormals = false );
@@ -6,9 +6,19 @@
 #include "zCVob.h"
 #include "zCMaterial.h"
 #include "zCTexture.h"
+#include "MeshSimplifier.h"
 
 const int WORLDMESHINFO_VERSION = 5;
 const int VISUALINFO_VERSION = 5;
+const int LODCACHE_VERSION = 1;
+
+/** Visuals with less triangles than this aren't worth simplifying */
+const unsigned int LOD_MIN_TRIANGLES = 128;
+
+/** Maximum geometric error of the coarsest level, relative to the size of the visual */
+const float LOD_MAX_RELATIVE_ERROR = 0.02f;
+
+static_assert(MESH_MAX_LODS == MeshSimplifier::MAX_LODS, "LOD count of the visuals and the simplifier differ");
 
 /** Saves the info for this visual */
 void WorldMeshInfo::SaveWorldMeshInfo( const std::string& name ) {
@@ -137,6 +147,172 @@ void MeshVisualInfo::CreatePNAENInfo( bool softNormals ) {
     }
 }
 
+/** Picks the LOD for an instance at the given distance */
+unsigned char MeshVisualInfo::SelectLOD( float distance, float pixelScale, float maxPixelError, unsigned char currentLOD ) const {
+    return MeshSimplifier::SelectLOD( LODErrors, NumLODs, distance, pixelScale, maxPixelError, currentLOD );
+}
+
+/** Copies the instances of this frame grouped by LOD, and fills LODInstanceStart/-Count */
+void MeshVisualInfo::WriteInstancesSortedByLOD( VobInstanceInfo* target ) {
+    memset( LODInstanceCount, 0, sizeof( LODInstanceCount ) );
+
+    if ( !NumLODs || InstanceLODs.size() != Instances.size() ) {
+        if ( !Instances.empty() )
+            memcpy( target, &Instances[0], Instances.size() * sizeof( VobInstanceInfo ) );
+
+        LODInstanceStart[0] = 0;
+        LODInstanceCount[0] = Instances.size();
+        return;
+    }
+
+    // Counting sort, straight into the instancing buffer
+    for ( unsigned char lod : InstanceLODs ) {
+        LODInstanceCount[lod]++;
+    }
+
+    unsigned int next[MESH_MAX_LODS + 1];
+    unsigned int start = 0;
+    for ( unsigned int l = 0; l <= MESH_MAX_LODS; l++ ) {
+        LODInstanceStart[l] = start;
+        next[l] = start;
+        start += LODInstanceCount[l];
+    }
+
+    for ( size_t i = 0; i < Instances.size(); i++ ) {
+        target[next[InstanceLODs[i]]++] = Instances[i];
+    }
+}
+
+/** Hash of the index data, to notice when a cached LOD-file belongs to a different version of the mesh */
+static uint32_t HashLODSource( const MeshInfo* mesh ) {
+    uint32_t hash = 2166136261u;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(mesh->Indices.data());
+    for ( size_t i = 0; i < mesh->Indices.size() * sizeof( VERTEX_INDEX ); i++ ) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+
+    return hash ^ static_cast<uint32_t>(mesh->Vertices.size());
+}
+
+/** Loads the simplified levels of all meshes from the cache. Fails if the cache doesn't match the meshes anymore. */
+static bool LoadLODCache( const std::string& file, const std::vector<MeshInfo*>& meshes, unsigned int& numLODs, float* errors, std::vector<std::vector<std::vector<VERTEX_INDEX>>>& levels ) {
+    FILE* f = fopen( file.c_str(), "rb" );
+    if ( !f )
+        return false;
+
+    int version = 0;
+    uint32_t numMeshes = 0;
+    bool ok = fread( &version, sizeof( version ), 1, f ) == 1 && version == LODCACHE_VERSION
+        && fread( &numMeshes, sizeof( numMeshes ), 1, f ) == 1 && numMeshes == meshes.size()
+        && fread( &numLODs, sizeof( numLODs ), 1, f ) == 1 && numLODs <= MESH_MAX_LODS
+        && fread( errors, sizeof( float ), numLODs, f ) == numLODs;
+
+    levels.assign( meshes.size(), std::vector<std::vector<VERTEX_INDEX>>( ok ? numLODs : 0 ) );
+    for ( size_t m = 0; ok && m < meshes.size(); m++ ) {
+        uint32_t hash = 0;
+        ok = fread( &hash, sizeof( hash ), 1, f ) == 1 && hash == HashLODSource( meshes[m] );
+
+        for ( unsigned int l = 0; ok && l < numLODs; l++ ) {
+            uint32_t numIndices = 0;
+            ok = fread( &numIndices, sizeof( numIndices ), 1, f ) == 1 && numIndices <= meshes[m]->Indices.size();
+            if ( !ok )
+                break;
+
+            levels[m][l].resize( numIndices );
+            ok = fread( levels[m][l].data(), sizeof( VERTEX_INDEX ), numIndices, f ) == numIndices;
+        }
+    }
+
+    fclose( f );
+    return ok;
+}
+
+/** Saves the simplified levels of all meshes, so the next start doesn't have to generate them again */
+static void SaveLODCache( const std::string& file, const std::vector<MeshInfo*>& meshes, unsigned int numLODs, const float* errors, const std::vector<std::vector<std::vector<VERTEX_INDEX>>>& levels ) {
+    static bool createdFolder = Toolbox::CreateDirectoryRecursive( "system\\GD3D11\\meshes\\lods" );
+
+    FILE* f = fopen( file.c_str(), "wb" );
+    if ( !f )
+        return; // Not a problem, we'll just generate them again next time
+
+    uint32_t numMeshes = static_cast<uint32_t>(meshes.size());
+    fwrite( &LODCACHE_VERSION, sizeof( LODCACHE_VERSION ), 1, f );
+    fwrite( &numMeshes, sizeof( numMeshes ), 1, f );
+    fwrite( &numLODs, sizeof( numLODs ), 1, f );
+    fwrite( errors, sizeof( float ), numLODs, f );
+
+    for ( size_t m = 0; m < meshes.size(); m++ ) {
+        uint32_t hash = HashLODSource( meshes[m] );
+        fwrite( &hash, sizeof( hash ), 1, f );
+
+        for ( unsigned int l = 0; l < numLODs; l++ ) {
+            uint32_t numIndices = static_cast<uint32_t>(levels[m][l].size());
+            fwrite( &numIndices, sizeof( numIndices ), 1, f );
+            fwrite( levels[m][l].data(), sizeof( VERTEX_INDEX ), numIndices, f );
+        }
+    }
+
+    fclose( f );
+}
+
+/** Generates the simplified levels for all meshes, or loads them from the cache */
+void MeshVisualInfo::CreateLODs() {
+    // Morphmeshes get their vertices replaced every frame, the error-bounds wouldn't hold
+    if ( NumLODs || MorphMeshVisual || VisualName.empty() )
+        return;
+
+    std::vector<MeshInfo*> meshes;
+    unsigned int numTriangles = 0;
+    for ( auto const& it : Meshes ) {
+        for ( MeshInfo* mesh : it.second ) {
+            meshes.push_back( mesh );
+            numTriangles += mesh->Indices.size() / 3;
+        }
+    }
+
+    if ( numTriangles < LOD_MIN_TRIANGLES )
+        return;
+
+    // The material-pointers change between runs, the submesh-index doesn't
+    std::sort( meshes.begin(), meshes.end(), []( const MeshInfo* a, const MeshInfo* b ) { return a->MeshIndex < b->MeshIndex; } );
+
+    const std::string cacheFile = "system\\GD3D11\\meshes\\lods\\" + VisualName + ".lod";
+    std::vector<std::vector<std::vector<VERTEX_INDEX>>> levels;
+    unsigned int numLODs = 0;
+    float errors[MESH_MAX_LODS] = {};
+
+    if ( !LoadLODCache( cacheFile, meshes, numLODs, errors, levels ) ) {
+        // A rejected cache may have filled in some of the errors already, these are overwritten here
+        std::vector<MeshSimplifierInput> inputs;
+        for ( MeshInfo* mesh : meshes ) {
+            inputs.push_back( { mesh->Vertices.empty() ? nullptr : &mesh->Vertices[0].Position.x, sizeof( ExVertexStruct ), mesh->Vertices.size(), &mesh->Indices } );
+        }
+
+        numLODs = MeshSimplifier::GenerateLODChains( inputs, MESH_MAX_LODS, MeshSize * LOD_MAX_RELATIVE_ERROR, levels, errors );
+
+        SaveLODCache( cacheFile, meshes, numLODs, errors, levels );
+    }
+
+    for ( size_t m = 0; m < meshes.size(); m++ ) {
+        for ( unsigned int l = 0; l < numLODs; l++ ) {
+            MeshLOD lod;
+            lod.NumIndices = levels[m][l].size();
+            lod.IndexBuffer = nullptr;
+
+            if ( lod.NumIndices ) {
+                Engine::GraphicsEngine->CreateVertexBuffer( &lod.IndexBuffer );
+                lod.IndexBuffer->Init( &levels[m][l][0], lod.NumIndices * sizeof( VERTEX_INDEX ), D3D11VertexBuffer::B_INDEXBUFFER, D3D11VertexBuffer::U_IMMUTABLE );
+                Engine::GAPI->GetRendererState().RendererInfo.VOBVerticesDataSize += lod.NumIndices * sizeof( VERTEX_INDEX );
+            }
+
+            meshes[m]->LODs.push_back( lod );
+        }
+    }
+
+    NumLODs = numLODs;
+    memcpy( LODErrors, errors, sizeof( LODErrors ) );
+}
+
 /** Removes PNAEN info from this visual */
 void BaseVisualInfo::ClearPNAENInfo() {
     for ( std::map<zCMaterial*, std::vector<MeshInfo*>>::iterator it = Meshes.begin(); it != Meshes.end(); it++ ) {
@@ -192,12 +368,6 @@ void BaseVisualInfo::LoadMeshVisualInfo( const std::string& name ) {
     fclose( f );
 }
 
-SectionInstanceCache::~SectionInstanceCache() {
-    for ( std::map<MeshVisualInfo*, D3D11VertexBuffer*>::iterator it = InstanceCache.begin(); it != InstanceCache.end(); it++ ) {
-        delete it->second;
-    }
-}
-
 MeshInfo::~MeshInfo() {
     //Engine::GAPI->GetRendererState().RendererInfo.VOBVerticesDataSize -= Indices.size() * sizeof(VERTEX_INDEX);
     //Engine::GAPI->GetRendererState().RendererInfo.VOBVerticesDataSize -= Vertices.size() * sizeof(ExVertexStruct);
@@ -206,6 +376,9 @@ MeshInfo::~MeshInfo() {
     delete MeshIndexBuffer;
     delete MeshIndexBufferPNAEN;
 
+    for ( MeshLOD& lod : LODs ) {
+        delete lod.IndexBuffer;
+    }
 }
 
 SkeletalMeshInfo::~SkeletalMeshInfo() {
@@ -217,16 +390,6 @@ SkeletalMeshInfo::~SkeletalMeshInfo() {
     delete MeshIndexBufferPNAEN;
 }
 
-/** Clears the cache for the given progmesh */
-void SectionInstanceCache::ClearCacheForStatic( MeshVisualInfo* pm ) {
-    if ( InstanceCache.find( pm ) != InstanceCache.end() ) {
-        D3D11VertexBuffer* vb = InstanceCache[pm];
-        delete vb;
-        InstanceCache[pm] = nullptr;
-        InstanceCacheData[pm].clear();
-    }
-}
-
 /** Saves this sections mesh to a file */
 void WorldMeshSectionInfo::SaveSectionMeshToFile( const std::string& name ) {
     FILE* f;
@@ -253,6 +416,23 @@ void WorldMeshSectionInfo::SaveMeshInfos( const std::string& worldName, INT2 sec
     }
 }
 
+/** Splits the worldmeshes into the clusters used by the pointlight shadows, if not done yet */
+void WorldMeshSectionInfo::BuildShadowClusters() {
+    if ( ShadowClustersBuilt )
+        return;
+
+    ShadowClusters.Clear();
+    for ( auto const& it : WorldMeshes ) {
+        if ( it.second->Indices.empty() )
+            continue;
+
+        ShadowClusters.AddMesh( &it.first, &it.second->Vertices[0].Position, sizeof( ExVertexStruct ),
+            &it.second->Indices[0], it.second->Indices.size(), it.second->BaseIndexLocation );
+    }
+
+    ShadowClustersBuilt = true;
+}
+
 /** Saves the mesh infos for this section */
 void WorldMeshSectionInfo::LoadMeshInfos( const std::string& worldName, INT2 sectionPos ) {
     for ( auto it = WorldMeshes.begin(); it != WorldMeshes.end(); it++ ) {
@@ -11,6 +11,11 @@
 #include "zCPolygon.h"
 #include "BaseShadowedPointLight.h"
 #include "D3D11VertexBuffer.h"
+#include "FrameArena.h"
+#include "MorphMeshVertices.h"
+#include "TriangleClusterSet.h"
+#include "WaterBodies.h"
+#include "StaticInstanceRuns.h"
 
 class zCMaterial;
 class zCPolygon;
@@ -36,6 +41,11 @@ struct ParticleInstanceInfo {
     float3 velocity;
 };
 
+/** Particles collected over a frame, grouped by texture. The maps live as long as GothicAPI, so only the
+    particle-lists inside, which are cleared every frame, come from the FrameArena. */
+typedef std::map<zCTexture*, FrameVector<ParticleInstanceInfo>> FrameParticleMap;
+typedef std::map<zCTexture*, ParticleRenderInfo> FrameParticleInfoMap;
+
 struct MeshKey {
     zCTexture* Texture;
     zCMaterial* Material;
@@ -49,6 +59,10 @@ struct cmpMeshKey {
     }
 };
 
+/** Clusters of the worldmesh, drawn out of the wrapped worldmesh-buffers */
+typedef TriangleClusterSet<const MeshKey*> WorldMeshClusterSet;
+typedef WorldMeshClusterSet::Range WorldMeshDrawRange;
+
 /*struct MeshKey
 {
     zCMaterial* Material;
@@ -89,6 +103,15 @@ struct VisualTesselationSettings {
     Buffer buffer;
 };
 
+/** Maximum number of simplified levels per static visual, besides the full mesh */
+const unsigned int MESH_MAX_LODS = 3;
+
+/** A simplified version of a mesh. Uses the vertexbuffer of the full mesh. */
+struct MeshLOD {
+    D3D11VertexBuffer* IndexBuffer;
+    unsigned int NumIndices;
+};
+
 /** Holds information about a mesh, ready to be loaded into the renderer */
 struct MeshInfo {
     MeshInfo() {
@@ -114,6 +137,9 @@ struct MeshInfo {
     std::vector<ExVertexStruct> VerticesPNAEN;
     unsigned int BaseIndexLocation;
     unsigned int MeshIndex;
+
+    /** Simplified levels of this mesh, LODs[0] is the first reduced one */
+    std::vector<MeshLOD> LODs;
 };
 
 struct WorldMeshInfo : public MeshInfo {
@@ -131,6 +157,9 @@ struct WorldMeshInfo : public MeshInfo {
 
     /** If true we will save an info-file on next zen-resource-save */
     bool SaveInfo;
+
+    /** Bodies of water of a water mesh, their ranges start at BaseIndexLocation. Empty for other meshes. */
+    std::vector<WaterBody> Bodies;
 };
 
 struct QuadMarkInfo {
@@ -227,9 +256,15 @@ struct MeshVisualInfo : public BaseVisualInfo {
     MeshVisualInfo() {
         Visual = nullptr;
         MorphMeshVisual = nullptr;
+        MorphVertices = nullptr;
         UnloadedSomething = false;
         StartInstanceNum = 0;
         FullMesh = nullptr;
+        NumLODs = 0;
+        InstanceCacheIndex = -1;
+        memset( LODErrors, 0, sizeof( LODErrors ) );
+        memset( LODInstanceStart, 0, sizeof( LODInstanceStart ) );
+        memset( LODInstanceCount, 0, sizeof( LODInstanceCount ) );
     }
 
     ~MeshVisualInfo() {
@@ -237,13 +272,31 @@ struct MeshVisualInfo : public BaseVisualInfo {
             zCObject_Release( MorphMeshVisual );
         }
         delete FullMesh;
+        delete MorphVertices;
     }
 
     /** Starts a new frame for this mesh */
     void StartNewFrame() {
         Instances.clear();
+        InstanceLODs.clear();
     }
 
+    /** Adds an instance to be drawn this frame with the given LOD */
+    void AddInstance( const VobInstanceInfo& instance, unsigned char lod = 0 ) {
+        Instances.push_back( instance );
+        InstanceLODs.push_back( lod );
+    }
+
+    /** Picks the LOD for an instance at the given distance. pixelScale converts world units at distance 1 into pixels.
+        Going to a coarser level needs some headroom, so instances don't flicker between two levels. */
+    unsigned char SelectLOD( float distance, float pixelScale, float maxPixelError, unsigned char currentLOD ) const;
+
+    /** Generates the simplified levels for all meshes, or loads them from the cache */
+    void CreateLODs();
+
+    /** Copies the instances of this frame grouped by LOD, and fills LODInstanceStart/-Count */
+    void WriteInstancesSortedByLOD( VobInstanceInfo* target );
+
     /** Creates PNAEN-Info for all meshes if not already there */
     void CreatePNAENInfo( bool softNormals = false );
 
@@ -256,12 +309,29 @@ struct MeshVisualInfo : public BaseVisualInfo {
     std::vector<VobInstanceInfo> Instances;
     unsigned int StartInstanceNum;
 
+    /** LOD of every instance in Instances */
+    std::vector<unsigned char> InstanceLODs;
+
+    /** Instances of each LOD after they were sorted into the instancing buffer, relative to StartInstanceNum */
+    unsigned int LODInstanceStart[MESH_MAX_LODS + 1];
+    unsigned int LODInstanceCount[MESH_MAX_LODS + 1];
+
+    /** Number of simplified levels and their geometric error in world units */
+    unsigned int NumLODs;
+    float LODErrors[MESH_MAX_LODS];
+
+    /** Index of this visual in the static instance cache, -1 if it has no instances there */
+    int InstanceCacheIndex;
+
     /** Full mesh of this */
     MeshInfo* FullMesh;
 
     /** This is true if we can't actually render something on this. TODO: Try to fix this! */
     bool UnloadedSomething;
     void* MorphMeshVisual;
+
+    /** Positions last uploaded for the morph mesh, created on its first update */
+    MorphMeshVertices* MorphVertices;
 };
 
 /** Holds the converted mesh of a VOB */
@@ -300,7 +370,8 @@ struct BaseVobInfo {
     zCVob* Vob;
 };
 
-struct WorldMeshSectionInfo;
+const unsigned int INSTANCE_SLOT_NONE = 0xFFFFFFFF;
+
 struct VobInfo : public BaseVobInfo {
     VobInfo() {
         //Vob = nullptr;
@@ -308,6 +379,9 @@ struct VobInfo : public BaseVobInfo {
         IsIndoorVob = false;
         VisibleInRenderPass = false;
         VobSection = nullptr;
+        CurrentLOD = 0;
+        InstanceSlot = INSTANCE_SLOT_NONE;
+        PortalCell = -1;
     }
 
     ~VobInfo() {
@@ -341,6 +415,15 @@ struct VobInfo : public BaseVobInfo {
 
     /** Color the underlaying polygon has */
     DWORD GroundColor;
+
+    /** LOD this vob was drawn with last time */
+    unsigned char CurrentLOD;
+
+    /** Slot in the static instance cache, INSTANCE_SLOT_NONE if the vob is collected through the BSP-Tree */
+    unsigned int InstanceSlot;
+
+    /** Cell of the portal-graph this indoor-vob is in, -1 if not looked up yet */
+    int PortalCell;
 };
 
 class zCVobLight;
@@ -424,21 +507,6 @@ struct SkeletalVobInfo : public BaseVobInfo {
     std::vector<BspInfo*> ParentBSPNodes;
 };
 
-struct SectionInstanceCache {
-    SectionInstanceCache() {
-
-    }
-
-    ~SectionInstanceCache();
-
-    /** Clears the cache for the given progmesh */
-    void ClearCacheForStatic( MeshVisualInfo* pm );
-
-    std::map<MeshVisualInfo*, std::vector<VS_ExConstantBuffer_PerInstance>> InstanceCacheData;
-    std::map<MeshVisualInfo*, D3D11VertexBuffer*> InstanceCache;
-
-};
-
 class D3D11Texture;
 
 /** Describes a world-section for the renderer */
@@ -447,6 +515,7 @@ struct WorldMeshSectionInfo {
         BoundingBox.Min = DirectX::XMFLOAT3( FLT_MAX, FLT_MAX, FLT_MAX );
         BoundingBox.Max = DirectX::XMFLOAT3( -FLT_MAX, -FLT_MAX, -FLT_MAX );
         FullStaticMesh = nullptr;
+        ShadowClustersBuilt = false;
     }
 
     ~WorldMeshSectionInfo() {
@@ -489,6 +558,9 @@ struct WorldMeshSectionInfo {
     /** Saves the mesh infos for this section */
     void LoadMeshInfos( const std::string& worldName, INT2 sectionPos );
 
+    /** Splits the worldmeshes into the clusters used by the pointlight shadows, if not done yet */
+    void BuildShadowClusters();
+
     std::map<MeshKey, WorldMeshInfo*, cmpMeshKey> WorldMeshes;
     std::map<D3D11Texture*, std::vector<MeshInfo*>> WorldMeshesByCustomTexture;
     std::map<zCMaterial*, std::vector<MeshInfo*>> WorldMeshesByCustomTextureOriginal;
@@ -510,7 +582,9 @@ struct WorldMeshSectionInfo {
     /** XY-Coord on the section array */
     INT2 WorldCoordinates;
 
-    SectionInstanceCache InstanceCache;
+    /** Worldmeshes split into small clusters, so shadows only need to draw what's in range */
+    WorldMeshClusterSet ShadowClusters;
+    bool ShadowClustersBuilt;
 
     unsigned int BaseIndexLocation;
     unsigned int NumIndices;
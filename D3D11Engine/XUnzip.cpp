@@ -4381,3 +4381,32 @@ bool IsZipHandleU(HZIP hz)
 }
 
 
+
+ZRESULT InflateRawMemory(const void *src, unsigned int srcLen, void *dst, unsigned int dstLen, unsigned long crc)
+{ if (src==0 || dst==0) return ZR_ARGS;
+
+  z_stream stream;
+  memset(&stream,0,sizeof(stream));
+  stream.next_in = (Byte*)src;
+  stream.avail_in = srcLen;
+  stream.next_out = (Byte*)dst;
+  stream.avail_out = dstLen;
+
+  if (inflateInit2(&stream)!=Z_OK) return ZR_NOALLOC;
+
+  int err = Z_OK;
+  while (err==Z_OK)
+  { uLong before = stream.total_out + stream.total_in;
+    err = inflate(&stream,Z_SYNC_FLUSH);
+    if (err==Z_OK && stream.total_out + stream.total_in == before) break; // no progress
+  }
+  uLong written = stream.total_out;
+  inflateEnd(&stream);
+
+  // Raw streams may want a dummy byte to report Z_STREAM_END, so the
+  // known size is what counts here. The crc catches everything else.
+  if (err!=Z_STREAM_END && err!=Z_OK && err!=Z_BUF_ERROR) return ZR_FLATE;
+  if (written!=dstLen) return ZR_CORRUPT;
+  if (ucrc32(0,(const Byte*)dst,dstLen)!=crc) return ZR_CORRUPT;
+  return ZR_OK;
+}
@@ -248,6 +248,25 @@ ZRESULT UnzipItem(HZIP hz, int index, void *dst, unsigned int len, DWORD flags);
 // and it emits 0 bytes.
 
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// InflateRawMemory()
+//
+// Purpose:     Inflate a single raw deflate stream, as stored inside a zip
+//              entry, from memory to memory. Doesn't need an open zip handle
+//              and keeps no global state, so it can run on several threads.
+//
+// Parameters:  src     - compressed data
+//              srcLen  - size of the compressed data
+//              dst     - receives the uncompressed data
+//              dstLen  - exact uncompressed size, from the central directory
+//              crc     - expected crc32 of the uncompressed data
+//
+// Returns:     ZRESULT - ZR_OK if success, otherwise some other value
+//
+ZRESULT InflateRawMemory(const void *src, unsigned int srcLen, void *dst, unsigned int dstLen, unsigned long crc);
+
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // CloseZip()
@@ -0,0 +1,369 @@
+#include "ZipFileSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
+#include <functional>
+#include "ThreadPool.h"
+
+namespace {
+    const uint32_t ZIP_LOCAL_HEADER_SIGNATURE = 0x04034b50;
+    const uint32_t ZIP_CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+    const uint32_t ZIP_END_OF_DIRECTORY_SIGNATURE = 0x06054b50;
+
+    const size_t ZIP_LOCAL_HEADER_SIZE = 30;
+    const size_t ZIP_CENTRAL_HEADER_SIZE = 46;
+    const size_t ZIP_END_OF_DIRECTORY_SIZE = 22;
+    const size_t ZIP_MAX_COMMENT_SIZE = 0xFFFF;
+
+    const uint16_t ZIP_METHOD_STORED = 0;
+    const uint16_t ZIP_METHOD_DEFLATED = 8;
+    const uint16_t ZIP_FLAG_ENCRYPTED = 1;
+
+    /** Files bigger than this fraction of the budget are never cached */
+    const size_t CACHE_MAX_FILE_FRACTION = 4;
+
+    uint16_t Read16( const uint8_t* p ) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+    uint32_t Read32( const uint8_t* p ) { return static_cast<uint32_t>(p[0] | (p[1] << 8) | (p[2] << 16)) | (static_cast<uint32_t>(p[3]) << 24); }
+}
+
+ZipFileSystem::ZipFileSystem( ZipInflateFunction inflate, size_t cacheBudget ) {
+    Inflate = inflate;
+    CacheSize = 0;
+    CacheBudget = cacheBudget;
+}
+
+ZipFileSystem::~ZipFileSystem() {
+    ClearCache();
+}
+
+/** Indexes the given archive. Files of later archives override the ones of earlier archives. */
+bool ZipFileSystem::Mount( const std::string& zip ) {
+    auto archive = std::make_unique<MemoryMappedFile>();
+    if ( !archive->Open( zip ) ) {
+        MountLog.push_back( "Failed to open zip-archive '" + zip + "'" );
+        return false;
+    }
+
+    const uint8_t* data = archive->GetData();
+    const size_t size = archive->GetSize();
+    if ( size < ZIP_END_OF_DIRECTORY_SIZE ) {
+        MountLog.push_back( "'" + zip + "' is not a zip-archive" );
+        return false;
+    }
+
+    // The end of central directory record sits behind a comment of unknown length, search it backwards
+    const uint8_t* eocd = nullptr;
+    size_t searchEnd = size > ZIP_END_OF_DIRECTORY_SIZE + ZIP_MAX_COMMENT_SIZE ? size - ZIP_END_OF_DIRECTORY_SIZE - ZIP_MAX_COMMENT_SIZE : 0;
+    for ( size_t i = size - ZIP_END_OF_DIRECTORY_SIZE + 1; i-- > searchEnd; ) {
+        if ( Read32( data + i ) == ZIP_END_OF_DIRECTORY_SIGNATURE ) {
+            eocd = data + i;
+            break;
+        }
+    }
+
+    if ( !eocd ) {
+        MountLog.push_back( "'" + zip + "' is not a zip-archive" );
+        return false;
+    }
+
+    const uint16_t numEntries = Read16( eocd + 10 );
+    const uint32_t directorySize = Read32( eocd + 12 );
+    const uint32_t directoryOffset = Read32( eocd + 16 );
+    if ( numEntries == 0xFFFF || directoryOffset == 0xFFFFFFFF ) {
+        MountLog.push_back( "'" + zip + "' is a ZIP64-archive, which is not supported" );
+        return false;
+    }
+
+    if ( static_cast<uint64_t>(directoryOffset) + directorySize > size ) {
+        MountLog.push_back( "Zip-archive '" + zip + "' has a broken central directory" );
+        return false;
+    }
+
+    // Nothing is taken over before the whole directory was read
+    const uint32_t archiveIndex = static_cast<uint32_t>(Archives.size());
+    const uint8_t* p = data + directoryOffset;
+    const uint8_t* directoryEnd = p + directorySize;
+    std::vector<std::pair<std::string, Entry>> entries;
+    for ( uint16_t i = 0; i < numEntries; i++ ) {
+        if ( p + ZIP_CENTRAL_HEADER_SIZE > directoryEnd || Read32( p ) != ZIP_CENTRAL_HEADER_SIGNATURE ) {
+            MountLog.push_back( "Zip-archive '" + zip + "' has a broken central directory" );
+            return false;
+        }
+
+        const uint16_t nameLength = Read16( p + 28 );
+        const size_t headerSize = ZIP_CENTRAL_HEADER_SIZE + nameLength + Read16( p + 30 ) + Read16( p + 32 );
+        if ( p + headerSize > directoryEnd ) {
+            MountLog.push_back( "Zip-archive '" + zip + "' has a broken central directory" );
+            return false;
+        }
+
+        Entry entry;
+        entry.Archive = archiveIndex;
+        entry.Method = Read16( p + 10 );
+        entry.Crc = Read32( p + 16 );
+        entry.CompressedSize = Read32( p + 20 );
+        entry.UncompressedSize = Read32( p + 24 );
+        entry.LocalHeaderOffset = Read32( p + 42 );
+
+        const uint16_t flags = Read16( p + 8 );
+        std::string name = NormalizePath( std::string( reinterpret_cast<const char*>(p + ZIP_CENTRAL_HEADER_SIZE), nameLength ) );
+        p += headerSize;
+
+        // Directories only show up through the files inside them
+        if ( name.empty() || name.back() == '\\' )
+            continue;
+
+        if ( (flags & ZIP_FLAG_ENCRYPTED) || (entry.Method != ZIP_METHOD_STORED && entry.Method != ZIP_METHOD_DEFLATED) ) {
+            MountLog.push_back( "Skipping '" + name + "' in '" + zip + "': Encrypted or unsupported compression method " + std::to_string( entry.Method ) );
+            continue;
+        }
+
+        if ( static_cast<uint64_t>(entry.LocalHeaderOffset) + ZIP_LOCAL_HEADER_SIZE + entry.CompressedSize > size
+            || (entry.Method == ZIP_METHOD_STORED && entry.CompressedSize != entry.UncompressedSize) ) {
+            MountLog.push_back( "Skipping broken entry '" + name + "' in '" + zip + "'" );
+            continue;
+        }
+
+        entries.emplace_back( std::move( name ), entry );
+    }
+
+    for ( const auto& it : entries ) {
+        const std::string& name = it.first;
+        for ( size_t slash = name.find( '\\' ); slash != std::string::npos; slash = name.find( '\\', slash + 1 ) ) {
+            Folders.insert( name.substr( 0, slash ) );
+        }
+
+        Files[name] = it.second;
+    }
+
+    Archives.push_back( std::move( archive ) );
+
+    // Older versions of overridden files may still be in the cache
+    ClearCache();
+
+    MountLog.push_back( "Mounted zip-archive '" + zip + "' with " + std::to_string( entries.size() ) + " files" );
+    return true;
+}
+
+/** Mounts all .zip-files in the given folder in alphabetical order. Returns the number of mounted archives. */
+int ZipFileSystem::MountFolder( const std::string& folder ) {
+    std::error_code ec;
+    std::vector<std::string> zips;
+    for ( const auto& it : std::filesystem::directory_iterator( folder, ec ) ) {
+        if ( !it.is_regular_file() )
+            continue;
+
+        std::string extension = it.path().extension().string();
+        std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+        if ( extension == ".zip" )
+            zips.push_back( it.path().string() );
+    }
+
+    std::sort( zips.begin(), zips.end() );
+
+    int numMounted = 0;
+    for ( const std::string& zip : zips ) {
+        if ( Mount( zip ) )
+            numMounted++;
+    }
+
+    return numMounted;
+}
+
+/** Returns whether the given file is in any of the mounted archives */
+bool ZipFileSystem::Exists( const std::string& path ) const {
+    return Files.find( NormalizePath( path ) ) != Files.end();
+}
+
+/** Returns whether at least one file is stored below the given folder */
+bool ZipFileSystem::FolderExists( const std::string& folder ) const {
+    std::string normalized = NormalizePath( folder );
+    while ( !normalized.empty() && normalized.back() == '\\' )
+        normalized.pop_back();
+
+    return Folders.find( normalized ) != Folders.end();
+}
+
+/** Reads the given file. Returns an invalid ZipFile if it doesn't exist or is broken. */
+ZipFile ZipFileSystem::ReadFile( const std::string& path ) {
+    std::string normalized = NormalizePath( path );
+    auto it = Files.find( normalized );
+    if ( it == Files.end() )
+        return ZipFile();
+
+    return ReadEntry( normalized, it->second );
+}
+
+/** Reads all given files, inflating them in parallel on the pool */
+std::vector<ZipFile> ZipFileSystem::ReadFiles( const std::vector<std::string>& paths, ThreadPool* pool ) {
+    std::vector<ZipFile> result( paths.size() );
+
+    // Stored and cached files are just a lookup, only the inflates are worth sharing out
+    std::vector<std::pair<std::string, const Entry*>> toInflate;
+    std::vector<size_t> toInflateIndex;
+    for ( size_t i = 0; i < paths.size(); i++ ) {
+        std::string normalized = NormalizePath( paths[i] );
+        auto it = Files.find( normalized );
+        if ( it == Files.end() )
+            continue;
+
+        const Entry& entry = it->second;
+        if ( entry.Method == ZIP_METHOD_STORED || entry.UncompressedSize == 0 || FindCached( normalized, result[i] ) ) {
+            if ( !result[i].IsValid() )
+                result[i] = ReadEntry( normalized, entry );
+            continue;
+        }
+
+        toInflate.emplace_back( std::move( normalized ), &entry );
+        toInflateIndex.push_back( i );
+    }
+
+    size_t numHelpers = pool && toInflate.size() > 1 ? std::min( pool->getNumThreads(), toInflate.size() - 1 ) : 0;
+    if ( !numHelpers ) {
+        for ( size_t i = 0; i < toInflate.size(); i++ ) {
+            result[toInflateIndex[i]] = ReadEntry( toInflate[i].first, *toInflate[i].second );
+        }
+        return result;
+    }
+
+    // Same scheme as TextureProcessing::CompressImage: files are handed out one by one and the
+    // caller works along, so nothing waits on a helper that hasn't started yet. Helpers starting
+    // late only find the job done, so it is shared.
+    struct Job {
+        std::function<void( size_t )> ReadOne;
+        size_t NumFiles;
+        std::atomic<size_t> NextFile;
+        std::atomic<size_t> FilesDone;
+    };
+
+    auto job = std::make_shared<Job>();
+    job->ReadOne = [this, &toInflate, &toInflateIndex, &result]( size_t i ) {
+        result[toInflateIndex[i]] = ReadEntry( toInflate[i].first, *toInflate[i].second );
+    };
+    job->NumFiles = toInflate.size();
+    job->NextFile = 0;
+    job->FilesDone = 0;
+
+    auto work = []( Job& j ) {
+        for ( size_t i = j.NextFile++; i < j.NumFiles; i = j.NextFile++ ) {
+            j.ReadOne( i );
+            j.FilesDone++;
+        }
+    };
+
+    for ( size_t i = 0; i < numHelpers; i++ ) {
+        pool->enqueue( [job, work]() { work( *job ); } );
+    }
+
+    work( *job );
+    while ( job->FilesDone.load() < job->NumFiles ) {
+        std::this_thread::yield();
+    }
+
+    return result;
+}
+
+/** Frees all cached files */
+void ZipFileSystem::ClearCache() {
+    std::lock_guard<std::mutex> lock( CacheMutex );
+    Cache.clear();
+    CacheOrder.clear();
+    CacheSize = 0;
+}
+
+/** Converts a path into the form used for the index: uppercase, backslashes and no leading ".\\" */
+std::string ZipFileSystem::NormalizePath( const std::string& path ) {
+    std::string normalized = path;
+    for ( char& c : normalized ) {
+        if ( c == '/' )
+            c = '\\';
+        else
+            c = static_cast<char>(toupper( static_cast<unsigned char>(c) ));
+    }
+
+    while ( normalized.compare( 0, 2, ".\\" ) == 0 )
+        normalized.erase( 0, 2 );
+
+    return normalized;
+}
+
+/** Resolves the entry to the compressed data inside the mapped archive */
+const uint8_t* ZipFileSystem::GetEntryData( const Entry& entry ) const {
+    const MemoryMappedFile& archive = *Archives[entry.Archive];
+    const uint8_t* header = archive.GetData() + entry.LocalHeaderOffset;
+    if ( Read32( header ) != ZIP_LOCAL_HEADER_SIGNATURE )
+        return nullptr;
+
+    // The local header can have a different extra-field than the central one
+    uint64_t dataOffset = static_cast<uint64_t>(entry.LocalHeaderOffset) + ZIP_LOCAL_HEADER_SIZE + Read16( header + 26 ) + Read16( header + 28 );
+    if ( dataOffset + entry.CompressedSize > archive.GetSize() )
+        return nullptr;
+
+    return archive.GetData() + dataOffset;
+}
+
+/** Reads an already looked up entry */
+ZipFile ZipFileSystem::ReadEntry( const std::string& normalizedPath, const Entry& entry ) {
+    ZipFile file;
+    const uint8_t* data = GetEntryData( entry );
+    if ( !data )
+        return file;
+
+    // Empty files have nothing to inflate
+    if ( entry.Method == ZIP_METHOD_STORED || entry.UncompressedSize == 0 ) {
+        file.Data = data;
+        file.Size = entry.UncompressedSize;
+        return file;
+    }
+
+    if ( FindCached( normalizedPath, file ) )
+        return file;
+
+    auto buffer = std::make_shared<std::vector<uint8_t>>( entry.UncompressedSize );
+    if ( !Inflate( data, entry.CompressedSize, buffer->data(), entry.UncompressedSize, entry.Crc ) )
+        return file;
+
+    AddCached( normalizedPath, buffer );
+
+    file.Buffer = buffer;
+    file.Data = buffer->data();
+    file.Size = entry.UncompressedSize;
+    return file;
+}
+
+bool ZipFileSystem::FindCached( const std::string& normalizedPath, ZipFile& file ) {
+    std::lock_guard<std::mutex> lock( CacheMutex );
+    auto it = Cache.find( normalizedPath );
+    if ( it == Cache.end() )
+        return false;
+
+    CacheOrder.splice( CacheOrder.begin(), CacheOrder, it->second.Position );
+
+    file.Buffer = it->second.Buffer;
+    file.Data = file.Buffer->data();
+    file.Size = static_cast<uint32_t>(file.Buffer->size());
+    return true;
+}
+
+void ZipFileSystem::AddCached( const std::string& normalizedPath, const std::shared_ptr<const std::vector<uint8_t>>& buffer ) {
+    if ( buffer->size() > CacheBudget / CACHE_MAX_FILE_FRACTION )
+        return;
+
+    std::lock_guard<std::mutex> lock( CacheMutex );
+
+    // Another thread may have inflated the same file in the meantime
+    if ( Cache.find( normalizedPath ) != Cache.end() )
+        return;
+
+    CacheOrder.push_front( normalizedPath );
+    Cache[normalizedPath] = { buffer, CacheOrder.begin() };
+    CacheSize += buffer->size();
+
+    while ( CacheSize > CacheBudget && !CacheOrder.empty() ) {
+        auto oldest = Cache.find( CacheOrder.back() );
+        CacheSize -= oldest->second.Buffer->size();
+        Cache.erase( oldest );
+        CacheOrder.pop_back();
+    }
+}
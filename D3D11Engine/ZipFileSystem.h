@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "MemoryMappedFile.h"
+
+class ThreadPool;
+
+/** Inflates a raw deflate-stream of a zip-entry into dst, which has to come out at exactly dstSize
+    bytes with the given crc. Has to be safe to call from several threads at once. */
+typedef bool( *ZipInflateFunction )( const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstSize, uint32_t crc );
+
+/** A file served out of a mounted zip-archive. Stored entries point straight into the mapped
+    archive, deflated ones keep their decompressed buffer alive through Buffer. */
+struct ZipFile {
+    ZipFile() {
+        Data = nullptr;
+        Size = 0;
+    }
+
+    bool IsValid() const { return Data != nullptr; }
+
+    const uint8_t* Data;
+    uint32_t Size;
+    std::shared_ptr<const std::vector<uint8_t>> Buffer;
+};
+
+/** Read-only virtual file system on top of zip-archives
+
+    Archives are mapped once and only their central directory is indexed. Files are then read
+    by their path relative to the game directory, e.g. "system\\GD3D11\\textures\\...",
+    without extracting anything to disk. Recently decompressed files are kept in a small LRU-cache.
+
+    Mounting is not thread safe and should happen at startup, reading is, so files can be
+    inflated on several threads, batches of files also in parallel on a pool. Doesn't know
+    anything about the engine and gets the inflater handed in, so it can be tested on its own. */
+class ZipFileSystem {
+public:
+    ZipFileSystem( ZipInflateFunction inflate, size_t cacheBudget = DEFAULT_CACHE_BUDGET );
+    ~ZipFileSystem();
+
+    /** Default amount of decompressed data kept in the cache */
+    static const size_t DEFAULT_CACHE_BUDGET = 64 * 1024 * 1024;
+
+    /** Indexes the given archive. Files of later archives override the ones of earlier archives. */
+    bool Mount( const std::string& zip );
+
+    /** Mounts all .zip-files in the given folder in alphabetical order. Returns the number of mounted archives. */
+    int MountFolder( const std::string& folder );
+
+    /** Returns what happened while mounting, broken archives and skipped entries, for the log */
+    const std::vector<std::string>& GetMountLog() const { return MountLog; }
+
+    /** Returns whether the given file is in any of the mounted archives */
+    bool Exists( const std::string& path ) const;
+
+    /** Returns whether at least one file is stored below the given folder */
+    bool FolderExists( const std::string& folder ) const;
+
+    /** Reads the given file. Returns an invalid ZipFile if it doesn't exist or is broken. */
+    ZipFile ReadFile( const std::string& path );
+
+    /** Reads all given files, inflating them in parallel on the pool, or one by one without one.
+        The result has one entry per path, invalid for the ones that can't be read.
+        Can also be called from a thread of the pool itself. */
+    std::vector<ZipFile> ReadFiles( const std::vector<std::string>& paths, ThreadPool* pool );
+
+    /** Returns the number of files in all mounted archives */
+    size_t GetNumFiles() const { return Files.size(); }
+
+    /** Frees all cached files */
+    void ClearCache();
+
+    /** Converts a path into the form used for the index: uppercase, backslashes and no leading ".\\" */
+    static std::string NormalizePath( const std::string& path );
+
+private:
+    struct Entry {
+        uint32_t Archive;
+        uint32_t LocalHeaderOffset;
+        uint32_t CompressedSize;
+        uint32_t UncompressedSize;
+        uint32_t Crc;
+        uint16_t Method;
+    };
+
+    /** Resolves the entry to the compressed data inside the mapped archive */
+    const uint8_t* GetEntryData( const Entry& entry ) const;
+
+    /** Reads an already looked up entry */
+    ZipFile ReadEntry( const std::string& normalizedPath, const Entry& entry );
+
+    /** Cache handling, both lock CacheMutex */
+    bool FindCached( const std::string& normalizedPath, ZipFile& file );
+    void AddCached( const std::string& normalizedPath, const std::shared_ptr<const std::vector<uint8_t>>& buffer );
+
+    ZipInflateFunction Inflate;
+    std::vector<std::string> MountLog;
+
+    std::vector<std::unique_ptr<MemoryMappedFile>> Archives;
+    std::unordered_map<std::string, Entry> Files;
+    std::unordered_set<std::string> Folders;
+
+    /** LRU-cache of decompressed files, front is the most recently used */
+    struct CacheEntry {
+        std::shared_ptr<const std::vector<uint8_t>> Buffer;
+        std::list<std::string>::iterator Position;
+    };
+
+    std::mutex CacheMutex;
+    std::list<std::string> CacheOrder;
+    std::unordered_map<std::string, CacheEntry> Cache;
+    size_t CacheSize;
+    size_t CacheBudget;
+};
@@ -0,0 +1,233 @@
+/** Checks DynamicAABBTree against brute force and measures the queries
+
+    Random boxes are added, moved and removed, and after every step all kinds of queries are compared
+    against a plain loop over all boxes. Then the queries are timed on a world-sized set of boxes. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "DynamicAABBTree.h"
+
+namespace {
+    typedef DynamicAABBTree<int> Tree;
+
+    struct Box {
+        float Min[3];
+        float Max[3];
+        int Proxy;
+        bool Alive;
+    };
+
+    std::mt19937 Rng( 1 );
+
+    float Rand( float a, float b ) {
+        return std::uniform_real_distribution<float>( a, b )( Rng );
+    }
+
+    void RandomBox( Box& b ) {
+        for ( int a = 0; a < 3; a++ ) {
+            const float c = Rand( -20000.0f, 20000.0f );
+            const float e = Rand( 50.0f, 2000.0f );
+            b.Min[a] = c - e;
+            b.Max[a] = c + e;
+        }
+    }
+
+    /** Planes of a box-shaped "frustum", facing inwards */
+    void RandomFrustum( Tree::Plane planes[4] ) {
+        for ( int i = 0; i < 4; i++ ) {
+            float n[3] = { Rand( -1, 1 ), Rand( -1, 1 ), Rand( -1, 1 ) };
+            for ( int a = 0; a < 3; a++ ) {
+                planes[i].Normal[a] = n[a];
+            }
+            planes[i].Distance = Rand( -10000.0f, 10000.0f );
+        }
+    }
+
+    bool BoxInFrustum( const Box& b, const Tree::Plane* planes, int numPlanes ) {
+        for ( int i = 0; i < numPlanes; i++ ) {
+            float d = 0.0f;
+            for ( int a = 0; a < 3; a++ ) {
+                d += planes[i].Normal[a] * (planes[i].Normal[a] >= 0.0f ? b.Max[a] : b.Min[a]);
+            }
+
+            if ( d < planes[i].Distance )
+                return false;
+        }
+        return true;
+    }
+
+    template <typename F>
+    double MeasureMs( F f ) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+
+    /** Compares all queries against brute force, returns the number of mismatches */
+    size_t CheckQueries( const Tree& tree, const std::vector<Box>& boxes, int numQueries ) {
+        size_t numErrors = 0;
+        std::vector<int> found, expected;
+
+        for ( int q = 0; q < numQueries; q++ ) {
+            // Sphere
+            const float center[3] = { Rand( -20000, 20000 ), Rand( -20000, 20000 ), Rand( -20000, 20000 ) };
+            const float radius = Rand( 100.0f, 5000.0f );
+
+            found.clear();
+            expected.clear();
+            tree.QuerySphere( center, radius, [&]( int i ) { found.push_back( i ); } );
+            for ( size_t i = 0; i < boxes.size(); i++ ) {
+                if ( boxes[i].Alive && Tree::SphereIntersectsBox( center, radius, boxes[i].Min, boxes[i].Max ) )
+                    expected.push_back( static_cast<int>(i) );
+            }
+
+            std::sort( found.begin(), found.end() );
+            numErrors += found != expected;
+
+            // Box
+            Box query;
+            RandomBox( query );
+            found.clear();
+            expected.clear();
+            tree.QueryBox( query.Min, query.Max, [&]( int i ) { found.push_back( i ); } );
+            for ( size_t i = 0; i < boxes.size(); i++ ) {
+                if ( boxes[i].Alive && Tree::Overlaps( query.Min, query.Max, boxes[i].Min, boxes[i].Max ) )
+                    expected.push_back( static_cast<int>(i) );
+            }
+
+            std::sort( found.begin(), found.end() );
+            numErrors += found != expected;
+
+            // Frustum
+            Tree::Plane planes[4];
+            RandomFrustum( planes );
+            found.clear();
+            expected.clear();
+            tree.QueryFrustum( planes, 4, [&]( int i ) { found.push_back( i ); } );
+            for ( size_t i = 0; i < boxes.size(); i++ ) {
+                if ( boxes[i].Alive && BoxInFrustum( boxes[i], planes, 4 ) )
+                    expected.push_back( static_cast<int>(i) );
+            }
+
+            std::sort( found.begin(), found.end() );
+            numErrors += found != expected;
+
+            // Closest ray hit
+            const float dir[3] = { Rand( -1, 1 ), Rand( -1, 1 ), Rand( -1, 1 ) };
+            float invDir[3] = { 1.0f / dir[0], 1.0f / dir[1], 1.0f / dir[2] };
+
+            float closest = 3.402823466e+38f;
+            int closestBox = -1;
+            tree.QueryRay( center, dir, closest, [&]( int i, float t ) {
+                if ( t < closest ) {
+                    closest = t;
+                    closestBox = i;
+                }
+                return closest;
+            } );
+
+            float expectedT = 3.402823466e+38f;
+            for ( size_t i = 0; i < boxes.size(); i++ ) {
+                float t;
+                if ( boxes[i].Alive && Tree::IntersectRay( boxes[i].Min, boxes[i].Max, center, invDir, t ) && t < expectedT )
+                    expectedT = t;
+            }
+
+            numErrors += expectedT != closest;
+        }
+
+        return numErrors;
+    }
+}
+
+int main() {
+    size_t numErrors = 0;
+
+    // Random edits, checked against brute force
+    {
+        Tree tree;
+        std::vector<Box> boxes;
+        for ( int step = 0; step < 2000; step++ ) {
+            const int op = std::uniform_int_distribution<int>( 0, 9 )( Rng );
+            std::vector<size_t> alive;
+            for ( size_t i = 0; i < boxes.size(); i++ ) {
+                if ( boxes[i].Alive )
+                    alive.push_back( i );
+            }
+
+            if ( op < 5 || alive.empty() ) {
+                Box b;
+                RandomBox( b );
+                b.Alive = true;
+                b.Proxy = tree.Insert( b.Min, b.Max, static_cast<int>(boxes.size()) );
+                boxes.push_back( b );
+            } else if ( op < 8 ) {
+                Box& b = boxes[alive[Rng() % alive.size()]];
+                RandomBox( b );
+                tree.Move( b.Proxy, b.Min, b.Max );
+            } else {
+                Box& b = boxes[alive[Rng() % alive.size()]];
+                tree.Remove( b.Proxy );
+                b.Alive = false;
+            }
+
+            if ( step % 50 == 0 )
+                numErrors += CheckQueries( tree, boxes, 20 );
+        }
+
+        numErrors += CheckQueries( tree, boxes, 200 );
+        printf( "%zu boxes after random edits, height %d, %zu mismatches\n", tree.Size(), tree.GetHeight(), numErrors );
+    }
+
+    // Timings
+    Tree tree;
+    std::vector<Box> boxes( 20000 );
+    double buildMs = MeasureMs( [&]() {
+        for ( size_t i = 0; i < boxes.size(); i++ ) {
+            RandomBox( boxes[i] );
+            boxes[i].Alive = true;
+            boxes[i].Proxy = tree.Insert( boxes[i].Min, boxes[i].Max, static_cast<int>(i) );
+        }
+    } );
+
+    const int numQueries = 1000;
+    std::vector<float> rays( numQueries * 6 );
+    for ( float& f : rays ) {
+        f = Rand( -20000, 20000 );
+    }
+
+    int sink = 0;
+    double treeMs = MeasureMs( [&]() {
+        for ( int q = 0; q < numQueries; q++ ) {
+            float closest = 3.402823466e+38f;
+            tree.QueryRay( &rays[q * 6], &rays[q * 6 + 3], closest, [&]( int i, float t ) { sink += i; return closest = std::min( closest, t ); } );
+        }
+    } );
+
+    double bruteMs = MeasureMs( [&]() {
+        for ( int q = 0; q < numQueries; q++ ) {
+            const float* d = &rays[q * 6 + 3];
+            const float invDir[3] = { 1.0f / d[0], 1.0f / d[1], 1.0f / d[2] };
+            float closest = 3.402823466e+38f;
+            for ( const Box& b : boxes ) {
+                float t;
+                if ( Tree::IntersectRay( b.Min, b.Max, &rays[q * 6], invDir, t ) && t < closest ) {
+                    closest = t;
+                    sink++;
+                }
+            }
+        }
+    } );
+
+    printf( "%zu boxes, height %d, built in %.2f ms\n", tree.Size(), tree.GetHeight(), buildMs );
+    printf( "%d closest-ray queries: tree %.2f ms, brute force %.2f ms\n", numQueries, treeMs, bruteMs );
+
+    // Keeps the loops from being optimized away
+    if ( sink == 42 )
+        printf( "\n" );
+
+    return numErrors ? 1 : 0;
+}
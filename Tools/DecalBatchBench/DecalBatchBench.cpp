@@ -0,0 +1,353 @@
+/** Checks the decal grid, batching and instance matrices and shows what they save over one draw call per decal
+
+    The SIMD matrices are compared to the straight multiplications the single draw calls used, for
+    all alignments. The grid is filled, moved around and emptied again, every sphere query has to
+    return the same decals as looking at all of them. The batches have to contain every decal once,
+    with the alpha-blended ones last and back to front. Then a world full of decals is drawn from
+    random spots, once like before by scanning and sorting all decals, once with the grid and batches. */
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+#include "DecalBatcher.h"
+#include "SpatialHashGrid.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    // Same values as zMAT_ALPHA_FUNC_*
+    const int ALPHA_NONE = 1;
+    const int ALPHA_BLEND = 2;
+    const int ALPHA_ADD = 3;
+    const int ALPHA_MUL = 5;
+    const int ALPHA_MUL2 = 6;
+
+    float Random( float min, float max ) {
+        return std::uniform_real_distribution<float>( min, max )(Rng);
+    }
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            if ( NumErrors < 10 ) {
+                printf( "FAILED: %s\n", what );
+            }
+            NumErrors++;
+        }
+    }
+
+    /** View-matrix with the translation in the fourth column, like GetViewMatrixXM */
+    void RandomView( float v[16], float cameraPosition[3] ) {
+        float yaw = Random( -3.14f, 3.14f );
+        float c = cosf( yaw );
+        float s = sinf( yaw );
+        for ( int a = 0; a < 3; a++ ) {
+            cameraPosition[a] = Random( -20000.0f, 20000.0f );
+        }
+
+        float right[3] = { c, 0.0f, -s };
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+        float forward[3] = { s, 0.0f, c };
+        const float* axes[3] = { right, up, forward };
+        for ( int r = 0; r < 3; r++ ) {
+            v[r * 4 + 0] = axes[r][0];
+            v[r * 4 + 1] = axes[r][1];
+            v[r * 4 + 2] = axes[r][2];
+            v[r * 4 + 3] = -(axes[r][0] * cameraPosition[0] + axes[r][1] * cameraPosition[1] + axes[r][2] * cameraPosition[2]);
+        }
+        v[12] = 0.0f; v[13] = 0.0f; v[14] = 0.0f; v[15] = 1.0f;
+    }
+
+    DecalInstanceInput RandomDecal( const std::vector<int>& materials, float worldSize ) {
+        static const int alphaFuncs[] = { ALPHA_BLEND, ALPHA_ADD, ALPHA_MUL, ALPHA_MUL2 };
+
+        DecalInstanceInput d;
+        d.Material = &materials[Rng() % materials.size()];
+        d.AlphaFunc = alphaFuncs[Rng() % 4];
+        d.Alignment = static_cast<int>(Rng() % 3);
+        d.Distance = 0.0f;
+
+        // Rotation around Y, with the translation in the fourth column
+        float yaw = Random( -3.14f, 3.14f );
+        float c = cosf( yaw );
+        float s = sinf( yaw );
+        float w[16] = { c, 0, s, 0, 0, 1, 0, 0, -s, 0, c, 0, 0, 0, 0, 1 };
+        std::copy( w, w + 16, d.World );
+        for ( int a = 0; a < 3; a++ ) {
+            d.Position[a] = Random( -worldSize, worldSize );
+            d.World[a * 4 + 3] = d.Position[a];
+        }
+        d.Position[1] *= 0.05f;
+        d.World[7] = d.Position[1];
+
+        d.Size[0] = Random( 5.0f, 100.0f );
+        d.Size[1] = Random( 5.0f, 100.0f );
+        d.Offset[0] = Random( -0.01f, 0.01f );
+        d.Offset[1] = Random( -0.01f, 0.01f );
+        return d;
+    }
+
+    void CheckMatrices() {
+        std::vector<int> materials( 4 );
+        std::vector<DecalInstanceInput> decals;
+        for ( int i = 0; i < 3000; i++ ) {
+            decals.push_back( RandomDecal( materials, 20000.0f ) );
+        }
+
+        std::vector<uint32_t> order( decals.size() );
+        for ( size_t i = 0; i < order.size(); i++ ) {
+            order[i] = static_cast<uint32_t>(order.size() - 1 - i);
+        }
+
+        float view[16];
+        float cameraPosition[3];
+        RandomView( view, cameraPosition );
+
+        // Same layout as VobInstanceInfo: matrix, color, padding
+        const size_t stride = 80;
+        std::vector<unsigned char> out( stride * decals.size(), 0xCD );
+        DecalInstancing::WriteInstanceMatrices( decals.data(), order.data(), order.size(), view, cameraPosition, out.data(), stride );
+
+        for ( size_t i = 0; i < order.size(); i++ ) {
+            float reference[16];
+            DecalInstancing::ComputeInstanceMatrixReference( decals[order[i]], view, cameraPosition, reference );
+
+            const float* m = reinterpret_cast<const float*>(&out[i * stride]);
+            bool ok = true;
+            for ( int r = 0; r < 4; r++ ) {
+                for ( int c = 0; c < 4; c++ ) {
+                    float a = m[c * 4 + r];
+                    float b = reference[r * 4 + c];
+                    ok &= fabsf( a - b ) <= 1e-3f + fabsf( b ) * 1e-5f;
+                }
+            }
+            Check( ok, "SIMD instance matrix matches the reference" );
+            Check( out[i * stride + 64] == 0xCD, "only the matrix is written" );
+        }
+    }
+
+    void CheckGrid() {
+        SpatialHashGrid<int> grid( 1000.0f );
+        std::vector<std::pair<bool, std::array<float, 3>>> objects( 2000 );
+
+        auto randomPosition = [&]() {
+            return std::array<float, 3>{ Random( -30000.0f, 30000.0f ), Random( -1000.0f, 1000.0f ), Random( -30000.0f, 30000.0f ) };
+        };
+
+        for ( int step = 0; step < 20000; step++ ) {
+            int i = static_cast<int>(Rng() % objects.size());
+            int op = static_cast<int>(Rng() % 10);
+            if ( op < 5 ) {
+                // Small moves mostly stay inside their cell
+                std::array<float, 3> p = objects[i].first && op < 3 ? objects[i].second : randomPosition();
+                p[0] += Random( -50.0f, 50.0f );
+                p[2] += Random( -50.0f, 50.0f );
+                grid.Insert( i, p.data() );
+                objects[i] = { true, p };
+            } else if ( op < 8 ) {
+                std::array<float, 3> p = randomPosition();
+                Check( grid.Move( i, p.data() ) == objects[i].first, "Move only works on contained objects" );
+                if ( objects[i].first ) {
+                    objects[i].second = p;
+                }
+            } else {
+                Check( grid.Remove( i ) == objects[i].first, "Remove only works on contained objects" );
+                objects[i].first = false;
+            }
+
+            if ( step % 100 == 0 ) {
+                float center[3] = { Random( -35000.0f, 35000.0f ), Random( -500.0f, 500.0f ), Random( -35000.0f, 35000.0f ) };
+                float radius = step % 1000 == 0 ? 1e6f : Random( 0.0f, 9000.0f );
+
+                std::set<int> found;
+                grid.QuerySphere( center, radius, [&]( int o, float ) {
+                    Check( found.insert( o ).second, "grid returns every object once" );
+                } );
+
+                std::set<int> expected;
+                size_t numContained = 0;
+                for ( size_t o = 0; o < objects.size(); o++ ) {
+                    if ( !objects[o].first )
+                        continue;
+
+                    numContained++;
+                    const float* p = objects[o].second.data();
+                    float dx = p[0] - center[0];
+                    float dy = p[1] - center[1];
+                    float dz = p[2] - center[2];
+                    if ( dx * dx + dy * dy + dz * dz <= radius * radius ) {
+                        expected.insert( static_cast<int>(o) );
+                    }
+                }
+
+                Check( found == expected, "grid query matches brute force" );
+                Check( grid.Size() == numContained, "grid size" );
+            }
+        }
+
+        for ( size_t o = 0; o < objects.size(); o++ ) {
+            grid.Remove( static_cast<int>(o) );
+        }
+        Check( grid.Size() == 0 && grid.GetNumCells() == 0, "empty grid doesn't keep cells around" );
+    }
+
+    void CheckBatches() {
+        std::vector<int> materials( 6 );
+        std::vector<DecalInstanceInput> decals;
+        for ( int i = 0; i < 5000; i++ ) {
+            decals.push_back( RandomDecal( materials, 8000.0f ) );
+            decals.back().Distance = Random( 0.0f, 8000.0f );
+        }
+
+        DecalBatcher batcher;
+        batcher.Build( decals.data(), decals.size(), ALPHA_BLEND );
+        const std::vector<uint32_t>& order = batcher.GetOrder();
+        const std::vector<DecalBatch>& batches = batcher.GetBatches();
+
+        std::vector<uint32_t> sorted = order;
+        std::sort( sorted.begin(), sorted.end() );
+        bool complete = sorted.size() == decals.size();
+        for ( size_t i = 0; complete && i < sorted.size(); i++ ) {
+            complete = sorted[i] == i;
+        }
+        Check( complete, "every decal is drawn once" );
+
+        uint32_t next = 0;
+        bool blendStarted = false;
+        std::set<std::pair<int, const void*>> unorderedGroups;
+        for ( const DecalBatch& b : batches ) {
+            Check( b.FirstInstance == next && b.NumInstances > 0, "batches cover the order without gaps" );
+            for ( uint32_t i = b.FirstInstance; i < b.FirstInstance + b.NumInstances; i++ ) {
+                Check( decals[order[i]].Material == b.Material && decals[order[i]].AlphaFunc == b.AlphaFunc, "batch contents share the state" );
+            }
+            next += b.NumInstances;
+
+            if ( b.AlphaFunc == ALPHA_BLEND ) {
+                blendStarted = true;
+            } else {
+                Check( !blendStarted, "blended decals come last" );
+                Check( unorderedGroups.insert( { b.AlphaFunc, b.Material } ).second, "one batch per blend-mode and material" );
+            }
+        }
+
+        float lastDistance = 1e30f;
+        for ( uint32_t index : order ) {
+            if ( decals[index].AlphaFunc == ALPHA_BLEND ) {
+                Check( decals[index].Distance <= lastDistance, "blended decals are back to front" );
+                lastDistance = decals[index].Distance;
+            }
+        }
+
+        batcher.Build( nullptr, 0, ALPHA_BLEND );
+        Check( batcher.GetOrder().empty() && batcher.GetBatches().empty(), "empty input" );
+
+        // Lighting pass: nothing needs to be sorted
+        for ( DecalInstanceInput& d : decals ) {
+            d.AlphaFunc = ALPHA_NONE;
+        }
+        batcher.Build( decals.data(), decals.size(), ALPHA_BLEND );
+        Check( batcher.GetBatches().size() == materials.size(), "lighting pass is one batch per material" );
+    }
+
+    void SimulateWorld() {
+        const int numDecals = 20000;
+        const float drawRadius = 8000.0f;
+        const int numFrames = 200;
+
+        std::vector<int> materials( 40 );
+        std::vector<DecalInstanceInput> world;
+        SpatialHashGrid<uint32_t> grid;
+        for ( int i = 0; i < numDecals; i++ ) {
+            world.push_back( RandomDecal( materials, 60000.0f ) );
+            grid.Insert( static_cast<uint32_t>(i), world.back().Position );
+        }
+
+        std::vector<std::pair<uint32_t, float>> visible;
+        std::vector<DecalInstanceInput> inputs;
+        std::vector<unsigned char> instances;
+        DecalBatcher batcher;
+
+        double oldSeconds = 0.0;
+        double newSeconds = 0.0;
+        size_t oldDraws = 0;
+        size_t newDraws = 0;
+        size_t numVisible = 0;
+        float checksum = 0.0f;
+        for ( int frame = 0; frame < numFrames; frame++ ) {
+            float view[16];
+            float cameraPosition[3];
+            RandomView( view, cameraPosition );
+            cameraPosition[0] *= 2.0f;
+            cameraPosition[2] *= 2.0f;
+            cameraPosition[1] = 0.0f;
+
+            // Before: distance to every decal, sort all visible ones, one matrix and draw call each
+            auto start = std::chrono::high_resolution_clock::now();
+            visible.clear();
+            for ( uint32_t i = 0; i < world.size(); i++ ) {
+                const float* p = world[i].Position;
+                float dx = p[0] - cameraPosition[0];
+                float dy = p[1] - cameraPosition[1];
+                float dz = p[2] - cameraPosition[2];
+                float dist = sqrtf( dx * dx + dy * dy + dz * dz );
+                if ( dist <= drawRadius ) {
+                    visible.push_back( { i, dist } );
+                }
+            }
+            std::sort( visible.begin(), visible.end(), []( auto const& a, auto const& b ) { return a.second > b.second; } );
+
+            for ( auto const& v : visible ) {
+                float m[16];
+                DecalInstancing::ComputeInstanceMatrixReference( world[v.first], view, cameraPosition, m );
+                checksum += m[0];
+                oldDraws++;
+            }
+            oldSeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+            numVisible += visible.size();
+
+            // After: grid query, batches, all matrices in one go
+            start = std::chrono::high_resolution_clock::now();
+            inputs.clear();
+            grid.QuerySphere( cameraPosition, drawRadius, [&]( uint32_t i, float dist ) {
+                inputs.push_back( world[i] );
+                inputs.back().Distance = dist;
+            } );
+
+            batcher.Build( inputs.data(), inputs.size(), ALPHA_BLEND );
+            instances.resize( inputs.size() * 80 );
+            DecalInstancing::WriteInstanceMatrices( inputs.data(), batcher.GetOrder().data(), batcher.GetOrder().size(),
+                view, cameraPosition, instances.data(), 80 );
+            if ( !inputs.empty() ) {
+                checksum += *reinterpret_cast<const float*>(instances.data());
+            }
+            newDraws += batcher.GetBatches().size();
+            newSeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+            Check( inputs.size() == visible.size(), "both ways find the same decals" );
+        }
+
+        printf( "%d decals, %.0f visible per frame (checksum %g)\n", numDecals, static_cast<double>(numVisible) / numFrames, checksum );
+        printf( "  scan + sort + single matrices: %7.3f ms/frame, %6.0f draw calls\n", oldSeconds * 1000.0 / numFrames, static_cast<double>(oldDraws) / numFrames );
+        printf( "  grid + batches + SIMD:         %7.3f ms/frame, %6.0f draw calls\n", newSeconds * 1000.0 / numFrames, static_cast<double>(newDraws) / numFrames );
+    }
+}
+
+int main() {
+    CheckMatrices();
+    CheckGrid();
+    CheckBatches();
+    SimulateWorld();
+
+    if ( NumErrors ) {
+        printf( "%d errors\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
@@ -0,0 +1,181 @@
+/** Micro-benchmark for the per-frame arena
+
+    Replays the transient containers the renderer builds each frame (visible vobs, particles grouped
+    by texture, the alpha-mesh queue and the morph-mesh vertices) once with the default allocator and
+    once with the FrameArena, and prints heap allocations and time per frame for both.
+
+    Frames are read from a workload file with one frame per line:
+
+        <visible vobs> <particle textures> <particles> <alpha meshes> <morph vertices>
+
+    Without a file a synthetic walk through a city is used. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "FrameArena.h"
+
+namespace {
+    size_t NumHeapAllocations = 0;
+
+    struct FrameWorkload {
+        unsigned int NumVobs;
+        unsigned int NumTextures;
+        unsigned int NumParticles;
+        unsigned int NumAlphaMeshes;
+        unsigned int NumMorphVertices;
+    };
+
+    /** Same sizes as the structs the renderer uses */
+    struct Particle {
+        float Data[13];
+    };
+
+    struct Vertex {
+        float Data[11];
+    };
+
+    struct AlphaMesh {
+        void* Key[3];
+        void* Visual;
+        void* Mesh;
+    };
+
+    /** Loads the frames of a workload file, returns false if it couldn't be read */
+    bool LoadWorkload( const char* file, std::vector<FrameWorkload>& frames ) {
+        FILE* f = fopen( file, "r" );
+        if ( !f )
+            return false;
+
+        FrameWorkload w;
+        while ( fscanf( f, "%u %u %u %u %u", &w.NumVobs, &w.NumTextures, &w.NumParticles, &w.NumAlphaMeshes, &w.NumMorphVertices ) == 5 ) {
+            frames.push_back( w );
+        }
+
+        fclose( f );
+        return !frames.empty();
+    }
+
+    /** Walks into a dense area and back out again */
+    void MakeSyntheticWorkload( std::vector<FrameWorkload>& frames ) {
+        for ( unsigned int i = 0; i < 2000; i++ ) {
+            const unsigned int density = 1 + (i < 1000 ? i : 2000 - i) / 100;
+
+            FrameWorkload w;
+            w.NumVobs = 200 * density + (i * 7) % 50;
+            w.NumTextures = 4 + density;
+            w.NumParticles = 300 * density + (i * 13) % 100;
+            w.NumAlphaMeshes = 20 * density;
+            w.NumMorphVertices = 800 + (i % 3) * 400;
+            frames.push_back( w );
+        }
+    }
+
+    /** Builds the containers of one frame like the renderer does. Returns something to keep the optimizer away. */
+    template <template <typename> class Alloc>
+    size_t RunFrame( const FrameWorkload& w ) {
+        typedef std::vector<void*, Alloc<void*>> VobVector;
+        typedef std::vector<Particle, Alloc<Particle>> ParticleVector;
+        typedef std::map<int, ParticleVector, std::less<int>, Alloc<std::pair<const int, ParticleVector>>> ParticleMap;
+        typedef std::list<AlphaMesh, Alloc<AlphaMesh>> AlphaList;
+        typedef std::vector<Vertex, Alloc<Vertex>> VertexVector;
+
+        size_t result = 0;
+
+        VobVector vobs;
+        for ( unsigned int i = 0; i < w.NumVobs; i++ )
+            vobs.push_back( reinterpret_cast<void*>(static_cast<uintptr_t>(i)) );
+
+        result += vobs.size();
+
+        ParticleMap particles;
+        for ( unsigned int i = 0; i < w.NumParticles; i++ ) {
+            Particle p = {};
+            particles[i % (w.NumTextures + 1)].push_back( p );
+        }
+
+        result += particles.size();
+
+        AlphaList alphaMeshes;
+        for ( unsigned int i = 0; i < w.NumAlphaMeshes; i++ )
+            alphaMeshes.emplace_back();
+
+        result += alphaMeshes.size();
+
+        // One vector per submesh, like UpdateMorphMeshVisual
+        for ( unsigned int s = 0; s < 4; s++ ) {
+            VertexVector vertices;
+            vertices.reserve( w.NumMorphVertices / 4 );
+            for ( unsigned int i = 0; i < w.NumMorphVertices / 4; i++ )
+                vertices.emplace_back();
+
+            result += vertices.size();
+        }
+
+        return result;
+    }
+
+    template <template <typename> class Alloc>
+    void RunBenchmark( const char* name, const std::vector<FrameWorkload>& frames, bool endFrames ) {
+        size_t check = 0;
+        const size_t allocationsBefore = NumHeapAllocations;
+        auto start = std::chrono::steady_clock::now();
+
+        for ( const FrameWorkload& w : frames ) {
+            check += RunFrame<Alloc>( w );
+
+            if ( endFrames )
+                FrameArena::EndFrame();
+        }
+
+        const double us = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count();
+        const size_t allocations = NumHeapAllocations - allocationsBefore;
+
+        printf( "%-16s %10.2f us/frame %10.2f heap allocations/frame (%zu)\n", name,
+            us / frames.size(), double( allocations ) / frames.size(), check );
+    }
+}
+
+/** Counts every allocation which reaches the heap */
+void* operator new(size_t size) {
+    NumHeapAllocations++;
+    if ( void* p = malloc( size ) )
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free( p );
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free( p );
+}
+
+int main( int argc, char** argv ) {
+    std::vector<FrameWorkload> frames;
+    if ( argc > 1 ) {
+        if ( !LoadWorkload( argv[1], frames ) ) {
+            printf( "Failed to read workload from '%s'\n", argv[1] );
+            return 1;
+        }
+    } else {
+        MakeSyntheticWorkload( frames );
+    }
+
+    printf( "Replaying %zu frames\n", frames.size() );
+
+    // Warm up both, so the arena already sits at its high-water mark
+    RunBenchmark<std::allocator>( "warmup", frames, false );
+    RunBenchmark<FrameAllocator>( "warmup", frames, true );
+
+    RunBenchmark<std::allocator>( "std::allocator", frames, false );
+    RunBenchmark<FrameAllocator>( "FrameAllocator", frames, true );
+
+    const FrameArena& arena = FrameArena::Get();
+    printf( "Arena holds %zu chunk(s)\n", arena.GetNumChunks() );
+    return 0;
+}
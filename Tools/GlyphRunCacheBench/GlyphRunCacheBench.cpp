@@ -0,0 +1,300 @@
+/** Checks the glyph run cache of the UI text and shows what it saves over laying out every string
+
+    Runs are laid out against a fake font: Spaces only advance, newlines go back to the start of the
+    line, the UVs come from the font. The same string, font and scale has to hit, a different string,
+    font, scale or length has to miss, and only the first len characters count.
+
+    Two runs with the same hash are searched by brute force, so the cache has to tell them apart by
+    the text, font and scale it stored instead of the hash, and hand out the right layout for both.
+    Runs unused for MAX_UNUSED_FRAMES frames are still there, after twice as many they are gone, runs
+    which are used every frame stay.
+    Finally a menu-like frame is drawn with and without the cache. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "GlyphRunCache.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            if ( NumErrors < 10 ) {
+                printf( "FAILED: %s\n", what );
+            }
+            NumErrors++;
+        }
+    }
+
+    double Seconds() {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now().time_since_epoch() ).count();
+    }
+
+    struct UV {
+        float v[2];
+    };
+
+    /** Has what the cache needs of zFont */
+    struct TestFont {
+        int height;
+        int width[256];
+        UV fontuv1[256];
+        UV fontuv2[256];
+    };
+
+    void MakeFont( TestFont& font, int seed ) {
+        font.height = 10 + seed;
+        for ( int c = 0; c < 256; c++ ) {
+            font.width[c] = 3 + (c * 7 + seed) % 9;
+            font.fontuv1[c].v[0] = (c % 16) / 16.0f;
+            font.fontuv1[c].v[1] = (c / 16) / 16.0f;
+            font.fontuv2[c].v[0] = font.fontuv1[c].v[0] + 1.0f / 16.0f;
+            font.fontuv2[c].v[1] = font.fontuv1[c].v[1] + 1.0f / 16.0f;
+        }
+    }
+
+    /** Layout of the text, the way it was written to the quads before there was a cache */
+    bool MatchesLayout( const GlyphRun& run, const std::string& text, const TestFont& font, float scale ) {
+        std::vector<GlyphQuad> quads;
+        float x = 0.0f, y = 0.0f;
+        for ( unsigned char c : text ) {
+            const float width = font.width[c] * scale;
+            if ( c == ' ' ) {
+                x += width;
+                continue;
+            }
+
+            GlyphQuad q = { x, y, x + width, y + font.height * scale,
+                font.fontuv1[c].v[0], font.fontuv1[c].v[1], font.fontuv2[c].v[0], font.fontuv2[c].v[1] };
+            quads.push_back( q );
+
+            if ( c == '\n' ) {
+                y += font.height * scale;
+                x = 0.0f;
+            } else {
+                x += width + scale;
+            }
+        }
+
+        return run.Text == text && run.Quads.size() == quads.size()
+            && (quads.empty() || memcmp( run.Quads.data(), quads.data(), quads.size() * sizeof( GlyphQuad ) ) == 0);
+    }
+
+    const GlyphRun& Get( GlyphRunCache& cache, const std::string& text, const TestFont& font, float scale ) {
+        return cache.GetRun( text.c_str(), text.size(), font, scale );
+    }
+
+    void TestLayout() {
+        TestFont font;
+        MakeFont( font, 0 );
+        GlyphRunCache cache;
+
+        for ( const char* text : { "", " ", "A", "Hello World", "  two\nlines ", "\n\n", "\xE4\xF6\xFC\xFF" } ) {
+            for ( float scale : { 1.0f, 0.5f, 2.25f } ) {
+                Check( MatchesLayout( Get( cache, text, font, scale ), text, font, scale ), "layout matches the one without cache" );
+            }
+        }
+
+        const GlyphRun& spaced = Get( cache, "a b", font, 1.0f );
+        Check( spaced.Quads.size() == 2 && spaced.Quads[1].MinX == font.width['a'] + 1.0f + font.width[' '], "space only advances" );
+
+        const GlyphRun& lines = Get( cache, "ab\nc", font, 1.0f );
+        Check( lines.Quads.size() == 4 && lines.Quads[3].MinX == 0.0f && lines.Quads[3].MinY == font.height, "newline goes back to the start of the next line" );
+    }
+
+    void TestHits() {
+        TestFont font, otherFont;
+        MakeFont( font, 0 );
+        MakeFont( otherFont, 0 );
+        GlyphRunCache cache;
+
+        const GlyphRun* first = &Get( cache, "Inventory", font, 1.0f );
+        Check( cache.GetNumMisses() == 1 && cache.GetNumHits() == 0, "first request misses" );
+
+        const GlyphRun* second = &Get( cache, "Inventory", font, 1.0f );
+        Check( cache.GetNumHits() == 1 && first == second, "same text, font and scale hits" );
+
+        Get( cache, "Inventory", otherFont, 1.0f );
+        Check( cache.GetNumMisses() == 2, "same text in another font misses" );
+
+        Get( cache, "Inventory", font, 1.5f );
+        Check( cache.GetNumMisses() == 3, "same text at another scale misses" );
+
+        Get( cache, "Inventor", font, 1.0f );
+        Check( cache.GetNumMisses() == 4, "shorter text misses" );
+
+        // Only the first len characters count, like DrawString cutting off trailing slashes
+        const char* slashes = "Inventory//";
+        const GlyphRun& cut = cache.GetRun( slashes, 9, font, 1.0f );
+        Check( cache.GetNumHits() == 2 && &cut == first && cut.Text == "Inventory", "first len characters hit" );
+
+        Check( cache.GetNumRuns() == 4, "every distinct run is stored once" );
+
+        cache.EndFrame();
+        Check( cache.GetNumHits() == 0 && cache.GetNumMisses() == 0, "statistics are per frame" );
+        Get( cache, "Inventory", font, 1.0f );
+        Check( cache.GetNumHits() == 1, "run still hits in the next frame" );
+    }
+
+    /** Two strings and scales with the same hash. Font and scale are xor-ed into the hash of the
+        text, the scale shifted by 17 bits. So two texts whose hashes only differ in bits 17 to 48
+        collide, given scales which differ in exactly those bits. Those are found by brute force. */
+    bool FindCollision( std::string& textA, float& scaleA, std::string& textB, float& scaleB ) {
+        std::unordered_map<uint32_t, std::string> seen;
+        for ( uint32_t i = 0; i < 4000000; i++ ) {
+            const std::string text = "Item " + std::to_string( i );
+            const uint64_t h = GlyphRunCache::HashRun( text.c_str(), text.size(), nullptr, 0.0f );
+            const uint32_t key = static_cast<uint32_t>(h & 0x1FFFF) | static_cast<uint32_t>(h >> 49) << 17;
+
+            auto it = seen.find( key );
+            if ( it == seen.end() ) {
+                seen[key] = text;
+                continue;
+            }
+
+            const uint64_t other = GlyphRunCache::HashRun( it->second.c_str(), it->second.size(), nullptr, 0.0f );
+            const uint32_t diff = static_cast<uint32_t>((h ^ other) >> 17);
+
+            // Both scales have to be usable floats
+            for ( uint32_t exponent = 100; exponent < 160; exponent++ ) {
+                const uint32_t bitsA = exponent << 23;
+                const uint32_t bitsB = bitsA ^ diff;
+                float a, b;
+                memcpy( &a, &bitsA, 4 );
+                memcpy( &b, &bitsB, 4 );
+                if ( std::isnormal( a ) && std::isnormal( b ) ) {
+                    textA = text;
+                    scaleA = a;
+                    textB = it->second;
+                    scaleB = b;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void TestCollision() {
+        TestFont font;
+        MakeFont( font, 0 );
+
+        std::string textA, textB;
+        float scaleA = 0.0f, scaleB = 0.0f;
+        if ( !FindCollision( textA, scaleA, textB, scaleB ) ) {
+            Check( false, "found two runs with the same hash" );
+            return;
+        }
+
+        Check( GlyphRunCache::HashRun( textA.c_str(), textA.size(), &font, scaleA ) == GlyphRunCache::HashRun( textB.c_str(), textB.size(), &font, scaleB ),
+            "runs have the same hash" );
+
+        GlyphRunCache cache;
+        Check( MatchesLayout( Get( cache, textA, font, scaleA ), textA, font, scaleA ), "first of the colliding runs is laid out" );
+        Check( MatchesLayout( Get( cache, textB, font, scaleB ), textB, font, scaleB ) && cache.GetNumMisses() == 2, "second colliding run is told apart from the first" );
+        Check( MatchesLayout( Get( cache, textA, font, scaleA ), textA, font, scaleA ) && cache.GetNumMisses() == 3, "first colliding run comes back right" );
+        Check( cache.GetNumHits() == 0 && cache.GetNumRuns() == 1, "colliding runs share their slot" );
+
+        Get( cache, textA, font, scaleA );
+        Check( cache.GetNumHits() == 1, "colliding run hits again once it's in the slot" );
+    }
+
+    void TestEviction() {
+        TestFont font;
+        MakeFont( font, 0 );
+        const uint32_t maxUnused = GlyphRunCache::MAX_UNUSED_FRAMES;
+
+        // Requested once, then left alone for some frames
+        for ( uint32_t unused : { 1u, maxUnused - 1, maxUnused, maxUnused + 1, 2 * maxUnused - 1, 2 * maxUnused, 5 * maxUnused } ) {
+            for ( uint32_t start = 0; start < maxUnused; start += 7 ) {
+                GlyphRunCache cache;
+                for ( uint32_t f = 0; f < start; f++ )
+                    cache.EndFrame();
+
+                Get( cache, "Gold: 100", font, 1.0f );
+                for ( uint32_t f = 0; f < unused; f++ ) {
+                    Get( cache, "Health", font, 1.0f );
+                    cache.EndFrame();
+                }
+
+                Get( cache, "Gold: 100", font, 1.0f );
+                if ( unused <= maxUnused )
+                    Check( cache.GetNumHits() == 1, "run unused for MAX_UNUSED_FRAMES frames is kept" );
+                else if ( unused >= 2 * maxUnused )
+                    Check( cache.GetNumMisses() == 1, "run unused for twice MAX_UNUSED_FRAMES frames is evicted" );
+            }
+        }
+
+        // Text which changes every frame, like a timer, mustn't pile up
+        GlyphRunCache cache;
+        size_t maxRuns = 0;
+        for ( uint32_t f = 0; f < 20 * maxUnused; f++ ) {
+            Get( cache, "Health", font, 1.0f );
+            Get( cache, "Time: " + std::to_string( f ), font, 1.0f );
+            if ( f > 0 )
+                Check( cache.GetNumHits() == 1, "run used every frame is never evicted" );
+
+            maxRuns = std::max( maxRuns, cache.GetNumRuns() );
+            cache.EndFrame();
+        }
+        Check( maxRuns <= 2 * maxUnused + 2, "changing text is evicted" );
+    }
+
+    /** Menu-like frame: A few hundred strings which stay the same, some of them moving */
+    void BenchFrame() {
+        TestFont font;
+        MakeFont( font, 0 );
+
+        std::vector<std::string> texts;
+        std::uniform_int_distribution<int> length( 3, 40 );
+        std::uniform_int_distribution<int> character( 32, 122 );
+        for ( int i = 0; i < 300; i++ ) {
+            std::string s;
+            for ( int n = length( Rng ); n > 0; n-- )
+                s += static_cast<char>(character( Rng ));
+            texts.push_back( s );
+        }
+
+        const int frames = 300;
+        GlyphRunCache cache;
+        size_t sink = 0;
+        double start = Seconds();
+        for ( int f = 0; f < frames; f++ ) {
+            for ( const std::string& s : texts )
+                sink += Get( cache, s, font, 1.0f ).Quads.size();
+            cache.EndFrame();
+        }
+        double cached = Seconds() - start;
+
+        std::vector<GlyphQuad> quads;
+        start = Seconds();
+        for ( int f = 0; f < frames; f++ ) {
+            for ( const std::string& s : texts ) {
+                GlyphRunCache::Layout( s.c_str(), s.size(), font, 1.0f, quads );
+                sink += quads.size();
+            }
+        }
+        double uncached = Seconds() - start;
+
+        printf( "%zu strings per frame: %.3f ms cached, %.3f ms laid out every frame (%zu)\n",
+            texts.size(), cached * 1000.0 / frames, uncached * 1000.0 / frames, sink % 10 );
+    }
+}
+
+int main() {
+    TestLayout();
+    TestHits();
+    TestCollision();
+    TestEviction();
+    BenchFrame();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
@@ -0,0 +1,507 @@
+/** Checks the .mcache format and compares loading it to the first version of the format
+
+    Half-floats are checked for all 65536 values and against random floats, octahedral normals for
+    their error. The batched decoder is compared bit for bit with the scalar one. Meshes are written and read back, quantized ones have to stay inside the error
+    limits, full ones have to come back bit-exact. Broken files (cut off or with random bytes
+    changed) must be rejected or at least read without touching memory outside of the file, build
+    with -fsanitize=address to see that. Files already in memory, like the ones read out of a
+    zip-pack, have to open the same, also when they don't start aligned. Then a few hundred meshes are loaded the old way, with one
+    fread per field, and out of the mapped files. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "MeshCache.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    float Random( float min, float max ) {
+        return std::uniform_real_distribution<float>( min, max )(Rng);
+    }
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            if ( NumErrors < 10 ) {
+                printf( "FAILED: %s\n", what );
+            }
+            NumErrors++;
+        }
+    }
+
+    struct TestMesh {
+        std::string Texture;
+        std::vector<MeshCacheVertex> Vertices;
+        std::vector<uint16_t> Indices;
+    };
+
+    /** Grid on a sphere of the given radius, with texture coordinates repeating the given number of times */
+    TestMesh MakeSphere( const std::string& texture, float radius, int rings, float texRepeat ) {
+        TestMesh m;
+        m.Texture = texture;
+        for ( int r = 0; r <= rings; r++ ) {
+            for ( int s = 0; s <= rings; s++ ) {
+                float theta = 3.14159265f * r / rings;
+                float phi = 2.0f * 3.14159265f * s / rings;
+                MeshCacheVertex v = {};
+                v.Normal[0] = sinf( theta ) * cosf( phi );
+                v.Normal[1] = cosf( theta );
+                v.Normal[2] = sinf( theta ) * sinf( phi );
+                float len = sqrtf( v.Normal[0] * v.Normal[0] + v.Normal[1] * v.Normal[1] + v.Normal[2] * v.Normal[2] );
+                for ( int a = 0; a < 3; a++ ) {
+                    v.Normal[a] /= len;
+                    v.Position[a] = v.Normal[a] * radius;
+                }
+                v.TexCoord[0] = texRepeat * s / rings;
+                v.TexCoord[1] = texRepeat * r / rings;
+                v.TexCoord2[0] = Random( 0.0f, 1.0f );
+                v.TexCoord2[1] = Random( 0.0f, 1.0f );
+                v.Color = static_cast<uint32_t>(Rng());
+                m.Vertices.push_back( v );
+            }
+        }
+
+        for ( int r = 0; r < rings; r++ ) {
+            for ( int s = 0; s < rings; s++ ) {
+                uint16_t a = static_cast<uint16_t>(r * (rings + 1) + s);
+                uint16_t b = static_cast<uint16_t>(a + rings + 1);
+                uint16_t idx[6] = { a, b, static_cast<uint16_t>(a + 1), static_cast<uint16_t>(a + 1), b, static_cast<uint16_t>(b + 1) };
+                m.Indices.insert( m.Indices.end(), idx, idx + 6 );
+            }
+        }
+        return m;
+    }
+
+    std::vector<uint8_t> ReadFile( const std::string& file ) {
+        std::vector<uint8_t> data;
+        FILE* f = fopen( file.c_str(), "rb" );
+        if ( !f )
+            return data;
+
+        fseek( f, 0, SEEK_END );
+        data.resize( static_cast<size_t>(ftell( f )) );
+        fseek( f, 0, SEEK_SET );
+        if ( !data.empty() && fread( data.data(), 1, data.size(), f ) != data.size() )
+            data.clear();
+        fclose( f );
+        return data;
+    }
+
+    bool WriteFile( const std::string& file, const std::vector<uint8_t>& data ) {
+        FILE* f = fopen( file.c_str(), "wb" );
+        if ( !f )
+            return false;
+
+        bool ok = data.empty() || fwrite( data.data(), 1, data.size(), f ) == data.size();
+        fclose( f );
+        return ok;
+    }
+
+    void CheckHalfFloats() {
+        for ( uint32_t h = 0; h < 0x10000; h++ ) {
+            uint16_t half = static_cast<uint16_t>(h);
+            bool nan = (half & 0x7C00) == 0x7C00 && (half & 0x3FF) != 0;
+            float f = MeshCacheQuantization::HalfToFloat( half );
+            if ( nan ) {
+                Check( std::isnan( f ), "NaN stays NaN" );
+                Check( std::isnan( MeshCacheQuantization::HalfToFloat( MeshCacheQuantization::FloatToHalf( f ) ) ), "NaN survives the round-trip" );
+            } else {
+                Check( MeshCacheQuantization::FloatToHalf( f ) == half, "every half-float survives the round-trip" );
+            }
+        }
+
+        for ( int i = 0; i < 200000; i++ ) {
+            float f = ldexpf( Random( -1.0f, 1.0f ), static_cast<int>(Rng() % 40) - 28 );
+            float back = MeshCacheQuantization::HalfToFloat( MeshCacheQuantization::FloatToHalf( f ) );
+
+            // Half of the spacing of half-floats around f, which is 2^-24 below the normal range
+            int exponent;
+            frexpf( f, &exponent );
+            float spacing = ldexpf( 1.0f, std::max( exponent - 11, -24 ) );
+            if ( fabsf( f ) <= 65504.0f ) {
+                Check( fabsf( back - f ) <= spacing * 0.5f, "half-float rounds to nearest" );
+            } else if ( fabsf( f ) >= 65520.0f ) {
+                Check( std::isinf( back ), "too large values become infinite" );
+            }
+        }
+    }
+
+    void CheckNormals() {
+        float maxError = 0.0f;
+        for ( int i = 0; i < 200000; i++ ) {
+            float n[3] = { Random( -1.0f, 1.0f ), Random( -1.0f, 1.0f ), Random( -1.0f, 1.0f ) };
+            if ( i < 8 ) {
+                // Corners of the octahedron
+                n[0] = (i & 1) ? 1.0f : -1.0f;
+                n[1] = 0.0f;
+                n[2] = (i & 2) ? 0.0f : ((i & 4) ? 1.0f : -1.0f);
+            }
+
+            float len = sqrtf( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+            if ( len < 1e-3f )
+                continue;
+
+            for ( int a = 0; a < 3; a++ ) {
+                n[a] /= len;
+            }
+
+            int16_t enc[2];
+            float dec[3];
+            MeshCacheQuantization::EncodeOctahedral( n, enc );
+            MeshCacheQuantization::DecodeOctahedral( enc, dec );
+            for ( int a = 0; a < 3; a++ ) {
+                maxError = std::max( maxError, fabsf( dec[a] - n[a] ) );
+            }
+        }
+
+        Check( maxError < 2e-4f, "octahedral normals are precise" );
+        printf( "Octahedral normals: max error %g\n", maxError );
+    }
+
+    /** The SSE2 decoder has to give the same bits as the scalar one, for every half-float and normal */
+    void CheckBatchDecode() {
+        const uint32_t count = 65536 + 3; // Not a multiple of four
+        std::vector<MeshCacheQuantizedVertex> quantized( count );
+        for ( uint32_t i = 0; i < count; i++ ) {
+            MeshCacheQuantizedVertex& q = quantized[i];
+            for ( int a = 0; a < 3; a++ ) {
+                q.Position[a] = static_cast<uint16_t>(Rng());
+            }
+            q.Padding = 0;
+            q.Normal[0] = static_cast<int16_t>(Rng());
+            q.Normal[1] = static_cast<int16_t>(Rng());
+            q.TexCoord[0] = static_cast<uint16_t>(i);
+            q.TexCoord[1] = static_cast<uint16_t>(Rng());
+            q.TexCoord2[0] = static_cast<uint16_t>(~i);
+            q.TexCoord2[1] = static_cast<uint16_t>(Rng());
+            q.Color = static_cast<uint32_t>(Rng());
+        }
+
+        const float boundsMin[3] = { -123.5f, 0.0f, -40000.0f };
+        const float boundsMax[3] = { 456.25f, 0.0f, 40000.0f };
+        std::vector<MeshCacheVertex> scalar( count );
+        std::vector<MeshCacheVertex> batch( count );
+        for ( uint32_t i = 0; i < count; i++ ) {
+            MeshCacheQuantization::DequantizeVertex( quantized[i], boundsMin, boundsMax, scalar[i] );
+        }
+        MeshCacheQuantization::DequantizeVertices( quantized.data(), count, boundsMin, boundsMax, batch.data() );
+
+        Check( memcmp( scalar.data(), batch.data(), count * sizeof( MeshCacheVertex ) ) == 0, "batch decoding matches the scalar one" );
+
+        const int numRounds = 50;
+        auto start = std::chrono::high_resolution_clock::now();
+        for ( int r = 0; r < numRounds; r++ ) {
+            for ( uint32_t i = 0; i < count; i++ ) {
+                MeshCacheQuantization::DequantizeVertex( quantized[i], boundsMin, boundsMax, scalar[i] );
+            }
+        }
+        double scalarSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+        start = std::chrono::high_resolution_clock::now();
+        for ( int r = 0; r < numRounds; r++ ) {
+            MeshCacheQuantization::DequantizeVertices( quantized.data(), count, boundsMin, boundsMax, batch.data() );
+        }
+        double batchSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+        printf( "Decoding: %.2f ns per vertex scalar, %.2f ns batched\n",
+            scalarSeconds * 1e9 / (static_cast<double>(count) * numRounds), batchSeconds * 1e9 / (static_cast<double>(count) * numRounds) );
+    }
+
+    void CheckRoundTrip() {
+        std::vector<TestMesh> meshes;
+        meshes.push_back( MakeSphere( "SKY", 1.0f, 32, 1.0f ) );            // Gets quantized
+        meshes.push_back( MakeSphere( "WORLD_GROUND", 50000.0f, 64, 1.0f ) ); // Positions too far apart
+        meshes.push_back( MakeSphere( "TILED", 100.0f, 16, 333.3f ) );      // Texture coordinates too large for half-floats
+        meshes.push_back( TestMesh{ "EMPTY", {}, {} } );
+
+        MeshCacheWriter writer;
+        for ( const TestMesh& m : meshes ) {
+            writer.AddSubmesh( m.Texture, m.Vertices.data(), static_cast<uint32_t>(m.Vertices.size()),
+                m.Indices.data(), static_cast<uint32_t>(m.Indices.size()) );
+        }
+
+        MeshCacheWriteOptions options;
+        options.SourceSize = 1234;
+        options.SourceTime = 5678;
+        options.Scale = 100.0f;
+
+        const std::string file = "MeshCacheBench_test.mcache";
+        Check( writer.Write( file, options ), "writing the cache-file" );
+        Check( writer.GetNumQuantized() == 1, "only the sky-sphere is quantized" );
+
+        MeshCacheFile cache;
+        Check( cache.Open( file ), "reading the cache-file" );
+        if ( !cache.IsOpen() )
+            return;
+
+        Check( cache.GetHeader().SourceSize == 1234 && cache.GetHeader().SourceTime == 5678 && cache.GetHeader().Scale == 100.0f, "source stamp" );
+        Check( cache.GetNumSubmeshes() == meshes.size(), "number of submeshes" );
+        for ( uint32_t i = 0; i < cache.GetNumSubmeshes() && i < meshes.size(); i++ ) {
+            const TestMesh& m = meshes[i];
+            const MeshCacheSubmesh& s = cache.GetSubmesh( i );
+            Check( cache.GetTextureName( i ) == m.Texture, "texture names" );
+            Check( s.NumVertices == m.Vertices.size() && s.NumIndices == m.Indices.size(), "sizes" );
+            Check( s.VertexOffset % 16 == 0 && s.IndexOffset % 16 == 0, "streams are aligned" );
+            Check( m.Indices.empty() || memcmp( cache.GetIndices( i ), m.Indices.data(), m.Indices.size() * sizeof( uint16_t ) ) == 0, "indices" );
+
+            std::vector<MeshCacheVertex> decoded( s.NumVertices );
+            cache.DecodeVertices( i, decoded.data() );
+            if ( s.VertexFormat == MCVF_FULL ) {
+                Check( reinterpret_cast<uintptr_t>(cache.GetFullVertices( i )) % 16 == 0, "mapped vertices are aligned" );
+                Check( m.Vertices.empty() || memcmp( decoded.data(), m.Vertices.data(), m.Vertices.size() * sizeof( MeshCacheVertex ) ) == 0, "full vertices are exact" );
+                continue;
+            }
+
+            Check( cache.GetFullVertices( i ) == nullptr, "quantized vertices can't be mapped" );
+            for ( size_t v = 0; v < m.Vertices.size(); v++ ) {
+                const MeshCacheVertex& a = m.Vertices[v];
+                const MeshCacheVertex& b = decoded[v];
+                bool ok = a.Color == b.Color;
+                for ( int c = 0; c < 3; c++ ) {
+                    ok &= fabsf( a.Position[c] - b.Position[c] ) <= options.MaxPositionError;
+                    ok &= fabsf( a.Normal[c] - b.Normal[c] ) <= 2e-3f;
+                }
+                for ( int c = 0; c < 2; c++ ) {
+                    ok &= fabsf( a.TexCoord[c] - b.TexCoord[c] ) <= options.MaxTexCoordError;
+                    ok &= fabsf( a.TexCoord2[c] - b.TexCoord2[c] ) <= options.MaxTexCoordError;
+                }
+                Check( ok, "quantized vertices stay inside the error limits" );
+            }
+        }
+        cache.Close();
+
+        // The first version of the format starts with a 1 and has no header
+        std::vector<uint8_t> legacy( 64, 0 );
+        legacy[0] = 1;
+        Check( WriteFile( file, legacy ) && !cache.Open( file ), "old files are rejected" );
+
+        std::vector<uint8_t> good = writer.Build( options );
+
+        // Files out of memory, a misaligned one is copied so full vertices can still be used in place
+        auto sameAsWritten = [&]( const MeshCacheFile& c ) {
+            if ( !c.IsOpen() || c.GetNumSubmeshes() != meshes.size() )
+                return false;
+
+            bool same = true;
+            for ( uint32_t i = 0; i < c.GetNumSubmeshes(); i++ ) {
+                const TestMesh& m = meshes[i];
+                same &= c.GetTextureName( i ) == m.Texture;
+                same &= m.Indices.empty() || memcmp( c.GetIndices( i ), m.Indices.data(), m.Indices.size() * sizeof( uint16_t ) ) == 0;
+                if ( c.GetSubmesh( i ).VertexFormat == MCVF_FULL ) {
+                    same &= reinterpret_cast<uintptr_t>(c.GetFullVertices( i )) % alignof(MeshCacheHeader) == 0;
+                    same &= m.Vertices.empty() || memcmp( c.GetFullVertices( i ), m.Vertices.data(), m.Vertices.size() * sizeof( MeshCacheVertex ) ) == 0;
+                }
+            }
+            return same;
+        };
+
+        auto owned = std::make_shared<std::vector<uint8_t>>( good );
+        Check( cache.Open( owned->data(), owned->size(), owned ) && sameAsWritten( cache ), "reading the cache out of memory" );
+        owned.reset();
+        Check( sameAsWritten( cache ), "memory stays alive while the cache is open" );
+        cache.Close();
+
+        std::vector<uint8_t> shifted( good.size() + 1 );
+        memcpy( shifted.data() + 1, good.data(), good.size() );
+        Check( cache.Open( shifted.data() + 1, good.size(), nullptr ) && sameAsWritten( cache ), "reading a misaligned cache out of memory" );
+        cache.Close();
+
+        Check( !cache.Open( good.data(), good.size() - 1, nullptr ), "cut off files in memory are rejected" );
+
+        // Cut off anywhere
+        for ( size_t size = 0; size < good.size(); size += 1 + good.size() / 97 ) {
+            std::vector<uint8_t> cut( good.begin(), good.begin() + size );
+            Check( WriteFile( file, cut ) && !cache.Open( file ), "cut off files are rejected" );
+        }
+
+        // Random bytes changed, must not read outside of the file
+        size_t numOpened = 0;
+        for ( int i = 0; i < 500; i++ ) {
+            std::vector<uint8_t> broken = good;
+            int numChanges = 1 + static_cast<int>(Rng() % 4);
+            for ( int c = 0; c < numChanges; c++ ) {
+                // Mostly hit the header and table, they matter the most
+                size_t limit = (Rng() % 2) ? std::min<size_t>( broken.size(), 512 ) : broken.size();
+                broken[Rng() % limit] = static_cast<uint8_t>(Rng());
+            }
+
+            if ( !WriteFile( file, broken ) || !cache.Open( file ) )
+                continue;
+
+            numOpened++;
+            for ( uint32_t s = 0; s < cache.GetNumSubmeshes(); s++ ) {
+                std::vector<MeshCacheVertex> decoded( cache.GetSubmesh( s ).NumVertices );
+                cache.DecodeVertices( s, decoded.data() );
+                volatile size_t length = cache.GetTextureName( s ).size();
+                (void)length;
+                if ( cache.GetSubmesh( s ).NumIndices ) {
+                    volatile uint16_t last = cache.GetIndices( s )[cache.GetSubmesh( s ).NumIndices - 1];
+                    (void)last;
+                }
+            }
+            cache.Close();
+        }
+        printf( "Damaged files: %zu of 500 still opened (damage inside the data)\n", numOpened );
+
+        remove( file.c_str() );
+    }
+
+    /** Writer of the first version, like WorldConverter::CacheMesh did it (32 bit build) */
+    void WriteLegacy( const std::string& file, const std::vector<TestMesh>& meshes ) {
+        FILE* f = fopen( file.c_str(), "wb" );
+        int version = 1;
+        fwrite( &version, sizeof( version ), 1, f );
+        int numTextures = static_cast<int>(meshes.size());
+        fwrite( &numTextures, sizeof( numTextures ), 1, f );
+        for ( const TestMesh& m : meshes ) {
+            uint8_t numChars = static_cast<uint8_t>(m.Texture.size());
+            fwrite( &numChars, 1, 1, f );
+            fwrite( m.Texture.data(), numChars, 1, f );
+            uint8_t numSubmeshes = 1;
+            fwrite( &numSubmeshes, 1, 1, f );
+            int numVertices = static_cast<int>(m.Vertices.size());
+            fwrite( &numVertices, sizeof( numVertices ), 1, f );
+            fwrite( m.Vertices.data(), sizeof( MeshCacheVertex ) * m.Vertices.size(), 1, f );
+            int numIndices = static_cast<int>(m.Indices.size());
+            fwrite( &numIndices, sizeof( numIndices ), 1, f );
+            fwrite( m.Indices.data(), sizeof( uint16_t ) * m.Indices.size(), 1, f );
+        }
+        fclose( f );
+    }
+
+    /** Reader of the first version, like GMesh::LoadCached did it */
+    size_t ReadLegacy( const std::string& file, std::vector<TestMesh>& out ) {
+        FILE* f = fopen( file.c_str(), "rb" );
+        if ( !f )
+            return 0;
+
+        size_t numVerticesRead = 0;
+        int version;
+        int numTextures;
+        bool ok = fread( &version, sizeof( version ), 1, f ) == 1 && fread( &numTextures, sizeof( numTextures ), 1, f ) == 1;
+        for ( int t = 0; ok && t < numTextures; t++ ) {
+            unsigned char numChars;
+            char tx[256] = {};
+            unsigned char numSubmeshes = 0;
+            ok = fread( &numChars, 1, 1, f ) == 1 && fread( tx, numChars, 1, f ) == 1 && fread( &numSubmeshes, 1, 1, f ) == 1;
+            for ( int i = 0; ok && i < numSubmeshes; i++ ) {
+                // One heap-allocation per submesh, like the MeshInfo
+                TestMesh* m = new TestMesh;
+                int numVertices;
+                ok = fread( &numVertices, sizeof( numVertices ), 1, f ) == 1;
+                m->Vertices.resize( numVertices );
+                ok = ok && fread( m->Vertices.data(), sizeof( MeshCacheVertex ) * numVertices, 1, f ) == 1;
+                int numIndices;
+                ok = ok && fread( &numIndices, sizeof( numIndices ), 1, f ) == 1;
+                m->Indices.resize( numIndices );
+                ok = ok && fread( m->Indices.data(), sizeof( uint16_t ) * numIndices, 1, f ) == 1;
+                m->Texture = tx;
+                numVerticesRead += m->Vertices.size();
+                out.push_back( std::move( *m ) );
+                delete m;
+            }
+        }
+        fclose( f );
+        return numVerticesRead;
+    }
+
+    void CompareLoading() {
+        const int numFiles = 300;
+
+        // Props of different sizes, some fit the quantization limits
+        std::vector<std::vector<TestMesh>> files( numFiles );
+        for ( int i = 0; i < numFiles; i++ ) {
+            int numSubmeshes = 1 + static_cast<int>(Rng() % 6);
+            for ( int s = 0; s < numSubmeshes; s++ ) {
+                float radius = (Rng() % 2) ? Random( 20.0f, 500.0f ) : Random( 5000.0f, 40000.0f );
+                files[i].push_back( MakeSphere( "TEX_" + std::to_string( s ), radius, 8 + static_cast<int>(Rng() % 48), 1.0f ) );
+            }
+        }
+
+        size_t legacyBytes = 0;
+        size_t newBytes = 0;
+        size_t numQuantized = 0;
+        size_t numSubmeshes = 0;
+        for ( int i = 0; i < numFiles; i++ ) {
+            WriteLegacy( "MeshCacheBench_" + std::to_string( i ) + ".legacy", files[i] );
+            legacyBytes += ReadFile( "MeshCacheBench_" + std::to_string( i ) + ".legacy" ).size();
+
+            MeshCacheWriter writer;
+            for ( const TestMesh& m : files[i] ) {
+                writer.AddSubmesh( m.Texture, m.Vertices.data(), static_cast<uint32_t>(m.Vertices.size()), m.Indices.data(), static_cast<uint32_t>(m.Indices.size()) );
+            }
+            writer.Write( "MeshCacheBench_" + std::to_string( i ) + ".mcache", MeshCacheWriteOptions() );
+            newBytes += ReadFile( "MeshCacheBench_" + std::to_string( i ) + ".mcache" ).size();
+            numQuantized += writer.GetNumQuantized();
+            numSubmeshes += files[i].size();
+        }
+
+        // Several rounds, the first ones warm up the file cache
+        double legacySeconds = 0.0;
+        double newSeconds = 0.0;
+        size_t legacyVertices = 0;
+        size_t newVertices = 0;
+        const int numRounds = 5;
+        for ( int round = 0; round < numRounds; round++ ) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for ( int i = 0; i < numFiles; i++ ) {
+                std::vector<TestMesh> meshes;
+                legacyVertices += ReadLegacy( "MeshCacheBench_" + std::to_string( i ) + ".legacy", meshes );
+            }
+            legacySeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+            // Like the engine: full streams are used in place, quantized ones are decoded
+            start = std::chrono::high_resolution_clock::now();
+            std::vector<MeshCacheVertex> decoded;
+            for ( int i = 0; i < numFiles; i++ ) {
+                MeshCacheFile cache;
+                if ( !cache.Open( "MeshCacheBench_" + std::to_string( i ) + ".mcache" ) )
+                    continue;
+
+                for ( uint32_t s = 0; s < cache.GetNumSubmeshes(); s++ ) {
+                    if ( const MeshCacheVertex* v = cache.GetFullVertices( s ) ) {
+                        volatile float touch = v[cache.GetSubmesh( s ).NumVertices - 1].Position[0];
+                        (void)touch;
+                    } else {
+                        decoded.resize( cache.GetSubmesh( s ).NumVertices );
+                        cache.DecodeVertices( s, decoded.data() );
+                    }
+                    newVertices += cache.GetSubmesh( s ).NumVertices;
+                }
+            }
+            newSeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+        }
+
+        Check( legacyVertices == newVertices, "both formats hold the same meshes" );
+
+        for ( int i = 0; i < numFiles; i++ ) {
+            remove( ("MeshCacheBench_" + std::to_string( i ) + ".legacy").c_str() );
+            remove( ("MeshCacheBench_" + std::to_string( i ) + ".mcache").c_str() );
+        }
+
+        printf( "%d files, %zu submeshes, %zu quantized\n", numFiles, numSubmeshes, numQuantized );
+        printf( "  version 1, fread:  %8.2f ms per load of all files, %7.2f MB\n", legacySeconds * 1000.0 / numRounds, legacyBytes / (1024.0 * 1024.0) );
+        printf( "  version 2, mapped: %8.2f ms per load of all files, %7.2f MB\n", newSeconds * 1000.0 / numRounds, newBytes / (1024.0 * 1024.0) );
+    }
+}
+
+int main() {
+    CheckHalfFloats();
+    CheckNormals();
+    CheckBatchDecode();
+    CheckRoundTrip();
+    CompareLoading();
+
+    if ( NumErrors ) {
+        printf( "%d errors\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
@@ -0,0 +1,266 @@
+/** Checks the LOD generation and the picking of levels for static meshes
+
+    A terrain-like patch with open borders and a UV-seam through its middle is simplified level by
+    level. Every level has to keep about half the triangles of the one before, only reference valid
+    vertices, have no degenerate triangles, and keep every border edge of the original, otherwise
+    neighbouring submeshes would get cracks. Seam vertices have to stay. The errors have to grow from
+    level to level and stay below the bound. A flat patch has to reduce without any error, a bumpy one
+    not at all if no error is allowed.
+
+    The levels of a visual are built for all submeshes together: A submesh which can't be reduced
+    repeats its triangles, and errors left in the output from before are overwritten.
+
+    Picking the level has to get coarser with the distance, and moving back and forth around a
+    threshold mustn't switch the level every frame. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+#include "MeshSimplifier.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    double Seconds( std::chrono::high_resolution_clock::time_point start ) {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+
+    struct Vertex {
+        float Position[3];
+        float Normal[3];
+        float TexCoord[2];
+    };
+
+    struct Mesh {
+        std::vector<Vertex> Vertices;
+        std::vector<uint16_t> Indices;
+
+        MeshSimplifierInput GetInput() const {
+            return { Vertices.empty() ? nullptr : Vertices[0].Position, sizeof( Vertex ), Vertices.size(), &Indices };
+        }
+    };
+
+    /** Grid of size x size quads. The column in the middle is split into two vertices on the same position,
+        like a UV-seam. */
+    Mesh MakePatch( int size, float bumpiness ) {
+        Mesh mesh;
+        std::uniform_real_distribution<float> noise( -1.0f, 1.0f );
+        const int seam = size / 2;
+
+        std::vector<int> left( (size + 1) * (size + 1) ), right( (size + 1) * (size + 1) );
+        for ( int y = 0; y <= size; y++ ) {
+            for ( int x = 0; x <= size; x++ ) {
+                float h = bumpiness * (sinf( x * 0.4f ) * cosf( y * 0.3f ) * 20.0f + noise( Rng ));
+                Vertex v = { { x * 100.0f, h, y * 100.0f }, { 0, 1, 0 }, { x / float( size ), y / float( size ) } };
+
+                left[y * (size + 1) + x] = static_cast<int>(mesh.Vertices.size());
+                mesh.Vertices.push_back( v );
+
+                if ( x == seam ) {
+                    v.TexCoord[0] += 0.5f;
+                    right[y * (size + 1) + x] = static_cast<int>(mesh.Vertices.size());
+                    mesh.Vertices.push_back( v );
+                } else {
+                    right[y * (size + 1) + x] = left[y * (size + 1) + x];
+                }
+            }
+        }
+
+        for ( int y = 0; y < size; y++ ) {
+            for ( int x = 0; x < size; x++ ) {
+                // Quads right of the seam use the other copy of the seam vertices
+                const std::vector<int>& ids = x >= seam ? right : left;
+                int a = ids[y * (size + 1) + x], b = ids[y * (size + 1) + x + 1];
+                int c = ids[(y + 1) * (size + 1) + x], d = ids[(y + 1) * (size + 1) + x + 1];
+                mesh.Indices.insert( mesh.Indices.end(), { uint16_t( a ), uint16_t( c ), uint16_t( b ), uint16_t( b ), uint16_t( c ), uint16_t( d ) } );
+            }
+        }
+
+        return mesh;
+    }
+
+    /** Edges used by one triangle only, sorted vertex pairs */
+    std::set<std::pair<uint16_t, uint16_t>> GetBorderEdges( const std::vector<uint16_t>& indices ) {
+        std::set<std::pair<uint16_t, uint16_t>> once, more;
+        for ( size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+            for ( int c = 0; c < 3; c++ ) {
+                uint16_t a = indices[i + c], b = indices[i + (c + 1) % 3];
+                std::pair<uint16_t, uint16_t> e( std::min( a, b ), std::max( a, b ) );
+                if ( !once.insert( e ).second )
+                    more.insert( e );
+            }
+        }
+
+        for ( const auto& e : more )
+            once.erase( e );
+
+        return once;
+    }
+
+    bool IsValidLevel( const Mesh& mesh, const std::vector<uint16_t>& indices ) {
+        if ( indices.size() % 3 )
+            return false;
+
+        for ( size_t i = 0; i < indices.size(); i += 3 ) {
+            uint16_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            if ( a >= mesh.Vertices.size() || b >= mesh.Vertices.size() || c >= mesh.Vertices.size() || a == b || b == c || a == c )
+                return false;
+        }
+
+        return true;
+    }
+
+    void CheckChain() {
+        const Mesh mesh = MakePatch( 40, 1.0f );
+        const float maxError = 50.0f;
+
+        std::vector<std::vector<uint16_t>> levels;
+        std::vector<float> errors;
+        auto start = std::chrono::high_resolution_clock::now();
+        unsigned int n = MeshSimplifier::GenerateLODChain( mesh.GetInput(), MeshSimplifier::MAX_LODS, maxError, levels, errors );
+        double time = Seconds( start );
+
+        Check( n > 0, "Bumpy patch gets levels" );
+        Check( levels.size() == n && errors.size() == n, "One index list and error per level" );
+
+        const auto border = GetBorderEdges( mesh.Indices );
+        std::set<uint16_t> seamVertices;
+        for ( size_t i = 0; i < mesh.Vertices.size(); i++ ) {
+            for ( size_t j = 0; j < i; j++ ) {
+                if ( mesh.Vertices[i].Position[0] == mesh.Vertices[j].Position[0] && mesh.Vertices[i].Position[2] == mesh.Vertices[j].Position[2] ) {
+                    seamVertices.insert( uint16_t( i ) );
+                    seamVertices.insert( uint16_t( j ) );
+                }
+            }
+        }
+
+        size_t before = mesh.Indices.size() / 3;
+        printf( "Patch with %zu triangles, %u levels in %.2f ms:", before, n, time * 1000.0 );
+        for ( unsigned int l = 0; l < n; l++ ) {
+            const size_t triangles = levels[l].size() / 3;
+            printf( " %zu (%.2f)", triangles, errors[l] );
+
+            Check( IsValidLevel( mesh, levels[l] ), "Levels only hold valid, non-degenerate triangles" );
+            Check( triangles <= before - before / 8 && triangles + 2 >= before / 2, "Each level has about half the triangles" );
+            Check( errors[l] >= 0.0f && errors[l] <= maxError, "Errors stay inside of the bound" );
+            Check( l == 0 || errors[l] >= errors[l - 1], "Errors don't shrink" );
+
+            const auto levelBorder = GetBorderEdges( levels[l] );
+            Check( std::includes( levelBorder.begin(), levelBorder.end(), border.begin(), border.end() ), "Open borders are kept" );
+
+            std::set<uint16_t> used( levels[l].begin(), levels[l].end() );
+            Check( std::includes( used.begin(), used.end(), seamVertices.begin(), seamVertices.end() ), "Seam vertices are kept" );
+
+            before = triangles;
+        }
+        printf( "\n" );
+
+        // Without any error allowed, only collapses on flat ground would be possible
+        unsigned int strict = MeshSimplifier::GenerateLODChain( mesh.GetInput(), MeshSimplifier::MAX_LODS, 0.0f, levels, errors );
+        Check( strict == 0 && levels.empty() && errors.empty(), "Bumpy patch isn't reduced without error" );
+
+        const Mesh flat = MakePatch( 40, 0.0f );
+        unsigned int numFlat = MeshSimplifier::GenerateLODChain( flat.GetInput(), MeshSimplifier::MAX_LODS, 0.0f, levels, errors );
+        Check( numFlat == MeshSimplifier::MAX_LODS, "Flat patch gets all levels" );
+        for ( unsigned int l = 0; l < numFlat; l++ ) {
+            Check( errors[l] == 0.0f, "Flat patch reduces without error" );
+        }
+
+        std::vector<uint16_t> decimated;
+        MeshSimplifier::Decimate( mesh.GetInput(), decimated );
+        Check( IsValidLevel( mesh, decimated ) && decimated.size() / 3 <= mesh.Indices.size() / 6 + 1, "Decimate halves the triangles" );
+
+        Mesh empty;
+        Check( MeshSimplifier::GenerateLODChain( empty.GetInput(), MeshSimplifier::MAX_LODS, maxError, levels, errors ) == 0, "Empty mesh gets no levels" );
+    }
+
+    void CheckChains() {
+        const Mesh big = MakePatch( 30, 1.0f );
+        const Mesh small = MakePatch( 1, 1.0f );
+        const float maxError = 50.0f;
+
+        // Left over from a cache-file which was rejected
+        float errors[MeshSimplifier::MAX_LODS];
+        std::fill( errors, errors + MeshSimplifier::MAX_LODS, 1.0e9f );
+
+        std::vector<std::vector<std::vector<uint16_t>>> levels = { { { 1, 2, 3 } } };
+        unsigned int n = MeshSimplifier::GenerateLODChains( { big.GetInput(), small.GetInput() }, MeshSimplifier::MAX_LODS, maxError, levels, errors );
+
+        Check( n > 0, "Visual gets levels" );
+        Check( levels.size() == 2 && levels[0].size() == n && levels[1].size() == n, "All submeshes get all levels" );
+        for ( unsigned int l = 0; l < MeshSimplifier::MAX_LODS; l++ ) {
+            Check( l < n ? errors[l] <= maxError : errors[l] == 0.0f, "Errors from before are overwritten" );
+            Check( l == 0 || l >= n || errors[l] >= errors[l - 1], "Errors of the visual don't shrink" );
+        }
+
+        for ( unsigned int l = 0; l < n && levels.size() == 2 && levels[1].size() == n; l++ ) {
+            Check( levels[1][l] == small.Indices, "Submesh which can't be reduced repeats its triangles" );
+            Check( IsValidLevel( big, levels[0][l] ), "Levels of the visual are valid" );
+        }
+
+        // The errors of the visual are those of its worst submesh
+        std::vector<std::vector<uint16_t>> bigLevels;
+        std::vector<float> bigErrors;
+        MeshSimplifier::GenerateLODChain( big.GetInput(), MeshSimplifier::MAX_LODS, maxError, bigLevels, bigErrors );
+        Check( bigLevels.size() == n && (n == 0 || errors[0] == bigErrors[0]), "Visual takes the errors of its submeshes" );
+    }
+
+    void CheckSelect() {
+        const float errors[MeshSimplifier::MAX_LODS] = { 1.0f, 2.0f, 4.0f };
+        const float pixelScale = 1000.0f;
+        const float maxPixelError = 1.0f;
+        const unsigned char NO_HISTORY = 255;
+
+        Check( MeshSimplifier::SelectLOD( errors, 3, 100.0f, pixelScale, maxPixelError, NO_HISTORY ) == 0, "Near instances are drawn full" );
+        Check( MeshSimplifier::SelectLOD( errors, 3, 1000.0f, pixelScale, maxPixelError, NO_HISTORY ) == 1, "First level once its error fits" );
+        Check( MeshSimplifier::SelectLOD( errors, 3, 2500.0f, pixelScale, maxPixelError, NO_HISTORY ) == 2, "Second level once its error fits" );
+        Check( MeshSimplifier::SelectLOD( errors, 3, 100000.0f, pixelScale, maxPixelError, NO_HISTORY ) == 3, "Far instances get the coarsest level" );
+        Check( MeshSimplifier::SelectLOD( errors, 0, 100000.0f, pixelScale, maxPixelError, NO_HISTORY ) == 0, "Visuals without levels are drawn full" );
+        Check( MeshSimplifier::SelectLOD( errors, 3, 0.0f, pixelScale, maxPixelError, NO_HISTORY ) == 0, "Distance 0 is handled" );
+
+        unsigned char last = 0;
+        for ( float d = 1.0f; d < 20000.0f; d *= 1.01f ) {
+            unsigned char lod = MeshSimplifier::SelectLOD( errors, 3, d, pixelScale, maxPixelError, NO_HISTORY );
+            Check( lod >= last, "Levels get coarser with the distance" );
+            last = lod;
+        }
+
+        // Coming from a finer level, the coarser one needs headroom
+        Check( MeshSimplifier::SelectLOD( errors, 3, 1000.0f, pixelScale, maxPixelError, 0 ) == 0, "Coarser level needs headroom" );
+        Check( MeshSimplifier::SelectLOD( errors, 3, 1000.0f / MeshSimplifier::LOD_HYSTERESIS, pixelScale, maxPixelError, 0 ) == 1, "Coarser level is taken with headroom" );
+        Check( MeshSimplifier::SelectLOD( errors, 3, 990.0f, pixelScale, maxPixelError, 1 ) == 0, "Finer level is taken right away" );
+
+        // Walking back and forth around a threshold
+        unsigned char lod = 0;
+        int numSwitches = 0;
+        std::uniform_real_distribution<float> jitter( -30.0f, 30.0f );
+        for ( int frame = 0; frame < 1000; frame++ ) {
+            unsigned char next = MeshSimplifier::SelectLOD( errors, 3, 1050.0f + jitter( Rng ), pixelScale, maxPixelError, lod );
+            numSwitches += next != lod;
+            lod = next;
+        }
+        Check( numSwitches == 0, "Level doesn't flicker around a threshold" );
+    }
+}
+
+int main() {
+    CheckChain();
+    CheckChains();
+    CheckSelect();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
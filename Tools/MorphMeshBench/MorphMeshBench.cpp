@@ -0,0 +1,183 @@
+/** Checks MorphMeshVertices against the old per-frame rebuild and shows what skipping idle heads saves
+
+    First the SSE2 change-detection is compared to the scalar one on random arrays with single
+    changed floats at every position. Then a tavern full of heads is simulated: a few are talking,
+    so their positions change every frame, the others only blink now and then. Every frame the old
+    path rebuilds all vertices of every head into a fresh vector and uploads them, the new one only
+    expands and uploads heads whose positions changed. The vertices of both have to match. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "MorphMeshVertices.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+
+    /** Same layout as ExVertexStruct */
+    struct Vertex {
+        float Position[3];
+        float Normal[3];
+        float TexCoord[2];
+        float TexCoord2[2];
+        uint32_t Color;
+    };
+
+    struct Wedge {
+        float Normal[3];
+        float TexCoord[2];
+        uint16_t Position;
+    };
+
+    struct Head {
+        std::vector<float> BasePositions;
+        std::vector<float> Positions;
+        std::vector<std::vector<Wedge>> Submeshes;
+        bool Talking;
+
+        // New path
+        MorphMeshVertices Morph;
+        std::vector<std::vector<Vertex>> Vertices;
+    };
+
+    size_t TestKernels() {
+        size_t errors = 0;
+        for ( size_t count = 0; count < 200; count++ ) {
+            std::vector<float> src( count );
+            for ( auto& f : src ) f = std::uniform_real_distribution<float>( -10.0f, 10.0f )( Rng );
+
+            for ( size_t changed = 0; changed <= count; changed++ ) {
+                std::vector<float> a = src, b = src, c = src, d = src;
+                if ( changed < count ) {
+                    a[changed] += 1.0f;
+                }
+
+                // b and c hold the old data
+                const bool simd = MorphMeshKernels::CopyIfChanged( a.data(), b.data(), count );
+                const bool scalar = MorphMeshKernels::CopyIfChangedScalar( a.data(), c.data(), count );
+                if ( simd != scalar || simd != (changed < count) || b != a || c != a )
+                    errors++;
+            }
+        }
+        return errors;
+    }
+
+    void FillVertices( const Head& h, size_t s, std::vector<Vertex>& out ) {
+        for ( const Wedge& w : h.Submeshes[s] ) {
+            out.emplace_back();
+            Vertex& v = out.back();
+            memset( &v, 0, sizeof( v ) );
+            memcpy( v.Position, &h.Positions[w.Position * 3], sizeof( v.Position ) );
+            memcpy( v.Normal, w.Normal, sizeof( v.Normal ) );
+            memcpy( v.TexCoord, w.TexCoord, sizeof( v.TexCoord ) );
+            v.Color = 0xFFFFFFFF;
+        }
+    }
+
+    /** Stand-in for CalcVertexPositions, a few channels blended with sine weights */
+    void Animate( Head& h, int frame, int index ) {
+        const float talk = h.Talking ? sinf( frame * 0.3f + index ) : 0.0f;
+        const float blink = (frame + index * 7) % 90 < 4 ? 1.0f : 0.0f;
+
+        for ( size_t i = 0; i < h.Positions.size(); i++ ) {
+            float delta = 0.0f;
+            if ( i % 3 == 1 && i / 3 % 5 == 0 ) delta += talk * 0.5f;
+            if ( i % 3 == 2 && i / 3 % 11 == 0 ) delta += blink * 0.2f;
+            h.Positions[i] = h.BasePositions[i] + delta;
+        }
+    }
+}
+
+int main() {
+    size_t errors = TestKernels();
+    printf( "Kernels: %zu errors\n", errors );
+
+    const int NUM_HEADS = 120;
+    const int NUM_FRAMES = 300;
+    const uint16_t NUM_POSITIONS = 900;
+
+    std::vector<Head> heads( NUM_HEADS );
+    for ( int i = 0; i < NUM_HEADS; i++ ) {
+        Head& h = heads[i];
+        h.Talking = i % 8 == 0;
+        h.BasePositions.resize( NUM_POSITIONS * 3 );
+        for ( auto& p : h.BasePositions ) p = std::uniform_real_distribution<float>( -20.0f, 20.0f )( Rng );
+        h.Positions = h.BasePositions;
+
+        const int numSubmeshes = 1 + i % 3;
+        h.Submeshes.resize( numSubmeshes );
+        h.Vertices.resize( numSubmeshes );
+        for ( int s = 0; s < numSubmeshes; s++ ) {
+            std::vector<uint16_t> indices( 1400 / numSubmeshes );
+            for ( auto& idx : indices ) {
+                idx = static_cast<uint16_t>(std::uniform_int_distribution<int>( 0, NUM_POSITIONS - 1 )( Rng ));
+                Wedge w = { { 0, 1, 0 }, { 0.5f, 0.5f }, idx };
+                h.Submeshes[s].push_back( w );
+            }
+
+            h.Morph.AddSubmesh( indices.data(), indices.size() );
+            FillVertices( h, s, h.Vertices[s] );
+        }
+    }
+
+    std::vector<uint8_t> gpu( 4 * 1024 * 1024 );
+    double oldTime = 0.0, newTime = 0.0;
+    size_t oldBytes = 0, newBytes = 0;
+
+    for ( int frame = 0; frame < NUM_FRAMES; frame++ ) {
+        for ( int i = 0; i < NUM_HEADS; i++ ) {
+            Animate( heads[i], frame, i );
+        }
+
+        // Old: fresh vectors for every submesh of every head, every frame
+        std::vector<std::vector<Vertex>> reference;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for ( Head& h : heads ) {
+            for ( size_t s = 0; s < h.Submeshes.size(); s++ ) {
+                std::vector<Vertex> vertices;
+                vertices.reserve( h.Submeshes[s].size() );
+                FillVertices( h, s, vertices );
+
+                memcpy( gpu.data(), vertices.data(), vertices.size() * sizeof( Vertex ) );
+                oldBytes += vertices.size() * sizeof( Vertex );
+                reference.push_back( std::move( vertices ) );
+            }
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        // New: only heads which changed
+        for ( Head& h : heads ) {
+            if ( !h.Morph.Update( h.Positions.data(), h.Positions.size() / 3 ) )
+                continue;
+
+            for ( size_t s = 0; s < h.Submeshes.size(); s++ ) {
+                h.Morph.Expand( s, h.Vertices[s].data(), sizeof( Vertex ) );
+
+                memcpy( gpu.data(), h.Vertices[s].data(), h.Vertices[s].size() * sizeof( Vertex ) );
+                newBytes += h.Vertices[s].size() * sizeof( Vertex );
+            }
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+
+        oldTime += std::chrono::duration<double, std::milli>( t1 - t0 ).count();
+        newTime += std::chrono::duration<double, std::milli>( t2 - t1 ).count();
+
+        size_t r = 0;
+        for ( Head& h : heads ) {
+            for ( size_t s = 0; s < h.Submeshes.size(); s++, r++ ) {
+                if ( memcmp( reference[r].data(), h.Vertices[s].data(), reference[r].size() * sizeof( Vertex ) ) != 0 )
+                    errors++;
+            }
+        }
+    }
+
+    printf( "%d heads, %d frames: old %.3f ms/frame, %.1f MB/frame uploaded; new %.3f ms/frame, %.2f MB/frame uploaded\n",
+        NUM_HEADS, NUM_FRAMES, oldTime / NUM_FRAMES, oldBytes / 1048576.0 / NUM_FRAMES,
+        newTime / NUM_FRAMES, newBytes / 1048576.0 / NUM_FRAMES );
+
+    printf( errors ? "FAILED (%zu errors)\n" : "OK\n", errors );
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,449 @@
+/** Checks the packed pipeline state keys and the state-object table, and compares them to hashing the state structs
+
+    Every field of every key has to stay inside its own bits, so no two different states can end up
+    with the same key, which is checked field by field and on random states. The table has to find
+    every key it was given and nothing else, keep the ids when it grows, and still work when all
+    keys land in the same slot. The benchmark toggles between the states a UI-heavy frame uses, once
+    like before by hashing the structs into an unordered_map and once with the keys and the table. */
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "PipelineStateKey.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool ok, const char* what ) {
+        if ( !ok ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    // Values of the enums in GothicGraphicsState.h
+    const int BLEND_FUNCS[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 14, 15, 16, 17, 18, 19 };
+    const int NUM_BLEND_FUNCS = sizeof( BLEND_FUNCS ) / sizeof( BLEND_FUNCS[0] );
+    const int NUM_BLEND_OPS = 5;     // 1..5
+    const int NUM_CULL_MODES = 3;    // 1..3
+    const int NUM_COMPARE_FUNCS = 8; // 1..8
+    const int NUM_ADDRESS_MODES = 5; // 1..5
+
+    /** Same layout as GothicBlendStateInfo without the pipeline-state header */
+    struct BlendState {
+        int SrcBlend;
+        int DestBlend;
+        int BlendOp;
+        int SrcBlendAlpha;
+        int DestBlendAlpha;
+        int BlendOpAlpha;
+        bool BlendEnabled;
+        bool AlphaToCoverage;
+        bool ColorWritesEnabled;
+        bool Padding;
+
+        uint64_t Key() const {
+            return PipelineStateKey::PackBlend( SrcBlend, DestBlend, BlendOp, SrcBlendAlpha, DestBlendAlpha, BlendOpAlpha,
+                BlendEnabled, AlphaToCoverage, ColorWritesEnabled );
+        }
+
+        auto Tie() const {
+            return std::tie( SrcBlend, DestBlend, BlendOp, SrcBlendAlpha, DestBlendAlpha, BlendOpAlpha,
+                BlendEnabled, AlphaToCoverage, ColorWritesEnabled );
+        }
+    };
+
+    BlendState RandomBlendState() {
+        BlendState s;
+        s.SrcBlend = BLEND_FUNCS[Rng() % NUM_BLEND_FUNCS];
+        s.DestBlend = BLEND_FUNCS[Rng() % NUM_BLEND_FUNCS];
+        s.BlendOp = 1 + Rng() % NUM_BLEND_OPS;
+        s.SrcBlendAlpha = BLEND_FUNCS[Rng() % NUM_BLEND_FUNCS];
+        s.DestBlendAlpha = BLEND_FUNCS[Rng() % NUM_BLEND_FUNCS];
+        s.BlendOpAlpha = 1 + Rng() % NUM_BLEND_OPS;
+        s.BlendEnabled = Rng() & 1;
+        s.AlphaToCoverage = Rng() & 1;
+        s.ColorWritesEnabled = Rng() & 1;
+        s.Padding = false;
+        return s;
+    }
+
+    /** keys holds the key for every value of one field, with all other fields the same. They have to
+        differ, and only in bits no other field has changed so far. */
+    void CheckField( const std::vector<uint64_t>& keys, uint64_t& usedBits, const char* what ) {
+        std::set<uint64_t> unique( keys.begin(), keys.end() );
+        Check( unique.size() == keys.size(), what );
+
+        uint64_t fieldBits = 0;
+        for ( uint64_t k : keys ) {
+            Check( (k & PipelineStateKey::VALID_BIT) != 0, "every key has the valid-bit" );
+            fieldBits |= k ^ keys[0];
+        }
+
+        Check( (fieldBits & usedBits) == 0, "fields don't share bits" );
+        Check( (fieldBits & PipelineStateKey::VALID_BIT) == 0, "fields stay off the valid-bit" );
+        usedBits |= fieldBits;
+    }
+
+    void CheckBlendKeys() {
+        // Two different bases, so a field which is only partly covered by one of them still shows up
+        for ( int pass = 0; pass < 2; pass++ ) {
+            const int base = pass == 0 ? 1 : 19;
+            uint64_t used = 0;
+
+            auto fieldKeys = [&]( int field, int numValues ) {
+                std::vector<uint64_t> keys;
+                for ( int i = 0; i < numValues; i++ ) {
+                    int v[9] = { base, base, pass == 0 ? 1 : 5, base, base, pass == 0 ? 1 : 5, pass, pass, pass };
+                    if ( field == 0 || field == 1 || field == 3 || field == 4 ) v[field] = BLEND_FUNCS[i];
+                    else if ( field == 2 || field == 5 ) v[field] = 1 + i;
+                    else v[field] = i;
+
+                    keys.push_back( PipelineStateKey::PackBlend( v[0], v[1], v[2], v[3], v[4], v[5], v[6] != 0, v[7] != 0, v[8] != 0 ) );
+                }
+                return keys;
+            };
+
+            CheckField( fieldKeys( 0, NUM_BLEND_FUNCS ), used, "blend: SrcBlend" );
+            CheckField( fieldKeys( 1, NUM_BLEND_FUNCS ), used, "blend: DestBlend" );
+            CheckField( fieldKeys( 2, NUM_BLEND_OPS ), used, "blend: BlendOp" );
+            CheckField( fieldKeys( 3, NUM_BLEND_FUNCS ), used, "blend: SrcBlendAlpha" );
+            CheckField( fieldKeys( 4, NUM_BLEND_FUNCS ), used, "blend: DestBlendAlpha" );
+            CheckField( fieldKeys( 5, NUM_BLEND_OPS ), used, "blend: BlendOpAlpha" );
+            CheckField( fieldKeys( 6, 2 ), used, "blend: BlendEnabled" );
+            CheckField( fieldKeys( 7, 2 ), used, "blend: AlphaToCoverage" );
+            CheckField( fieldKeys( 8, 2 ), used, "blend: ColorWritesEnabled" );
+        }
+
+        // Random states: Same key exactly when the states are the same
+        std::map<uint64_t, BlendState> seen;
+        int numDuplicates = 0;
+        for ( int i = 0; i < 200000; i++ ) {
+            BlendState s = RandomBlendState();
+            auto it = seen.find( s.Key() );
+            if ( it == seen.end() ) {
+                seen[s.Key()] = s;
+            } else {
+                Check( it->second.Tie() == s.Tie(), "blend: equal keys only for equal states" );
+                numDuplicates++;
+            }
+        }
+        printf( "blend:      %zu different random states, %d repeated, no key collisions\n", seen.size(), numDuplicates );
+    }
+
+    void CheckRasterizerKeys() {
+        const int zBiases[] = { 0, 1, -1, 2, 16, -16, 255, 256, 65536, INT_MAX, INT_MIN };
+        const int numZBiases = sizeof( zBiases ) / sizeof( zBiases[0] );
+
+        for ( int pass = 0; pass < 2; pass++ ) {
+            uint64_t used = 0;
+            auto fieldKeys = [&]( int field, int numValues ) {
+                std::vector<uint64_t> keys;
+                for ( int i = 0; i < numValues; i++ ) {
+                    int v[5] = { pass == 0 ? 1 : 3, pass, pass, pass, pass == 0 ? 0 : -1 };
+                    if ( field == 0 ) v[0] = 1 + i;
+                    else if ( field == 4 ) v[4] = zBiases[i];
+                    else v[field] = i;
+
+                    keys.push_back( PipelineStateKey::PackRasterizer( v[0], v[1] != 0, v[2] != 0, v[3] != 0, v[4] ) );
+                }
+                return keys;
+            };
+
+            CheckField( fieldKeys( 0, NUM_CULL_MODES ), used, "rasterizer: CullMode" );
+            CheckField( fieldKeys( 1, 2 ), used, "rasterizer: FrontCounterClockwise" );
+            CheckField( fieldKeys( 2, 2 ), used, "rasterizer: DepthClipEnable" );
+            CheckField( fieldKeys( 3, 2 ), used, "rasterizer: Wireframe" );
+            CheckField( fieldKeys( 4, numZBiases ), used, "rasterizer: ZBias" );
+        }
+    }
+
+    void CheckDepthAndSamplerKeys() {
+        std::set<uint64_t> keys;
+        for ( int enabled = 0; enabled < 2; enabled++ ) {
+            for ( int write = 0; write < 2; write++ ) {
+                for ( int func = 1; func <= NUM_COMPARE_FUNCS; func++ ) {
+                    uint64_t key = PipelineStateKey::PackDepth( enabled != 0, write != 0, func );
+                    Check( (key & ~PipelineStateKey::VALID_BIT) < (1ull << PipelineStateKey::PIPELINE_DEPTH_BITS),
+                        "depth: fits into the pipeline key" );
+                    keys.insert( key );
+                }
+            }
+        }
+        Check( keys.size() == 2 * 2 * NUM_COMPARE_FUNCS, "depth: all states have their own key" );
+
+        keys.clear();
+        for ( int u = 1; u <= NUM_ADDRESS_MODES; u++ ) {
+            for ( int v = 1; v <= NUM_ADDRESS_MODES; v++ ) {
+                keys.insert( PipelineStateKey::PackSampler( u, v ) );
+            }
+        }
+        Check( keys.size() == NUM_ADDRESS_MODES * NUM_ADDRESS_MODES, "sampler: all states have their own key" );
+    }
+
+    void CheckPipelineKeys() {
+        using namespace PipelineStateKey;
+        const uint64_t depth = PackDepth( true, true, 7 );
+
+        for ( int pass = 0; pass < 2; pass++ ) {
+            uint64_t used = 0;
+            const uint32_t base = pass == 0 ? 0 : 5;
+            auto fieldKeys = [&]( int field, uint32_t maxValue ) {
+                std::vector<uint64_t> keys;
+                for ( uint32_t value : { 0u, 1u, 2u, 3u, maxValue / 2, maxValue - 1, maxValue } ) {
+                    uint32_t v[4] = { base, base, base, base };
+                    v[field] = value;
+                    keys.push_back( MakePipelineKey( depth, v[0], v[1], v[2], v[3] ) );
+                }
+                return keys;
+            };
+
+            std::vector<uint64_t> depthKeys;
+            for ( int func = 1; func <= NUM_COMPARE_FUNCS; func++ ) {
+                depthKeys.push_back( MakePipelineKey( PackDepth( pass == 1, true, func ), base, base, base, base ) );
+            }
+            depthKeys.push_back( MakePipelineKey( PackDepth( pass == 0, true, 1 ), base, base, base, base ) );
+            depthKeys.push_back( MakePipelineKey( PackDepth( pass == 1, false, 1 ), base, base, base, base ) );
+
+            CheckField( depthKeys, used, "pipeline: depth" );
+            CheckField( fieldKeys( 0, (1u << PIPELINE_BLEND_ID_BITS) - 1 ), used, "pipeline: blend id" );
+            CheckField( fieldKeys( 1, (1u << PIPELINE_RASTERIZER_ID_BITS) - 1 ), used, "pipeline: rasterizer id" );
+            CheckField( fieldKeys( 2, (1u << PIPELINE_SHADER_ID_BITS) - 1 ), used, "pipeline: vertex shader id" );
+            CheckField( fieldKeys( 3, (1u << PIPELINE_SHADER_ID_BITS) - 1 ), used, "pipeline: pixel shader id" );
+        }
+
+        // Ids which don't fit must not wrap into other fields
+        Check( MakePipelineKey( depth, 1u << PIPELINE_BLEND_ID_BITS, 0, 0, 0 ) == 0, "pipeline: blend id too big" );
+        Check( MakePipelineKey( depth, 0, 1u << PIPELINE_RASTERIZER_ID_BITS, 0, 0 ) == 0, "pipeline: rasterizer id too big" );
+        Check( MakePipelineKey( depth, 0, 0, 1u << PIPELINE_SHADER_ID_BITS, 0 ) == 0, "pipeline: vertex shader id too big" );
+        Check( MakePipelineKey( depth, 0, 0, 0, 1u << PIPELINE_SHADER_ID_BITS ) == 0, "pipeline: pixel shader id too big" );
+        Check( MakePipelineKey( depth, 0, 0, 0, INVALID_ID ) == 0, "pipeline: invalid id" );
+        Check( MakePipelineKey( 0, 0, 0, 0, 0 ) == 0, "pipeline: depth-state without key" );
+        Check( MakePipelineKey( depth, 0, 0, 0, 0 ) != 0, "pipeline: all ids 0" );
+    }
+
+    struct Object {
+        uint64_t Key;
+    };
+
+    /** Makes every key land in the same slot */
+    struct ConstantHasher {
+        uint64_t operator()( uint64_t ) const { return 0xFFFFFFFF; }
+    };
+
+    template <typename Hasher>
+    void CheckTable( const char* name, int numKeys, bool checkProbes ) {
+        StateKeyTable<Object, Hasher> table( 4 );
+        std::vector<Object> objects( numKeys );
+        std::vector<uint64_t> keys;
+
+        std::set<uint64_t> used;
+        while ( static_cast<int>(keys.size()) < numKeys ) {
+            uint64_t key = RandomBlendState().Key();
+            if ( used.insert( key ).second )
+                keys.push_back( key );
+        }
+
+        for ( int i = 0; i < numKeys; i++ ) {
+            objects[i].Key = keys[i];
+            uint32_t id = table.Insert( keys[i], &objects[i] );
+            Check( id == static_cast<uint32_t>(i), "table: ids count up" );
+            Check( table.GetNumEntries() * 2 <= table.GetCapacity(), "table: at most half full" );
+        }
+
+        // Everything is still found after growing, with the id it got when it was added
+        uint64_t totalProbes = 0;
+        uint32_t maxProbe = 0;
+        for ( int i = 0; i < numKeys; i++ ) {
+            uint32_t id;
+            Object* o = table.Find( keys[i], &id );
+            Check( o == &objects[i] && o->Key == keys[i], "table: finds every key" );
+            Check( id == static_cast<uint32_t>(i), "table: ids survive growing" );
+
+            uint32_t probe = table.GetProbeLength( keys[i] );
+            totalProbes += probe;
+            maxProbe = std::max( maxProbe, probe );
+        }
+
+        int numFound = 0;
+        for ( int i = 0; i < 1000; i++ ) {
+            uint64_t key = RandomBlendState().Key();
+            if ( used.count( key ) )
+                continue;
+
+            uint32_t id = 0;
+            numFound += table.Find( key, &id ) != nullptr;
+            Check( id == PipelineStateKey::INVALID_ID, "table: unknown keys get no id" );
+        }
+        Check( numFound == 0, "table: doesn't find keys it doesn't have" );
+
+        uint32_t id = 0;
+        Check( table.Find( 0, &id ) == nullptr && id == PipelineStateKey::INVALID_ID, "table: key 0 is never found" );
+        Check( table.Insert( 0, &objects[0] ) == PipelineStateKey::INVALID_ID, "table: key 0 is rejected" );
+
+        int numVisited = 0;
+        table.ForEach( [&]( uint64_t key, Object* o ) {
+            numVisited++;
+            Check( o->Key == key, "table: ForEach hands out matching pairs" );
+        } );
+        Check( numVisited == numKeys, "table: ForEach visits every entry once" );
+
+        const float averageProbe = static_cast<float>(totalProbes) / numKeys;
+        printf( "table %-9s %6d keys, capacity %6u, probes avg %.2f max %u\n", name, numKeys,
+            table.GetCapacity(), averageProbe, maxProbe );
+        if ( checkProbes )
+            Check( averageProbe < 1.6f, "table: the keys spread over the slots" );
+
+        table.Clear();
+        Check( table.GetNumEntries() == 0 && table.Find( keys[0] ) == nullptr, "table: clear" );
+        Check( table.Insert( keys[1], &objects[1] ) == 0, "table: ids start at 0 again after clear" );
+    }
+
+    /** The old way: hash every DWORD after the header of the struct, like GothicPipelineState::HashThis on x86 */
+    struct OldBlendState {
+        bool StateDirty;
+        uint32_t Hash;
+        int StructSize;
+        BlendState State;
+
+        void SetDirty() {
+            StateDirty = true;
+            Hash = 0;
+
+            const unsigned char* data = reinterpret_cast<const unsigned char*>(&State);
+            for ( size_t i = 0; i < sizeof( BlendState ); i += 4 ) {
+                // std::hash<DWORD> of MSVC is FNV-1a over the bytes
+                uint32_t h = 2166136261u;
+                for ( size_t b = 0; b < 4; b++ ) {
+                    h ^= data[i + b];
+                    h *= 16777619u;
+                }
+                Hash ^= h + 0x9e3779b9 + (Hash << 6) + (Hash >> 2);
+            }
+        }
+
+        bool operator==( const OldBlendState& o ) const { return Hash == o.Hash; }
+    };
+
+    struct OldHasher {
+        size_t operator()( const OldBlendState& s ) const { return s.Hash; }
+    };
+
+    void CheckOldHashCollisions() {
+        // The old cache compared states by their hash only, different states with the same hash shared one object
+        std::unordered_map<uint32_t, BlendState> byHash;
+        int numCollisions = 0;
+        int numStates = 0;
+        std::set<uint64_t> seen;
+        while ( numStates < 200000 ) {
+            OldBlendState s = {};
+            s.State = RandomBlendState();
+            if ( !seen.insert( s.State.Key() ).second )
+                continue;
+
+            numStates++;
+            s.SetDirty();
+            auto it = byHash.find( s.Hash );
+            if ( it != byHash.end() ) {
+                numCollisions++;
+            } else {
+                byHash[s.Hash] = s.State;
+            }
+        }
+        printf( "old hash:   %d different states, %d share a 32-bit hash with another one (packed keys: 0)\n",
+            numStates, numCollisions );
+    }
+
+    template <typename Fn>
+    double TimeMs( Fn fn ) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+
+    void Benchmark() {
+        // A UI-heavy frame: a few dozen states, toggled thousands of times
+        const int numStates = 40;
+        const int numToggles = 2000000;
+
+        std::vector<BlendState> states;
+        std::set<uint64_t> used;
+        while ( static_cast<int>(states.size()) < numStates ) {
+            BlendState s = RandomBlendState();
+            if ( used.insert( s.Key() ).second )
+                states.push_back( s );
+        }
+
+        std::vector<int> sequence( numToggles );
+        for ( int& s : sequence ) {
+            s = Rng() % numStates;
+        }
+
+        std::vector<Object> objects( numStates );
+
+        // Before: SetDirty hashes the struct, the lookup goes through an unordered_map
+        std::unordered_map<OldBlendState, Object*, OldHasher> oldMap;
+        uintptr_t oldSum = 0;
+        const double oldMs = TimeMs( [&]() {
+            for ( int i : sequence ) {
+                OldBlendState s;
+                s.State = states[i];
+                s.SetDirty();
+
+                Object*& o = oldMap[s];
+                if ( !o ) o = &objects[i];
+                oldSum += reinterpret_cast<uintptr_t>(o);
+            }
+        } );
+
+        // Now: SetDirty packs the key, the lookup probes the flat table
+        StateKeyTable<Object> table;
+        uintptr_t newSum = 0;
+        const double newMs = TimeMs( [&]() {
+            for ( int i : sequence ) {
+                const uint64_t key = states[i].Key();
+
+                Object* o = table.Find( key );
+                if ( !o ) {
+                    o = &objects[i];
+                    table.Insert( key, o );
+                }
+                newSum += reinterpret_cast<uintptr_t>(o);
+            }
+        } );
+
+        Check( oldSum == newSum, "benchmark: both caches return the same objects" );
+        printf( "%d state changes over %d states: hashed structs %.1f ms (%.1f ns each), packed keys %.1f ms (%.1f ns each)\n",
+            numToggles, numStates, oldMs, oldMs * 1e6 / numToggles, newMs, newMs * 1e6 / numToggles );
+    }
+}
+
+int main() {
+    CheckBlendKeys();
+    CheckRasterizerKeys();
+    CheckDepthAndSamplerKeys();
+    CheckPipelineKeys();
+
+    CheckTable<PipelineStateKey::KeyHasher>( "(keys):", 20000, true );
+    CheckTable<ConstantHasher>( "(1 slot):", 300, false );
+
+    CheckOldHashCollisions();
+    Benchmark();
+
+    if ( NumErrors ) {
+        printf( "%d checks FAILED\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
@@ -0,0 +1,378 @@
+/** Checks the portal graph and visibility on synthetic levels and shows how much less is drawn than with the frustum alone
+
+    A dungeon is built as a grid of rooms, every room its own sector, with doors between some of
+    them. The doors are two triangles each, like the portals exported from the editor, and have to
+    be merged into one portal between exactly the two rooms they connect. A house standing outside
+    has to get its door connected to the outside.
+
+    Then the camera is put into random rooms, looking into random directions. Every point which can
+    be seen (inside the camera frustum and no wall in between) must be reported as visible, the
+    portals are allowed to see more but never less. How many rooms are left compared to the frustum
+    alone is printed, next to the time the walk through the portals takes. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "PortalGraph.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool ok, const char* what ) {
+        if ( !ok ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    const float ROOM_SIZE = 1000.0f;
+    const float ROOM_HEIGHT = 400.0f;
+    const float DOOR_WIDTH = 200.0f;
+    const float DOOR_HEIGHT = 250.0f;
+
+    struct Level {
+        std::vector<std::vector<float>> Vertices;
+        std::vector<PortalGraphPolygon> Polygons;
+
+        /** Polygons which block the view, as index into Vertices */
+        std::vector<size_t> Walls;
+
+        void Add( std::vector<float> vertices, int sector, bool portal, bool indoorOutdoor = false, bool wall = false ) {
+            if ( wall ) {
+                Walls.push_back( Vertices.size() );
+            }
+            Vertices.push_back( std::move( vertices ) );
+
+            PortalGraphPolygon p;
+            p.Vertices = nullptr;
+            p.NumVertices = static_cast<uint32_t>(Vertices.back().size() / 3);
+            p.Sector = sector;
+            p.Portal = portal;
+            p.IndoorOutdoor = indoorOutdoor;
+            Polygons.push_back( p );
+        }
+
+        /** Pointers are only taken once all polygons are there */
+        void Finish() {
+            for ( size_t i = 0; i < Polygons.size(); i++ ) {
+                Polygons[i].Vertices = Vertices[i].data();
+            }
+        }
+    };
+
+    /** Quad in a plane of constant x (axis 0) or z (axis 2), from a to b along the other horizontal axis */
+    std::vector<float> WallQuad( int axis, float planePos, float a, float b, float y0, float y1 ) {
+        if ( axis == 0 ) {
+            return { planePos, y0, a, planePos, y0, b, planePos, y1, b, planePos, y1, a };
+        }
+        return { a, y0, planePos, b, y0, planePos, b, y1, planePos, a, y1, planePos };
+    }
+
+    /** A wall of a room, with a door in it when doorAt >= 0 */
+    void AddWall( Level& level, int sector, int axis, float planePos, float from, float to, float doorAt, bool blocking ) {
+        if ( doorAt < 0.0f ) {
+            level.Add( WallQuad( axis, planePos, from, to, 0.0f, ROOM_HEIGHT ), sector, false, false, blocking );
+            return;
+        }
+
+        // Left, right and above the door, all sharing the corners of the door
+        level.Add( WallQuad( axis, planePos, from, doorAt, 0.0f, ROOM_HEIGHT ), sector, false, false, blocking );
+        level.Add( WallQuad( axis, planePos, doorAt + DOOR_WIDTH, to, 0.0f, ROOM_HEIGHT ), sector, false, false, blocking );
+        level.Add( WallQuad( axis, planePos, doorAt, doorAt + DOOR_WIDTH, DOOR_HEIGHT, ROOM_HEIGHT ), sector, false, false, blocking );
+        level.Add( WallQuad( axis, planePos, doorAt, doorAt + DOOR_WIDTH, 0.0f, DOOR_HEIGHT ), sector, false, false, false );
+        level.Polygons.pop_back();
+        level.Vertices.pop_back();
+    }
+
+    /** The door as two triangles */
+    void AddDoor( Level& level, int axis, float planePos, float doorAt, bool indoorOutdoor ) {
+        std::vector<float> q = WallQuad( axis, planePos, doorAt, doorAt + DOOR_WIDTH, 0.0f, DOOR_HEIGHT );
+        level.Add( { q[0], q[1], q[2], q[3], q[4], q[5], q[6], q[7], q[8] }, -1, true, indoorOutdoor );
+        level.Add( { q[0], q[1], q[2], q[6], q[7], q[8], q[9], q[10], q[11] }, -1, true, indoorOutdoor );
+    }
+
+    struct Dungeon {
+        Level L;
+        int SizeX, SizeZ;
+        int NumDoors = 0;
+
+        /** Door position along the wall to +x / +z of every room, negative if there is none */
+        std::vector<float> DoorX, DoorZ;
+
+        int Sector( int x, int z ) const { return z * SizeX + x; }
+    };
+
+    Dungeon MakeDungeon( int sizeX, int sizeZ, float doorChance ) {
+        Dungeon d;
+        d.SizeX = sizeX;
+        d.SizeZ = sizeZ;
+        d.DoorX.assign( sizeX * sizeZ, -1.0f );
+        d.DoorZ.assign( sizeX * sizeZ, -1.0f );
+
+        std::uniform_real_distribution<float> chance( 0.0f, 1.0f );
+        std::uniform_real_distribution<float> offset( 100.0f, ROOM_SIZE - DOOR_WIDTH - 100.0f );
+        for ( int z = 0; z < sizeZ; z++ ) {
+            for ( int x = 0; x < sizeX; x++ ) {
+                if ( x + 1 < sizeX && chance( Rng ) < doorChance ) d.DoorX[d.Sector( x, z )] = z * ROOM_SIZE + offset( Rng );
+                if ( z + 1 < sizeZ && chance( Rng ) < doorChance ) d.DoorZ[d.Sector( x, z )] = x * ROOM_SIZE + offset( Rng );
+            }
+        }
+
+        for ( int z = 0; z < sizeZ; z++ ) {
+            for ( int x = 0; x < sizeX; x++ ) {
+                const int s = d.Sector( x, z );
+                const float x0 = x * ROOM_SIZE, x1 = x0 + ROOM_SIZE;
+                const float z0 = z * ROOM_SIZE, z1 = z0 + ROOM_SIZE;
+
+                // Floor and ceiling
+                d.L.Add( { x0, 0.0f, z0, x1, 0.0f, z0, x1, 0.0f, z1, x0, 0.0f, z1 }, s, false );
+                d.L.Add( { x0, ROOM_HEIGHT, z0, x1, ROOM_HEIGHT, z0, x1, ROOM_HEIGHT, z1, x0, ROOM_HEIGHT, z1 }, s, false );
+
+                AddWall( d.L, s, 0, x0, z0, z1, x > 0 ? d.DoorX[d.Sector( x - 1, z )] : -1.0f, true );
+                AddWall( d.L, s, 0, x1, z0, z1, d.DoorX[s], true );
+                AddWall( d.L, s, 2, z0, x0, x1, z > 0 ? d.DoorZ[d.Sector( x, z - 1 )] : -1.0f, true );
+                AddWall( d.L, s, 2, z1, x0, x1, d.DoorZ[s], true );
+
+                if ( d.DoorX[s] >= 0.0f ) {
+                    AddDoor( d.L, 0, x1, d.DoorX[s], false );
+                    d.NumDoors++;
+                }
+                if ( d.DoorZ[s] >= 0.0f ) {
+                    AddDoor( d.L, 2, z1, d.DoorZ[s], false );
+                    d.NumDoors++;
+                }
+            }
+        }
+
+        d.L.Finish();
+        return d;
+    }
+
+    /** Camera looking along yaw, with a horizontal field of view of 90 degrees and 60 vertically */
+    std::vector<PortalPlane> MakeFrustum( const float* pos, float yaw, float pitch ) {
+        const float fx[3] = { cosf( yaw ) * cosf( pitch ), sinf( pitch ), sinf( yaw ) * cosf( pitch ) };
+        const float right[3] = { -sinf( yaw ), 0.0f, cosf( yaw ) };
+        const float up[3] = {
+            fx[1] * right[2] - fx[2] * right[1],
+            fx[2] * right[0] - fx[0] * right[2],
+            fx[0] * right[1] - fx[1] * right[0] };
+
+        auto plane = [&]( const float* forward, const float* side, float angle, float sign ) {
+            PortalPlane p;
+            const float c = cosf( angle ), s = sinf( angle );
+            for ( int k = 0; k < 3; k++ ) {
+                p.Normal[k] = forward[k] * s + sign * side[k] * c;
+            }
+            p.Distance = p.Normal[0] * pos[0] + p.Normal[1] * pos[1] + p.Normal[2] * pos[2];
+            return p;
+        };
+
+        const float h = 3.14159265f / 4.0f, v = 3.14159265f / 6.0f;
+        return { plane( fx, right, h, 1.0f ), plane( fx, right, h, -1.0f ), plane( fx, up, v, 1.0f ), plane( fx, up, v, -1.0f ) };
+    }
+
+    bool InFrustum( const std::vector<PortalPlane>& frustum, const float* p ) {
+        for ( const PortalPlane& plane : frustum ) {
+            if ( plane.Normal[0] * p[0] + plane.Normal[1] * p[1] + plane.Normal[2] * p[2] < plane.Distance )
+                return false;
+        }
+        return true;
+    }
+
+    /** Whether the segment passes through one of the axis-aligned wall quads */
+    bool Blocked( const Level& level, const float* a, const float* b ) {
+        for ( size_t w : level.Walls ) {
+            const std::vector<float>& q = level.Vertices[w];
+            const int axis = q[0] == q[3] && q[0] == q[6] ? 0 : 2;
+            const float plane = q[axis];
+            const float da = a[axis] - plane, db = b[axis] - plane;
+            if ( (da > 0.0f) == (db > 0.0f) || da == db )
+                continue;
+
+            const float t = da / (da - db);
+            const int other = axis == 0 ? 2 : 0;
+            const float po = a[other] + (b[other] - a[other]) * t;
+            const float py = a[1] + (b[1] - a[1]) * t;
+
+            float omin = q[other], omax = q[other], ymin = q[1], ymax = q[1];
+            for ( size_t v = 0; v < q.size(); v += 3 ) {
+                omin = std::min( omin, q[v + other] ); omax = std::max( omax, q[v + other] );
+                ymin = std::min( ymin, q[v + 1] ); ymax = std::max( ymax, q[v + 1] );
+            }
+            if ( po >= omin && po <= omax && py >= ymin && py <= ymax )
+                return true;
+        }
+        return false;
+    }
+
+    void CheckGraph() {
+        Dungeon d = MakeDungeon( 6, 5, 0.6f );
+
+        PortalGraph graph;
+        graph.Build( d.L.Polygons.data(), d.L.Polygons.size() );
+
+        Check( graph.GetCells().size() == static_cast<size_t>(d.SizeX * d.SizeZ + 1), "one cell per room and the outside" );
+        Check( static_cast<int>(graph.GetPortals().size()) == d.NumDoors, "the two triangles of a door are one portal" );
+        Check( graph.GetNumDroppedPortals() == 0, "no portal dropped" );
+
+        for ( const PortalGraph::Portal& p : graph.GetPortals() ) {
+            Check( p.Vertices.size() == 12, "door portal is a quad" );
+            Check( p.Cells.size() == 2 && p.Cells[0] != PortalGraph::OUTSIDE_CELL, "door between two rooms" );
+            if ( p.Cells.size() != 2 )
+                continue;
+
+            const PortalGraph::Cell& a = graph.GetCells()[p.Cells[0]];
+            const PortalGraph::Cell& b = graph.GetCells()[p.Cells[1]];
+            const int ax = a.Sector % d.SizeX, az = a.Sector / d.SizeX;
+            const int bx = b.Sector % d.SizeX, bz = b.Sector / d.SizeX;
+            Check( std::abs( ax - bx ) + std::abs( az - bz ) == 1, "door between neighbours" );
+        }
+
+        for ( int i = 0; i < 1000; i++ ) {
+            const int x = Rng() % d.SizeX, z = Rng() % d.SizeZ;
+            const float p[3] = { x * ROOM_SIZE + 1.0f + (Rng() % 998), 1.0f + (Rng() % 398), z * ROOM_SIZE + 1.0f + (Rng() % 998) };
+            const uint32_t cell = graph.FindCell( p );
+            Check( cell != PortalGraph::OUTSIDE_CELL && graph.GetCells()[cell].Sector == d.Sector( x, z ), "point finds its room" );
+        }
+
+        const float far[3] = { -5000.0f, 100.0f, -5000.0f };
+        Check( graph.FindCell( far ) == PortalGraph::OUTSIDE_CELL, "point outside of all rooms" );
+
+        // Without portals nothing is connected
+        std::vector<PortalGraphPolygon> noPortals;
+        for ( const PortalGraphPolygon& p : d.L.Polygons ) {
+            if ( !p.Portal ) noPortals.push_back( p );
+        }
+        graph.Build( noPortals.data(), noPortals.size() );
+        Check( !graph.HasPortals(), "no portals without portal polygons" );
+    }
+
+    void CheckHouse() {
+        // A house with a door to the outside, walls inside belong to the house, outside to the outside
+        Level l;
+        const float door = 400.0f;
+        l.Add( { -5000.0f, 0.0f, -5000.0f, 5000.0f, 0.0f, -5000.0f, 5000.0f, 0.0f, 5000.0f, -5000.0f, 0.0f, 5000.0f }, -1, false );
+        for ( int sector : { 7, -1 } ) {
+            AddWall( l, sector, 0, 0.0f, 0.0f, ROOM_SIZE, -1.0f, true );
+            AddWall( l, sector, 0, ROOM_SIZE, 0.0f, ROOM_SIZE, -1.0f, true );
+            AddWall( l, sector, 2, 0.0f, 0.0f, ROOM_SIZE, door, true );
+            AddWall( l, sector, 2, ROOM_SIZE, 0.0f, ROOM_SIZE, -1.0f, true );
+        }
+        l.Add( { 0.0f, 1.0f, 0.0f, ROOM_SIZE, 1.0f, 0.0f, ROOM_SIZE, 1.0f, ROOM_SIZE, 0.0f, 1.0f, ROOM_SIZE }, 7, false );
+        AddDoor( l, 2, 0.0f, door, true );
+        l.Finish();
+
+        PortalGraph graph;
+        graph.Build( l.Polygons.data(), l.Polygons.size() );
+        Check( graph.GetPortals().size() == 1, "house has one door" );
+        if ( graph.GetPortals().size() != 1 )
+            return;
+
+        const PortalGraph::Portal& p = graph.GetPortals()[0];
+        Check( p.Cells.size() == 2 && p.Cells[0] == PortalGraph::OUTSIDE_CELL && graph.GetCells()[p.Cells[1]].Sector == 7, "door between outside and house" );
+
+        PortalVisibility vis;
+        const float inside[3] = { 500.0f, 150.0f, 500.0f };
+        const float insideMax[3] = { 520.0f, 170.0f, 520.0f };
+        const uint32_t houseCell = p.Cells[1];
+
+        // In front of the door, looking in
+        const float front[3] = { door + DOOR_WIDTH * 0.5f, 150.0f, -800.0f };
+        std::vector<PortalPlane> frustum = MakeFrustum( front, 3.14159265f / 2.0f, 0.0f );
+        vis.Compute( graph, front, frustum.data(), static_cast<int>(frustum.size()) );
+        Check( vis.GetCameraCell() == PortalGraph::OUTSIDE_CELL, "camera outside" );
+        Check( vis.IsCellVisible( houseCell ), "house seen through the door" );
+        Check( vis.IsBoxVisible( houseCell, inside, insideMax ), "middle of the house seen through the door" );
+
+        // Behind the house, looking at its back wall
+        const float back[3] = { 500.0f, 150.0f, 2500.0f };
+        frustum = MakeFrustum( back, -3.14159265f / 2.0f, 0.0f );
+        vis.Compute( graph, back, frustum.data(), static_cast<int>(frustum.size()) );
+        Check( !vis.IsCellVisible( houseCell ), "house hidden from behind" );
+        Check( vis.IsBoxVisible( inside, insideMax ), "the outside cell still covers boxes in the house bounds" );
+
+        // Standing in the door
+        const float inDoor[3] = { door + DOOR_WIDTH * 0.5f, 150.0f, 2.0f };
+        frustum = MakeFrustum( inDoor, 3.14159265f / 2.0f, 0.0f );
+        vis.Compute( graph, inDoor, frustum.data(), static_cast<int>(frustum.size()) );
+        Check( vis.IsBoxVisible( houseCell, inside, insideMax ), "house seen while standing in the door" );
+    }
+
+    void CheckVisibility() {
+        for ( int level = 0; level < 3; level++ ) {
+            Dungeon d = MakeDungeon( 12, 12, 0.5f + level * 0.2f );
+            PortalGraph graph;
+            graph.Build( d.L.Polygons.data(), d.L.Polygons.size() );
+
+            PortalVisibility vis;
+            std::uniform_real_distribution<float> angle( -3.14159265f, 3.14159265f );
+            std::uniform_real_distribution<float> pitch( -0.3f, 0.3f );
+
+            const int numViews = 300;
+            const int numPoints = 2000;
+            size_t missed = 0, seen = 0, portalRooms = 0, frustumRooms = 0;
+            double seconds = 0.0;
+
+            for ( int view = 0; view < numViews; view++ ) {
+                const int cx = Rng() % d.SizeX, cz = Rng() % d.SizeZ;
+                const float cam[3] = { cx * ROOM_SIZE + 20.0f + (Rng() % 960), 20.0f + (Rng() % 360), cz * ROOM_SIZE + 20.0f + (Rng() % 960) };
+                std::vector<PortalPlane> frustum = MakeFrustum( cam, angle( Rng ), pitch( Rng ) );
+
+                auto start = std::chrono::high_resolution_clock::now();
+                vis.Compute( graph, cam, frustum.data(), static_cast<int>(frustum.size()) );
+                seconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+                // Rooms which would be drawn, by the frustum alone and through the portals
+                for ( uint32_t c = 1; c < graph.GetCells().size(); c++ ) {
+                    const PortalGraph::Cell& cell = graph.GetCells()[c];
+                    bool inFrustum = true;
+                    for ( const PortalPlane& p : frustum ) {
+                        float farDist = 0.0f;
+                        for ( int a = 0; a < 3; a++ ) {
+                            farDist += p.Normal[a] * (p.Normal[a] >= 0.0f ? cell.Max[a] : cell.Min[a]);
+                        }
+                        if ( farDist < p.Distance ) inFrustum = false;
+                    }
+                    frustumRooms += inFrustum;
+                    portalRooms += vis.IsBoxVisible( c, cell.Min, cell.Max );
+                }
+
+                // Nothing which can be seen may be missing
+                for ( int i = 0; i < numPoints; i++ ) {
+                    const int x = Rng() % d.SizeX, z = Rng() % d.SizeZ;
+                    const float p[3] = { x * ROOM_SIZE + 1.0f + (Rng() % 998), 1.0f + (Rng() % 398), z * ROOM_SIZE + 1.0f + (Rng() % 998) };
+                    if ( !InFrustum( frustum, p ) || Blocked( d.L, cam, p ) )
+                        continue;
+
+                    seen++;
+                    const uint32_t cell = graph.FindCell( p );
+                    if ( !vis.IsBoxVisible( cell, p, p ) ) {
+                        missed++;
+                    }
+                }
+            }
+
+            Check( missed == 0, "every visible point is found through the portals" );
+            printf( "%dx%d rooms, %d doors: %zu visible points, %zu missed\n", d.SizeX, d.SizeZ, d.NumDoors, seen, missed );
+            printf( "  rooms drawn by frustum: %6.1f, through portals: %6.1f, %7.2f us per update\n",
+                static_cast<double>(frustumRooms) / numViews, static_cast<double>(portalRooms) / numViews, seconds * 1e6 / numViews );
+        }
+    }
+}
+
+int main() {
+    CheckGraph();
+    CheckHouse();
+    CheckVisibility();
+
+    if ( NumErrors ) {
+        printf( "%d errors\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
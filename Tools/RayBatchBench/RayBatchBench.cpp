@@ -0,0 +1,253 @@
+/** Checks the batched ray-tests against the scalar ones and measures how much faster they are
+
+    Random rays are traced against random boxes and triangles, once with RayBatch and once with
+    a copy of Toolbox::IntersectBox/IntersectTri. The closest hits have to be the same primitives,
+    at the same distance. When built with AVX, the 8-wide version is tested. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "RayBatch.h"
+
+namespace {
+    struct Vec3 {
+        float x, y, z;
+    };
+
+    Vec3 Sub( const Vec3& a, const Vec3& b ) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    Vec3 Cross( const Vec3& a, const Vec3& b ) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    float Dot( const Vec3& a, const Vec3& b ) { return (a.x * b.x + a.y * b.y) + a.z * b.z; }
+
+    /** Same as Toolbox::IntersectBox */
+    bool IntersectBox( const Vec3& min, const Vec3& max, const Vec3& origin, const Vec3& direction, float& t ) {
+        const Vec3 dirfrac = { 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z };
+
+        float t1 = (min.x - origin.x) * dirfrac.x;
+        float t2 = (max.x - origin.x) * dirfrac.x;
+        float t3 = (min.y - origin.y) * dirfrac.y;
+        float t4 = (max.y - origin.y) * dirfrac.y;
+        float t5 = (min.z - origin.z) * dirfrac.z;
+        float t6 = (max.z - origin.z) * dirfrac.z;
+
+        float tmin = std::max( std::max( std::min( t1, t2 ), std::min( t3, t4 ) ), std::min( t5, t6 ) );
+        float tmax = std::min( std::min( std::max( t1, t2 ), std::max( t3, t4 ) ), std::max( t5, t6 ) );
+
+        if ( tmax < 0 || tmin > tmax )
+            return false;
+
+        t = tmin;
+        return true;
+    }
+
+    /** Same as Toolbox::IntersectTri */
+    bool IntersectTri( const Vec3& v0, const Vec3& v1, const Vec3& v2, const Vec3& origin, const Vec3& direction, float& u, float& v, float& t ) {
+        const float EPSILON = 0.00001f;
+        Vec3 edge1 = Sub( v1, v0 );
+        Vec3 edge2 = Sub( v2, v0 );
+        Vec3 pvec = Cross( direction, edge2 );
+        float det = Dot( edge1, pvec );
+        if ( det > -EPSILON && det < EPSILON ) return false;
+
+        float invDet = 1 / det;
+        Vec3 tvec = Sub( origin, v0 );
+        u = Dot( tvec, pvec ) * invDet;
+        if ( u < 0 || u > 1 ) return false;
+        Vec3 qvec = Cross( tvec, edge1 );
+
+        v = Dot( direction, qvec ) * invDet;
+        if ( v < 0 || u + v > 1 ) return false;
+        t = Dot( edge2, qvec ) * invDet;
+
+        return true;
+    }
+
+    struct Scene {
+        std::vector<Vec3> BoxMin, BoxMax;
+        std::vector<Vec3> Positions;
+        std::vector<uint16_t> Indices;
+        std::vector<RayBatch::Ray> Rays;
+
+        RayBatch::BoxSoA Boxes;
+        RayBatch::TriangleSoA Triangles;
+    };
+
+    void MakeScene( Scene& s, size_t numBoxes, size_t numTriangles, size_t numRays, unsigned int seed ) {
+        std::mt19937 rng( seed );
+        std::uniform_real_distribution<float> pos( -1000.0f, 1000.0f );
+        std::uniform_real_distribution<float> size( 1.0f, 150.0f );
+        std::uniform_real_distribution<float> dir( -1.0f, 1.0f );
+
+        for ( size_t i = 0; i < numBoxes; i++ ) {
+            Vec3 c = { pos( rng ), pos( rng ), pos( rng ) };
+            Vec3 e = { size( rng ), size( rng ), size( rng ) };
+            s.BoxMin.push_back( { c.x - e.x, c.y - e.y, c.z - e.z } );
+            s.BoxMax.push_back( { c.x + e.x, c.y + e.y, c.z + e.z } );
+            s.Boxes.Add( &s.BoxMin.back().x, &s.BoxMax.back().x );
+        }
+
+        // Triangles share vertices, like the meshes of the game do
+        const size_t numVertices = std::min<size_t>( numTriangles * 3, 0xFFFF );
+        for ( size_t i = 0; i < numVertices; i++ ) {
+            if ( i % 3 == 0 ) {
+                s.Positions.push_back( { pos( rng ), pos( rng ), pos( rng ) } );
+            } else {
+                const Vec3& p = s.Positions[i - i % 3];
+                s.Positions.push_back( { p.x + dir( rng ) * 200.0f, p.y + dir( rng ) * 200.0f, p.z + dir( rng ) * 200.0f } );
+            }
+        }
+
+        std::uniform_int_distribution<int> neighbour( -4, 4 );
+        for ( size_t i = 0; i < numTriangles * 3; i++ ) {
+            const int base = static_cast<int>(i % numVertices);
+            s.Indices.push_back( static_cast<uint16_t>(std::clamp( base + (i % 3 ? neighbour( rng ) : 0), 0, static_cast<int>(numVertices) - 1 )) );
+        }
+        s.Triangles.AddIndexed( &s.Positions[0], sizeof( Vec3 ), &s.Indices[0], s.Indices.size() );
+
+        for ( size_t i = 0; i < numRays; i++ ) {
+            RayBatch::Ray r;
+            for ( int a = 0; a < 3; a++ ) {
+                r.Origin[a] = pos( rng );
+                r.Direction[a] = dir( rng );
+            }
+
+            // Some axis-aligned rays, to get infinite reciprocals
+            if ( i % 7 == 0 )
+                r.Direction[i % 3] = 0.0f;
+
+            s.Rays.push_back( r );
+        }
+    }
+
+    int ScalarClosestBox( const Scene& s, const RayBatch::Ray& r, float& outT ) {
+        const Vec3 o = { r.Origin[0], r.Origin[1], r.Origin[2] };
+        const Vec3 d = { r.Direction[0], r.Direction[1], r.Direction[2] };
+
+        int best = -1;
+        outT = RayBatch::MISS;
+        for ( size_t i = 0; i < s.BoxMin.size(); i++ ) {
+            float t;
+            if ( IntersectBox( s.BoxMin[i], s.BoxMax[i], o, d, t ) && t < outT ) {
+                outT = t;
+                best = static_cast<int>(i);
+            }
+        }
+
+        return best;
+    }
+
+    int ScalarClosestTriangle( const Scene& s, const RayBatch::Ray& r, float& outT ) {
+        const Vec3 o = { r.Origin[0], r.Origin[1], r.Origin[2] };
+        const Vec3 d = { r.Direction[0], r.Direction[1], r.Direction[2] };
+
+        int best = -1;
+        outT = RayBatch::MISS;
+        for ( size_t i = 0; i + 2 < s.Indices.size(); i += 3 ) {
+            float u, v, t;
+            if ( IntersectTri( s.Positions[s.Indices[i]], s.Positions[s.Indices[i + 1]], s.Positions[s.Indices[i + 2]], o, d, u, v, t ) && t > 0 && t < outT ) {
+                outT = t;
+                best = static_cast<int>(i);
+            }
+        }
+
+        return best;
+    }
+
+    /** Distances are allowed to differ in the last bits, the compiler may contract to FMA */
+    bool SameHit( int a, float ta, int b, float tb ) {
+        if ( a != b )
+            return false;
+
+        return a < 0 || std::fabs( ta - tb ) <= 1e-4f * std::max( 1.0f, std::fabs( ta ) );
+    }
+
+    template <typename F>
+    double MeasureMs( F f ) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    }
+}
+
+int main() {
+    size_t numErrors = 0;
+
+    // Odd sizes, so the padding of the last lanes gets tested
+    const size_t sizes[] = { 0, 1, 3, 5, 8, 13, 100, 1001 };
+    for ( size_t n : sizes ) {
+        Scene s;
+        MakeScene( s, n, n, 257, static_cast<unsigned int>(n) + 1 );
+
+        std::vector<int> packetBoxes( s.Rays.size() ), packetTris( s.Rays.size() );
+        std::vector<float> packetBoxT( s.Rays.size() ), packetTriT( s.Rays.size() );
+        RayBatch::ClosestBoxes( &s.Rays[0], s.Rays.size(), s.Boxes, &packetBoxes[0], &packetBoxT[0] );
+        RayBatch::ClosestTriangles( &s.Rays[0], s.Rays.size(), s.Triangles, 0.0f, &packetTris[0], &packetTriT[0] );
+
+        std::vector<float> allT( n + 1 );
+        for ( size_t r = 0; r < s.Rays.size(); r++ ) {
+            const RayBatch::Ray& ray = s.Rays[r];
+
+            float refT, t, u, v;
+            int ref = ScalarClosestBox( s, ray, refT );
+            int hit = RayBatch::ClosestBox( ray, s.Boxes, t );
+            if ( !SameHit( ref, refT, hit, t ) || !SameHit( ref, refT, packetBoxes[r], packetBoxT[r] ) ) {
+                printf( "box mismatch: %zu boxes, ray %zu: scalar %d (%f), batch %d (%f), packet %d (%f)\n", n, r, ref, refT, hit, t, packetBoxes[r], packetBoxT[r] );
+                numErrors++;
+            }
+
+            if ( n ) {
+                RayBatch::IntersectBoxes( ray, s.Boxes, &allT[0] );
+                const Vec3 o = { ray.Origin[0], ray.Origin[1], ray.Origin[2] };
+                const Vec3 d = { ray.Direction[0], ray.Direction[1], ray.Direction[2] };
+                for ( size_t i = 0; i < n; i++ ) {
+                    float bt;
+                    bool refHit = IntersectBox( s.BoxMin[i], s.BoxMax[i], o, d, bt );
+                    if ( refHit != (allT[i] != RayBatch::MISS) || (refHit && !SameHit( 0, bt, 0, allT[i] )) ) {
+                        printf( "box %zu mismatch on ray %zu\n", i, r );
+                        numErrors++;
+                    }
+                }
+            }
+
+            ref = ScalarClosestTriangle( s, ray, refT );
+            hit = RayBatch::ClosestTriangle( ray, s.Triangles, 0.0f, t, u, v );
+            int indexed = s.Indices.empty() ? -1 : RayBatch::ClosestTriangleIndexed( ray, &s.Positions[0], sizeof( Vec3 ), &s.Indices[0], s.Indices.size(), 0.0f, u );
+            if ( !SameHit( ref, refT, hit < 0 ? -1 : hit * 3, t ) || !SameHit( ref, refT, indexed, u )
+                || !SameHit( ref, refT, packetTris[r] < 0 ? -1 : packetTris[r] * 3, packetTriT[r] ) ) {
+                printf( "triangle mismatch: %zu triangles, ray %zu: scalar %d, batch %d, indexed %d, packet %d\n", n, r, ref, hit * 3, indexed, packetTris[r] * 3 );
+                numErrors++;
+            }
+        }
+    }
+
+    printf( "%zu lanes, %zu mismatches\n", RayBatch::LANES, numErrors );
+
+    // Timings, roughly the size of a world-section and its meshes
+    Scene s;
+    MakeScene( s, 4096, 20000, 256, 1234 );
+
+    int sink = 0;
+    double scalarBoxMs = MeasureMs( [&]() { for ( auto& r : s.Rays ) { float t; sink += ScalarClosestBox( s, r, t ); } } );
+    double batchBoxMs = MeasureMs( [&]() { for ( auto& r : s.Rays ) { float t; sink += RayBatch::ClosestBox( r, s.Boxes, t ); } } );
+
+    std::vector<int> indices( s.Rays.size() );
+    std::vector<float> ts( s.Rays.size() );
+    double packetBoxMs = MeasureMs( [&]() { RayBatch::ClosestBoxes( &s.Rays[0], s.Rays.size(), s.Boxes, &indices[0], &ts[0] ); } );
+
+    double scalarTriMs = MeasureMs( [&]() { for ( auto& r : s.Rays ) { float t; sink += ScalarClosestTriangle( s, r, t ); } } );
+    double indexedTriMs = MeasureMs( [&]() { for ( auto& r : s.Rays ) { float t; sink += RayBatch::ClosestTriangleIndexed( r, &s.Positions[0], sizeof( Vec3 ), &s.Indices[0], s.Indices.size(), 0.0f, t ); } } );
+    double batchTriMs = MeasureMs( [&]() { for ( auto& r : s.Rays ) { float t, u, v; sink += RayBatch::ClosestTriangle( r, s.Triangles, 0.0f, t, u, v ); } } );
+    double packetTriMs = MeasureMs( [&]() { RayBatch::ClosestTriangles( &s.Rays[0], s.Rays.size(), s.Triangles, 0.0f, &indices[0], &ts[0] ); } );
+
+    printf( "%zu rays vs %zu boxes:     scalar %8.2f ms, batch %8.2f ms, packet %8.2f ms\n", s.Rays.size(), s.Boxes.Size(), scalarBoxMs, batchBoxMs, packetBoxMs );
+    printf( "%zu rays vs %zu triangles: scalar %8.2f ms, indexed %6.2f ms, batch %8.2f ms, packet %8.2f ms\n", s.Rays.size(), s.Triangles.Size(), scalarTriMs, indexedTriMs, batchTriMs, packetTriMs );
+
+    // Keeps the loops from being optimized away
+    if ( sink == 42 )
+        printf( "\n" );
+
+    return numErrors ? 1 : 0;
+}
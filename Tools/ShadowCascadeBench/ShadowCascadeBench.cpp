@@ -0,0 +1,349 @@
+/** Checks the cascade math and caster culling of ShadowCascades and shows what caching the far cascade saves
+
+    The fitted spheres have to contain their frustum slices and the matrices have to map the slices
+    into the shadowmaps. Snapping is checked by moving the camera in tiny steps, a world point has to
+    stay on the same spot inside its texel. Culling is compared to brute force: every box which has a
+    point whose shadow falls into the cascade has to pass. Then a walk through a world full of
+    casters is simulated, once like the old single shadowmap which drew everything every frame, once
+    with a near cascade drawn every frame and a cached far one. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "ShadowCascades.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    float Random( float min, float max ) {
+        return std::uniform_real_distribution<float>( min, max )(Rng);
+    }
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            if ( NumErrors < 10 ) {
+                printf( "FAILED: %s\n", what );
+            }
+            NumErrors++;
+        }
+    }
+
+    void Transform( const float p[3], const float m[16], float out[4] ) {
+        for ( int c = 0; c < 4; c++ ) {
+            out[c] = p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + m[12 + c];
+        }
+    }
+
+    /** Position in the shadowmap in texels, and the depth */
+    void Project( const ShadowCascade& c, const float p[3], float& u, float& v, float& depth, int resolution ) {
+        float vs[4];
+        float cs[4];
+        Transform( p, c.View, vs );
+        Transform( vs, c.Proj, cs );
+        u = (cs[0] * 0.5f + 0.5f) * resolution;
+        v = (cs[1] * -0.5f + 0.5f) * resolution;
+        depth = cs[2];
+    }
+
+    void RandomDirection( float d[3] ) {
+        float len;
+        do {
+            for ( int a = 0; a < 3; a++ ) d[a] = Random( -1, 1 );
+            len = sqrtf( d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+        } while ( len < 0.1f || len > 1.0f );
+        for ( int a = 0; a < 3; a++ ) d[a] /= len;
+    }
+
+    struct Camera {
+        float Position[3];
+        float Forward[3];
+        float Right[3];
+        float Up[3];
+        float TanX;
+        float TanY;
+    };
+
+    Camera MakeCamera( const float position[3], float yaw, float pitch, float tanX, float tanY ) {
+        Camera c;
+        for ( int a = 0; a < 3; a++ ) c.Position[a] = position[a];
+        c.Forward[0] = sinf( yaw ) * cosf( pitch );
+        c.Forward[1] = sinf( pitch );
+        c.Forward[2] = cosf( yaw ) * cosf( pitch );
+        c.Right[0] = cosf( yaw );
+        c.Right[1] = 0.0f;
+        c.Right[2] = -sinf( yaw );
+        c.Up[0] = c.Forward[1] * c.Right[2] - c.Forward[2] * c.Right[1];
+        c.Up[1] = c.Forward[2] * c.Right[0] - c.Forward[0] * c.Right[2];
+        c.Up[2] = c.Forward[0] * c.Right[1] - c.Forward[1] * c.Right[0];
+        c.TanX = tanX;
+        c.TanY = tanY;
+        return c;
+    }
+
+    /** The 8 corners of a slice of the view frustum */
+    void SliceCorners( const Camera& c, float n, float f, float corners[8][3] ) {
+        int i = 0;
+        for ( float d : { n, f } ) {
+            for ( float sx : { -1.0f, 1.0f } ) {
+                for ( float sy : { -1.0f, 1.0f } ) {
+                    for ( int a = 0; a < 3; a++ ) {
+                        corners[i][a] = c.Position[a] + c.Forward[a] * d + c.Right[a] * sx * d * c.TanX + c.Up[a] * sy * d * c.TanY;
+                    }
+                    i++;
+                }
+            }
+        }
+    }
+
+    void CheckSplitsAndSpheres() {
+        for ( int iter = 0; iter < 2000; iter++ ) {
+            int n = 1 + iter % MAX_SHADOW_CASCADES;
+            float nearZ = Random( 1, 200 );
+            float farZ = nearZ + Random( 100, 30000 );
+            float splits[MAX_SHADOW_CASCADES + 1];
+            ShadowCascadeMath::ComputeSplits( nearZ, farZ, n, Random( 0, 1 ), splits );
+
+            Check( splits[0] == nearZ && splits[n] == farZ, "splits cover the range" );
+            for ( int i = 0; i < n; i++ ) {
+                Check( splits[i] < splits[i + 1], "splits increase" );
+            }
+
+            float pos[3] = { Random( -1e4f, 1e4f ), Random( -1e3f, 1e3f ), Random( -1e4f, 1e4f ) };
+            Camera cam = MakeCamera( pos, Random( -3.14f, 3.14f ), Random( -1.4f, 1.4f ), Random( 0.3f, 2.0f ), Random( 0.3f, 1.5f ) );
+            int s = iter % n;
+            float d;
+            float r;
+            ShadowCascadeMath::FitSliceSphere( splits[s], splits[s + 1], cam.TanX, cam.TanY, d, r );
+
+            float corners[8][3];
+            SliceCorners( cam, splits[s], splits[s + 1], corners );
+            float maxDist = 0.0f;
+            for ( auto& corner : corners ) {
+                float dist = 0.0f;
+                for ( int a = 0; a < 3; a++ ) {
+                    float e = corner[a] - (cam.Position[a] + cam.Forward[a] * d);
+                    dist += e * e;
+                }
+                maxDist = std::max( maxDist, sqrtf( dist ) );
+            }
+            Check( maxDist <= r * 1.0001f + 0.01f, "slice inside its sphere" );
+
+            // Nothing on the view axis does better
+            for ( int i = 0; i <= 100; i++ ) {
+                float t = splits[s] + (splits[s + 1] - splits[s]) * i / 100.0f;
+                float k2 = cam.TanX * cam.TanX + cam.TanY * cam.TanY;
+                float best = std::max( sqrtf( (t - splits[s]) * (t - splits[s]) + splits[s] * splits[s] * k2 ),
+                    sqrtf( (splits[s + 1] - t) * (splits[s + 1] - t) + splits[s + 1] * splits[s + 1] * k2 ) );
+                Check( r <= best * 1.0001f + 0.01f, "sphere is the smallest" );
+            }
+
+            // The matrices map the slice into the shadowmap
+            ShadowCascade c;
+            float center[3];
+            for ( int a = 0; a < 3; a++ ) center[a] = cam.Position[a] + cam.Forward[a] * d;
+            float light[3];
+            RandomDirection( light );
+            light[1] = fabsf( light[1] );
+            if ( iter % 50 == 0 ) {
+                light[0] = 0.0f;
+                light[1] = 1.0f;
+                light[2] = 0.0f;
+            }
+            ShadowCascadeMath::FitCascade( center, r, light, 2048, 6000.0f, c );
+            for ( auto& corner : corners ) {
+                float u;
+                float v;
+                float depth;
+                Project( c, corner, u, v, depth, 2048 );
+                Check( u >= -0.01f && u <= 2048.01f && v >= -0.01f && v <= 2048.01f, "slice inside the shadowmap" );
+                Check( depth >= 0.0f && depth <= 1.0f, "slice inside the depth range" );
+            }
+        }
+    }
+
+    void CheckSnapping() {
+        const int resolution = 2048;
+        float light[3] = { 0.4f, 0.8f, -0.3f };
+        float worldPoint[3] = { 1234.5f, 87.25f, -432.125f };
+
+        float drift = 0.0f;
+        float firstU = 0.0f;
+        float firstV = 0.0f;
+        for ( int frame = 0; frame < 2000; frame++ ) {
+            float center[3] = { frame * 0.37f, frame * 0.05f, frame * -0.23f };
+            ShadowCascade c;
+            ShadowCascadeMath::FitCascade( center, 1533.3f, light, resolution, 6000.0f, c );
+
+            float u;
+            float v;
+            float depth;
+            Project( c, worldPoint, u, v, depth, resolution );
+            float fu = u - floorf( u );
+            float fv = v - floorf( v );
+            if ( frame == 0 ) {
+                firstU = fu;
+                firstV = fv;
+            }
+
+            float du = fabsf( fu - firstU );
+            float dv = fabsf( fv - firstV );
+            drift = std::max( drift, std::max( std::min( du, 1.0f - du ), std::min( dv, 1.0f - dv ) ) );
+        }
+
+        printf( "Snapping: a world point moved at most %.4f texels inside its texel over 2000 camera steps\n", drift );
+        Check( drift < 0.01f, "texel snapping keeps points on their texel" );
+    }
+
+    /** Brute force: does the shadow of any point of the box fall onto the cascades sphere? */
+    bool CastsBruteForce( const ShadowCascade& c, const float min[3], const float max[3] ) {
+        for ( int i = 0; i < 512; i++ ) {
+            float p[3];
+            for ( int a = 0; a < 3; a++ ) {
+                float t = (i >> (a * 3) & 7) / 7.0f;
+                p[a] = min[a] + (max[a] - min[a]) * t - c.Center[a];
+            }
+
+            // Behind the light-view position, clipped anyway
+            float z = p[0] * c.LightDir[0] + p[1] * c.LightDir[1] + p[2] * c.LightDir[2];
+            if ( z > c.DepthExtent ) continue;
+
+            // Closest point of the shadow ray to the center
+            float t = std::max( z, 0.0f );
+            float q[3];
+            for ( int a = 0; a < 3; a++ ) q[a] = p[a] - c.LightDir[a] * t;
+            if ( sqrtf( q[0] * q[0] + q[1] * q[1] + q[2] * q[2] ) <= c.Radius ) return true;
+        }
+        return false;
+    }
+
+    void CheckCulling() {
+        int numCasting = 0;
+        int numPassed = 0;
+        for ( int iter = 0; iter < 20000; iter++ ) {
+            float light[3];
+            RandomDirection( light );
+            light[1] = fabsf( light[1] ) + 0.1f;
+            float center[3] = { Random( -100, 100 ), Random( -100, 100 ), Random( -100, 100 ) };
+            ShadowCascade c;
+            ShadowCascadeMath::FitCascade( center, Random( 200, 2000 ), light, 2048, Random( 1000, 8000 ), c );
+
+            float min[3];
+            float max[3];
+            for ( int a = 0; a < 3; a++ ) {
+                min[a] = Random( -10000, 10000 );
+                max[a] = min[a] + Random( 1, 1500 );
+            }
+
+            bool casts = CastsBruteForce( c, min, max );
+            bool passed = c.TestBox( min, max );
+            Check( passed || !casts, "culling keeps every box which casts onto the cascade" );
+
+            float sphereCenter[3];
+            float r = 0.0f;
+            for ( int a = 0; a < 3; a++ ) {
+                sphereCenter[a] = (min[a] + max[a]) * 0.5f;
+                r += (max[a] - min[a]) * (max[a] - min[a]) * 0.25f;
+            }
+            Check( c.TestSphere( sphereCenter, sqrtf( r ) ) || !casts, "sphere-culling keeps every box which casts onto the cascade" );
+
+            numCasting += casts;
+            numPassed += passed;
+        }
+        printf( "Culling: %d of 20000 random boxes cast onto the cascade, %d passed the test\n", numCasting, numPassed );
+    }
+
+    struct Caster {
+        float Min[3];
+        float Max[3];
+    };
+
+    /** Walks through a world of casters, returns how many casters had to be drawn */
+    void SimulateWalk() {
+        std::vector<Caster> casters( 40000 );
+        for ( Caster& c : casters ) {
+            float size = Random( 50, 800 );
+            c.Min[0] = Random( -32000, 32000 );
+            c.Min[1] = Random( -200, 300 );
+            c.Min[2] = Random( -32000, 32000 );
+            c.Max[0] = c.Min[0] + size;
+            c.Max[1] = c.Min[1] + Random( 100, 1200 );
+            c.Max[2] = c.Min[2] + size;
+        }
+
+        ShadowCascadeSettings settings;
+        ShadowCascadeSet set;
+
+        const int numFrames = 3000;
+        size_t oldDrawn = 0;
+        size_t newDrawn = 0;
+        int renders[MAX_SHADOW_CASCADES] = {};
+        double cullMs = 0.0;
+        float pos[3] = { 0.0f, 180.0f, 0.0f };
+        float yaw = 0.0f;
+        for ( int frame = 0; frame < numFrames; frame++ ) {
+            // Walking at 5 units per frame, looking around, the sun moving slowly
+            yaw += 0.01f * sinf( frame * 0.01f );
+            pos[0] += sinf( yaw ) * 5.0f;
+            pos[2] += cosf( yaw ) * 5.0f;
+            float sunAngle = 0.6f + frame * 0.00002f;
+            float light[3] = { cosf( sunAngle ) * 0.6f, sinf( sunAngle ), cosf( sunAngle ) * 0.8f };
+            Camera cam = MakeCamera( pos, yaw + 0.3f * sinf( frame * 0.05f ), 0.1f * sinf( frame * 0.03f ), 1.0f, 0.5625f );
+
+            // The old shadowmap drew everything around the camera every frame
+            oldDrawn += casters.size();
+
+            auto start = std::chrono::high_resolution_clock::now();
+            unsigned int mask = set.Update( settings, cam.Position, cam.Forward, cam.TanX, cam.TanY, light );
+            for ( int i = 0; i < set.GetNumCascades(); i++ ) {
+                const ShadowCascade& c = set.GetCascade( i );
+                if ( mask & (1u << i) ) {
+                    renders[i]++;
+                    for ( const Caster& caster : casters ) {
+                        newDrawn += c.TestBox( caster.Min, caster.Max );
+                    }
+                }
+
+                // Whatever the cascade holds, it has to cover its slice of the current frustum
+                float corners[8][3];
+                SliceCorners( cam, c.SplitNear, c.SplitFar, corners );
+                for ( auto& corner : corners ) {
+                    float u;
+                    float v;
+                    float depth;
+                    Project( c, corner, u, v, depth, settings.Resolution );
+                    Check( u >= -0.01f && u <= settings.Resolution + 0.01f && v >= -0.01f && v <= settings.Resolution + 0.01f,
+                        "cached cascade still covers its slice" );
+                }
+            }
+            cullMs += std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+        }
+
+        printf( "Walk over %d frames, %zu casters:\n", numFrames, casters.size() );
+        for ( int i = 0; i < set.GetNumCascades(); i++ ) {
+            const ShadowCascade& c = set.GetCascade( i );
+            printf( "  cascade %d: %.0f - %.0f, radius %.0f, %.2f units per texel, rendered in %d frames\n",
+                i, c.SplitNear, c.SplitFar, c.Radius, c.TexelSize, renders[i] );
+        }
+        printf( "  old: 8192 radius, %.2f units per texel, every frame\n", 16384.0f / settings.Resolution );
+        printf( "  casters drawn per frame: old %.0f, new %.0f (culling took %.3f ms per frame)\n",
+            static_cast<double>(oldDrawn) / numFrames, static_cast<double>(newDrawn) / numFrames, cullMs / numFrames );
+    }
+}
+
+int main() {
+    CheckSplitsAndSpheres();
+    CheckSnapping();
+    CheckCulling();
+    SimulateWalk();
+
+    if ( NumErrors ) {
+        printf( "%d errors\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
@@ -0,0 +1,381 @@
+/** Checks the static and dynamic caster sets of the shadowed pointlights
+
+    A few hand-made cases first: Casters outside of the light and duplicates don't get into the static
+    set, moves and additions are ignored until the set is built, and a static caster which moves is
+    taken over into the dynamic set and makes the static map dirty.
+
+    Then a crowd of casters moves around, gets added and removed between lights which collect their
+    static set, render and move themselves every now and then. Every set is compared to a model which
+    keeps for each caster whether it was baked into the map and whether it moved since, and the index
+    of every caster inside of its list has to stay right after all the swap-removes.
+
+    The casters are reported the way the engine does it: Only to the lights whose range in an
+    AABB-tree touches the old or the new bounds of the caster. A second copy of every light gets told
+    about everything, both have to end up the same. Prints how many lights had to be told. */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "DynamicAABBTree.h"
+#include "ShadowCasterSet.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    const float WORLD_SIZE = 20000.0f;
+    const int NUM_LIGHTS = 60;
+    const int NUM_CASTERS = 3000;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    double Seconds( std::chrono::high_resolution_clock::time_point start ) {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+
+    float Random( float min, float max ) {
+        return std::uniform_real_distribution<float>( min, max )(Rng);
+    }
+
+    ShadowCasterSphere MakeSphere( float x, float y, float z, float radius ) {
+        ShadowCasterSphere s;
+        s.Center[0] = x;
+        s.Center[1] = y;
+        s.Center[2] = z;
+        s.Radius = radius;
+        return s;
+    }
+
+    ShadowCasterSphere RandomSphere( float minRadius, float maxRadius ) {
+        return MakeSphere( Random( 0.0f, WORLD_SIZE ), Random( 0.0f, 1000.0f ), Random( 0.0f, WORLD_SIZE ), Random( minRadius, maxRadius ) );
+    }
+
+    /** Checks that every caster is found at its index */
+    void CheckIndices( const ShadowCasterSet<int>& set ) {
+        for ( int c : set.GetStaticCasters() ) {
+            Check( set.IsStatic( c ) && !set.IsDynamic( c ), "static caster is in the static set" );
+        }
+
+        for ( int c : set.GetDynamicCasters() ) {
+            Check( set.IsDynamic( c ) && !set.IsStatic( c ), "dynamic caster is in the dynamic set" );
+        }
+    }
+
+    void TestBasics() {
+        ShadowCasterSet<int> set;
+        ShadowCasterSphere near = MakeSphere( 100, 0, 0, 50 );
+        ShadowCasterSphere far = MakeSphere( 5000, 0, 0, 50 );
+
+        Check( !set.IsBuilt(), "not built before Reset" );
+
+        // Nothing is tracked before the static set exists
+        set.OnCasterMoved( 1, near );
+        set.OnCasterAdded( 2, near );
+        Check( set.GetDynamicCasters().empty() && !set.HasChanged(), "moves and additions are ignored until built" );
+
+        set.Reset( MakeSphere( 0, 0, 0, 500 ) );
+        Check( set.IsBuilt() && set.IsStaticDirty() && set.HasChanged(), "Reset makes the map dirty" );
+
+        Check( set.AddStatic( 1, near ), "caster in range is added" );
+        Check( !set.AddStatic( 1, near ), "caster isn't added twice" );
+        Check( !set.AddStatic( 2, far ), "caster out of range isn't added" );
+        Check( set.AddStatic( 3, near ) && set.AddStatic( 4, near ), "more casters in range are added" );
+        Check( set.GetStaticCasters().size() == 3, "static set holds the casters in range" );
+
+        set.OnStaticRendered();
+        set.ClearChanged();
+
+        // Moving out of range isn't a change for casters the light doesn't know
+        set.OnCasterMoved( 2, far );
+        Check( !set.HasChanged() && !set.IsStaticDirty(), "caster moving far away changes nothing" );
+
+        // A static caster moving inside the light
+        set.OnCasterMoved( 1, near );
+        Check( set.IsDynamic( 1 ) && set.IsStaticDirty() && set.HasChanged(), "moved static caster becomes dynamic" );
+        Check( set.GetStaticCasters().size() == 2, "moved static caster leaves the static set" );
+        CheckIndices( set );
+
+        set.OnStaticRendered();
+        set.ClearChanged();
+
+        // A dynamic caster moving doesn't touch the static map
+        set.OnCasterMoved( 1, near );
+        Check( set.IsDynamic( 1 ) && !set.IsStaticDirty() && set.HasChanged(), "dynamic caster moving keeps the static map" );
+        set.ClearChanged();
+
+        set.OnCasterMoved( 1, far );
+        Check( !set.IsDynamic( 1 ) && !set.IsStaticDirty() && set.HasChanged(), "dynamic caster leaving is dropped" );
+        set.ClearChanged();
+
+        set.OnCasterAdded( 5, far );
+        Check( !set.HasChanged(), "added caster out of range is ignored" );
+        set.OnCasterAdded( 5, near );
+        Check( set.IsDynamic( 5 ) && set.HasChanged() && !set.IsStaticDirty(), "added caster in range becomes dynamic" );
+        set.ClearChanged();
+
+        set.OnCasterRemoved( 3 );
+        Check( !set.IsStatic( 3 ) && set.IsStaticDirty() && set.HasChanged(), "removed static caster makes the map dirty" );
+        CheckIndices( set );
+        set.OnStaticRendered();
+        set.ClearChanged();
+
+        set.OnCasterRemoved( 5 );
+        Check( !set.IsDynamic( 5 ) && !set.IsStaticDirty() && set.HasChanged(), "removed dynamic caster keeps the static map" );
+        set.ClearChanged();
+
+        set.OnCasterRemoved( 42 );
+        Check( !set.HasChanged(), "removing an unknown caster changes nothing" );
+
+        set.InvalidateStatic();
+        Check( set.IsStaticDirty() && set.HasChanged(), "InvalidateStatic makes the map dirty" );
+
+        set.Reset( ShadowCasterSphere() );
+        Check( !set.IsBuilt() && set.GetStaticCasters().empty() && set.GetDynamicCasters().empty(), "Reset with an empty sphere unbuilds" );
+    }
+
+    struct Caster {
+        ShadowCasterSphere Bounds;
+        bool Alive;
+    };
+
+    /** What a light should know about one caster */
+    struct ModelEntry {
+        /** Was in range when the static set was collected */
+        bool Baked;
+
+        /** Moved or got added since then */
+        bool Moved;
+    };
+
+    struct Light {
+        ShadowCasterSphere Range;
+        ShadowCasterSet<int> Set;
+
+        /** Gets told about everything */
+        ShadowCasterSet<int> Reference;
+
+        std::vector<ModelEntry> Model;
+        bool ExpectDirty;
+        int Proxy;
+    };
+
+    struct Scene {
+        std::vector<Caster> Casters;
+        std::vector<Light> Lights;
+        DynamicAABBTree<int> LightTree;
+        size_t NumNotified = 0;
+        size_t NumEvents = 0;
+
+        void Box( const ShadowCasterSphere& s, float* min, float* max ) {
+            for ( int a = 0; a < 3; a++ ) {
+                min[a] = s.Center[a] - s.Radius;
+                max[a] = s.Center[a] + s.Radius;
+            }
+        }
+
+        void BuildLight( int l ) {
+            Light& light = Lights[l];
+            light.Set.Reset( light.Range );
+            light.Reference.Reset( light.Range );
+            light.Model.assign( Casters.size(), ModelEntry() );
+
+            for ( size_t c = 0; c < Casters.size(); c++ ) {
+                if ( !Casters[c].Alive )
+                    continue;
+
+                light.Set.AddStatic( static_cast<int>(c), Casters[c].Bounds );
+                light.Reference.AddStatic( static_cast<int>(c), Casters[c].Bounds );
+                light.Model[c].Baked = ShadowCasterSet<int>::Intersects( light.Range, Casters[c].Bounds );
+            }
+
+            light.ExpectDirty = true;
+
+            float min[3], max[3];
+            Box( light.Range, min, max );
+            if ( light.Proxy == DynamicAABBTree<int>::NULL_NODE ) {
+                light.Proxy = LightTree.Insert( min, max, l );
+            } else {
+                LightTree.Move( light.Proxy, min, max );
+            }
+        }
+
+        /** Like RenderCachedCubemap */
+        void RenderLight( Light& light ) {
+            light.Set.OnStaticRendered();
+            light.Set.ClearChanged();
+            light.Reference.OnStaticRendered();
+            light.Reference.ClearChanged();
+            light.ExpectDirty = false;
+        }
+
+        void MoveCaster( int c, const ShadowCasterSphere& bounds ) {
+            ShadowCasterSphere old = Casters[c].Bounds;
+            Casters[c].Bounds = bounds;
+
+            for ( Light& light : Lights ) {
+                light.Reference.OnCasterMoved( c, bounds );
+
+                ModelEntry& m = light.Model[c];
+                if ( m.Baked && !m.Moved )
+                    light.ExpectDirty = true;
+                m.Moved = true;
+            }
+
+            // Same as GothicAPI::OnVobMoved
+            float min[3], max[3], newMin[3], newMax[3];
+            Box( old, min, max );
+            Box( bounds, newMin, newMax );
+            for ( int a = 0; a < 3; a++ ) {
+                min[a] = std::min( min[a], newMin[a] );
+                max[a] = std::max( max[a], newMax[a] );
+            }
+
+            LightTree.QueryBox( min, max, [&]( int l ) {
+                Lights[l].Set.OnCasterMoved( c, bounds );
+                NumNotified++;
+            } );
+            NumEvents++;
+        }
+
+        void AddCaster( const ShadowCasterSphere& bounds ) {
+            int c = static_cast<int>(Casters.size());
+            Casters.push_back( Caster{ bounds, true } );
+
+            for ( Light& light : Lights ) {
+                light.Model.push_back( ModelEntry{ false, true } );
+                light.Reference.OnCasterAdded( c, bounds );
+            }
+
+            float min[3], max[3];
+            Box( bounds, min, max );
+            LightTree.QueryBox( min, max, [&]( int l ) {
+                Lights[l].Set.OnCasterAdded( c, bounds );
+                NumNotified++;
+            } );
+            NumEvents++;
+        }
+
+        /** Removals still go to every light, they may hold the caster in their caches */
+        void RemoveCaster( int c ) {
+            Casters[c].Alive = false;
+
+            for ( Light& light : Lights ) {
+                light.Set.OnCasterRemoved( c );
+                light.Reference.OnCasterRemoved( c );
+
+                ModelEntry& m = light.Model[c];
+                if ( m.Baked && !m.Moved )
+                    light.ExpectDirty = true;
+            }
+        }
+
+        void CheckLight( const Light& light ) {
+            std::vector<int> statics = light.Set.GetStaticCasters();
+            std::vector<int> dynamics = light.Set.GetDynamicCasters();
+            std::vector<int> refStatics = light.Reference.GetStaticCasters();
+            std::vector<int> refDynamics = light.Reference.GetDynamicCasters();
+            std::sort( statics.begin(), statics.end() );
+            std::sort( dynamics.begin(), dynamics.end() );
+            std::sort( refStatics.begin(), refStatics.end() );
+            std::sort( refDynamics.begin(), refDynamics.end() );
+
+            Check( statics == refStatics && dynamics == refDynamics, "lights told through the tree match lights told everything" );
+            Check( light.Set.IsStaticDirty() == light.Reference.IsStaticDirty(), "dirty state matches the light told everything" );
+            Check( light.Set.IsStaticDirty() == light.ExpectDirty, "static map is dirty exactly when a baked caster moved or left" );
+
+            std::vector<int> expectedStatics, expectedDynamics;
+            for ( size_t c = 0; c < Casters.size(); c++ ) {
+                if ( !Casters[c].Alive )
+                    continue;
+
+                const ModelEntry& m = light.Model[c];
+                if ( m.Baked && !m.Moved ) {
+                    expectedStatics.push_back( static_cast<int>(c) );
+                } else if ( m.Moved && ShadowCasterSet<int>::Intersects( light.Range, Casters[c].Bounds ) ) {
+                    expectedDynamics.push_back( static_cast<int>(c) );
+                }
+            }
+
+            Check( statics == expectedStatics, "static set holds the baked casters which didn't move" );
+            Check( dynamics == expectedDynamics, "dynamic set holds the moved casters in range" );
+            CheckIndices( light.Set );
+        }
+    };
+
+    void TestRandom() {
+        Scene scene;
+        for ( int c = 0; c < NUM_CASTERS; c++ ) {
+            scene.Casters.push_back( Caster{ RandomSphere( 20.0f, 300.0f ), true } );
+        }
+
+        scene.Lights.resize( NUM_LIGHTS );
+        for ( int l = 0; l < NUM_LIGHTS; l++ ) {
+            scene.Lights[l].Range = RandomSphere( 500.0f, 2500.0f );
+            scene.Lights[l].Proxy = DynamicAABBTree<int>::NULL_NODE;
+            scene.BuildLight( l );
+            scene.RenderLight( scene.Lights[l] );
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for ( int step = 0; step < 20000; step++ ) {
+            int op = std::uniform_int_distribution<int>( 0, 99 )(Rng);
+            int c = std::uniform_int_distribution<int>( 0, static_cast<int>(scene.Casters.size()) - 1 )(Rng);
+
+            if ( op < 70 ) {
+                if ( !scene.Casters[c].Alive )
+                    continue;
+
+                // Mostly small steps, sometimes across the world
+                ShadowCasterSphere bounds = scene.Casters[c].Bounds;
+                if ( op < 60 ) {
+                    for ( int a = 0; a < 3; a++ )
+                        bounds.Center[a] += Random( -200.0f, 200.0f );
+                } else {
+                    bounds = RandomSphere( 20.0f, 300.0f );
+                }
+
+                scene.MoveCaster( c, bounds );
+            } else if ( op < 80 ) {
+                scene.AddCaster( RandomSphere( 20.0f, 300.0f ) );
+            } else if ( op < 88 ) {
+                if ( scene.Casters[c].Alive )
+                    scene.RemoveCaster( c );
+            } else if ( op < 90 ) {
+                // The light moved, it collects its static set again
+                int l = std::uniform_int_distribution<int>( 0, NUM_LIGHTS - 1 )(Rng);
+                scene.Lights[l].Range = RandomSphere( 500.0f, 2500.0f );
+                scene.BuildLight( l );
+            } else {
+                int l = std::uniform_int_distribution<int>( 0, NUM_LIGHTS - 1 )(Rng);
+                scene.RenderLight( scene.Lights[l] );
+            }
+
+            if ( step % 500 == 0 ) {
+                for ( const Light& light : scene.Lights )
+                    scene.CheckLight( light );
+            }
+        }
+        double time = Seconds( start );
+
+        for ( const Light& light : scene.Lights )
+            scene.CheckLight( light );
+
+        printf( "%zu moves and additions: %.2f lights told on average instead of %d, %.1f ms\n",
+            scene.NumEvents, static_cast<double>(scene.NumNotified) / static_cast<double>(scene.NumEvents), NUM_LIGHTS, time * 1000.0 );
+    }
+}
+
+int main() {
+    TestBasics();
+    TestRandom();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
@@ -0,0 +1,327 @@
+/** Benchmark for the worldmesh clusters of the pointlight shadows
+
+    Loads the geometry written by GothicAPI::SaveShadowGeometry (NUMPAD8 in non-release builds, saved
+    to system\GD3D11\ShadowGeometry.bin), or makes up a world of hills and scattered houses when no file
+    is given. It's split into clusters like the renderer does, and for all pointlights it prints how many
+    triangles the shadowcubes have to draw:
+
+        sections    - all meshes of the sections next to the light, like it was done before
+        clusters    - only the clusters touching the light-sphere
+        in range    - triangles which actually touch the light-sphere, the lower bound
+
+    Every triangle in range has to be inside of one of the clusters the light gets. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include "TriangleClusterSet.h"
+
+namespace {
+    int NumErrors = 0;
+
+    const float SECTION_SIZE = 16000.0f;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    struct Mesh {
+        std::vector<float> Positions;
+        std::vector<uint16_t> Indices;
+        unsigned int BaseIndexLocation;
+    };
+
+    struct Section {
+        int X, Y;
+        std::vector<Mesh> Meshes;
+        TriangleClusterSet<const Mesh*> Clusters;
+    };
+
+    struct Light {
+        float Position[3];
+        float Range;
+        int SectionX, SectionY;
+    };
+
+    template <typename T>
+    bool Read( FILE* f, T* data, size_t count = 1 ) {
+        return fread( data, sizeof( T ), count, f ) == count;
+    }
+
+    /** Loads the file written by GothicAPI::SaveShadowGeometry */
+    bool LoadShadowGeometry( const char* file, std::vector<std::unique_ptr<Section>>& sections, std::vector<Light>& lights ) {
+        FILE* f = fopen( file, "rb" );
+        if ( !f )
+            return false;
+
+        uint32_t version = 0, numSections = 0;
+        if ( !Read( f, &version ) || version != 1 || !Read( f, &numSections ) ) {
+            fclose( f );
+            return false;
+        }
+
+        // Indices of all meshes are packed into one buffer, like the wrapped worldmesh
+        unsigned int baseIndexLocation = 0;
+        for ( uint32_t s = 0; s < numSections; s++ ) {
+            std::unique_ptr<Section> section = std::make_unique<Section>();
+
+            int32_t xy[2];
+            uint32_t numMeshes = 0;
+            if ( !Read( f, xy, 2 ) || !Read( f, &numMeshes ) ) {
+                fclose( f );
+                return false;
+            }
+
+            section->X = xy[0];
+            section->Y = xy[1];
+            section->Meshes.resize( numMeshes );
+
+            for ( Mesh& mesh : section->Meshes ) {
+                uint32_t numVertices = 0, numIndices = 0;
+                if ( !Read( f, &numVertices ) ) {
+                    fclose( f );
+                    return false;
+                }
+
+                mesh.Positions.resize( numVertices * 3 );
+                if ( (numVertices && !Read( f, &mesh.Positions[0], mesh.Positions.size() )) || !Read( f, &numIndices ) ) {
+                    fclose( f );
+                    return false;
+                }
+
+                mesh.Indices.resize( numIndices );
+                if ( numIndices && !Read( f, &mesh.Indices[0], numIndices ) ) {
+                    fclose( f );
+                    return false;
+                }
+
+                mesh.BaseIndexLocation = baseIndexLocation;
+                baseIndexLocation += numIndices;
+            }
+
+            sections.push_back( std::move( section ) );
+        }
+
+        uint32_t numLights = 0;
+        if ( !Read( f, &numLights ) ) {
+            fclose( f );
+            return false;
+        }
+
+        lights.resize( numLights );
+        for ( Light& light : lights ) {
+            int32_t xy[2];
+            if ( !Read( f, light.Position, 3 ) || !Read( f, &light.Range ) || !Read( f, xy, 2 ) ) {
+                fclose( f );
+                return false;
+            }
+
+            light.SectionX = xy[0];
+            light.SectionY = xy[1];
+        }
+
+        fclose( f );
+        return true;
+    }
+
+    /** Adds a triangle to the mesh, with vertices of its own */
+    void AddTriangle( Mesh& mesh, const float a[3], const float b[3], const float c[3] ) {
+        for ( const float* p : { a, b, c } ) {
+            mesh.Indices.push_back( static_cast<uint16_t>(mesh.Positions.size() / 3) );
+            mesh.Positions.insert( mesh.Positions.end(), p, p + 3 );
+        }
+    }
+
+    /** Makes up a world of size x size sections. Each one has a hilly ground and a few houses, which are
+        boxes of loose triangles, and lights are spread over the ground. */
+    void MakeShadowGeometry( int size, int numLights, std::vector<std::unique_ptr<Section>>& sections, std::vector<Light>& lights ) {
+        std::mt19937 rng( 1234 );
+        std::uniform_real_distribution<float> unit( 0.0f, 1.0f );
+
+        const int GRID = 32;
+        const float cell = SECTION_SIZE / GRID;
+        auto height = []( float x, float z ) { return 600.0f * std::sin( x * 0.0007f ) * std::cos( z * 0.0005f ); };
+
+        unsigned int baseIndexLocation = 0;
+        for ( int sx = 0; sx < size; sx++ ) {
+            for ( int sy = 0; sy < size; sy++ ) {
+                std::unique_ptr<Section> section = std::make_unique<Section>();
+                section->X = sx;
+                section->Y = sy;
+                section->Meshes.resize( 2 );
+
+                // Ground, as a grid of shared vertices
+                Mesh& ground = section->Meshes[0];
+                for ( int z = 0; z <= GRID; z++ ) {
+                    for ( int x = 0; x <= GRID; x++ ) {
+                        const float px = sx * SECTION_SIZE + x * cell, pz = sy * SECTION_SIZE + z * cell;
+                        ground.Positions.insert( ground.Positions.end(), { px, height( px, pz ), pz } );
+                    }
+                }
+
+                for ( int z = 0; z < GRID; z++ ) {
+                    for ( int x = 0; x < GRID; x++ ) {
+                        const uint16_t i = static_cast<uint16_t>(z * (GRID + 1) + x);
+                        ground.Indices.insert( ground.Indices.end(), { i, static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + GRID + 1),
+                            static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i + GRID + 2), static_cast<uint16_t>(i + GRID + 1) } );
+                    }
+                }
+
+                // Houses, the walls of a box split into strips
+                Mesh& houses = section->Meshes[1];
+                for ( int h = 0; h < 12; h++ ) {
+                    const float x0 = sx * SECTION_SIZE + unit( rng ) * (SECTION_SIZE - 1000.0f), z0 = sy * SECTION_SIZE + unit( rng ) * (SECTION_SIZE - 1000.0f);
+                    const float w = 300.0f + unit( rng ) * 600.0f, y0 = height( x0, z0 ), y1 = y0 + 400.0f;
+                    const float corners[5][2] = { { x0, z0 }, { x0 + w, z0 }, { x0 + w, z0 + w }, { x0, z0 + w }, { x0, z0 } };
+
+                    for ( int c = 0; c < 4; c++ ) {
+                        for ( int strip = 0; strip < 8; strip++ ) {
+                            const float t0 = strip / 8.0f, t1 = (strip + 1) / 8.0f;
+                            const float ax = corners[c][0] + (corners[c + 1][0] - corners[c][0]) * t0, az = corners[c][1] + (corners[c + 1][1] - corners[c][1]) * t0;
+                            const float bx = corners[c][0] + (corners[c + 1][0] - corners[c][0]) * t1, bz = corners[c][1] + (corners[c + 1][1] - corners[c][1]) * t1;
+                            const float p0[3] = { ax, y0, az }, p1[3] = { bx, y0, bz }, p2[3] = { bx, y1, bz }, p3[3] = { ax, y1, az };
+                            AddTriangle( houses, p0, p1, p2 );
+                            AddTriangle( houses, p0, p2, p3 );
+                        }
+                    }
+                }
+
+                for ( Mesh& mesh : section->Meshes ) {
+                    mesh.BaseIndexLocation = baseIndexLocation;
+                    baseIndexLocation += static_cast<unsigned int>(mesh.Indices.size());
+                }
+
+                sections.push_back( std::move( section ) );
+            }
+        }
+
+        lights.resize( numLights );
+        for ( Light& light : lights ) {
+            light.Position[0] = unit( rng ) * size * SECTION_SIZE;
+            light.Position[2] = unit( rng ) * size * SECTION_SIZE;
+            light.Position[1] = height( light.Position[0], light.Position[2] ) + 100.0f + unit( rng ) * 400.0f;
+            light.Range = 300.0f + unit( rng ) * 2700.0f;
+            light.SectionX = static_cast<int>(light.Position[0] / SECTION_SIZE);
+            light.SectionY = static_cast<int>(light.Position[2] / SECTION_SIZE);
+        }
+    }
+
+    /** Whether the triangle starting at the given index has at least one vertex inside the sphere */
+    bool TriangleInRange( const Mesh& mesh, size_t i, const float center[3], float radius ) {
+        for ( int v = 0; v < 3; v++ ) {
+            const float* p = &mesh.Positions[mesh.Indices[i + v] * 3];
+            const float dx = p[0] - center[0], dy = p[1] - center[1], dz = p[2] - center[2];
+            if ( dx * dx + dy * dy + dz * dz < radius * radius )
+                return true;
+        }
+
+        return false;
+    }
+
+    /** Number of triangles having at least one vertex inside the sphere, which all have to be covered by the ranges */
+    size_t CountTrianglesInRange( const Mesh& mesh, const float center[3], float radius, const std::vector<TriangleClusterSet<const Mesh*>::Range>& ranges, size_t& numMissed ) {
+        size_t n = 0;
+        for ( size_t i = 0; i + 2 < mesh.Indices.size(); i += 3 ) {
+            if ( !TriangleInRange( mesh, i, center, radius ) )
+                continue;
+
+            n++;
+            const size_t index = mesh.BaseIndexLocation + i;
+            bool covered = false;
+            for ( const auto& r : ranges ) {
+                if ( r.MeshHandle == &mesh && index >= r.FirstIndex && index + 3 <= r.FirstIndex + r.NumIndices ) {
+                    covered = true;
+                    break;
+                }
+            }
+
+            if ( !covered )
+                numMissed++;
+        }
+
+        return n;
+    }
+}
+
+int main( int argc, char** argv ) {
+    std::vector<std::unique_ptr<Section>> sections;
+    std::vector<Light> lights;
+    if ( argc > 1 ) {
+        if ( !LoadShadowGeometry( argv[1], sections, lights ) ) {
+            printf( "Failed to read shadow geometry from '%s'\n", argv[1] );
+            return 1;
+        }
+    } else {
+        MakeShadowGeometry( 8, 500, sections, lights );
+    }
+
+    // Build clusters
+    auto start = std::chrono::steady_clock::now();
+    size_t numTriangles = 0, numClusters = 0;
+    for ( auto& section : sections ) {
+        for ( const Mesh& mesh : section->Meshes ) {
+            if ( !mesh.Indices.empty() )
+                section->Clusters.AddMesh( &mesh, &mesh.Positions[0], sizeof( float ) * 3, &mesh.Indices[0], static_cast<unsigned int>(mesh.Indices.size()), mesh.BaseIndexLocation );
+        }
+
+        numTriangles += section->Clusters.GetNumTriangles();
+        numClusters += section->Clusters.GetNumClusters();
+    }
+
+    const double buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    printf( "%zu sections, %zu triangles, %zu clusters, built in %.2f ms\n", sections.size(), numTriangles, numClusters, buildMs );
+
+    // Query like the shadowcubes do, with the range they use
+    size_t sumSections = 0, sumClusters = 0, sumInRange = 0, numRanges = 0, numMissed = 0;
+    double queryUs = 0.0;
+    std::vector<TriangleClusterSet<const Mesh*>::Range> ranges;
+
+    for ( const Light& light : lights ) {
+        const float range = light.Range * 1.1f;
+
+        ranges.clear();
+        auto queryStart = std::chrono::steady_clock::now();
+        for ( auto& section : sections ) {
+            sumClusters += section->Clusters.QuerySphere( light.Position, range, ranges );
+        }
+
+        queryUs += std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - queryStart ).count();
+        numRanges += ranges.size();
+
+        for ( auto& section : sections ) {
+            const float dx = static_cast<float>(section->X - light.SectionX);
+            const float dy = static_cast<float>(section->Y - light.SectionY);
+            if ( std::sqrt( dx * dx + dy * dy ) < 2.0f )
+                sumSections += section->Clusters.GetNumTriangles();
+
+            if ( TriangleClusterSet<const Mesh*>::SphereIntersectsBox( light.Position, range, section->Clusters.GetMin(), section->Clusters.GetMax() ) ) {
+                for ( const Mesh& mesh : section->Meshes )
+                    sumInRange += CountTrianglesInRange( mesh, light.Position, range, ranges, numMissed );
+            }
+        }
+    }
+
+    Check( numMissed == 0, "all triangles in range are inside of a cluster of the light" );
+
+    if ( lights.empty() ) {
+        printf( "No lights in the file\n" );
+    } else {
+        const double n = static_cast<double>(lights.size());
+        printf( "%zu lights, triangles per light:\n", lights.size() );
+        printf( "  sections %12.1f\n", sumSections / n );
+        printf( "  clusters %12.1f (%.1f drawcalls, %.2f us per query)\n", sumClusters / n, numRanges / n, queryUs / n );
+        printf( "  in range %12.1f\n", sumInRange / n );
+    }
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
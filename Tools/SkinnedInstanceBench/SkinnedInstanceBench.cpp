@@ -0,0 +1,240 @@
+/** Checks the grouping and bone palette of the skinned instancing and shows what it saves over one draw call per submesh
+
+    Every instance has to end up in exactly one group, the one of its mesh and texture, keep its
+    data and the order it was added in, and its bone offset has to point at the bones of its model.
+    Models without bones must not create instances. Then a town full of NPCs is drawn, once like
+    before with two constantbuffer updates per model and one draw call per submesh, once by
+    collecting everything into the palette and the instance groups. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <vector>
+#include "SkinnedInstanceBatcher.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool ok, const char* what ) {
+        if ( !ok ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    // Same as NUM_MAX_BONES of the shaders
+    const uint32_t NUM_MAX_BONES = 96;
+
+    struct Visual {
+        uint32_t NumBones;
+        std::vector<int> Submeshes;
+        int NumTextureVariations;
+    };
+
+    struct Model {
+        const Visual* Vis;
+        int TextureVariation;
+        std::vector<float> Bones;
+        SkinnedInstanceData Instance;
+    };
+
+    std::vector<Visual> MakeVisuals( int count, int firstSubmesh ) {
+        std::vector<Visual> visuals( count );
+        int submesh = firstSubmesh;
+        for ( Visual& v : visuals ) {
+            v.NumBones = 20 + Rng() % 60;
+            v.Submeshes.resize( 1 + Rng() % 4 );
+            for ( int& s : v.Submeshes ) {
+                s = submesh++;
+            }
+            v.NumTextureVariations = 1 + Rng() % 4;
+        }
+        return visuals;
+    }
+
+    Model MakeModel( const std::vector<Visual>& visuals ) {
+        std::uniform_real_distribution<float> dist( -1.0f, 1.0f );
+
+        Model m;
+        m.Vis = &visuals[Rng() % visuals.size()];
+        m.TextureVariation = Rng() % m.Vis->NumTextureVariations;
+        m.Bones.resize( m.Vis->NumBones * 16 );
+        for ( float& f : m.Bones ) {
+            f = dist( Rng );
+        }
+
+        for ( float& f : m.Instance.World ) {
+            f = dist( Rng );
+        }
+        for ( float& f : m.Instance.Color ) {
+            f = dist( Rng );
+        }
+        m.Instance.Fatness = dist( Rng );
+        m.Instance.Pad[0] = m.Instance.Pad[1] = 0;
+        return m;
+    }
+
+    // Meshes and textures are only compared, so fake pointers are enough
+    const void* MeshPtr( int submesh ) { return reinterpret_cast<const void*>(static_cast<uintptr_t>(0x1000 + submesh * 16)); }
+    const void* TexturePtr( int submesh, int variation ) { return reinterpret_cast<const void*>(static_cast<uintptr_t>(0x100000 + submesh * 64 + variation * 16)); }
+
+    void AddModel( SkinnedInstanceBatcher& batcher, Model& m ) {
+        m.Instance.BoneOffset = batcher.AddPalette( m.Bones.data(), m.Vis->NumBones );
+        for ( int s : m.Vis->Submeshes ) {
+            batcher.AddInstance( MeshPtr( s ), TexturePtr( s, m.TextureVariation ), m.Instance );
+        }
+    }
+
+    void CheckBatches() {
+        std::vector<Visual> visuals = MakeVisuals( 12, 0 );
+        SkinnedInstanceBatcher batcher;
+
+        for ( int round = 0; round < 3; round++ ) {
+            batcher.Clear();
+
+            std::vector<Model> models;
+            for ( int i = 0; i < 300; i++ ) {
+                models.push_back( MakeModel( visuals ) );
+            }
+
+            // Tag every instance with its model, to check the order and where the bones are
+            std::map<std::pair<const void*, const void*>, std::vector<int>> expected;
+            size_t numExpected = 0;
+            for ( size_t i = 0; i < models.size(); i++ ) {
+                models[i].Instance.Color[0] = static_cast<float>(i);
+                AddModel( batcher, models[i] );
+                for ( int s : models[i].Vis->Submeshes ) {
+                    expected[{ MeshPtr( s ), TexturePtr( s, models[i].TextureVariation ) }].push_back( static_cast<int>(i) );
+                    numExpected++;
+                }
+            }
+
+            // A model without bones can't be drawn
+            Model empty = MakeModel( visuals );
+            empty.Instance.BoneOffset = batcher.AddPalette( nullptr, 0 );
+            Check( empty.Instance.BoneOffset == SkinnedInstanceBatcher::INVALID_OFFSET, "no bones, no offset" );
+            batcher.AddInstance( MeshPtr( 0 ), TexturePtr( 0, 0 ), empty.Instance );
+
+            batcher.Build();
+
+            const auto& instances = batcher.GetInstances();
+            const auto& groups = batcher.GetGroups();
+            const auto& palette = batcher.GetPalette();
+
+            Check( instances.size() == numExpected, "every submesh once" );
+            Check( groups.size() == expected.size(), "one group per mesh and texture" );
+
+            uint32_t next = 0;
+            for ( const SkinnedInstanceGroup& g : groups ) {
+                Check( g.FirstInstance == next, "groups follow each other" );
+                next += g.NumInstances;
+
+                auto it = expected.find( { g.Mesh, g.Texture } );
+                if ( it == expected.end() ) {
+                    Check( false, "group for an unknown mesh" );
+                    continue;
+                }
+
+                Check( it->second.size() == g.NumInstances, "group size" );
+                for ( uint32_t i = 0; i < g.NumInstances && i < it->second.size(); i++ ) {
+                    const SkinnedInstanceData& inst = instances[g.FirstInstance + i];
+                    const Model& m = models[it->second[i]];
+
+                    Check( inst.Color[0] == static_cast<float>(it->second[i]), "order inside a group" );
+                    Check( memcmp( inst.World, m.Instance.World, sizeof( inst.World ) ) == 0, "world matrix kept" );
+                    Check( inst.Fatness == m.Instance.Fatness, "fatness kept" );
+                    Check( (inst.BoneOffset + m.Vis->NumBones) * 16 <= palette.size(), "bones inside the palette" );
+                    if ( (inst.BoneOffset + m.Vis->NumBones) * 16 <= palette.size() ) {
+                        Check( memcmp( &palette[inst.BoneOffset * 16], m.Bones.data(), m.Bones.size() * sizeof( float ) ) == 0, "offset points at the bones of the model" );
+                    }
+                }
+            }
+            Check( next == instances.size(), "groups cover all instances" );
+        }
+
+        batcher.Clear();
+        batcher.Build();
+        Check( batcher.IsEmpty() && batcher.GetGroups().empty() && batcher.GetInstances().empty(), "empty after clear" );
+    }
+
+    void SimulateTown() {
+        std::vector<Visual> visuals = MakeVisuals( 8, 0 );
+
+        for ( int numModels : { 40, 150, 400 } ) {
+            std::vector<Model> models;
+            for ( int i = 0; i < numModels; i++ ) {
+                models.push_back( MakeModel( visuals ) );
+            }
+
+            const int numFrames = 200;
+            double oldSeconds = 0.0, newSeconds = 0.0;
+            size_t oldDraws = 0, newDraws = 0, oldUpdates = 0, newUpdates = 0;
+            float checksum = 0.0f;
+
+            // Stand-ins for the constantbuffers and the two dynamic buffers
+            std::vector<float> cbInstance( 32 );
+            std::vector<float> cbBones( NUM_MAX_BONES * 16 );
+            std::vector<float> paletteBuffer;
+            std::vector<SkinnedInstanceData> instanceBuffer;
+
+            SkinnedInstanceBatcher batcher;
+            for ( int frame = 0; frame < numFrames; frame++ ) {
+                // Before: per model world/color and bones into their constantbuffers, one draw per submesh
+                auto start = std::chrono::high_resolution_clock::now();
+                for ( const Model& m : models ) {
+                    memcpy( cbInstance.data(), m.Instance.World, 16 * sizeof( float ) );
+                    memcpy( cbInstance.data() + 16, m.Instance.Color, 4 * sizeof( float ) );
+                    cbInstance[20] = m.Instance.Fatness;
+                    memcpy( cbBones.data(), m.Bones.data(), m.Bones.size() * sizeof( float ) );
+                    oldUpdates += 2;
+
+                    for ( int s : m.Vis->Submeshes ) {
+                        checksum += cbBones[s % cbBones.size()];
+                        oldDraws++;
+                    }
+                }
+                oldSeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+
+                // After: everything into the palette and groups, two buffer updates, one draw per group
+                start = std::chrono::high_resolution_clock::now();
+                batcher.Clear();
+                for ( Model& m : models ) {
+                    AddModel( batcher, m );
+                }
+                batcher.Build();
+
+                paletteBuffer.assign( batcher.GetPalette().begin(), batcher.GetPalette().end() );
+                instanceBuffer.assign( batcher.GetInstances().begin(), batcher.GetInstances().end() );
+                newUpdates += 2;
+
+                for ( const SkinnedInstanceGroup& g : batcher.GetGroups() ) {
+                    checksum += instanceBuffer[g.FirstInstance].Fatness + paletteBuffer[instanceBuffer[g.FirstInstance].BoneOffset * 16];
+                    newDraws++;
+                }
+                newSeconds += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+            }
+
+            printf( "%d NPCs of %zu visuals (checksum %g)\n", numModels, visuals.size(), checksum );
+            printf( "  per model:  %7.3f ms/frame, %6.0f draw calls, %6.0f buffer updates\n",
+                oldSeconds * 1000.0 / numFrames, static_cast<double>(oldDraws) / numFrames, static_cast<double>(oldUpdates) / numFrames );
+            printf( "  instanced:  %7.3f ms/frame, %6.0f draw calls, %6.0f buffer updates\n",
+                newSeconds * 1000.0 / numFrames, static_cast<double>(newDraws) / numFrames, static_cast<double>(newUpdates) / numFrames );
+        }
+    }
+}
+
+int main() {
+    CheckBatches();
+    SimulateTown();
+
+    if ( NumErrors ) {
+        printf( "%d errors\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
@@ -0,0 +1,334 @@
+/** Round-trip fuzzing of the snapshot format (.gsnap)
+
+    Compresses random data of different kinds and checks it comes back unchanged, feeds broken
+    streams to the decompressor, then plays through many editing sessions: chunks are added, changed
+    and removed at random, saved incrementally and read back by a fresh archive. Broken files are
+    made by flipping bytes and by cutting off a save halfway, which has to give back the state
+    before that save. Run with a sanitizer to catch reads outside of the buffers. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+#include "SnapshotArchive.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+
+    uint32_t RandInt( uint32_t a, uint32_t b ) {
+        return std::uniform_int_distribution<uint32_t>( a, b )( Rng );
+    }
+
+    /** Random data, some of it compressible like the real chunks */
+    std::vector<uint8_t> RandomData( size_t size ) {
+        std::vector<uint8_t> d( size );
+        switch ( RandInt( 0, 3 ) ) {
+        case 0: // Noise
+            for ( auto& b : d ) b = static_cast<uint8_t>(RandInt( 0, 255 ));
+            break;
+
+        case 1: // Few symbols, long runs
+            for ( size_t i = 0; i < size; i++ ) d[i] = static_cast<uint8_t>(i / RandInt( 1, 64 ) % 3);
+            break;
+
+        case 2: { // Floats like vegetation positions
+            float v = 0.0f;
+            for ( size_t i = 0; i + 4 <= size; i += 4 ) {
+                v += std::uniform_real_distribution<float>( 0.0f, 50.0f )( Rng );
+                memcpy( &d[i], &v, 4 );
+            }
+            break;
+        }
+
+        default: // Repeated pattern
+            for ( size_t i = 0; i < size; i++ ) d[i] = static_cast<uint8_t>("vegetation"[i % 10]);
+            break;
+        }
+        return d;
+    }
+
+    std::vector<uint8_t> ReadWholeFile( const char* file ) {
+        std::vector<uint8_t> d;
+        FILE* f = fopen( file, "rb" );
+        if ( !f ) return d;
+        fseek( f, 0, SEEK_END );
+        d.resize( ftell( f ) );
+        fseek( f, 0, SEEK_SET );
+        if ( !d.empty() && fread( d.data(), d.size(), 1, f ) != 1 ) d.clear();
+        fclose( f );
+        return d;
+    }
+
+    void WriteWholeFile( const char* file, const std::vector<uint8_t>& d ) {
+        FILE* f = fopen( file, "wb" );
+        fwrite( d.data(), d.size(), 1, f );
+        fclose( f );
+    }
+
+    typedef std::map<uint64_t, std::vector<uint8_t>> Model;
+
+    /** Checks that the archive holds exactly the model */
+    size_t Compare( const SnapshotArchive& a, const Model& model ) {
+        size_t errors = 0;
+        size_t numKeys = 0;
+        for ( uint32_t type = 0; type < 3; type++ ) {
+            numKeys += a.GetKeys( type ).size();
+        }
+        if ( numKeys != model.size() )
+            errors++;
+
+        std::vector<uint8_t> data;
+        for ( auto const& it : model ) {
+            if ( !a.Read( it.first, data ) || data != it.second )
+                errors++;
+        }
+        return errors;
+    }
+
+    size_t TestCodec() {
+        size_t errors = 0;
+        std::vector<uint8_t> packed, unpacked, shuffled;
+        size_t raw = 0, compressed = 0;
+
+        for ( int i = 0; i < 3000; i++ ) {
+            const std::vector<uint8_t> d = RandomData( RandInt( 0, 1 ) ? RandInt( 0, 64 ) : RandInt( 0, 100000 ) );
+
+            shuffled.resize( d.size() );
+            unpacked.resize( d.size() );
+            SnapshotCodec::Shuffle( d.data(), d.size(), shuffled.data() );
+            SnapshotCodec::Unshuffle( shuffled.data(), d.size(), unpacked.data() );
+            if ( unpacked != d )
+                errors++;
+
+            raw += d.size();
+            if ( !SnapshotCodec::Compress( d.data(), d.size(), packed ) ) {
+                compressed += d.size();
+                continue;
+            }
+
+            compressed += packed.size();
+            if ( !SnapshotCodec::Decompress( packed.data(), packed.size(), unpacked.data(), unpacked.size() ) || unpacked != d )
+                errors++;
+
+            // Wrong sizes have to be rejected
+            if ( !d.empty() && SnapshotCodec::Decompress( packed.data(), packed.size(), unpacked.data(), unpacked.size() - 1 ) )
+                errors++;
+
+            // Broken streams must never get out of bounds. Whatever comes out, it must fit.
+            for ( int m = 0; m < 8; m++ ) {
+                std::vector<uint8_t> broken = packed;
+                if ( RandInt( 0, 1 ) ) {
+                    broken[RandInt( 0, static_cast<uint32_t>(broken.size() - 1) )] ^= static_cast<uint8_t>(RandInt( 1, 255 ));
+                } else {
+                    broken.resize( RandInt( 0, static_cast<uint32_t>(broken.size() - 1) ) );
+                }
+
+                std::vector<uint8_t> out( d.size() );
+                SnapshotCodec::Decompress( broken.data(), broken.size(), out.data(), out.size() );
+            }
+        }
+
+        // Pure garbage
+        for ( int i = 0; i < 20000; i++ ) {
+            std::vector<uint8_t> garbage( RandInt( 0, 256 ) );
+            for ( auto& b : garbage ) b = static_cast<uint8_t>(RandInt( 0, 255 ));
+            std::vector<uint8_t> out( RandInt( 0, 1024 ) );
+            SnapshotCodec::Decompress( garbage.data(), garbage.size(), out.data(), out.size() );
+        }
+
+        printf( "Codec: %zu errors, %.1f%% of the original size\n", errors, 100.0 * compressed / std::max<size_t>( 1, raw ) );
+        return errors;
+    }
+
+    size_t TestSessions() {
+        const char* file = "SnapshotFuzz.gsnap";
+        const char* crashFile = "SnapshotFuzz_crash.gsnap";
+        size_t errors = 0;
+        size_t saves = 0, compactions = 0, written = 0, crashes = 0, corruptions = 0;
+
+        for ( int session = 0; session < 40; session++ ) {
+            remove( file );
+
+            SnapshotArchive archive;
+            if ( archive.Open( file ) )
+                errors++;
+
+            Model model;
+            std::map<uint64_t, bool> dirty;
+
+            // Crcs of every version of a chunk that was ever saved
+            std::map<uint64_t, std::set<uint32_t>> history;
+            uint32_t nextId = 1;
+
+            for ( int round = 0; round < 30; round++ ) {
+                // Edit
+                const int numEdits = static_cast<int>(RandInt( 0, 12 ));
+                for ( int e = 0; e < numEdits; e++ ) {
+                    const uint32_t what = RandInt( 0, 9 );
+                    if ( what < 4 || model.empty() ) {
+                        const uint64_t key = MakeSnapshotKey( RandInt( 0, 2 ), nextId++ );
+                        model[key] = RandomData( RandInt( 0, 20000 ) );
+                        dirty[key] = true;
+                    } else {
+                        auto it = model.begin();
+                        std::advance( it, RandInt( 0, static_cast<uint32_t>(model.size() - 1) ) );
+                        if ( what < 8 ) {
+                            it->second = RandomData( RandInt( 0, 20000 ) );
+                            dirty[it->first] = true;
+                        } else {
+                            dirty.erase( it->first );
+                            model.erase( it );
+                        }
+                    }
+                }
+
+                // Save, only the dirty chunks carry data. Sometimes everything, which must be detected as unchanged.
+                const bool full = RandInt( 0, 7 ) == 0;
+                std::vector<SnapshotChunk> chunks;
+                for ( auto const& it : model ) {
+                    SnapshotBuffer data;
+                    if ( full || dirty[it.first] )
+                        data = std::make_shared<const std::vector<uint8_t>>( it.second );
+                    chunks.emplace_back( it.first, data, RandInt( 0, 1 ) != 0 );
+                }
+
+                const std::vector<uint8_t> before = ReadWholeFile( file );
+                Model modelBefore;
+                if ( !before.empty() ) {
+                    SnapshotArchive old;
+                    old.Open( file );
+                    for ( auto const& it : model ) {
+                        std::vector<uint8_t> d;
+                        if ( old.Read( it.first, d ) )
+                            modelBefore[it.first] = d;
+                    }
+                }
+
+                if ( !archive.Save( chunks ) ) {
+                    printf( "Save failed: %s\n", archive.GetLastError().c_str() );
+                    errors++;
+                    continue;
+                }
+
+                saves++;
+                written += archive.GetNumChunksWritten();
+                compactions += archive.GetLastSaveWasCompaction() ? 1 : 0;
+                dirty.clear();
+
+                for ( auto const& it : model ) {
+                    history[it.first].insert( SnapshotCodec::Crc32( it.second.data(), it.second.size() ) );
+                }
+
+                // Fresh reader sees the same
+                SnapshotArchive reader;
+                if ( !reader.Open( file ) )
+                    errors++;
+                errors += Compare( reader, model );
+                errors += Compare( archive, model );
+
+                // Cut off an append halfway: old header with part of the new data behind it
+                const std::vector<uint8_t> after = ReadWholeFile( file );
+                if ( !before.empty() && !archive.GetLastSaveWasCompaction() && after.size() > before.size() ) {
+                    std::vector<uint8_t> crash( after.begin(), after.begin() + RandInt( static_cast<uint32_t>(before.size()), static_cast<uint32_t>(after.size() - 1) ) );
+                    memcpy( crash.data(), before.data(), sizeof( SnapshotHeader ) );
+                    WriteWholeFile( crashFile, crash );
+
+                    SnapshotArchive crashed;
+                    if ( !crashed.Open( crashFile ) )
+                        errors++;
+
+                    std::vector<uint8_t> d;
+                    for ( auto const& it : modelBefore ) {
+                        if ( !crashed.Read( it.first, d ) || d != it.second )
+                            errors++;
+                    }
+                    crashes++;
+                }
+
+                // Flipped bytes must never give data which wasn't saved. A broken header-reference falls back to an older save.
+                {
+                    std::vector<uint8_t> broken = after;
+                    const int flips = static_cast<int>(RandInt( 1, 4 ));
+                    for ( int f = 0; f < flips; f++ ) {
+                        broken[RandInt( 0, static_cast<uint32_t>(broken.size() - 1) )] ^= static_cast<uint8_t>(RandInt( 1, 255 ));
+                    }
+                    WriteWholeFile( crashFile, broken );
+
+                    SnapshotArchive corrupt;
+                    if ( corrupt.Open( crashFile ) ) {
+                        std::vector<uint8_t> d;
+                        for ( auto const& it : model ) {
+                            if ( corrupt.Read( it.first, d ) && !history[it.first].count( SnapshotCodec::Crc32( d.data(), d.size() ) ) )
+                                errors++;
+                        }
+                    }
+                    corruptions++;
+                }
+            }
+        }
+
+        remove( file );
+        remove( crashFile );
+
+        printf( "Sessions: %zu errors, %zu saves, %zu compactions, %zu chunks written, %zu cut saves, %zu corrupted files\n",
+            errors, saves, compactions, written, crashes, corruptions );
+        return errors;
+    }
+
+    /** A world with many boxes where only one changed between saves */
+    void Benchmark() {
+        const char* file = "SnapshotBench.gsnap";
+        remove( file );
+
+        std::vector<SnapshotChunk> chunks;
+        size_t raw = 0;
+        for ( uint32_t i = 0; i < 500; i++ ) {
+            auto d = std::make_shared<std::vector<uint8_t>>( RandInt( 2000, 40000 ) * 16 );
+            for ( size_t k = 0; k + 4 <= d->size(); k += 4 ) {
+                const float v = (k % 16 == 12) ? static_cast<float>(RandInt( 0, 65535 )) : std::floor( static_cast<float>(i) * 1000.0f + static_cast<float>(k % 4096) );
+                memcpy( &(*d)[k], &v, 4 );
+            }
+            raw += d->size();
+            chunks.emplace_back( MakeSnapshotKey( 1, i + 1 ), d, true );
+        }
+
+        SnapshotArchive archive;
+        archive.Open( file );
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        archive.Save( chunks );
+        auto t1 = std::chrono::high_resolution_clock::now();
+        const size_t fullSize = ReadWholeFile( file ).size();
+
+        for ( auto& c : chunks ) {
+            c.Data = nullptr;
+        }
+        auto changed = std::make_shared<std::vector<uint8_t>>( 16 * 1000, static_cast<uint8_t>(7) );
+        chunks[42].Data = changed;
+
+        auto t2 = std::chrono::high_resolution_clock::now();
+        archive.Save( chunks );
+        auto t3 = std::chrono::high_resolution_clock::now();
+        const size_t incrementalSize = ReadWholeFile( file ).size() - fullSize;
+
+        printf( "Full save: %.1f MB -> %.1f MB in %.1f ms, one dirty chunk: %zu bytes appended in %.2f ms\n",
+            raw / 1048576.0, fullSize / 1048576.0,
+            std::chrono::duration<double, std::milli>( t1 - t0 ).count(),
+            incrementalSize, std::chrono::duration<double, std::milli>( t3 - t2 ).count() );
+
+        remove( file );
+    }
+}
+
+int main() {
+    size_t errors = TestCodec();
+    errors += TestSessions();
+    Benchmark();
+
+    printf( errors ? "FAILED\n" : "OK\n" );
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+/** Checks which parts of the static instance cache are picked for a pass, and their LODs
+
+    A world of 16000 unit sections is filled with static vobs of a few visuals, trees spread over
+    everything, rocks in clumps and a few large buildings. After clustering, every slot has to belong
+    to exactly one cluster holding a single visual, section and cell, and the clusters of a visual
+    have to follow each other.
+
+    For cameras walking through the world the runs are compared to testing every instance on its own:
+    Nothing in range and inside of the culling volume may be missing, nothing may get a coarser LOD
+    than it would get on its own, and the runs of a visual have to stay inside of its slots. Prints how
+    many instances are drawn compared to the brute force, and compared to deciding per section.
+
+    The distance a visual is sorted by mustn't be farther than any of its drawn instances, and only
+    visuals with runs get one.
+
+    A shadow pass in between two camera passes mustn't change the LODs of the camera. Removed visuals
+    mustn't be drawn anymore. */
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "MeshSimplifier.h"
+#include "StaticInstanceRuns.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    const float SECTION_SIZE = 16000.0f;
+    const int NUM_SECTIONS = 6;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    double Seconds( std::chrono::high_resolution_clock::time_point start ) {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+
+    float PointBoxDistance( const float* p, const float* min, const float* max ) {
+        float sq = 0.0f;
+        for ( int i = 0; i < 3; i++ ) {
+            float d = std::max( std::max( min[i] - p[i], 0.0f ), p[i] - max[i] );
+            sq += d * d;
+        }
+
+        return sqrtf( sq );
+    }
+
+    struct World {
+        std::vector<StaticInstanceVisual> Visuals;
+        std::vector<StaticInstanceEntry> Entries;
+        std::vector<float> Errors;
+
+        /** Entry of every slot, after building */
+        std::vector<uint32_t> Order;
+        StaticInstanceRuns Runs;
+    };
+
+    void AddEntry( World& world, uint32_t visual, float x, float z ) {
+        StaticInstanceEntry e;
+        e.Visual = visual;
+        e.Section = static_cast<uint32_t>(floorf( x / SECTION_SIZE ) * NUM_SECTIONS + floorf( z / SECTION_SIZE ));
+        e.Position[0] = x;
+        e.Position[1] = 0.0f;
+        e.Position[2] = z;
+        e.Radius = world.Visuals[visual].MeshSize;
+        world.Entries.push_back( e );
+    }
+
+    void MakeWorld( World& world ) {
+        // Small plants, trees, rocks and buildings, each with three levels
+        const float sizes[] = { 60.0f, 400.0f, 250.0f, 1500.0f };
+        world.Errors.resize( 4 * MeshSimplifier::MAX_LODS );
+        for ( int v = 0; v < 4; v++ ) {
+            for ( unsigned int l = 0; l < MeshSimplifier::MAX_LODS; l++ )
+                world.Errors[v * MeshSimplifier::MAX_LODS + l] = sizes[v] * 0.002f * (1 << l);
+        }
+
+        for ( int v = 0; v < 4; v++ ) {
+            StaticInstanceVisual visual;
+            visual.MeshSize = sizes[v];
+            visual.LODErrors = &world.Errors[v * MeshSimplifier::MAX_LODS];
+            visual.NumLODs = MeshSimplifier::MAX_LODS;
+            world.Visuals.push_back( visual );
+        }
+
+        const float extent = SECTION_SIZE * NUM_SECTIONS;
+        std::uniform_real_distribution<float> pos( 0.0f, extent - 1.0f );
+        std::normal_distribution<float> clump( 0.0f, 600.0f );
+
+        for ( int i = 0; i < 20000; i++ )
+            AddEntry( world, 0, pos( Rng ), pos( Rng ) );
+
+        for ( int i = 0; i < 8000; i++ )
+            AddEntry( world, 1, pos( Rng ), pos( Rng ) );
+
+        for ( int c = 0; c < 300; c++ ) {
+            float cx = pos( Rng ), cz = pos( Rng );
+            for ( int i = 0; i < 12; i++ ) {
+                float x = std::min( std::max( cx + clump( Rng ), 0.0f ), extent - 1.0f );
+                float z = std::min( std::max( cz + clump( Rng ), 0.0f ), extent - 1.0f );
+                AddEntry( world, 2, x, z );
+            }
+        }
+
+        for ( int i = 0; i < 200; i++ )
+            AddEntry( world, 3, pos( Rng ), pos( Rng ) );
+
+        // Entries come in the order of the sections, like out of the section map
+        std::stable_sort( world.Entries.begin(), world.Entries.end(), []( const StaticInstanceEntry& a, const StaticInstanceEntry& b ) {
+            return a.Section < b.Section;
+            } );
+
+        world.Runs.Build( world.Visuals, world.Entries, world.Order );
+    }
+
+    int GetCell( float v ) {
+        return static_cast<int>(floorf( v / StaticInstanceRuns::CLUSTER_SIZE ));
+    }
+
+    void CheckClusters( const World& world ) {
+        const auto& clusters = world.Runs.GetClusters();
+
+        std::vector<uint32_t> sorted = world.Order;
+        std::sort( sorted.begin(), sorted.end() );
+        bool permutation = sorted.size() == world.Entries.size();
+        for ( uint32_t i = 0; permutation && i < sorted.size(); i++ )
+            permutation = sorted[i] == i;
+        Check( permutation, "Every entry gets exactly one slot" );
+
+        uint32_t next = 0;
+        bool contiguous = true, single = true, bounded = true, ordered = true, small = true;
+        for ( size_t ci = 0; ci < clusters.size(); ci++ ) {
+            const StaticInstanceCluster& c = clusters[ci];
+            contiguous = contiguous && c.Start == next && c.Count > 0;
+            small = small && c.Count <= StaticInstanceRuns::MAX_CLUSTER_INSTANCES;
+            ordered = ordered && (ci == 0 || clusters[ci - 1].Visual <= c.Visual);
+            next = c.Start + c.Count;
+
+            const StaticInstanceEntry& first = world.Entries[world.Order[c.Start]];
+            for ( uint32_t slot = c.Start; slot < c.Start + c.Count && slot < world.Order.size(); slot++ ) {
+                const StaticInstanceEntry& e = world.Entries[world.Order[slot]];
+                single = single && e.Visual == c.Visual && e.Section == first.Section
+                    && GetCell( e.Position[0] ) == GetCell( first.Position[0] ) && GetCell( e.Position[2] ) == GetCell( first.Position[2] );
+
+                for ( int i = 0; i < 3; i++ )
+                    bounded = bounded && c.Min[i] <= e.Position[i] - e.Radius && c.Max[i] >= e.Position[i] + e.Radius;
+            }
+        }
+
+        Check( contiguous && next == world.Entries.size(), "Clusters cover all slots in order" );
+        Check( small, "Clusters are small" );
+        Check( single, "Clusters hold one visual, section and cell" );
+        Check( bounded, "Cluster bounds hold their instances" );
+        Check( ordered, "Clusters of a visual follow each other" );
+
+        printf( "%zu instances in %zu clusters\n", world.Entries.size(), clusters.size() );
+    }
+
+    StaticInstancePassSettings MakeSettings( float x, float z ) {
+        StaticInstancePassSettings s;
+        s.Position[0] = x;
+        s.Position[1] = 200.0f;
+        s.Position[2] = z;
+        s.MaxDistance = 30000.0f;
+        s.VobDrawRadius = 20000.0f;
+        s.SmallVobDrawRadius = 6000.0f;
+        s.SmallVobSize = 100.0f;
+        s.EnableLOD = true;
+        s.LODPixelScale = 1000.0f;
+        s.LODPixelError = 1.0f;
+        return s;
+    }
+
+    /** LOD and visibility of every slot out of the runs of a pass, 255 if not drawn */
+    std::vector<unsigned char> GetSlotLODs( const World& world, const StaticInstancePass& pass, bool& runsInside ) {
+        std::vector<unsigned char> lods( world.Entries.size(), 255 );
+        const auto& clusters = world.Runs.GetClusters();
+
+        runsInside = pass.RunStart.size() == world.Visuals.size() + 1;
+        for ( uint32_t v = 0; runsInside && v < world.Visuals.size(); v++ ) {
+            // Slots of the visual
+            uint32_t begin = UINT32_MAX, end = 0;
+            for ( const StaticInstanceCluster& c : clusters ) {
+                if ( c.Visual == v ) {
+                    begin = std::min( begin, c.Start );
+                    end = std::max( end, c.Start + c.Count );
+                }
+            }
+
+            runsInside = pass.RunStart[v] <= pass.RunStart[v + 1];
+            for ( uint32_t r = pass.RunStart[v]; runsInside && r < pass.RunStart[v + 1]; r++ ) {
+                const InstanceRun& run = pass.Runs[r];
+                runsInside = run.Count > 0 && run.Start >= begin && run.Start + run.Count <= end;
+                for ( uint32_t slot = run.Start; runsInside && slot < run.Start + run.Count; slot++ ) {
+                    runsInside = lods[slot] == 255;
+                    lods[slot] = run.LOD;
+                }
+            }
+        }
+
+        return lods;
+    }
+
+    /** Slots drawn when deciding per section, like before the clusters */
+    size_t CountPerSection( const World& world, const StaticInstancePassSettings& s, const StaticInstanceRuns::CullFunction& cull ) {
+        std::vector<float> boxes( NUM_SECTIONS * NUM_SECTIONS * 6 );
+        for ( size_t i = 0; i < boxes.size(); i += 6 ) {
+            boxes[i] = boxes[i + 1] = boxes[i + 2] = 1e30f;
+            boxes[i + 3] = boxes[i + 4] = boxes[i + 5] = -1e30f;
+        }
+
+        for ( const StaticInstanceEntry& e : world.Entries ) {
+            float* b = &boxes[e.Section * 6];
+            for ( int i = 0; i < 3; i++ ) {
+                b[i] = std::min( b[i], e.Position[i] - e.Radius );
+                b[3 + i] = std::max( b[3 + i], e.Position[i] + e.Radius );
+            }
+        }
+
+        size_t n = 0;
+        for ( const StaticInstanceEntry& e : world.Entries ) {
+            const StaticInstanceVisual& visual = world.Visuals[e.Visual];
+            const float radius = std::min( s.MaxDistance, visual.MeshSize < s.SmallVobSize ? s.SmallVobDrawRadius : s.VobDrawRadius );
+            const float* b = &boxes[e.Section * 6];
+            if ( PointBoxDistance( s.Position, b, b + 3 ) < radius && (!cull || cull( b, b + 3 )) )
+                n++;
+        }
+
+        return n;
+    }
+
+    void CheckPasses( const World& world ) {
+        const unsigned char NO_HISTORY = 255;
+
+        // Looks along +x, everything behind the camera is culled
+        float viewX = 0.0f;
+        StaticInstanceRuns::CullFunction cull = [&viewX]( const float*, const float* max ) {
+            return max[0] >= viewX;
+        };
+
+        StaticInstancePass camera;
+        size_t drawn = 0, needed = 0, perSection = 0, numRuns = 0;
+        double time = 0.0;
+        int numFrames = 0;
+        bool complete = true, notCoarser = true, inside = true, nearest = true;
+
+        for ( float x = 2000.0f; x < SECTION_SIZE * NUM_SECTIONS; x += 1500.0f, numFrames++ ) {
+            const float z = SECTION_SIZE * NUM_SECTIONS * 0.5f + 3000.0f * sinf( x * 0.0003f );
+            StaticInstancePassSettings s = MakeSettings( x, z );
+            viewX = x - 500.0f;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            world.Runs.Collect( camera, s, cull );
+            time += Seconds( start );
+
+            bool runsInside;
+            std::vector<unsigned char> lods = GetSlotLODs( world, camera, runsInside );
+            inside = inside && runsInside;
+            numRuns += camera.Runs.size();
+
+            for ( uint32_t slot = 0; slot < world.Order.size(); slot++ ) {
+                const StaticInstanceEntry& e = world.Entries[world.Order[slot]];
+                const StaticInstanceVisual& visual = world.Visuals[e.Visual];
+                const float radius = std::min( s.MaxDistance, visual.MeshSize < s.SmallVobSize ? s.SmallVobDrawRadius : s.VobDrawRadius );
+
+                float min[3], max[3];
+                for ( int i = 0; i < 3; i++ ) {
+                    min[i] = e.Position[i] - e.Radius;
+                    max[i] = e.Position[i] + e.Radius;
+                }
+
+                const float distance = PointBoxDistance( s.Position, min, max );
+                drawn += lods[slot] != 255;
+                nearest = nearest && (lods[slot] == 255 || camera.NearestDistance[e.Visual] <= distance);
+                if ( distance >= radius || !cull( min, max ) )
+                    continue;
+
+                needed++;
+                complete = complete && lods[slot] != 255;
+                if ( lods[slot] != 255 ) {
+                    unsigned char own = MeshSimplifier::SelectLOD( visual.LODErrors, visual.NumLODs, distance, s.LODPixelScale, s.LODPixelError, NO_HISTORY );
+                    notCoarser = notCoarser && lods[slot] <= own;
+                }
+            }
+
+            for ( uint32_t v = 0; v < world.Visuals.size(); v++ ) {
+                const bool hasRuns = camera.RunStart[v + 1] > camera.RunStart[v];
+                nearest = nearest && hasRuns == (camera.NearestDistance[v] < FLT_MAX);
+            }
+
+            perSection += CountPerSection( world, s, cull );
+        }
+
+        Check( complete, "Nothing in range and inside of the volume is missing" );
+        Check( notCoarser, "No instance gets a coarser LOD than on its own" );
+        Check( inside, "Runs stay inside of the slots of their visual and don't overlap" );
+        Check( nearest, "Visuals are sorted by their closest drawn cluster" );
+
+        printf( "%d frames, %.3f ms per pass, %.0f runs: %.0f instances drawn, %.0f needed, %.0f when deciding per section\n",
+            numFrames, time * 1000.0 / numFrames, double( numRuns ) / numFrames, double( drawn ) / numFrames, double( needed ) / numFrames,
+            double( perSection ) / numFrames );
+
+        // Without a culling volume and with everything in range and at the same LOD, every visual is one run
+        StaticInstancePass all;
+        StaticInstancePassSettings s = MakeSettings( 0.0f, 0.0f );
+        s.MaxDistance = s.VobDrawRadius = s.SmallVobDrawRadius = 1e9f;
+        s.EnableLOD = false;
+        world.Runs.Collect( all, s, nullptr );
+        Check( all.Runs.size() == world.Visuals.size(), "Neighbouring clusters are merged into one run" );
+    }
+
+    void CheckSeparatePasses( const World& world ) {
+        // Walk towards a spot where the camera would take a coarser level only without the hysteresis
+        StaticInstancePass camera, shadow, coarse;
+        const float z = SECTION_SIZE * 2.5f;
+        for ( float x = 1000.0f; x <= 9000.0f; x += 250.0f )
+            world.Runs.Collect( camera, MakeSettings( x, z ), nullptr );
+
+        const std::vector<unsigned char> before = camera.ClusterLODs;
+        const std::vector<InstanceRun> runsBefore = camera.Runs;
+
+        // A pass coming from far away has coarse levels, the hysteresis doesn't hold it back there
+        world.Runs.Collect( coarse, MakeSettings( 90000.0f, z ), nullptr );
+        world.Runs.Collect( coarse, MakeSettings( 9000.0f, z ), nullptr );
+        Check( coarse.ClusterLODs != before, "The test position is inside of the hysteresis" );
+
+        // The light is far away, then the camera draws again from the same spot
+        world.Runs.Collect( shadow, MakeSettings( 90000.0f, z ), nullptr );
+        world.Runs.Collect( camera, MakeSettings( 9000.0f, z ), nullptr );
+
+        bool same = camera.Runs.size() == runsBefore.size();
+        for ( size_t i = 0; same && i < runsBefore.size(); i++ )
+            same = camera.Runs[i].Start == runsBefore[i].Start && camera.Runs[i].Count == runsBefore[i].Count && camera.Runs[i].LOD == runsBefore[i].LOD;
+        Check( same && camera.ClusterLODs == before, "A shadow pass doesn't change the LODs of the camera" );
+    }
+
+    void CheckRemoveVisual() {
+        World world;
+        MakeWorld( world );
+        world.Runs.RemoveVisual( 1 );
+
+        StaticInstancePass pass;
+        StaticInstancePassSettings s = MakeSettings( 0.0f, 0.0f );
+        s.MaxDistance = s.VobDrawRadius = s.SmallVobDrawRadius = 1e9f;
+        world.Runs.Collect( pass, s, nullptr );
+
+        Check( pass.RunStart[1] == pass.RunStart[2], "Removed visuals aren't drawn" );
+        Check( pass.RunStart[2] > pass.RunStart[1] || pass.RunStart[1] > pass.RunStart[0], "Other visuals are still drawn" );
+        for ( uint32_t ci : pass.VisibleClusters ) {
+            Check( world.Runs.GetClusters()[ci].Visual != 1, "Clusters of removed visuals aren't visible" );
+        }
+
+        // Nothing to draw
+        StaticInstanceRuns empty;
+        std::vector<uint32_t> order;
+        empty.Build( {}, {}, order );
+        empty.Collect( pass, s, nullptr );
+        Check( pass.Runs.empty() && pass.RunStart.size() == 1 && order.empty(), "Empty cache has no runs" );
+    }
+}
+
+int main() {
+    World world;
+    MakeWorld( world );
+
+    CheckClusters( world );
+    CheckPasses( world );
+    CheckSeparatePasses( world );
+    CheckRemoveVisual();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
@@ -0,0 +1,566 @@
+/** Fuzzing of the DDS-parser and the packed texture archives (.gta)
+
+    DDS-Files of all supported formats are built in memory, with legacy and DX10 headers, and parsed
+    back. Their mip-layout is compared to sizes computed independently in 64 bits. Then the files
+    are cut off at every length, get broken mip counts and dimensions up to overflowing sizes, and
+    random bytes flipped in their headers. Whatever the parser accepts has to lie inside of the
+    buffer it was given.
+
+    Archives are written from such files and read back, then cut off and broken the same way,
+    including offsets and sizes near the end of their integer range. Every texture an archive still
+    hands out has to lie inside of the mapped file. Buffers are allocated with their exact size, so
+    run with a sanitizer to catch reads outside of them. */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "DDSParser.h"
+#include "TextureArchive.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    const uint32_t DDSD_MIPMAPCOUNT = 0x00020000;
+    const uint32_t DDSD_DEPTH = 0x00800000;
+    const uint32_t DDPF_FOURCC = 0x00000004;
+    const uint32_t DDPF_RGB = 0x00000040;
+    const uint32_t DDPF_LUMINANCE = 0x00020000;
+    const uint32_t DDSCAPS2_CUBEMAP = 0x00000200;
+
+    /** Offsets of the fields inside of a DDS-File, including the magic */
+    const size_t DDS_FLAGS = 8;
+    const size_t DDS_HEIGHT = 12;
+    const size_t DDS_WIDTH = 16;
+    const size_t DDS_MIPCOUNT = 28;
+    const size_t DDS_PF_FLAGS = 80;
+    const size_t DDS_PF_FOURCC = 84;
+    const size_t DDS_CAPS2 = 112;
+    const size_t DDS_HEADER_END = 128;
+    const size_t DX10_FORMAT = 128;
+    const size_t DX10_DIMENSION = 132;
+    const size_t DX10_ARRAY_SIZE = 140;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            if ( NumErrors < 10 ) {
+                printf( "FAILED: %s\n", what );
+            }
+            NumErrors++;
+        }
+    }
+
+    uint32_t RandInt( uint32_t a, uint32_t b ) {
+        return std::uniform_int_distribution<uint32_t>( a, b )(Rng);
+    }
+
+    void Put32( std::vector<uint8_t>& d, size_t offset, uint32_t v ) {
+        memcpy( &d[offset], &v, 4 );
+    }
+
+    uint32_t Get32( const std::vector<uint8_t>& d, size_t offset ) {
+        uint32_t v;
+        memcpy( &v, &d[offset], 4 );
+        return v;
+    }
+
+    constexpr uint32_t FourCC( char a, char b, char c, char d ) {
+        return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+    }
+
+    /** A format as it's written into the header, and its size as the reference sees it */
+    struct TestFormat {
+        uint32_t Format;
+        bool DX10;
+        uint32_t PixelFlags;
+        uint32_t FourCC;
+        uint32_t BitCount;
+        uint32_t Masks[4];
+
+        /** Bytes per 4x4-block, or bits per pixel */
+        uint32_t BlockBytes;
+        uint32_t BitsPerPixel;
+    };
+
+    std::vector<TestFormat> MakeFormats() {
+        std::vector<TestFormat> f;
+        f.push_back( { DDS::FMT_BC1_UNORM, false, DDPF_FOURCC, FourCC( 'D', 'X', 'T', '1' ), 0, {}, 8, 0 } );
+        f.push_back( { DDS::FMT_BC2_UNORM, false, DDPF_FOURCC, FourCC( 'D', 'X', 'T', '3' ), 0, {}, 16, 0 } );
+        f.push_back( { DDS::FMT_BC3_UNORM, false, DDPF_FOURCC, FourCC( 'D', 'X', 'T', '5' ), 0, {}, 16, 0 } );
+        f.push_back( { DDS::FMT_BC5_UNORM, false, DDPF_FOURCC, FourCC( 'A', 'T', 'I', '2' ), 0, {}, 16, 0 } );
+        f.push_back( { DDS::FMT_R16G16B16A16_FLOAT, false, DDPF_FOURCC, 113, 0, {}, 0, 64 } );
+        f.push_back( { DDS::FMT_R32G32B32A32_FLOAT, false, DDPF_FOURCC, 116, 0, {}, 0, 128 } );
+        f.push_back( { DDS::FMT_B8G8R8A8_UNORM, false, DDPF_RGB, 0, 32, { 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 }, 0, 32 } );
+        f.push_back( { DDS::FMT_B5G6R5_UNORM, false, DDPF_RGB, 0, 16, { 0xf800, 0x07e0, 0x001f, 0 }, 0, 16 } );
+        f.push_back( { DDS::FMT_R8_UNORM, false, DDPF_LUMINANCE, 0, 8, { 0xff, 0, 0, 0 }, 0, 8 } );
+        f.push_back( { DDS::FMT_BC7_UNORM, true, DDPF_FOURCC, FourCC( 'D', 'X', '1', '0' ), 0, {}, 16, 0 } );
+        f.push_back( { DDS::FMT_BC6H_UF16, true, DDPF_FOURCC, FourCC( 'D', 'X', '1', '0' ), 0, {}, 16, 0 } );
+        f.push_back( { DDS::FMT_R32G32B32A32_FLOAT, true, DDPF_FOURCC, FourCC( 'D', 'X', '1', '0' ), 0, {}, 0, 128 } );
+        f.push_back( { DDS::FMT_R8G8B8A8_UNORM_SRGB, true, DDPF_FOURCC, FourCC( 'D', 'X', '1', '0' ), 0, {}, 0, 32 } );
+        return f;
+    }
+
+    /** Size of a level, computed without any care for the range */
+    uint64_t ReferenceMipSize( const TestFormat& format, uint64_t width, uint64_t height ) {
+        if ( format.BlockBytes )
+            return std::max<uint64_t>( 1, (width + 3) / 4 ) * std::max<uint64_t>( 1, (height + 3) / 4 ) * format.BlockBytes;
+
+        return (width * format.BitsPerPixel + 7) / 8 * height;
+    }
+
+    uint32_t FullMipChain( uint32_t width, uint32_t height ) {
+        uint32_t n = 1;
+        for ( uint32_t d = std::max( width, height ); d > 1; d /= 2 )
+            n++;
+        return n;
+    }
+
+    /** Header only, the pixel-data can be appended */
+    std::vector<uint8_t> BuildHeader( const TestFormat& format, uint32_t width, uint32_t height, uint32_t mipCount, bool mipFlag ) {
+        std::vector<uint8_t> d( format.DX10 ? DDS_HEADER_END + 20 : DDS_HEADER_END, 0 );
+        Put32( d, 0, FourCC( 'D', 'D', 'S', ' ' ) );
+        Put32( d, 4, 124 );
+        Put32( d, DDS_FLAGS, 0x1007 | (mipFlag ? DDSD_MIPMAPCOUNT : 0) );
+        Put32( d, DDS_HEIGHT, height );
+        Put32( d, DDS_WIDTH, width );
+        Put32( d, DDS_MIPCOUNT, mipCount );
+        Put32( d, 76, 32 );
+        Put32( d, DDS_PF_FLAGS, format.PixelFlags );
+        Put32( d, DDS_PF_FOURCC, format.FourCC );
+        Put32( d, 88, format.BitCount );
+        for ( int i = 0; i < 4; i++ )
+            Put32( d, 92 + i * 4, format.Masks[i] );
+        Put32( d, 108, 0x1000 );
+
+        if ( format.DX10 ) {
+            Put32( d, DX10_FORMAT, format.Format );
+            Put32( d, DX10_DIMENSION, 3 );
+            Put32( d, DX10_ARRAY_SIZE, 1 );
+        }
+        return d;
+    }
+
+    /** Header followed by all levels, each filled with its index */
+    std::vector<uint8_t> BuildDDS( const TestFormat& format, uint32_t width, uint32_t height, uint32_t mipCount ) {
+        std::vector<uint8_t> d = BuildHeader( format, width, height, mipCount, true );
+        for ( uint32_t i = 0; i < mipCount; i++ ) {
+            uint64_t size = ReferenceMipSize( format, std::max<uint32_t>( 1, width >> i ), std::max<uint32_t>( 1, height >> i ) );
+            d.insert( d.end(), static_cast<size_t>(size), static_cast<uint8_t>(i + 1) );
+        }
+        return d;
+    }
+
+    /** Parses out of a buffer of exactly the given size, so reading past it is caught */
+    DDS::EParseResult ParseExact( const std::vector<uint8_t>& d, size_t size, DDS::ImageInfo& info ) {
+        std::unique_ptr<uint8_t[]> exact( new uint8_t[size ? size : 1] );
+        if ( size )
+            memcpy( exact.get(), d.data(), size );
+
+        DDS::EParseResult r = DDS::Parse( exact.get(), size, info );
+        if ( r == DDS::PR_OK ) {
+            // Touch every byte the layout points to
+            uint32_t sum = 0;
+            for ( uint32_t m = 0; m < info.MipCount; m++ ) {
+                for ( uint32_t i = 0; i < info.Mips[m].Size; i += 61 )
+                    sum += exact[info.Mips[m].Offset + i];
+            }
+            Check( sum != 0xFFFFFFFF, "pixel-data can be read" );
+        }
+        return r;
+    }
+
+    /** Everything the parser accepted has to be inside of the buffer and hang together */
+    bool LayoutIsSane( const DDS::ImageInfo& info, size_t size ) {
+        if ( info.MipCount == 0 || info.MipCount > DDS::MAX_MIP_LEVELS || info.MipCount > FullMipChain( info.Width, info.Height ) )
+            return false;
+
+        uint64_t offset = info.DataOffset;
+        for ( uint32_t m = 0; m < info.MipCount; m++ ) {
+            const DDS::MipLevel& mip = info.Mips[m];
+            if ( mip.Offset != offset || mip.Width == 0 || mip.Height == 0 )
+                return false;
+
+            offset += mip.Size;
+        }
+
+        return offset == static_cast<uint64_t>(info.DataOffset) + info.DataSize && offset <= size;
+    }
+
+    void TestValidFiles() {
+        const uint32_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 4, 4 }, { 17, 9 }, { 256, 64 }, { 1, 512 }, { 100, 300 } };
+        for ( const TestFormat& format : MakeFormats() ) {
+            for ( const auto& s : sizes ) {
+                const uint32_t chain = FullMipChain( s[0], s[1] );
+                for ( uint32_t mips : { 1u, 2u, chain } ) {
+                    if ( mips > chain )
+                        continue;
+
+                    std::vector<uint8_t> d = BuildDDS( format, s[0], s[1], mips );
+                    DDS::ImageInfo info;
+                    Check( ParseExact( d, d.size(), info ) == DDS::PR_OK, "valid file parses" );
+                    Check( info.Format == format.Format && info.Width == s[0] && info.Height == s[1] && info.MipCount == mips, "header is read back" );
+                    Check( LayoutIsSane( info, d.size() ) && info.DataOffset + info.DataSize == d.size(), "layout covers exactly the pixel-data" );
+
+                    bool sizesMatch = true;
+                    for ( uint32_t m = 0; m < info.MipCount; m++ ) {
+                        sizesMatch = sizesMatch && info.Mips[m].Size == ReferenceMipSize( format, info.Mips[m].Width, info.Mips[m].Height )
+                            && d[info.Mips[m].Offset] == m + 1 && d[info.Mips[m].Offset + info.Mips[m].Size - 1] == m + 1;
+                    }
+                    Check( sizesMatch, "mip sizes match the reference" );
+                }
+            }
+        }
+    }
+
+    void TestTruncated() {
+        for ( const TestFormat& format : MakeFormats() ) {
+            std::vector<uint8_t> d = BuildDDS( format, 37, 21, FullMipChain( 37, 21 ) );
+            const size_t headerSize = format.DX10 ? DDS_HEADER_END + 20 : DDS_HEADER_END;
+
+            for ( size_t length = 0; length < d.size(); length++ ) {
+                DDS::ImageInfo info;
+                DDS::EParseResult r = ParseExact( d, length, info );
+                if ( length < headerSize )
+                    Check( r == DDS::PR_TOO_SMALL, "cut off header is too small" );
+                else
+                    Check( r == DDS::PR_TRUNCATED, "cut off pixel-data is truncated" );
+            }
+        }
+    }
+
+    void TestMipCounts() {
+        const TestFormat format = MakeFormats()[0];
+        DDS::ImageInfo info;
+
+        // The flag decides whether the count is read at all
+        std::vector<uint8_t> d = BuildDDS( format, 64, 64, 7 );
+        Put32( d, DDS_FLAGS, Get32( d, DDS_FLAGS ) & ~DDSD_MIPMAPCOUNT );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_OK && info.MipCount == 1, "count without the flag is 1" );
+
+        d = BuildDDS( format, 64, 64, 7 );
+        Put32( d, DDS_MIPCOUNT, 0 );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_OK && info.MipCount == 1, "count 0 is 1" );
+
+        // More than the chain is clamped to it, up to the biggest count there is
+        for ( uint32_t count : { 8u, 15u, 16u, 255u, 0x7FFFFFFFu, 0xFFFFFFFFu } ) {
+            Put32( d, DDS_MIPCOUNT, count );
+            Check( ParseExact( d, d.size(), info ) == DDS::PR_OK && info.MipCount == 7, "count beyond the chain is clamped" );
+        }
+
+        // A full chain of the biggest texture
+        std::vector<uint8_t> h = BuildHeader( format, DDS::MAX_TEXTURE_SIZE, 1, 0xFFFFFFFF, true );
+        Check( ParseExact( h, h.size(), info ) == DDS::PR_TRUNCATED, "maximum chain without data is truncated" );
+        Check( DDS::Parse( h.data(), h.size(), info ) == DDS::PR_TRUNCATED && info.MipCount == DDS::MAX_MIP_LEVELS, "maximum chain has all levels" );
+
+        // A missing last level
+        d = BuildDDS( format, 64, 64, 7 );
+        d.resize( d.size() - 1 );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_TRUNCATED, "missing part of the last level is truncated" );
+    }
+
+    void TestDimensions() {
+        const std::vector<TestFormat> formats = MakeFormats();
+        DDS::ImageInfo info;
+
+        for ( const TestFormat& format : formats ) {
+            for ( uint32_t w : { 0u, 1u, DDS::MAX_TEXTURE_SIZE, DDS::MAX_TEXTURE_SIZE + 1, 0x40000000u, 0x80000000u, 0xFFFFFFFFu } ) {
+                for ( uint32_t h : { 0u, 1u, DDS::MAX_TEXTURE_SIZE, DDS::MAX_TEXTURE_SIZE + 1, 0xFFFFFFFFu } ) {
+                    std::vector<uint8_t> d = BuildHeader( format, w, h, 1, false );
+                    d.resize( d.size() + 4096, 0 );
+
+                    DDS::EParseResult r = ParseExact( d, d.size(), info );
+                    const bool inRange = w > 0 && h > 0 && w <= DDS::MAX_TEXTURE_SIZE && h <= DDS::MAX_TEXTURE_SIZE;
+                    const uint64_t size = ReferenceMipSize( format, w, h );
+
+                    if ( !inRange || size > UINT32_MAX )
+                        Check( r == DDS::PR_BAD_HEADER, "dimensions out of range are refused" );
+                    else if ( size > 4096 )
+                        Check( r == DDS::PR_TRUNCATED, "big dimensions without data are truncated" );
+                    else
+                        Check( r == DDS::PR_OK && LayoutIsSane( info, d.size() ), "small dimensions parse" );
+                }
+            }
+        }
+
+        // 16384 * 16384 * 16 bytes is 2^32 and would wrap to 0
+        uint32_t rowPitch = 0, size = 0;
+        Check( !DDS::ComputeMipSize( DDS::FMT_R32G32B32A32_FLOAT, DDS::MAX_TEXTURE_SIZE, DDS::MAX_TEXTURE_SIZE, rowPitch, size ), "level of 4 GiB doesn't fit" );
+        Check( DDS::ComputeMipSize( DDS::FMT_R16G16B16A16_FLOAT, DDS::MAX_TEXTURE_SIZE, DDS::MAX_TEXTURE_SIZE, rowPitch, size ) && size == 0x80000000u, "level of 2 GiB fits" );
+        Check( !DDS::ComputeMipSize( 12345, 4, 4, rowPitch, size ), "unknown format has no size" );
+    }
+
+    void TestBrokenHeaders() {
+        DDS::ImageInfo info;
+        const std::vector<TestFormat> formats = MakeFormats();
+
+        std::vector<uint8_t> d = BuildDDS( formats[0], 8, 8, 1 );
+        Put32( d, 0, FourCC( 'D', 'D', 'S', 'X' ) );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_BAD_MAGIC, "wrong magic" );
+
+        d = BuildDDS( formats[0], 8, 8, 1 );
+        Put32( d, 4, 123 );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_BAD_HEADER, "wrong header size" );
+
+        d = BuildDDS( formats[0], 8, 8, 1 );
+        Put32( d, DDS_PF_FOURCC, FourCC( 'N', 'O', 'P', 'E' ) );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_UNSUPPORTED_FORMAT, "unknown fourcc" );
+
+        d = BuildDDS( formats[0], 8, 8, 1 );
+        Put32( d, DDS_CAPS2, DDSCAPS2_CUBEMAP );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_UNSUPPORTED_DIMENSION, "cubemap" );
+
+        d = BuildDDS( formats[0], 8, 8, 1 );
+        Put32( d, DDS_FLAGS, Get32( d, DDS_FLAGS ) | DDSD_DEPTH );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_UNSUPPORTED_DIMENSION, "volume" );
+
+        const TestFormat& dx10 = formats[formats.size() - 4];
+        d = BuildDDS( dx10, 8, 8, 1 );
+        Put32( d, DX10_ARRAY_SIZE, 2 );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_UNSUPPORTED_DIMENSION, "texture array" );
+
+        d = BuildDDS( dx10, 8, 8, 1 );
+        Put32( d, DX10_FORMAT, 0xFFFFFFFF );
+        Check( ParseExact( d, d.size(), info ) == DDS::PR_UNSUPPORTED_FORMAT, "unknown DXGI format" );
+
+        // Random bytes anywhere in the headers
+        for ( int i = 0; i < 200000; i++ ) {
+            const TestFormat& format = formats[RandInt( 0, static_cast<uint32_t>(formats.size()) - 1 )];
+            const uint32_t w = RandInt( 1, 70 );
+            const uint32_t h = RandInt( 1, 70 );
+            d = BuildDDS( format, w, h, RandInt( 1, FullMipChain( w, h ) ) );
+
+            const size_t headerSize = format.DX10 ? DDS_HEADER_END + 20 : DDS_HEADER_END;
+            for ( uint32_t f = RandInt( 1, 4 ); f > 0; f-- ) {
+                const size_t at = RandInt( 0, static_cast<uint32_t>(headerSize) - 1 );
+                d[at] = RandInt( 0, 3 ) == 0 ? 0xFF : static_cast<uint8_t>(RandInt( 0, 255 ));
+            }
+
+            if ( RandInt( 0, 3 ) == 0 )
+                d.resize( RandInt( 0, static_cast<uint32_t>(d.size()) ) );
+
+            DDS::EParseResult r = ParseExact( d, d.size(), info );
+            if ( r == DDS::PR_OK )
+                Check( LayoutIsSane( info, d.size() ), "accepted broken header has a sane layout" );
+        }
+    }
+
+    std::string TempFile( const std::string& name ) {
+        return (std::filesystem::temp_directory_path() / ("TextureFuzz_" + name)).string();
+    }
+
+    void WriteWholeFile( const std::string& file, const std::vector<uint8_t>& d ) {
+        FILE* f = fopen( file.c_str(), "wb" );
+        if ( !d.empty() )
+            fwrite( d.data(), 1, d.size(), f );
+        fclose( f );
+    }
+
+    std::vector<uint8_t> ReadWholeFile( const std::string& file ) {
+        std::vector<uint8_t> d;
+        FILE* f = fopen( file.c_str(), "rb" );
+        if ( !f ) return d;
+        fseek( f, 0, SEEK_END );
+        d.resize( ftell( f ) );
+        fseek( f, 0, SEEK_SET );
+        if ( !d.empty() && fread( d.data(), d.size(), 1, f ) != 1 ) d.clear();
+        fclose( f );
+        return d;
+    }
+
+    struct ArchiveTexture {
+        std::string Name;
+        std::vector<uint8_t> Data;
+    };
+
+    /** Opens the archive and looks up everything in it. Returns the number of textures handed out,
+        each of them has to lie inside of the file. */
+    int OpenAndFind( const std::string& file, const std::vector<ArchiveTexture>& textures, bool& inside ) {
+        inside = true;
+        TextureArchive archive;
+        if ( !archive.Open( file ) )
+            return -1;
+
+        const uint64_t fileSize = std::filesystem::file_size( file );
+
+        // Names out of the index itself, next to the ones which were packed
+        std::vector<std::string> names;
+        for ( const ArchiveTexture& t : textures )
+            names.push_back( t.Name );
+
+        for ( uint32_t i = 0; i < archive.GetNumEntries() && i < 64; i++ )
+            names.push_back( archive.GetEntryName( archive.GetEntry( i ) ) );
+
+        int found = 0;
+        for ( const std::string& name : names ) {
+            archive.Contains( name );
+            archive.ContainsDirectory( name );
+
+            DDS::ImageInfo info;
+            const uint8_t* payload = nullptr;
+            if ( !archive.Find( name, info, &payload ) )
+                continue;
+
+            found++;
+            const TextureArchiveEntry* entry = nullptr;
+            for ( uint32_t i = 0; i < archive.GetNumEntries(); i++ ) {
+                if ( archive.GetEntryName( archive.GetEntry( i ) ) == TextureArchive::NormalizeName( name ) ) {
+                    entry = &archive.GetEntry( i );
+                    break;
+                }
+            }
+
+            if ( !entry || entry->PayloadOffset > fileSize ) {
+                inside = false;
+                continue;
+            }
+
+            for ( uint32_t m = 0; m < info.MipCount; m++ ) {
+                if ( entry->PayloadOffset + info.Mips[m].Offset + static_cast<uint64_t>(info.Mips[m].Size) > fileSize )
+                    inside = false;
+            }
+        }
+
+        return found;
+    }
+
+    void TestArchives() {
+        const std::vector<TestFormat> formats = MakeFormats();
+
+        std::vector<ArchiveTexture> textures;
+        const char* names[] = { "Textures\\A.dds", "Textures\\Sub\\B.dds", "normalmaps_original\\C_normal.dds", "D.dds" };
+        for ( int i = 0; i < 4; i++ ) {
+            ArchiveTexture t;
+            t.Name = names[i];
+            t.Data = BuildDDS( formats[i * 3], 16 + i * 7, 8 + i * 3, 2 + i );
+            textures.push_back( t );
+        }
+
+        TextureArchiveWriter writer;
+        for ( const ArchiveTexture& t : textures ) {
+            Check( writer.AddMemory( t.Name, t.Data ), "texture is packed" );
+        }
+        Check( !writer.AddMemory( "textures/a.DDS", textures[0].Data ), "same name is refused" );
+        Check( !writer.AddMemory( "E.dds", std::vector<uint8_t>( textures[0].Data.begin(), textures[0].Data.end() - 1 ) ), "truncated texture is refused" );
+
+        const std::string file = TempFile( "archive.gta" );
+        Check( writer.Write( file ), "archive is written" );
+        const std::vector<uint8_t> archive = ReadWholeFile( file );
+
+        {
+            TextureArchive a;
+            Check( a.Open( file ) && a.GetNumEntries() == 4, "archive opens" );
+            for ( const ArchiveTexture& t : textures ) {
+                DDS::ImageInfo info, reference;
+                const uint8_t* payload = nullptr;
+                DDS::Parse( t.Data.data(), t.Data.size(), reference );
+                bool ok = a.Find( t.Name, info, &payload ) && info.MipCount == reference.MipCount && info.Format == reference.Format;
+                for ( uint32_t m = 0; ok && m < info.MipCount; m++ ) {
+                    ok = info.Mips[m].Offset == reference.Mips[m].Offset && info.Mips[m].Size == reference.Mips[m].Size
+                        && memcmp( payload + info.Mips[m].Offset, t.Data.data() + reference.Mips[m].Offset, info.Mips[m].Size ) == 0;
+                }
+                Check( ok, "texture reads back out of the archive" );
+            }
+
+            Check( a.Contains( "textures/sub/b.dds" ) && a.ContainsDirectory( "textures\\sub" ) && a.ContainsDirectory( "TEXTURES" ), "names and directories are found" );
+            Check( !a.Contains( "Textures\\Missing.dds" ) && !a.ContainsDirectory( "Missing" ), "missing names aren't found" );
+        }
+
+        bool inside;
+        const std::string broken = TempFile( "broken.gta" );
+
+        // Cut off everywhere in the index and strings, then in steps through the pixel-data
+        TextureArchiveHeader header;
+        memcpy( &header, archive.data(), sizeof( header ) );
+        for ( size_t length = 0; length < archive.size(); length += length < header.DataOffset + 64 ? 1 : 97 ) {
+            WriteWholeFile( broken, std::vector<uint8_t>( archive.begin(), archive.begin() + length ) );
+            int found = OpenAndFind( broken, textures, inside );
+            Check( inside, "cut off archive only hands out what's inside" );
+            if ( length < header.StringTableOffset + header.StringTableSize )
+                Check( found == -1, "archive without its index doesn't open" );
+        }
+
+        // Header fields near the end of their range
+        const uint64_t evil64[] = { 0, 1, 3, archive.size(), archive.size() + 1, UINT32_MAX, 0x7FFFFFFFFFFFFFFFull, UINT64_MAX - 2, UINT64_MAX };
+        const size_t headerFields[] = { offsetof( TextureArchiveHeader, IndexOffset ), offsetof( TextureArchiveHeader, StringTableOffset ),
+            offsetof( TextureArchiveHeader, StringTableSize ), offsetof( TextureArchiveHeader, DataOffset ) };
+        for ( size_t field : headerFields ) {
+            for ( uint64_t v : evil64 ) {
+                std::vector<uint8_t> d = archive;
+                memcpy( &d[field], &v, 8 );
+                WriteWholeFile( broken, d );
+                OpenAndFind( broken, textures, inside );
+                Check( inside, "broken header only hands out what's inside" );
+            }
+        }
+
+        for ( uint32_t n : { 0u, 5u, 1000u, 0x02000000u, 0xFFFFFFFFu } ) {
+            std::vector<uint8_t> d = archive;
+            memcpy( &d[offsetof( TextureArchiveHeader, NumEntries )], &n, 4 );
+            WriteWholeFile( broken, d );
+            OpenAndFind( broken, textures, inside );
+            Check( inside, "wrong number of entries only hands out what's inside" );
+        }
+
+        // Entry fields near the end of their range
+        const uint32_t evil32[] = { 0, 1, 15, 16, 100, 4096, 0x7FFFFFFF, 0xFFFFFFF0, 0xFFFFFFFF };
+        const size_t entryFields[] = { offsetof( TextureArchiveEntry, PayloadSize ), offsetof( TextureArchiveEntry, NameOffset ),
+            offsetof( TextureArchiveEntry, NameLength ), offsetof( TextureArchiveEntry, Width ), offsetof( TextureArchiveEntry, Height ),
+            offsetof( TextureArchiveEntry, Format ), offsetof( TextureArchiveEntry, MipCount ), offsetof( TextureArchiveEntry, MipOffsets ),
+            offsetof( TextureArchiveEntry, MipOffsets ) + 4 };
+        for ( uint32_t e = 0; e < header.NumEntries; e++ ) {
+            const size_t entry = header.IndexOffset + e * sizeof( TextureArchiveEntry );
+            for ( size_t field : entryFields ) {
+                for ( uint32_t v : evil32 ) {
+                    std::vector<uint8_t> d = archive;
+                    memcpy( &d[entry + field], &v, 4 );
+                    WriteWholeFile( broken, d );
+                    OpenAndFind( broken, textures, inside );
+                    Check( inside, "broken entry only hands out what's inside" );
+                }
+            }
+
+            for ( uint64_t v : evil64 ) {
+                std::vector<uint8_t> d = archive;
+                memcpy( &d[entry + offsetof( TextureArchiveEntry, PayloadOffset )], &v, 8 );
+                WriteWholeFile( broken, d );
+                OpenAndFind( broken, textures, inside );
+                Check( inside, "broken payload offset only hands out what's inside" );
+            }
+        }
+
+        // Random bytes in header, index and strings
+        for ( int i = 0; i < 3000; i++ ) {
+            std::vector<uint8_t> d = archive;
+            for ( uint32_t f = RandInt( 1, 6 ); f > 0; f-- ) {
+                const size_t at = RandInt( 0, static_cast<uint32_t>(header.StringTableOffset + header.StringTableSize) - 1 );
+                d[at] = RandInt( 0, 3 ) == 0 ? 0xFF : static_cast<uint8_t>(RandInt( 0, 255 ));
+            }
+            WriteWholeFile( broken, d );
+            OpenAndFind( broken, textures, inside );
+            Check( inside, "randomly broken archive only hands out what's inside" );
+        }
+
+        Check( OpenAndFind( TempFile( "missing.gta" ), textures, inside ) == -1, "missing archive doesn't open" );
+
+        std::filesystem::remove( file );
+        std::filesystem::remove( broken );
+    }
+}
+
+int main() {
+    TestValidFiles();
+    TestTruncated();
+    TestMipCounts();
+    TestDimensions();
+    TestBrokenHeaders();
+    TestArchives();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
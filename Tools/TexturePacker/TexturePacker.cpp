@@ -0,0 +1,70 @@
+/** Offline packer for GD3D11 texture archives (.gta)
+
+    Packs all .dds-files below a folder into one archive, which the renderer maps instead of
+    opening every file separately. For the replacement textures:
+
+        TexturePacker system\GD3D11\textures\replacements system\GD3D11\textures\replacements.gta */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "TextureArchive.h"
+
+namespace {
+    /** Reads the archive back and checks every entry against the index */
+    bool VerifyArchive( const std::string& file ) {
+        TextureArchive archive;
+        if ( !archive.Open( file ) ) {
+            printf( "Failed to open '%s' for verification\n", file.c_str() );
+            return false;
+        }
+
+        for ( uint32_t i = 0; i < archive.GetNumEntries(); i++ ) {
+            std::string name = archive.GetEntryName( archive.GetEntry( i ) );
+
+            DDS::ImageInfo info;
+            const uint8_t* payload;
+            if ( !archive.Find( name, info, &payload ) ) {
+                printf( "Entry '%s' is broken\n", name.c_str() );
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main( int argc, char** argv ) {
+    if ( argc < 3 ) {
+        printf( "Usage: %s <input folder> <output.gta>\n", argv[0] );
+        return 1;
+    }
+
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+
+    auto start = std::chrono::steady_clock::now();
+
+    TextureArchiveWriter writer;
+    int numFiles = writer.AddDirectory( input );
+    if ( numFiles <= 0 ) {
+        printf( "No usable .dds-files found in '%s'\n", input.c_str() );
+        return 1;
+    }
+
+    if ( !writer.GetLastError().empty() ) {
+        printf( "Some files were skipped, last error: %s\n", writer.GetLastError().c_str() );
+    }
+
+    if ( !writer.Write( output ) ) {
+        printf( "Failed to write archive: %s\n", writer.GetLastError().c_str() );
+        return 1;
+    }
+
+    if ( !VerifyArchive( output ) )
+        return 1;
+
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    printf( "Packed %d textures into '%s' in %lld ms\n", numFiles, output.c_str(), static_cast<long long>(ms) );
+    return 0;
+}
@@ -0,0 +1,567 @@
+/** Checks the CPU mip-generation and BC1/BC3-compression against reference images
+
+    The reference images are generated: smooth gradients, fractal noise like stone or dirt, hard edges
+    and an alpha-ramp. The sRGB-conversion has to round like the exact formula. Mip-levels are compared
+    to a double precision reference that filters every level in linear space, the compressed images are
+    decoded again and measured by their PSNR, next to a plain bounding-box encoder. Compressing with a
+    thread pool has to give the same bytes as compressing on one thread. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TextureProcessing.h"
+#include "ThreadPool.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    struct Image {
+        uint32_t Width;
+        uint32_t Height;
+        std::vector<uint8_t> Pixels;
+
+        uint8_t* At( uint32_t x, uint32_t y ) { return &Pixels[(static_cast<size_t>(y) * Width + x) * 4]; }
+    };
+
+    Image MakeImage( uint32_t width, uint32_t height ) {
+        Image image;
+        image.Width = width;
+        image.Height = height;
+        image.Pixels.resize( static_cast<size_t>(width) * height * 4 );
+        return image;
+    }
+
+    uint8_t ToByte( double v ) {
+        return static_cast<uint8_t>(std::min( std::max( lround( v * 255.0 ), 0L ), 255L ));
+    }
+
+    /** Smooth value-noise, summed over a few octaves */
+    double Noise( double x, double y, const std::vector<double>& lattice, int size ) {
+        int x0 = static_cast<int>(floor( x ));
+        int y0 = static_cast<int>(floor( y ));
+        double fx = x - x0;
+        double fy = y - y0;
+        fx = fx * fx * (3.0 - 2.0 * fx);
+        fy = fy * fy * (3.0 - 2.0 * fy);
+        auto v = [&]( int ix, int iy ) { return lattice[((iy & (size - 1)) * size) + (ix & (size - 1))]; };
+        double top = v( x0, y0 ) + (v( x0 + 1, y0 ) - v( x0, y0 )) * fx;
+        double bottom = v( x0, y0 + 1 ) + (v( x0 + 1, y0 + 1 ) - v( x0, y0 + 1 )) * fx;
+        return top + (bottom - top) * fy;
+    }
+
+    Image MakeGradient( uint32_t size ) {
+        Image image = MakeImage( size, size );
+        for ( uint32_t y = 0; y < size; y++ ) {
+            for ( uint32_t x = 0; x < size; x++ ) {
+                uint8_t* p = image.At( x, y );
+                p[0] = ToByte( x / double( size - 1 ) );
+                p[1] = ToByte( y / double( size - 1 ) );
+                p[2] = ToByte( 0.5 + 0.5 * sin( (x + y) * 0.02 ) );
+                p[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    /** Brownish stone with some green moss, like most of the world textures */
+    Image MakeStone( uint32_t size ) {
+        const int latticeSize = 256;
+        std::vector<double> lattice( latticeSize * latticeSize );
+        for ( double& v : lattice ) {
+            v = std::uniform_real_distribution<double>( 0.0, 1.0 )(Rng);
+        }
+
+        Image image = MakeImage( size, size );
+        for ( uint32_t y = 0; y < size; y++ ) {
+            for ( uint32_t x = 0; x < size; x++ ) {
+                double n = 0.0;
+                double amplitude = 0.5;
+                double frequency = 1.0 / 32.0;
+                for ( int octave = 0; octave < 5; octave++ ) {
+                    n += amplitude * Noise( x * frequency, y * frequency, lattice, latticeSize );
+                    amplitude *= 0.5;
+                    frequency *= 2.0;
+                }
+                double moss = std::max( 0.0, Noise( x / 48.0 + 100.0, y / 48.0, lattice, latticeSize ) - 0.6 ) * 2.5;
+
+                uint8_t* p = image.At( x, y );
+                p[0] = ToByte( n * 0.75 * (1.0 - moss) + moss * 0.25 );
+                p[1] = ToByte( n * 0.6 * (1.0 - moss) + moss * 0.45 );
+                p[2] = ToByte( n * 0.45 * (1.0 - moss) + moss * 0.15 );
+                p[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    /** Bricks with dark joints and text-like details, lots of hard edges */
+    Image MakeEdges( uint32_t size ) {
+        Image image = MakeImage( size, size );
+        for ( uint32_t y = 0; y < size; y++ ) {
+            for ( uint32_t x = 0; x < size; x++ ) {
+                uint32_t row = y / 16;
+                uint32_t bx = (x + (row & 1) * 16) % 32;
+                bool joint = (y % 16) < 2 || bx < 2;
+                bool letter = ((x / 3) * 7 + (y / 5) * 13) % 11 < 3 && (y / 40) % 3 == 1;
+
+                uint8_t* p = image.At( x, y );
+                if ( joint ) {
+                    p[0] = 40; p[1] = 38; p[2] = 35;
+                } else if ( letter ) {
+                    p[0] = 230; p[1] = 210; p[2] = 60;
+                } else {
+                    p[0] = static_cast<uint8_t>(150 + (row * 37) % 40);
+                    p[1] = static_cast<uint8_t>(70 + (row * 17) % 30);
+                    p[2] = 50;
+                }
+                p[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    /** Leaves: colors with a soft alpha-mask */
+    Image MakeFoliage( uint32_t size ) {
+        Image image = MakeStone( size );
+        for ( uint32_t y = 0; y < size; y++ ) {
+            for ( uint32_t x = 0; x < size; x++ ) {
+                double cx = (x % 64) - 32.0;
+                double cy = (y % 64) - 32.0;
+                double d = sqrt( cx * cx * 2.0 + cy * cy ) / 30.0;
+                uint8_t* p = image.At( x, y );
+                std::swap( p[0], p[1] );
+                p[3] = ToByte( std::min( std::max( (1.0 - d) * 4.0, 0.0 ), 1.0 ) );
+            }
+        }
+        return image;
+    }
+
+    double PSNR( const uint8_t* a, const uint8_t* b, size_t numPixels, int firstChannel, int numChannels ) {
+        double sum = 0.0;
+        for ( size_t i = 0; i < numPixels; i++ ) {
+            for ( int c = firstChannel; c < firstChannel + numChannels; c++ ) {
+                double d = double( a[i * 4 + c] ) - double( b[i * 4 + c] );
+                sum += d * d;
+            }
+        }
+
+        double mse = sum / (double( numPixels ) * numChannels);
+        return mse > 0.0 ? 10.0 * log10( 255.0 * 255.0 / mse ) : 99.0;
+    }
+
+    std::vector<uint8_t> Decompress( const uint8_t* blocks, uint32_t width, uint32_t height, ETextureBlockFormat format ) {
+        std::vector<uint8_t> out( static_cast<size_t>(width) * height * 4 );
+        uint32_t blocksX = (width + 3) / 4;
+        uint32_t blockSize = format == TBF_BC1 ? 8 : 16;
+        for ( uint32_t by = 0; by < (height + 3) / 4; by++ ) {
+            for ( uint32_t bx = 0; bx < blocksX; bx++ ) {
+                uint8_t block[64];
+                const uint8_t* in = blocks + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+                if ( format == TBF_BC1 ) {
+                    TextureProcessing::DecompressBC1Block( in, block );
+                } else {
+                    TextureProcessing::DecompressBC3Block( in, block );
+                }
+
+                for ( uint32_t y = 0; y < 4 && by * 4 + y < height; y++ ) {
+                    for ( uint32_t x = 0; x < 4 && bx * 4 + x < width; x++ ) {
+                        memcpy( &out[((by * 4 + y) * static_cast<size_t>(width) + bx * 4 + x) * 4], block + (y * 4 + x) * 4, 4 );
+                    }
+                }
+            }
+        }
+        return out;
+    }
+
+    /** The usual quick encoder: endpoints from the bounding box of the block, for comparison */
+    void CompressBoundingBox( const Image& image, std::vector<uint8_t>& out ) {
+        uint32_t blocksX = image.Width / 4;
+        out.assign( static_cast<size_t>(blocksX) * (image.Height / 4) * 8, 0 );
+        for ( uint32_t by = 0; by < image.Height / 4; by++ ) {
+            for ( uint32_t bx = 0; bx < blocksX; bx++ ) {
+                int lo[3] = { 255, 255, 255 };
+                int hi[3] = { 0, 0, 0 };
+                for ( uint32_t i = 0; i < 16; i++ ) {
+                    const uint8_t* p = &image.Pixels[((by * 4 + i / 4) * static_cast<size_t>(image.Width) + bx * 4 + i % 4) * 4];
+                    for ( int c = 0; c < 3; c++ ) {
+                        lo[c] = std::min( lo[c], int( p[c] ) );
+                        hi[c] = std::max( hi[c], int( p[c] ) );
+                    }
+                }
+
+                auto pack = []( const int* c ) {
+                    return uint16_t( ((c[0] * 31 + 127) / 255) << 11 | ((c[1] * 63 + 127) / 255) << 5 | ((c[2] * 31 + 127) / 255) );
+                };
+                uint16_t c0 = pack( hi );
+                uint16_t c1 = pack( lo );
+
+                // Decode the palette like the real decoder, then pick the closest entry
+                uint8_t header[8] = { uint8_t( c0 ), uint8_t( c0 >> 8 ), uint8_t( c1 ), uint8_t( c1 >> 8 ), 0xE4, 0, 0, 0 };
+                uint8_t palette[64];
+                TextureProcessing::DecompressBC1Block( header, palette );
+                uint32_t indices = 0;
+                for ( uint32_t i = 0; i < 16; i++ ) {
+                    const uint8_t* p = &image.Pixels[((by * 4 + i / 4) * static_cast<size_t>(image.Width) + bx * 4 + i % 4) * 4];
+                    int best = 0;
+                    int bestError = 1 << 30;
+                    for ( int k = 0; k < 4; k++ ) {
+                        int e = 0;
+                        for ( int c = 0; c < 3; c++ ) {
+                            int d = int( p[c] ) - int( palette[k * 4 + c] );
+                            e += d * d;
+                        }
+                        if ( e < bestError ) {
+                            bestError = e;
+                            best = k;
+                        }
+                    }
+                    indices |= uint32_t( best ) << (2 * i);
+                }
+
+                uint8_t* dst = &out[(static_cast<size_t>(by) * blocksX + bx) * 8];
+                memcpy( dst, header, 4 );
+                memcpy( dst + 4, &indices, 4 );
+            }
+        }
+    }
+
+    void CheckSRGB() {
+        for ( int i = 0; i < 256; i++ ) {
+            Check( TextureProcessing::LinearToSRGB( TextureProcessing::SRGBToLinear( uint8_t( i ) ) ) == i, "sRGB survives the round-trip" );
+        }
+
+        // Compare to rounding the exact conversion, away from the points exactly between two values
+        int numMismatches = 0;
+        const int numSteps = 1 << 20;
+        for ( int i = 0; i <= numSteps; i++ ) {
+            double v = double( i ) / numSteps;
+            double s = v <= 0.0031308 ? v * 12.92 : 1.055 * pow( v, 1.0 / 2.4 ) - 0.055;
+            double scaled = s * 255.0;
+            if ( fabs( scaled - floor( scaled ) - 0.5 ) < 1e-3 )
+                continue;
+
+            if ( TextureProcessing::LinearToSRGB( float( v ) ) != lround( scaled ) )
+                numMismatches++;
+        }
+        Check( numMismatches == 0, "linear to sRGB rounds like the exact conversion" );
+
+        Check( TextureProcessing::LinearToSRGB( -1.0f ) == 0 && TextureProcessing::LinearToSRGB( 2.0f ) == 255, "out of range values are clamped" );
+    }
+
+    /** Averaging black and white has to give half the light, not half the value */
+    void CheckGamma() {
+        Image checker = MakeImage( 2, 2 );
+        for ( uint32_t i = 0; i < 4; i++ ) {
+            uint8_t v = ((i ^ (i >> 1)) & 1) ? 255 : 0;
+            memset( &checker.Pixels[i * 4], v, 3 );
+            checker.Pixels[i * 4 + 3] = v;
+        }
+
+        TextureProcessOptions options;
+        options.Format = TBF_RGBA8;
+        options.Filter = TMF_BOX;
+        ProcessedTexture processed;
+        TextureProcessing::Process( checker.Pixels.data(), 2, 2, 8, options, processed );
+        const uint8_t* mip = processed.GetLevelData( 1 );
+        Check( processed.Levels.size() == 2 && mip[0] == 188 && mip[1] == 188 && mip[2] == 188, "gamma-correct average" );
+        Check( mip[3] == 128, "alpha is averaged as it is" );
+
+        options.GammaCorrect = false;
+        TextureProcessing::Process( checker.Pixels.data(), 2, 2, 8, options, processed );
+        Check( processed.GetLevelData( 1 )[0] == 128, "plain average without gamma-correction" );
+    }
+
+    /** Double precision reference: the same filter, level by level, without rounding in between */
+    std::vector<double> ReferenceDownsample( const std::vector<double>& src, uint32_t width, uint32_t height, ETextureMipFilter filter ) {
+        std::vector<double> taps;
+        int first;
+        if ( filter == TMF_BOX ) {
+            taps = { 0.5, 0.5 };
+            first = 0;
+        } else {
+            auto bessel = []( double x ) {
+                double sum = 1.0, term = 1.0;
+                for ( int k = 1; k < 40; k++ ) {
+                    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                    sum += term;
+                }
+                return sum;
+            };
+            first = -2;
+            double total = 0.0;
+            for ( int i = 0; i < 6; i++ ) {
+                double d = (first + i - 0.5) / 2.0;
+                double r = d / 1.5;
+                taps.push_back( sin( M_PI * d ) / (M_PI * d) * bessel( 4.0 * sqrt( 1.0 - r * r ) ) / bessel( 4.0 ) );
+                total += taps.back();
+            }
+            for ( double& t : taps ) {
+                t /= total;
+            }
+        }
+
+        uint32_t dw = std::max( width / 2, 1u );
+        uint32_t dh = std::max( height / 2, 1u );
+        std::vector<double> rows( static_cast<size_t>(dw) * height * 4 );
+        for ( uint32_t y = 0; y < height; y++ ) {
+            for ( uint32_t x = 0; x < dw; x++ ) {
+                for ( int c = 0; c < 4; c++ ) {
+                    double sum = 0.0;
+                    if ( width == 1 ) {
+                        sum = src[(y * width) * 4 + c];
+                    } else {
+                        for ( size_t k = 0; k < taps.size(); k++ ) {
+                            int s = std::min( std::max( int( 2 * x ) + first + int( k ), 0 ), int( width ) - 1 );
+                            sum += taps[k] * src[(y * width + s) * 4 + c];
+                        }
+                    }
+                    rows[(y * dw + x) * 4 + c] = sum;
+                }
+            }
+        }
+
+        std::vector<double> out( static_cast<size_t>(dw) * dh * 4 );
+        for ( uint32_t y = 0; y < dh; y++ ) {
+            for ( uint32_t x = 0; x < dw; x++ ) {
+                for ( int c = 0; c < 4; c++ ) {
+                    double sum = 0.0;
+                    if ( height == 1 ) {
+                        sum = rows[x * 4 + c];
+                    } else {
+                        for ( size_t k = 0; k < taps.size(); k++ ) {
+                            int s = std::min( std::max( int( 2 * y ) + first + int( k ), 0 ), int( height ) - 1 );
+                            sum += taps[k] * rows[(s * dw + x) * 4 + c];
+                        }
+                    }
+                    out[(y * dw + x) * 4 + c] = std::min( std::max( sum, 0.0 ), 1.0 );
+                }
+            }
+        }
+        return out;
+    }
+
+    void CheckMips() {
+        const Image images[] = { MakeStone( 256 ), MakeEdges( 256 ), MakeFoliage( 256 ) };
+        const char* names[] = { "stone", "edges", "foliage" };
+
+        for ( int filter = TMF_BOX; filter <= TMF_KAISER; filter++ ) {
+            double worstPSNR = 99.0;
+            int maxDifference = 0;
+            for ( int n = 0; n < 3; n++ ) {
+                // Non-square, to get levels of width 1
+                const Image& source = images[n];
+                uint32_t width = source.Width;
+                uint32_t height = source.Height / 4;
+
+                TextureProcessOptions options;
+                options.Format = TBF_RGBA8;
+                options.Filter = ETextureMipFilter( filter );
+                ProcessedTexture processed;
+                TextureProcessing::Process( source.Pixels.data(), width, height, width * 4, options, processed );
+                Check( processed.Levels.size() == 9 && processed.Levels[8].Width == 1 && processed.Levels[8].Height == 1, "full chain" );
+
+                std::vector<double> reference( static_cast<size_t>(width) * height * 4 );
+                for ( size_t i = 0; i < reference.size(); i++ ) {
+                    double v = source.Pixels[i] / 255.0;
+                    reference[i] = (i % 4 == 3) ? v : (v <= 0.04045 ? v / 12.92 : pow( (v + 0.055) / 1.055, 2.4 ));
+                }
+
+                Check( memcmp( processed.GetLevelData( 0 ), source.Pixels.data(), size_t( width ) * height * 4 ) == 0, "first level is the source" );
+                for ( size_t l = 1; l < processed.Levels.size(); l++ ) {
+                    reference = ReferenceDownsample( reference, width, height, ETextureMipFilter( filter ) );
+                    width = processed.Levels[l].Width;
+                    height = processed.Levels[l].Height;
+
+                    std::vector<uint8_t> expected( reference.size() );
+                    for ( size_t i = 0; i < reference.size(); i++ ) {
+                        double v = reference[i];
+                        if ( i % 4 != 3 ) {
+                            v = v <= 0.0031308 ? v * 12.92 : 1.055 * pow( v, 1.0 / 2.4 ) - 0.055;
+                        }
+                        expected[i] = ToByte( v );
+                    }
+
+                    const uint8_t* mip = processed.GetLevelData( uint32_t( l ) );
+                    for ( size_t i = 0; i < expected.size(); i++ ) {
+                        maxDifference = std::max( maxDifference, abs( int( mip[i] ) - int( expected[i] ) ) );
+                    }
+                    if ( width * height >= 16 ) {
+                        worstPSNR = std::min( worstPSNR, PSNR( mip, expected.data(), size_t( width ) * height, 0, 4 ) );
+                    }
+                }
+                (void)names;
+            }
+
+            printf( "%s mips: worst level %.2f dB against the reference, largest difference %d\n",
+                filter == TMF_BOX ? "Box" : "Kaiser", worstPSNR, maxDifference );
+            Check( maxDifference <= 1, "mip-levels match the reference up to rounding" );
+            Check( worstPSNR > 55.0, "mip-levels are close to the reference" );
+        }
+    }
+
+    void CheckSingleColors() {
+        int maxError = 0;
+        for ( int i = 0; i < 4096; i++ ) {
+            uint8_t color[4] = { uint8_t( Rng() ), uint8_t( Rng() ), uint8_t( Rng() ), 255 };
+            if ( i < 256 ) {
+                color[0] = color[1] = color[2] = uint8_t( i );
+            }
+
+            uint8_t block[64];
+            for ( int p = 0; p < 16; p++ ) {
+                memcpy( block + p * 4, color, 4 );
+            }
+
+            uint8_t bc1[8];
+            uint8_t decoded[64];
+            TextureProcessing::CompressBC1Block( block, bc1 );
+            TextureProcessing::DecompressBC1Block( bc1, decoded );
+            for ( int c = 0; c < 3; c++ ) {
+                maxError = std::max( maxError, abs( int( decoded[c] ) - int( color[c] ) ) );
+            }
+            Check( decoded[3] == 255, "single colors stay opaque" );
+        }
+
+        printf( "Single color blocks: largest error %d\n", maxError );
+        Check( maxError <= 2, "single color blocks hit the color" );
+    }
+
+    void CheckCompression() {
+        struct TestImage {
+            const char* Name;
+            Image Source;
+            double MinBC1;
+        };
+
+        TestImage images[] = {
+            { "gradient", MakeGradient( 512 ), 40.0 },
+            { "stone", MakeStone( 512 ), 36.0 },
+            { "edges", MakeEdges( 512 ), 33.0 },
+        };
+
+        for ( TestImage& t : images ) {
+            const Image& s = t.Source;
+            std::vector<uint8_t> bc1( TextureProcessing::GetLevelSize( TBF_BC1, s.Width, s.Height ) );
+            TextureProcessing::CompressImage( s.Pixels.data(), s.Width, s.Height, s.Width * 4, TBF_BC1, bc1.data(), nullptr );
+            std::vector<uint8_t> decoded = Decompress( bc1.data(), s.Width, s.Height, TBF_BC1 );
+            double psnr = PSNR( s.Pixels.data(), decoded.data(), size_t( s.Width ) * s.Height, 0, 3 );
+
+            std::vector<uint8_t> boxBC1;
+            CompressBoundingBox( s, boxBC1 );
+            std::vector<uint8_t> boxDecoded = Decompress( boxBC1.data(), s.Width, s.Height, TBF_BC1 );
+            double boxPsnr = PSNR( s.Pixels.data(), boxDecoded.data(), size_t( s.Width ) * s.Height, 0, 3 );
+
+            printf( "BC1 %-9s %.2f dB (bounding box encoder: %.2f dB)\n", t.Name, psnr, boxPsnr );
+            Check( psnr >= t.MinBC1, "BC1 quality" );
+            Check( psnr >= boxPsnr, "better than the bounding box" );
+
+            // Every BC1-block has to be in the opaque four color mode, or a single color
+            bool opaque = true;
+            for ( size_t i = 0; i < decoded.size(); i += 4 ) {
+                opaque = opaque && decoded[i + 3] == 255;
+            }
+            Check( opaque, "BC1 stays opaque" );
+        }
+
+        Image foliage = MakeFoliage( 512 );
+        std::vector<uint8_t> bc3( TextureProcessing::GetLevelSize( TBF_BC3, 512, 512 ) );
+        TextureProcessing::CompressImage( foliage.Pixels.data(), 512, 512, 512 * 4, TBF_BC3, bc3.data(), nullptr );
+        std::vector<uint8_t> decoded = Decompress( bc3.data(), 512, 512, TBF_BC3 );
+        double colorPsnr = PSNR( foliage.Pixels.data(), decoded.data(), 512 * 512, 0, 3 );
+        double alphaPsnr = PSNR( foliage.Pixels.data(), decoded.data(), 512 * 512, 3, 1 );
+        printf( "BC3 foliage   %.2f dB color, %.2f dB alpha\n", colorPsnr, alphaPsnr );
+        Check( colorPsnr >= 36.0 && alphaPsnr >= 38.0, "BC3 quality" );
+
+        // Sizes that aren't a multiple of the block size repeat their border
+        Image odd = MakeStone( 64 );
+        for ( uint32_t size : { 1u, 2u, 3u, 5u, 6u, 7u } ) {
+            std::vector<uint8_t> blocks( TextureProcessing::GetLevelSize( TBF_BC3, size, size + 1 ) );
+            TextureProcessing::CompressImage( odd.Pixels.data(), size, size + 1, 64 * 4, TBF_BC3, blocks.data(), nullptr );
+            std::vector<uint8_t> out = Decompress( blocks.data(), size, size + 1, TBF_BC3 );
+            int maxError = 0;
+            for ( uint32_t y = 0; y < size + 1; y++ ) {
+                for ( uint32_t x = 0; x < size * 4; x++ ) {
+                    maxError = std::max( maxError, abs( int( out[(y * size) * 4 + x] ) - int( odd.Pixels[(y * 64) * 4 + x] ) ) );
+                }
+            }
+            Check( maxError < 24, "partial blocks" );
+        }
+    }
+
+    void CheckThreads() {
+        ThreadPool pool( std::max( 2u, std::thread::hardware_concurrency() ) );
+        Image stone = MakeStone( 1024 );
+
+        for ( ETextureBlockFormat format : { TBF_BC1, TBF_BC3 } ) {
+            std::vector<uint8_t> single( TextureProcessing::GetLevelSize( format, 1024, 1024 ) );
+            std::vector<uint8_t> threaded( single.size() );
+
+            const int numRounds = 5;
+            auto start = std::chrono::high_resolution_clock::now();
+            for ( int r = 0; r < numRounds; r++ ) {
+                TextureProcessing::CompressImage( stone.Pixels.data(), 1024, 1024, 1024 * 4, format, single.data(), nullptr );
+            }
+            double singleSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count() / numRounds;
+
+            start = std::chrono::high_resolution_clock::now();
+            for ( int r = 0; r < numRounds; r++ ) {
+                TextureProcessing::CompressImage( stone.Pixels.data(), 1024, 1024, 1024 * 4, format, threaded.data(), &pool );
+            }
+            double threadedSeconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count() / numRounds;
+
+            Check( single == threaded, "threads give the same blocks" );
+            printf( "%s 1024x1024: %.1f ms on one thread, %.1f ms with %zu more (%.0f MPixel/s)\n", format == TBF_BC1 ? "BC1" : "BC3",
+                singleSeconds * 1000.0, threadedSeconds * 1000.0, pool.getNumThreads(), 1.048576 / threadedSeconds );
+        }
+
+        // The whole job for a typical 512x512 surface: full chain and compression
+        Image surface = MakeStone( 512 );
+        TextureProcessOptions options;
+        options.Pool = &pool;
+        ProcessedTexture processed;
+        const int numRounds = 10;
+        auto start = std::chrono::high_resolution_clock::now();
+        for ( int r = 0; r < numRounds; r++ ) {
+            TextureProcessing::Process( surface.Pixels.data(), 512, 512, 512 * 4, options, processed );
+        }
+        double seconds = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count() / numRounds;
+
+        size_t rgbaSize = 0;
+        for ( const ProcessedTextureLevel& level : processed.Levels ) {
+            rgbaSize += size_t( level.Width ) * level.Height * 4;
+        }
+        printf( "512x512 with %zu levels to BC1: %.2f ms, %.2f MB instead of %.2f MB as RGBA8\n", processed.Levels.size(),
+            seconds * 1000.0, processed.Data.size() / (1024.0 * 1024.0), rgbaSize / (1024.0 * 1024.0) );
+    }
+}
+
+int main() {
+    CheckSRGB();
+    CheckGamma();
+    CheckMips();
+    CheckSingleColors();
+    CheckCompression();
+    CheckThreads();
+
+    if ( NumErrors ) {
+        printf( "%d errors\n", NumErrors );
+        return 1;
+    }
+
+    printf( "OK\n" );
+    return 0;
+}
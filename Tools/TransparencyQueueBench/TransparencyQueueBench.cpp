@@ -0,0 +1,196 @@
+/** Checks the sorting and batching of the transparency queue and compares it to drawing mesh by mesh
+
+    The radix sort has to give the same order as a stable comparison sort, on one thread and spread
+    over a pool, for small queues as well as for ones with only a few differing bytes in the keys.
+    The batches have to draw every mesh once, the alpha-blended meshes back to front.
+
+    Then a forest scene is queued: Trees share a handful of leaf materials, mixed with additive
+    light-shafts and some alpha-blended water plants. The number of batches is compared to the number
+    of meshes, which is how often the state was bound before, and the sort is timed against std::sort. */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include "TransparencyQueue.h"
+#include "ThreadPool.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    double Seconds( std::chrono::high_resolution_clock::time_point start ) {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+
+    std::vector<TransparencyQueue::Entry> MakeEntries( size_t n, uint64_t mask ) {
+        std::uniform_int_distribution<uint64_t> key;
+        std::vector<TransparencyQueue::Entry> entries( n );
+        for ( size_t i = 0; i < n; i++ ) {
+            entries[i].Key = key( Rng ) & mask;
+            entries[i].Item = static_cast<uint32_t>(i);
+        }
+        return entries;
+    }
+
+    bool SortsLikeStableSort( std::vector<TransparencyQueue::Entry> entries, ThreadPool* pool ) {
+        std::vector<TransparencyQueue::Entry> reference = entries;
+        std::stable_sort( reference.begin(), reference.end(), []( const auto& a, const auto& b ) { return a.Key < b.Key; } );
+
+        std::vector<TransparencyQueue::Entry> scratch;
+        TransparencyQueue::RadixSort( entries, scratch, pool );
+
+        for ( size_t i = 0; i < entries.size(); i++ ) {
+            if ( entries[i].Key != reference[i].Key || entries[i].Item != reference[i].Item )
+                return false;
+        }
+        return true;
+    }
+
+    void CheckSort( ThreadPool& pool ) {
+        for ( size_t n : { 0, 1, 2, 31, 32, 33, 1000, 20000, 300000 } ) {
+            // All bytes, only a few bytes and many equal keys, the last tests stability
+            for ( uint64_t mask : { ~0ull, 0x00FF00000000FF00ull, 0x7ull } ) {
+                std::vector<TransparencyQueue::Entry> entries = MakeEntries( n, mask );
+                Check( SortsLikeStableSort( entries, nullptr ), "radix sort on one thread" );
+                Check( SortsLikeStableSort( entries, &pool ), "radix sort with a pool" );
+            }
+        }
+    }
+
+    void CheckKeys() {
+        const float distances[] = { 0.0f, 0.5f, 1.0f, 100.0f, 1e6f, 3.4e38f };
+        for ( size_t i = 1; i < sizeof( distances ) / sizeof( distances[0] ); i++ ) {
+            Check( TransparencyQueue::MakeKey( distances[i], TB_ALPHA, 0 ) < TransparencyQueue::MakeKey( distances[i - 1], TB_ALPHA, 0 ),
+                "farther meshes come first" );
+        }
+
+        // Slightly behind the camera still sorts behind everything in front
+        Check( TransparencyQueue::MakeKey( -1.0f, TB_ALPHA, 0 ) > TransparencyQueue::MakeKey( 0.0f, TB_ADDITIVE, 100 ), "negative distances" );
+        Check( TransparencyQueue::MakeKey( -1.0f, TB_ALPHA, 0 ) < TransparencyQueue::MakeKey( -2.0f, TB_ALPHA, 0 ), "negative distances" );
+    }
+
+    struct Mesh {
+        float Distance;
+        ETransparencyBlend Blend;
+        int Material;
+    };
+
+    /** Checks that every mesh is drawn once, and that alpha-blended meshes are drawn back to front */
+    void CheckBatches( const TransparencyQueue& queue, const std::vector<Mesh>& meshes, const int* materials ) {
+        std::vector<int> drawn( meshes.size() );
+        float lastAlpha = INFINITY;
+        bool ordered = true;
+        bool sameState = true;
+
+        for ( const TransparencyBatch& batch : queue.GetBatches() ) {
+            for ( uint32_t i = batch.FirstItem; i < batch.FirstItem + batch.NumItems; i++ ) {
+                const Mesh& mesh = meshes[queue.GetItems()[i]];
+                drawn[queue.GetItems()[i]]++;
+
+                sameState &= batch.Blend == mesh.Blend && batch.State == &materials[mesh.Material];
+                if ( mesh.Blend == TB_ALPHA ) {
+                    // Meshes less than 1% apart may be swapped
+                    ordered &= mesh.Distance <= lastAlpha * 1.01f;
+                    lastAlpha = mesh.Distance;
+                }
+            }
+        }
+
+        Check( std::all_of( drawn.begin(), drawn.end(), []( int d ) { return d == 1; } ), "every mesh drawn once" );
+        Check( ordered, "alpha-blended meshes back to front" );
+        Check( sameState, "batches only hold meshes of their state" );
+    }
+
+    /** A forest around the camera: leaves of a few materials, light-shafts and water plants */
+    std::vector<Mesh> MakeForest( size_t numTrees ) {
+        std::uniform_real_distribution<float> position( -6000.0f, 6000.0f );
+        std::uniform_int_distribution<int> leafMaterial( 0, 5 );
+        std::uniform_int_distribution<int> percent( 0, 99 );
+
+        std::vector<Mesh> meshes;
+        for ( size_t t = 0; t < numTrees; t++ ) {
+            const float x = position( Rng );
+            const float z = position( Rng );
+            const float distance = sqrtf( x * x + z * z );
+
+            // Two crowns per tree, of the same material
+            const int material = leafMaterial( Rng );
+            meshes.push_back( { distance, TB_ALPHA, material } );
+            meshes.push_back( { distance + 50.0f, TB_ALPHA, material } );
+
+            const int p = percent( Rng );
+            if ( p < 25 ) {
+                meshes.push_back( { distance + 10.0f, TB_ADDITIVE, 6 + p % 2 } );
+            } else if ( p < 35 ) {
+                meshes.push_back( { distance - 20.0f, TB_ALPHA, 8 } );
+            }
+        }
+        return meshes;
+    }
+
+    void CheckForest( ThreadPool& pool ) {
+        int materials[9];
+
+        for ( size_t numTrees : { 1000, 5000, 100000 } ) {
+            std::vector<Mesh> meshes = MakeForest( numTrees );
+
+            TransparencyQueue queue;
+            for ( size_t i = 0; i < meshes.size(); i++ ) {
+                queue.Add( meshes[i].Distance, meshes[i].Blend, &materials[meshes[i].Material], static_cast<uint32_t>(i) );
+            }
+
+            // Build sorts in place, so time it on copies of the filled queue
+            const int numRounds = numTrees > 10000 ? 10 : 200;
+            double serial = 0.0;
+            double parallel = 0.0;
+            for ( int r = 0; r < numRounds; r++ ) {
+                TransparencyQueue q = queue;
+                auto start = std::chrono::high_resolution_clock::now();
+                q.Build( nullptr );
+                serial += Seconds( start );
+
+                q = queue;
+                start = std::chrono::high_resolution_clock::now();
+                q.Build( &pool );
+                parallel += Seconds( start );
+            }
+
+            double comparison = 0.0;
+            for ( int r = 0; r < numRounds; r++ ) {
+                std::vector<Mesh> sorted = meshes;
+                auto start = std::chrono::high_resolution_clock::now();
+                std::sort( sorted.begin(), sorted.end(), []( const Mesh& a, const Mesh& b ) { return a.Distance > b.Distance; } );
+                comparison += Seconds( start );
+            }
+
+            queue.Build( &pool );
+            CheckBatches( queue, meshes, materials );
+
+            printf( "%6zu meshes: %6zu batches (%.1f meshes per bind), sort and batch %.3f ms, with pool %.3f ms, std::sort alone %.3f ms\n",
+                meshes.size(), queue.GetBatches().size(), meshes.size() / double( queue.GetBatches().size() ),
+                serial * 1000.0 / numRounds, parallel * 1000.0 / numRounds, comparison * 1000.0 / numRounds );
+        }
+    }
+}
+
+int main() {
+    ThreadPool pool( std::max( 2u, std::thread::hardware_concurrency() ) );
+
+    CheckKeys();
+    CheckSort( pool );
+    CheckForest( pool );
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
@@ -0,0 +1,349 @@
+/** Checks the batching of the UI trianglefans and shows how many draw calls it saves
+
+    Fans are turned into lists with the winding of WorldConverter::TriangleFanToList. Consecutive fans
+    and lists with the same state have to end up in one batch, a different state, a full batch or a
+    flush starts a new one. Big fans are split, every batch stays a whole trianglelist and fits the
+    buffer. Random streams of fans, lists and flushes are compared to drawing each of them on its own:
+    The batches have to contain the same triangles in the same order, each with the state it was
+    queued with.
+
+    The states are keyed like the engine does it, by the exact keys of PipelineStateKey. States which
+    only differ in a single field, like the z-bias or the alpha blend-op, must never share a batch.
+    Finally a menu-like frame is batched to show the number of draw calls. */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "PipelineStateKey.h"
+#include "TriangleFanBatcher.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            if ( NumErrors < 10 ) {
+                printf( "FAILED: %s\n", what );
+            }
+            NumErrors++;
+        }
+    }
+
+    double Seconds() {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now().time_since_epoch() ).count();
+    }
+
+    /** Vertices only carry a number, so every triangle can be traced back to its fan */
+    struct Vertex {
+        uint32_t Id;
+    };
+
+    /** Same fields FixedFunctionBatchState compares: The texture and the exact keys of the states */
+    struct State {
+        uint32_t Texture = 0;
+        uint64_t Blend = 0;
+        uint64_t Depth = 0;
+        uint64_t Rasterizer = 0;
+
+        bool operator == ( const State& o ) const {
+            return Texture == o.Texture && Blend == o.Blend && Depth == o.Depth && Rasterizer == o.Rasterizer;
+        }
+    };
+
+    struct Batch {
+        State Key;
+        std::vector<Vertex> Vertices;
+    };
+
+    typedef TriangleFanBatcher<Vertex, State> Batcher;
+
+    Batcher MakeBatcher( unsigned int maxVertices, std::vector<Batch>& out ) {
+        return Batcher( maxVertices, [&out]( const State& key, const Vertex* vertices, unsigned int numVertices ) {
+            Batch b;
+            b.Key = key;
+            b.Vertices.assign( vertices, vertices + numVertices );
+            out.push_back( std::move( b ) );
+        } );
+    }
+
+    /** Like WorldConverter::TriangleFanToList */
+    void ReferenceFanToList( const std::vector<Vertex>& fan, std::vector<Vertex>& out ) {
+        for ( size_t i = 1; i + 1 < fan.size(); i++ ) {
+            out.push_back( fan[0] );
+            out.push_back( fan[i + 1] );
+            out.push_back( fan[i] );
+        }
+    }
+
+    State MakeState( uint32_t texture, int destBlend, int blendOpAlpha, int zBias, bool depthWrite ) {
+        State s;
+        s.Texture = texture;
+        s.Blend = PipelineStateKey::PackBlend( 5, destBlend, 1, 2, 1, blendOpAlpha, true, false, true );
+        s.Depth = PipelineStateKey::PackDepth( true, depthWrite, 4 );
+        s.Rasterizer = PipelineStateKey::PackRasterizer( 1, false, true, false, zBias );
+        return s;
+    }
+
+    std::vector<Vertex> MakeFan( uint32_t& nextId, unsigned int numVertices ) {
+        std::vector<Vertex> fan( numVertices );
+        for ( Vertex& v : fan ) {
+            v.Id = nextId++;
+        }
+        return fan;
+    }
+
+    bool SameIds( const std::vector<Vertex>& a, const std::vector<Vertex>& b ) {
+        if ( a.size() != b.size() )
+            return false;
+
+        for ( size_t i = 0; i < a.size(); i++ ) {
+            if ( a[i].Id != b[i].Id )
+                return false;
+        }
+        return true;
+    }
+
+    void TestBasics() {
+        std::vector<Batch> batches;
+        Batcher b = MakeBatcher( 3000, batches );
+        Check( b.GetMaxVertices() == 3000, "whole triangles keep their size" );
+        Check( MakeBatcher( 3001, batches ).GetMaxVertices() == 3000, "size is rounded down to whole triangles" );
+        Check( MakeBatcher( 1, batches ).GetMaxVertices() == 3, "size holds at least one triangle" );
+        Check( MakeBatcher( 0, batches ).GetMaxVertices() == 3, "size 0 holds one triangle" );
+
+        // Winding has to match the unbatched path
+        uint32_t id = 0;
+        std::vector<Vertex> fan = MakeFan( id, 7 );
+        std::vector<Vertex> list( 15 ), reference;
+        Batcher::FanToList( fan.data(), 0, 5, list.data() );
+        ReferenceFanToList( fan, reference );
+        Check( SameIds( list, reference ), "fan is turned into a list with the same winding" );
+
+        std::vector<Vertex> part( 6 );
+        Batcher::FanToList( fan.data(), 2, 2, part.data() );
+        Check( SameIds( part, std::vector<Vertex>( reference.begin() + 6, reference.begin() + 12 ) ), "part of a fan starts at the right triangle" );
+
+        // Degenerate input doesn't queue anything
+        State s = MakeState( 1, 6, 1, 0, false );
+        b.AddFan( s, fan.data(), 2 );
+        b.AddFan( s, fan.data(), 0 );
+        b.AddTriangles( s, fan.data(), 2 );
+        Check( b.IsEmpty(), "fans with less than 3 vertices and partial triangles are dropped" );
+        b.Flush();
+        Check( batches.empty(), "flushing nothing doesn't draw" );
+
+        b.AddTriangles( s, fan.data(), 7 );
+        Check( b.GetNumPendingVertices() == 6, "trailing vertices of a list are dropped" );
+
+        // Same state goes into the same batch, until it changes
+        b.AddFan( s, fan.data(), 7 );
+        b.AddFan( s, fan.data(), 4 );
+        Check( batches.empty(), "same state doesn't draw" );
+        Check( b.GetNumPendingVertices() == 6 + 15 + 6, "fans are appended" );
+
+        State other = MakeState( 2, 6, 1, 0, false );
+        b.AddFan( other, fan.data(), 3 );
+        Check( batches.size() == 1 && batches[0].Key == s && batches[0].Vertices.size() == 27, "state change draws the old batch with its own state" );
+
+        b.Flush();
+        Check( batches.size() == 2 && batches[1].Key == other && b.IsEmpty(), "flush draws the pending batch" );
+    }
+
+    /** States which only differ in one field must not be merged, like a 32-bit hash could */
+    void TestStateKeys() {
+        std::vector<State> states;
+        states.push_back( MakeState( 1, 6, 1, 0, false ) );
+        states.push_back( MakeState( 2, 6, 1, 0, false ) );
+        states.push_back( MakeState( 1, 2, 1, 0, false ) );
+        states.push_back( MakeState( 1, 6, 2, 0, false ) );
+        states.push_back( MakeState( 1, 6, 1, 1, false ) );
+        states.push_back( MakeState( 1, 6, 1, -1, false ) );
+        states.push_back( MakeState( 1, 6, 1, 0x10000, false ) );
+        states.push_back( MakeState( 1, 6, 1, 0, true ) );
+
+        for ( size_t i = 0; i < states.size(); i++ ) {
+            for ( size_t j = 0; j < states.size(); j++ ) {
+                Check( (states[i] == states[j]) == (i == j), "states differing in one field have different keys" );
+            }
+        }
+
+        std::vector<Batch> batches;
+        Batcher b = MakeBatcher( 3000, batches );
+        uint32_t id = 0;
+        for ( const State& s : states ) {
+            std::vector<Vertex> fan = MakeFan( id, 4 );
+            b.AddFan( s, fan.data(), 4 );
+        }
+        b.Flush();
+
+        Check( batches.size() == states.size(), "every state gets a batch of its own" );
+        for ( size_t i = 0; i < batches.size() && i < states.size(); i++ ) {
+            Check( batches[i].Key == states[i], "batch is drawn with its state" );
+        }
+    }
+
+    void TestSplitting() {
+        for ( unsigned int maxVertices : { 3u, 6u, 30u, 31u, 300u } ) {
+            std::vector<Batch> batches;
+            Batcher b = MakeBatcher( maxVertices, batches );
+            State s = MakeState( 1, 6, 1, 0, false );
+
+            uint32_t id = 0;
+            std::vector<Vertex> reference;
+            for ( unsigned int n : { 3u, 5u, 40u, 102u, 4u } ) {
+                std::vector<Vertex> fan = MakeFan( id, n );
+                ReferenceFanToList( fan, reference );
+                b.AddFan( s, fan.data(), n );
+
+                // A list which doesn't fit is split too
+                std::vector<Vertex> list = MakeFan( id, n * 3 );
+                reference.insert( reference.end(), list.begin(), list.end() );
+                b.AddTriangles( s, list.data(), static_cast<unsigned int>(list.size()) );
+            }
+            b.Flush();
+
+            std::vector<Vertex> drawn;
+            bool fits = true;
+            for ( const Batch& batch : batches ) {
+                fits = fits && batch.Vertices.size() <= b.GetMaxVertices() && batch.Vertices.size() % 3 == 0 && !batch.Vertices.empty();
+                drawn.insert( drawn.end(), batch.Vertices.begin(), batch.Vertices.end() );
+            }
+
+            Check( fits, "split batches are whole trianglelists and fit" );
+            Check( SameIds( drawn, reference ), "split batches contain every triangle in order" );
+
+            // Only the last batch may be partially filled
+            bool full = true;
+            for ( size_t i = 0; i + 1 < batches.size(); i++ ) {
+                full = full && batches[i].Vertices.size() == b.GetMaxVertices();
+            }
+            Check( full, "batches are filled before a new one starts" );
+        }
+    }
+
+    /** Random streams, compared to drawing every fan on its own */
+    void TestRandomStreams() {
+        std::vector<State> states;
+        for ( int i = 0; i < 4; i++ ) {
+            states.push_back( MakeState( i % 2, 6, 1, i / 2, false ) );
+        }
+
+        for ( int round = 0; round < 300; round++ ) {
+            const unsigned int maxVertices = 3 + Rng() % 200;
+            std::vector<Batch> batches;
+            Batcher b = MakeBatcher( maxVertices, batches );
+
+            // Every triangle with the state it was queued with
+            std::vector<Vertex> reference;
+            std::vector<size_t> referenceStates;
+            std::vector<size_t> drawnStates;
+            std::vector<size_t> runLengths;
+            size_t lastState = SIZE_MAX;
+            uint32_t id = 0;
+
+            for ( int op = 0; op < 200; op++ ) {
+                const int what = Rng() % 10;
+                if ( what == 0 ) {
+                    b.Flush();
+                    lastState = SIZE_MAX;
+                    continue;
+                }
+
+                // Mostly keep the state, like the UI does
+                size_t state = lastState != SIZE_MAX && Rng() % 4 != 0 ? lastState : Rng() % states.size();
+                const unsigned int n = Rng() % 12;
+                std::vector<Vertex> fan = MakeFan( id, n );
+
+                size_t before = reference.size();
+                if ( what < 7 ) {
+                    ReferenceFanToList( fan, reference );
+                    b.AddFan( states[state], fan.data(), n );
+                } else {
+                    reference.insert( reference.end(), fan.begin(), fan.begin() + (n - n % 3) );
+                    b.AddTriangles( states[state], fan.data(), n );
+                }
+
+                referenceStates.resize( reference.size(), state );
+                if ( reference.size() > before ) {
+                    if ( state != lastState )
+                        runLengths.push_back( 0 );
+
+                    runLengths.back() += reference.size() - before;
+                    lastState = state;
+                }
+            }
+            b.Flush();
+
+            std::vector<Vertex> drawn;
+            for ( const Batch& batch : batches ) {
+                size_t state = 0;
+                while ( state < states.size() && !(states[state] == batch.Key) )
+                    state++;
+
+                drawn.insert( drawn.end(), batch.Vertices.begin(), batch.Vertices.end() );
+                drawnStates.resize( drawn.size(), state );
+            }
+
+            Check( SameIds( drawn, reference ), "random stream draws every triangle in order" );
+            Check( drawnStates == referenceStates, "random stream draws every triangle with its state" );
+
+            // Only state changes, flushes and full batches may split a run
+            size_t expectedBatches = 0;
+            for ( size_t length : runLengths ) {
+                expectedBatches += (length + b.GetMaxVertices() - 1) / b.GetMaxVertices();
+            }
+            Check( batches.size() == expectedBatches, "random stream isn't split more than needed" );
+        }
+    }
+
+    /** Menu-like frame: Backgrounds, borders and lots of text, mostly with the same state */
+    void BenchFrame() {
+        std::vector<State> states;
+        states.push_back( MakeState( 1, 6, 1, 0, false ) );
+        states.push_back( MakeState( 2, 6, 1, 0, false ) );
+        states.push_back( MakeState( 3, 2, 1, 0, false ) );
+
+        uint32_t id = 0;
+        std::vector<std::vector<Vertex>> fans;
+        std::vector<size_t> fanStates;
+        for ( int i = 0; i < 5000; i++ ) {
+            fans.push_back( MakeFan( id, 4 ) );
+            fanStates.push_back( i % 500 == 0 ? 2 : (i / 50) % 2 );
+        }
+
+        unsigned int numDraws = 0;
+        unsigned int numVertices = 0;
+        Batcher b( 6000, [&]( const State&, const Vertex*, unsigned int n ) {
+            numDraws++;
+            numVertices += n;
+        } );
+
+        const int frames = 200;
+        double start = Seconds();
+        for ( int frame = 0; frame < frames; frame++ ) {
+            for ( size_t i = 0; i < fans.size(); i++ ) {
+                b.AddFan( states[fanStates[i]], fans[i].data(), 4 );
+            }
+            b.Flush();
+        }
+        double time = Seconds() - start;
+
+        Check( numVertices == frames * fans.size() * 6, "frame draws every triangle" );
+        printf( "%zu fans per frame: %u draw calls instead of %zu, %.3f ms batching\n",
+            fans.size(), numDraws / frames, fans.size(), time * 1000.0 / frames );
+    }
+}
+
+int main() {
+    TestBasics();
+    TestStateKeys();
+    TestSplitting();
+    TestRandomStreams();
+    BenchFrame();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/** Checks UIDirtyRegion and shows how much of the screen gets redrawn
+
+    Random rectangles are invalidated and the region is compared against a pixel-mask of everything
+    that was touched: every touched pixel has to be covered, rectangles must stay inside the bounds
+    and there may never be more than the maximum. Then a few typical editor-interactions are played
+    through and the redrawn area is compared to drawing the whole screen every frame. */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "UIDirtyRegion.h"
+
+namespace {
+    const int WIDTH = 320;
+    const int HEIGHT = 200;
+
+    std::mt19937 Rng( 1 );
+
+    float Rand( float a, float b ) {
+        return std::uniform_real_distribution<float>( a, b )( Rng );
+    }
+
+    UIRect RandomRect() {
+        const float x = Rand( -40.0f, WIDTH ), y = Rand( -40.0f, HEIGHT );
+        return UIRect( x, y, x + Rand( 1.0f, 80.0f ), y + Rand( 1.0f, 60.0f ) );
+    }
+
+    /** Marks the pixel-centers inside the rect */
+    void Mark( std::vector<char>& mask, const UIRect& r ) {
+        for ( int y = 0; y < HEIGHT; y++ ) {
+            for ( int x = 0; x < WIDTH; x++ ) {
+                if ( x + 0.5f > r.Left && x + 0.5f < r.Right && y + 0.5f > r.Top && y + 0.5f < r.Bottom )
+                    mask[y * WIDTH + x] = 1;
+            }
+        }
+    }
+
+    size_t CheckRegion( const UIDirtyRegion& region, const std::vector<char>& touched, size_t maxRects ) {
+        size_t errors = 0;
+        std::vector<char> covered( touched.size(), 0 );
+        for ( const UIRect& r : region.GetRects() ) {
+            Mark( covered, r );
+            if ( !region.GetBounds().Contains( r ) )
+                errors++;
+        }
+
+        for ( size_t i = 0; i < touched.size(); i++ ) {
+            if ( touched[i] && !covered[i] )
+                errors++;
+        }
+
+        if ( region.GetRects().size() > maxRects )
+            errors++;
+
+        // Intersects against brute force
+        for ( int q = 0; q < 50; q++ ) {
+            const UIRect r = RandomRect();
+            bool expected = false;
+            for ( const UIRect& d : region.GetRects() ) {
+                expected |= d.Intersects( r );
+            }
+
+            if ( expected != region.Intersects( r ) )
+                errors++;
+        }
+
+        return errors;
+    }
+
+    /** Plays a sequence of frames, each invalidating some rects, returns the redrawn fraction */
+    template<typename F>
+    float Simulate( int frames, F&& invalidate ) {
+        UIDirtyRegion region;
+        region.SetBounds( UIRect( 0, 0, 1920, 1080 ) );
+
+        double redrawn = 0.0;
+        for ( int f = 0; f < frames; f++ ) {
+            invalidate( region, f );
+            redrawn += region.GetArea();
+            region.Clear();
+        }
+
+        return static_cast<float>(redrawn / (1920.0 * 1080.0 * frames));
+    }
+}
+
+int main() {
+    size_t numErrors = 0;
+
+    for ( size_t maxRects : { 1, 4, 8, 16 } ) {
+        for ( int round = 0; round < 20; round++ ) {
+            UIDirtyRegion region( maxRects );
+            region.SetBounds( UIRect( 0, 0, WIDTH, HEIGHT ) );
+            std::vector<char> touched( WIDTH * HEIGHT, 0 );
+
+            const int num = 1 + round * 3;
+            for ( int i = 0; i < num; i++ ) {
+                const UIRect r = RandomRect();
+                region.Add( r );
+                Mark( touched, r );
+            }
+
+            numErrors += CheckRegion( region, touched, maxRects );
+        }
+    }
+
+    printf( "random invalidations: %zu errors\n", numErrors );
+
+    // Editor open, only the help-text with the camera position changes
+    float idle = Simulate( 600, []( UIDirtyRegion& r, int ) {
+        r.Add( UIRect( 310, 0, 900, 600 ) );
+    } );
+
+    // Dragging a slider in the settings dialog, the slider and its label change every frame
+    float slider = Simulate( 600, []( UIDirtyRegion& r, int f ) {
+        r.Add( UIRect( 700, 400, 900, 420 ).Inflated( 20 ) );
+        r.Add( UIRect( 700 + f % 150, 400, 760 + f % 150, 420 ).Inflated( 20 ) );
+    } );
+
+    // Settings dialog open, nothing happens
+    float settings = Simulate( 600, []( UIDirtyRegion& r, int f ) {
+        if ( f == 0 )
+            r.AddAll();
+    } );
+
+    printf( "redrawn per frame compared to a full redraw: idle editor %.1f%%, dragging a slider %.2f%%, open settings %.2f%%\n",
+        idle * 100.0f, slider * 100.0f, settings * 100.0f );
+
+    return numErrors ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/** Checks VegetationPlacement and compares it to the old per-polygon placement
+
+    A ground-patch is built from a coarse and a finely tessellated half. Grass is placed on it twice
+    to check the result is reproducible, all pairs are checked against the minimum distance and the
+    packed instances are compared to the values they were made from. Then the instances per area are
+    compared to the old way of putting a fixed number of random spots on every polygon. */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "VegetationPlacement.h"
+
+namespace {
+    const float PATCH_SIZE = 4000.0f;
+
+    /** Adds a grid of quads over [x0, x1] x [0, PATCH_SIZE], with a bit of height */
+    void AddGrid( std::vector<float>& tris, float x0, float x1, int cells ) {
+        const float sx = (x1 - x0) / cells;
+        const float sz = PATCH_SIZE / cells;
+        auto vertex = [&]( int x, int z ) {
+            const float px = x0 + x * sx;
+            const float pz = z * sz;
+            tris.push_back( px );
+            tris.push_back( sinf( px * 0.002f ) * cosf( pz * 0.003f ) * 100.0f );
+            tris.push_back( pz );
+        };
+
+        for ( int z = 0; z < cells; z++ ) {
+            for ( int x = 0; x < cells; x++ ) {
+                vertex( x, z ); vertex( x, z + 1 ); vertex( x + 1, z );
+                vertex( x + 1, z ); vertex( x, z + 1 ); vertex( x + 1, z + 1 );
+            }
+        }
+    }
+
+    /** What GVegetationBox did before: 30 spots per polygon, no matter how large it is */
+    size_t PlacePerPolygon( const std::vector<float>& tris, std::vector<float>& positions ) {
+        VegetationPlacement::Random rnd( 7 );
+        for ( size_t i = 0; i < tris.size(); i += 9 ) {
+            for ( int d = 0; d < 30; d++ ) {
+                const float b0 = rnd.NextFloat();
+                const float b1 = (1.0f - b0) * rnd.NextFloat();
+                const float b2 = 1.0f - b0 - b1;
+                for ( int a = 0; a < 3; a++ ) {
+                    positions.push_back( tris[i + a] * b0 + tris[i + 3 + a] * b1 + tris[i + 6 + a] * b2 );
+                }
+            }
+        }
+        return positions.size() / 3;
+    }
+
+    /** Ratio of instances on the fine half to the ones on the coarse half, 1 is even */
+    float HalfRatio( const float* positions, size_t num, size_t stride ) {
+        size_t left = 0, right = 0;
+        for ( size_t i = 0; i < num; i++ ) {
+            (positions[i * stride] < PATCH_SIZE * 0.5f ? left : right)++;
+        }
+        return left ? static_cast<float>(right) / left : 0.0f;
+    }
+
+    template<typename F>
+    double MeasureMs( F&& fn ) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+}
+
+int main() {
+    size_t numErrors = 0;
+
+    // Left half coarse, right half fine
+    std::vector<float> tris;
+    AddGrid( tris, 0.0f, PATCH_SIZE * 0.5f, 4 );
+    AddGrid( tris, PATCH_SIZE * 0.5f, PATCH_SIZE, 32 );
+    const size_t numTris = tris.size() / 9;
+
+    VegetationPlacement::Settings settings;
+    settings.Seed = 1234;
+    auto filter = []( const float* p ) { return p[1] > -80.0f; };
+
+    std::vector<VegetationInstance> a, b;
+    double placeMs = MeasureMs( [&]() { VegetationPlacement::Place( &tris[0], numTris, settings, filter, a ); } );
+    VegetationPlacement::Place( &tris[0], numTris, settings, filter, b );
+
+    const bool same = a.size() == b.size() && !memcmp( a.data(), b.data(), a.size() * sizeof( VegetationInstance ) );
+    numErrors += same ? 0 : 1;
+    printf( "%zu triangles, %zu instances in %.2f ms, reproducible: %s\n", numTris, a.size(), placeMs, same ? "yes" : "NO" );
+
+    // Minimum distance and filter
+    size_t tooClose = 0, filtered = 0;
+    const float d2 = settings.MinDistance * settings.MinDistance;
+    for ( size_t i = 0; i < a.size(); i++ ) {
+        filtered += filter( a[i].Position ) ? 0 : 1;
+        for ( size_t j = i + 1; j < a.size(); j++ ) {
+            float d = 0.0f;
+            for ( int k = 0; k < 3; k++ ) {
+                d += (a[i].Position[k] - a[j].Position[k]) * (a[i].Position[k] - a[j].Position[k]);
+            }
+            tooClose += d < d2 ? 1 : 0;
+        }
+    }
+    numErrors += tooClose + filtered;
+    printf( "%zu pairs closer than %.0f, %zu outside of the filter\n", tooClose, settings.MinDistance, filtered );
+
+    // Packing
+    float maxRotationError = 0.0f, maxScaleError = 0.0f;
+    VegetationPlacement::Random rnd( 99 );
+    for ( int i = 0; i < 100000; i++ ) {
+        const float p[3] = { 0, 0, 0 };
+        const float rotation = rnd.NextFloat() * 6.28318530718f;
+        const float scale = settings.MinScale + (settings.MaxScale - settings.MinScale) * rnd.NextFloat();
+        VegetationInstance v = VegetationPlacement::Encode( p, rotation, scale );
+
+        float dr = fabsf( VegetationPlacement::DecodeRotation( v ) - rotation );
+        dr = fminf( dr, 6.28318530718f - dr );
+        maxRotationError = fmaxf( maxRotationError, dr );
+        maxScaleError = fmaxf( maxScaleError, fabsf( VegetationPlacement::DecodeScale( v ) - scale ) / scale );
+    }
+
+    if ( maxRotationError > 6.28318530718f / 65536.0f || maxScaleError > 1.0f / 2048.0f )
+        numErrors++;
+
+    printf( "sizeof(VegetationInstance) %zu (matrix %zu), max rotation error %.6f rad, max relative scale error %.6f\n",
+        sizeof( VegetationInstance ), sizeof( float ) * 16, maxRotationError, maxScaleError );
+
+    // Evenness: instances on the fine half vs the coarse half, both have the same area
+    std::vector<float> old;
+    size_t numOld = PlacePerPolygon( tris, old );
+    printf( "fine/coarse ratio: per-polygon %.2f (%zu instances, %zu KB), area-weighted %.2f (%zu instances, %zu KB)\n",
+        HalfRatio( &old[0], numOld, 3 ), numOld, numOld * 64 / 1024,
+        HalfRatio( a[0].Position, a.size(), sizeof( VegetationInstance ) / sizeof( float ) ), a.size(), a.size() * sizeof( VegetationInstance ) / 1024 );
+
+    return numErrors ? 1 : 0;
+}
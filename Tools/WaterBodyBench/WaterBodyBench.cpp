@@ -0,0 +1,544 @@
+/** Checks how the water meshes are split into bodies and compares drawing the visible bodies to drawing whole meshes
+
+    A section of water is made of a lake with split vertices along its texture seams, a waterfall
+    running into it, a river coming down in steps and a few puddles. The triangles are shuffled like
+    the face optimization does. Every triangle has to be kept once, every body has to be one range
+    of the indices, and the planes have to go through the flat bodies.
+
+    Then a coast of such sections is looked at from the shore, and the drawcalls of whole meshes
+    are compared to those of the visible bodies, merged like the renderer does it. A frame without
+    any visible body doesn't need the copies of the backbuffer and the depth for the refraction.
+
+    Converted world data can be checked as well: Pass an .obj-file, the faces of every material with
+    "water" in its name (or the given text) are split into bodies and checked the same way. */
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "WaterBodies.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+
+    const float SECTION_SIZE = 16000.0f;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    double Seconds( std::chrono::high_resolution_clock::time_point start ) {
+        return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - start ).count();
+    }
+
+    struct Vertex {
+        float Position[3];
+        float TexCoord[2];
+    };
+
+    struct Mesh {
+        std::vector<Vertex> Vertices;
+        std::vector<uint32_t> Indices;
+
+        uint32_t AddVertex( float x, float y, float z, float u = 0.0f ) {
+            Vertices.push_back( { { x, y, z }, { u, 0.0f } } );
+            return static_cast<uint32_t>(Vertices.size() - 1);
+        }
+
+        /** Grid of quads from the corner along two axes, height given per column along a. Every
+            seamEvery columns the vertices are split, like at a seam of the texture. */
+        void AddGrid( const float* corner, const float* a, const float* b, int na, int nb,
+            const std::vector<float>& heights = {}, int seamEvery = 0 ) {
+            std::vector<uint32_t> left( nb + 1 );
+            std::vector<uint32_t> right( nb + 1 );
+            auto column = [&]( int i, std::vector<uint32_t>& out, float u ) {
+                const float h = heights.empty() ? 0.0f : heights[i];
+                for ( int j = 0; j <= nb; j++ ) {
+                    out[j] = AddVertex( corner[0] + a[0] * i + b[0] * j,
+                        corner[1] + a[1] * i + b[1] * j + h,
+                        corner[2] + a[2] * i + b[2] * j, u );
+                }
+            };
+
+            column( 0, left, 0.0f );
+            for ( int i = 1; i <= na; i++ ) {
+                column( i, right, 1.0f );
+                for ( int j = 0; j < nb; j++ ) {
+                    Indices.insert( Indices.end(), { left[j], right[j], right[j + 1], left[j], right[j + 1], left[j + 1] } );
+                }
+
+                if ( seamEvery && i % seamEvery == 0 ) {
+                    column( i, left, 0.0f );
+                } else {
+                    left = right;
+                }
+            }
+        }
+
+        void ShuffleTriangles() {
+            std::vector<std::array<uint32_t, 3>> triangles( Indices.size() / 3 );
+            memcpy( triangles.data(), Indices.data(), triangles.size() * sizeof( triangles[0] ) );
+            std::shuffle( triangles.begin(), triangles.end(), Rng );
+            memcpy( Indices.data(), triangles.data(), triangles.size() * sizeof( triangles[0] ) );
+        }
+    };
+
+    /** Small puddles in a section, away from where MakeSectionWater puts the lake and the river */
+    void MakePuddles( Mesh& mesh, float x, float z, int numPuddles ) {
+        std::uniform_real_distribution<float> position( 500.0f, 15000.0f );
+        std::uniform_real_distribution<float> height( 100.0f, 2000.0f );
+        for ( int p = 0; p < numPuddles; p++ ) {
+            float px, pz;
+            do {
+                px = position( Rng );
+                pz = position( Rng );
+            } while ( px > 1000.0f && px < 10000.0f && pz > 1000.0f && pz < 14000.0f );
+
+            const float corner[3] = { x + px, height( Rng ), z + pz };
+            const float a[3] = { 100.0f, 0.0f, 0.0f };
+            const float b[3] = { 0.0f, 0.0f, 100.0f };
+            mesh.AddGrid( corner, a, b, 3, 2 );
+        }
+    }
+
+    /** One section worth of water at the given corner, returns the number of bodies put in */
+    int MakeSectionWater( Mesh& mesh, float x, float z, int numPuddles ) {
+        // Lake, the top edge is where the waterfall comes down
+        const float lakeCorner[3] = { x + 2000.0f, 0.0f, z + 2000.0f };
+        const float alongX[3] = { 250.0f, 0.0f, 0.0f };
+        const float alongZ[3] = { 0.0f, 0.0f, 250.0f };
+        mesh.AddGrid( lakeCorner, alongX, alongZ, 24, 16, {}, 8 );
+
+        // Waterfall, 800 units high, starting at the far edge of the lake
+        const float fallCorner[3] = { x + 3000.0f, 0.0f, z + 6000.0f };
+        const float up[3] = { 0.0f, 100.0f, 0.0f };
+        mesh.AddGrid( fallCorner, alongX, up, 4, 8 );
+
+        // River above the fall: A flat step, a steep slope and a gentle bend. The bend is one body
+        // with the top of the steep slope, but it isn't flat.
+        std::vector<float> heights;
+        for ( int i = 0; i <= 30; i++ ) {
+            heights.push_back( i < 10 ? 800.0f : i < 12 ? 800.0f + (i - 9) * 300.0f : 1400.0f + (i - 12) * (i - 12) * 1.0f );
+        }
+        const float riverCorner[3] = { x + 3000.0f, 0.0f, z + 6000.0f };
+        const float alongRiver[3] = { 0.0f, 0.0f, 250.0f };
+        const float acrossRiver[3] = { 250.0f, 0.0f, 0.0f };
+        mesh.AddGrid( riverCorner, alongRiver, acrossRiver, 30, 4, heights );
+
+        // Puddles in the woods around it
+        MakePuddles( mesh, x, z, numPuddles );
+
+        // Lake, waterfall, the lower step, the slope and the river above it, and the puddles
+        return 1 + 1 + 3 + numPuddles;
+    }
+
+    bool SameTriangles( std::vector<uint32_t> a, std::vector<uint32_t> b ) {
+        auto sorted = []( std::vector<uint32_t>& indices ) {
+            std::vector<std::array<uint32_t, 3>> triangles( indices.size() / 3 );
+            memcpy( triangles.data(), indices.data(), triangles.size() * sizeof( triangles[0] ) );
+            std::sort( triangles.begin(), triangles.end() );
+            return triangles;
+        };
+        return a.size() == b.size() && sorted( a ) == sorted( b );
+    }
+
+    /** Builds the bodies and checks them, returns the number of planar bodies */
+    uint32_t BuildAndCheck( Mesh& mesh, std::vector<WaterBody>& bodies, const WaterBodyOptions& options = WaterBodyOptions() ) {
+        const std::vector<uint32_t> original = mesh.Indices;
+        WaterBodies::Build( mesh.Vertices.data(), sizeof( Vertex ), mesh.Indices.data(), static_cast<uint32_t>(mesh.Indices.size()), bodies, options );
+
+        Check( SameTriangles( original, mesh.Indices ), "every triangle kept once" );
+
+        uint32_t next = 0;
+        uint32_t numPlanar = 0;
+        bool contiguous = true;
+        bool planesFit = true;
+        bool boundsFit = true;
+        for ( const WaterBody& body : bodies ) {
+            contiguous &= body.FirstIndex == next && body.NumIndices > 0 && body.NumIndices % 3 == 0;
+            next = body.FirstIndex + body.NumIndices;
+
+            for ( uint32_t i = body.FirstIndex; i < body.FirstIndex + body.NumIndices; i++ ) {
+                const float* p = mesh.Vertices[mesh.Indices[i]].Position;
+                const float d = body.Normal[0] * p[0] + body.Normal[1] * p[1] + body.Normal[2] * p[2] - body.Distance;
+                if ( body.Planar ) {
+                    planesFit &= fabsf( d ) <= options.PlaneTolerance;
+                }
+                for ( int a = 0; a < 3; a++ ) {
+                    boundsFit &= p[a] >= body.Min[a] && p[a] <= body.Max[a];
+                }
+            }
+
+            const float length = sqrtf( body.Normal[0] * body.Normal[0] + body.Normal[1] * body.Normal[1] + body.Normal[2] * body.Normal[2] );
+            planesFit &= fabsf( length - 1.0f ) < 1e-4f && body.Normal[1] >= 0.0f;
+            numPlanar += body.Planar ? 1 : 0;
+        }
+
+        Check( contiguous && next == mesh.Indices.size() - mesh.Indices.size() % 3, "bodies are contiguous ranges" );
+        Check( planesFit, "planes go through the flat bodies" );
+        Check( boundsFit, "bounds hold the bodies" );
+        return numPlanar;
+    }
+
+    void CheckSection() {
+        Mesh mesh;
+        const int expected = MakeSectionWater( mesh, 0.0f, 0.0f, 12 );
+        mesh.ShuffleTriangles();
+
+        std::vector<WaterBody> bodies;
+        const uint32_t numPlanar = BuildAndCheck( mesh, bodies );
+        Check( bodies.size() == static_cast<size_t>(expected), "lake, waterfall, river steps and puddles found" );
+
+        // Everything but the river from the top step on is flat, that one slopes gently
+        Check( numPlanar == bodies.size() - 1, "flat bodies are planar" );
+
+        // The lake is the largest one and lies at 0
+        const WaterBody* lake = &bodies[0];
+        for ( const WaterBody& body : bodies ) {
+            lake = body.NumIndices > lake->NumIndices ? &body : lake;
+        }
+        Check( lake->Planar && fabsf( lake->Normal[1] - 1.0f ) < 1e-5f && fabsf( lake->Distance ) < 1e-3f, "plane of the lake" );
+
+        // Nothing to split, and a mesh without triangles
+        Mesh empty;
+        WaterBodies::Build( empty.Vertices.data(), sizeof( Vertex ), empty.Indices.data(), 0, bodies );
+        Check( bodies.empty(), "empty mesh" );
+
+        // A degenerate sliver between the waterfall and the lake must not join them
+        Mesh sliver;
+        const float corner[3] = { 0.0f, 0.0f, 0.0f };
+        const float a[3] = { 100.0f, 0.0f, 0.0f };
+        const float b[3] = { 0.0f, 0.0f, 100.0f };
+        const float up[3] = { 0.0f, 100.0f, 0.0f };
+        sliver.AddGrid( corner, a, b, 2, 2 );
+        sliver.AddGrid( corner, a, up, 2, 2 );
+        const uint32_t s0 = sliver.AddVertex( 0.0f, 0.0f, 0.0f );
+        const uint32_t s1 = sliver.AddVertex( 100.0f, 0.0f, 0.0f );
+        sliver.Indices.insert( sliver.Indices.begin(), { s0, s1, s1 } );
+        BuildAndCheck( sliver, bodies );
+        Check( bodies.size() == 2, "degenerate triangles don't bridge bodies" );
+    }
+
+    /** Camera looking along the xz-plane, far away boxes are tested against the section draw radius */
+    struct Frustum {
+        float Planes[4][4];
+
+        Frustum( const float* position, float yaw, float fovX, float fovY ) {
+            const float dir[3] = { sinf( yaw ), 0.0f, cosf( yaw ) };
+            const float right[3] = { cosf( yaw ), 0.0f, -sinf( yaw ) };
+            const float up[3] = { 0.0f, 1.0f, 0.0f };
+
+            auto set = [&]( int i, const float* side, float angle ) {
+                // Leans towards side, so it cuts off the other one. Points inside have dot(plane, p) >= plane[3]
+                float n[3];
+                for ( int a = 0; a < 3; a++ ) {
+                    n[a] = dir[a] * sinf( angle ) + side[a] * cosf( angle );
+                }
+                Planes[i][0] = n[0];
+                Planes[i][1] = n[1];
+                Planes[i][2] = n[2];
+                Planes[i][3] = n[0] * position[0] + n[1] * position[1] + n[2] * position[2];
+            };
+
+            const float left[3] = { -right[0], -right[1], -right[2] };
+            const float down[3] = { 0.0f, -1.0f, 0.0f };
+            set( 0, right, fovX * 0.5f );
+            set( 1, left, fovX * 0.5f );
+            set( 2, up, fovY * 0.5f );
+            set( 3, down, fovY * 0.5f );
+        }
+
+        bool IsBoxVisible( const float* min, const float* max ) const {
+            for ( const auto& plane : Planes ) {
+                float p[3];
+                for ( int a = 0; a < 3; a++ ) {
+                    p[a] = plane[a] >= 0.0f ? max[a] : min[a];
+                }
+                if ( plane[0] * p[0] + plane[1] * p[1] + plane[2] * p[2] < plane[3] )
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    struct SectionWater {
+        float Min[3];
+        float Max[3];
+        int Texture;
+        uint32_t BaseIndexLocation;
+        Mesh Water;
+        std::vector<WaterBody> Bodies;
+    };
+
+    /** A coast: sea in the first row of sections, inland some sections with lakes and rivers, most
+        only with puddles and some without water */
+    void CheckCoast() {
+        const int size = 8;
+        std::vector<SectionWater> sections;
+        int textures[2];
+        std::uniform_int_distribution<int> percent( 0, 99 );
+
+        for ( int sx = 0; sx < size; sx++ ) {
+            for ( int sz = 0; sz < size; sz++ ) {
+                SectionWater section;
+                const float x = sx * SECTION_SIZE;
+                const float z = sz * SECTION_SIZE;
+                if ( sz == 0 ) {
+                    const float corner[3] = { x, 0.0f, z };
+                    const float a[3] = { 500.0f, 0.0f, 0.0f };
+                    const float b[3] = { 0.0f, 0.0f, 500.0f };
+                    section.Water.AddGrid( corner, a, b, 32, 28, {}, 8 );
+                    section.Texture = 0;
+                } else {
+                    const int p = percent( Rng );
+                    if ( p < 25 ) {
+                        MakeSectionWater( section.Water, x, z, 10 );
+                    } else if ( p < 75 ) {
+                        MakePuddles( section.Water, x, z, 5 + p % 16 );
+                    } else {
+                        continue;
+                    }
+                    section.Texture = 1;
+                }
+                section.Water.ShuffleTriangles();
+
+                for ( int a = 0; a < 3; a++ ) {
+                    section.Min[a] = INFINITY;
+                    section.Max[a] = -INFINITY;
+                }
+                for ( const Vertex& v : section.Water.Vertices ) {
+                    for ( int a = 0; a < 3; a++ ) {
+                        section.Min[a] = std::min( section.Min[a], v.Position[a] );
+                        section.Max[a] = std::max( section.Max[a], v.Position[a] );
+                    }
+                }
+                sections.push_back( std::move( section ) );
+            }
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for ( SectionWater& section : sections ) {
+            BuildAndCheck( section.Water, section.Bodies );
+        }
+        const double buildTime = Seconds( start );
+
+        // Wrapped like the world converter does it: water by texture, sections in order
+        std::vector<SectionWater*> order;
+        for ( SectionWater& section : sections ) {
+            order.push_back( &section );
+        }
+        std::stable_sort( order.begin(), order.end(), []( const SectionWater* a, const SectionWater* b ) { return a->Texture < b->Texture; } );
+        uint32_t base = 0;
+        for ( SectionWater* section : order ) {
+            section->BaseIndexLocation = base;
+            base += static_cast<uint32_t>(section->Water.Indices.size());
+        }
+
+        uint64_t numBodies = 0;
+        for ( const SectionWater& section : sections ) {
+            numBodies += section.Bodies.size();
+        }
+        printf( "coast of %zu sections, %llu bodies, split in %.2f ms\n", sections.size(), (unsigned long long)numBodies, buildTime * 1000.0 );
+
+        // Walk along the shore and further inland, looking out to sea, along the coast and inland
+        for ( float walkZ : { 1.05f, 5.5f } ) {
+            const int numViews = 360;
+            uint64_t wholeDraws = 0, wholeIndices = 0, bodyDraws = 0, bodyIndices = 0, mergedDraws = 0, mergedIndices = 0;
+            int wholeCopies = 0, bodyCopies = 0;
+            std::vector<WaterDrawRange> ranges;
+
+            for ( int view = 0; view < numViews; view++ ) {
+                const float camera[3] = { (1.5f + view / float( numViews ) * (size - 3)) * SECTION_SIZE, 300.0f, SECTION_SIZE * walkZ };
+                const float yaw = view * 2.39996f; // Golden angle, covers all directions
+                const Frustum frustum( camera, yaw, 1.6f, 1.0f );
+
+                bool anyWhole = false;
+                uint64_t numVisible = 0;
+                ranges.clear();
+                for ( SectionWater& section : sections ) {
+                    // Sections in draw range and in the frustum, like CollectVisibleSections
+                    const float dx = std::max( { section.Min[0] - camera[0], 0.0f, camera[0] - section.Max[0] } );
+                    const float dz = std::max( { section.Min[2] - camera[2], 0.0f, camera[2] - section.Max[2] } );
+                    if ( dx > 4 * SECTION_SIZE || dz > 4 * SECTION_SIZE || !frustum.IsBoxVisible( section.Min, section.Max ) )
+                        continue;
+
+                    anyWhole = true;
+                    wholeDraws++;
+                    wholeIndices += section.Water.Indices.size();
+
+                    for ( const WaterBody& body : section.Bodies ) {
+                        if ( !frustum.IsBoxVisible( body.Min, body.Max ) )
+                            continue;
+
+                        bodyDraws++;
+                        numVisible += body.NumIndices;
+                        ranges.push_back( { &textures[section.Texture], section.BaseIndexLocation + body.FirstIndex, body.NumIndices } );
+                    }
+                }
+
+                WaterBodies::MergeRanges( ranges, WaterBodies::MERGE_GAP );
+                mergedDraws += ranges.size();
+                wholeCopies += anyWhole ? 1 : 0;
+                bodyCopies += ranges.empty() ? 0 : 1;
+
+                // Merged ranges are sorted and further apart than the gap, the gaps are drawn along
+                uint64_t numMerged = 0;
+                bool sorted = true;
+                for ( size_t i = 0; i < ranges.size(); i++ ) {
+                    numMerged += ranges[i].NumIndices;
+                    if ( i > 0 && ranges[i].Texture == ranges[i - 1].Texture ) {
+                        sorted &= ranges[i].FirstIndex > ranges[i - 1].FirstIndex + ranges[i - 1].NumIndices + WaterBodies::MERGE_GAP;
+                    }
+                }
+                Check( sorted, "merged ranges are sorted and apart" );
+                Check( numMerged >= numVisible, "merged ranges hold the visible bodies" );
+
+                bodyIndices += numVisible;
+                mergedIndices += numMerged;
+            }
+
+            Check( bodyIndices <= wholeIndices && bodyCopies <= wholeCopies, "visible bodies are part of the visible meshes" );
+
+            printf( " %.2f sections from the sea:\n", walkZ );
+            printf( "  whole meshes:   %6.1f draws, %8.0f indices per view, refraction copied in %d of %d views\n",
+                wholeDraws / double( numViews ), wholeIndices / double( numViews ), wholeCopies, numViews );
+            printf( "  visible bodies: %6.1f draws, %8.0f indices per view, refraction copied in %d of %d views\n",
+                bodyDraws / double( numViews ), bodyIndices / double( numViews ), bodyCopies, numViews );
+            printf( "  merged:         %6.1f draws, %8.0f indices per view\n", mergedDraws / double( numViews ), mergedIndices / double( numViews ) );
+        }
+    }
+
+    void CheckMergeRanges() {
+        int a, b;
+        std::vector<WaterDrawRange> ranges = {
+            { &b, 30, 6 }, { &a, 0, 3 }, { &a, 3, 6 }, { &a, 12, 3 }, { &b, 36, 3 }, { &a, 9, 3 }, { &a, 2, 4 }, { &b, 0, 3 } };
+        WaterBodies::MergeRanges( ranges );
+
+        std::vector<WaterDrawRange> expected = { { &a, 0, 15 }, { &b, 0, 3 }, { &b, 30, 9 } };
+        if ( &b < &a ) {
+            std::rotate( expected.begin(), expected.begin() + 1, expected.end() );
+        }
+
+        bool same = ranges.size() == expected.size();
+        for ( size_t i = 0; same && i < ranges.size(); i++ ) {
+            same = ranges[i].Texture == expected[i].Texture && ranges[i].FirstIndex == expected[i].FirstIndex && ranges[i].NumIndices == expected[i].NumIndices;
+        }
+        Check( same, "merge ranges" );
+
+        // With a gap the ranges of b close up, a is one range already
+        WaterBodies::MergeRanges( ranges, 30 );
+        Check( ranges.size() == 2 && ranges[&b < &a ? 0 : 1].NumIndices == 39, "merge ranges with a gap" );
+    }
+
+    /** Faces of the materials matching the filter, fans are split into triangles */
+    bool LoadObj( const char* file, const std::string& filter, std::map<std::string, Mesh>& meshes ) {
+        std::ifstream in( file );
+        if ( !in ) {
+            printf( "Can't open %s\n", file );
+            return false;
+        }
+
+        auto lower = []( std::string s ) {
+            std::transform( s.begin(), s.end(), s.begin(), []( unsigned char c ) { return static_cast<char>(tolower( c )); } );
+            return s;
+        };
+
+        std::vector<std::array<float, 3>> positions;
+        std::map<std::string, std::map<uint32_t, uint32_t>> remaps;
+        Mesh* mesh = nullptr;
+        std::string material;
+        std::string line;
+
+        while ( std::getline( in, line ) ) {
+            std::istringstream ls( line );
+            std::string type;
+            ls >> type;
+
+            if ( type == "v" ) {
+                std::array<float, 3> p = {};
+                ls >> p[0] >> p[1] >> p[2];
+                positions.push_back( p );
+            } else if ( type == "usemtl" ) {
+                ls >> material;
+                mesh = lower( material ).find( filter ) != std::string::npos ? &meshes[material] : nullptr;
+            } else if ( type == "f" && mesh ) {
+                std::vector<uint32_t> polygon;
+                std::string corner;
+                while ( ls >> corner ) {
+                    long index = atol( corner.c_str() );
+                    index = index < 0 ? static_cast<long>(positions.size()) + index : index - 1;
+                    if ( index < 0 || index >= static_cast<long>(positions.size()) )
+                        break;
+
+                    auto& remap = remaps[material];
+                    auto it = remap.find( static_cast<uint32_t>(index) );
+                    if ( it == remap.end() ) {
+                        const auto& p = positions[index];
+                        it = remap.emplace( static_cast<uint32_t>(index), mesh->AddVertex( p[0], p[1], p[2] ) ).first;
+                    }
+                    polygon.push_back( it->second );
+                }
+
+                for ( size_t i = 2; i < polygon.size(); i++ ) {
+                    mesh->Indices.insert( mesh->Indices.end(), { polygon[0], polygon[i - 1], polygon[i] } );
+                }
+            }
+        }
+        return true;
+    }
+
+    void CheckObj( const char* file, std::string filter ) {
+        std::transform( filter.begin(), filter.end(), filter.begin(), []( unsigned char c ) { return static_cast<char>(tolower( c )); } );
+
+        std::map<std::string, Mesh> meshes;
+        if ( !LoadObj( file, filter, meshes ) ) {
+            NumErrors++;
+            return;
+        }
+
+        if ( meshes.empty() ) {
+            printf( "%s: no material containing \"%s\"\n", file, filter.c_str() );
+        }
+
+        for ( auto& it : meshes ) {
+            std::vector<WaterBody> bodies;
+            auto start = std::chrono::high_resolution_clock::now();
+            const uint32_t numPlanar = BuildAndCheck( it.second, bodies );
+            const double time = Seconds( start );
+
+            uint32_t largest = 0;
+            for ( const WaterBody& body : bodies ) {
+                largest = std::max( largest, body.NumIndices / 3 );
+            }
+
+            printf( "%s: %zu triangles, %zu bodies (%u flat), largest %u triangles, %.2f ms\n", it.first.c_str(),
+                it.second.Indices.size() / 3, bodies.size(), numPlanar, largest, time * 1000.0 );
+        }
+    }
+}
+
+int main( int argc, char** argv ) {
+    CheckSection();
+    CheckMergeRanges();
+    CheckCoast();
+
+    if ( argc > 1 ) {
+        CheckObj( argv[1], argc > 2 ? argv[2] : "water" );
+    }
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}
@@ -0,0 +1,564 @@
+/** Checks the zip file system on archives built right here
+
+    Archives with stored, deflated and empty files, folders, a comment behind the central directory
+    and local headers with other extra-fields than the central ones are mounted and read back.
+    Later archives have to override earlier ones, also for files which already sit in the cache.
+    Encrypted entries, unsupported methods, entries pointing outside of the archive and ZIP64
+    archives are skipped. An archive whose central directory breaks halfway mustn't leave any of
+    its entries behind.
+
+    Deflated files with broken data or a wrong crc can't be read, the cache keeps the most recently
+    used files inside of its budget, and several threads reading the same files get the same data.
+    Batches read in parallel on a pool, also from a thread of that pool, have to come out with the
+    same bytes as the files read one by one.
+    Finally, archives are cut off at every length and get random bytes flipped, mounting and reading
+    them mustn't crash. Run with a sanitizer to catch reads outside of the buffers.
+
+    The inflater and the test archives come from zlib. */
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include "ThreadPool.h"
+#include "ZipFileSystem.h"
+
+namespace {
+    std::mt19937 Rng( 1 );
+    int NumErrors = 0;
+    volatile uint8_t Sink;
+
+    const uint16_t METHOD_STORED = 0;
+    const uint16_t METHOD_DEFLATED = 8;
+    const uint16_t METHOD_LZMA = 14;
+    const uint16_t FLAG_ENCRYPTED = 1;
+
+    void Check( bool condition, const char* what ) {
+        if ( !condition ) {
+            printf( "FAILED: %s\n", what );
+            NumErrors++;
+        }
+    }
+
+    bool ZlibInflate( const uint8_t* src, uint32_t srcSize, uint8_t* dst, uint32_t dstSize, uint32_t crc ) {
+        z_stream stream;
+        memset( &stream, 0, sizeof( stream ) );
+        if ( inflateInit2( &stream, -MAX_WBITS ) != Z_OK )
+            return false;
+
+        stream.next_in = const_cast<Bytef*>(src);
+        stream.avail_in = srcSize;
+        stream.next_out = dst;
+        stream.avail_out = dstSize;
+        int result = inflate( &stream, Z_FINISH );
+        uLong written = stream.total_out;
+        inflateEnd( &stream );
+
+        return result == Z_STREAM_END && written == dstSize && crc32( 0, dst, dstSize ) == crc;
+    }
+
+    std::vector<uint8_t> Deflate( const std::vector<uint8_t>& data ) {
+        z_stream stream;
+        memset( &stream, 0, sizeof( stream ) );
+        deflateInit2( &stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY );
+
+        std::vector<uint8_t> out( deflateBound( &stream, static_cast<uLong>(data.size()) ) );
+        stream.next_in = const_cast<Bytef*>(data.data());
+        stream.avail_in = static_cast<uInt>(data.size());
+        stream.next_out = out.data();
+        stream.avail_out = static_cast<uInt>(out.size());
+        deflate( &stream, Z_FINISH );
+        out.resize( stream.total_out );
+        deflateEnd( &stream );
+        return out;
+    }
+
+    /** Random data, some of it compressible like real files */
+    std::vector<uint8_t> RandomData( size_t size ) {
+        std::vector<uint8_t> d( size );
+        bool noise = Rng() % 2 == 0;
+        for ( size_t i = 0; i < size; i++ )
+            d[i] = static_cast<uint8_t>(noise ? Rng() : (i / (1 + Rng() % 8)) % 5);
+        return d;
+    }
+
+    struct TestEntry {
+        std::string Name;
+        std::vector<uint8_t> Data;
+        uint16_t Method = METHOD_DEFLATED;
+        uint16_t Flags = 0;
+
+        /** Breaks the entry in a certain way */
+        bool WrongCrc = false;
+        bool BrokenStream = false;
+        bool OffsetOutside = false;
+    };
+
+    void Put16( std::vector<uint8_t>& out, uint32_t v ) {
+        out.push_back( static_cast<uint8_t>(v) );
+        out.push_back( static_cast<uint8_t>(v >> 8) );
+    }
+
+    void Put32( std::vector<uint8_t>& out, uint32_t v ) {
+        Put16( out, v & 0xFFFF );
+        Put16( out, v >> 16 );
+    }
+
+    void PutString( std::vector<uint8_t>& out, const std::string& s ) {
+        out.insert( out.end(), s.begin(), s.end() );
+    }
+
+    struct ZipOptions {
+        std::string Comment;
+
+        /** Central header of this entry gets a broken signature */
+        int BreakDirectoryAt = -1;
+        bool Zip64 = false;
+    };
+
+    std::vector<uint8_t> BuildZip( const std::vector<TestEntry>& entries, const ZipOptions& options = ZipOptions() ) {
+        std::vector<uint8_t> zip;
+        std::vector<uint32_t> offsets;
+        std::vector<std::vector<uint8_t>> payloads;
+
+        for ( const TestEntry& e : entries ) {
+            std::vector<uint8_t> payload = e.Method == METHOD_DEFLATED ? Deflate( e.Data ) : e.Data;
+            if ( e.BrokenStream && !payload.empty() ) {
+                for ( size_t i = 0; i < payload.size(); i += 3 )
+                    payload[i] ^= 0x5A;
+            }
+
+            uint32_t crc = static_cast<uint32_t>(crc32( 0, e.Data.data(), static_cast<uInt>(e.Data.size()) ));
+            if ( e.WrongCrc )
+                crc ^= 1;
+
+            offsets.push_back( static_cast<uint32_t>(zip.size()) );
+
+            // The local header gets an extra-field the central one doesn't have
+            Put32( zip, 0x04034b50 );
+            Put16( zip, 20 );
+            Put16( zip, e.Flags );
+            Put16( zip, e.Method );
+            Put32( zip, 0 );
+            Put32( zip, crc );
+            Put32( zip, static_cast<uint32_t>(payload.size()) );
+            Put32( zip, static_cast<uint32_t>(e.Data.size()) );
+            Put16( zip, static_cast<uint32_t>(e.Name.size()) );
+            Put16( zip, 8 );
+            PutString( zip, e.Name );
+            Put16( zip, 0xCAFE );
+            Put16( zip, 4 );
+            Put32( zip, 0x12345678 );
+            zip.insert( zip.end(), payload.begin(), payload.end() );
+            payloads.push_back( std::move( payload ) );
+        }
+
+        uint32_t directoryOffset = static_cast<uint32_t>(zip.size());
+        for ( size_t i = 0; i < entries.size(); i++ ) {
+            const TestEntry& e = entries[i];
+            uint32_t crc = static_cast<uint32_t>(crc32( 0, e.Data.data(), static_cast<uInt>(e.Data.size()) ));
+            if ( e.WrongCrc )
+                crc ^= 1;
+
+            Put32( zip, static_cast<int>(i) == options.BreakDirectoryAt ? 0x02014b51 : 0x02014b50 );
+            Put16( zip, 20 );
+            Put16( zip, 20 );
+            Put16( zip, e.Flags );
+            Put16( zip, e.Method );
+            Put32( zip, 0 );
+            Put32( zip, crc );
+            Put32( zip, static_cast<uint32_t>(payloads[i].size()) );
+            Put32( zip, static_cast<uint32_t>(e.Data.size()) );
+            Put16( zip, static_cast<uint32_t>(e.Name.size()) );
+            Put16( zip, 0 );
+            Put16( zip, 0 );
+            Put16( zip, 0 );
+            Put16( zip, 0 );
+            Put32( zip, 0 );
+            Put32( zip, e.OffsetOutside ? 0x7FFFFFF0 : offsets[i] );
+            PutString( zip, e.Name );
+        }
+
+        uint32_t directorySize = static_cast<uint32_t>(zip.size()) - directoryOffset;
+        Put32( zip, 0x06054b50 );
+        Put16( zip, 0 );
+        Put16( zip, 0 );
+        Put16( zip, options.Zip64 ? 0xFFFF : static_cast<uint32_t>(entries.size()) );
+        Put16( zip, options.Zip64 ? 0xFFFF : static_cast<uint32_t>(entries.size()) );
+        Put32( zip, directorySize );
+        Put32( zip, options.Zip64 ? 0xFFFFFFFF : directoryOffset );
+        Put16( zip, static_cast<uint32_t>(options.Comment.size()) );
+        PutString( zip, options.Comment );
+        return zip;
+    }
+
+    std::string TempFile( const std::string& name ) {
+        return (std::filesystem::temp_directory_path() / ("ZipFileSystemTest_" + name)).string();
+    }
+
+    std::string WriteZip( const std::string& name, const std::vector<uint8_t>& zip ) {
+        std::string path = TempFile( name );
+        FILE* f = fopen( path.c_str(), "wb" );
+        if ( !zip.empty() )
+            fwrite( zip.data(), 1, zip.size(), f );
+        fclose( f );
+        return path;
+    }
+
+    bool ReadsAs( ZipFileSystem& fs, const std::string& path, const std::vector<uint8_t>& data ) {
+        ZipFile file = fs.ReadFile( path );
+        return file.IsValid() && file.Size == data.size() && (data.empty() || memcmp( file.Data, data.data(), data.size() ) == 0);
+    }
+
+    TestEntry MakeEntry( const std::string& name, size_t size, uint16_t method ) {
+        TestEntry e;
+        e.Name = name;
+        e.Data = RandomData( size );
+        e.Method = method;
+        return e;
+    }
+
+    void TestReading() {
+        std::vector<TestEntry> entries;
+        entries.push_back( MakeEntry( "system/GD3D11/textures/a.dds", 5000, METHOD_STORED ) );
+        entries.push_back( MakeEntry( "system/GD3D11/textures/b.dds", 70000, METHOD_DEFLATED ) );
+        entries.push_back( MakeEntry( "System/GD3D11/Meshes/Deep/c.bin", 1, METHOD_DEFLATED ) );
+        entries.push_back( MakeEntry( "empty_stored.txt", 0, METHOD_STORED ) );
+        entries.push_back( MakeEntry( "empty_deflated.txt", 0, METHOD_DEFLATED ) );
+        entries.push_back( MakeEntry( "system/GD3D11/folder/", 0, METHOD_STORED ) );
+
+        ZipOptions options;
+        options.Comment = "Signature in the comment: PK\x05\x06 and more";
+        std::string path = WriteZip( "reading.zip", BuildZip( entries, options ) );
+
+        ZipFileSystem fs( ZlibInflate );
+        Check( fs.Mount( path ), "archive with a comment mounts" );
+        Check( fs.GetNumFiles() == 5, "directories aren't counted as files" );
+
+        Check( ReadsAs( fs, "system\\GD3D11\\textures\\a.dds", entries[0].Data ), "stored file reads back" );
+        Check( ReadsAs( fs, "SYSTEM/gd3d11/TEXTURES/B.DDS", entries[1].Data ), "deflated file reads back, any case and slashes" );
+        Check( ReadsAs( fs, ".\\System\\GD3D11\\Meshes\\Deep\\c.bin", entries[2].Data ), "leading .\\ is ignored" );
+        Check( ReadsAs( fs, "empty_stored.txt", entries[3].Data ), "empty stored file reads back" );
+        Check( ReadsAs( fs, "empty_deflated.txt", entries[4].Data ), "empty deflated file reads back" );
+
+        // Stored files come straight out of the mapping
+        ZipFile stored = fs.ReadFile( "system\\GD3D11\\textures\\a.dds" );
+        Check( stored.IsValid() && !stored.Buffer, "stored file isn't copied" );
+
+        Check( fs.Exists( "system/gd3d11/textures/a.dds" ), "Exists finds the file" );
+        Check( !fs.Exists( "system/gd3d11/textures/missing.dds" ), "Exists doesn't find a missing file" );
+        Check( !fs.ReadFile( "missing" ).IsValid(), "missing file can't be read" );
+
+        Check( fs.FolderExists( "system\\GD3D11\\textures\\" ), "folder of files exists" );
+        Check( fs.FolderExists( "system/gd3d11/meshes/deep" ), "nested folder exists" );
+        Check( fs.FolderExists( "system" ), "top folder exists" );
+        Check( !fs.FolderExists( "system\\GD3D11\\folder" ), "folder without files doesn't exist" );
+        Check( !fs.FolderExists( "system\\GD3D11\\textures\\a.dds" ), "file isn't a folder" );
+
+        std::filesystem::remove( path );
+    }
+
+    void TestOverride() {
+        std::vector<TestEntry> first, second;
+        first.push_back( MakeEntry( "shared.bin", 3000, METHOD_DEFLATED ) );
+        first.push_back( MakeEntry( "first.bin", 300, METHOD_STORED ) );
+        second.push_back( MakeEntry( "SHARED.BIN", 4000, METHOD_STORED ) );
+        second.push_back( MakeEntry( "second.bin", 400, METHOD_DEFLATED ) );
+
+        std::string folder = TempFile( "folder" );
+        std::filesystem::create_directories( folder );
+        std::string firstPath = (std::filesystem::path( folder ) / "a.zip").string();
+        std::string secondPath = (std::filesystem::path( folder ) / "b.ZIP").string();
+        WriteZip( "folder/a.zip", BuildZip( first ) );
+        WriteZip( "folder/b.ZIP", BuildZip( second ) );
+        WriteZip( "folder/c.txt", BuildZip( first ) );
+
+        // The first one goes into the cache before the second one overrides it
+        ZipFileSystem fs( ZlibInflate );
+        Check( fs.Mount( firstPath ), "first archive mounts" );
+        Check( ReadsAs( fs, "shared.bin", first[0].Data ), "first archive is read" );
+        Check( fs.Mount( secondPath ), "second archive mounts" );
+        Check( ReadsAs( fs, "shared.bin", second[0].Data ), "later archive overrides, also for cached files" );
+        Check( ReadsAs( fs, "first.bin", first[1].Data ) && ReadsAs( fs, "second.bin", second[1].Data ), "files of both archives are there" );
+
+        ZipFileSystem folderFs( ZlibInflate );
+        Check( folderFs.MountFolder( folder ) == 2, "MountFolder mounts all zips, any case" );
+        Check( ReadsAs( folderFs, "shared.bin", second[0].Data ), "MountFolder mounts in alphabetical order" );
+        Check( folderFs.MountFolder( TempFile( "missing" ) ) == 0, "missing folder mounts nothing" );
+
+        std::filesystem::remove_all( folder );
+    }
+
+    void TestBrokenArchives() {
+        std::vector<TestEntry> entries;
+        entries.push_back( MakeEntry( "good.bin", 1000, METHOD_DEFLATED ) );
+        entries.push_back( MakeEntry( "encrypted.bin", 100, METHOD_STORED ) );
+        entries.back().Flags = FLAG_ENCRYPTED;
+        entries.push_back( MakeEntry( "lzma.bin", 100, METHOD_STORED ) );
+        entries.back().Method = METHOD_LZMA;
+        entries.push_back( MakeEntry( "outside.bin", 100, METHOD_DEFLATED ) );
+        entries.back().OffsetOutside = true;
+        entries.push_back( MakeEntry( "crc.bin", 1000, METHOD_DEFLATED ) );
+        entries.back().WrongCrc = true;
+        entries.push_back( MakeEntry( "stream.bin", 20000, METHOD_DEFLATED ) );
+        entries.back().BrokenStream = true;
+
+        std::string path = WriteZip( "broken_entries.zip", BuildZip( entries ) );
+        ZipFileSystem fs( ZlibInflate );
+        Check( fs.Mount( path ), "archive with broken entries mounts" );
+        Check( ReadsAs( fs, "good.bin", entries[0].Data ), "good entry next to broken ones reads back" );
+        Check( !fs.Exists( "encrypted.bin" ), "encrypted entry is skipped" );
+        Check( !fs.Exists( "lzma.bin" ), "unsupported method is skipped" );
+        Check( !fs.Exists( "outside.bin" ), "entry outside of the archive is skipped" );
+        Check( fs.Exists( "crc.bin" ) && !fs.ReadFile( "crc.bin" ).IsValid(), "wrong crc can't be read" );
+        Check( fs.Exists( "stream.bin" ) && !fs.ReadFile( "stream.bin" ).IsValid(), "broken deflate-stream can't be read" );
+        Check( fs.GetMountLog().size() == 4, "skipped entries and the mount are logged" );
+        std::filesystem::remove( path );
+
+        // A directory breaking halfway takes the whole archive out
+        std::vector<TestEntry> halfway;
+        halfway.push_back( MakeEntry( "halfway_a.bin", 100, METHOD_STORED ) );
+        halfway.push_back( MakeEntry( "halfway_b.bin", 100, METHOD_STORED ) );
+        halfway.push_back( MakeEntry( "halfway_c.bin", 100, METHOD_STORED ) );
+        ZipOptions options;
+        options.BreakDirectoryAt = 2;
+        path = WriteZip( "halfway.zip", BuildZip( halfway, options ) );
+        Check( !fs.Mount( path ), "broken central directory doesn't mount" );
+        Check( !fs.Exists( "halfway_a.bin" ) && !fs.FolderExists( "halfway_a.bin" ), "nothing of a broken directory is left behind" );
+        Check( ReadsAs( fs, "good.bin", entries[0].Data ), "earlier archive still reads after a failed mount" );
+        std::filesystem::remove( path );
+
+        ZipOptions zip64;
+        zip64.Zip64 = true;
+        path = WriteZip( "zip64.zip", BuildZip( halfway, zip64 ) );
+        Check( !fs.Mount( path ), "ZIP64 doesn't mount" );
+        std::filesystem::remove( path );
+
+        path = WriteZip( "empty.zip", std::vector<uint8_t>() );
+        Check( !fs.Mount( path ), "empty file doesn't mount" );
+        std::filesystem::remove( path );
+
+        path = WriteZip( "text.zip", std::vector<uint8_t>( 100, 'x' ) );
+        Check( !fs.Mount( path ), "file without end of directory doesn't mount" );
+        std::filesystem::remove( path );
+
+        Check( !fs.Mount( TempFile( "missing.zip" ) ), "missing file doesn't mount" );
+    }
+
+    void TestCache() {
+        std::vector<TestEntry> entries;
+        for ( int i = 0; i < 8; i++ )
+            entries.push_back( MakeEntry( "small" + std::to_string( i ), 10000, METHOD_DEFLATED ) );
+        entries.push_back( MakeEntry( "large", 20000, METHOD_DEFLATED ) );
+
+        std::string path = WriteZip( "cache.zip", BuildZip( entries ) );
+        ZipFileSystem fs( ZlibInflate, 50000 );
+        Check( fs.Mount( path ), "cache archive mounts" );
+
+        ZipFile a = fs.ReadFile( "small0" );
+        ZipFile b = fs.ReadFile( "small0" );
+        Check( a.IsValid() && a.Buffer == b.Buffer, "second read comes out of the cache" );
+
+        // More than a quarter of the budget is never cached
+        ZipFile large = fs.ReadFile( "large" );
+        Check( large.IsValid() && large.Buffer != fs.ReadFile( "large" ).Buffer, "large file isn't cached" );
+
+        // small0 stays the most recently used one while the others push each other out
+        ZipFile firstSmall1;
+        for ( int i = 1; i < 8; i++ ) {
+            ZipFile file = fs.ReadFile( "small" + std::to_string( i ) );
+            if ( i == 1 )
+                firstSmall1 = file;
+
+            Check( fs.ReadFile( "small0" ).Buffer == a.Buffer, "recently used file stays in the cache" );
+        }
+
+        // small1 was pushed out by the ones after it
+        ZipFile evicted = fs.ReadFile( "small1" );
+        Check( evicted.IsValid() && evicted.Buffer != firstSmall1.Buffer, "least recently used file is evicted" );
+        Check( ReadsAs( fs, "small1", entries[1].Data ), "evicted file reads back" );
+
+        // Files handed out stay valid after the cache dropped them
+        fs.ClearCache();
+        Check( a.Size == entries[0].Data.size() && memcmp( a.Data, entries[0].Data.data(), a.Size ) == 0, "handed out file survives ClearCache" );
+
+        std::filesystem::remove( path );
+    }
+
+    void TestThreads() {
+        std::vector<TestEntry> entries;
+        for ( int i = 0; i < 16; i++ )
+            entries.push_back( MakeEntry( "file" + std::to_string( i ), 20000 + i * 100, i % 4 ? METHOD_DEFLATED : METHOD_STORED ) );
+
+        std::string path = WriteZip( "threads.zip", BuildZip( entries ) );
+        ZipFileSystem fs( ZlibInflate, 150000 );
+        Check( fs.Mount( path ), "thread archive mounts" );
+
+        std::vector<int> errors( 4, 0 );
+        std::vector<std::thread> threads;
+        for ( int t = 0; t < 4; t++ ) {
+            threads.emplace_back( [&, t]() {
+                for ( int i = 0; i < 400; i++ ) {
+                    int f = (i * 7 + t * 3) % 16;
+                    if ( !ReadsAs( fs, "file" + std::to_string( f ), entries[f].Data ) )
+                        errors[t]++;
+                }
+            } );
+        }
+
+        for ( std::thread& t : threads )
+            t.join();
+
+        Check( errors[0] + errors[1] + errors[2] + errors[3] == 0, "threads reading at once get the right data" );
+        std::filesystem::remove( path );
+    }
+
+    bool SameFile( const ZipFile& a, const ZipFile& b ) {
+        if ( a.IsValid() != b.IsValid() )
+            return false;
+
+        return !a.IsValid() || (a.Size == b.Size && (a.Size == 0 || memcmp( a.Data, b.Data, a.Size ) == 0));
+    }
+
+    void TestParallelReads() {
+        std::vector<TestEntry> entries;
+        for ( int i = 0; i < 48; i++ ) {
+            uint16_t method = i % 5 ? METHOD_DEFLATED : METHOD_STORED;
+            entries.push_back( MakeEntry( "batch/file" + std::to_string( i ), i % 7 ? 1000 + Rng() % 60000 : 0, method ) );
+        }
+
+        entries[3].WrongCrc = true;
+        entries[8].BrokenStream = true;
+        std::string path = WriteZip( "parallel.zip", BuildZip( entries ) );
+
+        // Paths in random order, some twice, with a few missing ones in between
+        std::vector<std::string> paths;
+        for ( int i = 0; i < 200; i++ ) {
+            int f = static_cast<int>(Rng() % (entries.size() + 4));
+            paths.push_back( f < static_cast<int>(entries.size()) ? entries[f].Name : "batch/missing" + std::to_string( f ) );
+        }
+
+        ZipFileSystem serialFs( ZlibInflate );
+        Check( serialFs.Mount( path ), "batch archive mounts" );
+
+        std::vector<ZipFile> serial;
+        for ( const std::string& p : paths )
+            serial.push_back( serialFs.ReadFile( p ) );
+
+        // Otherwise comparing would prove nothing
+        size_t numValid = 0;
+        for ( const ZipFile& file : serial )
+            numValid += file.IsValid() ? 1 : 0;
+        Check( numValid > paths.size() / 2 && numValid < paths.size(), "batch has readable and unreadable files" );
+
+        ThreadPool pool( 4 );
+        for ( size_t budget : { ZipFileSystem::DEFAULT_CACHE_BUDGET, static_cast<size_t>(100000) } ) {
+            ZipFileSystem fs( ZlibInflate, budget );
+            Check( fs.Mount( path ), "batch archive mounts on a pool" );
+
+            int mismatches = 0;
+            for ( int round = 0; round < 3; round++ ) {
+                std::vector<ZipFile> parallel = fs.ReadFiles( paths, &pool );
+                if ( parallel.size() != paths.size() ) {
+                    mismatches++;
+                    continue;
+                }
+
+                for ( size_t i = 0; i < paths.size(); i++ ) {
+                    if ( !SameFile( parallel[i], serial[i] ) )
+                        mismatches++;
+                }
+            }
+
+            Check( mismatches == 0, "parallel batches read the same bytes as serial reads" );
+
+            // A thread of the pool reading a batch mustn't wait on the other, busy ones
+            std::vector<std::future<std::vector<ZipFile>>> nested;
+            for ( size_t t = 0; t < pool.getNumThreads(); t++ )
+                nested.push_back( pool.enqueue( [&]() { return fs.ReadFiles( paths, &pool ); } ) );
+
+            mismatches = 0;
+            for ( auto& n : nested ) {
+                std::vector<ZipFile> parallel = n.get();
+                for ( size_t i = 0; i < paths.size(); i++ ) {
+                    if ( !SameFile( parallel[i], serial[i] ) )
+                        mismatches++;
+                }
+            }
+
+            Check( mismatches == 0, "batches read from the pool itself read the same bytes" );
+        }
+
+        Check( serialFs.ReadFiles( {}, &pool ).empty(), "empty batch reads nothing" );
+
+        // Without a pool everything is read on the calling thread
+        std::vector<ZipFile> withoutPool = serialFs.ReadFiles( paths, nullptr );
+        int mismatches = 0;
+        for ( size_t i = 0; i < paths.size(); i++ ) {
+            if ( !SameFile( withoutPool[i], serial[i] ) )
+                mismatches++;
+        }
+        Check( mismatches == 0, "batches without a pool read the same bytes" );
+        std::filesystem::remove( path );
+    }
+
+    void TestCorruption() {
+        std::vector<TestEntry> entries;
+        entries.push_back( MakeEntry( "a/one.bin", 300, METHOD_DEFLATED ) );
+        entries.push_back( MakeEntry( "a/two.bin", 200, METHOD_STORED ) );
+        entries.push_back( MakeEntry( "b/three.bin", 500, METHOD_DEFLATED ) );
+        ZipOptions options;
+        options.Comment = "comment";
+        std::vector<uint8_t> zip = BuildZip( entries, options );
+        std::string path = TempFile( "corrupt.zip" );
+
+        auto mountAndRead = [&]( const std::vector<uint8_t>& data ) {
+            WriteZip( "corrupt.zip", data );
+            ZipFileSystem fs( ZlibInflate );
+            if ( !fs.Mount( path ) )
+                return;
+
+            for ( const TestEntry& e : entries ) {
+                ZipFile file = fs.ReadFile( e.Name );
+                if ( file.IsValid() && file.Size > 0 ) {
+                    // Touch everything that was handed out
+                    uint8_t sum = 0;
+                    for ( uint32_t i = 0; i < file.Size; i++ )
+                        sum = static_cast<uint8_t>(sum + file.Data[i]);
+                    Sink = sum;
+                }
+            }
+        };
+
+        for ( size_t length = 0; length < zip.size(); length++ ) {
+            mountAndRead( std::vector<uint8_t>( zip.begin(), zip.begin() + length ) );
+        }
+
+        for ( int i = 0; i < 3000; i++ ) {
+            std::vector<uint8_t> broken = zip;
+            int flips = 1 + static_cast<int>(Rng() % 4);
+            for ( int f = 0; f < flips; f++ )
+                broken[Rng() % broken.size()] = static_cast<uint8_t>(Rng());
+            mountAndRead( broken );
+        }
+
+        std::filesystem::remove( path );
+    }
+}
+
+int main() {
+    TestReading();
+    TestOverride();
+    TestBrokenArchives();
+    TestCache();
+    TestThreads();
+    TestParallelReads();
+    TestCorruption();
+
+    printf( NumErrors ? "%d errors\n" : "OK\n", NumErrors );
+    return NumErrors ? 1 : 0;
+}